@@ -55,6 +55,225 @@
 
 #include "CommonServices.h"
 #include "DebugServices.h"
+#include "TickUtils.h"
+
+//===========================================================================================================================
+//	Hardware
+//
+//	CTR and CBC use AES instructions when the CPU has them. They're much faster than the table-driven software code and 
+//	they run in constant time. CTR and CBC decryption encrypt/decrypt 4 independent blocks at a time so the latency of 
+//	each round instruction is hidden behind the others (important for in-order cores). CBC encryption can only do one 
+//	block at a time because each block depends on the previous one. The choice is made at runtime the first time a 
+//	context is initialized so the same binary runs on CPUs with and without AES instructions.
+//===========================================================================================================================
+
+#if( AES_UTILS_HAS_HARDWARE )
+	#if( defined( __x86_64__ ) || defined( __i386__ ) )
+		#include <cpuid.h>
+		#include <immintrin.h>
+		
+		#define AES_HARDWARE_TARGET		__attribute__( ( target( "aes,ssse3" ) ) )
+		
+		typedef __m128i		aes_block_t;
+		
+		#define AES_HW_LOAD( PTR )			_mm_loadu_si128( (const __m128i *)(PTR) )
+		#define AES_HW_STORE( PTR, B )		_mm_storeu_si128( (__m128i *)(PTR), (B) )
+		#define AES_HW_XOR( A, B )			_mm_xor_si128( (A), (B) )
+		#define AES_HW_INV_MIX( B )			_mm_aesimc_si128( (B) )
+		#define AES_HW_SUB_WORD( X ) \
+			( (uint32_t) _mm_cvtsi128_si32( _mm_aesenclast_si128( _mm_set1_epi32( (int)(X) ), _mm_setzero_si128() ) ) )
+		#define AES_HW_COUNTER( HI, LO ) \
+			_mm_shuffle_epi8( _mm_set_epi64x( (int64_t)(LO), (int64_t)(HI) ), \
+				_mm_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7 ) )
+		
+		#define AES_HW_ENCRYPT( B, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				(B) = _mm_xor_si128( (B), (K)[ 0 ] ); \
+				for( r_ = 1; r_ < 10; ++r_ ) (B) = _mm_aesenc_si128( (B), (K)[ r_ ] ); \
+				(B) = _mm_aesenclast_si128( (B), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_ENCRYPT4( B0, B1, B2, B3, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				(B0) = _mm_xor_si128( (B0), (K)[ 0 ] ); \
+				(B1) = _mm_xor_si128( (B1), (K)[ 0 ] ); \
+				(B2) = _mm_xor_si128( (B2), (K)[ 0 ] ); \
+				(B3) = _mm_xor_si128( (B3), (K)[ 0 ] ); \
+				for( r_ = 1; r_ < 10; ++r_ ) \
+				{ \
+					(B0) = _mm_aesenc_si128( (B0), (K)[ r_ ] ); \
+					(B1) = _mm_aesenc_si128( (B1), (K)[ r_ ] ); \
+					(B2) = _mm_aesenc_si128( (B2), (K)[ r_ ] ); \
+					(B3) = _mm_aesenc_si128( (B3), (K)[ r_ ] ); \
+				} \
+				(B0) = _mm_aesenclast_si128( (B0), (K)[ 10 ] ); \
+				(B1) = _mm_aesenclast_si128( (B1), (K)[ 10 ] ); \
+				(B2) = _mm_aesenclast_si128( (B2), (K)[ 10 ] ); \
+				(B3) = _mm_aesenclast_si128( (B3), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_DECRYPT( B, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				(B) = _mm_xor_si128( (B), (K)[ 0 ] ); \
+				for( r_ = 1; r_ < 10; ++r_ ) (B) = _mm_aesdec_si128( (B), (K)[ r_ ] ); \
+				(B) = _mm_aesdeclast_si128( (B), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_DECRYPT4( B0, B1, B2, B3, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				(B0) = _mm_xor_si128( (B0), (K)[ 0 ] ); \
+				(B1) = _mm_xor_si128( (B1), (K)[ 0 ] ); \
+				(B2) = _mm_xor_si128( (B2), (K)[ 0 ] ); \
+				(B3) = _mm_xor_si128( (B3), (K)[ 0 ] ); \
+				for( r_ = 1; r_ < 10; ++r_ ) \
+				{ \
+					(B0) = _mm_aesdec_si128( (B0), (K)[ r_ ] ); \
+					(B1) = _mm_aesdec_si128( (B1), (K)[ r_ ] ); \
+					(B2) = _mm_aesdec_si128( (B2), (K)[ r_ ] ); \
+					(B3) = _mm_aesdec_si128( (B3), (K)[ r_ ] ); \
+				} \
+				(B0) = _mm_aesdeclast_si128( (B0), (K)[ 10 ] ); \
+				(B1) = _mm_aesdeclast_si128( (B1), (K)[ 10 ] ); \
+				(B2) = _mm_aesdeclast_si128( (B2), (K)[ 10 ] ); \
+				(B3) = _mm_aesdeclast_si128( (B3), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+	#else
+		#include <arm_neon.h>
+		#if( TARGET_OS_LINUX )
+			#include <sys/auxv.h>
+			
+			#if( !defined( HWCAP_AES ) )
+				#define HWCAP_AES		( 1 << 3 )
+			#endif
+		#endif
+		
+		#if( defined( __ARM_FEATURE_CRYPTO ) || defined( __ARM_FEATURE_AES ) )
+			#define AES_HARDWARE_TARGET
+		#else
+			#define AES_HARDWARE_TARGET		__attribute__( ( target( "+crypto" ) ) )
+		#endif
+		
+		typedef uint8x16_t		aes_block_t;
+		
+		// ARM applies the round key at the start of each round (AESE/AESD) instead of the end like x86 so the last 
+		// round key is XOR'd separately. The round keys are the same for both.
+		
+		#define AES_HW_LOAD( PTR )			vld1q_u8( (const uint8_t *)(PTR) )
+		#define AES_HW_STORE( PTR, B )		vst1q_u8( (uint8_t *)(PTR), (B) )
+		#define AES_HW_XOR( A, B )			veorq_u8( (A), (B) )
+		#define AES_HW_INV_MIX( B )			vaesimcq_u8( (B) )
+		#define AES_HW_SUB_WORD( X ) \
+			vgetq_lane_u32( vreinterpretq_u32_u8( vaeseq_u8( vreinterpretq_u8_u32( vdupq_n_u32( (X) ) ), vdupq_n_u8( 0 ) ) ), 0 )
+		#define AES_HW_COUNTER( HI, LO ) \
+			vrev64q_u8( vreinterpretq_u8_u64( vcombine_u64( vcreate_u64( (HI) ), vcreate_u64( (LO) ) ) ) )
+		
+		#define AES_HW_ENCRYPT( B, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				for( r_ = 0; r_ < 9; ++r_ ) (B) = vaesmcq_u8( vaeseq_u8( (B), (K)[ r_ ] ) ); \
+				(B) = veorq_u8( vaeseq_u8( (B), (K)[ 9 ] ), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_ENCRYPT4( B0, B1, B2, B3, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				for( r_ = 0; r_ < 9; ++r_ ) \
+				{ \
+					(B0) = vaesmcq_u8( vaeseq_u8( (B0), (K)[ r_ ] ) ); \
+					(B1) = vaesmcq_u8( vaeseq_u8( (B1), (K)[ r_ ] ) ); \
+					(B2) = vaesmcq_u8( vaeseq_u8( (B2), (K)[ r_ ] ) ); \
+					(B3) = vaesmcq_u8( vaeseq_u8( (B3), (K)[ r_ ] ) ); \
+				} \
+				(B0) = veorq_u8( vaeseq_u8( (B0), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B1) = veorq_u8( vaeseq_u8( (B1), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B2) = veorq_u8( vaeseq_u8( (B2), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B3) = veorq_u8( vaeseq_u8( (B3), (K)[ 9 ] ), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_DECRYPT( B, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				for( r_ = 0; r_ < 9; ++r_ ) (B) = vaesimcq_u8( vaesdq_u8( (B), (K)[ r_ ] ) ); \
+				(B) = veorq_u8( vaesdq_u8( (B), (K)[ 9 ] ), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+		
+		#define AES_HW_DECRYPT4( B0, B1, B2, B3, K ) \
+			do \
+			{ \
+				int		r_; \
+				\
+				for( r_ = 0; r_ < 9; ++r_ ) \
+				{ \
+					(B0) = vaesimcq_u8( vaesdq_u8( (B0), (K)[ r_ ] ) ); \
+					(B1) = vaesimcq_u8( vaesdq_u8( (B1), (K)[ r_ ] ) ); \
+					(B2) = vaesimcq_u8( vaesdq_u8( (B2), (K)[ r_ ] ) ); \
+					(B3) = vaesimcq_u8( vaesdq_u8( (B3), (K)[ r_ ] ) ); \
+				} \
+				(B0) = veorq_u8( vaesdq_u8( (B0), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B1) = veorq_u8( vaesdq_u8( (B1), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B2) = veorq_u8( vaesdq_u8( (B2), (K)[ 9 ] ), (K)[ 10 ] ); \
+				(B3) = veorq_u8( vaesdq_u8( (B3), (K)[ 9 ] ), (K)[ 10 ] ); \
+				\
+			}	while( 0 )
+	#endif
+
+typedef enum
+{
+	kAESImpl_Unknown	= 0, // Not selected yet.
+	kAESImpl_Software	= 1, // Library selected by the AES_UTILS_USE_* options.
+	kAESImpl_Hardware	= 2  // AES instructions.
+	
+}	AESImpl;
+
+static AESImpl		gAESImpl = kAESImpl_Unknown;
+
+static Boolean	_AES_UseHardware( void );
+static Boolean	_AES_HardwareSupported( void );
+AES_HARDWARE_TARGET
+static void		_AES_ExpandKeyHardware( const uint8_t inKey[ 16 ], Boolean inEncrypt, uint8_t outKeys[ 11 ][ 16 ] );
+AES_HARDWARE_TARGET
+static void
+	_AES_CTR_Hardware( 
+		const uint8_t *	inKeys, 
+		uint8_t			ioCtr[ 16 ], 
+		const uint8_t *	inSrc, 
+		size_t			inLen, 
+		uint8_t *		inDst );
+AES_HARDWARE_TARGET
+static void
+	_AES_CBC_Hardware( 
+		const uint8_t *	inKeys, 
+		Boolean			inEncrypt, 
+		uint8_t			ioIV[ 16 ], 
+		const uint8_t *	inSrc, 
+		size_t			inLen, 
+		uint8_t *		inDst );
+#endif
 
 
 #if( !AES_UTILS_USE_COMMON_CRYPTO && !AES_UTILS_USE_GLADMAN_AES && !AES_UTILS_USE_WICED && !AES_UTILS_USE_WINDOWS_API && \
@@ -108,6 +327,10 @@ OSStatus
 	if( err ) return( err );
 #else
 	AES_set_encrypt_key( inKey, kAES_CTR_Size * 8, &inContext->key );
+#endif
+#if( AES_UTILS_HAS_HARDWARE )
+	inContext->hardware = _AES_UseHardware();
+	if( inContext->hardware ) _AES_ExpandKeyHardware( inKey, true, inContext->hwKeys );
 #endif
 	memcpy( inContext->ctr, inNonce, kAES_CTR_Size );
 	inContext->used = 0;
@@ -148,6 +371,32 @@ OSStatus	AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_t i
 	}
 	inContext->used = used;
 	
+#if( AES_UTILS_HAS_HARDWARE )
+	if( inContext->hardware )
+	{
+		size_t		len;
+		
+		// Process whole blocks then make key material for any trailing bytes by encrypting a block of zeros.
+		
+		len = inLen & ~( (size_t)( kAES_CTR_Size - 1 ) );
+		_AES_CTR_Hardware( inContext->hwKeys[ 0 ], inContext->ctr, src, len, dst );
+		src   += len;
+		dst   += len;
+		inLen -= len;
+		if( inLen > 0 )
+		{
+			memset( buf, 0, kAES_CTR_Size );
+			_AES_CTR_Hardware( inContext->hwKeys[ 0 ], inContext->ctr, buf, kAES_CTR_Size, buf );
+			for( i = 0; i < inLen; ++i )
+			{
+				*dst++ = *src++ ^ buf[ used++ ];
+			}
+			inContext->used = used;
+		}
+		return( kNoErr );
+	}
+#endif
+	
 	// Process whole blocks.
 	
 	while( inLen >= kAES_CTR_Size )
@@ -282,6 +531,11 @@ OSStatus
 	if( inEncrypt ) AES_set_encrypt_key( inKey, kAES_CBCFrame_Size * 8, &inContext->key );
 	else			AES_set_decrypt_key( inKey, kAES_CBCFrame_Size * 8, &inContext->key );
 	inContext->mode = inEncrypt ? AES_ENCRYPT : AES_DECRYPT;
+#endif
+#if( AES_UTILS_HAS_HARDWARE )
+	inContext->hardware  = _AES_UseHardware();
+	inContext->hwEncrypt = inEncrypt;
+	if( inContext->hardware ) _AES_ExpandKeyHardware( inKey, inEncrypt, inContext->hwKeys );
 #endif
 	memcpy( inContext->iv, inIV, kAES_CBCFrame_Size );
 	return( kNoErr );
@@ -306,6 +560,18 @@ OSStatus	AES_CBCFrame_Update( AES_CBCFrame_Context *inContext, const void *inSrc
 	// Process whole blocks.
 	
 	len = inSrcLen & ~( (size_t)( kAES_CBCFrame_Size - 1 ) );
+#if( AES_UTILS_HAS_HARDWARE )
+	if( ( len > 0 ) && inContext->hardware )
+	{
+		uint8_t		iv[ kAES_CBCFrame_Size ];
+		
+		memcpy( iv, inContext->iv, kAES_CBCFrame_Size ); // Use local copy so original IV is not changed.
+		_AES_CBC_Hardware( inContext->hwKeys[ 0 ], inContext->hwEncrypt, iv, src, len, dst );
+		src += len;
+		dst += len;
+	}
+	else
+#endif
 	if( len > 0 )
 	{
 		#if( AES_UTILS_USE_COMMON_CRYPTO )
@@ -410,6 +676,10 @@ OSStatus
 	len = inLen1 & ~( (size_t)( kAES_CBCFrame_Size - 1 ) );
 	if( len > 0 )
 	{
+		#if( AES_UTILS_HAS_HARDWARE )
+		if( inContext->hardware ) _AES_CBC_Hardware( inContext->hwKeys[ 0 ], inContext->hwEncrypt, iv, src1, len, dst );
+		else
+		#endif
 		#if( AES_UTILS_USE_COMMON_CRYPTO )
 			err = CCCryptorUpdate( inContext->cryptor, src1, len, dst, len, &len );
 			require_noerr( err, exit );
@@ -451,6 +721,10 @@ OSStatus
 		{
 			buf[ i ] = *src2++;
 		}
+		#if( AES_UTILS_HAS_HARDWARE )
+		if( inContext->hardware ) _AES_CBC_Hardware( inContext->hwKeys[ 0 ], inContext->hwEncrypt, iv, buf, i, dst );
+		else
+		#endif
 		#if( AES_UTILS_USE_COMMON_CRYPTO )
 			err = CCCryptorUpdate( inContext->cryptor, buf, i, dst, i, &i );
 			require_noerr( err, exit );
@@ -483,6 +757,10 @@ OSStatus
 	len = ( (size_t)( end2 - src2 ) ) & ~( (size_t)( kAES_CBCFrame_Size - 1 ) );
 	if( len > 0 )
 	{
+		#if( AES_UTILS_HAS_HARDWARE )
+		if( inContext->hardware ) _AES_CBC_Hardware( inContext->hwKeys[ 0 ], inContext->hwEncrypt, iv, src2, len, dst );
+		else
+		#endif
 		#if( AES_UTILS_USE_COMMON_CRYPTO )
 			err = CCCryptorUpdate( inContext->cryptor, src2, len, dst, len, &len );
 			require_noerr( err, exit );
@@ -1432,6 +1710,214 @@ exit:
 #pragma mark -
 #endif
 
+#if( AES_UTILS_HAS_HARDWARE )
+//===========================================================================================================================
+//	_AES_UseHardware
+//===========================================================================================================================
+
+static Boolean	_AES_UseHardware( void )
+{
+	AESImpl		impl;
+	
+	impl = gAESImpl;
+	if( impl == kAESImpl_Unknown )
+	{
+		impl = _AES_HardwareSupported() ? kAESImpl_Hardware : kAESImpl_Software;
+		gAESImpl = impl;
+	}
+	return( (Boolean)( impl == kAESImpl_Hardware ) );
+}
+
+//===========================================================================================================================
+//	_AES_HardwareSupported
+//===========================================================================================================================
+
+static Boolean	_AES_HardwareSupported( void )
+{
+#if( defined( __x86_64__ ) || defined( __i386__ ) )
+	unsigned int		eax, ebx, ecx, edx;
+	
+	if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) ) return( false );
+	return( (Boolean)( ( ecx & bit_AES ) && ( ecx & bit_SSSE3 ) ) );
+#elif( defined( __ARM_FEATURE_CRYPTO ) || defined( __ARM_FEATURE_AES ) )
+	return( true );
+#elif( TARGET_OS_LINUX )
+	return( (Boolean)( ( getauxval( AT_HWCAP ) & HWCAP_AES ) != 0 ) );
+#else
+	return( false );
+#endif
+}
+
+//===========================================================================================================================
+//	_AES_ExpandKeyHardware
+//
+//	Expands an AES-128 key into round keys. Decryption uses the "equivalent inverse cipher" from FIPS-197 section 5.3.5, 
+//	which needs the round keys in reverse order with InvMixColumns applied to all but the first and last.
+//===========================================================================================================================
+
+AES_HARDWARE_TARGET
+static void	_AES_ExpandKeyHardware( const uint8_t inKey[ 16 ], Boolean inEncrypt, uint8_t outKeys[ 11 ][ 16 ] )
+{
+	static const uint8_t		kRcon[ 10 ] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+	uint32_t					w[ 44 ];
+	uint32_t					t;
+	int							i;
+	
+	// Words are little endian so the first byte of the word is in the low bits. This makes RotWord a right rotate.
+	
+	for( i = 0; i < 4; ++i ) w[ i ] = ReadLittle32( &inKey[ i * 4 ] );
+	for( i = 4; i < 44; ++i )
+	{
+		t = w[ i - 1 ];
+		if( ( i % 4 ) == 0 ) t = ROTR32( AES_HW_SUB_WORD( t ), 8 ) ^ kRcon[ ( i / 4 ) - 1 ];
+		w[ i ] = w[ i - 4 ] ^ t;
+	}
+	if( inEncrypt )
+	{
+		for( i = 0; i < 44; ++i ) WriteLittle32( &outKeys[ i / 4 ][ ( i % 4 ) * 4 ], w[ i ] );
+	}
+	else
+	{
+		for( i = 0; i < 44; ++i ) WriteLittle32( &outKeys[ 10 - ( i / 4 ) ][ ( i % 4 ) * 4 ], w[ i ] );
+		for( i = 1; i < 10; ++i ) AES_HW_STORE( outKeys[ i ], AES_HW_INV_MIX( AES_HW_LOAD( outKeys[ i ] ) ) );
+	}
+	MemZeroSecure( w, sizeof( w ) );
+}
+
+//===========================================================================================================================
+//	_AES_CTR_Hardware
+//
+//	Encrypts or decrypts whole blocks and advances the counter. inKeys is the 11 round keys from _AES_ExpandKeyHardware.
+//	inSrc and inDst may be the same.
+//===========================================================================================================================
+
+AES_HARDWARE_TARGET
+static void
+	_AES_CTR_Hardware( 
+		const uint8_t *	inKeys, 
+		uint8_t			ioCtr[ 16 ], 
+		const uint8_t *	inSrc, 
+		size_t			inLen, 
+		uint8_t *		inDst )
+{
+	aes_block_t		k[ 11 ];
+	aes_block_t		b0, b1, b2, b3;
+	uint64_t		hi, lo;
+	int				i;
+	
+	for( i = 0; i < 11; ++i ) k[ i ] = AES_HW_LOAD( &inKeys[ i * 16 ] );
+	
+	// The counter is a 128-bit big endian number so carry into the high half when the low half wraps.
+	
+	hi = ReadBig64( &ioCtr[ 0 ] );
+	lo = ReadBig64( &ioCtr[ 8 ] );
+	#define AES_HW_NEXT_COUNTER( B )	do { (B) = AES_HW_COUNTER( hi, lo ); if( ++lo == 0 ) ++hi; } while( 0 )
+	
+	for( ; inLen >= ( 4 * 16 ); inLen -= ( 4 * 16 ) )
+	{
+		AES_HW_NEXT_COUNTER( b0 );
+		AES_HW_NEXT_COUNTER( b1 );
+		AES_HW_NEXT_COUNTER( b2 );
+		AES_HW_NEXT_COUNTER( b3 );
+		AES_HW_ENCRYPT4( b0, b1, b2, b3, k );
+		AES_HW_STORE( &inDst[  0 ], AES_HW_XOR( b0, AES_HW_LOAD( &inSrc[  0 ] ) ) );
+		AES_HW_STORE( &inDst[ 16 ], AES_HW_XOR( b1, AES_HW_LOAD( &inSrc[ 16 ] ) ) );
+		AES_HW_STORE( &inDst[ 32 ], AES_HW_XOR( b2, AES_HW_LOAD( &inSrc[ 32 ] ) ) );
+		AES_HW_STORE( &inDst[ 48 ], AES_HW_XOR( b3, AES_HW_LOAD( &inSrc[ 48 ] ) ) );
+		inSrc += ( 4 * 16 );
+		inDst += ( 4 * 16 );
+	}
+	for( ; inLen >= 16; inLen -= 16 )
+	{
+		AES_HW_NEXT_COUNTER( b0 );
+		AES_HW_ENCRYPT( b0, k );
+		AES_HW_STORE( inDst, AES_HW_XOR( b0, AES_HW_LOAD( inSrc ) ) );
+		inSrc += 16;
+		inDst += 16;
+	}
+	#undef AES_HW_NEXT_COUNTER
+	
+	WriteBig64( &ioCtr[ 0 ], hi );
+	WriteBig64( &ioCtr[ 8 ], lo );
+}
+
+//===========================================================================================================================
+//	_AES_CBC_Hardware
+//
+//	Encrypts or decrypts whole blocks and updates the IV for the next call. inKeys is the 11 round keys from 
+//	_AES_ExpandKeyHardware. inSrc and inDst may be the same.
+//===========================================================================================================================
+
+AES_HARDWARE_TARGET
+static void
+	_AES_CBC_Hardware( 
+		const uint8_t *	inKeys, 
+		Boolean			inEncrypt, 
+		uint8_t			ioIV[ 16 ], 
+		const uint8_t *	inSrc, 
+		size_t			inLen, 
+		uint8_t *		inDst )
+{
+	aes_block_t		k[ 11 ];
+	aes_block_t		iv, b0, b1, b2, b3, c0, c1, c2, c3;
+	int				i;
+	
+	for( i = 0; i < 11; ++i ) k[ i ] = AES_HW_LOAD( &inKeys[ i * 16 ] );
+	iv = AES_HW_LOAD( ioIV );
+	if( inEncrypt )
+	{
+		for( ; inLen >= 16; inLen -= 16 )
+		{
+			iv = AES_HW_XOR( iv, AES_HW_LOAD( inSrc ) );
+			AES_HW_ENCRYPT( iv, k );
+			AES_HW_STORE( inDst, iv );
+			inSrc += 16;
+			inDst += 16;
+		}
+	}
+	else
+	{
+		// Each plaintext block is the decrypted block XOR'd with the previous ciphertext block. The ciphertext is 
+		// read before anything is written so this works in place.
+		
+		for( ; inLen >= ( 4 * 16 ); inLen -= ( 4 * 16 ) )
+		{
+			c0 = AES_HW_LOAD( &inSrc[  0 ] );
+			c1 = AES_HW_LOAD( &inSrc[ 16 ] );
+			c2 = AES_HW_LOAD( &inSrc[ 32 ] );
+			c3 = AES_HW_LOAD( &inSrc[ 48 ] );
+			b0 = c0;
+			b1 = c1;
+			b2 = c2;
+			b3 = c3;
+			AES_HW_DECRYPT4( b0, b1, b2, b3, k );
+			AES_HW_STORE( &inDst[  0 ], AES_HW_XOR( b0, iv ) );
+			AES_HW_STORE( &inDst[ 16 ], AES_HW_XOR( b1, c0 ) );
+			AES_HW_STORE( &inDst[ 32 ], AES_HW_XOR( b2, c1 ) );
+			AES_HW_STORE( &inDst[ 48 ], AES_HW_XOR( b3, c2 ) );
+			iv = c3;
+			inSrc += ( 4 * 16 );
+			inDst += ( 4 * 16 );
+		}
+		for( ; inLen >= 16; inLen -= 16 )
+		{
+			c0 = AES_HW_LOAD( inSrc );
+			b0 = c0;
+			AES_HW_DECRYPT( b0, k );
+			AES_HW_STORE( inDst, AES_HW_XOR( b0, iv ) );
+			iv = c0;
+			inSrc += 16;
+			inDst += 16;
+		}
+	}
+	AES_HW_STORE( ioIV, iv );
+}
+#endif // AES_UTILS_HAS_HARDWARE
+
+#if 0
+#pragma mark -
+#endif
+
 #if( AES_UTILS_USE_WINDOWS_API )
 //===========================================================================================================================
 //	_CreateWindowsCryptoAPIContext
@@ -1484,6 +1970,10 @@ exit:
 #endif
 
 #if( !EXCLUDE_UNIT_TESTS )
+static OSStatus	_AESUtils_TestImpls( int inPrint, int inPerf );
+static OSStatus	_AESUtils_TestModes( const uint8_t *inPlain, uint8_t *outCTR, uint8_t *outCBC, uint8_t *inTemp );
+static OSStatus	_AESUtils_TestPerf( const char *inName, uint8_t *inBuf );
+
 //===========================================================================================================================
 //	AESUtils_Test
 //===========================================================================================================================
@@ -1750,12 +2240,15 @@ OSStatus	AESUtils_Test( int inPrint, int inPerf )
 	require_noerr( err, exit );
 	require_action( memcmp( output, expected, len ) == 0, exit, err = -1 );
 	
+	// Hardware and software implementations.
+	
+	err = _AESUtils_TestImpls( inPrint, inPerf );
+	require_noerr( err, exit );
+	
 	// AES-GCM Tests
 	
 #if( AES_UTILS_HAS_GCM )
 	AES_GCM_Test( inPrint, inPerf );
-#else
-	(void) inPerf;
 #endif
 	
 	err = kNoErr;
@@ -1764,4 +2257,210 @@ exit:
 	printf( "AESUtils_Test: %s\n", !err ? "PASSED" : "FAILED" );
 	return( err );
 }
+
+//===========================================================================================================================
+//	_AESUtils_TestImpls
+//
+//	Runs the same data through each implementation and checks they all give the same results.
+//===========================================================================================================================
+
+#define kAESUtilsTestBufSize		4113
+
+static OSStatus	_AESUtils_TestImpls( int inPrint, int inPerf )
+{
+	OSStatus		err;
+	uint8_t *		buf;
+	uint8_t *		plain;
+	uint8_t *		temp;
+	size_t			i;
+	
+	// Layout: plaintext, temp, then CTR and CBC output for each implementation.
+	
+	buf = (uint8_t *) malloc( 6 * kAESUtilsTestBufSize );
+	require_action( buf, exit, err = kNoMemoryErr );
+	plain	= &buf[ 0 ];
+	temp	= &buf[ kAESUtilsTestBufSize ];
+	for( i = 0; i < kAESUtilsTestBufSize; ++i ) plain[ i ] = (uint8_t)( ( i * 31 ) + ( i >> 8 ) + 7 );
+	
+#if( AES_UTILS_HAS_HARDWARE )
+	if( inPrint ) printf( "AES instructions: %s\n", _AES_HardwareSupported() ? "yes" : "no" );
+	
+	gAESImpl = kAESImpl_Software;
+	err = _AESUtils_TestModes( plain, &buf[ 2 * kAESUtilsTestBufSize ], &buf[ 3 * kAESUtilsTestBufSize ], temp );
+	require_noerr( err, exit );
+	if( inPerf )
+	{
+		err = _AESUtils_TestPerf( "software", temp );
+		require_noerr( err, exit );
+	}
+	
+	if( _AES_HardwareSupported() )
+	{
+		gAESImpl = kAESImpl_Hardware;
+		err = _AESUtils_TestModes( plain, &buf[ 4 * kAESUtilsTestBufSize ], &buf[ 5 * kAESUtilsTestBufSize ], temp );
+		require_noerr( err, exit );
+		require_action( memcmp( &buf[ 2 * kAESUtilsTestBufSize ], &buf[ 4 * kAESUtilsTestBufSize ], 
+			2 * kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+		if( inPerf )
+		{
+			err = _AESUtils_TestPerf( "hardware", temp );
+			require_noerr( err, exit );
+		}
+	}
+#else
+	(void) inPrint;
+	
+	err = _AESUtils_TestModes( plain, &buf[ 2 * kAESUtilsTestBufSize ], &buf[ 3 * kAESUtilsTestBufSize ], temp );
+	require_noerr( err, exit );
+	if( inPerf )
+	{
+		err = _AESUtils_TestPerf( "software", temp );
+		require_noerr( err, exit );
+	}
+#endif
+	err = kNoErr;
+	
+exit:
+#if( AES_UTILS_HAS_HARDWARE )
+	gAESImpl = kAESImpl_Unknown;
+#endif
+	FreeNullSafe( buf );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AESUtils_TestModes
+//
+//	Encrypts kAESUtilsTestBufSize bytes with CTR and CBC frame mode, checks that splitting the data into pieces gives 
+//	the same results, and checks that decrypting (in place) gets the plaintext back.
+//===========================================================================================================================
+
+static OSStatus	_AESUtils_TestModes( const uint8_t *inPlain, uint8_t *outCTR, uint8_t *outCBC, uint8_t *inTemp )
+{
+	static const size_t		kChunks[] = { 1, 15, 16, 17, 63, 64, 65, 100, 257 };
+	static const size_t		kSplits[] = { 0, 1, 15, 16, 17, 100, 2049, kAESUtilsTestBufSize };
+	const uint8_t * const	key		= (const uint8_t *) "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xAA\xBB\xCC\xDD\xEE\xFF";
+	const uint8_t * const	iv		= (const uint8_t *) "\xF0\xF1\xF2\xF3\xF4\xF5\xF6\xF7\xF8\xF9\xFA\xFB\xFC\xFD\xFE\xFF";
+	const uint8_t * const	nonce	= (const uint8_t *) "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFD";
+	OSStatus				err;
+	AES_CTR_Context			ctr;
+	AES_CBCFrame_Context	cbc;
+	size_t					i, offset, len;
+	
+	// CTR. The nonce makes the counter carry into the high 64 bits and then wrap.
+	
+	err = AES_CTR_Init( &ctr, key, nonce );
+	require_noerr( err, exit );
+	err = AES_CTR_Update( &ctr, inPlain, kAESUtilsTestBufSize, outCTR );
+	AES_CTR_Final( &ctr );
+	require_noerr( err, exit );
+	
+	err = AES_CTR_Init( &ctr, key, nonce );
+	require_noerr( err, exit );
+	for( i = 0, offset = 0; offset < kAESUtilsTestBufSize; ++i, offset += len )
+	{
+		len = Min( kChunks[ i % countof( kChunks ) ], kAESUtilsTestBufSize - offset );
+		err = AES_CTR_Update( &ctr, &inPlain[ offset ], len, &inTemp[ offset ] );
+		require_noerr( err, exit );
+	}
+	AES_CTR_Final( &ctr );
+	require_action( memcmp( inTemp, outCTR, kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+	
+	err = AES_CTR_Init( &ctr, key, nonce );
+	require_noerr( err, exit );
+	err = AES_CTR_Update( &ctr, inTemp, kAESUtilsTestBufSize, inTemp );
+	AES_CTR_Final( &ctr );
+	require_noerr( err, exit );
+	require_action( memcmp( inTemp, inPlain, kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+	
+	// CBC frame.
+	
+	err = AES_CBCFrame_Init( &cbc, key, iv, true );
+	require_noerr( err, exit );
+	err = AES_CBCFrame_Update( &cbc, inPlain, kAESUtilsTestBufSize, outCBC );
+	require_noerr( err, exit );
+	for( i = 0; i < countof( kSplits ); ++i )
+	{
+		len = kSplits[ i ];
+		err = AES_CBCFrame_Update2( &cbc, inPlain, len, &inPlain[ len ], kAESUtilsTestBufSize - len, inTemp );
+		require_noerr( err, exit );
+		require_action( memcmp( inTemp, outCBC, kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+	}
+	AES_CBCFrame_Final( &cbc );
+	
+	err = AES_CBCFrame_Init( &cbc, key, iv, false );
+	require_noerr( err, exit );
+	for( i = 0; i < countof( kSplits ); ++i )
+	{
+		len = kSplits[ i ];
+		err = AES_CBCFrame_Update2( &cbc, outCBC, len, &outCBC[ len ], kAESUtilsTestBufSize - len, inTemp );
+		require_noerr( err, exit );
+		require_action( memcmp( inTemp, inPlain, kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+	}
+	memcpy( inTemp, outCBC, kAESUtilsTestBufSize );
+	err = AES_CBCFrame_Update( &cbc, inTemp, kAESUtilsTestBufSize, inTemp );
+	AES_CBCFrame_Final( &cbc );
+	require_noerr( err, exit );
+	require_action( memcmp( inTemp, inPlain, kAESUtilsTestBufSize ) == 0, exit, err = kResponseErr );
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AESUtils_TestPerf
+//
+//	Reports MB/sec for CTR and CBC frame mode with the current implementation.
+//===========================================================================================================================
+
+static OSStatus	_AESUtils_TestPerf( const char *inName, uint8_t *inBuf )
+{
+	static const size_t		kPerfSizes[] = { 64, 1024, 4096 };
+	const uint8_t * const	key		= (const uint8_t *) "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xAA\xBB\xCC\xDD\xEE\xFF";
+	const uint8_t * const	iv		= (const uint8_t *) "\xF0\xF1\xF2\xF3\xF4\xF5\xF6\xF7\xF8\xF9\xFA\xFB\xFC\xFD\xFE\xFF";
+	OSStatus				err;
+	AES_CTR_Context			ctr;
+	AES_CBCFrame_Context	cbc;
+	size_t					i, j, len, count;
+	uint64_t				ticks;
+	double					mbs[ 3 ];
+	
+	memset( inBuf, 'a', kAESUtilsTestBufSize );
+	for( i = 0; i < countof( kPerfSizes ); ++i )
+	{
+		len		= kPerfSizes[ i ];
+		count	= ( 16 * 1024 * 1024 ) / len;
+		
+		err = AES_CTR_Init( &ctr, key, iv );
+		require_noerr( err, exit );
+		ticks = UpTicks();
+		for( j = 0; j < count; ++j ) AES_CTR_Update( &ctr, inBuf, len, inBuf );
+		ticks = UpTicks() - ticks;
+		AES_CTR_Final( &ctr );
+		mbs[ 0 ] = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+		
+		err = AES_CBCFrame_Init( &cbc, key, iv, true );
+		require_noerr( err, exit );
+		ticks = UpTicks();
+		for( j = 0; j < count; ++j ) AES_CBCFrame_Update( &cbc, inBuf, len, inBuf );
+		ticks = UpTicks() - ticks;
+		AES_CBCFrame_Final( &cbc );
+		mbs[ 1 ] = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+		
+		err = AES_CBCFrame_Init( &cbc, key, iv, false );
+		require_noerr( err, exit );
+		ticks = UpTicks();
+		for( j = 0; j < count; ++j ) AES_CBCFrame_Update( &cbc, inBuf, len, inBuf );
+		ticks = UpTicks() - ticks;
+		AES_CBCFrame_Final( &cbc );
+		mbs[ 2 ] = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+		
+		fprintf( stderr, "\tAES %-8s CTR %8.2f MB/sec, CBC encrypt %8.2f MB/sec, CBC decrypt %8.2f MB/sec (%4zu bytes)\n", 
+			inName, mbs[ 0 ], mbs[ 1 ], mbs[ 2 ], len );
+	}
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
 #endif // !EXCLUDE_UNIT_TESTS
@@ -63,6 +63,8 @@
 	- OpenSSL.
 	- Windows CryptoAPI.
 	
+	CTR and CBC frame mode also use AES instructions (x86 AES-NI or ARMv8 Cryptography Extensions) when the CPU has them.
+	
 	If one of these libraries is not available, the AES_* APIs will need to be implemented for your platform.
 */
 
@@ -106,6 +108,32 @@
 	#endif
 #endif
 
+// AES_UTILS_ARMV8_ENABLED: 1=Allow the ARMv8 AES instruction code. It's off by default until it has been built and has
+// passed the AES tests on ARM. ARM builds use the software code until then.
+
+#if( !defined( AES_UTILS_ARMV8_ENABLED ) )
+	#define AES_UTILS_ARMV8_ENABLED		0
+#endif
+
+// AES_UTILS_HAS_HARDWARE: 1=Use AES instructions (x86 AES-NI or ARMv8 Cryptography Extensions) if the CPU has them.
+// CommonCrypto and CryptoAPI already use them and WICED targets don't have them.
+
+#if( !defined( AES_UTILS_HAS_HARDWARE ) )
+	#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_WICED || AES_UTILS_USE_WINDOWS_API )
+		#define AES_UTILS_HAS_HARDWARE		0
+	#elif( ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( ( COMPILER_GCC >= 40900 ) || ( COMPILER_CLANG >= 30800 ) ) )
+		#define AES_UTILS_HAS_HARDWARE		1
+	#elif( !AES_UTILS_ARMV8_ENABLED )
+		#define AES_UTILS_HAS_HARDWARE		0
+	#elif( defined( __aarch64__ ) && ( defined( __ARM_FEATURE_CRYPTO ) || defined( __ARM_FEATURE_AES ) ) )
+		#define AES_UTILS_HAS_HARDWARE		1
+	#elif( defined( __aarch64__ ) && ( COMPILER_GCC >= 60000 ) && !COMPILER_CLANG )
+		#define AES_UTILS_HAS_HARDWARE		1
+	#else
+		#define AES_UTILS_HAS_HARDWARE		0
+	#endif
+#endif
+
 // AES_UTILS_HAS_GCM
 
 
@@ -222,6 +250,10 @@ typedef struct
 	HCRYPTKEY			key;					// PRIVATE: CryptoAPI key.
 #else
 	AES_KEY				key;					// PRIVATE: Internal AES key.
+#endif
+#if( AES_UTILS_HAS_HARDWARE )
+	uint8_t				hwKeys[ 11 ][ 16 ];		// PRIVATE: Round keys for AES instructions.
+	Boolean				hardware;				// PRIVATE: True if using AES instructions.
 #endif
 	uint8_t				ctr[ kAES_CTR_Size ];	// PRIVATE: Big endian counter.
 	uint8_t				buf[ kAES_CTR_Size ];	// PRIVATE: Keystream buffer.
@@ -311,6 +343,11 @@ typedef struct
 #else
 	int						mode;						// PRIVATE: AES_ENCRYPT or AES_DECRYPT.
 	AES_KEY					key;						// PRIVATE: Internal AES key.
+#endif
+#if( AES_UTILS_HAS_HARDWARE )
+	uint8_t					hwKeys[ 11 ][ 16 ];			// PRIVATE: Round keys for AES instructions (inverse if decrypting).
+	Boolean					hardware;					// PRIVATE: True if using AES instructions.
+	Boolean					hwEncrypt;					// PRIVATE: True if encrypting with AES instructions.
 #endif
 	uint8_t					iv[ kAES_CBCFrame_Size ];	// PRIVATE: Initialization vector.
 	
@@ -1014,7 +1014,7 @@ CFStringRef
 					( inEncoding == kCFStringEncodingASCII ), exit, err = kUnsupportedErr );
 #endif
 	
-	err = CFLStringCreateWithText( inAllocator, inBytes, (size_t) inSize, &obj );
+	err = CFLStringCreateImmutableWithText( inAllocator, inBytes, (size_t) inSize, &obj );
 	require_noerr( err, exit );
 	
 exit:
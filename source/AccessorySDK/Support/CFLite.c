@@ -62,6 +62,7 @@
 #include "AtomicUtils.h"
 #include "CommonServices.h"
 #include "DebugServices.h"
+#include "TickUtils.h"
 
 #if( TARGET_HAS_STD_C_LIB )
 	#include <limits.h>
@@ -71,6 +72,10 @@
 	#include <string.h>
 #endif
 
+#if( TARGET_OS_LINUX && !EXCLUDE_UNIT_TESTS )
+	#include <sys/wait.h>
+#endif
+
 #if( COMPILER_VISUAL_CPP )
 	#pragma warning( disable:4311 ) // Disable "type cast' : pointer truncation from ABC to XYZ" for CFLHashCode casts.
 #endif
@@ -101,6 +106,28 @@
 #define kCFLConstantFlag		( 1 << 0 )
 #define	kCFLConstantRefCount	0x7FFFFFFF
 
+// Object Allocation
+//
+// Objects up to kCFLSlabMaxObjectSize bytes are carved out of slabs by size class. Each size class has its own free 
+// list and spinlock so allocating or freeing an object is a few instructions when uncontended and objects of the same 
+// size are packed together instead of being scattered around the heap. Slabs are kept until CFLRuntimeFinalize. Larger 
+// objects (e.g. custom runtime classes) are malloc'd with a header to track their size. The size class is stored in 
+// the object itself so freeing doesn't depend on the object's type.
+
+#define kCFLSizeClassNone			0		// Not allocated by the runtime (e.g. constant objects).
+#define kCFLSizeClassMalloc			0xFF	// Allocated with malloc after a CFLMallocHeader.
+#define kCFLSlabSize				16384	// Bytes per slab, including its header.
+#define kCFLSlabMaxObjectSize		128		// Largest object allocated from slabs.
+
+// Caches
+//
+// Small integers and common plist keys are parsed over and over again so CFLNumberCreate and 
+// CFLStringCreateImmutableWithText return shared constant objects for them instead of allocating.
+
+#define kCFLSmallNumberMin				-1
+#define kCFLSmallNumberMax				255
+#define kCFLInternedStringMaxSize		32	// No string in kCFLInternedStrings is longer than this.
+
 #if 0
 #pragma mark == Structures ==
 #endif
@@ -150,15 +177,23 @@ struct CFLDate
 	CFLDateComponents		date;
 };
 
-// CFLDictionaryNode
+// CFLDictionaryEntry
+//
+// Dictionaries are open-addressed tables using Robin Hood hashing with entries stored inline. Each entry caches the 
+// mixed hash of its key so lookups only call the equal callback on a hash match and growing never rehashes keys. 
+// A hash of 0 marks an empty entry.
+
+#define kCFLDictionaryMinCapacity		16	// Smallest non-empty table. Must be a power of 2.
 
-typedef struct CFLDictionaryNode	CFLDictionaryNode;
-struct CFLDictionaryNode
+#define CFLDictionaryMaxCount( CAPACITY )		( ( (CAPACITY) / 4 ) * 3 )	// Grow when more than 75% full.
+
+typedef struct
 {
-	CFLDictionaryNode *		next;
-	const void *			key;
-	const void *			value;
-};
+	const void *		key;
+	const void *		value;
+	CFLHashCode			hash;
+	
+}	CFLDictionaryEntry;
 
 // CFLDictionary
 
@@ -169,8 +204,8 @@ struct CFLDictionary
 	CFLDictionaryKeyCallBacks		keyCallBacks;
 	CFLDictionaryValueCallBacks		valueCallBacks;
 	CFLIndex						count;
-	CFLIndex						bucketCount;
-	CFLDictionaryNode **			buckets;
+	CFLIndex						capacity;	// Number of entries in the table. 0 (not allocated yet) or a power of 2.
+	CFLDictionaryEntry *			entries;
 };
 
 // CFLNull
@@ -212,6 +247,55 @@ struct CFLString
 	size_t			size;
 };
 
+// CFLInternedString
+
+typedef struct
+{
+	CFLStringRef		string;
+	size_t				size;
+	
+}	CFLInternedString;
+
+// CFLFreeObject
+//
+// Object on a size class free list. The CFLObject header is kept so freed objects still fail validity checks.
+
+typedef struct CFLFreeObject		CFLFreeObject;
+struct CFLFreeObject
+{
+	CFLObject			base;
+	CFLFreeObject *		next;
+};
+
+// CFLSlab
+
+typedef struct CFLSlab		CFLSlab;
+struct CFLSlab
+{
+	CFLSlab *		next;
+	void *			pad;		// Keep objects after the header 16-byte aligned on 64-bit platforms.
+};
+
+// CFLSizeClass
+
+typedef struct
+{
+	atomic_spinlock_t		lock;
+	CFLFreeObject *			freeList;
+	CFLSlab *				slabs;
+	int32_t					liveCount;	// Objects allocated from this size class that haven't been freed.
+	
+}	CFLSizeClass;
+
+// CFLMallocHeader
+
+typedef struct
+{
+	size_t		size;
+	size_t		pad;	// Keep the object 16-byte aligned on 64-bit platforms.
+	
+}	CFLMallocHeader;
+
 #if 0
 #pragma mark == Macros ==
 #endif
@@ -280,7 +364,15 @@ static Boolean		_CFLDictionaryEqual( CFLObjectRef inLeft, CFLObjectRef inRight )
 static CFLHashCode	_CFLDictionaryHash( CFLObjectRef inObject );
 static void			_CFLDictionaryFree( CFLObjectRef inObject );
 static OSStatus		_CFLDictionaryCopy( CFLDictionaryRef inSrc, CFLDictionaryRef *outDst );
-static OSStatus		_CFLDictionaryFindKey( const CFLDictionary *inObject, const void *inKey, CFLDictionaryNode ***outNode );
+static OSStatus
+	_CFLDictionaryFindKey( 
+		const CFLDictionary *	inObject, 
+		const void *			inKey, 
+		CFLHashCode *			outHash, 
+		CFLDictionaryEntry **	outEntry );
+static OSStatus		_CFLDictionaryInsert( CFLDictionary *inObject, CFLHashCode inHash, const void *inKey, const void *inValue );
+static OSStatus		_CFLDictionaryResize( CFLDictionary *inObject, CFLIndex inCapacity );
+static void			_CFLDictionaryRemoveEntry( CFLDictionary *inObject, CFLDictionaryEntry *inEntry );
 
 // Number
 
@@ -296,10 +388,15 @@ static CFLHashCode	_CFLStringHash( CFLObjectRef inObject );
 static void			_CFLStringFree( CFLObjectRef inObject );
 static OSStatus		_CFLStringCopy( CFLStringRef inSrc, CFLStringRef *outDst );
 
+// Runtime
+
+static void *			_CFLObjectAlloc( CFLTypeID inTypeID, size_t inSize );
+static void				_CFLObjectFree( CFLObject *inObj );
+static CFLFreeObject *	_CFLSizeClassGrow( uint8_t inSizeClass );
+
 // Utilities
 
 static CFLHashCode	_CFLHashFNV1a( const void *inPtr, size_t inLen );
-static CFLIndex		_CFLNextPrime( CFLIndex inValue );
 static void			_CFLQSortPtrs( void *inPtrArray, size_t inPtrCount, CFLComparatorFunction inCmp, void *inContext );
 #if( TARGET_NO_REALLOC )
 	static void *	_CFLrealloc( void *inMem, size_t inOldSize, size_t inNewSize );
@@ -334,6 +431,21 @@ static const CFLRuntimeClass *		gCFLRuntimeClassTable			= kCFLRuntimeClassTable;
 static CFLRuntimeClass *			gCFLRuntimeClassTableStorage	= NULL;
 static size_t						gCFLRuntimeClassTableCount		= countof( kCFLRuntimeClassTable );
 
+// Object allocation. Index 0 is kCFLSizeClassNone so it's never used.
+
+static const uint16_t		kCFLSizeClassSizes[]	= { 0, 16, 32, 48, 64, 96, 128 };
+static const uint8_t		kCFLSizeClassForSize[]	= { 1, 1, 2, 3, 4, 5, 5, 6, 6 }; // Indexed by ( size + 15 ) / 16.
+
+check_compile_time( countof( kCFLSizeClassForSize ) == ( ( kCFLSlabMaxObjectSize / 16 ) + 1 ) );
+
+static CFLSizeClass			gCFLSizeClasses[ countof( kCFLSizeClassSizes ) ];
+static Boolean				gCFLSlabsDisabled	= !CFL_SLAB_ALLOCATOR;
+static int32_t				gCFLLiveObjects[ kCFLRuntimeStatsMaxTypes ];
+static int32_t				gCFLBytesInUse		= 0;
+static int32_t				gCFLBytesReserved	= 0;
+static int32_t				gCFLNumberCacheHits	= 0;
+static int32_t				gCFLStringCacheHits	= 0;
+
 //
 // Array
 //
@@ -391,6 +503,200 @@ const CFLDictionaryValueCallBacks		kCFLDictionaryValueCallBacksNull 	= { 0, 0, 0
 static CFLNull		_kCFLNull 	= { { kCFLSignatureValid, kCFLTypeNull, kCFLConstantFlag, 0, kCFLConstantRefCount } };
 CFLNullRef			kCFLNull	= &_kCFLNull;
 
+//
+// Number
+//
+
+#define CFLSmallNumber( X )		\
+	{ { kCFLSignatureValid, kCFLTypeNumber, kCFLConstantFlag, 0, kCFLConstantRefCount }, kCFLNumberSInt64Type, { (X) } }
+
+#define CFLSmallNumbers8( X )	\
+	CFLSmallNumber( (X) ),     CFLSmallNumber( (X) + 1 ), CFLSmallNumber( (X) + 2 ), CFLSmallNumber( (X) + 3 ), \
+	CFLSmallNumber( (X) + 4 ), CFLSmallNumber( (X) + 5 ), CFLSmallNumber( (X) + 6 ), CFLSmallNumber( (X) + 7 )
+
+#define CFLSmallNumbers64( X )	\
+	CFLSmallNumbers8( (X) ),      CFLSmallNumbers8( (X) +  8 ), CFLSmallNumbers8( (X) + 16 ), CFLSmallNumbers8( (X) + 24 ), \
+	CFLSmallNumbers8( (X) + 32 ), CFLSmallNumbers8( (X) + 40 ), CFLSmallNumbers8( (X) + 48 ), CFLSmallNumbers8( (X) + 56 )
+
+static CFLNumber		kCFLSmallNumbers[] = 
+{
+	CFLSmallNumber( -1 ), CFLSmallNumbers64( 0 ), CFLSmallNumbers64( 64 ), CFLSmallNumbers64( 128 ), CFLSmallNumbers64( 192 )
+};
+check_compile_time( countof( kCFLSmallNumbers ) == ( ( kCFLSmallNumberMax - kCFLSmallNumberMin ) + 1 ) );
+
+//
+// String
+//
+// Interned strings must be sorted by strcmp order because they're binary searched.
+
+#define CFLInternedString( X )		{ CFLSTR( X ), sizeof( X ) - 1 }
+
+static const CFLInternedString		kCFLInternedStrings[] = 
+{
+	CFLInternedString( "OSInfo" ), 
+	CFLInternedString( "UpdateBonjour" ), 
+	CFLInternedString( "active" ), 
+	CFLInternedString( "address" ), 
+	CFLInternedString( "appStateID" ), 
+	CFLInternedString( "appStates" ), 
+	CFLInternedString( "audioFormat" ), 
+	CFLInternedString( "audioFormats" ), 
+	CFLInternedString( "audioInputFormats" ), 
+	CFLInternedString( "audioLatencies" ), 
+	CFLInternedString( "audioLatencyMs" ), 
+	CFLInternedString( "audioLoopback" ), 
+	CFLInternedString( "audioOutputFormats" ), 
+	CFLInternedString( "audioSource" ), 
+	CFLInternedString( "audioType" ), 
+	CFLInternedString( "bluetoothIDs" ), 
+	CFLInternedString( "borrowConstraint" ), 
+	CFLInternedString( "ch" ), 
+	CFLInternedString( "changeModes" ), 
+	CFLInternedString( "clientOSBuildVersionMin" ), 
+	CFLInternedString( "command" ), 
+	CFLInternedString( "controlPort" ), 
+	CFLInternedString( "ct" ), 
+	CFLInternedString( "dB" ), 
+	CFLInternedString( "data" ), 
+	CFLInternedString( "dataPort" ), 
+	CFLInternedString( "default" ), 
+	CFLInternedString( "deviceID" ), 
+	CFLInternedString( "disableBluetooth" ), 
+	CFLInternedString( "display" ), 
+	CFLInternedString( "displayUUID" ), 
+	CFLInternedString( "displays" ), 
+	CFLInternedString( "duckAudio" ), 
+	CFLInternedString( "durationMs" ), 
+	CFLInternedString( "edid" ), 
+	CFLInternedString( "eiv" ), 
+	CFLInternedString( "ekey" ), 
+	CFLInternedString( "entity" ), 
+	CFLInternedString( "et" ), 
+	CFLInternedString( "eventPort" ), 
+	CFLInternedString( "extendedFeatures" ), 
+	CFLInternedString( "features" ), 
+	CFLInternedString( "firmwareRevision" ), 
+	CFLInternedString( "flushAudio" ), 
+	CFLInternedString( "forceKeyFrame" ), 
+	CFLInternedString( "getLogs" ), 
+	CFLInternedString( "hardwareRevision" ), 
+	CFLInternedString( "heightPhysical" ), 
+	CFLInternedString( "heightPixels" ), 
+	CFLInternedString( "hidCopyInputMode" ), 
+	CFLInternedString( "hidCountryCode" ), 
+	CFLInternedString( "hidDescriptor" ), 
+	CFLInternedString( "hidDevice" ), 
+	CFLInternedString( "hidDevices" ), 
+	CFLInternedString( "hidInputLanguage" ), 
+	CFLInternedString( "hidInputMode" ), 
+	CFLInternedString( "hidLanguages" ), 
+	CFLInternedString( "hidProductID" ), 
+	CFLInternedString( "hidReport" ), 
+	CFLInternedString( "hidSendReport" ), 
+	CFLInternedString( "hidSetInputMode" ), 
+	CFLInternedString( "hidSetReport" ), 
+	CFLInternedString( "hidVendorID" ), 
+	CFLInternedString( "iAPSendMessage" ), 
+	CFLInternedString( "input" ), 
+	CFLInternedString( "inputLatencyMicros" ), 
+	CFLInternedString( "interfaceName" ), 
+	CFLInternedString( "keepAliveLowPower" ), 
+	CFLInternedString( "keepAlivePort" ), 
+	CFLInternedString( "keepAliveSendStatsAsBody" ), 
+	CFLInternedString( "language" ), 
+	CFLInternedString( "latencyMax" ), 
+	CFLInternedString( "latencyMin" ), 
+	CFLInternedString( "limitedUI" ), 
+	CFLInternedString( "limitedUIElements" ), 
+	CFLInternedString( "macAddress" ), 
+	CFLInternedString( "manufacturer" ), 
+	CFLInternedString( "maxFPS" ), 
+	CFLInternedString( "mediaTime" ), 
+	CFLInternedString( "model" ), 
+	CFLInternedString( "modelCode" ), 
+	CFLInternedString( "modes" ), 
+	CFLInternedString( "modesChanged" ), 
+	CFLInternedString( "name" ), 
+	CFLInternedString( "nightMode" ), 
+	CFLInternedString( "oemIcon" ), 
+	CFLInternedString( "oemIconLabel" ), 
+	CFLInternedString( "oemIconPath" ), 
+	CFLInternedString( "oemIconVisible" ), 
+	CFLInternedString( "oemIcons" ), 
+	CFLInternedString( "osBuildVersion" ), 
+	CFLInternedString( "outputLatencyMicros" ), 
+	CFLInternedString( "params" ), 
+	CFLInternedString( "path" ), 
+	CFLInternedString( "pi" ), 
+	CFLInternedString( "pk" ), 
+	CFLInternedString( "playing" ), 
+	CFLInternedString( "primaryInputDevice" ), 
+	CFLInternedString( "property" ), 
+	CFLInternedString( "protocolVersion" ), 
+	CFLInternedString( "qualifier" ), 
+	CFLInternedString( "reasonCode" ), 
+	CFLInternedString( "reasonStr" ), 
+	CFLInternedString( "redundantAudio" ), 
+	CFLInternedString( "requestSiri" ), 
+	CFLInternedString( "requestUI" ), 
+	CFLInternedString( "resourceID" ), 
+	CFLInternedString( "resources" ), 
+	CFLInternedString( "rightHandDrive" ), 
+	CFLInternedString( "sampleTime" ), 
+	CFLInternedString( "screenDecodeQueueDepth" ), 
+	CFLInternedString( "screenDecryptQueueDepth" ), 
+	CFLInternedString( "screenStreamOptions" ), 
+	CFLInternedString( "serialNumber" ), 
+	CFLInternedString( "sessionDied" ), 
+	CFLInternedString( "sessionUUID" ), 
+	CFLInternedString( "setLimitedUI" ), 
+	CFLInternedString( "setNightMode" ), 
+	CFLInternedString( "setUpStreams" ), 
+	CFLInternedString( "siriAction" ), 
+	CFLInternedString( "sourceVersion" ), 
+	CFLInternedString( "speechMode" ), 
+	CFLInternedString( "spf" ), 
+	CFLInternedString( "sr" ), 
+	CFLInternedString( "ss" ), 
+	CFLInternedString( "startServer" ), 
+	CFLInternedString( "startSession" ), 
+	CFLInternedString( "state" ), 
+	CFLInternedString( "status" ), 
+	CFLInternedString( "statusFlags" ), 
+	CFLInternedString( "stopServer" ), 
+	CFLInternedString( "stopSession" ), 
+	CFLInternedString( "streamConnectionID" ), 
+	CFLInternedString( "streams" ), 
+	CFLInternedString( "supportsMediaControlPort" ), 
+	CFLInternedString( "takeConstraint" ), 
+	CFLInternedString( "tearDownStreams" ), 
+	CFLInternedString( "timelineOffset" ), 
+	CFLInternedString( "timestamp" ), 
+	CFLInternedString( "timestampInfo" ), 
+	CFLInternedString( "timestampRawNs" ), 
+	CFLInternedString( "timingPort" ), 
+	CFLInternedString( "transferPriority" ), 
+	CFLInternedString( "transferType" ), 
+	CFLInternedString( "transportType" ), 
+	CFLInternedString( "txtAirPlay" ), 
+	CFLInternedString( "type" ), 
+	CFLInternedString( "udid" ), 
+	CFLInternedString( "unborrowConstraint" ), 
+	CFLInternedString( "unduckAudio" ), 
+	CFLInternedString( "updateFeedback" ), 
+	CFLInternedString( "updateTimestamps" ), 
+	CFLInternedString( "updateVehicleInformation" ), 
+	CFLInternedString( "url" ), 
+	CFLInternedString( "usingScreen" ), 
+	CFLInternedString( "uuid" ), 
+	CFLInternedString( "value" ), 
+	CFLInternedString( "vehicleInformation" ), 
+	CFLInternedString( "volume" ), 
+	CFLInternedString( "wallTime" ), 
+	CFLInternedString( "widthPhysical" ), 
+	CFLInternedString( "widthPixels" )
+};
+
 #if 0
 #pragma mark -
 #pragma mark == General ==
@@ -477,9 +783,7 @@ void	CFLRelease( CFLObjectRef inObject )
 			
 			// Mark the object as invalid to help detect accident re-use then free the memory used by the object.
 			
-			obj->signature	= kCFLSignatureFree;
-			obj->type		= kCFLTypeInvalid;
-			free( obj );
+			_CFLObjectFree( obj );
 		}
 	}
 
@@ -705,12 +1009,9 @@ OSStatus	CFLArrayCreate( CFLAllocatorRef inAllocator, const CFLArrayCallBacks *i
 	
 	// Allocate and initialize the array.
 	
-	object = (CFLArray *) calloc( 1U, sizeof( CFLArray ) );
+	object = (CFLArray *) _CFLObjectAlloc( kCFLTypeArray, sizeof( CFLArray ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeArray;
-	object->base.retainCount	= 1;
 	object->callbacks	 		= inCallBacks ? *inCallBacks : kCFLArrayCallBacksNull;
 	
 	// Success!
@@ -1277,13 +1578,9 @@ OSStatus	CFLDataCreate( CFLAllocatorRef inAllocator, const void *inData, size_t
 	
 	// Allocate and initialize the object.
 	
-	object = (CFLData *) calloc( 1U, sizeof( CFLData ) );
+	object = (CFLData *) _CFLObjectAlloc( kCFLTypeData, sizeof( CFLData ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeData;
-	object->base.retainCount	= 1;
-	
 	// Allocate the data buffer. Round the reserved size up to the next chunk size multiple. Copy any input data.
 	
 	n = CFLDataRoundUpSize( inSize );
@@ -1326,12 +1623,9 @@ OSStatus
 		exit, err = kParamErr );
 	require_action( outRef, exit, err = kParamErr );
 	
-	object = (CFLData *) calloc( 1U, sizeof( CFLData ) );
+	object = (CFLData *) _CFLObjectAlloc( kCFLTypeData, sizeof( CFLData ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeData;
-	object->base.retainCount	= 1;
 	object->data				= (uint8_t *) inData;
 	object->usedSize			= inSize;
 	object->reservedSize		= inSize;
@@ -1374,12 +1668,9 @@ OSStatus
 	ptr += inRange.location;
 	require_action( ( end - ptr ) >= ( (ptrdiff_t) inRange.length ), exit, err = kSizeErr );
 	
-	object = (CFLData *) calloc( 1U, sizeof( CFLData ) );
+	object = (CFLData *) _CFLObjectAlloc( kCFLTypeData, sizeof( CFLData ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeData;
-	object->base.retainCount	= 1;
 	object->data				= ptr;
 	object->usedSize			= (size_t) inRange.length;
 	object->reservedSize		= object->usedSize;
@@ -1639,13 +1930,9 @@ OSStatus	CFLDateCreate( CFLAllocatorRef inAllocator, const CFLDateComponents *in
 	
 	// Allocate and initialize the Date.
 	
-	object = (CFLDate *) calloc( 1U, sizeof( CFLDate ) );
+	object = (CFLDate *) _CFLObjectAlloc( kCFLTypeDate, sizeof( CFLDate ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeDate;
-	object->base.retainCount	= 1;
-	
 	err = CFLDateSetDate( (CFLDateRef) object, inDate );
 	require_noerr( err, exit );
 	
@@ -1823,25 +2110,23 @@ OSStatus
 	
 	require_action( inAllocator == kCFLAllocatorDefault, exit, err = kParamErr );
 	require_action( outRef, exit, err = kParamErr );
-	if( inCapacity <= 0 )	inCapacity = 101;	// Default to a reasonable prime number so modular hashes work well.
-	else					inCapacity = _CFLNextPrime( inCapacity );
 	
 	// Allocate and initialize the dictionary.
 	
-	object = (CFLDictionary *) calloc( 1U, sizeof( CFLDictionary ) );
+	object = (CFLDictionary *) _CFLObjectAlloc( kCFLTypeDictionary, sizeof( CFLDictionary ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeDictionary;
-	object->base.retainCount	= 1;
 	object->keyCallBacks 		= inKeyCallBacks   ? *inKeyCallBacks   : kCFLDictionaryKeyCallBacksNull;
 	object->valueCallBacks 		= inValueCallBacks ? *inValueCallBacks : kCFLDictionaryValueCallBacksNull;
 	
-	// Allocate an initial array of buckets.
+	// If the caller knows how many entries there will be, size the table up front. Otherwise, wait until the first 
+	// entry is added so empty dictionaries don't allocate a table at all.
 	
-	object->buckets = (CFLDictionaryNode **) calloc( 1U, ( (size_t) inCapacity ) * sizeof( CFLDictionaryNode * ) );
-	require_action( object->buckets, exit, err = kNoMemoryErr );
-	object->bucketCount = inCapacity;
+	if( inCapacity > 0 )
+	{
+		err = _CFLDictionaryResize( object, inCapacity );
+		require_noerr( err, exit );
+	}
 	
 	// Success!
 	
@@ -1860,24 +2145,24 @@ exit:
 
 OSStatus	CFLDictionaryCreateCopy( CFLAllocatorRef inAllocator, CFLDictionaryRef inDict, CFLDictionaryRef *outDict )
 {
-	OSStatus				err;
-	CFLDictionaryRef		newDict = NULL;
-	CFLIndex				i, n;
-	CFLDictionaryNode *		node;
+	OSStatus					err;
+	CFLDictionaryRef			newDict = NULL;
+	CFLIndex					i, n;
+	CFLDictionaryEntry *		entry;
 	
 	require_action( CFLValidObjectType( inDict, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	
-	err = CFLDictionaryCreate( inAllocator, inDict->bucketCount, &inDict->keyCallBacks, &inDict->valueCallBacks, &newDict );
+	err = CFLDictionaryCreate( inAllocator, inDict->count, &inDict->keyCallBacks, &inDict->valueCallBacks, &newDict );
 	require_noerr( err, exit );
 	
-	n = inDict->bucketCount;
+	n = inDict->capacity;
 	for( i = 0; i < n; ++i )
 	{
-		for( node = inDict->buckets[ i ]; node; node = node->next )
-		{
-			err = CFLDictionaryAddValue( newDict, node->key, node->value );
-			require_noerr( err, exit );
-		}
+		entry = &inDict->entries[ i ];
+		if( entry->hash == 0 ) continue;
+		
+		err = CFLDictionaryAddValue( newDict, entry->key, entry->value );
+		require_noerr( err, exit );
 	}
 		
 	*outDict = newDict;
@@ -1915,17 +2200,17 @@ OSStatus	CFLDictionaryGetValue( CFLDictionaryRef inObject, const void *inKey, vo
 {
 	OSStatus					err;
 	CFLDictionary *				object;
-	CFLDictionaryNode **		node;
+	CFLDictionaryEntry *		entry;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	// Search for the node by key.
+	// Search for the entry by key.
 	
-	err = _CFLDictionaryFindKey( object, inKey, &node );
+	err = _CFLDictionaryFindKey( object, inKey, NULL, &entry );
 	if( err == kNoErr )
 	{
-		if( outValue ) *( (const void **) outValue ) = ( *node )->value;
+		if( outValue ) *( (const void **) outValue ) = entry->value;
 	}
 	
 exit:
@@ -1940,47 +2225,34 @@ OSStatus	CFLDictionarySetValue( CFLDictionaryRef inObject, const void *inKey, co
 {
 	OSStatus					err;
 	CFLDictionary *				object;
-	CFLDictionaryNode **		node;
-	int							found;
+	CFLDictionaryEntry *		entry;
+	CFLHashCode					hash;
+	const void *				oldValue;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	// Search for the node by key and get a pointer to the node it should go whether found or not.
-	
-	err = _CFLDictionaryFindKey( object, inKey, &node );
+	err = _CFLDictionaryFindKey( object, inKey, &hash, &entry );
 	require( ( err == kNoErr ) || ( err == kNotFoundErr ), exit );
-	require_action( node, exit, err = kUnknownErr );
-	found = ( err == kNoErr );
 	
-	// If the key was not found, add a new entry for it.
+	// If the key was not found, add a new entry for it and retain the key and value.
 	
-	if( !found )
+	if( err == kNotFoundErr )
 	{
-		CFLDictionaryNode *		newNode;
-		
-		newNode = (CFLDictionaryNode *) calloc( 1U, sizeof( CFLDictionaryNode ) );
-		require_action( newNode, exit, err = kNoMemoryErr );
-		
-		newNode->key 	= inKey;
-		newNode->next 	= NULL;
-		*node 			= newNode;
-		object->count  += 1;
-		
-		// Retain the key.
+		err = _CFLDictionaryInsert( object, hash, inKey, inValue );
+		require_noerr( err, exit );
 		
-		if( object->keyCallBacks.retain ) object->keyCallBacks.retain( kCFLAllocatorDefault, inKey );
+		if( object->keyCallBacks.retain )	object->keyCallBacks.retain( kCFLAllocatorDefault, inKey );
+		if( object->valueCallBacks.retain )	object->valueCallBacks.retain( kCFLAllocatorDefault, inValue );
+		goto exit;
 	}
 	
 	// Retain the new value then release any existing value.
 	
 	if( object->valueCallBacks.retain ) object->valueCallBacks.retain( kCFLAllocatorDefault, inValue );
-	if( found )
-	{
-		if( object->valueCallBacks.release ) object->valueCallBacks.release( kCFLAllocatorDefault, ( *node )->value );
-	}
-	( *node )->value = inValue;
-	err = kNoErr;
+	oldValue = entry->value;
+	entry->value = inValue;
+	if( object->valueCallBacks.release ) object->valueCallBacks.release( kCFLAllocatorDefault, oldValue );
 	
 exit:
 	return( err );
@@ -1992,31 +2264,22 @@ exit:
 
 OSStatus	CFLDictionaryAddValue( CFLDictionaryRef inObject, const void *inKey, const void *inValue )
 {
-	OSStatus					err;
-	CFLDictionary *				object;
-	CFLDictionaryNode **		node;
-	CFLDictionaryNode *			newNode;
+	OSStatus			err;
+	CFLDictionary *		object;
+	CFLHashCode			hash;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	err = _CFLDictionaryFindKey( object, inKey, &node );
+	err = _CFLDictionaryFindKey( object, inKey, &hash, NULL );
 	if( !err ) goto exit;
 	require( err == kNotFoundErr, exit );
-	require_action( node, exit, err = kUnknownErr );
 	
-	newNode = (CFLDictionaryNode *) calloc( 1U, sizeof( CFLDictionaryNode ) );
-	require_action( newNode, exit, err = kNoMemoryErr );
-	
-	newNode->key 	= inKey;
-	newNode->next 	= NULL;
-	*node 			= newNode;
-	object->count  += 1;
+	err = _CFLDictionaryInsert( object, hash, inKey, inValue );
+	require_noerr( err, exit );
 	
 	if( object->keyCallBacks.retain ) object->keyCallBacks.retain( kCFLAllocatorDefault, inKey );
 	if( object->valueCallBacks.retain ) object->valueCallBacks.retain( kCFLAllocatorDefault, inValue );
-	( *node )->value = inValue;
-	err = kNoErr;
 	
 exit:
 	return( err );
@@ -2028,34 +2291,29 @@ exit:
 
 OSStatus	CFLDictionaryRemoveValue( CFLDictionaryRef inObject, const void *inKey )
 {
-	OSStatus				err;
-	CFLDictionary *			object;
-	CFLDictionaryNode **	node;
+	OSStatus					err;
+	CFLDictionary *				object;
+	CFLDictionaryEntry *		entry;
+	const void *				key;
+	const void *				value;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	// Search for the node by key and get a pointer to the node it should go whether found or not.
-	
-	err = _CFLDictionaryFindKey( object, inKey, &node );
+	err = _CFLDictionaryFindKey( object, inKey, NULL, &entry );
 	require( ( err == kNoErr ) || ( err == kNotFoundErr ), exit );
-	require_action( node, exit, err = kUnknownErr );
 	
-	// Remove the node if found.
+	// Remove the entry if found then release the key and value. Releasing last means callbacks always see a 
+	// consistent table.
 	
 	if( err == kNoErr )
 	{
-		CFLDictionaryNode *		next;
-		
-		// Release the key and value, free the node, and disconnect from the list.
+		key   = entry->key;
+		value = entry->value;
+		_CFLDictionaryRemoveEntry( object, entry );
 		
-		if( object->keyCallBacks.release )		object->keyCallBacks.release( kCFLAllocatorDefault, ( *node )->key );
-		if( object->valueCallBacks.release )	object->valueCallBacks.release( kCFLAllocatorDefault, ( *node )->value );
-		
-		next = ( *node )->next;
-		free( *node );
-		*node = next;
-		object->count -= 1;
+		if( object->keyCallBacks.release )		object->keyCallBacks.release( kCFLAllocatorDefault, key );
+		if( object->valueCallBacks.release )	object->valueCallBacks.release( kCFLAllocatorDefault, value );
 	}
 	err = kNoErr;
 	
@@ -2069,33 +2327,26 @@ exit:
 
 OSStatus	CFLDictionaryRemoveAllValues( CFLDictionaryRef inObject )
 {
-	OSStatus				err;
-	CFLIndex				i;
-	CFLIndex				n;
-	CFLDictionary *			object;
-	CFLDictionaryNode *		node;
+	OSStatus					err;
+	CFLIndex					i;
+	CFLIndex					n;
+	CFLDictionary *				object;
+	CFLDictionaryEntry *		entry;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	// Remove each node in each bucket.
+	// Release the key and value of each entry. The table is kept for reuse.
 	
-	n = object->bucketCount;
+	n = object->capacity;
 	for( i = 0; i < n; ++i )
 	{
-		CFLDictionaryNode *		nextNode;
+		entry = &object->entries[ i ];
+		if( entry->hash == 0 ) continue;
 		
-		for( node = object->buckets[ i ]; node; node = nextNode )
-		{
-			// Release the key and value and free the node.
-			
-			if( object->keyCallBacks.release ) 		object->keyCallBacks.release( kCFLAllocatorDefault, node->key );
-			if( object->valueCallBacks.release )	object->valueCallBacks.release( kCFLAllocatorDefault, node->value );
-			
-			nextNode = node->next;
-			free( node );
-		}
-		object->buckets[ i ] = NULL;
+		if( object->keyCallBacks.release ) 		object->keyCallBacks.release( kCFLAllocatorDefault, entry->key );
+		if( object->valueCallBacks.release )	object->valueCallBacks.release( kCFLAllocatorDefault, entry->value );
+		entry->hash = 0;
 	}
 	object->count = 0;
 	err = kNoErr;
@@ -2110,7 +2361,7 @@ exit:
 
 Boolean	CFLDictionaryContainsKey( CFLDictionaryRef inObject, const void *inKey )
 {
-	return( (Boolean)( _CFLDictionaryFindKey( inObject, inKey, NULL ) == kNoErr ) );
+	return( (Boolean)( _CFLDictionaryFindKey( inObject, inKey, NULL, NULL ) == kNoErr ) );
 }
 
 //===========================================================================================================================
@@ -2123,9 +2374,6 @@ OSStatus	CFLDictionaryCopyKeysAndValues( CFLDictionaryRef inObject, void *outKey
 	CFLDictionary *		object;
 	void **				keys;
 	void **				values;
-	CFLIndex			n;
-	CFLIndex			i;
-	CFLIndex			iTotal;
 	
 	keys 	= NULL;
 	values 	= NULL;
@@ -2147,19 +2395,8 @@ OSStatus	CFLDictionaryCopyKeysAndValues( CFLDictionaryRef inObject, void *outKey
 		
 		// Copy each key/value ptr.
 		
-		iTotal = 0;
-		n = object->bucketCount;
-		for( i = 0; i < n; ++i )
-		{
-			CFLDictionaryNode *		node;
-			
-			for( node = object->buckets[ i ]; node; node = node->next )
-			{
-				if( keys )   keys[   iTotal ] = (void *) node->key;
-				if( values ) values[ iTotal ] = (void *) node->value;
-				++iTotal;
-			}
-		}
+		err = CFLDictionaryGetKeysAndValues( object, (const void **) keys, (const void **) values );
+		require_noerr( err, exit );
 	}
 	if( outKeys )
 	{
@@ -2186,30 +2423,26 @@ exit:
 
 OSStatus	CFLDictionaryGetKeysAndValues( CFLDictionaryRef inObject, const void **ioKeys, const void **ioValues )
 {
-	OSStatus			err;
-	CFLDictionary *		object;
-	CFLIndex			n;
-	CFLIndex			i;
-	CFLIndex			iTotal;
+	OSStatus					err;
+	CFLDictionary *				object;
+	CFLIndex					n;
+	CFLIndex					i;
+	CFLIndex					iTotal;
+	CFLDictionaryEntry *		entry;
 	
 	require_action( CFLValidObjectType( inObject, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	object = (CFLDictionary *) inObject;
 	
-	if( object->count > 0 )
+	iTotal = 0;
+	n = object->capacity;
+	for( i = 0; i < n; ++i )
 	{
-		iTotal = 0;
-		n = object->bucketCount;
-		for( i = 0; i < n; ++i )
-		{
-			CFLDictionaryNode *		node;
-			
-			for( node = object->buckets[ i ]; node; node = node->next )
-			{
-				if( ioKeys )   ioKeys[   iTotal ] = (void *) node->key;
-				if( ioValues ) ioValues[ iTotal ] = (void *) node->value;
-				++iTotal;
-			}
-		}
+		entry = &object->entries[ i ];
+		if( entry->hash == 0 ) continue;
+		
+		if( ioKeys )   ioKeys[   iTotal ] = entry->key;
+		if( ioValues ) ioValues[ iTotal ] = entry->value;
+		++iTotal;
 	}
 	err = kNoErr;
 	
@@ -2223,22 +2456,22 @@ exit:
 
 OSStatus	CFLDictionaryApplyFunction( CFLDictionaryRef inDict, CFLDictionaryApplierFunction inApplier, void *inContext )
 {
-	OSStatus				err;
-	CFLDictionary *			obj;
-	CFLIndex				i;
-	CFLIndex				n;
-	CFLDictionaryNode *		node;
+	OSStatus					err;
+	CFLDictionary *				obj;
+	CFLIndex					i;
+	CFLIndex					n;
+	CFLDictionaryEntry *		entry;
 	
 	require_action( CFLValidObjectType( inDict, kCFLTypeDictionary ), exit, err = kBadReferenceErr );
 	obj = (CFLDictionary *) inDict;
 	
-	n = obj->bucketCount;
+	n = obj->capacity;
 	for( i = 0; i < n; ++i )
 	{
-		for( node = obj->buckets[ i ]; node; node = node->next )
-		{
-			inApplier( node->key, node->value, inContext );
-		}
+		entry = &obj->entries[ i ];
+		if( entry->hash == 0 ) continue;
+		
+		inApplier( entry->key, entry->value, inContext );
 	}
 	err = kNoErr;
 	
@@ -2252,11 +2485,13 @@ exit:
 
 static Boolean	_CFLDictionaryEqual( CFLObjectRef inLeft, CFLObjectRef inRight )
 {
-	OSStatus			err;
-	CFLDictionary *		l;
-	CFLDictionary *		r;
-	CFLIndex			i;
-	CFLIndex			n;
+	OSStatus					err;
+	CFLDictionary *				l;
+	CFLDictionary *				r;
+	CFLIndex					i;
+	CFLIndex					n;
+	CFLDictionaryEntry *		entry;
+	CFLDictionaryEntry *		rightEntry;
 	
 	// The upper-level CFLEqual routine will have already validated the objects and performed pointer equality testing 
 	// so it is unnecessary here because this should never get called unless those tests failed. Just assert instead.
@@ -2294,34 +2529,30 @@ static Boolean	_CFLDictionaryEqual( CFLObjectRef inLeft, CFLObjectRef inRight )
 	
 	// Lookup each key and compare the values. Any missing key or differing value means different objects.
 	
-	n = l->bucketCount;
+	n = l->capacity;
 	for( i = 0; i < n; ++i )
 	{
-		CFLDictionaryNode *		node;
+		entry = &l->entries[ i ];
+		if( entry->hash == 0 ) continue;
+		
+		// Missing key means objects are different.
+		
+		err = _CFLDictionaryFindKey( r, entry->key, NULL, &rightEntry );
+		check( ( err == kNoErr ) || ( err == kNotFoundErr ) );
+		require_noerr_quiet( err, exit );
+		
+		// Equal ptrs means equal values.
+		
+		if( entry->value == rightEntry->value ) continue;
+		
+		// Different values means different objects.
 		
-		for( node = l->buckets[ i ]; node; node = node->next )
+		if( l->valueCallBacks.equal )
 		{
-			const void *		value;
-			
-			// Missing key means objects are different.
-			
-			err = CFLDictionaryGetValue( r, node->key, (void *) &value );
-			check( ( err == kNoErr ) || ( err == kNotFoundErr ) );
-			require_noerr_quiet( err, exit );
-			
-			// Equal ptrs means equal values.
-			
-			if( node->value == value ) continue;
-			
-			// Different values means different objects.
-			
-			if( l->valueCallBacks.equal )
+			if( !l->valueCallBacks.equal( entry->value, rightEntry->value ) )
 			{
-				if( !l->valueCallBacks.equal( node->value, value ) )
-				{
-					err = kMismatchErr;
-					goto exit;
-				}
+				err = kMismatchErr;
+				goto exit;
 			}
 		}
 	}
@@ -2366,13 +2597,14 @@ static void	_CFLDictionaryFree( CFLObjectRef inObject )
 	
 	// Remove all the values in the dictionary. This also releases all the keys and values in the dictionary.
 	
-	if( object->buckets )
+	if( object->entries )
 	{
 		err = CFLDictionaryRemoveAllValues( object );
 		require_noerr( err, exit );
 		
-		free( object->buckets );
-		object->buckets = NULL;
+		free( object->entries );
+		object->entries = NULL;
+		object->capacity = 0;
 	}
 	
 exit:
@@ -2385,13 +2617,14 @@ exit:
 
 static OSStatus	_CFLDictionaryCopy( CFLDictionaryRef inSrc, CFLDictionaryRef *outDst )
 {
-	OSStatus				err;
-	CFLDictionary *			object;
-	CFLDictionaryRef		newDict;
-	CFLIndex				n;
-	CFLIndex				i;
-	CFLObjectRef			newKey;
-	CFLObjectRef			newValue;
+	OSStatus					err;
+	CFLDictionary *				object;
+	CFLDictionaryRef			newDict;
+	CFLIndex					n;
+	CFLIndex					i;
+	CFLDictionaryEntry *		entry;
+	CFLObjectRef				newKey;
+	CFLObjectRef				newValue;
 	
 	newDict		= NULL;
 	newKey 		= NULL;
@@ -2400,35 +2633,33 @@ static OSStatus	_CFLDictionaryCopy( CFLDictionaryRef inSrc, CFLDictionaryRef *ou
 	object = (CFLDictionary *) inSrc;
 	check( outDst );
 	
-	// Create an empty array to copy the entries into.
+	// Create an empty dictionary big enough for all the entries to copy them into.
 	
-	err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+	err = CFLDictionaryCreate( kCFLAllocatorDefault, object->count, &kCFLDictionaryKeyCallBacksCFLTypes, 
 		&kCFLDictionaryValueCallBacksCFLTypes, &newDict );
 	require_noerr( err, exit );
 	
 	// Copy each key/value object.
 	
-	n = object->bucketCount;
+	n = object->capacity;
 	for( i = 0; i < n; ++i )
 	{
-		CFLDictionaryNode *		node;
+		entry = &object->entries[ i ];
+		if( entry->hash == 0 ) continue;
 		
-		for( node = object->buckets[ i ]; node; node = node->next )
-		{
-			err = CFLCopy( node->key, &newKey );
-			require_noerr( err, exit );
-			
-			err = CFLCopy( node->value, &newValue );
-			require_noerr( err, exit );
-			
-			err = CFLDictionarySetValue( newDict, newKey, newValue );
-			require_noerr( err, exit );
-			
-			CFLRelease( newKey );
-			CFLRelease( newValue );
-			newKey = NULL;
-			newValue = NULL;
-		}
+		err = CFLCopy( entry->key, &newKey );
+		require_noerr( err, exit );
+		
+		err = CFLCopy( entry->value, &newValue );
+		require_noerr( err, exit );
+		
+		err = CFLDictionarySetValue( newDict, newKey, newValue );
+		require_noerr( err, exit );
+		
+		CFLRelease( newKey );
+		CFLRelease( newValue );
+		newKey = NULL;
+		newValue = NULL;
 	}
 	*outDst = newDict;
 	newDict = NULL;
@@ -2443,18 +2674,25 @@ exit:
 
 //===========================================================================================================================
 //	_CFLDictionaryFindKey
+//
+//	Looks up a key and returns its entry if found. Also returns the hash of the key so a following insert doesn't have 
+//	to call the hash callback again.
 //===========================================================================================================================
 
-static OSStatus	_CFLDictionaryFindKey( const CFLDictionary *inObject, const void *inKey, CFLDictionaryNode ***outNode )
+static OSStatus
+	_CFLDictionaryFindKey( 
+		const CFLDictionary *	inObject, 
+		const void *			inKey, 
+		CFLHashCode *			outHash, 
+		CFLDictionaryEntry **	outEntry )
 {
-	OSStatus				err;
-	CFLHashCode				hash;
-	CFLDictionaryNode **	node;
+	OSStatus					err;
+	CFLHashCode					hash;
+	uint32_t					mask, i, dist;
+	CFLDictionaryEntry *		entry;
 	
 	check( inObject );
 	
-	node = NULL;
-	
 	if( inObject->keyCallBacks.hash )
 	{
 		hash = inObject->keyCallBacks.hash( inKey );
@@ -2463,30 +2701,188 @@ static OSStatus	_CFLDictionaryFindKey( const CFLDictionary *inObject, const void
 	{
 		hash = (CFLHashCode)(uintptr_t) inKey;
 	}
-	hash %= (CFLHashCode) inObject->bucketCount;
 	
-	for( node = &inObject->buckets[ hash ]; *node; node = &( *node )->next )
+	// Mix the bits (MurmurHash3 finalizer) because the table index only uses the low bits and hashes like aligned 
+	// pointers or small numbers don't vary much there.
+	
+	hash ^= hash >> 16;
+	hash *= UINT32_C( 0x85EBCA6B );
+	hash ^= hash >> 13;
+	hash *= UINT32_C( 0xC2B2AE35 );
+	hash ^= hash >> 16;
+	if( hash == 0 ) hash = 1; // 0 marks an empty entry.
+	if( outHash ) *outHash = hash;
+	
+	require_action_quiet( inObject->count > 0, exit, err = kNotFoundErr );
+	
+	// Probe from the key's home slot. Entries are kept in order of their distance from home (Robin Hood) so the key 
+	// can't be past an empty entry or past an entry that's closer to its home than the key would be.
+	
+	mask = (uint32_t)( inObject->capacity - 1 );
+	i = hash & mask;
+	for( dist = 0; ; ++dist )
 	{
-		if( inObject->keyCallBacks.equal )
+		entry = &inObject->entries[ i ];
+		if( entry->hash == 0 ) break;
+		if( ( ( i - entry->hash ) & mask ) < dist ) break;
+		if( entry->hash == hash )
 		{
-			if( inObject->keyCallBacks.equal( inKey, ( *node )->key ) )
+			if( inObject->keyCallBacks.equal )
 			{
-				break;
+				if( inObject->keyCallBacks.equal( inKey, entry->key ) )
+				{
+					if( outEntry ) *outEntry = entry;
+					err = kNoErr;
+					goto exit;
+				}
 			}
-		}
-		else
-		{
-			if( inKey == ( *node )->key )
+			else
 			{
-				break;
+				if( inKey == entry->key )
+				{
+					if( outEntry ) *outEntry = entry;
+					err = kNoErr;
+					goto exit;
+				}
 			}
 		}
+		i = ( i + 1 ) & mask;
+	}
+	err = kNotFoundErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_CFLDictionaryInsert
+//
+//	Adds an entry for a key that isn't in the dictionary yet. Doesn't retain the key or value.
+//===========================================================================================================================
+
+static OSStatus	_CFLDictionaryInsert( CFLDictionary *inObject, CFLHashCode inHash, const void *inKey, const void *inValue )
+{
+	OSStatus					err;
+	CFLDictionaryEntry			newEntry;
+	CFLDictionaryEntry			tempEntry;
+	CFLDictionaryEntry *		entry;
+	uint32_t					mask, i, dist, entryDist;
+	
+	if( inObject->count >= CFLDictionaryMaxCount( inObject->capacity ) )
+	{
+		err = _CFLDictionaryResize( inObject, inObject->count + 1 );
+		require_noerr( err, exit );
+	}
+	
+	// Walk from the key's home slot until an empty entry. Whenever the new entry is further from its home than the 
+	// existing entry, swap them and keep going with the displaced entry. This keeps the longest probe short.
+	
+	newEntry.key	= inKey;
+	newEntry.value	= inValue;
+	newEntry.hash	= inHash;
+	mask = (uint32_t)( inObject->capacity - 1 );
+	i = inHash & mask;
+	for( dist = 0; ; ++dist )
+	{
+		entry = &inObject->entries[ i ];
+		if( entry->hash == 0 )
+		{
+			*entry = newEntry;
+			break;
+		}
+		entryDist = ( i - entry->hash ) & mask;
+		if( entryDist < dist )
+		{
+			tempEntry	= *entry;
+			*entry		= newEntry;
+			newEntry	= tempEntry;
+			dist		= entryDist;
+		}
+		i = ( i + 1 ) & mask;
+	}
+	inObject->count += 1;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_CFLDictionaryResize
+//
+//	Grows the table so it can hold at least inCount entries without going over the max load.
+//===========================================================================================================================
+
+static OSStatus	_CFLDictionaryResize( CFLDictionary *inObject, CFLIndex inCount )
+{
+	OSStatus					err;
+	CFLIndex					capacity;
+	CFLDictionaryEntry *		oldEntries;
+	CFLIndex					oldCapacity;
+	CFLIndex					i;
+	
+	capacity = ( inObject->capacity > 0 ) ? inObject->capacity : kCFLDictionaryMinCapacity;
+	while( CFLDictionaryMaxCount( capacity ) < inCount )
+	{
+		require_action( capacity <= ( INT_MAX / 2 ), exit, err = kSizeErr );
+		capacity *= 2;
+	}
+	require_action_quiet( capacity != inObject->capacity, exit, err = kNoErr );
+	
+	oldEntries	= inObject->entries;
+	oldCapacity	= inObject->capacity;
+	inObject->entries = (CFLDictionaryEntry *) calloc( (size_t) capacity, sizeof( CFLDictionaryEntry ) );
+	if( !inObject->entries )
+	{
+		inObject->entries = oldEntries;
+		err = kNoMemoryErr;
+		goto exit;
+	}
+	inObject->capacity	= capacity;
+	inObject->count		= 0;
+	
+	// Reinsert the entries using their cached hashes. Callbacks aren't needed because every key is already unique.
+	
+	for( i = 0; i < oldCapacity; ++i )
+	{
+		if( oldEntries[ i ].hash == 0 ) continue;
+		err = _CFLDictionaryInsert( inObject, oldEntries[ i ].hash, oldEntries[ i ].key, oldEntries[ i ].value );
+		check_noerr( err );
 	}
-	err = ( *node ) ? kNoErr : kNotFoundErr;
-	if( outNode ) *outNode = node;
+	if( oldEntries ) free( oldEntries );
+	err = kNoErr;
+	
+exit:
 	return( err );
 }
 
+//===========================================================================================================================
+//	_CFLDictionaryRemoveEntry
+//
+//	Removes an entry by shifting the entries after it back one slot until one is empty or already in its home slot. 
+//	This keeps probes short without needing tombstones. Doesn't release the key or value.
+//===========================================================================================================================
+
+static void	_CFLDictionaryRemoveEntry( CFLDictionary *inObject, CFLDictionaryEntry *inEntry )
+{
+	uint32_t const				mask = (uint32_t)( inObject->capacity - 1 );
+	uint32_t					i, next;
+	CFLDictionaryEntry *		entry;
+	
+	i = (uint32_t)( inEntry - inObject->entries );
+	for( ;; )
+	{
+		next  = ( i + 1 ) & mask;
+		entry = &inObject->entries[ next ];
+		if( ( entry->hash == 0 ) || ( ( ( next - entry->hash ) & mask ) == 0 ) ) break;
+		
+		inObject->entries[ i ] = *entry;
+		i = next;
+	}
+	inObject->entries[ i ].hash = 0;
+	inObject->count -= 1;
+}
+
 #if 0
 #pragma mark -
 #pragma mark == Null ==
@@ -2522,49 +2918,59 @@ CFLTypeID	CFLNumberGetTypeID( void )
 OSStatus	CFLNumberCreate( CFLAllocatorRef inAllocator, CFLNumberType inType, const void *inValue, CFLNumberRef *outRef )
 {
 	OSStatus		err;
+	CFLNumber		temp;
 	CFLNumber *		object;
 	
-	object = NULL;
 	require_action( inAllocator == kCFLAllocatorDefault, exit, err = kParamErr );
 	require_action( outRef, exit, err = kParamErr );
 	
-	// Allocate and initialize the Number.
-	
-	object = (CFLNumber *) calloc( 1U, sizeof( CFLNumber ) );
-	require_action( object, exit, err = kNoMemoryErr );
-	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeNumber;
-	object->base.retainCount	= 1;
-	object->type				= inType;
-	
-	if(      inType == kCFLNumberSInt8Type )	object->value.s64  = *( (int8_t *)		inValue );
-	else if( inType == kCFLNumberSInt16Type )	object->value.s64  = *( (int16_t *)		inValue );
-	else if( inType == kCFLNumberSInt32Type )	object->value.s64  = *( (int32_t *)		inValue );
-	else if( inType == kCFLNumberSInt64Type )	object->value.s64  = *( (int64_t *)		inValue );
-	else if( inType == kCFLNumberSInt128Type )	object->value.s128 = *( (int128_compat *) inValue );
-	else if( inType == kCFLNumberCharType )		object->value.s64  = *( (char *)		inValue );
-	else if( inType == kCFLNumberShortType )	object->value.s64  = *( (short *)		inValue );
-	else if( inType == kCFLNumberIntType )		object->value.s64  = *( (int *)			inValue );
-	else if( inType == kCFLNumberLongType )		object->value.s64  = *( (long *)		inValue );
-	else if( inType == kCFLNumberLongLongType )	object->value.s64  = *( (long long *)	inValue );
-	else if( inType == kCFLNumberCFIndexType )	object->value.s64  = *( (CFLIndex *)	inValue );
+	// Read the value first so small integers can use a shared constant object instead of allocating.
+	
+	memset( &temp, 0, sizeof( temp ) ); // Integers are compared as 128-bit so the upper half must be zero.
+	temp.type = inType;
+	if(      inType == kCFLNumberSInt8Type )	temp.value.s64  = *( (int8_t *)		inValue );
+	else if( inType == kCFLNumberSInt16Type )	temp.value.s64  = *( (int16_t *)		inValue );
+	else if( inType == kCFLNumberSInt32Type )	temp.value.s64  = *( (int32_t *)		inValue );
+	else if( inType == kCFLNumberSInt64Type )	temp.value.s64  = *( (int64_t *)		inValue );
+	else if( inType == kCFLNumberSInt128Type )	temp.value.s128 = *( (int128_compat *) inValue );
+	else if( inType == kCFLNumberCharType )		temp.value.s64  = *( (char *)		inValue );
+	else if( inType == kCFLNumberShortType )	temp.value.s64  = *( (short *)		inValue );
+	else if( inType == kCFLNumberIntType )		temp.value.s64  = *( (int *)			inValue );
+	else if( inType == kCFLNumberLongType )		temp.value.s64  = *( (long *)		inValue );
+	else if( inType == kCFLNumberLongLongType )	temp.value.s64  = *( (long long *)	inValue );
+	else if( inType == kCFLNumberCFIndexType )	temp.value.s64  = *( (CFLIndex *)	inValue );
 #if( CFL_FLOATING_POINT_NUMBERS )
-	else if( inType == kCFLNumberFloat32Type )	object->value.f64  = *( (Float32 *)		inValue );
-	else if( inType == kCFLNumberFloat64Type )	object->value.f64  = *( (Float64 *)		inValue );
-	else if( inType == kCFLNumberFloatType )	object->value.f64  = *( (float *)		inValue );
-	else if( inType == kCFLNumberDoubleType )	object->value.f64  = *( (double *)		inValue );
+	else if( inType == kCFLNumberFloat32Type )	temp.value.f64  = *( (Float32 *)		inValue );
+	else if( inType == kCFLNumberFloat64Type )	temp.value.f64  = *( (Float64 *)		inValue );
+	else if( inType == kCFLNumberFloatType )	temp.value.f64  = *( (float *)		inValue );
+	else if( inType == kCFLNumberDoubleType )	temp.value.f64  = *( (double *)		inValue );
 #endif
 	else { dlogassert( "bad number type %d", inType ); err = kParamErr; goto exit; }
 	
-	// Success!
+	if( ( inType != kCFLNumberSInt128Type ) && 
+	#if( CFL_FLOATING_POINT_NUMBERS )
+		!CFLNumberTypeIsFloatType( inType ) && 
+	#endif
+		( temp.value.s64 >= kCFLSmallNumberMin ) && ( temp.value.s64 <= kCFLSmallNumberMax ) )
+	{
+		atomic_add_32( &gCFLNumberCacheHits, 1 );
+		*outRef = (CFLNumberRef) &kCFLSmallNumbers[ temp.value.s64 - kCFLSmallNumberMin ];
+		err = kNoErr;
+		goto exit;
+	}
+	
+	// Allocate and initialize the Number.
+	
+	object = (CFLNumber *) _CFLObjectAlloc( kCFLTypeNumber, sizeof( CFLNumber ) );
+	require_action( object, exit, err = kNoMemoryErr );
+	
+	object->type	= temp.type;
+	object->value	= temp.value;
 	
 	*outRef = (CFLNumberRef) object;
-	object = NULL;
 	err = kNoErr;
 	
 exit:
-	if( object ) CFLRelease( (CFLNumberRef) object );
 	return( err );
 }
 
@@ -2946,12 +3352,9 @@ static OSStatus	_CFLNumberCopy( CFLNumberRef inSrc, CFLNumberRef *outDst )
 	require_action( outDst, exit, err = kParamErr );
 	srcObject = (CFLNumber *) inSrc;
 	
-	object = (CFLNumber *) calloc( 1U, sizeof( CFLNumber ) );
+	object = (CFLNumber *) _CFLObjectAlloc( kCFLTypeNumber, sizeof( CFLNumber ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeNumber;
-	object->base.retainCount	= 1;
 	object->type				= srcObject->type;
 	object->value				= srcObject->value;
 	
@@ -2997,13 +3400,9 @@ OSStatus
 	
 	// Allocate and initialize the String.
 	
-	object = (CFLString *) calloc( 1U, sizeof( CFLString ) );
+	object = (CFLString *) _CFLObjectAlloc( kCFLTypeString, sizeof( CFLString ) );
 	require_action( object, exit, err = kNoMemoryErr );
 	
-	object->base.signature		= kCFLSignatureValid;
-	object->base.type			= kCFLTypeString;
-	object->base.retainCount	= 1;
-	
 	// Set the string to the input text (even if null/empty).
 	
 	err = CFLStringSetText( (CFLStringRef) object, inText, inTextSize );
@@ -3020,6 +3419,59 @@ exit:
 	return( err );
 }
 
+//===========================================================================================================================
+//	CFLStringCreateImmutableWithText
+//===========================================================================================================================
+
+OSStatus
+	CFLStringCreateImmutableWithText( 
+		CFLAllocatorRef 	inAllocator, 
+		const void *		inText, 
+		size_t 				inTextSize, 
+		CFLStringRef *		outRef )
+{
+	OSStatus						err;
+	const CFLInternedString *		interned;
+	size_t							lo, hi, mid, n;
+	int								cmp;
+	
+	require_action( inAllocator == kCFLAllocatorDefault, exit, err = kParamErr );
+	require_action( ( inTextSize == 0 ) || inText, exit, err = kParamErr );
+	require_action( outRef, exit, err = kParamErr );
+	if( inTextSize == kSizeCString )	inTextSize = strlen( (const char *) inText );
+	else								inTextSize = _CFLstrnlen( (const char *) inText, inTextSize );
+	
+	// Binary search the interned strings. Shorter strings sort first when one is a prefix of the other like strcmp.
+	
+	if( ( inTextSize > 0 ) && ( inTextSize <= kCFLInternedStringMaxSize ) )
+	{
+		lo = 0;
+		hi = countof( kCFLInternedStrings );
+		while( lo < hi )
+		{
+			mid			= lo + ( ( hi - lo ) / 2 );
+			interned	= &kCFLInternedStrings[ mid ];
+			n			= Min( interned->size, inTextSize );
+			cmp			= memcmp( CFLGetConstantStringPtr( interned->string ), inText, n );
+			if( cmp == 0 ) cmp = ( interned->size < inTextSize ) ? -1 : ( interned->size > inTextSize ) ? 1 : 0;
+			if( cmp == 0 )
+			{
+				atomic_add_32( &gCFLStringCacheHits, 1 );
+				*outRef = interned->string;
+				err = kNoErr;
+				goto exit;
+			}
+			if( cmp < 0 )	lo = mid + 1;
+			else			hi = mid;
+		}
+	}
+	
+	err = CFLStringCreateWithText( inAllocator, inText, inTextSize, outRef );
+	
+exit:
+	return( err );
+}
+
 //===========================================================================================================================
 //	CFLStringGetLength
 //===========================================================================================================================
@@ -3389,9 +3841,33 @@ exit:
 
 void	CFLRuntimeFinalize( void )
 {
+	size_t				i;
+	CFLSizeClass *		sc;
+	CFLSlab *			slab;
+	
 	gCFLRuntimeClassTable = kCFLRuntimeClassTable;
 	ForgetMem( &gCFLRuntimeClassTableStorage );
 	gCFLRuntimeClassTableCount = countof( kCFLRuntimeClassTable );
+	
+	// Free slabs with no live objects. Slabs with live objects are leaked rather than freeing memory still in use.
+	
+	for( i = 1; i < countof( gCFLSizeClasses ); ++i )
+	{
+		sc = &gCFLSizeClasses[ i ];
+		atomic_spinlock_lock( &sc->lock );
+		check( sc->liveCount == 0 );
+		if( sc->liveCount == 0 )
+		{
+			while( ( slab = sc->slabs ) != NULL )
+			{
+				sc->slabs = slab->next;
+				free( slab );
+				atomic_add_32( &gCFLBytesReserved, -kCFLSlabSize );
+			}
+			sc->freeList = NULL;
+		}
+		atomic_spinlock_unlock( &sc->lock );
+	}
 }
 
 //===========================================================================================================================
@@ -3440,20 +3916,192 @@ OSStatus	CFLRuntimeCreateInstance( CFLAllocatorRef inAllocator, CFLTypeID inType
 	require_action( inAllocator == kCFLAllocatorDefault, exit, err = kParamErr );
 	require_action( inTypeID < gCFLRuntimeClassTableCount, exit, err = kParamErr );
 	
-	obj = (CFLObject *) malloc( sizeof( CFLObject ) + inExtraBytes );
+	obj = (CFLObject *) _CFLObjectAlloc( inTypeID, sizeof( CFLObject ) + inExtraBytes );
 	require_action( obj, exit, err = kNoMemoryErr );
 	
+	*( (CFLObject **) outObj ) = obj;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	CFLRuntimeGetStats
+//===========================================================================================================================
+
+void	CFLRuntimeGetStats( CFLRuntimeStats *outStats )
+{
+	size_t		i;
+	
+	for( i = 0; i < kCFLRuntimeStatsMaxTypes; ++i )
+	{
+		outStats->liveObjects[ i ] = (size_t) atomic_fetch_and_add_32( &gCFLLiveObjects[ i ], 0 );
+	}
+	outStats->bytesInUse			= (size_t) atomic_fetch_and_add_32( &gCFLBytesInUse, 0 );
+	outStats->bytesReserved			= (size_t) atomic_fetch_and_add_32( &gCFLBytesReserved, 0 );
+	outStats->numberCacheHits		= (uint32_t) atomic_fetch_and_add_32( &gCFLNumberCacheHits, 0 );
+	outStats->stringCacheHits		= (uint32_t) atomic_fetch_and_add_32( &gCFLStringCacheHits, 0 );
+	
+	// Each number hit saves the object. Each string hit saves the object and its text buffer.
+	
+	outStats->allocationsAvoided	= outStats->numberCacheHits + ( 2 * outStats->stringCacheHits );
+}
+
+//===========================================================================================================================
+//	_CFLObjectAlloc
+//
+//	Allocates a zeroed object with its header initialized and a retain count of 1.
+//===========================================================================================================================
+
+static void *	_CFLObjectAlloc( CFLTypeID inTypeID, size_t inSize )
+{
+	CFLObject *				obj = NULL;
+	uint8_t					sizeClass;
+	size_t					size;
+	CFLSizeClass *			sc;
+	CFLFreeObject *			freeObj;
+	CFLMallocHeader *		header;
+	
+	if( ( inSize <= kCFLSlabMaxObjectSize ) && !gCFLSlabsDisabled )
+	{
+		sizeClass	= kCFLSizeClassForSize[ ( inSize + 15 ) / 16 ];
+		size		= kCFLSizeClassSizes[ sizeClass ];
+		sc			= &gCFLSizeClasses[ sizeClass ];
+		
+		atomic_spinlock_lock( &sc->lock );
+		freeObj = sc->freeList;
+		if( freeObj ) sc->freeList = freeObj->next;
+		++sc->liveCount;
+		atomic_spinlock_unlock( &sc->lock );
+		if( !freeObj )
+		{
+			freeObj = _CFLSizeClassGrow( sizeClass );
+			if( !freeObj )
+			{
+				atomic_spinlock_lock( &sc->lock );
+				--sc->liveCount;
+				atomic_spinlock_unlock( &sc->lock );
+				goto exit;
+			}
+		}
+		obj = &freeObj->base;
+		memset( obj, 0, size );
+	}
+	else
+	{
+		sizeClass	= kCFLSizeClassMalloc;
+		size		= inSize;
+		header = (CFLMallocHeader *) calloc( 1, sizeof( *header ) + inSize );
+		require( header, exit );
+		header->size = inSize;
+		obj = (CFLObject *)( header + 1 );
+	}
 	obj->signature		= kCFLSignatureValid;
 	obj->type			= (uint8_t) inTypeID;
-	obj->flags			= 0;
-	obj->pad			= 0;
+	obj->sizeClass		= sizeClass;
 	obj->retainCount	= 1;
 	
-	*( (CFLObject **) outObj ) = obj;
-	err = kNoErr;
+	atomic_add_32( &gCFLLiveObjects[ Min( inTypeID, kCFLRuntimeStatsMaxTypes - 1 ) ], 1 );
+	atomic_add_32( &gCFLBytesInUse, (int32_t) size );
 	
 exit:
-	return( err );
+	return( obj );
+}
+
+//===========================================================================================================================
+//	_CFLObjectFree
+//===========================================================================================================================
+
+static void	_CFLObjectFree( CFLObject *inObj )
+{
+	CFLTypeID			typeID = inObj->type;
+	CFLFreeObject *		freeObj;
+	CFLSizeClass *		sc;
+	size_t				size;
+	
+	inObj->signature	= kCFLSignatureFree;
+	inObj->type			= kCFLTypeInvalid;
+	
+	if( inObj->sizeClass == kCFLSizeClassMalloc )
+	{
+		CFLMallocHeader * const		header = ( (CFLMallocHeader *) inObj ) - 1;
+		
+		size = header->size;
+		free( header );
+	}
+	else
+	{
+		check( ( inObj->sizeClass > kCFLSizeClassNone ) && ( inObj->sizeClass < countof( gCFLSizeClasses ) ) );
+		size	= kCFLSizeClassSizes[ inObj->sizeClass ];
+		sc		= &gCFLSizeClasses[ inObj->sizeClass ];
+		freeObj	= (CFLFreeObject *) inObj;
+		
+		atomic_spinlock_lock( &sc->lock );
+		freeObj->next = sc->freeList;
+		sc->freeList = freeObj;
+		--sc->liveCount;
+		atomic_spinlock_unlock( &sc->lock );
+	}
+	
+	atomic_add_32( &gCFLLiveObjects[ Min( typeID, kCFLRuntimeStatsMaxTypes - 1 ) ], -1 );
+	atomic_add_32( &gCFLBytesInUse, -( (int32_t) size ) );
+}
+
+//===========================================================================================================================
+//	_CFLSizeClassGrow
+//
+//	Allocates a new slab for a size class, adds all but one of its objects to the free list, and returns the other one.
+//===========================================================================================================================
+
+static CFLFreeObject *	_CFLSizeClassGrow( uint8_t inSizeClass )
+{
+	CFLSizeClass * const		sc		= &gCFLSizeClasses[ inSizeClass ];
+	size_t const				size	= kCFLSizeClassSizes[ inSizeClass ];
+	CFLFreeObject *				obj		= NULL;
+	CFLSlab *					slab;
+	uint8_t *					ptr;
+	uint8_t *					end;
+	CFLFreeObject *				head;
+	CFLFreeObject *				tail;
+	CFLFreeObject *				freeObj;
+	
+	// Carve up the slab without the lock held then splice its objects onto the free list in one step.
+	
+	slab = (CFLSlab *) malloc( kCFLSlabSize );
+	require( slab, exit );
+	
+	ptr = (uint8_t *)( slab + 1 );
+	end = ( (uint8_t *) slab ) + kCFLSlabSize;
+	obj = (CFLFreeObject *) ptr;
+	ptr += size;
+	
+	head = NULL;
+	tail = NULL;
+	for( ; ( end - ptr ) >= (ptrdiff_t) size; ptr += size )
+	{
+		freeObj = (CFLFreeObject *) ptr;
+		freeObj->base.signature = kCFLSignatureFree;
+		freeObj->base.type		= kCFLTypeInvalid;
+		freeObj->next			= NULL;
+		if( tail )	tail->next	= freeObj;
+		else		head		= freeObj;
+		tail = freeObj;
+	}
+	
+	atomic_spinlock_lock( &sc->lock );
+	slab->next = sc->slabs;
+	sc->slabs = slab;
+	if( tail )
+	{
+		tail->next = sc->freeList;
+		sc->freeList = head;
+	}
+	atomic_spinlock_unlock( &sc->lock );
+	atomic_add_32( &gCFLBytesReserved, kCFLSlabSize );
+	
+exit:
+	return( obj );
 }
 
 #if 0
@@ -3494,47 +4142,6 @@ static CFLHashCode	_CFLHashFNV1a( const void *inPtr, size_t inLen )
 	return( hash );
 }
 
-//===========================================================================================================================
-//	_CFLNextPrime
-//
-//	Based on prime number code from snippets.org.
-//===========================================================================================================================
-
-static CFLIndex	_CFLNextPrime( CFLIndex inValue )
-{
-	CFLIndex		i;
-	
-	if( inValue < 2 )
-	{
-		inValue = 1;
-	}
-	else if( inValue < 4 )
-	{
-		inValue = 3;
-	}
-	else
-	{
-		if( ( inValue % 2 ) == 0 )
-		{
-			inValue += 1;
-		}
-		for( ;; )
-		{
-			i = 3;
-			for( ;; )
-			{
-				if( ( inValue % i ) == 0 ) break;
-				if( ( inValue / i ) < i )  goto exit;
-				i += 2;
-			}
-			inValue += 2;
-		}
-	}
-
-exit:
-	return( inValue );
-}
-
 //===========================================================================================================================
 //	_CFLQSortPtrs
 //
@@ -3643,36 +4250,696 @@ static char *	CFLRandomString( size_t inMinChars, size_t inMaxChars, char *outSt
 //	CFLDictionaryStats
 //===========================================================================================================================
 
-static void	CFLDictionaryStats( CFLDictionaryRef inDictionary, int *outMinDepth, int *outMaxDepth );
+static void	CFLDictionaryStats( CFLDictionaryRef inDictionary, int *outCapacity, int *outMaxProbe );
 
-static void	CFLDictionaryStats( CFLDictionaryRef inDictionary, int *outMinDepth, int *outMaxDepth )
+static void	CFLDictionaryStats( CFLDictionaryRef inDictionary, int *outCapacity, int *outMaxProbe )
 {
 	CFLDictionary *			dict;
 	CFLIndex				i;
 	CFLIndex				n;
-	int						minDepth;
-	int						maxDepth;
-	int						depth;
-	CFLDictionaryNode *		node;
+	uint32_t				mask;
+	int						probe;
+	int						maxProbe;
 	
 	check( inDictionary );
 	
 	dict = (CFLDictionary *) inDictionary;
-	minDepth = 0x7FFFFFFF;
-	maxDepth = 0;
-	n = dict->bucketCount;
+	maxProbe = 0;
+	n = dict->capacity;
+	mask = (uint32_t)( n - 1 );
 	for( i = 0; i < n; ++i )
 	{
-		depth = 0;
-		for( node = dict->buckets[ i ]; node; node = node->next )
+		if( dict->entries[ i ].hash == 0 ) continue;
+		probe = (int)( ( ( (uint32_t) i ) - dict->entries[ i ].hash ) & mask );
+		if( probe > maxProbe ) maxProbe = probe;
+	}
+	if( outCapacity ) *outCapacity = (int) n;
+	if( outMaxProbe ) *outMaxProbe = maxProbe;
+}
+
+//===========================================================================================================================
+//	CFLDictionaryChurnTest
+//
+//	Adds and removes integer keys in a pseudo-random order, checking every key against a shadow array so growing and 
+//	backward-shift removal get exercised with long probe runs.
+//===========================================================================================================================
+
+#define kCFLDictionaryChurnKeys		1024
+
+static OSStatus	CFLDictionaryChurnTest( void );
+static void		CFLDictionaryChurnApplier( const void *inKey, const void *inValue, void *inContext );
+
+static OSStatus	CFLDictionaryChurnTest( void )
+{
+	OSStatus				err;
+	CFLDictionaryRef		dict = NULL;
+	CFLDictionaryRef		dict2 = NULL;
+	uint8_t *				present;
+	CFLIndex				count, expected;
+	uintptr_t				key;
+	const void *			value;
+	uint32_t				seed;
+	int						i;
+	
+	present = (uint8_t *) calloc( 1, kCFLDictionaryChurnKeys );
+	require_action( present, exit, err = kNoMemoryErr );
+	
+	err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, NULL, NULL, &dict );
+	require_noerr( err, exit );
+	
+	expected = 0;
+	seed = 1;
+	for( i = 0; i < ( 20 * kCFLDictionaryChurnKeys ); ++i )
+	{
+		seed = ( seed * 1103515245 ) + 12345;
+		key = ( ( seed >> 8 ) % kCFLDictionaryChurnKeys ) * 16; // Multiples of 16 like aligned pointers.
+		if( ( ( seed >> 24 ) % 3 ) != 0 )
+		{
+			err = CFLDictionarySetValue( dict, (const void *) key, (const void *)( key + 1 ) );
+			require_noerr( err, exit );
+			if( !present[ key / 16 ] ) ++expected;
+			present[ key / 16 ] = 1;
+		}
+		else
+		{
+			err = CFLDictionaryRemoveValue( dict, (const void *) key );
+			require_noerr( err, exit );
+			if( present[ key / 16 ] ) --expected;
+			present[ key / 16 ] = 0;
+		}
+	}
+	
+	err = CFLDictionaryGetCount( dict, &count );
+	require_noerr( err, exit );
+	require_action( count == expected, exit, err = kCountErr );
+	for( key = 0; key < ( kCFLDictionaryChurnKeys * 16 ); key += 16 )
+	{
+		value = NULL;
+		err = CFLDictionaryGetValue( dict, (const void *) key, (void *) &value );
+		if( present[ key / 16 ] )
+		{
+			require_noerr( err, exit );
+			require_action( value == (const void *)( key + 1 ), exit, err = kMismatchErr );
+		}
+		else
+		{
+			require_action( err == kNotFoundErr, exit, err = kUnexpectedErr );
+		}
+	}
+	count = 0;
+	err = CFLDictionaryApplyFunction( dict, CFLDictionaryChurnApplier, &count );
+	require_noerr( err, exit );
+	require_action( count == expected, exit, err = kCountErr );
+	
+	err = CFLDictionaryCreateCopy( kCFLAllocatorDefault, dict, &dict2 );
+	require_noerr( err, exit );
+	require_action( CFLEqual( dict, dict2 ), exit, err = kMismatchErr );
+	
+	err = CFLDictionaryRemoveAllValues( dict );
+	require_noerr( err, exit );
+	err = CFLDictionaryGetCount( dict, &count );
+	require_noerr( err, exit );
+	require_action( count == 0, exit, err = kCountErr );
+	require_action( !CFLDictionaryContainsKey( dict, (const void *) 0 ), exit, err = kUnexpectedErr );
+	require_action( !CFLEqual( dict, dict2 ), exit, err = kUnexpectedErr );
+	
+exit:
+	if( dict )		CFLRelease( dict );
+	if( dict2 )		CFLRelease( dict2 );
+	if( present )	free( present );
+	return( err );
+}
+
+static void	CFLDictionaryChurnApplier( const void *inKey, const void *inValue, void *inContext )
+{
+	CFLIndex * const		countPtr = (CFLIndex *) inContext;
+	
+	if( inValue == (const void *)( ( (uintptr_t) inKey ) + 1 ) ) *countPtr += 1;
+}
+
+//===========================================================================================================================
+//	CFLDictionaryBenchmark
+//
+//	Times building, looking up every key in, and iterating dictionaries of string keys and number values at sizes 
+//	typical of RTSP requests (SETUP) and responses (/info). Lookups use separate but equal key objects like a parser 
+//	would. Memory is the table overhead per entry, not counting keys and values.
+//===========================================================================================================================
+
+#define kCFLDictionaryBenchmarkOps		200000
+
+static OSStatus	CFLDictionaryBenchmark( int inPrint );
+static void		CFLDictionaryBenchmarkApplier( const void *inKey, const void *inValue, void *inContext );
+
+static OSStatus	CFLDictionaryBenchmark( int inPrint )
+{
+	static const int		kSizes[] = { 8, 16, 32, 64, 256 };
+	OSStatus				err;
+	CFLDictionaryRef		dict = NULL;
+	CFLStringRef *			keys = NULL;
+	CFLStringRef *			lookupKeys = NULL;
+	CFLNumberRef			number = NULL;
+	CFLDictionary *			obj;
+	const void *			value;
+	char					tempString[ 64 ];
+	int						size, maxSize, rounds, i, j, k, n;
+	uint64_t				ticks, insertTicks, lookupTicks, iterateTicks;
+	size_t					bytes;
+	CFLIndex				count;
+	
+	maxSize = kSizes[ countof( kSizes ) - 1 ];
+	keys		= (CFLStringRef *) calloc( (size_t) maxSize, sizeof( *keys ) );
+	lookupKeys	= (CFLStringRef *) calloc( (size_t) maxSize, sizeof( *lookupKeys ) );
+	require_action( keys && lookupKeys, exit, err = kNoMemoryErr );
+	for( i = 0; i < maxSize; ++i )
+	{
+		n = snprintf( tempString, sizeof( tempString ), "%s%d", ( i % 2 ) ? "statusFlags" : "deviceID", i );
+		err = CFLStringCreateWithText( kCFLAllocatorDefault, tempString, (size_t) n, &keys[ i ] );
+		require_noerr( err, exit );
+		err = CFLStringCreateWithText( kCFLAllocatorDefault, tempString, (size_t) n, &lookupKeys[ i ] );
+		require_noerr( err, exit );
+	}
+	n = 12345;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberIntType, &n, &number );
+	require_noerr( err, exit );
+	
+	for( k = 0; k < (int) countof( kSizes ); ++k )
+	{
+		size	= kSizes[ k ];
+		rounds	= kCFLDictionaryBenchmarkOps / size;
+		insertTicks		= 0;
+		lookupTicks		= 0;
+		iterateTicks	= 0;
+		bytes			= 0;
+		for( j = 0; j < rounds; ++j )
+		{
+			ticks = UpTicks();
+			err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+				&kCFLDictionaryValueCallBacksCFLTypes, &dict );
+			require_noerr( err, exit );
+			for( i = 0; i < size; ++i )
+			{
+				err = CFLDictionarySetValue( dict, keys[ i ], number );
+				require_noerr( err, exit );
+			}
+			insertTicks += UpTicks() - ticks;
+			
+			ticks = UpTicks();
+			for( i = 0; i < size; ++i )
+			{
+				err = CFLDictionaryGetValue( dict, lookupKeys[ i ], (void *) &value );
+				require_noerr( err, exit );
+			}
+			lookupTicks += UpTicks() - ticks;
+			
+			count = 0;
+			ticks = UpTicks();
+			err = CFLDictionaryApplyFunction( dict, CFLDictionaryBenchmarkApplier, &count );
+			require_noerr( err, exit );
+			iterateTicks += UpTicks() - ticks;
+			require_action( count == size, exit, err = kCountErr );
+			
+			obj = (CFLDictionary *) dict;
+			bytes = sizeof( *obj ) + ( ( (size_t) obj->capacity ) * sizeof( *obj->entries ) );
+			CFLRelease( dict );
+			dict = NULL;
+		}
+		if( inPrint )
+		{
+			printf( "\tdictionary benchmark: %2d entries, insert %.1f ns, lookup %.1f ns, iterate %.1f ns, %.1f bytes/entry\n", 
+				size, 
+				( 1e9 * insertTicks )  / ( ( (double) rounds ) * size * UpTicksPerSecond() ), 
+				( 1e9 * lookupTicks )  / ( ( (double) rounds ) * size * UpTicksPerSecond() ), 
+				( 1e9 * iterateTicks ) / ( ( (double) rounds ) * size * UpTicksPerSecond() ), 
+				( (double) bytes ) / size );
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	if( dict )		CFLRelease( dict );
+	if( number )	CFLRelease( number );
+	for( i = 0; i < maxSize; ++i )
+	{
+		if( keys && keys[ i ] )				CFLRelease( keys[ i ] );
+		if( lookupKeys && lookupKeys[ i ] )	CFLRelease( lookupKeys[ i ] );
+	}
+	if( keys )			free( keys );
+	if( lookupKeys )	free( lookupKeys );
+	return( err );
+}
+
+static void	CFLDictionaryBenchmarkApplier( const void *inKey, const void *inValue, void *inContext )
+{
+	CFLIndex * const		countPtr = (CFLIndex *) inContext;
+	
+	(void) inKey;
+	(void) inValue;
+	
+	*countPtr += 1;
+}
+
+//===========================================================================================================================
+//	CFLAllocatorBenchmark
+//
+//	Builds and releases object graphs shaped like /info responses with many of them alive at once, first with slabs 
+//	then with a malloc for every object. Graphs are released in an interleaved order to fragment the heap like 
+//	sessions coming and going. Memory is how much the resident set grew while the graphs were alive. On Linux, each 
+//	run is in a child process so both start from the same heap instead of the second reusing memory freed by the first.
+//	Also checks the runtime stats account for every object.
+//===========================================================================================================================
+
+#define kCFLAllocatorBenchmarkGraphs		1000
+#define kCFLAllocatorBenchmarkRounds		20
+#define kCFLAllocatorBenchmarkDicts			6	// Dictionaries per graph.
+
+static OSStatus	CFLAllocatorBenchmark( int inPrint );
+static OSStatus	CFLAllocatorBenchmarkRun( Boolean inUseSlabs, int inPrint );
+static OSStatus	CFLAllocatorBenchmarkCreateGraph( int inIndex, CFLDictionaryRef *outGraph );
+static OSStatus	CFLAllocatorBenchmarkSetNumber( CFLDictionaryRef inDict, CFLStringRef inKey, int64_t inValue );
+static OSStatus	CFLAllocatorBenchmarkSetString( CFLDictionaryRef inDict, CFLStringRef inKey, const char *inStr );
+static size_t	CFLAllocatorBenchmarkResidentBytes( void );
+
+static OSStatus	CFLAllocatorBenchmark( int inPrint )
+{
+	OSStatus		err;
+	int				i;
+#if( TARGET_OS_LINUX )
+	pid_t			pid, pid2;
+	int				status;
+#endif
+	
+	for( i = 0; i < 2; ++i )
+	{
+	#if( TARGET_OS_LINUX )
+		fflush( stdout );
+		pid = fork();
+		require_action( pid >= 0, exit, err = errno_safe() );
+		if( pid == 0 )
+		{
+			err = CFLAllocatorBenchmarkRun( i == 0, inPrint );
+			fflush( stdout );
+			_exit( err ? 1 : 0 );
+		}
+		do
+		{
+			pid2 = waitpid( pid, &status, 0 );
+			
+		}	while( ( pid2 == -1 ) && ( errno == EINTR ) );
+		require_action( pid2 == pid, exit, err = kUnexpectedErr );
+		require_action( WIFEXITED( status ) && ( WEXITSTATUS( status ) == 0 ), exit, err = kResponseErr );
+	#else
+		err = CFLAllocatorBenchmarkRun( i == 0, inPrint );
+		require_noerr( err, exit );
+	#endif
+	}
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+static OSStatus	CFLAllocatorBenchmarkRun( Boolean inUseSlabs, int inPrint )
+{
+	Boolean const			savedSlabsDisabled = gCFLSlabsDisabled;
+	OSStatus				err;
+	CFLDictionaryRef *		graphs;
+	CFLRuntimeStats			before, during, after;
+	CFLTypeID				typeID;
+	size_t					objects, bytesInUse, residentBase, residentGrowth, n;
+	uint64_t				ticks, totalTicks;
+	int						round, i;
+	
+	gCFLSlabsDisabled = !inUseSlabs;
+	graphs = (CFLDictionaryRef *) calloc( kCFLAllocatorBenchmarkGraphs, sizeof( *graphs ) );
+	require_action( graphs, exit, err = kNoMemoryErr );
+	
+	CFLRuntimeGetStats( &before );
+	residentBase	= CFLAllocatorBenchmarkResidentBytes();
+	residentGrowth	= 0;
+	objects			= 0;
+	bytesInUse		= 0;
+	totalTicks		= 0;
+	for( round = 0; round < kCFLAllocatorBenchmarkRounds; ++round )
+	{
+		ticks = UpTicks();
+		for( i = 0; i < kCFLAllocatorBenchmarkGraphs; ++i )
+		{
+			err = CFLAllocatorBenchmarkCreateGraph( i, &graphs[ i ] );
+			require_noerr( err, exit );
+		}
+		totalTicks += UpTicks() - ticks;
+		
+		n = CFLAllocatorBenchmarkResidentBytes();
+		if( ( n > residentBase ) && ( ( n - residentBase ) > residentGrowth ) ) residentGrowth = n - residentBase;
+		if( round == 0 )
 		{
-			++depth;
+			CFLRuntimeGetStats( &during );
+			for( typeID = 0; typeID < kCFLRuntimeStatsMaxTypes; ++typeID )
+			{
+				objects += during.liveObjects[ typeID ] - before.liveObjects[ typeID ];
+			}
+			bytesInUse = during.bytesInUse - before.bytesInUse;
+			typeID = CFLDictionaryGetTypeID();
+			require_action( ( during.liveObjects[ typeID ] - before.liveObjects[ typeID ] ) == 
+				( kCFLAllocatorBenchmarkGraphs * kCFLAllocatorBenchmarkDicts ), exit, err = kCountErr );
 		}
-		if( depth > maxDepth ) maxDepth = depth;
-		if( depth < minDepth ) minDepth = depth;
+		
+		ticks = UpTicks();
+		for( i = 1; i < kCFLAllocatorBenchmarkGraphs; i += 2 ) ForgetCustom( &graphs[ i ], CFLRelease );
+		for( i = 0; i < kCFLAllocatorBenchmarkGraphs; i += 2 ) ForgetCustom( &graphs[ i ], CFLRelease );
+		totalTicks += UpTicks() - ticks;
+	}
+	
+	CFLRuntimeGetStats( &after );
+	for( typeID = 0; typeID < kCFLRuntimeStatsMaxTypes; ++typeID )
+	{
+		require_action( after.liveObjects[ typeID ] == before.liveObjects[ typeID ], exit, err = kCountErr );
 	}
-	if( outMinDepth ) *outMinDepth = minDepth;
-	if( outMaxDepth ) *outMaxDepth = maxDepth;
+	require_action( after.bytesInUse == before.bytesInUse, exit, err = kCountErr );
+	
+	if( inPrint )
+	{
+		printf( "\tallocator benchmark: %-6s %d graphs of %zu objects, %.1f ns/object, %zu bytes/object, %zu KB RSS growth\n", 
+			inUseSlabs ? "slabs," : "malloc,", kCFLAllocatorBenchmarkGraphs, objects / kCFLAllocatorBenchmarkGraphs, 
+			( 1e9 * totalTicks ) / ( ( (double) kCFLAllocatorBenchmarkRounds ) * objects * UpTicksPerSecond() ), 
+			bytesInUse / objects, residentGrowth / 1024 );
+	}
+	err = kNoErr;
+	
+exit:
+	if( graphs )
+	{
+		for( i = 0; i < kCFLAllocatorBenchmarkGraphs; ++i ) ForgetCustom( &graphs[ i ], CFLRelease );
+		free( graphs );
+	}
+	gCFLSlabsDisabled = savedSlabsDisabled;
+	return( err );
+}
+
+static OSStatus	CFLAllocatorBenchmarkCreateGraph( int inIndex, CFLDictionaryRef *outGraph )
+{
+	OSStatus				err;
+	CFLDictionaryRef		graph	= NULL;
+	CFLArrayRef				array	= NULL;
+	CFLDictionaryRef		dict	= NULL;
+	CFLDataRef				data	= NULL;
+	uint8_t					buf[ 32 ];
+	char					str[ 64 ];
+	int						i;
+	
+	err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+		&kCFLDictionaryValueCallBacksCFLTypes, &graph );
+	require_noerr( err, exit );
+	
+	snprintf( str, sizeof( str ), "00:11:22:33:%02X:%02X", ( inIndex >> 8 ) & 0xFF, inIndex & 0xFF );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "deviceID" ), str );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( graph, CFLSTR( "features" ), INT64_C( 0x1E5A7FFFF7 ) );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "model" ), "AirPlayReceiver1,1" );
+	require_noerr( err, exit );
+	snprintf( str, sizeof( str ), "Receiver %d", inIndex );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "name" ), str );
+	require_noerr( err, exit );
+	snprintf( str, sizeof( str ), "2e388006-13ba-4041-9a67-25dd4a43%04x", inIndex & 0xFFFF );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "pi" ), str );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "protocolVersion" ), "1.1" );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetString( graph, CFLSTR( "sourceVersion" ), "410.12" );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( graph, CFLSTR( "statusFlags" ), 4 );
+	require_noerr( err, exit );
+	err = CFLDictionarySetValue( graph, CFLSTR( "keepAliveLowPower" ), kCFLBooleanTrue );
+	require_noerr( err, exit );
+	
+	memset( buf, inIndex & 0xFF, sizeof( buf ) );
+	err = CFLDataCreate( kCFLAllocatorDefault, buf, sizeof( buf ), &data );
+	require_noerr( err, exit );
+	err = CFLDictionarySetValue( graph, CFLSTR( "pk" ), data );
+	ForgetCustom( &data, CFLRelease );
+	require_noerr( err, exit );
+	
+	// audioFormats and audioLatencies.
+	
+	err = CFLArrayCreate( kCFLAllocatorDefault, &kCFLArrayCallBacksCFLTypes, &array );
+	require_noerr( err, exit );
+	for( i = 0; i < 2; ++i )
+	{
+		err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+			&kCFLDictionaryValueCallBacksCFLTypes, &dict );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "type" ), 100 + ( i * 2 ) );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "audioInputFormats" ), 0x3FFFFFC );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "audioOutputFormats" ), 0x3FFFFFC );
+		require_noerr( err, exit );
+		err = CFLArrayAppendValue( array, dict );
+		require_noerr( err, exit );
+		ForgetCustom( &dict, CFLRelease );
+	}
+	err = CFLDictionarySetValue( graph, CFLSTR( "audioFormats" ), array );
+	require_noerr( err, exit );
+	ForgetCustom( &array, CFLRelease );
+	
+	err = CFLArrayCreate( kCFLAllocatorDefault, &kCFLArrayCallBacksCFLTypes, &array );
+	require_noerr( err, exit );
+	for( i = 0; i < 2; ++i )
+	{
+		err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+			&kCFLDictionaryValueCallBacksCFLTypes, &dict );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "type" ), 100 + ( i * 2 ) );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetString( dict, CFLSTR( "audioType" ), "default" );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "inputLatencyMicros" ), 0 );
+		require_noerr( err, exit );
+		err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "outputLatencyMicros" ), 0 );
+		require_noerr( err, exit );
+		err = CFLArrayAppendValue( array, dict );
+		require_noerr( err, exit );
+		ForgetCustom( &dict, CFLRelease );
+	}
+	err = CFLDictionarySetValue( graph, CFLSTR( "audioLatencies" ), array );
+	require_noerr( err, exit );
+	ForgetCustom( &array, CFLRelease );
+	
+	// displays
+	
+	err = CFLArrayCreate( kCFLAllocatorDefault, &kCFLArrayCallBacksCFLTypes, &array );
+	require_noerr( err, exit );
+	err = CFLDictionaryCreate( kCFLAllocatorDefault, 0, &kCFLDictionaryKeyCallBacksCFLTypes, 
+		&kCFLDictionaryValueCallBacksCFLTypes, &dict );
+	require_noerr( err, exit );
+	snprintf( str, sizeof( str ), "e0ff8a27-6738-3d56-8a16-cc53aacee9%02x", inIndex & 0xFF );
+	err = CFLAllocatorBenchmarkSetString( dict, CFLSTR( "uuid" ), str );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "widthPixels" ), 1920 );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "heightPixels" ), 1080 );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "widthPhysical" ), 0 );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "heightPhysical" ), 0 );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "maxFPS" ), 30 );
+	require_noerr( err, exit );
+	err = CFLAllocatorBenchmarkSetNumber( dict, CFLSTR( "features" ), 14 );
+	require_noerr( err, exit );
+	err = CFLArrayAppendValue( array, dict );
+	require_noerr( err, exit );
+	ForgetCustom( &dict, CFLRelease );
+	err = CFLDictionarySetValue( graph, CFLSTR( "displays" ), array );
+	require_noerr( err, exit );
+	ForgetCustom( &array, CFLRelease );
+	
+	*outGraph = graph;
+	graph = NULL;
+	
+exit:
+	if( data )	CFLRelease( data );
+	if( dict )	CFLRelease( dict );
+	if( array )	CFLRelease( array );
+	if( graph )	CFLRelease( graph );
+	return( err );
+}
+
+static OSStatus	CFLAllocatorBenchmarkSetNumber( CFLDictionaryRef inDict, CFLStringRef inKey, int64_t inValue )
+{
+	OSStatus			err;
+	CFLNumberRef		number;
+	
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberSInt64Type, &inValue, &number );
+	require_noerr( err, exit );
+	err = CFLDictionarySetValue( inDict, inKey, number );
+	CFLRelease( number );
+	
+exit:
+	return( err );
+}
+
+static OSStatus	CFLAllocatorBenchmarkSetString( CFLDictionaryRef inDict, CFLStringRef inKey, const char *inStr )
+{
+	OSStatus			err;
+	CFLStringRef		string;
+	
+	err = CFLStringCreateWithText( kCFLAllocatorDefault, inStr, kSizeCString, &string );
+	require_noerr( err, exit );
+	err = CFLDictionarySetValue( inDict, inKey, string );
+	CFLRelease( string );
+	
+exit:
+	return( err );
+}
+
+static size_t	CFLAllocatorBenchmarkResidentBytes( void )
+{
+#if( TARGET_OS_LINUX )
+	FILE *				file;
+	unsigned long		totalPages, residentPages;
+	size_t				bytes = 0;
+	
+	file = fopen( "/proc/self/statm", "r" );
+	if( file )
+	{
+		if( fscanf( file, "%lu %lu", &totalPages, &residentPages ) == 2 )
+		{
+			bytes = ( (size_t) residentPages ) * ( (size_t) sysconf( _SC_PAGESIZE ) );
+		}
+		fclose( file );
+	}
+	return( bytes );
+#else
+	return( 0 );
+#endif
+}
+
+//===========================================================================================================================
+//	CFLiteCachesTest
+//===========================================================================================================================
+
+static OSStatus	CFLiteCachesTest( void )
+{
+	OSStatus			err;
+	CFLRuntimeStats		before, after;
+	CFLNumberRef		number	= NULL;
+	CFLNumberRef		number2	= NULL;
+	CFLStringRef		string	= NULL;
+	CFLStringRef		string2	= NULL;
+	const char *		s;
+	size_t				i, n;
+	int					x;
+	int64_t				s64;
+	double				d;
+	
+	// Interned strings must be sorted for the binary search to find them.
+	
+	for( i = 0; i < countof( kCFLInternedStrings ); ++i )
+	{
+		s = CFLGetConstantStringPtr( kCFLInternedStrings[ i ].string );
+		require_action( strlen( s ) == kCFLInternedStrings[ i ].size, exit, err = kSizeErr );
+		require_action( kCFLInternedStrings[ i ].size <= kCFLInternedStringMaxSize, exit, err = kSizeErr );
+		require_action( ( i == 0 ) || ( strcmp( CFLGetConstantStringPtr( kCFLInternedStrings[ i - 1 ].string ), s ) < 0 ), 
+			exit, err = kOrderErr );
+	}
+	
+	CFLRuntimeGetStats( &before );
+	
+	// Small integers.
+	
+	x = 1;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberIntType, &x, &number );
+	require_noerr( err, exit );
+	require_action( CFLIsConstantObject( number ), exit, err = kResponseErr );
+	s64 = 1;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberSInt64Type, &s64, &number2 );
+	require_noerr( err, exit );
+	require_action( number2 == number, exit, err = kResponseErr );
+	require_action( CFLNumberGetType( number ) == kCFLNumberSInt64Type, exit, err = kTypeErr );
+	err = CFLNumberGetValue( number, kCFLNumberIntType, &x );
+	require_noerr( err, exit );
+	require_action( x == 1, exit, err = kMismatchErr );
+	ForgetCustom( &number, CFLRelease );
+	ForgetCustom( &number2, CFLRelease );
+	
+	x = kCFLSmallNumberMin;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberIntType, &x, &number );
+	require_noerr( err, exit );
+	require_action( CFLIsConstantObject( number ), exit, err = kResponseErr );
+	err = CFLNumberGetValue( number, kCFLNumberSInt64Type, &s64 );
+	require_noerr( err, exit );
+	require_action( s64 == kCFLSmallNumberMin, exit, err = kMismatchErr );
+	ForgetCustom( &number, CFLRelease );
+	
+	x = kCFLSmallNumberMax + 1;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberIntType, &x, &number );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( number ), exit, err = kResponseErr );
+	require_action( CFLNumberGetType( number ) == kCFLNumberIntType, exit, err = kTypeErr );
+	ForgetCustom( &number, CFLRelease );
+	
+	x = kCFLSmallNumberMin - 1;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberIntType, &x, &number );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( number ), exit, err = kResponseErr );
+	ForgetCustom( &number, CFLRelease );
+	
+#if( CFL_FLOATING_POINT_NUMBERS )
+	d = 1.0;
+	err = CFLNumberCreate( kCFLAllocatorDefault, kCFLNumberDoubleType, &d, &number );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( number ), exit, err = kResponseErr );
+	ForgetCustom( &number, CFLRelease );
+#else
+	(void) d;
+#endif
+	
+	// Interned strings.
+	
+	err = CFLStringCreateImmutableWithText( kCFLAllocatorDefault, "type", 4, &string );
+	require_noerr( err, exit );
+	require_action( CFLIsConstantObject( string ), exit, err = kResponseErr );
+	require_action( CFLEqual( string, CFLSTR( "type" ) ), exit, err = kMismatchErr );
+	err = CFLStringCreateImmutableWithText( kCFLAllocatorDefault, "timestampInfo", kSizeCString, &string2 );
+	require_noerr( err, exit );
+	require_action( CFLIsConstantObject( string2 ), exit, err = kResponseErr );
+	err = CFLStringGetCStringPtr( string2, &s, &n );
+	require_noerr( err, exit );
+	require_action( ( n == 13 ) && ( strcmp( s, "timestampInfo" ) == 0 ), exit, err = kMismatchErr );
+	ForgetCustom( &string, CFLRelease );
+	ForgetCustom( &string2, CFLRelease );
+	
+	err = CFLStringCreateImmutableWithText( kCFLAllocatorDefault, "typ", 3, &string );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( string ), exit, err = kResponseErr );
+	ForgetCustom( &string, CFLRelease );
+	
+	err = CFLStringCreateImmutableWithText( kCFLAllocatorDefault, "types", 5, &string );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( string ), exit, err = kResponseErr );
+	ForgetCustom( &string, CFLRelease );
+	
+	err = CFLStringCreateWithText( kCFLAllocatorDefault, "type", 4, &string );
+	require_noerr( err, exit );
+	require_action( !CFLIsConstantObject( string ), exit, err = kResponseErr );
+	err = CFLStringAppendText( string, "s", 1 );
+	require_noerr( err, exit );
+	ForgetCustom( &string, CFLRelease );
+	
+	CFLRuntimeGetStats( &after );
+	require_action( ( after.numberCacheHits - before.numberCacheHits ) == 3, exit, err = kCountErr );
+	require_action( ( after.stringCacheHits - before.stringCacheHits ) == 2, exit, err = kCountErr );
+	require_action( ( after.allocationsAvoided - before.allocationsAvoided ) == 7, exit, err = kCountErr );
+	err = kNoErr;
+	
+exit:
+	if( number )	CFLRelease( number );
+	if( number2 )	CFLRelease( number2 );
+	if( string )	CFLRelease( string );
+	if( string2 )	CFLRelease( string2 );
+	return( err );
 }
 
 //===========================================================================================================================
@@ -3763,8 +5030,8 @@ OSStatus	CFLiteTest( int inPrint )
 #endif
 	size_t					n, n2;
 	CFLDateComponents		dateComponents;
-	int						minDepth;
-	int						maxDepth;
+	int						capacity;
+	int						maxProbe;
 	char					tempString[ 256 ];
 	const void *			values[ 8 ];
 	
@@ -4121,12 +5388,12 @@ OSStatus	CFLiteTest( int inPrint )
 		string = NULL;
 		require_noerr( err, exit );
 	}
-	CFLDictionaryStats( dict, &minDepth, &maxDepth );
+	CFLDictionaryStats( dict, &capacity, &maxProbe );
 	
 	CFLRelease( dict );
 	dict = NULL;
 	
-	if( inPrint ) printf( "\tdictionary tests: %d entries, table size 31 -> minDepth %d, maxDepth %d\n", i, minDepth, maxDepth );
+	if( inPrint ) printf( "\tdictionary tests: %d entries, table size %d -> max probe %d\n", i, capacity, maxProbe );
 	
 	err = CFLDictionaryCreate( kCFLAllocatorDefault, 31, &kCFLDictionaryKeyCallBacksCFLTypes, 
 		&kCFLDictionaryValueCallBacksCFLTypes, &dict );
@@ -4143,12 +5410,21 @@ OSStatus	CFLiteTest( int inPrint )
 		string = NULL;
 		require_noerr( err, exit );
 	}
-	CFLDictionaryStats( dict, &minDepth, &maxDepth );
+	CFLDictionaryStats( dict, &capacity, &maxProbe );
 	
 	CFLRelease( dict );
 	dict = NULL;
 	
-	if( inPrint ) printf( "\tdictionary tests: %d entries, table size 31 -> minDepth %d, maxDepth %d\n", i, minDepth, maxDepth );
+	if( inPrint ) printf( "\tdictionary tests: %d entries, table size %d -> max probe %d\n", i, capacity, maxProbe );
+	
+	err = CFLDictionaryChurnTest();
+	require_noerr( err, exit );
+	
+	err = CFLDictionaryBenchmark( inPrint );
+	require_noerr( err, exit );
+	
+	err = CFLAllocatorBenchmark( inPrint );
+	require_noerr( err, exit );
 	
 	//
 	// Null
@@ -4669,6 +5945,11 @@ OSStatus	CFLiteTest( int inPrint )
 	require_action( CFLEqual( CFLSTR( "test" ), CFLSTR( "test" ) ), exit, err = kMismatchErr );
 	require_action( !CFLEqual( CFLSTR( "abc" ), CFLSTR( "xyz" ) ), exit, err = kMismatchErr );
 	
+	// Caches
+	
+	err = CFLiteCachesTest();
+	require_noerr( err, exit );
+	
 	// Runtime
 	
 	err = CFLiteRuntimeClassesTest();
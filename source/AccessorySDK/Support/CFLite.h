@@ -76,6 +76,12 @@
 	#endif
 #endif
 
+// CFL_SLAB_ALLOCATOR -- 1=Allocate small objects from per-size slabs. 0=malloc each object (e.g. for heap checkers).
+
+#if( !defined( CFL_SLAB_ALLOCATOR ) )
+	#define	CFL_SLAB_ALLOCATOR		1
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -984,6 +990,9 @@ CFLTypeID	CFLNumberGetTypeID( void );
 	
 	The caller of this function receives a reference to the returned object. The caller also implicitly retains the object, 
 	and is responsible for releasing it. 
+	
+	Integers from -1 to 255 return shared constant objects instead of allocating. These are kCFLNumberSInt64Type 
+	regardless of the type passed in.
 */
 OSStatus	CFLNumberCreate( CFLAllocatorRef inAllocator, CFLNumberType inType, const void *inValue, CFLNumberRef *outRef );
 
@@ -1072,6 +1081,22 @@ OSStatus
 		size_t 				inTextSize, 
 		CFLStringRef *		outRef );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFLStringCreateImmutableWithText
+	@abstract	Creates a CFLString object with the specified text that will never be modified. 
+	@result		An error code indicating failure reason or kNoErr (0) if successful.
+	@discussion
+	
+	Same as CFLStringCreateWithText except common short strings (e.g. plist keys such as "type" and "streams") return 
+	shared constant objects instead of allocating. The caller must release the object as usual.
+*/
+OSStatus
+	CFLStringCreateImmutableWithText( 
+		CFLAllocatorRef 	inAllocator, 
+		const void *		inText, 
+		size_t 				inTextSize, 
+		CFLStringRef *		outRef );
+
 //---------------------------------------------------------------------------------------------------------------------------
 /*!	@function	CFLStringGetLength
 	@abstract	Obtains the number of characters in a CFLString object. 
@@ -1127,7 +1152,7 @@ typedef struct
 	uint8_t		signature;
 	uint8_t		type;
 	uint8_t		flags;
-	uint8_t		pad;
+	uint8_t		sizeClass;		// How the object was allocated. 0 for constant objects.
 	int32_t		retainCount;
 	
 }	CFLObject;
@@ -1135,7 +1160,7 @@ typedef struct
 check_compile_time( offsetof( CFLObject, signature )	== 0 );
 check_compile_time( offsetof( CFLObject, type )			== 1 );
 check_compile_time( offsetof( CFLObject, flags )		== 2 );
-check_compile_time( offsetof( CFLObject, pad )			== 3 );
+check_compile_time( offsetof( CFLObject, sizeClass )	== 3 );
 check_compile_time( offsetof( CFLObject, retainCount )	== 4 );
 check_compile_time( sizeof( CFLObject )					== kCFLStringConstantHeaderSize );
 
@@ -1178,6 +1203,27 @@ OSStatus	CFLRuntimeRegisterClass( const CFLRuntimeClass * const inClass, CFLType
 */
 OSStatus	CFLRuntimeCreateInstance( CFLAllocatorRef inAllocator, CFLTypeID inTypeID, size_t inExtraBytes, void *outObj );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFLRuntimeGetStats
+	@abstract	Gets the number of live objects by type and the memory used by them.
+	
+	@param		outStats	Receives the stats. Index liveObjects with a type ID (e.g. CFLStringGetTypeID()).
+*/
+#define kCFLRuntimeStatsMaxTypes		16
+
+typedef struct
+{
+	size_t		liveObjects[ kCFLRuntimeStatsMaxTypes ];	// Live objects by type ID. Last entry includes higher type IDs.
+	size_t		bytesInUse;									// Bytes used by live objects, rounded up to their size class.
+	size_t		bytesReserved;								// Bytes held in slabs, including free objects.
+	size_t		numberCacheHits;							// Numbers created as shared small integers.
+	size_t		stringCacheHits;							// Strings created as shared interned strings.
+	size_t		allocationsAvoided;							// Allocations saved by cache hits.
+	
+}	CFLRuntimeStats;
+
+void	CFLRuntimeGetStats( CFLRuntimeStats *outStats );
+
 #if 0
 #pragma mark -
 #pragma mark == Debugging ==
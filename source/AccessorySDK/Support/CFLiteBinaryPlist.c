@@ -57,6 +57,7 @@
 #include "CommonServices.h"
 #include "DebugServices.h"
 #include "MiscUtils.h"
+#include "TickUtils.h"
 
 #if( TARGET_HAS_STD_C_LIB )
 	#include <limits.h>
@@ -82,6 +83,9 @@
 
 #define kMaxDepth								32
 
+#define kFNV1aOffsetBasis32						UINT32_C( 0x811C9DC5 )
+#define kFNV1aPrime32							UINT32_C( 0x01000193 )
+
 #define	kCFLBinaryPlistMarkerNull				0x00
 #define	kCFLBinaryPlistMarkerNullTerminator		0x01
 #define	kCFLBinaryPlistMarkerFalse				0x08
@@ -109,19 +113,8 @@
 
 typedef struct
 {
-	uint8_t*						ptr;
-	size_t							ptrSize;
-	size_t							ptrFull;
-	union
-	{
-		uint16_t					u16[ 128 ];
-		uint8_t						u8[ 256 ];
-		
-	}	tempBuf;
-	CFMutableArrayRef				array;
 	CFMutableDictionaryRef			uniqueDict;
 	CFIndex							uniqueCount;
-	size_t							bytesWritten;
 	uint8_t							objectRefSize;
 	uint8_t							offsetIntSize;
 	size_t							offsetTableOffset;
@@ -131,11 +124,8 @@ typedef struct
 #define CFBinaryPlistContextInit( CTX ) \
 	do \
 	{ \
-		(CTX)->ptr					= NULL; \
-		(CTX)->array				= NULL; \
 		(CTX)->uniqueDict			= NULL; \
 		(CTX)->uniqueCount			= 0; \
-		(CTX)->bytesWritten			= 0; \
 		(CTX)->objectRefSize		= 0; \
 		(CTX)->offsetIntSize		= 0; \
 		(CTX)->offsetTableOffset	= 0; \
@@ -145,18 +135,51 @@ typedef struct
 #define CFBinaryPlistContextFree( CTX ) \
 	do \
 	{ \
-		ForgetMem( &(CTX)->ptr ); \
-		ForgetCF( &(CTX)->array ); \
 		ForgetCF( &(CTX)->uniqueDict ); \
 		\
 	}	while( 0 )
 
+// CFBinaryPlistObject
+
+#define kCFBinaryPlistObjectHeaderMaxSize		17 // Marker + 16 byte integer.
+
+typedef struct
+{
+	const uint8_t *		ptr;		// Bytes written after the header (data or string characters).
+	size_t				len;		// Number of bytes at ptr.
+	uint8_t *			mem;		// Malloc'd buffer ptr points to if the string had to be converted.
+	uint32_t			hash;		// Hash of the header and bytes. Only used when uniquing.
+	uint32_t			refIndex;	// Index of the first object reference of an array or dictionary.
+	uint32_t			refCount;	// Number of object references of an array or dictionary.
+	uint8_t				headerLen;	// Number of bytes in header.
+	uint8_t				header[ kCFBinaryPlistObjectHeaderMaxSize ]; // Marker and count or the entire scalar object.
+	
+}	CFBinaryPlistObject;
+
+// CFBinaryPlistWriter
+
+typedef struct
+{
+	CFBinaryPlistFlags			flags;
+	CFBinaryPlistObject *		objects;			// Objects in the order they're written. The top-level object is first.
+	size_t						objectCount;
+	size_t						objectMax;
+	uint32_t *					refs;				// Object references of all arrays and dictionaries.
+	size_t						refCount;
+	size_t						refMax;
+	uint32_t *					uniqueTable;		// Open-addressed hash table of object index + 1 (0 means empty).
+	size_t						uniqueTableSize;	// Number of slots in uniqueTable. Always a power of 2.
+	size_t						dataSize;			// Total size of all objects, excluding object references.
+	
+}	CFBinaryPlistWriter;
+
 // CFBinaryPlistDictionaryApplierContext
 
 typedef struct
 {
-	CFBinaryPlistContext *		plistCtx;
-	CFDictionaryRef				dict;
+	CFBinaryPlistWriter *		writer;
+	size_t						keyRefIndex;
+	size_t						valueRefIndex;
 	OSStatus					err;
 	
 }	CFBinaryPlistDictionaryApplierContext;
@@ -190,16 +213,16 @@ check_compile_time( sizeof(   CFBinaryPlistTrailer )					== 32 );
 
 static void		_GlobalEnsureInitialized( void );
 
-static void		_FlattenPlist( CFBinaryPlistContext *ctx, CFTypeRef inObj );
-static void		_FlattenArray( const void *inValue, void *inContext );
-static void		_FlattenDictionaryKey( const void *inKey, const void *inValue, void *inContext );
-static void		_FlattenDictionaryValue( const void *inKey, const void *inValue, void *inContext );
+static OSStatus	_WriterAddObject( CFBinaryPlistWriter *w, CFTypeRef inObj, uint32_t *outRef );
+static void		_WriterAddDictionaryEntry( const void *inKey, const void *inValue, void *inContext );
+static OSStatus	_WriterAddUniqueObject( CFBinaryPlistWriter *w, CFBinaryPlistObject *inObj, uint32_t *outRef );
+static OSStatus	_WriterAppendObject( CFBinaryPlistWriter *w, CFBinaryPlistObject *inObj, uint32_t *outRef );
+static OSStatus	_WriterReserveRefs( CFBinaryPlistWriter *w, size_t inCount, size_t *outIndex );
+static OSStatus	_WriterGrowUniqueTable( CFBinaryPlistWriter *w );
+static void		_WriterFree( CFBinaryPlistWriter *w );
+static OSStatus	_InitString( CFBinaryPlistObject *inObj, CFStringRef inStr );
+static void		_InitNumber( CFBinaryPlistObject *inObj, CFNumberRef inNum );
 static Boolean	_ObjectsExactlyEqual( const void *a, const void *b );
-static void		_WriteV0ArrayValue( const void *inValue, void *inContext );
-static void		_WriteV0DictionaryKey( const void *inKey, const void *inValue, void *inContext );
-static void		_WriteV0DictionaryValue( const void *inKey, const void *inValue, void *inContext );
-static OSStatus	_WriteV0Object( CFBinaryPlistContext *inContext, CFTypeRef inObj );
-static OSStatus	_WriteV0String( CFBinaryPlistContext *ctx, CFStringRef inStr );
 
 CF_RETURNS_RETAINED
 static CFTypeRef
@@ -217,6 +240,15 @@ static OSStatus
 		const uint8_t **		ioPtr, 
 		size_t *				outOffset );
 
+static void		_CursorInitContext( CFBinaryPlistContext *ctx, const CFBinaryPlistCursor *inCursor );
+static OSStatus
+	_CursorReadHeader( 
+		const CFBinaryPlistCursor *	inCursor, 
+		uint8_t *					outMarker, 
+		uint64_t *					outCount, 
+		const uint8_t **			outPtr );
+static Boolean	_CursorStringEqual( const CFBinaryPlistCursor *inCursor, const char *inStr, size_t inLen );
+
 static OSStatus
 	_ReadInteger( 
 		const uint8_t **	ioPtr, 
@@ -228,9 +260,10 @@ static OSStatus
 		const uint8_t *		inEnd, 
 		size_t				inLen, 
 		uint64_t *			outValue );
-static OSStatus	_WriteBytes( CFBinaryPlistContext *inContext, const void *inData, size_t inSize );
-static OSStatus	_WriteInteger( CFBinaryPlistContext *ctx, uint64_t inValue );
-static OSStatus	_WriteNumber( CFBinaryPlistContext *ctx, CFNumberRef inNum );
+static void		_WriteSizedInteger( uint8_t *inPtr, size_t inLen, uint64_t inValue );
+static uint8_t	_EncodeInteger( uint8_t *inBuf, uint64_t inValue );
+static uint8_t	_EncodeCountHeader( uint8_t *inBuf, uint8_t inMarker, uint64_t inCount );
+static uint32_t	_HashBytes( uint32_t inHash, const uint8_t *inPtr, size_t inLen );
 
 //===========================================================================================================================
 //	Globals
@@ -273,79 +306,86 @@ static void	_GlobalEnsureInitialized( void )
 
 const void* CFBinaryPlistV0Create( CFTypeRef inObj, size_t *outSize, OSStatus *outErr )
 {
-	const void*						result = NULL;
+	return( CFBinaryPlistV0CreateEx( inObj, kCFBinaryPlistFlags_None, outSize, outErr ) );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistV0CreateEx
+//===========================================================================================================================
+
+const void *	CFBinaryPlistV0CreateEx( CFTypeRef inObj, CFBinaryPlistFlags inFlags, size_t *outSize, OSStatus *outErr )
+{
+	const void *					result = NULL;
 	OSStatus						err;
-	CFBinaryPlistContext			ctx;
-	CFDictionaryKeyCallBacks		dictCallbacks;
+	CFBinaryPlistWriter				writer;
 	CFBinaryPlistTrailer			trailer;
-	uint64_t *						offsets = NULL;
-	CFIndex							i;
-	CFTypeRef						obj;
-	uint8_t							buf[ 8 ];
+	const CFBinaryPlistObject *		obj;
+	uint32_t						ref;
+	size_t							objectRefSize, offsetIntSize, offsetTableOffset, len, i, j;
+	uint8_t *						buf = NULL;
+	uint8_t *						dst;
+	uint8_t *						offsetPtr;
 	
 	_GlobalEnsureInitialized();
-	CFBinaryPlistContextInit( &ctx );
-	
-	// Flatten the plist to an array of unique objects.
+	memset( &writer, 0, sizeof( writer ) );
+	writer.flags = inFlags;
 	
-	ctx.ptrSize = 1024;
-	ctx.ptr = malloc( ctx.ptrSize );
-	require_action( ctx.ptr, exit, err = kNoMemoryErr );
-	ctx.ptrFull = 0;
+	// Flatten the plist to a table of objects with the top-level object first. This also sums up the size of each 
+	// object so the exact size of the output is known before writing it.
 	
-	ctx.array = CFArrayCreateMutable( NULL, 0, NULL );
-	require_action( ctx.array, exit, err = kNoMemoryErr );
-	
-	dictCallbacks			= kCFTypeDictionaryKeyCallBacks;
-	dictCallbacks.equal		= _ObjectsExactlyEqual;
-	dictCallbacks.retain	= NULL;
-	dictCallbacks.release	= NULL;
-	ctx.uniqueDict = CFDictionaryCreateMutable( NULL, 0, &dictCallbacks, NULL );
-	require_action( ctx.uniqueDict, exit, err = kNoMemoryErr );
-	
-	_FlattenPlist( &ctx, inObj );
-	check( ctx.uniqueCount > 0 );
-	
-	// Write the header and object table.
-	
-	err = _WriteBytes( &ctx, "bplist00", 8 );
+	err = _WriterAddObject( &writer, inObj, &ref );
 	require_noerr( err, exit );
+	check( ref == 0 );
 	
-	memset( &trailer, 0, sizeof( trailer ) );
-	trailer.numObjects		= hton64( ctx.uniqueCount );
-	trailer.objectRefSize	= MinPowerOf2BytesForValue( (uint64_t) ctx.uniqueCount );
-	ctx.objectRefSize		= trailer.objectRefSize;
+	objectRefSize		= MinPowerOf2BytesForValue( (uint64_t) writer.objectCount );
+	offsetTableOffset	= 8 + writer.dataSize + ( writer.refCount * objectRefSize );
+	offsetIntSize		= MinPowerOf2BytesForValue( (uint64_t) offsetTableOffset );
+	len					= offsetTableOffset + ( writer.objectCount * offsetIntSize ) + sizeof( trailer );
+	buf = (uint8_t *) malloc( len );
+	require_action( buf, exit, err = kNoMemoryErr );
+	
+	// Write the header, the object table, and the offsets table in one pass.
 	
-	offsets = (uint64_t *) malloc( ( (size_t) ctx.uniqueCount ) * sizeof( *offsets ) );
-	require_action( offsets, exit, err = kNoMemoryErr );
-	for( i = 0; i < ctx.uniqueCount; ++i )
+	memcpy( buf, "bplist00", 8 );
+	dst = buf + 8;
+	offsetPtr = buf + offsetTableOffset;
+	for( i = 0; i < writer.objectCount; ++i )
 	{
-		offsets[ i ] = ctx.bytesWritten;
-		obj = CFArrayGetValueAtIndex( ctx.array, i );
-		err = _WriteV0Object( &ctx, obj );
-		require_noerr( err, exit );
+		obj = &writer.objects[ i ];
+		_WriteSizedInteger( offsetPtr, offsetIntSize, (uint64_t)( dst - buf ) );
+		offsetPtr += offsetIntSize;
+		
+		memcpy( dst, obj->header, obj->headerLen );
+		dst += obj->headerLen;
+		if( obj->len > 0 )
+		{
+			memcpy( dst, obj->ptr, obj->len );
+			dst += obj->len;
+		}
+		for( j = 0; j < obj->refCount; ++j )
+		{
+			_WriteSizedInteger( dst, objectRefSize, writer.refs[ obj->refIndex + j ] );
+			dst += objectRefSize;
+		}
 	}
+	check( dst == ( buf + offsetTableOffset ) );
 	
-	// Write the offsets table and trailer.
+	// Write the trailer.
 	
-	trailer.offsetTableOffset	= hton64( ctx.bytesWritten );
-	trailer.offsetIntSize		= MinPowerOf2BytesForValue( ctx.bytesWritten );
-	for( i = 0; i < ctx.uniqueCount; ++i )
-	{
-		WriteBig64( buf, offsets[ i ] );
-		err = _WriteBytes( &ctx, buf + ( sizeof( *offsets ) - trailer.offsetIntSize ), trailer.offsetIntSize );
-		require_noerr( err, exit );
-	}
-	err = _WriteBytes( &ctx, &trailer, sizeof( trailer ) );
-	require_noerr( err, exit );
+	memset( &trailer, 0, sizeof( trailer ) );
+	trailer.offsetIntSize		= (uint8_t) offsetIntSize;
+	trailer.objectRefSize		= (uint8_t) objectRefSize;
+	trailer.numObjects			= hton64( (uint64_t) writer.objectCount );
+	trailer.offsetTableOffset	= hton64( (uint64_t) offsetTableOffset );
+	memcpy( offsetPtr, &trailer, sizeof( trailer ) );
 	
-	result = ctx.ptr;
-	*outSize = ctx.ptrFull;
-	ctx.ptr = NULL;
+	result = buf;
+	*outSize = len;
+	buf = NULL;
 	
 exit:
-	FreeNullSafe( offsets );
-	CFBinaryPlistContextFree( &ctx );
+	FreeNullSafe( buf );
+	_WriterFree( &writer );
 	if( outErr ) *outErr = err;
 	return( result );
 }
@@ -364,261 +404,305 @@ CFDataRef	CFBinaryPlistV0CreateData( CFTypeRef inObj, OSStatus *outErr )
 }
 
 //===========================================================================================================================
-//	_FlattenPlist
+//	_WriterAddObject
 //===========================================================================================================================
 
-static void	_FlattenPlist( CFBinaryPlistContext *ctx, CFTypeRef inObj )
+static OSStatus	_WriterAddObject( CFBinaryPlistWriter *w, CFTypeRef inObj, uint32_t *outRef )
 {
-	CFTypeID		type;
-	CFIndex			oldCount;
-	
-	// Add the object and if the count doesn't change, it means the object was already there so we can skip it.
-	// This doesn't unique arrays or dictionaries because it's slow and they have poor hash functions.
-	
-	oldCount = CFDictionaryGetCount( ctx->uniqueDict );
-	CFDictionaryAddValue( ctx->uniqueDict, inObj, (const void *)(uintptr_t) ctx->uniqueCount );
-	
+	OSStatus									err;
+	CFBinaryPlistObject							obj;
+	CFTypeID									type;
+	CFIndex										count, i;
+	size_t										refIndex;
+	uint32_t									ref;
+	Value64										v;
+	CFBinaryPlistDictionaryApplierContext		applierCtx;
+	
+	memset( &obj, 0, sizeof( obj ) );
 	type = CFGetTypeID( inObj );
-	if( ( type == gCFStringType )  || 
-		( type == gCFNumberType )  ||
-		( type == gCFBooleanType ) || 
-		( type == gCFDataType )    || 
-		( type == gCFDateType ) )
+	if( type == gCFStringType )
 	{
-		if( CFDictionaryGetCount( ctx->uniqueDict ) == oldCount )
-		{
-			return;
-		}
+		err = _InitString( &obj, (CFStringRef) inObj );
+		require_noerr( err, exit );
 	}
-	CFArrayAppendValue( ctx->array, inObj );
-	++ctx->uniqueCount;
-	
-	if( type == gCFDictionaryType )
+	else if( type == gCFNumberType )
 	{
-		CFDictionaryApplyFunction( (CFDictionaryRef) inObj, _FlattenDictionaryKey, ctx );
-		CFDictionaryApplyFunction( (CFDictionaryRef) inObj, _FlattenDictionaryValue, ctx );
+		_InitNumber( &obj, (CFNumberRef) inObj );
 	}
-	else if( type == gCFArrayType )
+	else if( type == gCFBooleanType )
 	{
-		CFArrayApplyFunction( (CFArrayRef) inObj, CFRangeMake( 0, CFArrayGetCount( (CFArrayRef) inObj ) ), _FlattenArray, ctx );
+		obj.header[ 0 ] = ( inObj == kCFBooleanTrue ) ? kCFLBinaryPlistMarkerTrue : kCFLBinaryPlistMarkerFalse;
+		obj.headerLen = 1;
 	}
-}
-
-static void	_FlattenArray( const void *inValue, void *inContext )
-{
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
+	else if( type == gCFDataType )
+	{
+		obj.ptr = CFDataGetBytePtr( (CFDataRef) inObj );
+		obj.len = (size_t) CFDataGetLength( (CFDataRef) inObj );
+		obj.headerLen = _EncodeCountHeader( obj.header, kCFLBinaryPlistMarkerData, obj.len );
+	}
+	else if( type == gCFDateType )
+	{
+		v.f64 = CFDateGetAbsoluteTime( (CFDateRef) inObj );
+		obj.header[ 0 ] = kCFLBinaryPlistMarkerDateFloat;
+		WriteBig64( &obj.header[ 1 ], v.u64 );
+		obj.headerLen = 9;
+	}
+	else if( inObj == ( (CFTypeRef) kCFNull ) )
+	{
+		obj.header[ 0 ] = kCFLBinaryPlistMarkerNull;
+		obj.headerLen = 1;
+	}
+	else if( ( type == gCFDictionaryType ) || ( type == gCFArrayType ) )
+	{
+		// Arrays and dictionaries aren't uniqued because comparing them is slow. Their references are reserved before 
+		// adding what they contain so the references of each one are contiguous.
+		
+		if( type == gCFDictionaryType )
+		{
+			count = CFDictionaryGetCount( (CFDictionaryRef) inObj );
+			obj.headerLen = _EncodeCountHeader( obj.header, kCFLBinaryPlistMarkerDictionary, (uint64_t) count );
+			obj.refCount = (uint32_t)( count * 2 );
+		}
+		else
+		{
+			count = CFArrayGetCount( (CFArrayRef) inObj );
+			obj.headerLen = _EncodeCountHeader( obj.header, kCFLBinaryPlistMarkerArray, (uint64_t) count );
+			obj.refCount = (uint32_t) count;
+		}
+		err = _WriterReserveRefs( w, obj.refCount, &refIndex );
+		require_noerr( err, exit );
+		obj.refIndex = (uint32_t) refIndex;
+		err = _WriterAppendObject( w, &obj, outRef );
+		require_noerr( err, exit );
+		
+		if( type == gCFDictionaryType )
+		{
+			applierCtx.writer			= w;
+			applierCtx.keyRefIndex		= refIndex;
+			applierCtx.valueRefIndex	= refIndex + ( (size_t) count );
+			applierCtx.err				= kNoErr;
+			CFDictionaryApplyFunction( (CFDictionaryRef) inObj, _WriterAddDictionaryEntry, &applierCtx );
+			err = applierCtx.err;
+			require_noerr_quiet( err, exit );
+		}
+		else
+		{
+			for( i = 0; i < count; ++i )
+			{
+				err = _WriterAddObject( w, CFArrayGetValueAtIndex( (CFArrayRef) inObj, i ), &ref );
+				require_noerr_quiet( err, exit );
+				w->refs[ refIndex + ( (size_t) i ) ] = ref;
+			}
+		}
+		goto exit;
+	}
+	else
+	{
+		dlogassert( "Unsupported object type: %lu", type );
+		err = kUnsupportedDataErr;
+		goto exit;
+	}
+	
+	err = _WriterAddUniqueObject( w, &obj, outRef );
+	require_noerr( err, exit );
 	
-	_FlattenPlist( ctx, inValue );
+exit:
+	FreeNullSafe( obj.mem );
+	return( err );
 }
 
-static void	_FlattenDictionaryKey( const void *inKey, const void *inValue, void *inContext )
+//===========================================================================================================================
+//	_WriterAddDictionaryEntry
+//===========================================================================================================================
+
+static void	_WriterAddDictionaryEntry( const void *inKey, const void *inValue, void *inContext )
 {
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
+	CFBinaryPlistDictionaryApplierContext * const		ctx = (CFBinaryPlistDictionaryApplierContext *) inContext;
+	uint32_t											ref;
 	
-	(void) inValue;
+	if( ctx->err ) return;
 	
-	_FlattenPlist( ctx, inKey );
-}
-
-static void	_FlattenDictionaryValue( const void *inKey, const void *inValue, void *inContext )
-{
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
+	ctx->err = _WriterAddObject( ctx->writer, inKey, &ref );
+	require_noerr_quiet( ctx->err, exit );
+	ctx->writer->refs[ ctx->keyRefIndex++ ] = ref;
 	
-	(void) inKey;
+	ctx->err = _WriterAddObject( ctx->writer, inValue, &ref );
+	require_noerr_quiet( ctx->err, exit );
+	ctx->writer->refs[ ctx->valueRefIndex++ ] = ref;
 	
-	_FlattenPlist( ctx, inValue );
+exit:
+	return;
 }
 
 //===========================================================================================================================
-//	_ObjectsExactlyEqual
-//
-//	This is needed because we need exact matches to avoid lossy roundtrip conversions:
+//	_WriterAddUniqueObject
 //
-//	1. CFEqual will treat kCFBooleanFalse == CFNumber(0) and kCFBooleanTrue == CFNumber(1).
-//	2. CFEqual will treat CFNumber( 1.0 ) == CFNumber( 1 ).
+//	Adds a scalar, string, or data object unless an object with the same encoding was already added. Objects are only 
+//	equal if they encode to the same bytes so booleans never match numbers and integers never match reals.
 //===========================================================================================================================
 
-static Boolean	_ObjectsExactlyEqual( const void *a, const void *b )
+static OSStatus	_WriterAddUniqueObject( CFBinaryPlistWriter *w, CFBinaryPlistObject *inObj, uint32_t *outRef )
 {
-	CFTypeID const		aType = CFGetTypeID( a );
-	CFTypeID const		bType = CFGetTypeID( b );
+	OSStatus						err;
+	size_t							mask, i;
+	uint32_t						slot;
+	const CFBinaryPlistObject *		other;
 	
-	if( ( aType == bType ) && CFEqual( a, b ) )
+	if( w->flags & kCFBinaryPlistFlag_NoUniquing )
 	{
-		if( aType != gCFNumberType )
-		{
-			return( true );
-		}
-		if( CFNumberIsFloatType( (CFNumberRef) a ) == CFNumberIsFloatType( (CFNumberRef) b ) )
+		err = _WriterAppendObject( w, inObj, outRef );
+		require_noerr( err, exit );
+		goto exit;
+	}
+	
+	inObj->hash = _HashBytes( _HashBytes( kFNV1aOffsetBasis32, inObj->header, inObj->headerLen ), inObj->ptr, inObj->len );
+	if( ( ( w->objectCount + 1 ) * 2 ) > w->uniqueTableSize )
+	{
+		err = _WriterGrowUniqueTable( w );
+		require_noerr( err, exit );
+	}
+	mask = w->uniqueTableSize - 1;
+	for( i = inObj->hash & mask; ( slot = w->uniqueTable[ i ] ) != 0; i = ( i + 1 ) & mask )
+	{
+		other = &w->objects[ slot - 1 ];
+		if( ( other->hash == inObj->hash ) && 
+			( other->headerLen == inObj->headerLen ) && 
+			( other->len == inObj->len ) && 
+			( memcmp( other->header, inObj->header, inObj->headerLen ) == 0 ) && 
+			( ( inObj->len == 0 ) || ( memcmp( other->ptr, inObj->ptr, inObj->len ) == 0 ) ) )
 		{
-			return( true );
+			*outRef = slot - 1;
+			err = kNoErr;
+			goto exit;
 		}
 	}
-	return( false );
+	err = _WriterAppendObject( w, inObj, outRef );
+	require_noerr( err, exit );
+	w->uniqueTable[ i ] = *outRef + 1;
+	
+exit:
+	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteV0Object
+//	_WriterAppendObject
+//
+//	Appends an object to the object table. The table takes ownership of the object's memory.
 //===========================================================================================================================
 
-static OSStatus	_WriteV0Object( CFBinaryPlistContext *ctx, CFTypeRef inObj )
+static OSStatus	_WriterAppendObject( CFBinaryPlistWriter *w, CFBinaryPlistObject *inObj, uint32_t *outRef )
 {
-	OSStatus		err;
-	CFTypeID		type;
-	uint8_t			marker;
-	Value64			v;
-	CFIndex			count;
+	OSStatus					err;
+	CFBinaryPlistObject *		objects;
+	size_t						newMax;
 	
-	type = CFGetTypeID( inObj );
-	if( type == gCFStringType )
-	{
-		err = _WriteV0String( ctx, (CFStringRef) inObj );
-		require_noerr( err, exit );
-	}
-	else if( type == gCFNumberType )
-	{
-		err = _WriteNumber( ctx, (CFNumberRef) inObj );
-		require_noerr( err, exit );
-	}
-	else if( type == gCFBooleanType )
-	{
-		marker = ( inObj == kCFBooleanTrue ) ? kCFLBinaryPlistMarkerTrue : kCFLBinaryPlistMarkerFalse;
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-	}
-	else if( type == gCFDataType )
-	{
-		count = CFDataGetLength( (CFDataRef) inObj );
-		marker = (uint8_t)( kCFLBinaryPlistMarkerData | ( ( count < 15 ) ? count : 0xF ) );
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-		if( count >= 15 )
-		{
-			err = _WriteInteger( ctx, (uint64_t) count );
-			require_noerr( err, exit );
-		}
-		err = _WriteBytes( ctx, CFDataGetBytePtr( (CFDataRef) inObj ), (size_t) count );
-		require_noerr( err, exit );
-	}
-	else if( type == gCFDictionaryType )
-	{
-		count = CFDictionaryGetCount( (CFDictionaryRef) inObj );
-		marker = (uint8_t)( kCFLBinaryPlistMarkerDictionary | ( ( count < 15 ) ? count : 0xF ) );
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-		if( count >= 15 )
-		{
-			err = _WriteInteger( ctx, (uint64_t) count );
-			require_noerr( err, exit );
-		}
-		CFDictionaryApplyFunction( (CFDictionaryRef) inObj, _WriteV0DictionaryKey, ctx );
-		CFDictionaryApplyFunction( (CFDictionaryRef) inObj, _WriteV0DictionaryValue, ctx );
-	}
-	else if( type == gCFArrayType )
-	{
-		count = CFArrayGetCount( (CFArrayRef) inObj );
-		marker = (uint8_t)( kCFLBinaryPlistMarkerArray | ( ( count < 15 ) ? count : 0xF ) );
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-		if( count >= 15 )
-		{
-			err = _WriteInteger( ctx, (uint64_t) count );
-			require_noerr( err, exit );
-		}
-		CFArrayApplyFunction( (CFArrayRef) inObj, CFRangeMake( 0, count ), _WriteV0ArrayValue, ctx );
-	}
-	else if( type == gCFDateType )
-	{
-		marker = kCFLBinaryPlistMarkerDateFloat;
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-		
-		v.f64 = CFDateGetAbsoluteTime( (CFDateRef) inObj );
-		v.u64 = hton64( v.u64 );
-		err = _WriteBytes( ctx, &v.u64, 8 );
-		require_noerr( err, exit );
-	}
-	else if( inObj == ( (CFTypeRef) kCFNull ) )
-	{
-		marker = kCFLBinaryPlistMarkerNull;
-		err = _WriteBytes( ctx, &marker, 1 );
-		require_noerr( err, exit );
-	}
-	else
+	if( w->objectCount >= w->objectMax )
 	{
-		dlogassert( "Unsupported object type: %lu", type );
-		err = kUnsupportedDataErr;
-		goto exit;
+		require_action( w->objectCount < UINT32_MAX, exit, err = kSizeErr );
+		newMax = ( w->objectMax > 0 ) ? ( w->objectMax * 2 ) : 64;
+		objects = (CFBinaryPlistObject *) realloc( w->objects, newMax * sizeof( *objects ) );
+		require_action( objects, exit, err = kNoMemoryErr );
+		w->objects = objects;
+		w->objectMax = newMax;
 	}
+	w->objects[ w->objectCount ] = *inObj;
+	inObj->mem = NULL;
+	*outRef = (uint32_t) w->objectCount++;
+	w->dataSize += ( inObj->headerLen + inObj->len );
+	err = kNoErr;
 	
 exit:
 	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteV0ArrayValue
+//	_WriterReserveRefs
 //===========================================================================================================================
 
-static void	_WriteV0ArrayValue( const void *inValue, void *inContext )
+static OSStatus	_WriterReserveRefs( CFBinaryPlistWriter *w, size_t inCount, size_t *outIndex )
 {
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
-	uint32_t							refnum;
-	uint8_t								buf[ 4 ];
+	OSStatus		err;
+	uint32_t *		refs;
+	size_t			newMax;
+	
+	if( ( w->refCount + inCount ) > w->refMax )
+	{
+		require_action( ( w->refCount + inCount ) < UINT32_MAX, exit, err = kSizeErr );
+		newMax = ( w->refMax > 0 ) ? ( w->refMax * 2 ) : 256;
+		while( newMax < ( w->refCount + inCount ) ) newMax *= 2;
+		refs = (uint32_t *) realloc( w->refs, newMax * sizeof( *refs ) );
+		require_action( refs, exit, err = kNoMemoryErr );
+		w->refs = refs;
+		w->refMax = newMax;
+	}
+	*outIndex = w->refCount;
+	w->refCount += inCount;
+	err = kNoErr;
 	
-	refnum = (uint32_t)(uintptr_t) CFDictionaryGetValue( ctx->uniqueDict, inValue );
-	WriteBig32( buf, refnum );
-	_WriteBytes( ctx, buf + ( 4 - ctx->objectRefSize ), ctx->objectRefSize );
+exit:
+	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteV0DictionaryKey
+//	_WriterGrowUniqueTable
 //===========================================================================================================================
 
-static void	_WriteV0DictionaryKey( const void *inKey, const void *inValue, void *inContext )
+static OSStatus	_WriterGrowUniqueTable( CFBinaryPlistWriter *w )
 {
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
-	uint32_t							refnum;
-	uint8_t								buf[ 4 ];
+	OSStatus		err;
+	uint32_t *		table;
+	size_t			size, mask, i, j;
+	uint8_t			marker;
 	
-	(void) inValue;
+	size = ( w->uniqueTableSize > 0 ) ? ( w->uniqueTableSize * 2 ) : 64;
+	while( size < ( ( w->objectCount + 1 ) * 2 ) ) size *= 2;
+	table = (uint32_t *) calloc( size, sizeof( *table ) );
+	require_action( table, exit, err = kNoMemoryErr );
+	
+	mask = size - 1;
+	for( i = 0; i < w->objectCount; ++i )
+	{
+		marker = w->objects[ i ].header[ 0 ] & 0xF0;
+		if( ( marker == kCFLBinaryPlistMarkerArray ) || ( marker == kCFLBinaryPlistMarkerDictionary ) ) continue;
+		for( j = w->objects[ i ].hash & mask; table[ j ] != 0; j = ( j + 1 ) & mask ) {}
+		table[ j ] = (uint32_t)( i + 1 );
+	}
+	FreeNullSafe( w->uniqueTable );
+	w->uniqueTable = table;
+	w->uniqueTableSize = size;
+	err = kNoErr;
 	
-	refnum = (uint32_t)(uintptr_t) CFDictionaryGetValue( ctx->uniqueDict, inKey );
-	WriteBig32( buf, refnum );
-	_WriteBytes( ctx, buf + ( 4 - ctx->objectRefSize ), ctx->objectRefSize );
+exit:
+	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteV0DictionaryValue
+//	_WriterFree
 //===========================================================================================================================
 
-static void	_WriteV0DictionaryValue( const void *inKey, const void *inValue, void *inContext )
+static void	_WriterFree( CFBinaryPlistWriter *w )
 {
-	CFBinaryPlistContext * const		ctx = (CFBinaryPlistContext *) inContext;
-	uint32_t							refnum;
-	uint8_t								buf[ 4 ];
+	size_t		i;
 	
-	(void) inKey;
-	
-	refnum = (uint32_t)(uintptr_t) CFDictionaryGetValue( ctx->uniqueDict, inValue );
-	WriteBig32( buf, refnum );
-	_WriteBytes( ctx, buf + ( 4 - ctx->objectRefSize ), ctx->objectRefSize );
+	for( i = 0; i < w->objectCount; ++i )
+	{
+		FreeNullSafe( w->objects[ i ].mem );
+	}
+	ForgetMem( &w->objects );
+	ForgetMem( &w->refs );
+	ForgetMem( &w->uniqueTable );
 }
 
 //===========================================================================================================================
-//	_WriteV0String
+//	_InitString
 //===========================================================================================================================
 
-static OSStatus	_WriteV0String( CFBinaryPlistContext *ctx, CFStringRef inStr )
+static OSStatus	_InitString( CFBinaryPlistObject *inObj, CFStringRef inStr )
 {
 	OSStatus			err;
 	const uint8_t *		src;
-	uint8_t *			utf8;
 	uint8_t *			utf8Buf = NULL;
-#if( ( TARGET_OS_DARWIN && !COMMON_SERVICES_NO_CORE_SERVICES ) || CFCOMPAT_HAS_UNICODE_SUPPORT )
-	uint16_t *			utf16Buf = NULL;
-#endif
-	size_t				len, i, count;
-	uint8_t				marker;
+	size_t				len, i;
 	CFIndex				nBytes;
 	CFRange				range;
 	
@@ -631,20 +715,11 @@ static OSStatus	_WriteV0String( CFBinaryPlistContext *ctx, CFStringRef inStr )
 	{
 		range = CFRangeMake( 0, CFStringGetLength( inStr ) );
 		nBytes = CFStringGetMaximumSizeForEncoding( range.length, kCFStringEncodingUTF8 );
-		if( nBytes < (CFIndex) sizeof( ctx->tempBuf ) )
-		{
-			utf8 = ctx->tempBuf.u8;
-		}
-		else
-		{
-			utf8Buf = (uint8_t *) malloc( (size_t)( nBytes + 1 ) );
-			require_action( utf8Buf, exit, err = kNoMemoryErr );
-			utf8 = utf8Buf;
-		}
-		range.location = CFStringGetBytes( inStr, range, kCFStringEncodingUTF8, 0, false, utf8, nBytes, &nBytes );
+		utf8Buf = (uint8_t *) malloc( (size_t)( nBytes + 1 ) );
+		require_action( utf8Buf, exit, err = kNoMemoryErr );
+		range.location = CFStringGetBytes( inStr, range, kCFStringEncodingUTF8, 0, false, utf8Buf, nBytes, &nBytes );
 		require_action( range.location == range.length, exit, err = kUnknownErr );
-		utf8[ nBytes ] = '\0';
-		src = utf8;
+		src = utf8Buf;
 		len = (size_t) nBytes;
 	}
 	
@@ -653,146 +728,140 @@ static OSStatus	_WriteV0String( CFBinaryPlistContext *ctx, CFStringRef inStr )
 	for( i = 0; ( i < len ) && !( src[ i ] & 0x80 ); ++i ) {}
 	if( i == len )
 	{
-		marker = kCFLBinaryPlistMarkerASCIIString;
-		count  = len;
+		inObj->headerLen	= _EncodeCountHeader( inObj->header, kCFLBinaryPlistMarkerASCIIString, len );
+		inObj->ptr			= src;
+		inObj->len			= len;
+		inObj->mem			= utf8Buf;
+		utf8Buf				= NULL;
 	}
 	else
 	{
 		#if( TARGET_OS_DARWIN && !COMMON_SERVICES_NO_CORE_SERVICES )
-			uint16_t *		utf16;
-			
-			ForgetMem( &utf8Buf );
 			range = CFRangeMake( 0, CFStringGetLength( inStr ) );
 			nBytes = CFStringGetMaximumSizeForEncoding( range.length, kCFStringEncodingUTF16BE );
-			if( nBytes <= (CFIndex) sizeof( ctx->tempBuf ) )
-			{
-				utf16 = ctx->tempBuf.u16;
-			}
-			else
-			{
-				utf16Buf = (uint16_t *) malloc( (size_t) nBytes );
-				require_action( utf16Buf, exit, err = kNoMemoryErr );
-				utf16 = utf16Buf;
-			}
-			range.location = CFStringGetBytes( inStr, range, kCFStringEncodingUTF16BE, 0, false, (uint8_t *) utf16, nBytes, &nBytes );
+			inObj->mem = (uint8_t *) malloc( (size_t) nBytes );
+			require_action( inObj->mem, exit, err = kNoMemoryErr );
+			range.location = CFStringGetBytes( inStr, range, kCFStringEncodingUTF16BE, 0, false, inObj->mem, nBytes, &nBytes );
 			require_action( range.location == range.length, exit, err = kUnknownErr );
-			
-			marker = kCFLBinaryPlistMarkerUnicodeString;
-			src    = (const uint8_t *) utf16;
-			len    = (size_t) nBytes;
-			count  = len / 2;
+			len = (size_t) nBytes;
 		#elif( CFCOMPAT_HAS_UNICODE_SUPPORT )
-			err = utf8_decodestr_copy( src, len, &utf16Buf, &len, 0, UTF_BIG_ENDIAN );
+			inObj->mem = (uint8_t *) malloc( len * sizeof( uint16_t ) );
+			require_action( inObj->mem, exit, err = kNoMemoryErr );
+			err = utf8_decodestr( src, len, (uint16_t *) inObj->mem, &len, len * sizeof( uint16_t ), 0, UTF_BIG_ENDIAN );
 			require_noerr( err, exit );
-			
-			marker = kCFLBinaryPlistMarkerUnicodeString;
-			src    = (const uint8_t *) utf16Buf;
-			count  = len / 2;
 		#else
 			dlogassert( "UTF-16 required, but conversion code stripped out" );
 			err = kUnsupportedDataErr;
 			goto exit;
 		#endif
+		
+		inObj->headerLen	= _EncodeCountHeader( inObj->header, kCFLBinaryPlistMarkerUnicodeString, len / 2 );
+		inObj->ptr			= inObj->mem;
+		inObj->len			= len;
 	}
-	
-	marker |= ( ( count < 15 ) ? count : 0xF );
-	err = _WriteBytes( ctx, &marker, 1 );
-	require_noerr( err, exit );
-	if( count >= 15 )
-	{
-		err = _WriteInteger( ctx, count );
-		require_noerr( err, exit );
-	}
-	err = _WriteBytes( ctx, src, len );
-	require_noerr( err, exit );
+	err = kNoErr;
 	
 exit:
 	FreeNullSafe( utf8Buf );
-#if( TARGET_OS_DARWIN && !COMMON_SERVICES_NO_CORE_SERVICES )
-	FreeNullSafe( utf16Buf );
-#elif( CFCOMPAT_HAS_UNICODE_SUPPORT )
-	if( utf16Buf ) utffree( utf16Buf );
-#endif
 	return( err );
 }
 
-#if 0
-#pragma mark -
-#endif
-
 //===========================================================================================================================
-//	CFBinaryPlistV0CreateWithData
+//	_InitNumber
 //===========================================================================================================================
 
-CFPropertyListRef	CFBinaryPlistV0CreateWithData( const void *inPtr, size_t inLen, OSStatus *outErr )
+static void	_InitNumber( CFBinaryPlistObject *inObj, CFNumberRef inNum )
 {
-	const uint8_t *					src   = (const uint8_t *) inPtr;
-	const uint8_t *					end   = src + inLen;
-	CFPropertyListRef				plist = NULL;
-	CFBinaryPlistContext			ctx;
-	OSStatus						err;
-	CFDictionaryValueCallBacks		dictCallbacks;
-	CFBinaryPlistTrailer			trailer;
-	uint64_t						offset;
-	const uint8_t *					ptr;
-	
-	CFBinaryPlistContextInit( &ctx );
+	uint8_t * const		buf = inObj->header;
+	Value64				v;
 	
-	// Sanity check the header/trailer up front to speed up batch checking of arbitrary files.
-	
-	require_action_quiet( src < end, exit, err = kSizeErr );
-	require_action_quiet( inLen > ( 8 + sizeof( trailer ) ), exit, err = kSizeErr );
-	require_action_quiet( memcmp( src, "bplist00", 8 ) == 0, exit, err = kFormatErr );
-	memcpy( &trailer, end - sizeof( trailer ), sizeof( trailer ) );
-	end -= sizeof( trailer );
-	
-	require_action_quiet( 
-		( trailer.offsetIntSize == 1 ) || 
-		( trailer.offsetIntSize == 2 ) ||
-		( trailer.offsetIntSize == 4 ) ||
-		( trailer.offsetIntSize == 8 ), exit, err = kMalformedErr );
-	require_action_quiet( 
-		( trailer.objectRefSize == 1 ) || 
-		( trailer.objectRefSize == 2 ) ||
-		( trailer.objectRefSize == 4 ) ||
-		( trailer.objectRefSize == 8 ), exit, err = kMalformedErr );
-	
-	trailer.numObjects = ntoh64( trailer.numObjects );
-	require_action_quiet( trailer.numObjects > 0, exit, err = kCountErr );
-	
-	trailer.topObject = ntoh64( trailer.topObject );
-	require_action_quiet( trailer.topObject < trailer.numObjects, exit, err = kRangeErr );
+	if( CFNumberIsFloatType( inNum ) )
+	{
+		if( CFNumberGetByteSize( inNum ) <= ( (CFIndex) sizeof( Float32 ) ) )
+		{
+			CFNumberGetValue( inNum, kCFNumberFloat32Type, &v.f32[ 0 ] );
+			
+			buf[ 0 ] = kCFLBinaryPlistMarkerReal | 2; // 2 for 2^2 = 4 byte Float32.
+			WriteBigFloat32( &buf[ 1 ], v.f32[ 0 ] );
+			inObj->headerLen = 5;
+		}
+		else
+		{
+			CFNumberGetValue( inNum, kCFNumberFloat64Type, &v.f64 );
+			
+			buf[ 0 ] = kCFLBinaryPlistMarkerReal | 3; // 2 for 2^3 = 8 byte Float64.
+			WriteBigFloat64( &buf[ 1 ], v.f64 );
+			inObj->headerLen = 9;
+		}
+	}
+	else if( CFNumberGetType( inNum ) == kCFNumberSInt128Type_compat )
+	{
+		int128_compat		u128;
+		
+		CFNumberGetValue( inNum, kCFNumberSInt128Type_compat, &u128 );
+		
+		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 4;
+		WriteBig64( &buf[ 1 ], u128.hi );
+		WriteBig64( &buf[ 9 ], u128.lo );
+		inObj->headerLen = 17;
+	}
+	else
+	{
+		CFNumberGetValue( inNum, kCFNumberSInt64Type, &v.u64 );
+		
+		inObj->headerLen = _EncodeInteger( buf, v.u64 );
+	}
+}
+
+//===========================================================================================================================
+//	_ObjectsExactlyEqual
+//
+//	This is needed because we need exact matches to avoid lossy roundtrip conversions:
+//
+//	1. CFEqual will treat kCFBooleanFalse == CFNumber(0) and kCFBooleanTrue == CFNumber(1).
+//	2. CFEqual will treat CFNumber( 1.0 ) == CFNumber( 1 ).
+//===========================================================================================================================
+
+static Boolean	_ObjectsExactlyEqual( const void *a, const void *b )
+{
+	CFTypeID const		aType = CFGetTypeID( a );
+	CFTypeID const		bType = CFGetTypeID( b );
 	
-	trailer.offsetTableOffset = ntoh64( trailer.offsetTableOffset );
-	require_action_quiet( trailer.offsetTableOffset >= 9, exit, err = kMalformedErr );
-	require_action_quiet( trailer.offsetTableOffset < ( inLen - sizeof( trailer ) ), exit, err = kMalformedErr );
-	require_action_quiet( trailer.numObjects <= 
-		( ( (size_t)( end - ( src + trailer.offsetTableOffset ) ) ) / trailer.offsetIntSize ), exit, err = kCountErr );
+	if( ( aType == bType ) && CFEqual( a, b ) )
+	{
+		if( aType != gCFNumberType )
+		{
+			return( true );
+		}
+		if( CFNumberIsFloatType( (CFNumberRef) a ) == CFNumberIsFloatType( (CFNumberRef) b ) )
+		{
+			return( true );
+		}
+	}
+	return( false );
+}
+
+#if 0
+#pragma mark -
+#endif
+
+//===========================================================================================================================
+//	CFBinaryPlistV0CreateWithData
+//===========================================================================================================================
+
+CFPropertyListRef	CFBinaryPlistV0CreateWithData( const void *inPtr, size_t inLen, OSStatus *outErr )
+{
+	CFPropertyListRef		plist = NULL;
+	OSStatus				err;
+	CFBinaryPlistCursor		cursor;
 	
-	offset = trailer.offsetTableOffset + ( trailer.topObject * trailer.offsetIntSize );
-	require_action_quiet( offset < ( (uint64_t)( end - src ) ), exit, err = kRangeErr );
-	ptr = src + offset;
-	err = _ReadSizedInteger( &ptr, end, trailer.offsetIntSize, &offset );
+	err = CFBinaryPlistCursorInit( &cursor, inPtr, inLen );
 	require_noerr_quiet( err, exit );
 	
-	// Read the root object (and any objects it contains).
-	
-	_GlobalEnsureInitialized();
-	ctx.uniqueCount			= (CFIndex) trailer.numObjects;
-	ctx.offsetIntSize		= trailer.offsetIntSize;
-	ctx.objectRefSize		= trailer.objectRefSize;
-	ctx.offsetTableOffset	= (size_t) trailer.offsetTableOffset;
-	
-	dictCallbacks = kCFTypeDictionaryValueCallBacks;
-	dictCallbacks.equal = _ObjectsExactlyEqual;
-	ctx.uniqueDict = CFDictionaryCreateMutable( NULL, 0, NULL, &dictCallbacks );
-	require_action( ctx.uniqueDict, exit, err = kNoMemoryErr );
-	
-	plist = _ReadV0Object( &ctx, src, end, (size_t) offset, &err );
+	plist = CFBinaryPlistCursorCopyObject( &cursor, &err );
 	require_noerr_quiet( err, exit );
 	
 exit:
-	CFBinaryPlistContextFree( &ctx );
 	if( outErr ) *outErr = err;
 	return( plist );
 }
@@ -826,7 +895,7 @@ static CFTypeRef
 	
 	require_action_quiet( inOffset < ( (size_t)( inEnd - inSrc ) ), exit, err = kRangeErr );
 	
-	obj = CFDictionaryGetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset );
+	obj = ctx->uniqueDict ? CFDictionaryGetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset ) : NULL;
 	if( obj )
 	{
 		CFRetain( obj );
@@ -864,7 +933,7 @@ static CFTypeRef
 				obj = CFNumberCreate( NULL, kCFNumberSInt64Type, &v64.u64 );
 			}
 			require_action( obj, exit, err = kNoMemoryErr );
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerReal:
@@ -888,7 +957,7 @@ static CFTypeRef
 					err = kSizeErr;
 					goto exit;
 			}
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerDateBase:
@@ -897,7 +966,7 @@ static CFTypeRef
 			v64.u64 = ReadBig64( ptr );
 			obj = CFDateCreate( NULL, v64.f64 );
 			require_action( obj, exit, err = kNoMemoryErr );
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerData:
@@ -911,7 +980,7 @@ static CFTypeRef
 			
 			obj = CFDataCreate( NULL, ptr, (CFIndex) count );
 			require_action( obj, exit, err = kNoMemoryErr );
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerASCIIString:
@@ -928,7 +997,7 @@ static CFTypeRef
 				( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerASCIIString ) ? kCFStringEncodingASCII : kCFStringEncodingUTF8, 
 				false );
 			require_action( obj, exit, err = kNoMemoryErr );
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerUnicodeString:
@@ -943,7 +1012,7 @@ static CFTypeRef
 			
 			obj = CFStringCreateWithBytes( NULL, ptr, (CFIndex) count, kCFStringEncodingUTF16BE, false );
 			require_action( obj, exit, err = kNoMemoryErr );
-			CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
+			if( ctx->uniqueDict ) CFDictionarySetValue( ctx->uniqueDict, (const void *)(uintptr_t) inOffset, obj );
 			break;
 		
 		case kCFLBinaryPlistMarkerArray:
@@ -1054,18 +1123,601 @@ static OSStatus
 	offsetPtr = inSrc + ctx->offsetTableOffset + ( refnum * ctx->offsetIntSize );
 	switch( ctx->offsetIntSize )
 	{
-		case 1: offset = Read8( offsetPtr ); break;
-		case 2: offset = ReadBig16( offsetPtr ); break;
-		case 4: offset = ReadBig32( offsetPtr ); break;
-		case 8: offset = ReadBig64( offsetPtr ); break;
-		default: err = kInternalErr; goto exit;
+		case 1: offset = Read8( offsetPtr ); break;
+		case 2: offset = ReadBig16( offsetPtr ); break;
+		case 4: offset = ReadBig32( offsetPtr ); break;
+		case 8: offset = ReadBig64( offsetPtr ); break;
+		default: err = kInternalErr; goto exit;
+	}
+	require_action_quiet( offset <= SIZE_MAX, exit, err = kSizeErr );
+	*outOffset = (size_t) offset;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+#if 0
+#pragma mark -
+#pragma mark == Cursors ==
+#endif
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorInit
+//===========================================================================================================================
+
+OSStatus	CFBinaryPlistCursorInit( CFBinaryPlistCursor *outCursor, const void *inPtr, size_t inLen )
+{
+	const uint8_t *				src = (const uint8_t *) inPtr;
+	const uint8_t *				end = src + inLen;
+	OSStatus					err;
+	CFBinaryPlistTrailer		trailer;
+	uint64_t					offset;
+	const uint8_t *				ptr;
+	
+	// Sanity check the header/trailer up front to speed up batch checking of arbitrary files.
+	
+	require_action_quiet( src < end, exit, err = kSizeErr );
+	require_action_quiet( inLen > ( 8 + sizeof( trailer ) ), exit, err = kSizeErr );
+	require_action_quiet( memcmp( src, "bplist00", 8 ) == 0, exit, err = kFormatErr );
+	memcpy( &trailer, end - sizeof( trailer ), sizeof( trailer ) );
+	end -= sizeof( trailer );
+	
+	require_action_quiet( 
+		( trailer.offsetIntSize == 1 ) || 
+		( trailer.offsetIntSize == 2 ) ||
+		( trailer.offsetIntSize == 4 ) ||
+		( trailer.offsetIntSize == 8 ), exit, err = kMalformedErr );
+	require_action_quiet( 
+		( trailer.objectRefSize == 1 ) || 
+		( trailer.objectRefSize == 2 ) ||
+		( trailer.objectRefSize == 4 ) ||
+		( trailer.objectRefSize == 8 ), exit, err = kMalformedErr );
+	
+	trailer.numObjects = ntoh64( trailer.numObjects );
+	require_action_quiet( trailer.numObjects > 0, exit, err = kCountErr );
+	
+	trailer.topObject = ntoh64( trailer.topObject );
+	require_action_quiet( trailer.topObject < trailer.numObjects, exit, err = kRangeErr );
+	
+	trailer.offsetTableOffset = ntoh64( trailer.offsetTableOffset );
+	require_action_quiet( trailer.offsetTableOffset >= 9, exit, err = kMalformedErr );
+	require_action_quiet( trailer.offsetTableOffset < ( inLen - sizeof( trailer ) ), exit, err = kMalformedErr );
+	require_action_quiet( trailer.numObjects <= 
+		( ( (size_t)( end - ( src + trailer.offsetTableOffset ) ) ) / trailer.offsetIntSize ), exit, err = kCountErr );
+	
+	offset = trailer.offsetTableOffset + ( trailer.topObject * trailer.offsetIntSize );
+	require_action_quiet( offset < ( (uint64_t)( end - src ) ), exit, err = kRangeErr );
+	ptr = src + offset;
+	err = _ReadSizedInteger( &ptr, end, trailer.offsetIntSize, &offset );
+	require_noerr_quiet( err, exit );
+	require_action_quiet( offset < ( (uint64_t)( end - src ) ), exit, err = kRangeErr );
+	
+	outCursor->base					= src;
+	outCursor->end					= end;
+	outCursor->offsetTableOffset	= (size_t) trailer.offsetTableOffset;
+	outCursor->numObjects			= trailer.numObjects;
+	outCursor->offsetIntSize		= trailer.offsetIntSize;
+	outCursor->objectRefSize		= trailer.objectRefSize;
+	outCursor->offset				= (size_t) offset;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetTypeID
+//===========================================================================================================================
+
+CFTypeID	CFBinaryPlistCursorGetTypeID( const CFBinaryPlistCursor *inCursor )
+{
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count;
+	const uint8_t *		ptr;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	
+	_GlobalEnsureInitialized();
+	switch( marker & 0xF0 )
+	{
+		case 0:
+			if( marker == kCFLBinaryPlistMarkerNull )	return( CFNullGetTypeID() );
+			if( ( marker == kCFLBinaryPlistMarkerFalse ) || ( marker == kCFLBinaryPlistMarkerTrue ) ) return( gCFBooleanType );
+			break;
+		
+		case kCFLBinaryPlistMarkerInt:
+		case kCFLBinaryPlistMarkerReal:				return( gCFNumberType );
+		case kCFLBinaryPlistMarkerDateBase:			if( marker == kCFLBinaryPlistMarkerDateFloat ) return( gCFDateType ); break;
+		case kCFLBinaryPlistMarkerData:				return( gCFDataType );
+		case kCFLBinaryPlistMarkerASCIIString:
+		case kCFLBinaryPlistMarkerUTF8String:
+		case kCFLBinaryPlistMarkerUnicodeString:	return( gCFStringType );
+		case kCFLBinaryPlistMarkerArray:			return( gCFArrayType );
+		case kCFLBinaryPlistMarkerDictionary:		return( gCFDictionaryType );
+		default: break;
+	}
+	
+exit:
+	return( 0 );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetCount
+//===========================================================================================================================
+
+CFIndex	CFBinaryPlistCursorGetCount( const CFBinaryPlistCursor *inCursor, OSStatus *outErr )
+{
+	CFIndex				result = 0;
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count;
+	const uint8_t *		ptr;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	require_action_quiet( 
+		( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerArray ) || 
+		( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerDictionary ), exit, err = kTypeErr );
+	result = (CFIndex) count;
+	
+exit:
+	if( outErr ) *outErr = err;
+	return( result );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetValueAtIndex
+//===========================================================================================================================
+
+OSStatus	CFBinaryPlistCursorGetValueAtIndex( const CFBinaryPlistCursor *inArray, CFIndex inIndex, CFBinaryPlistCursor *outValue )
+{
+	OSStatus					err;
+	CFBinaryPlistContext		ctx;
+	uint8_t						marker;
+	uint64_t					count;
+	const uint8_t *				ptr;
+	size_t						offset;
+	
+	err = _CursorReadHeader( inArray, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	require_action_quiet( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerArray, exit, err = kTypeErr );
+	require_action_quiet( ( inIndex >= 0 ) && ( ( (uint64_t) inIndex ) < count ), exit, err = kRangeErr );
+	
+	_CursorInitContext( &ctx, inArray );
+	ptr += ( ( (size_t) inIndex ) * inArray->objectRefSize );
+	err = _ReadRefOffset( &ctx, inArray->base, inArray->end, &ptr, &offset );
+	require_noerr_quiet( err, exit );
+	
+	*outValue = *inArray;
+	outValue->offset = offset;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetValue
+//===========================================================================================================================
+
+OSStatus	CFBinaryPlistCursorGetValue( const CFBinaryPlistCursor *inDict, const char *inKey, CFBinaryPlistCursor *outValue )
+{
+	size_t const				keyLen = strlen( inKey );
+	OSStatus					err;
+	CFBinaryPlistContext		ctx;
+	uint8_t						marker;
+	uint64_t					count, i;
+	const uint8_t *				ptr;
+	const uint8_t *				keyPtr;
+	CFBinaryPlistCursor			cursor;
+	
+	err = _CursorReadHeader( inDict, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	require_action_quiet( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerDictionary, exit, err = kTypeErr );
+	
+	// Keys are stored before values so scan the keys until there's a match and then read the corresponding value.
+	
+	_CursorInitContext( &ctx, inDict );
+	cursor = *inDict;
+	keyPtr = ptr;
+	for( i = 0; i < count; ++i )
+	{
+		err = _ReadRefOffset( &ctx, inDict->base, inDict->end, &keyPtr, &cursor.offset );
+		require_noerr_quiet( err, exit );
+		if( _CursorStringEqual( &cursor, inKey, keyLen ) ) break;
+	}
+	require_action_quiet( i < count, exit, err = kNotFoundErr );
+	
+	ptr += ( ( count + i ) * inDict->objectRefSize );
+	err = _ReadRefOffset( &ctx, inDict->base, inDict->end, &ptr, &cursor.offset );
+	require_noerr_quiet( err, exit );
+	*outValue = cursor;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetInt64
+//===========================================================================================================================
+
+int64_t	CFBinaryPlistCursorGetInt64( const CFBinaryPlistCursor *inCursor, OSStatus *outErr )
+{
+	int64_t				result = 0;
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count;
+	const uint8_t *		ptr;
+	uint32_t			len;
+	uint64_t			hi;
+	Value64				v64;
+	double				d;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	switch( marker & 0xF0 )
+	{
+		case 0:
+			if(      marker == kCFLBinaryPlistMarkerFalse )	result = 0;
+			else if( marker == kCFLBinaryPlistMarkerTrue )	result = 1;
+			else { err = kTypeErr; goto exit; }
+			break;
+		
+		case kCFLBinaryPlistMarkerInt:
+			
+			// 1, 2, and 4 byte integers are unsigned, 8 byte integers are signed, and 16 byte integers need to fit in 
+			// 64 bits (sign-extended) to be returned.
+			
+			len = 1U << ( marker & 0x0F );
+			require_action_quiet( len <= 16, exit, err = kCountErr );
+			require_action_quiet( len <= ( (size_t)( inCursor->end - ptr ) ), exit, err = kSizeErr );
+			for( hi = 0; len > 8; --len ) hi = ( hi << 8 ) | *ptr++;
+			for( v64.u64 = 0; len > 0; --len ) v64.u64 = ( v64.u64 << 8 ) | *ptr++;
+			require_action_quiet( ( hi == 0 ) || ( ( hi == UINT64_MAX ) && ( v64.s64 < 0 ) ), exit, err = kRangeErr );
+			require_action_quiet( ( hi != 0 ) || ( v64.s64 >= 0 ) || ( ( marker & 0x0F ) == 3 ), exit, err = kRangeErr );
+			result = v64.s64;
+			break;
+		
+		case kCFLBinaryPlistMarkerReal:
+			if( marker == ( kCFLBinaryPlistMarkerReal | 2 ) )
+			{
+				require_action_quiet( ( inCursor->end - ptr ) >= 4, exit, err = kSizeErr );
+				v64.u32[ 0 ] = ReadBig32( ptr );
+				d = v64.f32[ 0 ];
+			}
+			else if( marker == ( kCFLBinaryPlistMarkerReal | 3 ) )
+			{
+				require_action_quiet( ( inCursor->end - ptr ) >= 8, exit, err = kSizeErr );
+				v64.u64 = ReadBig64( ptr );
+				d = v64.f64;
+			}
+			else
+			{
+				err = kSizeErr;
+				goto exit;
+			}
+			require_action_quiet( ( d >= -9223372036854775808.0 ) && ( d < 9223372036854775808.0 ), exit, err = kRangeErr );
+			result = (int64_t) d;
+			break;
+		
+		default:
+			err = kTypeErr;
+			goto exit;
+	}
+	err = kNoErr;
+	
+exit:
+	if( outErr ) *outErr = err;
+	return( result );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetStringPtr
+//===========================================================================================================================
+
+const char *	CFBinaryPlistCursorGetStringPtr( const CFBinaryPlistCursor *inCursor, size_t *outLen, OSStatus *outErr )
+{
+	const char *		result = NULL;
+	size_t				len = 0;
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count;
+	const uint8_t *		ptr;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	switch( marker & 0xF0 )
+	{
+		case kCFLBinaryPlistMarkerASCIIString:
+		case kCFLBinaryPlistMarkerUTF8String:
+			result = (const char *) ptr;
+			len = (size_t) count;
+			break;
+		
+		case kCFLBinaryPlistMarkerUnicodeString:
+			err = kUnsupportedDataErr;
+			goto exit;
+		
+		default:
+			err = kTypeErr;
+			goto exit;
+	}
+	
+exit:
+	if( outLen ) *outLen = len;
+	if( outErr ) *outErr = err;
+	return( result );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetCString
+//===========================================================================================================================
+
+char *	CFBinaryPlistCursorGetCString( const CFBinaryPlistCursor *inCursor, char *inBuf, size_t inMaxLen, OSStatus *outErr )
+{
+	char *					result;
+	OSStatus				err;
+	const char *			ptr;
+	size_t					len;
+	CFPropertyListRef		obj;
+	
+	if( inMaxLen > 0 )	{ *inBuf = '\0'; result = inBuf; }
+	else				result = "";
+	
+	ptr = CFBinaryPlistCursorGetStringPtr( inCursor, &len, &err );
+	if( !err )
+	{
+		// Truncate long strings at a UTF-8 character boundary.
+		
+		if( inMaxLen > 0 )
+		{
+			if( len >= inMaxLen )
+			{
+				len = inMaxLen - 1;
+				while( ( len > 0 ) && ( ( ( (const uint8_t *) ptr )[ len ] & 0xC0 ) == 0x80 ) ) --len;
+			}
+			memcpy( inBuf, ptr, len );
+			inBuf[ len ] = '\0';
+		}
+	}
+	else if( ( err == kTypeErr ) || ( err == kUnsupportedDataErr ) )
+	{
+		// Not a string that can be read in place so convert it the same way as CF objects.
+		
+		obj = CFBinaryPlistCursorCopyObject( inCursor, &err );
+		require_noerr_quiet( err, exit );
+		result = CFGetCString( obj, inBuf, inMaxLen );
+		CFRelease( obj );
+	}
+	
+exit:
+	if( outErr ) *outErr = err;
+	return( result );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorGetDataPtr
+//===========================================================================================================================
+
+const uint8_t *	CFBinaryPlistCursorGetDataPtr( const CFBinaryPlistCursor *inCursor, size_t *outLen, OSStatus *outErr )
+{
+	const uint8_t *		result = NULL;
+	size_t				len = 0;
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count;
+	const uint8_t *		ptr;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	require_noerr_quiet( err, exit );
+	require_action_quiet( ( marker & 0xF0 ) == kCFLBinaryPlistMarkerData, exit, err = kTypeErr );
+	result = ptr;
+	len = (size_t) count;
+	
+exit:
+	if( outLen ) *outLen = len;
+	if( outErr ) *outErr = err;
+	return( result );
+}
+
+//===========================================================================================================================
+//	CFBinaryPlistCursorCopyObject
+//===========================================================================================================================
+
+CFPropertyListRef	CFBinaryPlistCursorCopyObject( const CFBinaryPlistCursor *inCursor, OSStatus *outErr )
+{
+	CFPropertyListRef				plist = NULL;
+	CFBinaryPlistContext			ctx;
+	OSStatus						err;
+	CFDictionaryValueCallBacks		dictCallbacks;
+	uint8_t							marker;
+	
+	_GlobalEnsureInitialized();
+	_CursorInitContext( &ctx, inCursor );
+	require_action_quiet( inCursor->offset < ( (size_t)( inCursor->end - inCursor->base ) ), exit, err = kRangeErr );
+	
+	// Only arrays and dictionaries can refer to the same object more than once so leaf objects skip uniquing.
+	
+	marker = inCursor->base[ inCursor->offset ] & 0xF0;
+	if( ( marker == kCFLBinaryPlistMarkerArray ) || ( marker == kCFLBinaryPlistMarkerDictionary ) )
+	{
+		dictCallbacks = kCFTypeDictionaryValueCallBacks;
+		dictCallbacks.equal = _ObjectsExactlyEqual;
+		ctx.uniqueDict = CFDictionaryCreateMutable( NULL, 0, NULL, &dictCallbacks );
+		require_action( ctx.uniqueDict, exit, err = kNoMemoryErr );
+	}
+	
+	plist = _ReadV0Object( &ctx, inCursor->base, inCursor->end, inCursor->offset, &err );
+	require_noerr_quiet( err, exit );
+	
+exit:
+	CFBinaryPlistContextFree( &ctx );
+	if( outErr ) *outErr = err;
+	return( plist );
+}
+
+//===========================================================================================================================
+//	_CursorInitContext
+//===========================================================================================================================
+
+static void	_CursorInitContext( CFBinaryPlistContext *ctx, const CFBinaryPlistCursor *inCursor )
+{
+	CFBinaryPlistContextInit( ctx );
+	ctx->uniqueCount		= (CFIndex) inCursor->numObjects;
+	ctx->offsetIntSize		= inCursor->offsetIntSize;
+	ctx->objectRefSize		= inCursor->objectRefSize;
+	ctx->offsetTableOffset	= inCursor->offsetTableOffset;
+}
+
+//===========================================================================================================================
+//	_CursorReadHeader
+//
+//	Reads the marker of the object at the cursor. For data, strings, arrays, and dictionaries, it also reads the count 
+//	and verifies the contents fit in the plist. For other objects, the count is the low 4 bits of the marker.
+//===========================================================================================================================
+
+static OSStatus
+	_CursorReadHeader( 
+		const CFBinaryPlistCursor *	inCursor, 
+		uint8_t *					outMarker, 
+		uint64_t *					outCount, 
+		const uint8_t **			outPtr )
+{
+	const uint8_t * const		end = inCursor->end;
+	OSStatus					err;
+	const uint8_t *				ptr;
+	uint8_t						marker;
+	uint64_t					count;
+	
+	require_action_quiet( inCursor->offset < ( (size_t)( end - inCursor->base ) ), exit, err = kRangeErr );
+	ptr = inCursor->base + inCursor->offset;
+	marker = *ptr++;
+	count = marker & 0x0F;
+	switch( marker & 0xF0 )
+	{
+		case kCFLBinaryPlistMarkerData:
+		case kCFLBinaryPlistMarkerASCIIString:
+		case kCFLBinaryPlistMarkerUTF8String:
+		case kCFLBinaryPlistMarkerUnicodeString:
+		case kCFLBinaryPlistMarkerArray:
+		case kCFLBinaryPlistMarkerDictionary:
+			if( count == 0xF )
+			{
+				err = _ReadInteger( &ptr, end, &count );
+				require_noerr_quiet( err, exit );
+			}
+			break;
+		
+		default:
+			break;
+	}
+	switch( marker & 0xF0 )
+	{
+		case kCFLBinaryPlistMarkerData:
+		case kCFLBinaryPlistMarkerASCIIString:
+		case kCFLBinaryPlistMarkerUTF8String:
+			require_action_quiet( count <= ( (size_t)( end - ptr ) ), exit, err = kSizeErr );
+			break;
+		
+		case kCFLBinaryPlistMarkerUnicodeString:
+			require_action_quiet( count <= ( ( (size_t)( end - ptr ) ) / 2 ), exit, err = kSizeErr );
+			break;
+		
+		case kCFLBinaryPlistMarkerArray:
+			require_action_quiet( count <= ( ( (size_t)( end - ptr ) ) / inCursor->objectRefSize ), exit, err = kCountErr );
+			break;
+		
+		case kCFLBinaryPlistMarkerDictionary:
+			require_action_quiet( count <= ( ( (size_t)( end - ptr ) ) / ( 2 * inCursor->objectRefSize ) ), exit, err = kCountErr );
+			break;
+		
+		default:
+			break;
+	}
+	*outMarker	= marker;
+	*outCount	= count;
+	*outPtr		= ptr;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_CursorStringEqual
+//
+//	Compares a string object in the plist to a UTF-8 string. UTF-16 strings are converted to UTF-8 as they're compared.
+//===========================================================================================================================
+
+static Boolean	_CursorStringEqual( const CFBinaryPlistCursor *inCursor, const char *inStr, size_t inLen )
+{
+	const uint8_t *		src = (const uint8_t *) inStr;
+	const uint8_t *		end = src + inLen;
+	OSStatus			err;
+	uint8_t				marker;
+	uint64_t			count, i;
+	const uint8_t *		ptr;
+	uint32_t			c, c2;
+	uint8_t				buf[ 4 ];
+	size_t				len;
+	
+	err = _CursorReadHeader( inCursor, &marker, &count, &ptr );
+	if( err ) return( false );
+	switch( marker & 0xF0 )
+	{
+		case kCFLBinaryPlistMarkerASCIIString:
+		case kCFLBinaryPlistMarkerUTF8String:
+			return( ( count == inLen ) && ( memcmp( ptr, inStr, inLen ) == 0 ) );
+		
+		case kCFLBinaryPlistMarkerUnicodeString:
+			for( i = 0; i < count; ++i )
+			{
+				c = ReadBig16( ptr + ( i * 2 ) );
+				if( ( c >= 0xD800 ) && ( c <= 0xDBFF ) && ( ( i + 1 ) < count ) )
+				{
+					c2 = ReadBig16( ptr + ( ( i + 1 ) * 2 ) );
+					if( ( c2 >= 0xDC00 ) && ( c2 <= 0xDFFF ) )
+					{
+						c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( c2 - 0xDC00 );
+						++i;
+					}
+				}
+				if( c < 0x80 )
+				{
+					buf[ 0 ] = (uint8_t) c;
+					len = 1;
+				}
+				else if( c < 0x800 )
+				{
+					buf[ 0 ] = (uint8_t)( 0xC0 | ( c >> 6 ) );
+					buf[ 1 ] = (uint8_t)( 0x80 | ( c & 0x3F ) );
+					len = 2;
+				}
+				else if( c < 0x10000 )
+				{
+					buf[ 0 ] = (uint8_t)( 0xE0 |   ( c >> 12 ) );
+					buf[ 1 ] = (uint8_t)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+					buf[ 2 ] = (uint8_t)( 0x80 |   ( c        & 0x3F ) );
+					len = 3;
+				}
+				else
+				{
+					buf[ 0 ] = (uint8_t)( 0xF0 |   ( c >> 18 ) );
+					buf[ 1 ] = (uint8_t)( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+					buf[ 2 ] = (uint8_t)( 0x80 | ( ( c >>  6 ) & 0x3F ) );
+					buf[ 3 ] = (uint8_t)( 0x80 |   ( c         & 0x3F ) );
+					len = 4;
+				}
+				if( ( len > ( (size_t)( end - src ) ) ) || ( memcmp( src, buf, len ) != 0 ) ) return( false );
+				src += len;
+			}
+			return( src == end );
+		
+		default:
+			break;
 	}
-	require_action_quiet( offset <= SIZE_MAX, exit, err = kSizeErr );
-	*outOffset = (size_t) offset;
-	err = kNoErr;
-	
-exit:
-	return( err );
+	return( false );
 }
 
 #if 0
@@ -1154,142 +1806,585 @@ exit:
 }
 
 //===========================================================================================================================
-//	_WriteBytes
+//	_WriteSizedInteger
 //===========================================================================================================================
 
-static OSStatus	_WriteBytes( CFBinaryPlistContext *ctx, const void *inData, size_t inSize )
+static void	_WriteSizedInteger( uint8_t *inPtr, size_t inLen, uint64_t inValue )
 {
-	OSStatus		err;
-	
-	if( ctx->ptr )
-	{
-		if( ctx->ptrFull + inSize > ctx->ptrSize ) {
-			size_t newSize = (ctx->ptrSize + inSize + 0x3FF) & ~0x3FF;
-			void* newPtr = realloc( ctx->ptr, newSize );
-			require_action( newPtr, exit, err = kNoMemoryErr );
-			ctx->ptr = newPtr;
-			ctx->ptrSize = newSize;
-		}
-		memcpy( &ctx->ptr[ ctx->ptrFull ], inData, inSize );
-		ctx->ptrFull += inSize;
-	}
-	else
+	switch( inLen )
 	{
-		err = kNotPreparedErr;
-		goto exit;
+		case 1: Write8( inPtr, (uint8_t) inValue ); break;
+		case 2: WriteBig16( inPtr, inValue ); break;
+		case 4: WriteBig32( inPtr, inValue ); break;
+		case 8: WriteBig64( inPtr, inValue ); break;
+		default: dlogassert( "Bad integer size: %zu", inLen ); break;
 	}
-	ctx->bytesWritten += inSize;
-	err = kNoErr;
-	
-exit:
-	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteInteger
+//	_EncodeInteger
+//
+//	Encodes an integer object (marker and value) using the smallest size that fits. Returns the number of bytes.
 //===========================================================================================================================
 
-static OSStatus	_WriteInteger( CFBinaryPlistContext *ctx, uint64_t inValue )
+static uint8_t	_EncodeInteger( uint8_t *inBuf, uint64_t inValue )
 {
-	OSStatus		err;
-	uint8_t			buf[ 9 ];
-	size_t			len;
-	
 	if( inValue <= UINT64_C( 0xFF ) )
 	{
-		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 0;
-		buf[ 1 ] = (uint8_t) inValue;
-		len = 2;
+		inBuf[ 0 ] = kCFLBinaryPlistMarkerInt | 0;
+		inBuf[ 1 ] = (uint8_t) inValue;
+		return( 2 );
 	}
-	else if( inValue <= UINT64_C( 0xFFFF ) )
+	if( inValue <= UINT64_C( 0xFFFF ) )
 	{
-		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 1;
-		WriteBig16( &buf[ 1 ], inValue );
-		len = 3;
+		inBuf[ 0 ] = kCFLBinaryPlistMarkerInt | 1;
+		WriteBig16( &inBuf[ 1 ], inValue );
+		return( 3 );
 	}
-	else if( inValue <= UINT64_C( 0xFFFFFFFF ) )
+	if( inValue <= UINT64_C( 0xFFFFFFFF ) )
 	{
-		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 2;
-		WriteBig32( &buf[ 1 ], inValue );
-		len = 5;
+		inBuf[ 0 ] = kCFLBinaryPlistMarkerInt | 2;
+		WriteBig32( &inBuf[ 1 ], inValue );
+		return( 5 );
 	}
-	else
+	inBuf[ 0 ] = kCFLBinaryPlistMarkerInt | 3;
+	WriteBig64( &inBuf[ 1 ], inValue );
+	return( 9 );
+}
+
+//===========================================================================================================================
+//	_EncodeCountHeader
+//
+//	Encodes the marker and count for data, strings, arrays, and dictionaries. Returns the number of bytes.
+//===========================================================================================================================
+
+static uint8_t	_EncodeCountHeader( uint8_t *inBuf, uint8_t inMarker, uint64_t inCount )
+{
+	if( inCount < 15 )
+	{
+		inBuf[ 0 ] = (uint8_t)( inMarker | inCount );
+		return( 1 );
+	}
+	inBuf[ 0 ] = inMarker | 0xF;
+	return( (uint8_t)( 1 + _EncodeInteger( &inBuf[ 1 ], inCount ) ) );
+}
+
+//===========================================================================================================================
+//	_HashBytes
+//
+//	FNV-1a hash. Pass kFNV1aOffsetBasis32 as the hash to start a new hash or a previous result to continue it.
+//===========================================================================================================================
+
+static uint32_t	_HashBytes( uint32_t inHash, const uint8_t *inPtr, size_t inLen )
+{
+	const uint8_t * const		end = inPtr + inLen;
+	
+	for( ; inPtr < end; ++inPtr )
 	{
-		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 3;
-		WriteBig64( &buf[ 1 ], inValue );
-		len = 9;
+		inHash = ( inHash ^ *inPtr ) * kFNV1aPrime32;
 	}
+	return( inHash );
+}
+
+#if 0
+#pragma mark -
+#pragma mark == Debugging ==
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+//===========================================================================================================================
+//	_CFLiteBinaryPlistCreateTestCorpus
+//
+//	Creates control plists like those exchanged during a CarPlay session (SETUP requests and responses, /info, mode 
+//	changes, timestamps, feedback, and teardown).
+//===========================================================================================================================
+
+static OSStatus	_CFLiteBinaryPlistCreateTestCorpus( CFMutableArrayRef *outCorpus )
+{
+	OSStatus				err;
+	CFMutableArrayRef		corpus;
+	CFPropertyListRef		plist = NULL;
+	uint8_t					mac[ 6 ] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+	uint8_t					key[ 16 ];
+	
+	corpus = CFArrayCreateMutable( NULL, 0, &kCFTypeArrayCallBacks );
+	require_action( corpus, exit, err = kNoMemoryErr );
+	memset( key, 0xA5, sizeof( key ) );
+	
+	// SETUP request and response for the session.
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"deviceID=%.6a"
+			"macAddress=%.6a"
+			"model=iPhone10,4;"
+			"name=iPhone;"
+			"osBuildVersion=16A366;"
+			"sessionUUID=2E388006-13BA-4041-9A67-25DD4A43D536;"
+			"sourceVersion=410.12;"
+			"timingPort=%i"
+			"statusFlags=%i"
+			"ekey=%D"
+			"eiv=%D"
+		"}", 
+		mac, mac, 60123, 4, key, (int) sizeof( key ), key, (int) sizeof( key ) );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{eventPort=%i timingPort=%i keepAlivePort=%i}", 
+		49152, 49153, 49154 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	// SETUP request and response for the streams.
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"streams=["
+				"{type=%i audioFormat=%lli audioType=default; ct=%i spf=%i sr=%i ss=%i ch=%i "
+					"latencyMin=%i latencyMax=%i redundantAudio=%i controlPort=%i}"
+				"{type=%i audioFormat=%lli audioType=media; ct=%i spf=%i sr=%i ss=%i ch=%i "
+					"latencyMin=%i latencyMax=%i controlPort=%i}"
+				"{type=%i screenDecodeQueueDepth=%i screenDecryptQueueDepth=%i}"
+			"]"
+		"}", 
+		100, (int64_t) 0x40000, 1, 1024, 24000, 16, 1, 0, 3750, 0, 50000, 
+		96, (int64_t) 0x400000, 4, 352, 44100, 16, 2, 11025, 88200, 50001, 
+		110, 3, 3 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"streams=["
+				"{type=%i dataPort=%i controlPort=%i streamConnectionID=%lli}"
+				"{type=%i dataPort=%i controlPort=%i streamConnectionID=%lli}"
+				"{type=%i dataPort=%i streamConnectionID=%lli}"
+			"]"
+		"}", 
+		100, 50100, 50101, INT64_C( 0x1234567812345678 ), 
+		96, 50102, 50103, INT64_C( 0x1234567812345679 ), 
+		110, 50104, INT64_C( 0x123456781234567A ) );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	// /info response.
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"deviceID=%.6a"
+			"features=%lli"
+			"model=AirPlayReceiver1,1;"
+			"manufacturer=Example;"
+			"name=Head Unit;"
+			"pi=2e388006-13ba-4041-9a67-25dd4a43d536;"
+			"protocolVersion=1.1;"
+			"sourceVersion=410.12;"
+			"statusFlags=%i"
+			"keepAliveLowPower=%b"
+			"keepAliveSendStatsAsBody=%b"
+			"rightHandDrive=%b"
+			"limitedUI=%b"
+			"nightMode=%b"
+			"pk=%D"
+			"audioFormats=["
+				"{type=%i audioInputFormats=%lli audioOutputFormats=%lli}"
+				"{type=%i audioInputFormats=%lli audioOutputFormats=%lli}"
+			"]"
+			"audioLatencies=["
+				"{type=%i audioType=default; inputLatencyMicros=%i outputLatencyMicros=%i}"
+				"{type=%i audioType=media; inputLatencyMicros=%i outputLatencyMicros=%i}"
+			"]"
+			"displays=["
+				"{uuid=e0ff8a27-6738-3d56-8a16-cc53aacee925; widthPixels=%i heightPixels=%i widthPhysical=%i "
+					"heightPhysical=%i maxFPS=%i features=%i primaryInputDevice=%i}"
+			"]"
+			"hidDevices=["
+				"{uuid=4B8DE4D4-1F8B-4B47-B8C2-A4C6E0C5D9F1; name=Touchscreen; hidProductID=%i hidVendorID=%i "
+					"hidCountryCode=%i displayUUID=e0ff8a27-6738-3d56-8a16-cc53aacee925; hidDescriptor=%D}"
+			"]"
+		"}", 
+		mac, INT64_C( 0x1E5A7FFFF7 ), 4, true, true, false, false, false, key, (int) sizeof( key ), 
+		100, (int64_t) 0x3FFFFFC, (int64_t) 0x3FFFFFC, 
+		96, (int64_t) 0x3FFFFFC, (int64_t) 0x3FFFFFC, 
+		100, 0, 0, 
+		96, 0, 0, 
+		800, 480, 154, 86, 60, 14, 1, 
+		1, 1452, 0, key, (int) sizeof( key ) );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	// Commands.
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"type=modesChanged;"
+			"params={"
+				"appStates=["
+					"{appStateID=%i entity=%i}"
+					"{appStateID=%i entity=%i speechMode=%i}"
+					"{appStateID=%i entity=%i}"
+				"]"
+				"resources=["
+					"{resourceID=%i entity=%i}"
+					"{resourceID=%i entity=%i}"
+				"]"
+			"}"
+		"}", 
+		1, 2, 2, 0, -1, 3, 0, 
+		1, 1, 2, 2 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"type=changeModes;"
+			"params={"
+				"resources=["
+					"{resourceID=%i transferType=%i transferPriority=%i takeConstraint=%i borrowConstraint=%i "
+						"unborrowConstraint=%i}"
+				"]"
+				"reasonStr=User initiated;"
+			"}"
+		"}", 
+		1, 1, 100, 300, 300, 100 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"type=updateTimestamps;"
+			"params={"
+				"timestampInfo=["
+					"{name=SubSu; timestamp=%lli}"
+					"{name=SePASe; timestamp=%lli}"
+					"{name=SeFRAS; timestamp=%lli}"
+					"{name=SeSAc; timestamp=%lli}"
+					"{name=SeCmp; timestamp=%lli}"
+					"{name=SuCmp; timestamp=%lli}"
+				"]"
+			"}"
+		"}", 
+		INT64_C( 1000000000123 ), INT64_C( 1000000000456 ), INT64_C( 1000000000789 ), 
+		INT64_C( 1000000001123 ), INT64_C( 1000000001456 ), INT64_C( 1000000001789 ) );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, 
+		"{"
+			"type=updateFeedback;"
+			"params={streams=[{type=%i sr=%f}{type=%i sr=%f}]}"
+		"}", 
+		100, 24000.12, 96, 44099.87 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{type=requestUI; params={url=maps:;}}" );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
 	
-	err = _WriteBytes( ctx, buf, len );
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{type=duckAudio; params={durationMs=%i volume=%f}}", 500, 0.2 );
 	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	// TEARDOWN request for a stream and the reply to an event.
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{streams=[{type=%i streamConnectionID=%lli}]}", 
+		110, INT64_C( 0x123456781234567A ) );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{status=%i}", 0 );
+	require_noerr( err, exit );
+	CFArrayAppendValue( corpus, plist );
+	ForgetCF( &plist );
+	
+	*outCorpus = corpus;
+	corpus = NULL;
 	
 exit:
+	CFReleaseNullSafe( plist );
+	CFReleaseNullSafe( corpus );
 	return( err );
 }
 
 //===========================================================================================================================
-//	_WriteNumber
+//	CFLiteBinaryPlistParseBenchmark
+//
+//	Times parsing the test corpus. With CFLite, also reports how many objects each parse allocates and how many the 
+//	small integer and interned string caches saved. Then times reading the few keys a request handler typically needs 
+//	with a cursor instead of parsing the whole plist.
 //===========================================================================================================================
 
-static OSStatus	_WriteNumber( CFBinaryPlistContext *ctx, CFNumberRef inNum )
+#define kCFLiteBinaryPlistParseRounds		2000
+
+static const char * const		kCFLiteBinaryPlistCursorKeys[] = { "type", "streams", "sessionUUID", "timingPort" };
+
+static OSStatus	CFLiteBinaryPlistParseBenchmark( void )
 {
-	OSStatus		err;
-	Value64			v;
-	uint8_t			buf[ 17 ];
-	size_t			len;
+	OSStatus				err;
+	CFMutableArrayRef		corpus = NULL;
+	CFPropertyListRef		plist = NULL;
+	CFDataRef				data;
+	CFIndex					i, n;
+	int						round;
+	uint64_t				ticks;
+	size_t					bytes;
+	CFBinaryPlistCursor		cursor, value;
+	CFTypeID				typeID;
+	size_t					k, len;
+	uint64_t				found;
+#if( CFLITE_ENABLED )
+	CFLRuntimeStats			before, during, after;
+	size_t					objects = 0;
+#endif
 	
-	if( CFNumberIsFloatType( inNum ) )
+	err = _CFLiteBinaryPlistCreateTestCorpus( &corpus );
+	require_noerr( err, exit );
+	
+	// Convert each one to a binary plist like it would arrive over the wire.
+	
+	n = CFArrayGetCount( corpus );
+	bytes = 0;
+	for( i = 0; i < n; ++i )
 	{
-		if( CFNumberGetByteSize( inNum ) <= ( (CFIndex) sizeof( Float32 ) ) )
+		data = CFBinaryPlistV0CreateData( CFArrayGetValueAtIndex( corpus, i ), &err );
+		require_noerr( err, exit );
+		bytes += (size_t) CFDataGetLength( data );
+		CFArraySetValueAtIndex( corpus, i, data );
+		CFRelease( data );
+	}
+	
+#if( CFLITE_ENABLED )
+	CFLRuntimeGetStats( &before );
+#endif
+	ticks = UpTicks();
+	for( round = 0; round < kCFLiteBinaryPlistParseRounds; ++round )
+	{
+		for( i = 0; i < n; ++i )
 		{
-			CFNumberGetValue( inNum, kCFNumberFloat32Type, &v.f32[ 0 ] );
-			
-			buf[ 0 ] = kCFLBinaryPlistMarkerReal | 2; // 2 for 2^2 = 4 byte Float32.
-			WriteBigFloat32( &buf[ 1 ], v.f32[ 0 ] );
-			len = 5;
+			data = (CFDataRef) CFArrayGetValueAtIndex( corpus, i );
+			plist = CFBinaryPlistV0CreateWithData( CFDataGetBytePtr( data ), (size_t) CFDataGetLength( data ), &err );
+			require_noerr( err, exit );
+		#if( CFLITE_ENABLED )
+			if( round == 0 )
+			{
+				CFLRuntimeGetStats( &during );
+				for( typeID = 0; typeID < kCFLRuntimeStatsMaxTypes; ++typeID )
+				{
+					objects += during.liveObjects[ typeID ] - before.liveObjects[ typeID ];
+				}
+			}
+		#endif
+			ForgetCF( &plist );
 		}
-		else
+	}
+	ticks = UpTicks() - ticks;
+	
+	printf( "\tparse benchmark: %d plists, %zu bytes avg, %.1f us/plist\n", (int) n, bytes / (size_t) n, 
+		( 1e6 * ticks ) / ( ( (double) kCFLiteBinaryPlistParseRounds ) * n * UpTicksPerSecond() ) );
+#if( CFLITE_ENABLED )
+	CFLRuntimeGetStats( &after );
+	printf( "\tparse benchmark: %.1f objects/plist, %.1f number hits/plist, %.1f string hits/plist, "
+		"%.1f allocations avoided/plist\n", 
+		( (double) objects ) / n, 
+		( (double)( after.numberCacheHits - before.numberCacheHits ) )  / ( kCFLiteBinaryPlistParseRounds * n ), 
+		( (double)( after.stringCacheHits - before.stringCacheHits ) )  / ( kCFLiteBinaryPlistParseRounds * n ), 
+		( (double)( after.allocationsAvoided - before.allocationsAvoided ) ) / ( kCFLiteBinaryPlistParseRounds * n ) );
+#endif
+	
+	// Read the keys handlers look at with cursors.
+	
+#if( CFLITE_ENABLED )
+	CFLRuntimeGetStats( &before );
+	objects = 0;
+#endif
+	found = 0;
+	ticks = UpTicks();
+	for( round = 0; round < kCFLiteBinaryPlistParseRounds; ++round )
+	{
+		for( i = 0; i < n; ++i )
 		{
-			CFNumberGetValue( inNum, kCFNumberFloat64Type, &v.f64 );
-			
-			buf[ 0 ] = kCFLBinaryPlistMarkerReal | 3; // 2 for 2^3 = 8 byte Float64.
-			WriteBigFloat64( &buf[ 1 ], v.f64 );
-			len = 9;
+			data = (CFDataRef) CFArrayGetValueAtIndex( corpus, i );
+			err = CFBinaryPlistCursorInit( &cursor, CFDataGetBytePtr( data ), (size_t) CFDataGetLength( data ) );
+			require_noerr( err, exit );
+			for( k = 0; k < countof( kCFLiteBinaryPlistCursorKeys ); ++k )
+			{
+				err = CFBinaryPlistCursorGetValue( &cursor, kCFLiteBinaryPlistCursorKeys[ k ], &value );
+				if( err == kNotFoundErr ) continue;
+				require_noerr( err, exit );
+				
+				typeID = CFBinaryPlistCursorGetTypeID( &value );
+				if(      typeID == CFStringGetTypeID() ) CFBinaryPlistCursorGetStringPtr( &value, &len, &err );
+				else if( typeID == CFNumberGetTypeID() ) CFBinaryPlistCursorGetInt64( &value, &err );
+				else if( typeID == CFArrayGetTypeID() )  CFBinaryPlistCursorGetCount( &value, &err );
+				require_noerr( err, exit );
+				++found;
+			}
+		#if( CFLITE_ENABLED )
+			if( round == 0 )
+			{
+				CFLRuntimeGetStats( &during );
+				for( k = 0; k < kCFLRuntimeStatsMaxTypes; ++k )
+				{
+					objects += during.liveObjects[ k ] - before.liveObjects[ k ];
+				}
+			}
+		#endif
 		}
-		err = _WriteBytes( ctx, buf, len );
-		require_noerr( err, exit );
 	}
-	else if( CFNumberGetType( inNum ) == kCFNumberSInt128Type_compat )
+	ticks = UpTicks() - ticks;
+	
+	printf( "\tcursor benchmark: %.1f keys/plist, %.1f us/plist", 
+		( (double) found ) / ( kCFLiteBinaryPlistParseRounds * n ), 
+		( 1e6 * ticks ) / ( ( (double) kCFLiteBinaryPlistParseRounds ) * n * UpTicksPerSecond() ) );
+#if( CFLITE_ENABLED )
+	printf( ", %.1f objects/plist", ( (double) objects ) / n );
+#endif
+	printf( "\n" );
+	err = kNoErr;
+	
+exit:
+	CFReleaseNullSafe( plist );
+	CFReleaseNullSafe( corpus );
+	return( err );
+}
+
+//===========================================================================================================================
+//	CFLiteBinaryPlistWriteBenchmark
+//
+//	Times writing small (each plist in the test corpus), medium (the corpus repeated in one plist), and very large 
+//	(log-like records and a large data blob) plists with and without uniquing. Each result is parsed back to verify it.
+//===========================================================================================================================
+
+#define kCFLiteBinaryPlistWriteLargeRecords		20000
+#define kCFLiteBinaryPlistWriteLargeDataSize	( 1024 * 1024 )
+
+static OSStatus	_CFLiteBinaryPlistWriteBenchmarkOne( const char *inLabel, CFArrayRef inPlists, int inRounds );
+
+static OSStatus	CFLiteBinaryPlistWriteBenchmark( void )
+{
+	OSStatus					err;
+	CFMutableArrayRef			corpus = NULL;
+	CFMutableArrayRef			array = NULL;
+	CFMutableArrayRef			records = NULL;
+	CFPropertyListRef			plist = NULL;
+	CFMutableDataRef			data = NULL;
+	CFArrayRef					plists;
+	int							i;
+	
+	err = _CFLiteBinaryPlistCreateTestCorpus( &corpus );
+	require_noerr( err, exit );
+	err = _CFLiteBinaryPlistWriteBenchmarkOne( "small", corpus, 2000 );
+	require_noerr( err, exit );
+	
+	array = CFArrayCreateMutable( NULL, 0, &kCFTypeArrayCallBacks );
+	require_action( array, exit, err = kNoMemoryErr );
+	for( i = 0; i < 8; ++i ) CFArrayAppendArray( array, corpus, CFRangeMake( 0, CFArrayGetCount( corpus ) ) );
+	plists = CFArrayCreate( NULL, (const void **) &array, 1, &kCFTypeArrayCallBacks );
+	require_action( plists, exit, err = kNoMemoryErr );
+	err = _CFLiteBinaryPlistWriteBenchmarkOne( "medium", plists, 500 );
+	CFRelease( plists );
+	require_noerr( err, exit );
+	
+	records = CFArrayCreateMutable( NULL, 0, &kCFTypeArrayCallBacks );
+	require_action( records, exit, err = kNoMemoryErr );
+	for( i = 0; i < kCFLiteBinaryPlistWriteLargeRecords; ++i )
 	{
-		int128_compat		u128;
-		
-		CFNumberGetValue( inNum, kCFNumberSInt128Type_compat, &u128 );
-		
-		buf[ 0 ] = kCFLBinaryPlistMarkerInt | 4;
-		WriteBig64( &buf[ 1 ], u128.hi );
-		WriteBig64( &buf[ 9 ], u128.lo );
-		
-		err = _WriteBytes( ctx, buf, 17 );
+		err = CFPropertyListCreateFormatted( NULL, &plist, 
+			"{timestamp=%lli subsystem=%s level=%i message=%s value=%i}", 
+			INT64_C( 1000000000000 ) + ( i * 1000 ), ( i % 3 ) ? "com.example.airplay" : "com.example.screen", 
+			i % 4, ( i % 5 ) ? "Audio stream started" : "Screen frame dropped", i );
 		require_noerr( err, exit );
+		CFArrayAppendValue( records, plist );
+		ForgetCF( &plist );
 	}
-	else
+	data = CFDataCreateMutable( NULL, 0 );
+	require_action( data, exit, err = kNoMemoryErr );
+	CFDataSetLength( data, kCFLiteBinaryPlistWriteLargeDataSize );
+	require_action( CFDataGetLength( data ) == kCFLiteBinaryPlistWriteLargeDataSize, exit, err = kNoMemoryErr );
+	memset( CFDataGetMutableBytePtr( data ), 0x5A, kCFLiteBinaryPlistWriteLargeDataSize );
+	err = CFPropertyListCreateFormatted( NULL, &plist, "{records=%O blob=%O}", records, data );
+	require_noerr( err, exit );
+	plists = CFArrayCreate( NULL, &plist, 1, &kCFTypeArrayCallBacks );
+	require_action( plists, exit, err = kNoMemoryErr );
+	err = _CFLiteBinaryPlistWriteBenchmarkOne( "large", plists, 5 );
+	CFRelease( plists );
+	require_noerr( err, exit );
+	
+exit:
+	CFReleaseNullSafe( corpus );
+	CFReleaseNullSafe( array );
+	CFReleaseNullSafe( records );
+	CFReleaseNullSafe( plist );
+	CFReleaseNullSafe( data );
+	return( err );
+}
+
+static OSStatus	_CFLiteBinaryPlistWriteBenchmarkOne( const char *inLabel, CFArrayRef inPlists, int inRounds )
+{
+	static const CFBinaryPlistFlags		kFlags[] = { kCFBinaryPlistFlags_None, kCFBinaryPlistFlag_NoUniquing };
+	OSStatus							err;
+	CFIndex								i, n;
+	int									round;
+	size_t								f, len, bytes[ countof( kFlags ) ];
+	uint64_t							ticks[ countof( kFlags ) ];
+	const void *						ptr;
+	CFPropertyListRef					plist;
+	Boolean								equal;
+	
+	n = CFArrayGetCount( inPlists );
+	for( f = 0; f < countof( kFlags ); ++f )
 	{
-		CFNumberGetValue( inNum, kCFNumberSInt64Type, &v.u64 );
+		bytes[ f ] = 0;
+		ticks[ f ] = UpTicks();
+		for( round = 0; round < inRounds; ++round )
+		{
+			for( i = 0; i < n; ++i )
+			{
+				ptr = CFBinaryPlistV0CreateEx( CFArrayGetValueAtIndex( inPlists, i ), kFlags[ f ], &len, &err );
+				require_noerr( err, exit );
+				free( (void *) ptr );
+			}
+		}
+		ticks[ f ] = UpTicks() - ticks[ f ];
 		
-		err = _WriteInteger( ctx, v.u64 );
-		require_noerr( err, exit );
+		// Verify each plist round trips outside of the timed loop.
+		
+		for( i = 0; i < n; ++i )
+		{
+			ptr = CFBinaryPlistV0CreateEx( CFArrayGetValueAtIndex( inPlists, i ), kFlags[ f ], &len, &err );
+			require_noerr( err, exit );
+			bytes[ f ] += len;
+			plist = CFBinaryPlistV0CreateWithData( ptr, len, &err );
+			free( (void *) ptr );
+			equal = plist && CFEqual( plist, CFArrayGetValueAtIndex( inPlists, i ) );
+			CFReleaseNullSafe( plist );
+			require_action( equal, exit, err = kMismatchErr );
+		}
 	}
 	
+	printf( "\twrite benchmark: %-6s %8zu bytes, %9.1f us/plist, no uniquing: %8zu bytes, %9.1f us/plist\n", inLabel, 
+		bytes[ 0 ] / (size_t) n, ( 1e6 * ticks[ 0 ] ) / ( ( (double) inRounds ) * n * UpTicksPerSecond() ), 
+		bytes[ 1 ] / (size_t) n, ( 1e6 * ticks[ 1 ] ) / ( ( (double) inRounds ) * n * UpTicksPerSecond() ) );
+	err = kNoErr;
+	
 exit:
 	return( err );
 }
 
-#if 0
-#pragma mark -
-#pragma mark == Debugging ==
-#endif
-
-#if( !EXCLUDE_UNIT_TESTS )
 //===========================================================================================================================
 //	CFLiteBinaryPlistTest
 //===========================================================================================================================
@@ -1384,6 +2479,10 @@ OSStatus	CFLiteBinaryPlistTest( void )
 	size_t							i;
 	uint8_t							buf[ 32 ];
 	CFTypeRef						obj;
+	CFBinaryPlistCursor				cursor, value, value2;
+	const char *					sptr;
+	const uint8_t *					dptr;
+	size_t							len;
 	
 	// Empty Test
 	
@@ -1530,6 +2629,11 @@ OSStatus	CFLiteBinaryPlistTest( void )
 	CFDictionarySetValue( plist, CFSTR( "dictionary" ), dict );
 	ForgetCF( &dict );
 	
+	str = CFStringCreateWithCString( kCFAllocatorDefault, "key (こんにちは)", kCFStringEncodingUTF8 );
+	require_action( str, exit, err = kNoMemoryErr );
+	CFDictionarySetValue( plist, str, kCFBooleanTrue );
+	CFRelease( str );
+	
 	// V0 Basic
 	
 	data = CFBinaryPlistV0CreateData( plist, &err );
@@ -1547,6 +2651,109 @@ OSStatus	CFLiteBinaryPlistTest( void )
 	require_action( CFEqual( plist, plist2 ), exit, err = kResponseErr );
 	ForgetCF( &plist2 );
 #endif
+	
+	// V0 Cursor
+	
+	err = CFBinaryPlistCursorInit( &cursor, CFDataGetBytePtr( data ), (size_t) CFDataGetLength( data ) );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetTypeID( &cursor ) == CFDictionaryGetTypeID(), exit, err = kTypeErr );
+	require_action( CFBinaryPlistCursorGetCount( &cursor, &err ) == CFDictionaryGetCount( plist ), exit, err = kCountErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "missing", &value );
+	require_action( err == kNotFoundErr, exit, err = kResponseErr );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "true", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetTypeID( &value ) == CFBooleanGetTypeID(), exit, err = kTypeErr );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == 1, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "number", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetTypeID( &value ) == CFNumberGetTypeID(), exit, err = kTypeErr );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == 1234567, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "number2", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == -123, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+#if( CFLITE_ENABLED )
+	err = CFBinaryPlistCursorGetValue( &cursor, "number3", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == -1, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "number4", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == -123, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+#endif
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "real", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == 123, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "data", &value );
+	require_noerr( err, exit );
+	dptr = CFBinaryPlistCursorGetDataPtr( &value, &len, &err );
+	require_noerr( err, exit );
+	require_action( ( len == 5 ) && ( memcmp( dptr, "\x01\x02\x03\x04\x05", 5 ) == 0 ), exit, err = kMismatchErr );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "string", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetTypeID( &value ) == CFStringGetTypeID(), exit, err = kTypeErr );
+	sptr = CFBinaryPlistCursorGetStringPtr( &value, &len, &err );
+	require_noerr( err, exit );
+	require_action( ( len == sizeof_string( "test string" ) ) && ( memcmp( sptr, "test string", len ) == 0 ), exit, err = kMismatchErr );
+	CFBinaryPlistCursorGetCString( &value, cstr, 5, &err );
+	require_noerr( err, exit );
+	require_action( strcmp( cstr, "test" ) == 0, exit, err = kMismatchErr );
+	CFBinaryPlistCursorGetDataPtr( &value, &len, &err );
+	require_action( err == kTypeErr, exit, err = kResponseErr );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "string2", &value );
+	require_noerr( err, exit );
+	CFBinaryPlistCursorGetStringPtr( &value, &len, &err );
+	require_action( err == kUnsupportedDataErr, exit, err = kResponseErr );
+	CFBinaryPlistCursorGetCString( &value, cstr, sizeof( cstr ), &err );
+	require_noerr( err, exit );
+	require_action( strcmp( cstr, "test string (こんにちは)" ) == 0, exit, err = kMismatchErr );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "key (こんにちは)", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetInt64( &value, &err ) == 1, exit, err = kMismatchErr );
+	require_noerr( err, exit );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "array", &value );
+	require_noerr( err, exit );
+	require_action( CFBinaryPlistCursorGetCount( &value, &err ) == 2, exit, err = kCountErr );
+	require_noerr( err, exit );
+	err = CFBinaryPlistCursorGetValue( &value, "false", &value2 );
+	require_action( err == kTypeErr, exit, err = kResponseErr );
+	err = CFBinaryPlistCursorGetValueAtIndex( &value, 2, &value2 );
+	require_action( err == kRangeErr, exit, err = kResponseErr );
+	err = CFBinaryPlistCursorGetValueAtIndex( &value, 1, &value2 );
+	require_noerr( err, exit );
+	CFBinaryPlistCursorGetCString( &value2, cstr, sizeof( cstr ), &err );
+	require_noerr( err, exit );
+	require_action( strcmp( cstr, "test string" ) == 0, exit, err = kMismatchErr );
+	
+	err = CFBinaryPlistCursorGetValue( &cursor, "dictionary", &value );
+	require_noerr( err, exit );
+	obj = CFBinaryPlistCursorCopyObject( &value, &err );
+	require_noerr( err, exit );
+	x = CFEqual( obj, CFDictionaryGetValue( plist, CFSTR( "dictionary" ) ) );
+	CFRelease( obj );
+	require_action( x, exit, err = kMismatchErr );
+	
+	plist2 = (CFMutableDictionaryRef) CFBinaryPlistCursorCopyObject( &cursor, &err );
+	require_noerr( err, exit );
+	require_action( CFEqual( plist, plist2 ), exit, err = kResponseErr );
+	ForgetCF( &plist2 );
 	ForgetCF( &data );
 	
 	// V0 Test 1
@@ -1601,6 +2808,12 @@ OSStatus	CFLiteBinaryPlistTest( void )
 	
 	ForgetCF( &plist2 );
 	
+	err = CFLiteBinaryPlistParseBenchmark();
+	require_noerr( err, exit );
+	
+	err = CFLiteBinaryPlistWriteBenchmark();
+	require_noerr( err, exit );
+	
 exit:
 	CFReleaseNullSafe( array );
 	CFReleaseNullSafe( data );
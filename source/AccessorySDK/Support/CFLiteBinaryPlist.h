@@ -73,6 +73,17 @@ extern "C" {
  */
 const void* CFBinaryPlistV0Create( CFTypeRef inObj, size_t *outSize, OSStatus *outErr );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistV0CreateEx
+	@abstract	Converts an object to a version 0 binary plist with flags to control how it's written.
+	@discussion	The returned pointer must be freed with free().
+*/
+typedef uint32_t		CFBinaryPlistFlags;
+#define kCFBinaryPlistFlags_None			0
+#define kCFBinaryPlistFlag_NoUniquing		( 1 << 0 ) // Write equal objects separately. Faster, but the output is larger.
+
+const void *	CFBinaryPlistV0CreateEx( CFTypeRef inObj, CFBinaryPlistFlags inFlags, size_t *outSize, OSStatus *outErr );
+
 //---------------------------------------------------------------------------------------------------------------------------
 /*!	@function	CFBinaryPlistV0CreateData
  @abstract	Converts an object to a version 0 binary plist (i.e. compatible with Mac/iOS binary plists).
@@ -87,6 +98,97 @@ CFDataRef	CFBinaryPlistV0CreateData( CFTypeRef inObj, OSStatus *outErr );
 CF_RETURNS_RETAINED
 CFPropertyListRef	CFBinaryPlistV0CreateWithData( const void *inPtr, size_t inLen, OSStatus *outErr );
 
+#if 0
+#pragma mark == Cursors ==
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@group		CFBinaryPlistCursor
+	@abstract	Reads values directly from binary plist bytes without creating objects.
+	@discussion
+
+	A cursor refers to a single object inside a binary plist. Dictionary and array cursors can be used to get cursors
+	for the objects they contain. Integers, strings, and data are read in place. Use CFBinaryPlistCursorCopyObject to
+	create objects for only the parts of the plist that need them. Cursors don't allocate memory or retain anything so
+	they can be copied freely, but the plist bytes must remain valid while any cursor into them is in use.
+*/
+typedef struct
+{
+	const uint8_t *		base;				// Start of the binary plist.
+	const uint8_t *		end;				// End of the object data (start of the trailer).
+	size_t				offsetTableOffset;	// Offset from the start of the plist to the offset table.
+	uint64_t			numObjects;			// Number of objects in the offset table.
+	uint8_t				offsetIntSize;		// Size of each entry in the offset table.
+	uint8_t				objectRefSize;		// Size of each object reference in an array or dictionary.
+	size_t				offset;				// Offset from the start of the plist to the object for this cursor.
+
+}	CFBinaryPlistCursor;
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorInit
+	@abstract	Validates a binary plist and initializes a cursor for its top-level object.
+*/
+OSStatus	CFBinaryPlistCursorInit( CFBinaryPlistCursor *outCursor, const void *inPtr, size_t inLen );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetTypeID
+	@abstract	Returns the CF type ID of the object the cursor refers to or 0 if the object is invalid.
+*/
+CFTypeID	CFBinaryPlistCursorGetTypeID( const CFBinaryPlistCursor *inCursor );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetCount
+	@abstract	Returns the number of values in an array or key/value pairs in a dictionary.
+*/
+CFIndex	CFBinaryPlistCursorGetCount( const CFBinaryPlistCursor *inCursor, OSStatus *outErr );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetValueAtIndex
+	@abstract	Gets a cursor for the value at an index of an array.
+*/
+OSStatus	CFBinaryPlistCursorGetValueAtIndex( const CFBinaryPlistCursor *inArray, CFIndex inIndex, CFBinaryPlistCursor *outValue );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetValue
+	@abstract	Gets a cursor for the value of a key in a dictionary.
+	@discussion	Keys are compared without creating objects. Returns kNotFoundErr if the dictionary doesn't have the key.
+*/
+OSStatus	CFBinaryPlistCursorGetValue( const CFBinaryPlistCursor *inDict, const char *inKey, CFBinaryPlistCursor *outValue );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetInt64
+	@abstract	Returns the value of an integer, boolean, or real (truncated) object.
+*/
+int64_t	CFBinaryPlistCursorGetInt64( const CFBinaryPlistCursor *inCursor, OSStatus *outErr );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetStringPtr
+	@abstract	Returns a pointer to the UTF-8 bytes of a string inside the plist.
+	@discussion	The string is NOT null terminated. Returns kUnsupportedDataErr for UTF-16 strings, which need to be
+				read with CFBinaryPlistCursorGetCString or CFBinaryPlistCursorCopyObject instead.
+*/
+const char *	CFBinaryPlistCursorGetStringPtr( const CFBinaryPlistCursor *inCursor, size_t *outLen, OSStatus *outErr );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetCString
+	@abstract	Copies an object to a null-terminated C string like CFGetCString.
+	@discussion	ASCII and UTF-8 strings are copied directly. Other objects are converted by creating them temporarily.
+*/
+char *	CFBinaryPlistCursorGetCString( const CFBinaryPlistCursor *inCursor, char *inBuf, size_t inMaxLen, OSStatus *outErr );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorGetDataPtr
+	@abstract	Returns a pointer to the bytes of a data object inside the plist.
+*/
+const uint8_t *	CFBinaryPlistCursorGetDataPtr( const CFBinaryPlistCursor *inCursor, size_t *outLen, OSStatus *outErr );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	CFBinaryPlistCursorCopyObject
+	@abstract	Creates an object for the value the cursor refers to (and any objects it contains).
+*/
+CF_RETURNS_RETAINED
+CFPropertyListRef	CFBinaryPlistCursorCopyObject( const CFBinaryPlistCursor *inCursor, OSStatus *outErr );
+
 #if 0
 #pragma mark == Debugging ==
 #endif
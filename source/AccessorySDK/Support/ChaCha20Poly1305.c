@@ -1128,7 +1128,63 @@ exit:
 #define U32TO8_LE( PTR, VALUE )		WriteLittle32( (PTR), (VALUE) )
 #define mul32x32_64(a,b)			((uint64_t)(a) * (b))
 
+// Long runs of blocks are processed in parallel with vector code. NEON and SSE2 do 2 blocks per vector and AVX2 does 4.
+// AVX2 is only used if the CPU supports it so the same binary runs on older x86 CPUs.
+//
+// POLY1305_NEON_ENABLED -- Opts in to the NEON code. It's off by default until it has been built and has passed the
+// RFC 8439 test vectors on ARM. ARM builds use the scalar code until then.
+
+#if( !defined( POLY1305_NEON_ENABLED ) )
+	#define POLY1305_NEON_ENABLED		0
+#endif
+
+#if( ( TARGET_HAS_NEON && POLY1305_NEON_ENABLED ) || ( !TARGET_HAS_NEON && ( TARGET_HAS_SSE >= SSE_VERSION( 2, 0 ) ) ) )
+	#define POLY1305_SIMD		1
+#else
+	#define POLY1305_SIMD		0
+#endif
+
+#if( POLY1305_SIMD && !TARGET_HAS_NEON && ( defined( __x86_64__ ) || defined( __i386__ ) ) && \
+	( ( COMPILER_GCC >= 40900 ) || ( COMPILER_CLANG >= 30800 ) ) )
+	#define POLY1305_AVX2		1
+#else
+	#define POLY1305_AVX2		0
+#endif
+
+#define kPoly1305SIMDMinLen		256	// Shorter runs are faster with scalar code because each key needs powers of r set up.
+
+// Indexes into rpow for each power of r.
+
+#define kPoly1305Pow2		0
+#define kPoly1305Pow3		1
+#define kPoly1305Pow4		2
+#define kPoly1305Pow8		3
+
+#if( POLY1305_SIMD )
+typedef enum
+{
+	kPoly1305Impl_Unknown	= 0, // Not selected yet.
+	kPoly1305Impl_Scalar	= 1, // 1 block at a time.
+	kPoly1305Impl_SIMD		= 2, // NEON or SSE2: 2 blocks at a time.
+	kPoly1305Impl_AVX2		= 3  // AVX2: 4 blocks at a time.
+	
+}	poly1305_impl;
+
+static poly1305_impl		gPoly1305Impl = kPoly1305Impl_Unknown;
+#endif
+
 static void _poly1305_update(poly1305_state *state, const uint8_t *in, size_t len);
+#if( POLY1305_SIMD )
+static size_t	_poly1305_blocks( poly1305_state *state, const uint8_t *in, size_t len );
+static size_t	_poly1305_blocks_simd( poly1305_state *state, const uint8_t *in, size_t len );
+#if( POLY1305_AVX2 )
+__attribute__( ( target( "avx2" ) ) )
+static size_t	_poly1305_blocks_avx2( poly1305_state *state, const uint8_t *in, size_t len );
+#endif
+static Boolean	_poly1305_impl_supported( poly1305_impl inImpl );
+static void		_poly1305_setup_powers( poly1305_state *state );
+static void		_poly1305_mul( uint32_t outH[ 5 ], const uint32_t inA[ 5 ], const uint32_t inB[ 5 ] );
+#endif
 
 void poly1305_init(poly1305_state *state, const uint8_t key[32])
 {
@@ -1162,6 +1218,7 @@ void poly1305_init(poly1305_state *state, const uint8_t key[32])
 	state->buf_used = 0;
 	for (i = 0; i < 16; ++i)
 		state->key[i] = key[i + 16];
+	state->rpow_ready = 0;
 }
 
 void poly1305_update(poly1305_state *state, const uint8_t *in, size_t in_len)
@@ -1249,6 +1306,14 @@ static void _poly1305_update(poly1305_state *state, const uint8_t *in, size_t le
 	size_t j;
 	uint8_t mp[16];
 
+#if( POLY1305_SIMD )
+	if (len >= kPoly1305SIMDMinLen) {
+		j = _poly1305_blocks(state, in, len);
+		in += j;
+		len -= j;
+	}
+#endif
+
 	if (len < 16)
 		goto poly1305_donna_atmost15bytes;
 
@@ -1330,6 +1395,392 @@ poly1305_donna_atmost15bytes:
 	goto poly1305_donna_mul;
 }
 
+#if( POLY1305_SIMD )
+//===========================================================================================================================
+//	poly1305 SIMD
+//
+//	Each vector lane holds a hash in 26-bit limbs (one limb per 64-bit element) and accumulates every Nth block, where N 
+//	is the number of lanes. Each step multiplies the lanes by r^N so no lane depends on another. At the end, the lanes 
+//	are multiplied by r^N...r^1 and added together, which gives the same result as processing each block in order.
+//	Loops do two steps at once (h * r^2N + m * r^N + m') to keep more multiplies in flight.
+//===========================================================================================================================
+
+#if( TARGET_HAS_NEON )
+	#include <arm_neon.h>
+	typedef uint64_t		poly1305_u64x2 __attribute__( ( vector_size( 16 ) ) );
+	#define POLY1305_MUL2( A, B ) \
+		( (poly1305_u64x2) vmull_u32( vmovn_u64( (uint64x2_t)(A) ), vmovn_u64( (uint64x2_t)(B) ) ) )
+	#define POLY1305_LOAD2( PTR, LO, HI ) \
+		do \
+		{ \
+			uint64x2_t const		a_ = vreinterpretq_u64_u8( vld1q_u8( (PTR) ) ); \
+			uint64x2_t const		b_ = vreinterpretq_u64_u8( vld1q_u8( (PTR) + 16 ) ); \
+			\
+			(LO) = (poly1305_u64x2) vcombine_u64( vget_low_u64( a_ ),  vget_low_u64( b_ ) ); \
+			(HI) = (poly1305_u64x2) vcombine_u64( vget_high_u64( a_ ), vget_high_u64( b_ ) ); \
+		\
+		}	while( 0 )
+#else
+	#include <emmintrin.h>
+	typedef uint64_t		poly1305_u64x2 __attribute__( ( vector_size( 16 ) ) );
+	#define POLY1305_MUL2( A, B ) \
+		( (poly1305_u64x2) _mm_mul_epu32( (__m128i)(A), (__m128i)(B) ) )
+	#define POLY1305_LOAD2( PTR, LO, HI ) \
+		do \
+		{ \
+			__m128i const		a_ = _mm_loadu_si128( (const __m128i *)(PTR) ); \
+			__m128i const		b_ = _mm_loadu_si128( (const __m128i *)( (PTR) + 16 ) ); \
+			\
+			(LO) = (poly1305_u64x2) _mm_unpacklo_epi64( a_, b_ ); \
+			(HI) = (poly1305_u64x2) _mm_unpackhi_epi64( a_, b_ ); \
+		\
+		}	while( 0 )
+#endif
+
+// Splits the low and high 64 bits of each lane's block into 26-bit limbs and adds the 2^128 bit.
+
+#define POLY1305_VEC_SPLIT( M, LO, HI, MASK, HIBIT ) \
+	(M)[ 0 ] = (LO) & (MASK); \
+	(M)[ 1 ] = ( (LO) >> 26 ) & (MASK); \
+	(M)[ 2 ] = ( ( (LO) >> 52 ) | ( (HI) << 12 ) ) & (MASK); \
+	(M)[ 3 ] = ( (HI) >> 14 ) & (MASK); \
+	(M)[ 4 ] = ( (HI) >> 40 ) | (HIBIT)
+
+// T = H * R or T += H * R where S is R * 5 (for the 2^130 wrap around). MUL multiplies the low 32 bits of each element.
+
+#define POLY1305_VEC_MUL( MUL, OP, T, H, R, S ) \
+	(T)[ 0 ] OP MUL( (H)[ 0 ], (R)[ 0 ] ) + MUL( (H)[ 1 ], (S)[ 4 ] ) + MUL( (H)[ 2 ], (S)[ 3 ] ) + MUL( (H)[ 3 ], (S)[ 2 ] ) + MUL( (H)[ 4 ], (S)[ 1 ] ); \
+	(T)[ 1 ] OP MUL( (H)[ 0 ], (R)[ 1 ] ) + MUL( (H)[ 1 ], (R)[ 0 ] ) + MUL( (H)[ 2 ], (S)[ 4 ] ) + MUL( (H)[ 3 ], (S)[ 3 ] ) + MUL( (H)[ 4 ], (S)[ 2 ] ); \
+	(T)[ 2 ] OP MUL( (H)[ 0 ], (R)[ 2 ] ) + MUL( (H)[ 1 ], (R)[ 1 ] ) + MUL( (H)[ 2 ], (R)[ 0 ] ) + MUL( (H)[ 3 ], (S)[ 4 ] ) + MUL( (H)[ 4 ], (S)[ 3 ] ); \
+	(T)[ 3 ] OP MUL( (H)[ 0 ], (R)[ 3 ] ) + MUL( (H)[ 1 ], (R)[ 2 ] ) + MUL( (H)[ 2 ], (R)[ 1 ] ) + MUL( (H)[ 3 ], (R)[ 0 ] ) + MUL( (H)[ 4 ], (S)[ 4 ] ); \
+	(T)[ 4 ] OP MUL( (H)[ 0 ], (R)[ 4 ] ) + MUL( (H)[ 1 ], (R)[ 3 ] ) + MUL( (H)[ 2 ], (R)[ 2 ] ) + MUL( (H)[ 3 ], (R)[ 1 ] ) + MUL( (H)[ 4 ], (R)[ 0 ] )
+
+// Carries each limb into the next so they fit in 26 bits again (limb 1 may be slightly over, which is fine).
+
+#define POLY1305_VEC_CARRY( T, C, MASK ) \
+	(C) = (T)[ 0 ] >> 26; (T)[ 0 ] &= (MASK); (T)[ 1 ] += (C); \
+	(C) = (T)[ 1 ] >> 26; (T)[ 1 ] &= (MASK); (T)[ 2 ] += (C); \
+	(C) = (T)[ 2 ] >> 26; (T)[ 2 ] &= (MASK); (T)[ 3 ] += (C); \
+	(C) = (T)[ 3 ] >> 26; (T)[ 3 ] &= (MASK); (T)[ 4 ] += (C); \
+	(C) = (T)[ 4 ] >> 26; (T)[ 4 ] &= (MASK); (T)[ 0 ] += (C) + ( (C) << 2 ); \
+	(C) = (T)[ 0 ] >> 26; (T)[ 0 ] &= (MASK); (T)[ 1 ] += (C)
+
+//===========================================================================================================================
+//	_poly1305_blocks
+//
+//	Processes as many full blocks as it can with the best vector code for this CPU. Returns the number of bytes used.
+//===========================================================================================================================
+
+static size_t	_poly1305_blocks( poly1305_state *state, const uint8_t *in, size_t len )
+{
+	poly1305_impl		impl;
+	
+	impl = gPoly1305Impl;
+	if( impl == kPoly1305Impl_Unknown )
+	{
+	#if( POLY1305_AVX2 )
+		impl = _poly1305_impl_supported( kPoly1305Impl_AVX2 ) ? kPoly1305Impl_AVX2 : kPoly1305Impl_SIMD;
+	#else
+		impl = kPoly1305Impl_SIMD;
+	#endif
+		gPoly1305Impl = impl;
+	}
+#if( POLY1305_AVX2 )
+	if( impl == kPoly1305Impl_AVX2 ) return( _poly1305_blocks_avx2( state, in, len ) );
+#endif
+	if( impl != kPoly1305Impl_Scalar ) return( _poly1305_blocks_simd( state, in, len ) );
+	return( 0 );
+}
+
+//===========================================================================================================================
+//	_poly1305_blocks_simd
+//
+//	Processes pairs of blocks with NEON or SSE2. Lane 0 has the first block of each pair. Requires at least 2 blocks.
+//===========================================================================================================================
+
+static size_t	_poly1305_blocks_simd( poly1305_state *state, const uint8_t *in, size_t len )
+{
+	const uint8_t * const		start	= in;
+	poly1305_u64x2 const		mask	= { 0x3ffffff, 0x3ffffff };
+	poly1305_u64x2 const		hibit	= { 1 << 24, 1 << 24 };
+	const uint32_t				r1[ 5 ]	= { state->r0, state->r1, state->r2, state->r3, state->r4 };
+	const uint32_t * const		r2		= state->rpow[ kPoly1305Pow2 ];
+	const uint32_t * const		r4		= state->rpow[ kPoly1305Pow4 ];
+	poly1305_u64x2				rr2[ 5 ], ss2[ 5 ], rr4[ 5 ], ss4[ 5 ], rrf[ 5 ], ssf[ 5 ];
+	poly1305_u64x2				h[ 5 ], t[ 5 ], m[ 5 ], lo, hi, c;
+	uint64_t					h0, h1, h2, h3, h4, b;
+	int							i;
+	
+	if( !state->rpow_ready ) _poly1305_setup_powers( state );
+	for( i = 0; i < 5; ++i )
+	{
+		rr2[ i ] = (poly1305_u64x2){ r2[ i ], r2[ i ] };
+		rr4[ i ] = (poly1305_u64x2){ r4[ i ], r4[ i ] };
+		rrf[ i ] = (poly1305_u64x2){ r2[ i ], r1[ i ] };
+		ss2[ i ] = rr2[ i ] + ( rr2[ i ] << 2 );
+		ss4[ i ] = rr4[ i ] + ( rr4[ i ] << 2 );
+		ssf[ i ] = rrf[ i ] + ( rrf[ i ] << 2 );
+	}
+	
+	// Start with the first pair, adding the current hash to the first block.
+	
+	POLY1305_LOAD2( in, lo, hi );
+	POLY1305_VEC_SPLIT( h, lo, hi, mask, hibit );
+	h[ 0 ] += (poly1305_u64x2){ state->h0, 0 };
+	h[ 1 ] += (poly1305_u64x2){ state->h1, 0 };
+	h[ 2 ] += (poly1305_u64x2){ state->h2, 0 };
+	h[ 3 ] += (poly1305_u64x2){ state->h3, 0 };
+	h[ 4 ] += (poly1305_u64x2){ state->h4, 0 };
+	in  += 32;
+	len -= 32;
+	
+	// 4 blocks at a time: h = ( h * r^4 ) + ( m * r^2 ) + m'.
+	
+	while( len >= 64 )
+	{
+		POLY1305_LOAD2( in, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_MUL( POLY1305_MUL2, =,  t, h, rr4, ss4 );
+		POLY1305_VEC_MUL( POLY1305_MUL2, +=, t, m, rr2, ss2 );
+		POLY1305_LOAD2( in + 32, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_CARRY( t, c, mask );
+		for( i = 0; i < 5; ++i ) h[ i ] = t[ i ] + m[ i ];
+		in  += 64;
+		len -= 64;
+	}
+	if( len >= 32 )
+	{
+		POLY1305_LOAD2( in, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_MUL( POLY1305_MUL2, =, t, h, rr2, ss2 );
+		POLY1305_VEC_CARRY( t, c, mask );
+		for( i = 0; i < 5; ++i ) h[ i ] = t[ i ] + m[ i ];
+		in  += 32;
+		len -= 32;
+	}
+	
+	// Multiply the lanes by r^2 and r^1, add them together, and carry back into the scalar hash.
+	
+	POLY1305_VEC_MUL( POLY1305_MUL2, =, t, h, rrf, ssf );
+	POLY1305_VEC_CARRY( t, c, mask );
+	h0 = t[ 0 ][ 0 ] + t[ 0 ][ 1 ];
+	h1 = t[ 1 ][ 0 ] + t[ 1 ][ 1 ];
+	h2 = t[ 2 ][ 0 ] + t[ 2 ][ 1 ];
+	h3 = t[ 3 ][ 0 ] + t[ 3 ][ 1 ];
+	h4 = t[ 4 ][ 0 ] + t[ 4 ][ 1 ];
+	                  b = h0 >> 26; h0 &= 0x3ffffff;
+	h1 += b;          b = h1 >> 26; h1 &= 0x3ffffff;
+	h2 += b;          b = h2 >> 26; h2 &= 0x3ffffff;
+	h3 += b;          b = h3 >> 26; h3 &= 0x3ffffff;
+	h4 += b;          b = h4 >> 26; h4 &= 0x3ffffff;
+	h0 += b * 5;      b = h0 >> 26; h0 &= 0x3ffffff;
+	h1 += b;
+	state->h0 = (uint32_t) h0;
+	state->h1 = (uint32_t) h1;
+	state->h2 = (uint32_t) h2;
+	state->h3 = (uint32_t) h3;
+	state->h4 = (uint32_t) h4;
+	return( (size_t)( in - start ) );
+}
+
+#if( POLY1305_AVX2 )
+//===========================================================================================================================
+//	_poly1305_blocks_avx2
+//
+//	Processes groups of 4 blocks with AVX2. The unpacks work within each 128-bit half so lanes 0-3 have blocks 0, 2, 1,
+//	and 3 of each group. The final powers of r are ordered to match. Requires at least 4 blocks.
+//===========================================================================================================================
+
+#include <immintrin.h>
+
+typedef uint64_t		poly1305_u64x4 __attribute__( ( vector_size( 32 ) ) );
+
+#define POLY1305_MUL4( A, B ) \
+	( (poly1305_u64x4) _mm256_mul_epu32( (__m256i)(A), (__m256i)(B) ) )
+#define POLY1305_LOAD4( PTR, LO, HI ) \
+	do \
+	{ \
+		__m256i const		a_ = _mm256_loadu_si256( (const __m256i *)(PTR) ); \
+		__m256i const		b_ = _mm256_loadu_si256( (const __m256i *)( (PTR) + 32 ) ); \
+		\
+		(LO) = (poly1305_u64x4) _mm256_unpacklo_epi64( a_, b_ ); \
+		(HI) = (poly1305_u64x4) _mm256_unpackhi_epi64( a_, b_ ); \
+	\
+	}	while( 0 )
+
+__attribute__( ( target( "avx2" ) ) )
+static size_t	_poly1305_blocks_avx2( poly1305_state *state, const uint8_t *in, size_t len )
+{
+	const uint8_t * const		start	= in;
+	poly1305_u64x4 const		mask	= { 0x3ffffff, 0x3ffffff, 0x3ffffff, 0x3ffffff };
+	poly1305_u64x4 const		hibit	= { 1 << 24, 1 << 24, 1 << 24, 1 << 24 };
+	const uint32_t				r1[ 5 ]	= { state->r0, state->r1, state->r2, state->r3, state->r4 };
+	const uint32_t * const		r2		= state->rpow[ kPoly1305Pow2 ];
+	const uint32_t * const		r3		= state->rpow[ kPoly1305Pow3 ];
+	const uint32_t * const		r4		= state->rpow[ kPoly1305Pow4 ];
+	const uint32_t * const		r8		= state->rpow[ kPoly1305Pow8 ];
+	poly1305_u64x4				rr4[ 5 ], ss4[ 5 ], rr8[ 5 ], ss8[ 5 ], rrf[ 5 ], ssf[ 5 ];
+	poly1305_u64x4				h[ 5 ], t[ 5 ], m[ 5 ], lo, hi, c;
+	uint64_t					h0, h1, h2, h3, h4, b;
+	int							i;
+	
+	if( !state->rpow_ready ) _poly1305_setup_powers( state );
+	for( i = 0; i < 5; ++i )
+	{
+		rr4[ i ] = (poly1305_u64x4){ r4[ i ], r4[ i ], r4[ i ], r4[ i ] };
+		rr8[ i ] = (poly1305_u64x4){ r8[ i ], r8[ i ], r8[ i ], r8[ i ] };
+		rrf[ i ] = (poly1305_u64x4){ r4[ i ], r2[ i ], r3[ i ], r1[ i ] };
+		ss4[ i ] = rr4[ i ] + ( rr4[ i ] << 2 );
+		ss8[ i ] = rr8[ i ] + ( rr8[ i ] << 2 );
+		ssf[ i ] = rrf[ i ] + ( rrf[ i ] << 2 );
+	}
+	
+	// Start with the first group, adding the current hash to the first block.
+	
+	POLY1305_LOAD4( in, lo, hi );
+	POLY1305_VEC_SPLIT( h, lo, hi, mask, hibit );
+	h[ 0 ] += (poly1305_u64x4){ state->h0, 0, 0, 0 };
+	h[ 1 ] += (poly1305_u64x4){ state->h1, 0, 0, 0 };
+	h[ 2 ] += (poly1305_u64x4){ state->h2, 0, 0, 0 };
+	h[ 3 ] += (poly1305_u64x4){ state->h3, 0, 0, 0 };
+	h[ 4 ] += (poly1305_u64x4){ state->h4, 0, 0, 0 };
+	in  += 64;
+	len -= 64;
+	
+	// 8 blocks at a time: h = ( h * r^8 ) + ( m * r^4 ) + m'.
+	
+	while( len >= 128 )
+	{
+		POLY1305_LOAD4( in, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_MUL( POLY1305_MUL4, =,  t, h, rr8, ss8 );
+		POLY1305_VEC_MUL( POLY1305_MUL4, +=, t, m, rr4, ss4 );
+		POLY1305_LOAD4( in + 64, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_CARRY( t, c, mask );
+		for( i = 0; i < 5; ++i ) h[ i ] = t[ i ] + m[ i ];
+		in  += 128;
+		len -= 128;
+	}
+	if( len >= 64 )
+	{
+		POLY1305_LOAD4( in, lo, hi );
+		POLY1305_VEC_SPLIT( m, lo, hi, mask, hibit );
+		POLY1305_VEC_MUL( POLY1305_MUL4, =, t, h, rr4, ss4 );
+		POLY1305_VEC_CARRY( t, c, mask );
+		for( i = 0; i < 5; ++i ) h[ i ] = t[ i ] + m[ i ];
+		in  += 64;
+		len -= 64;
+	}
+	
+	// Multiply the lanes by r^4, r^2, r^3, and r^1, add them together, and carry back into the scalar hash.
+	
+	POLY1305_VEC_MUL( POLY1305_MUL4, =, t, h, rrf, ssf );
+	POLY1305_VEC_CARRY( t, c, mask );
+	h0 = t[ 0 ][ 0 ] + t[ 0 ][ 1 ] + t[ 0 ][ 2 ] + t[ 0 ][ 3 ];
+	h1 = t[ 1 ][ 0 ] + t[ 1 ][ 1 ] + t[ 1 ][ 2 ] + t[ 1 ][ 3 ];
+	h2 = t[ 2 ][ 0 ] + t[ 2 ][ 1 ] + t[ 2 ][ 2 ] + t[ 2 ][ 3 ];
+	h3 = t[ 3 ][ 0 ] + t[ 3 ][ 1 ] + t[ 3 ][ 2 ] + t[ 3 ][ 3 ];
+	h4 = t[ 4 ][ 0 ] + t[ 4 ][ 1 ] + t[ 4 ][ 2 ] + t[ 4 ][ 3 ];
+	                  b = h0 >> 26; h0 &= 0x3ffffff;
+	h1 += b;          b = h1 >> 26; h1 &= 0x3ffffff;
+	h2 += b;          b = h2 >> 26; h2 &= 0x3ffffff;
+	h3 += b;          b = h3 >> 26; h3 &= 0x3ffffff;
+	h4 += b;          b = h4 >> 26; h4 &= 0x3ffffff;
+	h0 += b * 5;      b = h0 >> 26; h0 &= 0x3ffffff;
+	h1 += b;
+	state->h0 = (uint32_t) h0;
+	state->h1 = (uint32_t) h1;
+	state->h2 = (uint32_t) h2;
+	state->h3 = (uint32_t) h3;
+	state->h4 = (uint32_t) h4;
+	return( (size_t)( in - start ) );
+}
+#endif // POLY1305_AVX2
+
+//===========================================================================================================================
+//	_poly1305_impl_supported
+//===========================================================================================================================
+
+static Boolean	_poly1305_impl_supported( poly1305_impl inImpl )
+{
+	switch( inImpl )
+	{
+		case kPoly1305Impl_Scalar:
+		case kPoly1305Impl_SIMD:
+			return( true );
+		
+	#if( POLY1305_AVX2 )
+		case kPoly1305Impl_AVX2:
+		#if( TARGET_HAS_AVX >= AVX_VERSION( 2 ) )
+			return( true );
+		#else
+			__builtin_cpu_init();
+			return( __builtin_cpu_supports( "avx2" ) ? true : false );
+		#endif
+	#endif
+		
+		default:
+			return( false );
+	}
+}
+
+//===========================================================================================================================
+//	_poly1305_setup_powers
+//===========================================================================================================================
+
+static void	_poly1305_setup_powers( poly1305_state *state )
+{
+	const uint32_t		r[ 5 ] = { state->r0, state->r1, state->r2, state->r3, state->r4 };
+	
+	_poly1305_mul( state->rpow[ kPoly1305Pow2 ], r, r );
+	_poly1305_mul( state->rpow[ kPoly1305Pow3 ], state->rpow[ kPoly1305Pow2 ], r );
+	_poly1305_mul( state->rpow[ kPoly1305Pow4 ], state->rpow[ kPoly1305Pow2 ], state->rpow[ kPoly1305Pow2 ] );
+	_poly1305_mul( state->rpow[ kPoly1305Pow8 ], state->rpow[ kPoly1305Pow4 ], state->rpow[ kPoly1305Pow4 ] );
+	state->rpow_ready = 1;
+}
+
+//===========================================================================================================================
+//	_poly1305_mul
+//
+//	Multiplies two 26-bit limb numbers modulo 2^130 - 5.
+//===========================================================================================================================
+
+static void	_poly1305_mul( uint32_t outH[ 5 ], const uint32_t inA[ 5 ], const uint32_t inB[ 5 ] )
+{
+	uint32_t const		s1 = inB[ 1 ] * 5;
+	uint32_t const		s2 = inB[ 2 ] * 5;
+	uint32_t const		s3 = inB[ 3 ] * 5;
+	uint32_t const		s4 = inB[ 4 ] * 5;
+	uint64_t			t0, t1, t2, t3, t4, c;
+	
+	t0 = mul32x32_64( inA[ 0 ], inB[ 0 ] ) + mul32x32_64( inA[ 1 ], s4 ) + mul32x32_64( inA[ 2 ], s3 ) + 
+		 mul32x32_64( inA[ 3 ], s2 ) + mul32x32_64( inA[ 4 ], s1 );
+	t1 = mul32x32_64( inA[ 0 ], inB[ 1 ] ) + mul32x32_64( inA[ 1 ], inB[ 0 ] ) + mul32x32_64( inA[ 2 ], s4 ) + 
+		 mul32x32_64( inA[ 3 ], s3 ) + mul32x32_64( inA[ 4 ], s2 );
+	t2 = mul32x32_64( inA[ 0 ], inB[ 2 ] ) + mul32x32_64( inA[ 1 ], inB[ 1 ] ) + mul32x32_64( inA[ 2 ], inB[ 0 ] ) + 
+		 mul32x32_64( inA[ 3 ], s4 ) + mul32x32_64( inA[ 4 ], s3 );
+	t3 = mul32x32_64( inA[ 0 ], inB[ 3 ] ) + mul32x32_64( inA[ 1 ], inB[ 2 ] ) + mul32x32_64( inA[ 2 ], inB[ 1 ] ) + 
+		 mul32x32_64( inA[ 3 ], inB[ 0 ] ) + mul32x32_64( inA[ 4 ], s4 );
+	t4 = mul32x32_64( inA[ 0 ], inB[ 4 ] ) + mul32x32_64( inA[ 1 ], inB[ 3 ] ) + mul32x32_64( inA[ 2 ], inB[ 2 ] ) + 
+		 mul32x32_64( inA[ 3 ], inB[ 1 ] ) + mul32x32_64( inA[ 4 ], inB[ 0 ] );
+	
+	           c = t0 >> 26; t0 &= 0x3ffffff;
+	t1 += c;   c = t1 >> 26; t1 &= 0x3ffffff;
+	t2 += c;   c = t2 >> 26; t2 &= 0x3ffffff;
+	t3 += c;   c = t3 >> 26; t3 &= 0x3ffffff;
+	t4 += c;   c = t4 >> 26; t4 &= 0x3ffffff;
+	t0 += c * 5; c = t0 >> 26; t0 &= 0x3ffffff;
+	t1 += c;
+	outH[ 0 ] = (uint32_t) t0;
+	outH[ 1 ] = (uint32_t) t1;
+	outH[ 2 ] = (uint32_t) t2;
+	outH[ 3 ] = (uint32_t) t3;
+	outH[ 4 ] = (uint32_t) t4;
+}
+#endif // POLY1305_SIMD
+
 void	poly1305(uint8_t out[16], const uint8_t *m, size_t inlen, const uint8_t key[32])
 {
 	poly1305_state state;
@@ -1344,6 +1795,14 @@ void	poly1305(uint8_t out[16], const uint8_t *m, size_t inlen, const uint8_t key
 //	poly1305_test
 //===========================================================================================================================
 
+#define kPoly1305TestBufSize		4112
+
+static OSStatus	_poly1305_test_long( void );
+#if( POLY1305_SIMD )
+static OSStatus	_poly1305_test_compare( poly1305_impl inImpl, uint8_t *inBuf );
+#endif
+static void		_poly1305_test_fill( uint8_t *inBuf, size_t inLen, uint8_t inSeed );
+
 OSStatus	poly1305_test( int inPerf );
 OSStatus	poly1305_test( int inPerf )
 {
@@ -1809,6 +2268,11 @@ OSStatus	poly1305_test( int inPerf )
 	poly1305_final( &state, result );
 	require_action( memcmp( result, kPoly1305Test11_Tag, sizeof( kPoly1305Test11_Tag ) ) == 0, exit, err = -1 );
 	
+	// Long messages for the vector code.
+	
+	err = _poly1305_test_long();
+	require_noerr( err, exit );
+	
 	if( inPerf )
 	{
 		// Small performance test.
@@ -1874,6 +2338,149 @@ exit:
 	printf( "poly1305_test: %s\n", !err ? "PASSED" : "FAILED" );
 	return( err );
 }
+
+//===========================================================================================================================
+//	_poly1305_test_long
+//
+//	Tests long messages with each implementation this CPU supports. Tags were generated independently with a big 
+//	integer implementation of Poly1305.
+//===========================================================================================================================
+
+typedef struct
+{
+	size_t			len;
+	uint8_t			fill;		// 0 to use _poly1305_test_fill for the key and message or a byte to fill both with.
+	uint8_t			tag[ 16 ];
+	
+}	poly1305_test_vector;
+
+static OSStatus	_poly1305_test_long( void )
+{
+	static const poly1305_test_vector		kTests[] = 
+	{
+		{ 64,   0x00, { 0xF8, 0x8C, 0x69, 0xDA, 0x49, 0x2C, 0xC7, 0x22, 0xD8, 0x6A, 0xF1, 0xAC, 0x63, 0x90, 0x74, 0xBE } }, 
+		{ 288,  0x00, { 0xA8, 0x4F, 0x94, 0x30, 0x65, 0xC9, 0x0E, 0x52, 0xD8, 0x8B, 0x2B, 0x51, 0xC0, 0x90, 0x25, 0xAB } }, 
+		{ 1031, 0x00, { 0x7B, 0x2F, 0xC5, 0xC3, 0xF2, 0x9E, 0x5D, 0xCB, 0x0F, 0xB0, 0x70, 0x26, 0x71, 0x2D, 0xA1, 0xC9 } }, 
+		{ 4111, 0x00, { 0xF4, 0xB8, 0x9B, 0xF1, 0x79, 0xC9, 0x35, 0x44, 0xB1, 0x68, 0xAF, 0x9D, 0x41, 0x9F, 0x28, 0x0B } }, 
+		{ 1024, 0xFF, { 0x25, 0xD4, 0x92, 0x6A, 0x53, 0xBB, 0x48, 0x0D, 0xA2, 0x28, 0xEC, 0x61, 0xE0, 0xA3, 0x1A, 0x38 } }
+	};
+	OSStatus		err;
+	uint8_t *		buf;
+	uint8_t			key[ 32 ];
+	uint8_t			result[ 16 ];
+	size_t			i;
+	int				impl, lastImpl;
+	
+	buf = (uint8_t *) malloc( kPoly1305TestBufSize );
+	require_action( buf, exit, err = kNoMemoryErr );
+	
+#if( POLY1305_SIMD )
+	lastImpl = kPoly1305Impl_AVX2;
+#else
+	lastImpl = 0;
+#endif
+	for( impl = 0; impl <= lastImpl; ++impl )
+	{
+	#if( POLY1305_SIMD )
+		if( !_poly1305_impl_supported( (poly1305_impl) impl ) ) continue;
+		gPoly1305Impl = (poly1305_impl) impl;
+	#endif
+		for( i = 0; i < countof( kTests ); ++i )
+		{
+			if( kTests[ i ].fill )
+			{
+				memset( key, kTests[ i ].fill, sizeof( key ) );
+				memset( buf, kTests[ i ].fill, kTests[ i ].len );
+			}
+			else
+			{
+				_poly1305_test_fill( key, sizeof( key ), 0x55 );
+				_poly1305_test_fill( buf, kTests[ i ].len, 7 );
+			}
+			poly1305( result, buf, kTests[ i ].len, key );
+			require_action( memcmp( result, kTests[ i ].tag, 16 ) == 0, exit, err = -1 );
+		}
+		
+	#if( POLY1305_SIMD )
+		if( impl != kPoly1305Impl_Scalar )
+		{
+			err = _poly1305_test_compare( (poly1305_impl) impl, buf );
+			require_noerr( err, exit );
+		}
+	#endif
+	}
+	err = kNoErr;
+	
+exit:
+#if( POLY1305_SIMD )
+	gPoly1305Impl = kPoly1305Impl_Unknown;
+#endif
+	FreeNullSafe( buf );
+	return( err );
+}
+
+#if( POLY1305_SIMD )
+//===========================================================================================================================
+//	_poly1305_test_compare
+//
+//	Compares vector code with the scalar code for every length up to a few hundred blocks with unaligned input and for 
+//	updates split at odd sizes so vector code starts and stops in the middle of a hash.
+//===========================================================================================================================
+
+static OSStatus	_poly1305_test_compare( poly1305_impl inImpl, uint8_t *inBuf )
+{
+	static const size_t		kSplits[] = { 1, 15, 17, 48, 63, 64, 100, 257 };
+	OSStatus				err;
+	uint8_t					key[ 32 ];
+	uint8_t					result[ 16 ];
+	uint8_t					expected[ 16 ];
+	poly1305_state			state;
+	size_t					i, j, len, offset, n;
+	
+	_poly1305_test_fill( key, sizeof( key ), 0xA3 );
+	_poly1305_test_fill( inBuf, kPoly1305TestBufSize, 0x1F );
+	for( len = 0; len <= 1100; ++len )
+	{
+		offset = len % 3;
+		gPoly1305Impl = kPoly1305Impl_Scalar;
+		poly1305( expected, &inBuf[ offset ], len, key );
+		gPoly1305Impl = inImpl;
+		poly1305( result, &inBuf[ offset ], len, key );
+		require_action( memcmp( result, expected, 16 ) == 0, exit, err = -1 );
+	}
+	
+	gPoly1305Impl = kPoly1305Impl_Scalar;
+	poly1305( expected, inBuf, kPoly1305TestBufSize, key );
+	gPoly1305Impl = inImpl;
+	for( i = 0; i < countof( kSplits ); ++i )
+	{
+		poly1305_init( &state, key );
+		for( offset = 0, j = 0; offset < kPoly1305TestBufSize; offset += n, ++j )
+		{
+			n = ( j % 2 ) ? ( kSplits[ i ] + 512 ) : kSplits[ i ];
+			n = Min( n, kPoly1305TestBufSize - offset );
+			poly1305_update( &state, &inBuf[ offset ], n );
+		}
+		poly1305_final( &state, result );
+		require_action( memcmp( result, expected, 16 ) == 0, exit, err = -1 );
+	}
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+#endif // POLY1305_SIMD
+
+//===========================================================================================================================
+//	_poly1305_test_fill
+//===========================================================================================================================
+
+static void	_poly1305_test_fill( uint8_t *inBuf, size_t inLen, uint8_t inSeed )
+{
+	size_t		i;
+	
+	for( i = 0; i < inLen; ++i ) inBuf[ i ] = (uint8_t)( ( i * 31 ) + ( i >> 8 ) + inSeed );
+}
 #endif // !EXCLUDE_UNIT_TESTS
 
 #if 0
@@ -2391,11 +2998,12 @@ OSStatus	chacha20_poly1305_test( int inPrint, int inPerf )
 		0xf3, 0xff, 0xc7, 0x70, 0x3f, 0x94, 0x00, 0xe5
 	};
 	
+	static const size_t			kPerfSizes[] = { 64, 1024, 16 * 1024, 256 * 1024 };
 	OSStatus					err;
-	size_t						i, n;
+	size_t						i, j, n, count;
 	chacha20_poly1305_state		state;
 	uint64_t					ticks;
-	double						d;
+	double						d, encryptMBs, decryptMBs, polyMBs, scalarMBs;
 	size_t						len;
 	uint8_t *					buf = NULL;
 	uint8_t *					buf2 = NULL;
@@ -2544,6 +3152,58 @@ OSStatus	chacha20_poly1305_test( int inPrint, int inPerf )
 		fprintf( stderr, "\tchacha20_poly1305 (%zu bytes): %f (%f µs, %.2f MB/sec), BUF: " sixteenByteHexFormat ", MAC: " sixteenByteHexFormat "\n",
 			len, d, ( 1000000 * d ) / i, ( i * len ) / ( d * 1048576.0 ), sixteenBytes(buf), sixteenBytes(mac) );
 		ForgetMem( &buf );
+		
+		// Throughput for audio, screen, and control sized packets. Poly1305 is shown on its own with the best code for 
+		// this CPU and with the scalar code to show how much of the AEAD time is spent authenticating.
+		
+		for( i = 0; i < countof( kPerfSizes ); ++i )
+		{
+			len = kPerfSizes[ i ];
+			count = ( 64 * 1024 * 1024 ) / len;
+			buf = (uint8_t *) malloc( len );
+			require_action( buf, exit, err = kNoMemoryErr );
+			memset( buf, 'a', len );
+			buf2 = (uint8_t *) malloc( len );
+			require_action( buf2, exit, err = kNoMemoryErr );
+			
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j )
+			{
+				chacha20_poly1305_encrypt_all_64x64( kTestKey, kTestNonce, NULL, 0, buf, len, buf2, mac );
+			}
+			ticks = UpTicks() - ticks;
+			encryptMBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+			
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j )
+			{
+				err = chacha20_poly1305_decrypt_all_64x64( kTestKey, kTestNonce, NULL, 0, buf2, len, buf, mac );
+				require_noerr( err, exit );
+			}
+			ticks = UpTicks() - ticks;
+			decryptMBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+			
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j ) poly1305( mac, buf, len, kTestKey );
+			ticks = UpTicks() - ticks;
+			polyMBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+			
+		#if( POLY1305_SIMD )
+			gPoly1305Impl = kPoly1305Impl_Scalar;
+		#endif
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j ) poly1305( mac, buf, len, kTestKey );
+			ticks = UpTicks() - ticks;
+		#if( POLY1305_SIMD )
+			gPoly1305Impl = kPoly1305Impl_Unknown;
+		#endif
+			scalarMBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+			
+			fprintf( stderr, "\tchacha20_poly1305 %6zu bytes: encrypt %8.2f MB/sec, decrypt %8.2f MB/sec, "
+				"poly1305 %8.2f MB/sec (scalar %8.2f MB/sec)\n", len, encryptMBs, decryptMBs, polyMBs, scalarMBs );
+			ForgetMem( &buf );
+			ForgetMem( &buf2 );
+		}
 	}
 	err = kNoErr;
 	
@@ -112,6 +112,8 @@ void
 /*!	@group		poly1305
 	@abstract	Generates a 16-byte Poly1305 Message Authentication Code from N bytes of data and a 32-byte key.
 	@discussion	See DJB's paper on Poly1305 <http://cr.yp.to/mac.html> for details.
+	
+	Long messages are processed several blocks at a time using NEON, SSE2, or AVX2 (selected at runtime) when available.
 */
 typedef struct
 {
@@ -121,6 +123,8 @@ typedef struct
 	uint8_t			buf[ 16 ];
 	size_t			buf_used;
 	uint8_t			key[ 16 ];
+	uint32_t		rpow[ 4 ][ 5 ];	// r^2, r^3, r^4, and r^8 for processing blocks in parallel. Only valid if rpow_ready.
+	uint32_t		rpow_ready;
 	
 }	poly1305_state;
 
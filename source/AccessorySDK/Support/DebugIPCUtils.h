@@ -84,8 +84,10 @@ OSStatus	IPCAgent_Perform( CFDictionaryRef inMessage, IPCMessageHandlerFunc inRe
 #define kDebugIPCOpCode_Control			CFSTR( "control" )
 #define kDebugIPCOpCode_Logging			CFSTR( "logging" )
 #define kDebugIPCOpCode_Show			CFSTR( "show" )
+#define kDebugIPCOpCode_Trace			CFSTR( "trace" )
 
 #define kDebugIPCKey_Command			CFSTR( "command" )
+#define kDebugIPCKey_Path				CFSTR( "path" )
 #define kDebugIPCKey_ResponseType		CFSTR( "responseType" )
 #define kDebugIPCKey_Value				CFSTR( "value" )
 
@@ -70,9 +70,14 @@
 	#include <sys/event.h>
 #endif
 
+#if( DISPATCH_LITE_USE_EPOLL )
+	#include <sys/epoll.h>
+#endif
+
 #if( TARGET_OS_POSIX )
 	#include <fcntl.h>
 	#include <pthread.h>
+	#include <sys/resource.h>
 	#include <sys/stat.h>
 	#include <sys/time.h>
 #endif
@@ -94,10 +99,6 @@
 //	Constants and Types
 //===========================================================================================================================
 
-#if( !defined( TARGET_NO_PTHREAD_BROADCAST ) )
-	#define TARGET_NO_PTHREAD_BROADCAST				0
-#endif
-
 #if( TARGET_OS_WINDOWS )
 	#define kLibDispatchWindowEvent_Socket			( WM_USER + 0x100 )
 	#define kLibDispatchWindowEvent_WorkPending		( WM_USER + 0x101 )
@@ -124,6 +125,50 @@ struct dispatch_item_s
 	void *					context;
 };
 
+// dispatch_item_cache
+//
+// Each thread caches up to two batches of free items. Threads that free more than they allocate (e.g. work threads) 
+// hand full batches to a bounded global pool and threads that allocate more than they free take batches back out so 
+// steady state async work doesn't touch the heap.
+
+#define kDispatchItemCacheBatchSize		32	// Items per batch moved between a thread and the global pool.
+#define kDispatchItemPoolMaxBatches		32	// Max batches kept in the global pool. Extra batches are freed.
+
+typedef struct
+{
+	dispatch_item_t		current;		// Items to allocate from and free to.
+	int					currentCount;
+	dispatch_item_t		full;			// Full batch of kDispatchItemCacheBatchSize items or NULL.
+	
+}	dispatch_item_cache;
+
+// dispatch_worker
+//
+// Each pool thread owns a slot with a deque of items. Work scheduled from a pool thread goes on the bottom of its own 
+// deque and runs LIFO while it's still cache hot. Work scheduled from other threads goes on a global FIFO list. A thread 
+// that runs out of work steals from the top of other deques before it parks. Slots are never freed while the pool is 
+// up so thieves can peek at any of them without holding a lock.
+
+#if( !TARGET_OS_WINDOWS )
+	#define kDispatchWorkerDequeMinCapacity		64	// Initial deque capacity. Must be a power of 2.
+	#define kDispatchThreadPoolIdleSeconds		2	// Seconds a parked thread above the min waits before exiting.
+	
+	typedef struct dispatch_worker_s *	dispatch_worker_t;
+	struct dispatch_worker_s
+	{
+		dispatch_worker_t		idleNext;		// Next parked worker. Protected by the pool mutex.
+		Boolean					initialized;	// True if mutex and condition have been initialized.
+		Boolean					active;			// True if a thread owns this slot. Protected by the pool mutex.
+		Boolean					wake;			// True if another thread woke us up. Protected by the pool mutex.
+		pthread_mutex_t			mutex;			// Protects the deque.
+		pthread_cond_t			condition;		// Signaled to wake a parked worker. Uses the monotonic clock if possible.
+		dispatch_item_t *		deque;			// Ring buffer of items.
+		uint32_t				dequeCapacity;	// Always a power of 2.
+		uint32_t				dequeTop;		// Index of the oldest item. Thieves take from here.
+		uint32_t volatile		dequeCount;		// Peeked without the mutex to skip empty deques.
+	};
+#endif
+
 // dispatch_simple_item
 
 typedef struct
@@ -209,6 +254,7 @@ struct dispatch_source_s
 			unsigned long		count;
 			#if( DISPATCH_LITE_USE_SELECT )
 				uint64_t		expireTicks;
+				size_t			heapIndex;			// 1-based index in the timer heap or 0 if not armed.
 			#elif( TARGET_OS_WINDOWS )
 				HANDLE			timer;
 			#endif
@@ -226,6 +272,7 @@ struct dispatch_source_s
 #define kDispatchCommandDisarmSource		2
 #define kDispatchCommandFreeSource			3
 #define kDispatchCommandQuit				4
+#define kDispatchCommandWake				5
 
 typedef struct
 {
@@ -236,6 +283,27 @@ typedef struct
 
 #endif
 
+// dispatch_epoll_fd -- Read/write interest in a single FD. epoll only allows one registration per FD so read and write 
+// sources on the same FD share it.
+
+#if( DISPATCH_LITE_USE_EPOLL )
+
+#define kDispatchEPollMaxEvents			64
+
+typedef struct
+{
+	dispatch_source_t		readSource;		// Read source attached to this FD. NULL if none or canceled.
+	dispatch_source_t		writeSource;	// Write source attached to this FD. NULL if none or canceled.
+	Boolean					readArmed;		// true if the read source is waiting for an event.
+	Boolean					writeArmed;		// true if the write source is waiting for an event.
+	Boolean					added;			// true if the FD has been added to the epoll set.
+	Boolean					alwaysReady;	// true if epoll can't watch the FD (e.g. regular files) so it's always ready.
+	uint32_t				events;			// Events currently enabled in the epoll set.
+	
+}	dispatch_epoll_fd;
+
+#endif
+
 // dispatch_semaphore
 
 struct dispatch_semaphore_s
@@ -281,10 +349,24 @@ typedef union
 
 DEBUG_STATIC OSStatus		__LibDispatch_ScheduleWork( dispatch_function_t inFunction, void *inContext );
 #if( !TARGET_OS_WINDOWS )
-	DEBUG_STATIC void *		__LibDispatch_WorkThread( void *inArg );
+	DEBUG_STATIC void				__LibDispatch_ThreadPoolSignal( void );
+	DEBUG_STATIC void *				__LibDispatch_WorkThread( void *inArg );
+	DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkThreadTakeItem( dispatch_worker_t inWorker );
+	DEBUG_STATIC Boolean			__LibDispatch_WorkThreadPark( dispatch_worker_t inWorker, Boolean inTimed );
+	DEBUG_STATIC OSStatus			__LibDispatch_WorkerPush( dispatch_worker_t inWorker, dispatch_item_t inItem );
+	DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkerPop( dispatch_worker_t inWorker );
+	DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkerSteal( dispatch_worker_t inWorker );
 #endif
 DEBUG_STATIC void			__dispatch_empty_callback( void *inContext );
 
+// Work Items
+
+DEBUG_STATIC dispatch_item_t		__dispatch_item_alloc( void );
+DEBUG_STATIC void					__dispatch_item_free( dispatch_item_t inItem );
+DEBUG_STATIC dispatch_item_cache *	__dispatch_item_cache_get( void );
+DEBUG_STATIC void					__dispatch_item_cache_free( void *inArg );
+DEBUG_STATIC void					__dispatch_item_list_free( dispatch_item_t inList );
+
 // Objects
 
 DEBUG_STATIC void	__dispatch_free_object( dispatch_object_t inObj );
@@ -345,6 +427,23 @@ DEBUG_STATIC void	__LibDispatch_PlatformDisarmSourceAndUnlock( dispatch_source_t
 	DEBUG_STATIC void		__LibDispatch_SelectHandleReadWriteEvent( void *inContext );
 	DEBUG_STATIC void		__LibDispatch_SelectHandleTimerEvent( void *inContext );
 	DEBUG_STATIC void		__LibDispatch_PlatformArmOrDisarmSourceAndUnlock( dispatch_source_t inSource, uint8_t inCmd );
+	DEBUG_STATIC Boolean	__LibDispatch_SelectArmTimer( dispatch_source_t inSource );
+	DEBUG_STATIC void		__LibDispatch_SelectDisarmTimer( dispatch_source_t inSource );
+	DEBUG_STATIC Boolean	__LibDispatch_TimerHeapInsert( dispatch_source_t inSource );
+	DEBUG_STATIC void		__LibDispatch_TimerHeapRemove( dispatch_source_t inSource );
+	DEBUG_STATIC void		__LibDispatch_TimerHeapSiftUp( size_t inIndex );
+	DEBUG_STATIC void		__LibDispatch_TimerHeapSiftDown( size_t inIndex );
+#endif
+
+// EPoll Support
+
+#if( DISPATCH_LITE_USE_EPOLL )
+	DEBUG_STATIC OSStatus	__LibDispatch_EPollEnsureInitialized( void );
+	DEBUG_STATIC void		__LibDispatch_EPollFinalize( void );
+	DEBUG_STATIC Boolean	__LibDispatch_EPollArmOrDisarm( dispatch_source_t inSource, Boolean inArm );
+	DEBUG_STATIC void		__LibDispatch_EPollHandleEvents( const struct epoll_event *inEvents, int inCount );
+	DEBUG_STATIC void		__LibDispatch_EPollFireAlwaysReady( dispatch_source_t inSource );
+	DEBUG_STATIC void		__LibDispatch_EPollUpdateLocked( int inFD, dispatch_epoll_fd *inEntry );
 #endif
 
 // Windows Support
@@ -384,12 +483,21 @@ static pthread_mutex_t				gDispatchInitializeMutex			= PTHREAD_MUTEX_INITIALIZER
 	static pthread_cond_t *			gDispatchThreadPool_ConditionPtr	= NULL;
 	static pthread_attr_t			gDispatchThreadPool_Attr;
 	static pthread_attr_t *			gDispatchThreadPool_AttrPtr			= NULL;
-	static int						gDispatchThreadPool_CurrentThreads	= 0;
-	static int						gDispatchThreadPool_IdleThreads		= 0;
+	static pthread_key_t			gDispatchKey_Worker;
+	static pthread_key_t *			gDispatchKey_WorkerPtr				= NULL;
+	static dispatch_worker_t		gDispatchThreadPool_Workers			= NULL;
+	static int						gDispatchThreadPool_WorkerCapacity	= 0;
+	static int volatile				gDispatchThreadPool_WorkerHighWater	= 0;
+	static dispatch_worker_t		gDispatchThreadPool_IdleList		= NULL;
+	static int volatile				gDispatchThreadPool_CurrentThreads	= 0;
+	static int volatile				gDispatchThreadPool_StartingThreads	= 0;
+	static int32_t volatile			gDispatchThreadPool_IdleThreads		= 0;
+	static int						gDispatchThreadPool_MinThreads		= 0;
 	static int						gDispatchThreadPool_MaxThreads		= 128;
+	static int						gDispatchThreadPool_CreatedThreads	= 0;
 	static dispatch_item_t			gDispatchThreadPool_ItemsHead		= NULL;
 	static dispatch_item_t *		gDispatchThreadPool_ItemsNext		= NULL;
-	static int						gDispatchThreadPool_PendingItems	= 0;
+	static int32_t volatile			gDispatchThreadPool_PendingItems	= 0;
 	static Boolean					gDispatchThreadPool_Quit			= false;
 #endif
 
@@ -397,6 +505,15 @@ static pthread_mutex_t				gDispatchInitializeMutex			= PTHREAD_MUTEX_INITIALIZER
 
 static pthread_key_t				gDispatchKey_CurrentQueue;
 static pthread_key_t *				gDispatchKey_CurrentQueuePtr		= NULL;
+
+// Work Item Cache
+
+static pthread_key_t				gDispatchKey_ItemCache;
+static pthread_key_t *				gDispatchKey_ItemCachePtr			= NULL;
+static pthread_mutex_t				gDispatchItemPool_Mutex;
+static pthread_mutex_t *			gDispatchItemPool_MutexPtr			= NULL;
+static dispatch_item_t				gDispatchItemPool_Batches[ kDispatchItemPoolMaxBatches ];
+static int volatile					gDispatchItemPool_BatchCount		= 0;
 static dispatch_queue_t				gDispatchConcurrentQueues[ 3 ]		= { NULL, NULL, NULL };
 
 static dispatch_queue_t				gDispatchMainQueue					= NULL;
@@ -432,13 +549,30 @@ dispatch_function_t					gDispatchMainQueueScheduleHookFunc	= NULL;
 #if( DISPATCH_LITE_USE_SELECT )
 	static dispatch_queue_t			gDispatchSelect_CommandQueue		= NULL;
 	static SocketRef				gDispatchSelect_CommandSock			= kInvalidSocketRef;
+	#if( !DISPATCH_LITE_USE_EPOLL )
 	static dispatch_source_t		gDispatchSelect_ReadWriteList		= NULL;
 	static fd_set					gDispatchSelect_ReadSet;
 	static fd_set					gDispatchSelect_WriteSet;
-	static dispatch_source_t		gDispatchSelect_TimerList			= NULL;
+	#endif
+	static pthread_mutex_t			gDispatchSelect_TimerMutex;
+	static pthread_mutex_t *		gDispatchSelect_TimerMutexPtr		= NULL;
+	static dispatch_source_t *		gDispatchSelect_TimerHeap			= NULL;	// Min-heap by expireTicks.
+	static size_t					gDispatchSelect_TimerCount			= 0;
+	static size_t					gDispatchSelect_TimerCapacity		= 0;
+	static Boolean					gDispatchSelect_TimerWakePending	= false;
 	static dispatch_semaphore_t		gDispatchSelect_QuitSem				= NULL;
 #endif
 
+// EPoll Support
+
+#if( DISPATCH_LITE_USE_EPOLL )
+	static int						gDispatchEPoll_FD					= -1;
+	static pthread_mutex_t			gDispatchEPoll_Mutex;
+	static pthread_mutex_t *		gDispatchEPoll_MutexPtr				= NULL;
+	static dispatch_epoll_fd *		gDispatchEPoll_FDs					= NULL;	// Indexed by FD.
+	static int						gDispatchEPoll_FDCount				= 0;
+#endif
+
 // Windows Support
 
 #if( TARGET_OS_WINDOWS )
@@ -501,10 +635,35 @@ OSStatus	LibDispatch_EnsureInitialized( void )
 	err = pthread_attr_setdetachstate( gDispatchThreadPool_AttrPtr, PTHREAD_CREATE_DETACHED );
 	require_noerr( err, exit );
 	
+	err = pthread_key_create( &gDispatchKey_Worker, NULL ); 
+	require_noerr( err, exit );
+	gDispatchKey_WorkerPtr = &gDispatchKey_Worker;
+	
+	// Worker slots can't move once threads are using them so allocate enough for the max up front. Only the slots 
+	// that get used have their mutex, condition, and deque set up.
+	
+	gDispatchThreadPool_Workers = (dispatch_worker_t) calloc( (size_t) gDispatchThreadPool_MaxThreads, 
+		sizeof( *gDispatchThreadPool_Workers ) );
+	require_action( gDispatchThreadPool_Workers, exit, err = kNoMemoryErr );
+	gDispatchThreadPool_WorkerCapacity	= gDispatchThreadPool_MaxThreads;
+	gDispatchThreadPool_WorkerHighWater	= 0;
+	gDispatchThreadPool_IdleList		= NULL;
+	gDispatchThreadPool_CreatedThreads	= 0;
+	
 	gDispatchThreadPool_ItemsHead = NULL;
 	gDispatchThreadPool_ItemsNext = &gDispatchThreadPool_ItemsHead;
 #endif
 	
+	// Set up work item cache.
+	
+	err = pthread_mutex_init( &gDispatchItemPool_Mutex, NULL );
+	require_noerr( err, exit );
+	gDispatchItemPool_MutexPtr = &gDispatchItemPool_Mutex;
+	
+	err = pthread_key_create( &gDispatchKey_ItemCache, __dispatch_item_cache_free ); 
+	require_noerr( err, exit );
+	gDispatchKey_ItemCachePtr = &gDispatchKey_ItemCache;
+	
 	// Set up global queues.
 	
 	err = pthread_key_create( &gDispatchKey_CurrentQueue, NULL ); 
@@ -689,8 +848,16 @@ void	LibDispatch_Finalize( void )
 	}
 	dispatch_forget( &gDispatchSelect_CommandQueue );
 	ForgetSocket( &gDispatchSelect_CommandSock );
+#if( DISPATCH_LITE_USE_EPOLL )
+	__LibDispatch_EPollFinalize();
+#else
 	check( gDispatchSelect_ReadWriteList == NULL );
-	check( gDispatchSelect_TimerList == NULL );
+#endif
+	check( gDispatchSelect_TimerCount == 0 );
+	ForgetMem( &gDispatchSelect_TimerHeap );
+	gDispatchSelect_TimerCount		= 0;
+	gDispatchSelect_TimerCapacity	= 0;
+	pthread_mutex_forget( &gDispatchSelect_TimerMutexPtr );
 	check( gDispatchSelect_QuitSem == NULL );
 #endif
 	
@@ -755,55 +922,60 @@ void	LibDispatch_Finalize( void )
 			dispatch_sync_f( gDispatchConcurrentQueues[ i ], NULL, __dispatch_empty_callback );
 		}
 	}
-#endif
-	for( i = 0; i < countof( gDispatchConcurrentQueues ); ++i )
-	{
-		dispatch_forget( &gDispatchConcurrentQueues[ i ] );
-	}
-	if( gDispatchKey_CurrentQueuePtr )
-	{
-		err = pthread_key_delete( gDispatchKey_CurrentQueue );
-		check_noerr( err );
-		gDispatchKey_CurrentQueuePtr = NULL;
-	}
 	
-	// Tear down thread pool.
+	// Tear down thread pool. This has to happen before the global queues go away because concurrent drains scheduled 
+	// by the work above may not have run yet and they walk all the global queues.
 	
-#if( !TARGET_OS_WINDOWS )
 	if( gDispatchThreadPool_MutexPtr )
 	{
+		dispatch_worker_t		worker;
+		
 		pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
 		gDispatchThreadPool_Quit = true;
-		#if( TARGET_NO_PTHREAD_BROADCAST )
-			while( gDispatchThreadPool_CurrentThreads > 0 )
-			{
-				err = pthread_cond_signal( gDispatchThreadPool_ConditionPtr );
-				check_noerr( err );
-				
-				pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
-				usleep( 50000 ); // Cheesy, but probably not worth a quit condition.
-				pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
-			}
-		#else
-			if( gDispatchThreadPool_CurrentThreads > 0 )
-			{
-				if( gDispatchThreadPool_IdleThreads > 0 )
-				{
-					err = pthread_cond_broadcast( gDispatchThreadPool_ConditionPtr );
-					check_noerr( err );
-				}
-				while( gDispatchThreadPool_CurrentThreads > 0 )
-				{
-					err = pthread_cond_wait( gDispatchThreadPool_ConditionPtr, gDispatchThreadPool_MutexPtr );
-					check_noerr( err );
-				}
-			}
-		#endif
+		while( ( worker = gDispatchThreadPool_IdleList ) != NULL )
+		{
+			gDispatchThreadPool_IdleList = worker->idleNext;
+			atomic_add_and_fetch_32( &gDispatchThreadPool_IdleThreads, -1 );
+			worker->wake = true;
+			err = pthread_cond_signal( &worker->condition );
+			check_noerr( err );
+		}
+		while( gDispatchThreadPool_CurrentThreads > 0 )
+		{
+			err = pthread_cond_wait( gDispatchThreadPool_ConditionPtr, gDispatchThreadPool_MutexPtr );
+			check_noerr( err );
+		}
 		pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
 	}
 	check( gDispatchThreadPool_ItemsHead == NULL );
 	check( gDispatchThreadPool_PendingItems == 0 );
+	check( gDispatchThreadPool_IdleThreads == 0 );
 	
+	if( gDispatchThreadPool_Workers )
+	{
+		int		j;
+		
+		for( j = 0; j < gDispatchThreadPool_WorkerCapacity; ++j )
+		{
+			dispatch_worker_t const		worker = &gDispatchThreadPool_Workers[ j ];
+			
+			if( !worker->initialized ) continue;
+			check( worker->dequeCount == 0 );
+			ForgetMem( &worker->deque );
+			pthread_cond_destroy( &worker->condition );
+			pthread_mutex_destroy( &worker->mutex );
+		}
+		ForgetMem( &gDispatchThreadPool_Workers );
+	}
+	gDispatchThreadPool_WorkerCapacity	= 0;
+	gDispatchThreadPool_WorkerHighWater	= 0;
+	gDispatchThreadPool_IdleList		= NULL;
+	if( gDispatchKey_WorkerPtr )
+	{
+		err = pthread_key_delete( gDispatchKey_Worker );
+		check_noerr( err );
+		gDispatchKey_WorkerPtr = NULL;
+	}
 	if( gDispatchThreadPool_AttrPtr )
 	{
 		pthread_attr_destroy( gDispatchThreadPool_AttrPtr );
@@ -812,10 +984,85 @@ void	LibDispatch_Finalize( void )
 	pthread_cond_forget( &gDispatchThreadPool_ConditionPtr );
 	pthread_mutex_forget( &gDispatchThreadPool_MutexPtr );
 #endif
+	for( i = 0; i < countof( gDispatchConcurrentQueues ); ++i )
+	{
+		dispatch_forget( &gDispatchConcurrentQueues[ i ] );
+	}
+	if( gDispatchKey_CurrentQueuePtr )
+	{
+		err = pthread_key_delete( gDispatchKey_CurrentQueue );
+		check_noerr( err );
+		gDispatchKey_CurrentQueuePtr = NULL;
+	}
+	
+	// Tear down work item cache. Threads still running keep their caches until they exit.
+	
+	if( gDispatchKey_ItemCachePtr )
+	{
+		__dispatch_item_cache_free( pthread_getspecific( gDispatchKey_ItemCache ) );
+		pthread_setspecific( gDispatchKey_ItemCache, NULL );
+		err = pthread_key_delete( gDispatchKey_ItemCache );
+		check_noerr( err );
+		gDispatchKey_ItemCachePtr = NULL;
+	}
+	while( gDispatchItemPool_BatchCount > 0 )
+	{
+		__dispatch_item_list_free( gDispatchItemPool_Batches[ --gDispatchItemPool_BatchCount ] );
+	}
+	pthread_mutex_forget( &gDispatchItemPool_MutexPtr );
 	
 	gDispatchInitialized = false;
 }
 
+//===========================================================================================================================
+//	LibDispatch_SetWorkerLimits
+//===========================================================================================================================
+
+void	LibDispatch_SetWorkerLimits( int inMinWorkers, int inMaxWorkers )
+{
+#if( TARGET_OS_WINDOWS )
+	(void) inMinWorkers;
+	(void) inMaxWorkers;
+#else
+	pthread_mutex_lock( &gDispatchInitializeMutex );
+	if( gDispatchThreadPool_MutexPtr ) pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	
+	// Worker slots are allocated when the pool is set up so the max can only be lowered after that.
+	
+	if( inMaxWorkers < 1 ) inMaxWorkers = 1;
+	if( gDispatchThreadPool_Workers && ( inMaxWorkers > gDispatchThreadPool_WorkerCapacity ) )
+	{
+		gcd_ulog( kLogLevelWarning, "### Can't raise max workers to %d after init, using %d\n", inMaxWorkers, 
+			gDispatchThreadPool_WorkerCapacity );
+		inMaxWorkers = gDispatchThreadPool_WorkerCapacity;
+	}
+	gDispatchThreadPool_MaxThreads = inMaxWorkers;
+	gDispatchThreadPool_MinThreads = Clamp( inMinWorkers, 0, inMaxWorkers );
+	
+	if( gDispatchThreadPool_MutexPtr ) pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	pthread_mutex_unlock( &gDispatchInitializeMutex );
+#endif
+}
+
+//===========================================================================================================================
+//	LibDispatch_GetWorkerLimits
+//===========================================================================================================================
+
+void	LibDispatch_GetWorkerLimits( int *outMinWorkers, int *outMaxWorkers )
+{
+#if( TARGET_OS_WINDOWS )
+	*outMinWorkers = 0;
+	*outMaxWorkers = 0;
+#else
+	pthread_mutex_lock( &gDispatchInitializeMutex );
+	if( gDispatchThreadPool_MutexPtr ) pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	*outMinWorkers = gDispatchThreadPool_MinThreads;
+	*outMaxWorkers = gDispatchThreadPool_MaxThreads;
+	if( gDispatchThreadPool_MutexPtr ) pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	pthread_mutex_unlock( &gDispatchInitializeMutex );
+#endif
+}
+
 //===========================================================================================================================
 //	__LibDispatch_ScheduleWork
 //===========================================================================================================================
@@ -829,7 +1076,7 @@ DEBUG_STATIC OSStatus	__LibDispatch_ScheduleWork( dispatch_function_t inFunction
 	dispatch_item_t		item;
 	BOOL				good;
 	
-	item = (dispatch_item_t) malloc( sizeof( *item ) );
+	item = __dispatch_item_alloc();
 	require_action( item, exit, err = kNoMemoryErr );
 	item->function = inFunction;
 	item->context  = inContext;
@@ -840,7 +1087,7 @@ DEBUG_STATIC OSStatus	__LibDispatch_ScheduleWork( dispatch_function_t inFunction
 	item = NULL;
 	
 exit:
-	if( item ) free( item );
+	if( item ) __dispatch_item_free( item );
 	return( err );
 }
 
@@ -849,7 +1096,7 @@ DEBUG_STATIC DWORD WINAPI	__LibDispatch_ScheduleWorkWrapper( void *inArg )
 	dispatch_item_t const		item = (dispatch_item_t) inArg;
 	
 	item->function( item->context );
-	free( item );
+	__dispatch_item_free( item );
 	return( 0 );
 }
 #else // !TARGET_OS_WINDOWS
@@ -857,190 +1104,585 @@ DEBUG_STATIC OSStatus	__LibDispatch_ScheduleWork( dispatch_function_t inFunction
 {
 	OSStatus			err;
 	dispatch_item_t		item;
-	pthread_t			tid;
+	dispatch_worker_t	worker;
 	
-	item = (dispatch_item_t) calloc( 1, sizeof( *item ) );
-	require_action( item, exit2, err = kNoMemoryErr );
+	item = __dispatch_item_alloc();
+	require_action( item, exit, err = kNoMemoryErr );
 	item->function = inFunction;
 	item->context  = inContext;
 	
-	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	// Work scheduled from a pool thread goes on its own deque. Everything else (or if the deque can't grow) goes on 
+	// the global list.
+	
+	worker = (dispatch_worker_t) pthread_getspecific( gDispatchKey_Worker );
+	if( !worker || ( __LibDispatch_WorkerPush( worker, item ) != kNoErr ) )
+	{
+		pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+		*gDispatchThreadPool_ItemsNext = item;
+		 gDispatchThreadPool_ItemsNext = &item->next;
+		pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	}
+	
+	// The pending count is bumped after the item is visible and parking threads bump the idle count before they check 
+	// the pending count so either we see an idle thread to wake up or it sees our item and doesn't park.
+	
+	atomic_add_and_fetch_32( &gDispatchThreadPool_PendingItems, 1 );
+	if( ( gDispatchThreadPool_IdleThreads > 0 ) || 
+		( ( gDispatchThreadPool_StartingThreads == 0 ) && 
+		  ( gDispatchThreadPool_CurrentThreads < gDispatchThreadPool_MaxThreads ) ) )
+	{
+		__LibDispatch_ThreadPoolSignal();
+	}
+	err = kNoErr;
 	
-	*gDispatchThreadPool_ItemsNext = item;
-	 gDispatchThreadPool_ItemsNext = &item->next;
-	++gDispatchThreadPool_PendingItems;
+exit:
+	return( err );
+}
+#endif // TARGET_OS_WINDOWS
+
+#if( !TARGET_OS_WINDOWS )
+//===========================================================================================================================
+//	__LibDispatch_ThreadPoolSignal
+//
+//	Wakes up a parked thread or, if none are parked, starts a new thread unless one is already starting. Threads that 
+//	take an item while more are pending call this again so a burst ramps up one thread at a time instead of creating a 
+//	thread per item.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_ThreadPoolSignal( void )
+{
+	OSStatus				err;
+	dispatch_worker_t		worker;
+	int						i;
+	pthread_t				tid;
 	
-	// If there's already an idle thread, signal one that more work is available.
+	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
 	
-	if( gDispatchThreadPool_IdleThreads > 0 )
+	worker = gDispatchThreadPool_IdleList;
+	if( worker )
 	{
-		err = pthread_cond_signal( gDispatchThreadPool_ConditionPtr );
+		gDispatchThreadPool_IdleList = worker->idleNext;
+		atomic_add_and_fetch_32( &gDispatchThreadPool_IdleThreads, -1 );
+		worker->wake = true;
+		err = pthread_cond_signal( &worker->condition );
 		check_noerr( err );
+		goto exit;
+	}
+	require_quiet( gDispatchThreadPool_StartingThreads == 0, exit );
+	if( gDispatchThreadPool_CurrentThreads >= gDispatchThreadPool_MaxThreads )
+	{
+		gcd_ulog( kLogLevelNotice, "*** more work, but not allowed to create another thread (%d of %d)\n", 
+			gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
+		goto exit;
 	}
 	
-	// If we have more work than threads and we haven't hit our max threads, create a new thread.
+	// Find a free slot for the new thread. The max may have been lowered so there's always one if we're under it.
 	
-	if( gDispatchThreadPool_IdleThreads < gDispatchThreadPool_PendingItems )
+	for( i = 0; i < gDispatchThreadPool_WorkerCapacity; ++i )
 	{
-		if( gDispatchThreadPool_CurrentThreads < gDispatchThreadPool_MaxThreads )
-		{
-			err = pthread_create( &tid, gDispatchThreadPool_AttrPtr, __LibDispatch_WorkThread, NULL );
-			require_noerr( err, exit );
-			
-			++gDispatchThreadPool_CurrentThreads;
-			gcd_ulog( kLogLevelChatty, "+++ created work thread: %d now (%d max)\n", 
-				gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
-		}
-		else
-		{
-			gcd_ulog( kLogLevelNotice, "*** more work, but not allowed to create another thread (%d of %d)\n", 
-				gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
-		}
+		worker = &gDispatchThreadPool_Workers[ i ];
+		if( !worker->active ) break;
+	}
+	require_action( i < gDispatchThreadPool_WorkerCapacity, exit, worker = NULL );
+	if( !worker->initialized )
+	{
+		#if( !TARGET_OS_DARWIN && !TARGET_OS_THREADX )
+			pthread_condattr_t		condAttr;
+		#endif
+		
+		err = pthread_mutex_init( &worker->mutex, NULL );
+		require_noerr( err, exit );
+		
+		#if( TARGET_OS_DARWIN || TARGET_OS_THREADX )
+			err = pthread_cond_init( &worker->condition, NULL );
+		#else
+			pthread_condattr_init( &condAttr );
+			pthread_condattr_setclock( &condAttr, CLOCK_MONOTONIC );
+			err = pthread_cond_init( &worker->condition, &condAttr );
+			pthread_condattr_destroy( &condAttr );
+		#endif
+		if( err ) pthread_mutex_destroy( &worker->mutex );
+		require_noerr( err, exit );
+		worker->initialized = true;
 	}
-	err = kNoErr;
+	
+	worker->active	= true;
+	worker->wake	= false;
+	err = pthread_create( &tid, gDispatchThreadPool_AttrPtr, __LibDispatch_WorkThread, worker );
+	if( err ) worker->active = false;
+	require_noerr( err, exit );
+	
+	if( i >= gDispatchThreadPool_WorkerHighWater ) gDispatchThreadPool_WorkerHighWater = i + 1;
+	++gDispatchThreadPool_CurrentThreads;
+	++gDispatchThreadPool_StartingThreads;
+	++gDispatchThreadPool_CreatedThreads;
+	gcd_ulog( kLogLevelChatty, "+++ created work thread: %d now (%d max)\n", 
+		gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
 	
 exit:
 	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
-	
-exit2:
-	return( err );
 }
-#endif // TARGET_OS_WINDOWS
 
 //===========================================================================================================================
 //	__LibDispatch_WorkThread
 //===========================================================================================================================
 
-#if( !TARGET_OS_WINDOWS )
 DEBUG_STATIC void *	__LibDispatch_WorkThread( void *inArg )
 {
-	OSStatus			err;
-	Boolean				timedOut;
-	dispatch_item_t		item;
-	struct timespec		timeout;
-	
-	(void) inArg; // Unused
+	dispatch_worker_t const		worker = (dispatch_worker_t) inArg;
+	dispatch_item_t				item;
+	Boolean						timedOut;
 	
 	pthread_setname_np_compat( "gcd-work" );
+	pthread_setspecific( gDispatchKey_Worker, worker );
+	
 	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	--gDispatchThreadPool_StartingThreads;
+	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	
 	for( ;; )
 	{
-		// Wait for work or timeout if we're idle for too long.
-		
-		#if( TARGET_OS_THREADX )
-			timeout.tv_sec  = 2;
-			timeout.tv_nsec = 0;
-			timedOut = false;
-			while( ( gDispatchThreadPool_ItemsHead == NULL ) && !gDispatchThreadPool_Quit )
-			{
-				++gDispatchThreadPool_IdleThreads;
-				err = pthread_cond_timedwait_relative_np( gDispatchThreadPool_ConditionPtr, gDispatchThreadPool_MutexPtr, 
-					&timeout );
-				--gDispatchThreadPool_IdleThreads;
-				if( err == ETIMEDOUT )
-				{
-					timedOut = true;
-					break;
-				}
-				check_noerr( err );
-			}
-		#else
-			struct timeval		now;
-			
-			// Warning: there's a bug here in that pthread_cond_timedwait is broken without support for CLOCK_MONOTONIC,  
-			// which is rarely supported. This needs to be revisited to come up with a better replacement for waiting.
-			
-			gettimeofday( &now, NULL );
-			timeout.tv_sec  = now.tv_sec + 2;
-			timeout.tv_nsec = now.tv_usec * 1000;
-			timedOut = false;
-			while( ( gDispatchThreadPool_ItemsHead == NULL ) && !gDispatchThreadPool_Quit )
-			{
-				++gDispatchThreadPool_IdleThreads;
-				err = pthread_cond_timedwait( gDispatchThreadPool_ConditionPtr, gDispatchThreadPool_MutexPtr, &timeout );
-				--gDispatchThreadPool_IdleThreads;
-				if( err == ETIMEDOUT )
-				{
-					timedOut = true;
-					break;
-				}
-				check_noerr( err );
-			}
-		#endif
-		
-		// Process the next item (if any).
-		
-		item = gDispatchThreadPool_ItemsHead;
+		item = __LibDispatch_WorkThreadTakeItem( worker );
 		if( item )
 		{
-			timedOut = false;
+			// If there's still more work, get another thread going on it before we run this item in case it blocks.
 			
-			if( ( gDispatchThreadPool_ItemsHead = item->next ) == NULL )
+			if( atomic_add_and_fetch_32( &gDispatchThreadPool_PendingItems, -1 ) > 0 )
 			{
-				gDispatchThreadPool_ItemsNext = &gDispatchThreadPool_ItemsHead;
+				if( ( gDispatchThreadPool_IdleThreads > 0 ) || ( gDispatchThreadPool_StartingThreads == 0 ) )
+				{
+					__LibDispatch_ThreadPoolSignal();
+				}
 			}
-			--gDispatchThreadPool_PendingItems;
-			
-			pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
 			item->function( item->context );
-			free( item );
-			pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+			__dispatch_item_free( item );
+			continue;
 		}
 		
-		// Exit if there's no more work and we're quitting.
+		// Park until there's more work. Threads above the min exit if they stay idle for too long.
 		
-		item = gDispatchThreadPool_ItemsHead;
-		if( ( item == NULL ) && gDispatchThreadPool_Quit )
+		pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+		if( gDispatchThreadPool_Quit )
 		{
-			// If we're last thread to go away, tell the delete function.
-			
-			if( --gDispatchThreadPool_CurrentThreads == 0 )
+			timedOut = true;
+		}
+		else
+		{
+			timedOut = __LibDispatch_WorkThreadPark( worker, 
+				gDispatchThreadPool_CurrentThreads > gDispatchThreadPool_MinThreads );
+			if( timedOut && !gDispatchThreadPool_Quit && 
+				( gDispatchThreadPool_CurrentThreads <= gDispatchThreadPool_MinThreads ) )
 			{
-				#if( !TARGET_NO_PTHREAD_BROADCAST )
-					err = pthread_cond_broadcast( gDispatchThreadPool_ConditionPtr );
-					check_noerr( err );
-				#endif
+				timedOut = false; // Other threads exited while we waited so stick around to keep the min.
 			}
-			gcd_ulog( kLogLevelNotice, "--- quitting thread: %d now (%d max)\n", 
-				gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
-			break;
 		}
-		
-		// Exit if there's no more work and we timed out.
-		
-		if( ( item == NULL ) && timedOut )
+		if( timedOut )
 		{
+			worker->active = false;
 			--gDispatchThreadPool_CurrentThreads;
-			gcd_ulog( kLogLevelChatty, "--- aging idle thread: %d now (%d max)\n", 
-				gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
+			if( gDispatchThreadPool_Quit )
+			{
+				// If we're last thread to go away, tell the finalize function.
+				
+				if( gDispatchThreadPool_CurrentThreads == 0 )
+				{
+					pthread_cond_signal( gDispatchThreadPool_ConditionPtr );
+				}
+				gcd_ulog( kLogLevelNotice, "--- quitting thread: %d now (%d max)\n", 
+					gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
+			}
+			else
+			{
+				gcd_ulog( kLogLevelChatty, "--- aging idle thread: %d now (%d max)\n", 
+					gDispatchThreadPool_CurrentThreads, gDispatchThreadPool_MaxThreads );
+			}
+			pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
 			break;
 		}
+		pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
 	}
-	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );	
 	return( NULL );
 }
-#endif // !TARGET_OS_WINDOWS
-
-#if 0
-#pragma mark -
-#endif
 
 //===========================================================================================================================
-//	__dispatch_free_object
+//	__LibDispatch_WorkThreadTakeItem
+//
+//	Takes the newest item from our own deque, then the oldest item from the global list, then the oldest item from 
+//	another thread's deque.
 //===========================================================================================================================
 
-DEBUG_STATIC void	__dispatch_free_object( dispatch_object_t inObj )
+DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkThreadTakeItem( dispatch_worker_t inWorker )
 {
-	dispatch_union * const			obj		= (dispatch_union *) inObj;
-	dispatch_function_t const		func	= obj->base.doFinalize;
-	void * const					context	= obj->base.context;
+	dispatch_item_t		item;
+	int					n, i, start;
 	
-	free( inObj );
-	if( func ) func( context );
-}
-
-//===========================================================================================================================
-//	dispatch_retain
+	item = __LibDispatch_WorkerPop( inWorker );
+	if( item ) goto exit;
+	
+	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	item = gDispatchThreadPool_ItemsHead;
+	if( item )
+	{
+		if( ( gDispatchThreadPool_ItemsHead = item->next ) == NULL )
+		{
+			gDispatchThreadPool_ItemsNext = &gDispatchThreadPool_ItemsHead;
+		}
+	}
+	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	if( item ) goto exit;
+	
+	// Start stealing after our own slot so thieves spread out instead of all hitting the first slot.
+	
+	n = gDispatchThreadPool_WorkerHighWater;
+	start = (int)( inWorker - gDispatchThreadPool_Workers );
+	for( i = 1; i < n; ++i )
+	{
+		item = __LibDispatch_WorkerSteal( &gDispatchThreadPool_Workers[ ( start + i ) % n ] );
+		if( item ) break;
+	}
+	
+exit:
+	return( item );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_WorkThreadPark
+//
+//	Waits until another thread wakes us up or, if inTimed is true, until we've been idle too long.
+//	Returns true if it timed out. Note: Thread pool mutex must be held.
+//===========================================================================================================================
+
+DEBUG_STATIC Boolean	__LibDispatch_WorkThreadPark( dispatch_worker_t inWorker, Boolean inTimed )
+{
+	OSStatus				err;
+	Boolean					timedOut = false;
+	dispatch_worker_t *		next;
+	struct timespec			timeout;
+#if( TARGET_OS_DARWIN || TARGET_OS_THREADX )
+	uint64_t				deadline, now;
+#endif
+	
+	inWorker->wake		= false;
+	inWorker->idleNext	= gDispatchThreadPool_IdleList;
+	gDispatchThreadPool_IdleList = inWorker;
+	atomic_add_and_fetch_32( &gDispatchThreadPool_IdleThreads, 1 );
+	
+	// If work was scheduled before it saw us as idle, don't park. Yield in case the thread that took it is still 
+	// between removing it and updating the pending count.
+	
+	if( gDispatchThreadPool_PendingItems > 0 )
+	{
+		pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+		atomic_yield();
+		pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+		goto exit;
+	}
+	
+	// Idle timeouts use the monotonic clock so wall clock changes don't make threads exit early or stick around forever.
+	
+#if( TARGET_OS_DARWIN || TARGET_OS_THREADX )
+	deadline = UpTicks() + SecondsToUpTicks( kDispatchThreadPoolIdleSeconds );
+#else
+	clock_gettime( CLOCK_MONOTONIC, &timeout );
+	timeout.tv_sec += kDispatchThreadPoolIdleSeconds;
+#endif
+	while( !inWorker->wake && !gDispatchThreadPool_Quit )
+	{
+		if( inTimed )
+		{
+			#if( TARGET_OS_DARWIN || TARGET_OS_THREADX )
+				now = UpTicks();
+				if( now >= deadline )
+				{
+					timedOut = true;
+					break;
+				}
+				now = deadline - now;
+				timeout.tv_sec  = (time_t)( now / UpTicksPerSecond() );
+				timeout.tv_nsec = (long)( ( ( now % UpTicksPerSecond() ) * kNanosecondsPerSecond ) / UpTicksPerSecond() );
+				err = pthread_cond_timedwait_relative_np( &inWorker->condition, gDispatchThreadPool_MutexPtr, &timeout );
+			#else
+				err = pthread_cond_timedwait( &inWorker->condition, gDispatchThreadPool_MutexPtr, &timeout );
+			#endif
+			if( err == ETIMEDOUT )
+			{
+				timedOut = true;
+				break;
+			}
+		}
+		else
+		{
+			err = pthread_cond_wait( &inWorker->condition, gDispatchThreadPool_MutexPtr );
+		}
+		check_noerr( err );
+	}
+	
+exit:
+	
+	// Take ourself off the idle list unless the thread that woke us already did.
+	
+	if( !inWorker->wake )
+	{
+		for( next = &gDispatchThreadPool_IdleList; *next; next = &( *next )->idleNext )
+		{
+			if( *next == inWorker )
+			{
+				*next = inWorker->idleNext;
+				atomic_add_and_fetch_32( &gDispatchThreadPool_IdleThreads, -1 );
+				break;
+			}
+		}
+	}
+	inWorker->idleNext = NULL;
+	return( timedOut );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_WorkerPush
+//
+//	Pushes an item on the bottom of a worker's deque. Only the thread that owns the worker may push.
+//===========================================================================================================================
+
+DEBUG_STATIC OSStatus	__LibDispatch_WorkerPush( dispatch_worker_t inWorker, dispatch_item_t inItem )
+{
+	OSStatus				err;
+	dispatch_item_t *		deque;
+	uint32_t				capacity, i;
+	
+	pthread_mutex_lock( &inWorker->mutex );
+	if( inWorker->dequeCount == inWorker->dequeCapacity )
+	{
+		capacity = inWorker->dequeCapacity ? ( inWorker->dequeCapacity * 2 ) : kDispatchWorkerDequeMinCapacity;
+		deque = (dispatch_item_t *) malloc( capacity * sizeof( *deque ) );
+		require_action( deque, exit, err = kNoMemoryErr );
+		for( i = 0; i < inWorker->dequeCount; ++i )
+		{
+			deque[ i ] = inWorker->deque[ ( inWorker->dequeTop + i ) & ( inWorker->dequeCapacity - 1 ) ];
+		}
+		if( inWorker->deque ) free( inWorker->deque );
+		inWorker->deque			= deque;
+		inWorker->dequeCapacity	= capacity;
+		inWorker->dequeTop		= 0;
+	}
+	inWorker->deque[ ( inWorker->dequeTop + inWorker->dequeCount ) & ( inWorker->dequeCapacity - 1 ) ] = inItem;
+	inWorker->dequeCount += 1;
+	err = kNoErr;
+	
+exit:
+	pthread_mutex_unlock( &inWorker->mutex );
+	return( err );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_WorkerPop
+//
+//	Pops the newest item from the bottom of a worker's deque. Only the thread that owns the worker may pop.
+//===========================================================================================================================
+
+DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkerPop( dispatch_worker_t inWorker )
+{
+	dispatch_item_t		item = NULL;
+	
+	if( inWorker->dequeCount == 0 ) return( NULL );
+	
+	pthread_mutex_lock( &inWorker->mutex );
+	if( inWorker->dequeCount > 0 )
+	{
+		inWorker->dequeCount -= 1;
+		item = inWorker->deque[ ( inWorker->dequeTop + inWorker->dequeCount ) & ( inWorker->dequeCapacity - 1 ) ];
+	}
+	pthread_mutex_unlock( &inWorker->mutex );
+	return( item );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_WorkerSteal
+//
+//	Takes the oldest item from the top of another worker's deque.
+//===========================================================================================================================
+
+DEBUG_STATIC dispatch_item_t	__LibDispatch_WorkerSteal( dispatch_worker_t inWorker )
+{
+	dispatch_item_t		item = NULL;
+	
+	if( inWorker->dequeCount == 0 ) return( NULL );
+	
+	pthread_mutex_lock( &inWorker->mutex );
+	if( inWorker->dequeCount > 0 )
+	{
+		item = inWorker->deque[ inWorker->dequeTop ];
+		inWorker->dequeTop = ( inWorker->dequeTop + 1 ) & ( inWorker->dequeCapacity - 1 );
+		inWorker->dequeCount -= 1;
+	}
+	pthread_mutex_unlock( &inWorker->mutex );
+	return( item );
+}
+#endif // !TARGET_OS_WINDOWS
+
+#if 0
+#pragma mark -
+#pragma mark == Work Items ==
+#endif
+
+//===========================================================================================================================
+//	__dispatch_item_alloc
+//===========================================================================================================================
+
+DEBUG_STATIC dispatch_item_t	__dispatch_item_alloc( void )
+{
+	dispatch_item_cache *		cache;
+	dispatch_item_t				item;
+	
+	cache = __dispatch_item_cache_get();
+	if( cache )
+	{
+		// Refill from our own full batch first then from the global pool.
+		
+		if( !cache->current )
+		{
+			cache->current	= cache->full;
+			cache->full		= NULL;
+			if( !cache->current && ( gDispatchItemPool_BatchCount > 0 ) ) // Unlocked peek to skip the lock when empty.
+			{
+				pthread_mutex_lock( gDispatchItemPool_MutexPtr );
+				if( gDispatchItemPool_BatchCount > 0 )
+				{
+					cache->current = gDispatchItemPool_Batches[ --gDispatchItemPool_BatchCount ];
+				}
+				pthread_mutex_unlock( gDispatchItemPool_MutexPtr );
+			}
+			cache->currentCount = cache->current ? kDispatchItemCacheBatchSize : 0;
+		}
+		item = cache->current;
+		if( item )
+		{
+			cache->current = item->next;
+			--cache->currentCount;
+			item->next = NULL;
+			return( item );
+		}
+	}
+	return( (dispatch_item_t) calloc( 1, sizeof( *item ) ) );
+}
+
+//===========================================================================================================================
+//	__dispatch_item_free
+//===========================================================================================================================
+
+DEBUG_STATIC void	__dispatch_item_free( dispatch_item_t inItem )
+{
+	dispatch_item_cache *		cache;
+	dispatch_item_t				batch;
+	
+	cache = __dispatch_item_cache_get();
+	if( !cache )
+	{
+		free( inItem );
+		return;
+	}
+	
+	// When the current batch fills up, it becomes our full batch and any previous full batch goes to the global pool.
+	
+	if( cache->currentCount >= kDispatchItemCacheBatchSize )
+	{
+		batch = cache->full;
+		if( batch )
+		{
+			pthread_mutex_lock( gDispatchItemPool_MutexPtr );
+			if( gDispatchItemPool_BatchCount < kDispatchItemPoolMaxBatches )
+			{
+				gDispatchItemPool_Batches[ gDispatchItemPool_BatchCount++ ] = batch;
+				batch = NULL;
+			}
+			pthread_mutex_unlock( gDispatchItemPool_MutexPtr );
+			if( batch ) __dispatch_item_list_free( batch );
+		}
+		cache->full			= cache->current;
+		cache->current		= NULL;
+		cache->currentCount	= 0;
+	}
+	inItem->next = cache->current;
+	cache->current = inItem;
+	++cache->currentCount;
+}
+
+//===========================================================================================================================
+//	__dispatch_item_cache_get
+//===========================================================================================================================
+
+DEBUG_STATIC dispatch_item_cache *	__dispatch_item_cache_get( void )
+{
+	dispatch_item_cache *		cache;
+	OSStatus					err;
+	
+	if( !gDispatchKey_ItemCachePtr ) return( NULL );
+	cache = (dispatch_item_cache *) pthread_getspecific( gDispatchKey_ItemCache );
+	if( !cache )
+	{
+		cache = (dispatch_item_cache *) calloc( 1, sizeof( *cache ) );
+		require( cache, exit );
+		
+		err = pthread_setspecific( gDispatchKey_ItemCache, cache );
+		require_noerr_action( err, exit, ForgetMem( &cache ) );
+	}
+	
+exit:
+	return( cache );
+}
+
+//===========================================================================================================================
+//	__dispatch_item_cache_free
+//
+//	Note: Called when a thread with a cache exits. Frees items directly since the global pool may already be gone.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__dispatch_item_cache_free( void *inArg )
+{
+	dispatch_item_cache * const		cache = (dispatch_item_cache *) inArg;
+	
+	if( cache )
+	{
+		__dispatch_item_list_free( cache->current );
+		__dispatch_item_list_free( cache->full );
+		free( cache );
+	}
+}
+
+//===========================================================================================================================
+//	__dispatch_item_list_free
+//===========================================================================================================================
+
+DEBUG_STATIC void	__dispatch_item_list_free( dispatch_item_t inList )
+{
+	dispatch_item_t		item;
+	
+	while( ( item = inList ) != NULL )
+	{
+		inList = item->next;
+		free( item );
+	}
+}
+
+#if 0
+#pragma mark -
+#endif
+
+//===========================================================================================================================
+//	__dispatch_free_object
+//===========================================================================================================================
+
+DEBUG_STATIC void	__dispatch_free_object( dispatch_object_t inObj )
+{
+	dispatch_union * const			obj		= (dispatch_union *) inObj;
+	dispatch_function_t const		func	= obj->base.doFinalize;
+	void * const					context	= obj->base.context;
+	
+	free( inObj );
+	if( func ) func( context );
+}
+
+//===========================================================================================================================
+//	dispatch_retain
 //===========================================================================================================================
 
 void	dispatch_retain( dispatch_object_t inObj )
@@ -1232,7 +1874,7 @@ void	dispatch_async_f( dispatch_queue_t inQueue, void *inContext, dispatch_funct
 	
 	require_action( DispatchQueueValid( inQueue ), exit, err = EINVAL );
 	
-	item = (dispatch_item_t) calloc( 1, sizeof( *item ) );
+	item = __dispatch_item_alloc();
 	require_action( item, exit, err = ENOMEM );
 	
 	item->function	= inFunction;
@@ -1733,7 +2375,7 @@ DEBUG_STATIC void	__dispatch_queue_concurrent_drain( void *inContext )
 			}
 			
 			item->function( item->context );
-			free( item );
+			__dispatch_item_free( item );
 			i = n; // Reset back to the highest priority queue so we always prefer it.
 		}
 		else
@@ -1813,7 +2455,7 @@ DEBUG_STATIC void	__dispatch_queue_serial_drain_locked( dispatch_queue_t inQueue
 		
 		pthread_mutex_unlock( inQueue->lockPtr );
 			item->function( item->context );
-			free( item );
+			__dispatch_item_free( item );
 			if( releaseQueue )
 			{
 				dispatch_release( inQueue );
@@ -2836,6 +3478,10 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectEnsureInitialized( void )
 	gDispatchSelect_CommandQueue = __dispatch_queue_create_internal( "com.apple.select-commands" );
 	require_action( gDispatchSelect_CommandQueue, exit, err = ENOMEM );
 	
+	err = pthread_mutex_init( &gDispatchSelect_TimerMutex, NULL );
+	require_noerr( err, exit );
+	gDispatchSelect_TimerMutexPtr = &gDispatchSelect_TimerMutex;
+	
 	// Set up a loopback socket that's connected to itself so we can send/receive to the command thread.
 	
 	sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
@@ -2862,6 +3508,11 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectEnsureInitialized( void )
 	gDispatchSelect_CommandSock = sock;
 	sock = kInvalidSocketRef;
 	
+#if( DISPATCH_LITE_USE_EPOLL )
+	err = __LibDispatch_EPollEnsureInitialized();
+	require_noerr( err, exit );
+#endif
+	
 	dispatch_async_f( gDispatchSelect_CommandQueue, NULL, __LibDispatch_SelectDrain ); // $$$ TO DO: do this lazily.
 	
 exit:
@@ -2878,14 +3529,22 @@ DEBUG_STATIC void	__LibDispatch_SelectDrain( void *inArg )
 	OSStatus				err;
 	int						n;
 	dispatch_source_t		curr;
-	dispatch_source_t *		next;
 	uint64_t				ticksPerSec;
 	uint64_t				nowTicks;
 	uint64_t				deltaTicks;
+	uint64_t				expireTicks;
+	Boolean					haveTimer;
+#if( DISPATCH_LITE_USE_EPOLL )
+	struct epoll_event		events[ kDispatchEPollMaxEvents ];
+	int						timeoutMs;
+	int						i;
+#else
 	struct timeval			timeout;
 	struct timeval *		timeoutPtr;
 	fd_set *				writeSetPtr;
 	int						maxFD;
+	dispatch_source_t *		next;
+#endif
 	dispatch_source_t		expiredList;
 	dispatch_source_t		expiredCurr;
 	
@@ -2895,15 +3554,62 @@ DEBUG_STATIC void	__LibDispatch_SelectDrain( void *inArg )
 	ticksPerSec = UpTicksPerSecond();
 	for( ;; )
 	{
-		// Set up the timeout for the nearest timer (sorted by expiration time).
+		// Set up the timeout for the nearest timer (top of the heap). Clearing the wake flag here means a timer armed 
+		// earlier than this from another thread after this point will send a wake command.
+		
+		pthread_mutex_lock( gDispatchSelect_TimerMutexPtr );
+		gDispatchSelect_TimerWakePending = false;
+		haveTimer = ( gDispatchSelect_TimerCount > 0 );
+		expireTicks = haveTimer ? gDispatchSelect_TimerHeap[ 0 ]->u.timer.expireTicks : 0;
+		pthread_mutex_unlock( gDispatchSelect_TimerMutexPtr );
+#if( DISPATCH_LITE_USE_EPOLL )
+		if( haveTimer )
+		{
+			// epoll only has millisecond resolution so round up to avoid waking early and spinning until it expires.
+			
+			nowTicks = UpTicks();
+			if( nowTicks < expireTicks )
+			{
+				deltaTicks	= expireTicks - nowTicks;
+				deltaTicks	= ( ( deltaTicks * kMillisecondsPerSecond ) + ( ticksPerSec - 1 ) ) / ticksPerSec;
+				timeoutMs	= ( deltaTicks < INT_MAX ) ? ( (int) deltaTicks ) : INT_MAX;
+			}
+			else
+			{
+				timeoutMs = 0;
+			}
+		}
+		else
+		{
+			timeoutMs = -1;
+		}
+		
+		// Wait for an event. Handle FD events before commands so freeing a source is serialized after its events.
 		
-		curr = gDispatchSelect_TimerList;
-		if( curr )
+		n = epoll_wait( gDispatchEPoll_FD, events, kDispatchEPollMaxEvents, timeoutMs );
+		err = map_global_value_errno( n >= 0, n );
+		if( !err )
+		{
+			__LibDispatch_EPollHandleEvents( events, n );
+			for( i = 0; ( i < n ) && ( events[ i ].data.fd != gDispatchSelect_CommandSock ); ++i ) {}
+			if( i < n )
+			{
+				err = __LibDispatch_SelectHandleCommand( NULL );
+				if( err ) break;
+			}
+		}
+		else if( err != EINTR )
+		{
+			dlogassert( "epoll_wait() error: %#m", err );
+			sleep( 1 );
+		}
+#else
+		if( haveTimer )
 		{
 			nowTicks = UpTicks();
-			if( nowTicks < curr->u.timer.expireTicks )
+			if( nowTicks < expireTicks )
 			{
-				deltaTicks		= curr->u.timer.expireTicks - nowTicks;
+				deltaTicks		= expireTicks - nowTicks;
 				timeout.tv_sec  = (int32_t)(     deltaTicks / ticksPerSec );
 				timeout.tv_usec = (int32_t)( ( ( deltaTicks % ticksPerSec ) * kMicrosecondsPerSecond ) / ticksPerSec );
 			}
@@ -2989,17 +3695,35 @@ DEBUG_STATIC void	__LibDispatch_SelectDrain( void *inArg )
 			dlogassert( "select() error: %#m", err );
 			sleep( 1 );
 		}
+#endif
 		
-		// Process expired timers.
+		// Pop expired timers then re-insert them based on their new expiration so each fires at most once per pass.
 		
 		expiredList = NULL;
 		nowTicks = UpTicks();
-		while( ( curr = gDispatchSelect_TimerList ) != NULL )
+		pthread_mutex_lock( gDispatchSelect_TimerMutexPtr );
+		while( gDispatchSelect_TimerCount > 0 )
 		{
+			curr = gDispatchSelect_TimerHeap[ 0 ];
 			if( nowTicks < curr->u.timer.expireTicks ) break;
-			gDispatchSelect_TimerList = curr->armedNext;
+			__LibDispatch_TimerHeapRemove( curr );
 			curr->armedNext = expiredList;
 			expiredList = curr;
+		}
+		for( expiredCurr = expiredList; expiredCurr; expiredCurr = expiredCurr->armedNext )
+		{
+			deltaTicks = MillisecondsToUpTicks( expiredCurr->u.timer.intervalMs );
+			add_saturate( expiredCurr->u.timer.expireTicks, deltaTicks, UINT64_MAX );
+			__LibDispatch_TimerHeapInsert( expiredCurr );
+		}
+		pthread_mutex_unlock( gDispatchSelect_TimerMutexPtr );
+		
+		// Schedule expired timers outside the timer lock since arming takes the timer lock with the queue locked.
+		// Sources are only freed by commands on this thread so expired timers can't go away out from under us.
+		
+		while( ( curr = expiredList ) != NULL )
+		{
+			expiredList = curr->armedNext;
 			
 			check( DispatchSourceValidOrFreeing( curr ) );
 			check( curr->type == DISPATCH_SOURCE_TYPE_TIMER );
@@ -3014,26 +3738,11 @@ DEBUG_STATIC void	__LibDispatch_SelectDrain( void *inArg )
 				++curr->u.timer.count;
 			}
 		}
-		
-		// Re-insert expired timers based on their new expiration.
-		
-		while( ( expiredCurr = expiredList ) != NULL )
-		{
-			expiredList = expiredCurr->armedNext;
-			
-			deltaTicks = MillisecondsToUpTicks( expiredCurr->u.timer.intervalMs );
-			add_saturate( expiredCurr->u.timer.expireTicks, deltaTicks, UINT64_MAX );
-			for( next = &gDispatchSelect_TimerList; ( curr = *next ) != NULL; next = &curr->armedNext )
-			{
-				if( expiredCurr->u.timer.expireTicks < curr->u.timer.expireTicks )
-					break;
-			}
-			expiredCurr->armedNext = *next;
-			*next = expiredCurr;
-		}
 	}
+#if( !DISPATCH_LITE_USE_EPOLL )
 	check( gDispatchSelect_ReadWriteList == NULL );
-	check( gDispatchSelect_TimerList == NULL );
+#endif
+	check( gDispatchSelect_TimerCount == 0 );
 }
 
 //===========================================================================================================================
@@ -3045,8 +3754,10 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectHandleCommand( const dispatch_select_p
 	OSStatus					err;
 	dispatch_select_packet		pkt;
 	ssize_t						n;
+#if( !DISPATCH_LITE_USE_EPOLL )
 	dispatch_source_t *			next;
 	dispatch_source_t			curr;
+#endif
 	
 	if( inPkt == NULL )
 	{
@@ -3059,72 +3770,29 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectHandleCommand( const dispatch_select_p
 	switch( inPkt->cmd )
 	{
 		case kDispatchCommandArmSource:
-			if( inPkt->source->type == DISPATCH_SOURCE_TYPE_TIMER )
+			if( ( inPkt->source->type == DISPATCH_SOURCE_TYPE_READ ) ||
+				( inPkt->source->type == DISPATCH_SOURCE_TYPE_WRITE ) )
 			{
-				uint64_t		milliseconds;
-				
-				if( ( (int64_t) inPkt->source->u.timer.start ) < 0 ) // Wall clock time.
+			#if( DISPATCH_LITE_USE_EPOLL )
+				__LibDispatch_EPollFireAlwaysReady( inPkt->source );
+			#else
+				for( next = &gDispatchSelect_ReadWriteList; ( curr = *next ) != NULL; next = &curr->armedNext )
 				{
-					uint64_t		tempStart;
-					
-					tempStart = -inPkt->source->u.timer.start;
-					milliseconds = tempStart - __dispatch_wall_milliseconds();
-					if( milliseconds > tempStart ) milliseconds = 0; // Start is in the past...force to now.
-				}
-				else
-				{
-					milliseconds = inPkt->source->u.timer.start - __dispatch_milliseconds();
-					if( milliseconds > inPkt->source->u.timer.start ) milliseconds = 0; // Start is in the past...force to now.
-				}
-				inPkt->source->u.timer.expireTicks = UpTicks() + MillisecondsToUpTicks( milliseconds );
-				
-				// Remove the timer if it already exists and re-insert it based on the new expiration.
-				
-				for( next = &gDispatchSelect_TimerList; ( curr = *next ) != NULL; next = &curr->armedNext )
-				{
-					if( curr == inPkt->source )
-					{
-						*next = curr->armedNext;
-						break;
-					}
-				}
-				for( next = &gDispatchSelect_TimerList; ( curr = *next ) != NULL; next = &curr->armedNext )
-				{
-					if( inPkt->source->u.timer.expireTicks < curr->u.timer.expireTicks )
-						break;
-				}
-				inPkt->source->armedNext = *next;
-				*next = inPkt->source;
-			}
-			else if( ( inPkt->source->type == DISPATCH_SOURCE_TYPE_READ ) ||
-					 ( inPkt->source->type == DISPATCH_SOURCE_TYPE_WRITE ) )
-			{
-				for( next = &gDispatchSelect_ReadWriteList; ( curr = *next ) != NULL; next = &curr->armedNext )
-				{
-					if( curr == inPkt->source ) break;
+					if( curr == inPkt->source ) break;
 				}
 				if( !curr )
 				{
 					inPkt->source->armedNext = NULL;
 					*next = inPkt->source;
 				}
+			#endif
 			}
 			break;
 		
 		case kDispatchCommandDisarmSource:
-			if( inPkt->source->type == DISPATCH_SOURCE_TYPE_TIMER )
-			{
-				for( next = &gDispatchSelect_TimerList; ( curr = *next ) != NULL; next = &curr->armedNext )
-				{
-					if( curr == inPkt->source )
-					{
-						*next = curr->armedNext;
-						break;
-					}
-				}
-			}
-			else if( ( inPkt->source->type == DISPATCH_SOURCE_TYPE_READ ) ||
-					 ( inPkt->source->type == DISPATCH_SOURCE_TYPE_WRITE ) )
+		#if( !DISPATCH_LITE_USE_EPOLL )
+			if( ( inPkt->source->type == DISPATCH_SOURCE_TYPE_READ ) ||
+				( inPkt->source->type == DISPATCH_SOURCE_TYPE_WRITE ) )
 			{
 				for( next = &gDispatchSelect_ReadWriteList; ( curr = *next ) != NULL; next = &curr->armedNext )
 				{
@@ -3135,6 +3803,7 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectHandleCommand( const dispatch_select_p
 					}
 				}
 			}
+		#endif
 			break;
 		
 		case kDispatchCommandFreeSource:
@@ -3151,6 +3820,10 @@ DEBUG_STATIC OSStatus	__LibDispatch_SelectHandleCommand( const dispatch_select_p
 			dispatch_async_f( inPkt->source->queue, inPkt->source, __dispatch_source_free );
 			break;
 		
+		case kDispatchCommandWake:
+			// Nothing to do. Waking up the select thread is enough for it to pick up the new nearest timer.
+			break;
+		
 		case kDispatchCommandQuit:
 			gcd_ulog( kLogLevelInfo, "quit command received...exiting\n" );
 			check( gDispatchSelect_QuitSem );
@@ -3276,6 +3949,42 @@ DEBUG_STATIC void	__LibDispatch_PlatformArmOrDisarmSourceAndUnlock( dispatch_sou
 	
 	DEBUG_USE_ONLY( err );
 	
+	// Timers are armed directly in the heap from any thread. The select thread only needs to be woken up if the 
+	// timer is now the nearest one so it can shorten its wait.
+	
+	if( inSource->type == DISPATCH_SOURCE_TYPE_TIMER )
+	{
+		if( inCmd == kDispatchCommandArmSource )
+		{
+			if( !__LibDispatch_SelectArmTimer( inSource ) )
+			{
+				pthread_mutex_unlock( inSource->queue->lockPtr );
+				return;
+			}
+			inCmd = kDispatchCommandWake;
+		}
+		else
+		{
+			__LibDispatch_SelectDisarmTimer( inSource );
+			pthread_mutex_unlock( inSource->queue->lockPtr );
+			return;
+		}
+	}
+	
+#if( DISPATCH_LITE_USE_EPOLL )
+	// Read/write sources are registered with epoll directly from any thread. Only FDs epoll can't watch need the 
+	// command thread to deliver their events since they're always ready.
+	
+	if( ( inSource->type == DISPATCH_SOURCE_TYPE_READ ) || ( inSource->type == DISPATCH_SOURCE_TYPE_WRITE ) )
+	{
+		if( !__LibDispatch_EPollArmOrDisarm( inSource, inCmd == kDispatchCommandArmSource ) )
+		{
+			pthread_mutex_unlock( inSource->queue->lockPtr );
+			return;
+		}
+	}
+#endif
+	
 	pkt.cmd		= inCmd;
 	pkt.source	= inSource;
 	
@@ -3294,8 +4003,445 @@ DEBUG_STATIC void	__LibDispatch_PlatformArmOrDisarmSourceAndUnlock( dispatch_sou
 	}
 }
 
+//===========================================================================================================================
+//	__LibDispatch_SelectArmTimer
+//
+//	Adds the timer to the heap or moves it if it's already armed. Returns true if the select thread needs to be woken 
+//	up because this timer is now the nearest one and no wake up is already on the way.
+//===========================================================================================================================
+
+DEBUG_STATIC Boolean	__LibDispatch_SelectArmTimer( dispatch_source_t inSource )
+{
+	uint64_t		milliseconds;
+	Boolean			wake;
+	
+	if( ( (int64_t) inSource->u.timer.start ) < 0 ) // Wall clock time.
+	{
+		uint64_t		tempStart;
+		
+		tempStart = -inSource->u.timer.start;
+		milliseconds = tempStart - __dispatch_wall_milliseconds();
+		if( milliseconds > tempStart ) milliseconds = 0; // Start is in the past...force to now.
+	}
+	else
+	{
+		milliseconds = inSource->u.timer.start - __dispatch_milliseconds();
+		if( milliseconds > inSource->u.timer.start ) milliseconds = 0; // Start is in the past...force to now.
+	}
+	
+	pthread_mutex_lock( gDispatchSelect_TimerMutexPtr );
+	inSource->u.timer.expireTicks = UpTicks() + MillisecondsToUpTicks( milliseconds );
+	if( inSource->u.timer.heapIndex > 0 )
+	{
+		__LibDispatch_TimerHeapSiftUp( inSource->u.timer.heapIndex - 1 );
+		__LibDispatch_TimerHeapSiftDown( inSource->u.timer.heapIndex - 1 );
+	}
+	else if( !__LibDispatch_TimerHeapInsert( inSource ) )
+	{
+		pthread_mutex_unlock( gDispatchSelect_TimerMutexPtr );
+		dlogassert( "no memory to arm timer %p", inSource );
+		return( false );
+	}
+	wake = ( inSource->u.timer.heapIndex == 1 ) && !gDispatchSelect_TimerWakePending;
+	if( wake ) gDispatchSelect_TimerWakePending = true;
+	pthread_mutex_unlock( gDispatchSelect_TimerMutexPtr );
+	return( wake );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_SelectDisarmTimer
+//
+//	Note: Doesn't wake the select thread. If this was the nearest timer, it'll just wake up early and find nothing to do.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_SelectDisarmTimer( dispatch_source_t inSource )
+{
+	pthread_mutex_lock( gDispatchSelect_TimerMutexPtr );
+	if( inSource->u.timer.heapIndex > 0 ) __LibDispatch_TimerHeapRemove( inSource );
+	pthread_mutex_unlock( gDispatchSelect_TimerMutexPtr );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_TimerHeapInsert
+//
+//	Note: Timer mutex must be held.
+//===========================================================================================================================
+
+DEBUG_STATIC Boolean	__LibDispatch_TimerHeapInsert( dispatch_source_t inSource )
+{
+	dispatch_source_t *		heap;
+	size_t					capacity;
+	
+	check( inSource->u.timer.heapIndex == 0 );
+	if( gDispatchSelect_TimerCount >= gDispatchSelect_TimerCapacity )
+	{
+		capacity = ( gDispatchSelect_TimerCapacity > 0 ) ? ( gDispatchSelect_TimerCapacity * 2 ) : 32;
+		heap = (dispatch_source_t *) realloc( gDispatchSelect_TimerHeap, capacity * sizeof( *heap ) );
+		if( !heap ) return( false );
+		gDispatchSelect_TimerHeap		= heap;
+		gDispatchSelect_TimerCapacity	= capacity;
+	}
+	gDispatchSelect_TimerHeap[ gDispatchSelect_TimerCount ] = inSource;
+	inSource->u.timer.heapIndex = ++gDispatchSelect_TimerCount;
+	__LibDispatch_TimerHeapSiftUp( gDispatchSelect_TimerCount - 1 );
+	return( true );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_TimerHeapRemove
+//
+//	Note: Timer mutex must be held.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_TimerHeapRemove( dispatch_source_t inSource )
+{
+	size_t					i;
+	dispatch_source_t		last;
+	
+	check( ( inSource->u.timer.heapIndex > 0 ) && ( inSource->u.timer.heapIndex <= gDispatchSelect_TimerCount ) );
+	i = inSource->u.timer.heapIndex - 1;
+	inSource->u.timer.heapIndex = 0;
+	
+	// Move the last timer into the hole then let it find its place in either direction.
+	
+	last = gDispatchSelect_TimerHeap[ --gDispatchSelect_TimerCount ];
+	if( i < gDispatchSelect_TimerCount )
+	{
+		gDispatchSelect_TimerHeap[ i ] = last;
+		last->u.timer.heapIndex = i + 1;
+		__LibDispatch_TimerHeapSiftUp( i );
+		__LibDispatch_TimerHeapSiftDown( last->u.timer.heapIndex - 1 );
+	}
+}
+
+//===========================================================================================================================
+//	__LibDispatch_TimerHeapSiftUp
+//
+//	Note: Timer mutex must be held.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_TimerHeapSiftUp( size_t inIndex )
+{
+	dispatch_source_t * const		heap = gDispatchSelect_TimerHeap;
+	dispatch_source_t const			source = heap[ inIndex ];
+	size_t							parent;
+	
+	while( inIndex > 0 )
+	{
+		parent = ( inIndex - 1 ) / 2;
+		if( heap[ parent ]->u.timer.expireTicks <= source->u.timer.expireTicks ) break;
+		heap[ inIndex ] = heap[ parent ];
+		heap[ inIndex ]->u.timer.heapIndex = inIndex + 1;
+		inIndex = parent;
+	}
+	heap[ inIndex ] = source;
+	source->u.timer.heapIndex = inIndex + 1;
+}
+
+//===========================================================================================================================
+//	__LibDispatch_TimerHeapSiftDown
+//
+//	Note: Timer mutex must be held.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_TimerHeapSiftDown( size_t inIndex )
+{
+	dispatch_source_t * const		heap = gDispatchSelect_TimerHeap;
+	size_t const					count = gDispatchSelect_TimerCount;
+	dispatch_source_t const			source = heap[ inIndex ];
+	size_t							child;
+	
+	for( ;; )
+	{
+		child = ( inIndex * 2 ) + 1;
+		if( child >= count ) break;
+		if( ( ( child + 1 ) < count ) && ( heap[ child + 1 ]->u.timer.expireTicks < heap[ child ]->u.timer.expireTicks ) )
+		{
+			++child;
+		}
+		if( source->u.timer.expireTicks <= heap[ child ]->u.timer.expireTicks ) break;
+		heap[ inIndex ] = heap[ child ];
+		heap[ inIndex ]->u.timer.heapIndex = inIndex + 1;
+		inIndex = child;
+	}
+	heap[ inIndex ] = source;
+	source->u.timer.heapIndex = inIndex + 1;
+}
+
 #endif // DISPATCH_LITE_USE_SELECT
 
+#if 0
+#pragma mark -
+#pragma mark == EPoll Support ==
+#endif
+
+#if( DISPATCH_LITE_USE_EPOLL )
+//===========================================================================================================================
+//	__LibDispatch_EPollEnsureInitialized
+//===========================================================================================================================
+
+DEBUG_STATIC OSStatus	__LibDispatch_EPollEnsureInitialized( void )
+{
+	OSStatus				err;
+	struct epoll_event		ev;
+	int						n;
+	
+	err = pthread_mutex_init( &gDispatchEPoll_Mutex, NULL );
+	require_noerr( err, exit );
+	gDispatchEPoll_MutexPtr = &gDispatchEPoll_Mutex;
+	
+	gDispatchEPoll_FD = epoll_create1( EPOLL_CLOEXEC );
+	err = map_fd_creation_errno( gDispatchEPoll_FD );
+	require_noerr( err, exit );
+	
+	// The command socket stays level-triggered so any unread commands keep waking up the select thread.
+	
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events	= EPOLLIN;
+	ev.data.fd	= gDispatchSelect_CommandSock;
+	n = epoll_ctl( gDispatchEPoll_FD, EPOLL_CTL_ADD, gDispatchSelect_CommandSock, &ev );
+	err = map_global_noerr_errno( n );
+	require_noerr( err, exit );
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_EPollFinalize
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_EPollFinalize( void )
+{
+	int		fd;
+	
+	for( fd = 0; fd < gDispatchEPoll_FDCount; ++fd )
+	{
+		check( !gDispatchEPoll_FDs[ fd ].readArmed && !gDispatchEPoll_FDs[ fd ].writeArmed );
+	}
+	ForgetMem( &gDispatchEPoll_FDs );
+	gDispatchEPoll_FDCount = 0;
+	ForgetFD( &gDispatchEPoll_FD );
+	pthread_mutex_forget( &gDispatchEPoll_MutexPtr );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_EPollArmOrDisarm
+//
+//	Updates the epoll interest for a read/write source's FD. Returns true if the source was armed on an FD epoll can't
+//	watch, in which case the caller needs to have the command thread deliver the event.
+//
+//	Note: Owning queue must be locked.
+//===========================================================================================================================
+
+DEBUG_STATIC Boolean	__LibDispatch_EPollArmOrDisarm( dispatch_source_t inSource, Boolean inArm )
+{
+	int const				fd = (int) inSource->u.rw.fd;
+	Boolean					alwaysReady = false;
+	dispatch_epoll_fd *		entry;
+	int						count;
+	
+	pthread_mutex_lock( gDispatchEPoll_MutexPtr );
+	require( fd >= 0, exit );
+	if( fd >= gDispatchEPoll_FDCount )
+	{
+		require_quiet( inArm, exit ); // Never armed so there's nothing to disarm.
+		
+		count = ( gDispatchEPoll_FDCount > 0 ) ? gDispatchEPoll_FDCount : 64;
+		while( count <= fd ) count *= 2;
+		entry = (dispatch_epoll_fd *) realloc( gDispatchEPoll_FDs, ( (size_t) count ) * sizeof( *entry ) );
+		require( entry, exit );
+		memset( &entry[ gDispatchEPoll_FDCount ], 0, ( (size_t)( count - gDispatchEPoll_FDCount ) ) * sizeof( *entry ) );
+		gDispatchEPoll_FDs		= entry;
+		gDispatchEPoll_FDCount	= count;
+	}
+	
+	entry = &gDispatchEPoll_FDs[ fd ];
+	if( inSource->type == DISPATCH_SOURCE_TYPE_READ )
+	{
+		if( inArm )
+		{
+			entry->readSource	= inSource;
+			entry->readArmed	= true;
+		}
+		else if( entry->readSource == inSource )
+		{
+			entry->readArmed = false;
+			if( inSource->canceled ) entry->readSource = NULL;
+		}
+	}
+	else
+	{
+		if( inArm )
+		{
+			entry->writeSource	= inSource;
+			entry->writeArmed	= true;
+		}
+		else if( entry->writeSource == inSource )
+		{
+			entry->writeArmed = false;
+			if( inSource->canceled ) entry->writeSource = NULL;
+		}
+	}
+	__LibDispatch_EPollUpdateLocked( fd, entry );
+	alwaysReady = inArm && entry->alwaysReady;
+	
+exit:
+	pthread_mutex_unlock( gDispatchEPoll_MutexPtr );
+	return( alwaysReady );
+}
+
+//===========================================================================================================================
+//	__LibDispatch_EPollUpdateLocked
+//
+//	Makes the events enabled in the epoll set match what's armed. FDs are registered one-shot so an event disables the 
+//	FD until it's re-armed, the same as the kqueue support.
+//
+//	Note: gDispatchEPoll_Mutex must be locked.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_EPollUpdateLocked( int inFD, dispatch_epoll_fd *inEntry )
+{
+	OSStatus				err;
+	struct epoll_event		ev;
+	uint32_t				events;
+	int						n;
+	
+	memset( &ev, 0, sizeof( ev ) );
+	if( !inEntry->readSource && !inEntry->writeSource )
+	{
+		// Nothing is attached to the FD anymore. Closing the FD removes it from the epoll set so it may already be gone.
+		
+		if( inEntry->added )
+		{
+			n = epoll_ctl( gDispatchEPoll_FD, EPOLL_CTL_DEL, inFD, &ev );
+			err = map_global_noerr_errno( n );
+			if( ( err == ENOENT ) || ( err == EBADF ) ) err = kNoErr;
+			check_noerr( err );
+		}
+		memset( inEntry, 0, sizeof( *inEntry ) );
+		goto exit;
+	}
+	require_quiet( !inEntry->alwaysReady, exit );
+	
+	events = 0;
+	if( inEntry->readArmed )	events |= EPOLLIN;
+	if( inEntry->writeArmed )	events |= EPOLLOUT;
+	require_quiet( events != inEntry->events, exit );
+	
+	ev.events	= events | EPOLLONESHOT;
+	ev.data.fd	= inFD;
+	err			= kNotPreparedErr;
+	if( inEntry->added )
+	{
+		n = epoll_ctl( gDispatchEPoll_FD, EPOLL_CTL_MOD, inFD, &ev );
+		err = map_global_noerr_errno( n );
+		if( err == ENOENT ) inEntry->added = false; // FD was closed and reopened since it was added.
+	}
+	if( !inEntry->added )
+	{
+		n = epoll_ctl( gDispatchEPoll_FD, EPOLL_CTL_ADD, inFD, &ev );
+		err = map_global_noerr_errno( n );
+		if( err == EPERM )
+		{
+			// epoll doesn't support regular files and some devices, but they're always ready.
+			
+			inEntry->alwaysReady = true;
+			goto exit;
+		}
+		if( !err ) inEntry->added = true;
+	}
+	require_noerr( err, exit );
+	inEntry->events = events;
+	
+exit:
+	return;
+}
+
+//===========================================================================================================================
+//	__LibDispatch_EPollHandleEvents
+//
+//	Note: Only called on the select thread. Sources are only freed on that thread so they stay valid while dispatching.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_EPollHandleEvents( const struct epoll_event *inEvents, int inCount )
+{
+	dispatch_source_t		ready[ kDispatchEPollMaxEvents * 2 ];
+	int						readyCount;
+	int						i, fd;
+	dispatch_epoll_fd *		entry;
+	uint32_t				events;
+	
+	readyCount = 0;
+	pthread_mutex_lock( gDispatchEPoll_MutexPtr );
+	for( i = 0; i < inCount; ++i )
+	{
+		fd = inEvents[ i ].data.fd;
+		if( ( fd == gDispatchSelect_CommandSock ) || ( fd < 0 ) || ( fd >= gDispatchEPoll_FDCount ) ) continue;
+		
+		entry = &gDispatchEPoll_FDs[ fd ];
+		entry->events = 0; // One-shot so the FD is disabled until it's re-enabled.
+		
+		// Errors and hang ups make the FD readable and writable, the same as select().
+		
+		events = inEvents[ i ].events;
+		if( ( events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) && entry->readArmed )
+		{
+			entry->readArmed = false;
+			ready[ readyCount++ ] = entry->readSource;
+		}
+		if( ( events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) && entry->writeArmed )
+		{
+			entry->writeArmed = false;
+			ready[ readyCount++ ] = entry->writeSource;
+		}
+		__LibDispatch_EPollUpdateLocked( fd, entry ); // Re-enable the other direction if it's still armed.
+	}
+	pthread_mutex_unlock( gDispatchEPoll_MutexPtr );
+	
+	// Dispatch after unlocking because arming takes the queue lock then the epoll lock.
+	
+	for( i = 0; i < readyCount; ++i )
+	{
+		check( DispatchSourceValidOrFreeing( ready[ i ] ) );
+		dispatch_async_f( ready[ i ]->queue, ready[ i ], __LibDispatch_SelectHandleReadWriteEvent );
+	}
+}
+
+//===========================================================================================================================
+//	__LibDispatch_EPollFireAlwaysReady
+//
+//	Delivers the event for a source on an FD epoll can't watch. These are always ready so it fires as soon as it's armed.
+//===========================================================================================================================
+
+DEBUG_STATIC void	__LibDispatch_EPollFireAlwaysReady( dispatch_source_t inSource )
+{
+	int const				fd = (int) inSource->u.rw.fd;
+	dispatch_epoll_fd *		entry;
+	Boolean					fire;
+	
+	fire = false;
+	pthread_mutex_lock( gDispatchEPoll_MutexPtr );
+	if( ( fd >= 0 ) && ( fd < gDispatchEPoll_FDCount ) )
+	{
+		entry = &gDispatchEPoll_FDs[ fd ];
+		if( ( inSource->type == DISPATCH_SOURCE_TYPE_READ ) && ( entry->readSource == inSource ) && entry->readArmed )
+		{
+			entry->readArmed = false;
+			fire = true;
+		}
+		else if( ( inSource->type == DISPATCH_SOURCE_TYPE_WRITE ) && ( entry->writeSource == inSource ) && entry->writeArmed )
+		{
+			entry->writeArmed = false;
+			fire = true;
+		}
+	}
+	pthread_mutex_unlock( gDispatchEPoll_MutexPtr );
+	
+	if( fire ) dispatch_async_f( inSource->queue, inSource, __LibDispatch_SelectHandleReadWriteEvent );
+}
+#endif // DISPATCH_LITE_USE_EPOLL
+
 #if( TARGET_OS_WINDOWS )
 
 #if 0
@@ -3815,12 +4961,31 @@ void	DispatchLite_OnceTest( void *inContext );
 void	DispatchLite_TestQueueFinalizerCallBack( void *inContext );
 void	DispatchLite_CancelCallBack( void *inContext );
 #if( TARGET_OS_POSIX )
-	void	DispatchLite_ReadTestCallBack( void *inContext );
-	void	DispatchLite_WriteTestCallBack( void *inContext );
+	void		DispatchLite_ReadTestCallBack( void *inContext );
+	void		DispatchLite_WriteTestCallBack( void *inContext );
+	OSStatus	DispatchLite_SocketSourceBenchmark( int inCount );
+	void		DispatchLite_SocketSourceBenchmarkReadHandler( void *inContext );
+	void		DispatchLite_SocketSourceBenchmarkCancelHandler( void *inContext );
 #endif
 void	DispatchLite_TimerTestCallBack( void *inContext );
 void	DispatchLite_TimerTest2CallBack( void *inContext );
 void	DispatchLite_AfterCallBack( void *inContext );
+#if( TARGET_OS_POSIX )
+	OSStatus	DispatchLite_TimerChurnBenchmark( int inCount );
+	OSStatus	DispatchLite_TimerAccuracyTest( void );
+	void		DispatchLite_TimerNopCallBack( void *inContext );
+	void		DispatchLite_TimerAccuracyCallBack( void *inContext );
+	void		DispatchLite_TimerCancelSignalCallBack( void *inContext );
+	void		DispatchLite_TimerAccuracyCancelCallBack( void *inContext );
+	void *		DispatchLite_TimerChurnThread( void *inArg );
+	OSStatus	DispatchLite_AsyncThroughputBenchmark( int inThreads );
+	void *		DispatchLite_AsyncThroughputThread( void *inArg );
+	void		DispatchLite_AsyncThroughputCallBack( void *inContext );
+	OSStatus	DispatchLite_BurstyWorkloadBenchmark( int inMinWorkers, int inMaxWorkers );
+	void		DispatchLite_BurstyWorkloadFanOut( void *inContext );
+	void		DispatchLite_BurstyWorkloadCallBack( void *inContext );
+	int			DispatchLite_BurstyWorkloadCompare( const void *inLeft, const void *inRight );
+#endif
 #if( DISPATCH_LITE_CF_ENABLED )
 	void	DispatchLite_TestCF( void *inContext );
 #endif
@@ -3845,7 +5010,7 @@ typedef struct
 
 }	SourceTuple;
 
-OSStatus	DispatchLite_Test( void )
+OSStatus	DispatchLite_Test( int inPerf )
 {
 	OSStatus				err;
 	dispatch_queue_t		dq;
@@ -4022,11 +5187,66 @@ OSStatus	DispatchLite_Test( void )
 	require_action( n == 1, exit, err = -1 );
 	require_action( ( u64 >= 90 ) && ( u64 <= 200 ), exit, err = kRangeErr );
 	
-	// Write Test
+	// Async Throughput Benchmark
 	
 #if( TARGET_OS_POSIX )
-	gcd_ulog( kLogLevelMax, "\n" );
-	gcd_ulog( kLogLevelMax, "== %s: write test\n", __ROUTINE__ );
+	if( inPerf )
+	{
+		gcd_ulog( kLogLevelMax, "\n" );
+		gcd_ulog( kLogLevelMax, "== %s: async throughput benchmark\n", __ROUTINE__ );
+		
+		err = DispatchLite_AsyncThroughputBenchmark( 1 );
+		require_noerr( err, exit );
+		err = DispatchLite_AsyncThroughputBenchmark( 4 );
+		require_noerr( err, exit );
+		err = DispatchLite_AsyncThroughputBenchmark( 8 );
+		require_noerr( err, exit );
+	}
+#endif
+	
+	// Bursty Workload Benchmark
+	
+#if( TARGET_OS_POSIX )
+	if( inPerf )
+	{
+		gcd_ulog( kLogLevelMax, "\n" );
+		gcd_ulog( kLogLevelMax, "== %s: bursty workload benchmark\n", __ROUTINE__ );
+		
+		err = DispatchLite_BurstyWorkloadBenchmark( 0, 128 );
+		require_noerr( err, exit );
+		err = DispatchLite_BurstyWorkloadBenchmark( 4, 16 );
+		require_noerr( err, exit );
+	}
+#endif
+	
+	// Timer Churn Benchmark
+	
+#if( TARGET_OS_POSIX )
+	if( inPerf )
+	{
+		gcd_ulog( kLogLevelMax, "\n" );
+		gcd_ulog( kLogLevelMax, "== %s: timer churn benchmark\n", __ROUTINE__ );
+		
+		err = DispatchLite_TimerChurnBenchmark( 1000 );
+		require_noerr( err, exit );
+		err = DispatchLite_TimerChurnBenchmark( 10000 );
+		require_noerr( err, exit );
+		
+		// Timer Accuracy Test
+		
+		gcd_ulog( kLogLevelMax, "\n" );
+		gcd_ulog( kLogLevelMax, "== %s: timer accuracy test\n", __ROUTINE__ );
+		
+		err = DispatchLite_TimerAccuracyTest();
+		require_noerr( err, exit );
+	}
+#endif
+	
+	// Write Test
+	
+#if( TARGET_OS_POSIX )
+	gcd_ulog( kLogLevelMax, "\n" );
+	gcd_ulog( kLogLevelMax, "== %s: write test\n", __ROUTINE__ );
 	
 	dq = dispatch_queue_create( "WriteTest", NULL );
 	require_action( dq, exit, err = -1 );
@@ -4079,6 +5299,21 @@ OSStatus	DispatchLite_Test( void )
 	unlink( "/tmp/DispatchLiteReadWriteTest" );
 	
 	dispatch_release( dq );
+	
+	// Socket Source Benchmark
+	
+	if( inPerf )
+	{
+		gcd_ulog( kLogLevelMax, "\n" );
+		gcd_ulog( kLogLevelMax, "== %s: socket source benchmark\n", __ROUTINE__ );
+		
+		err = DispatchLite_SocketSourceBenchmark( 10 );
+		require_noerr( err, exit );
+		err = DispatchLite_SocketSourceBenchmark( 100 );
+		require_noerr( err, exit );
+		err = DispatchLite_SocketSourceBenchmark( 1000 );
+		require_noerr( err, exit );
+	}
 #else
 	gcd_ulog( kLogLevelMax, "### writes not implemented so read/write test skipped\n" );
 #endif
@@ -4388,6 +5623,771 @@ void	DispatchLite_TestWindowsMessageLoop( void *inContext )
 }
 #endif
 
+#if( TARGET_OS_POSIX )
+//===========================================================================================================================
+//	DispatchLite_AsyncThroughputBenchmark
+//
+//	Each submitter thread dispatch_async's no-op work to its own serial queue as fast as it can. Reports the total 
+//	submissions per second from the first submission until all the work has run.
+//===========================================================================================================================
+
+#define kDispatchLiteAsyncBenchmarkTotal		400000
+
+typedef struct
+{
+	dispatch_semaphore_t		doneSem;
+	int32_t						remaining;		// Work items that haven't run yet.
+	int							perThread;		// Work items each thread submits.
+	
+}	DispatchLiteAsyncBenchmark;
+
+typedef struct
+{
+	DispatchLiteAsyncBenchmark *		bench;
+	dispatch_queue_t					queue;
+	pthread_t							thread;
+	Boolean								started;
+	
+}	DispatchLiteAsyncBenchmarkThread;
+
+OSStatus	DispatchLite_AsyncThroughputBenchmark( int inThreads )
+{
+	OSStatus								err;
+	DispatchLiteAsyncBenchmark				bench;
+	DispatchLiteAsyncBenchmarkThread *		threads = NULL;
+	DispatchLiteAsyncBenchmarkThread *		thread;
+	int										i;
+	uint64_t								ticks;
+	
+	memset( &bench, 0, sizeof( bench ) );
+	bench.perThread = kDispatchLiteAsyncBenchmarkTotal / inThreads;
+	bench.remaining = bench.perThread * inThreads;
+	bench.doneSem = dispatch_semaphore_create( 0 );
+	require_action( bench.doneSem, exit, err = kNoMemoryErr );
+	
+	threads = (DispatchLiteAsyncBenchmarkThread *) calloc( (size_t) inThreads, sizeof( *threads ) );
+	require_action( threads, exit, err = kNoMemoryErr );
+	for( i = 0; i < inThreads; ++i )
+	{
+		thread = &threads[ i ];
+		thread->bench = &bench;
+		thread->queue = dispatch_queue_create( "AsyncThroughputBenchmark", NULL );
+		require_action( thread->queue, exit, err = kNoMemoryErr );
+	}
+	
+	ticks = UpTicks();
+	for( i = 0; i < inThreads; ++i )
+	{
+		thread = &threads[ i ];
+		err = pthread_create( &thread->thread, NULL, DispatchLite_AsyncThroughputThread, thread );
+		require_noerr( err, exit );
+		thread->started = true;
+	}
+	err = (OSStatus) dispatch_semaphore_wait( bench.doneSem, dispatch_time_seconds( 30 ) );
+	require_noerr( err, exit );
+	ticks = UpTicks() - ticks;
+	
+	gcd_ulog( kLogLevelMax, "\t%d submitter(s): %.2f M asyncs/sec\n", inThreads, 
+		( ( (double) bench.perThread ) * inThreads * UpTicksPerSecond() ) / ( 1e6 * ticks ) );
+	
+exit:
+	if( threads )
+	{
+		for( i = 0; i < inThreads; ++i )
+		{
+			thread = &threads[ i ];
+			if( thread->started ) pthread_join( thread->thread, NULL );
+			if( thread->queue )
+			{
+				dispatch_sync_f( thread->queue, NULL, __dispatch_empty_callback );
+				dispatch_release( thread->queue );
+			}
+		}
+		free( threads );
+	}
+	if( bench.doneSem ) dispatch_release( bench.doneSem );
+	return( err );
+}
+
+void *	DispatchLite_AsyncThroughputThread( void *inArg )
+{
+	DispatchLiteAsyncBenchmarkThread * const		thread = (DispatchLiteAsyncBenchmarkThread *) inArg;
+	int												i;
+	
+	for( i = 0; i < thread->bench->perThread; ++i )
+	{
+		dispatch_async_f( thread->queue, thread->bench, DispatchLite_AsyncThroughputCallBack );
+	}
+	return( NULL );
+}
+
+void	DispatchLite_AsyncThroughputCallBack( void *inContext )
+{
+	DispatchLiteAsyncBenchmark * const		bench = (DispatchLiteAsyncBenchmark *) inContext;
+	
+	if( atomic_add_and_fetch_32( &bench->remaining, -1 ) == 0 ) dispatch_semaphore_signal( bench->doneSem );
+}
+#endif
+
+#if( TARGET_OS_POSIX )
+//===========================================================================================================================
+//	DispatchLite_BurstyWorkloadBenchmark
+//
+//	Submits bursts of short tasks to the default global queue with a pause between bursts, then waits long enough for 
+//	idle threads to exit and does it again. Half of each burst is submitted by a task already running on the queue. 
+//	Reports the percentiles of the time from submit to run and how many threads had to be created. Runs with the given
+//	worker limits and restores the previous ones when it's done.
+//===========================================================================================================================
+
+#define kDispatchLiteBurstBenchmarkBursts		16		// Bursts per run. Half before and half after the idle gap.
+#define kDispatchLiteBurstBenchmarkTasks		200		// Tasks per burst.
+#define kDispatchLiteBurstBenchmarkPauseMs		50		// Time between the start of each burst.
+#define kDispatchLiteBurstBenchmarkGapMs		2500	// Idle gap. Longer than the thread pool idle timeout.
+#define kDispatchLiteBurstBenchmarkWorkUs		20		// Time each task spins for.
+
+typedef struct DispatchLiteBurstBenchmark	DispatchLiteBurstBenchmark;
+
+typedef struct
+{
+	DispatchLiteBurstBenchmark *		bench;
+	uint64_t							submitTicks;
+	uint64_t							latencyTicks;
+	
+}	DispatchLiteBurstBenchmarkTask;
+
+struct DispatchLiteBurstBenchmark
+{
+	dispatch_semaphore_t					doneSem;
+	int32_t									remaining;	// Tasks that haven't run yet.
+	dispatch_queue_t						queue;
+	DispatchLiteBurstBenchmarkTask *		tasks;
+};
+
+OSStatus	DispatchLite_BurstyWorkloadBenchmark( int inMinWorkers, int inMaxWorkers )
+{
+	size_t const							total = kDispatchLiteBurstBenchmarkBursts * kDispatchLiteBurstBenchmarkTasks;
+	OSStatus								err;
+	DispatchLiteBurstBenchmark				bench;
+	DispatchLiteBurstBenchmarkTask *		task;
+	uint64_t *								latencies = NULL;
+	uint64_t								ticks;
+	size_t									i, j;
+	int										created;
+	int										oldMinWorkers, oldMaxWorkers;
+	Boolean									limitsChanged = false;
+	
+	memset( &bench, 0, sizeof( bench ) );
+	bench.queue		= dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 );
+	bench.remaining	= (int32_t) total;
+	bench.doneSem = dispatch_semaphore_create( 0 );
+	require_action( bench.doneSem, exit, err = kNoMemoryErr );
+	
+	bench.tasks = (DispatchLiteBurstBenchmarkTask *) calloc( total, sizeof( *bench.tasks ) );
+	require_action( bench.tasks, exit, err = kNoMemoryErr );
+	latencies = (uint64_t *) malloc( total * sizeof( *latencies ) );
+	require_action( latencies, exit, err = kNoMemoryErr );
+	for( i = 0; i < total; ++i ) bench.tasks[ i ].bench = &bench;
+	
+	// Let threads from earlier tests exit so every run starts from the same place.
+	
+	LibDispatch_GetWorkerLimits( &oldMinWorkers, &oldMaxWorkers );
+	LibDispatch_SetWorkerLimits( inMinWorkers, inMaxWorkers );
+	limitsChanged = true;
+	usleep( ( kDispatchLiteBurstBenchmarkGapMs + 500 ) * 1000 );
+	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	created = gDispatchThreadPool_CreatedThreads;
+	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	
+	for( i = 0; i < kDispatchLiteBurstBenchmarkBursts; ++i )
+	{
+		if( i == ( kDispatchLiteBurstBenchmarkBursts / 2 ) ) usleep( kDispatchLiteBurstBenchmarkGapMs * 1000 );
+		else if( i > 0 ) usleep( kDispatchLiteBurstBenchmarkPauseMs * 1000 );
+		
+		task = &bench.tasks[ i * kDispatchLiteBurstBenchmarkTasks ];
+		ticks = UpTicks();
+		for( j = 0; j < ( kDispatchLiteBurstBenchmarkTasks / 2 ); ++j )
+		{
+			task[ j ].submitTicks = ticks;
+			dispatch_async_f( bench.queue, &task[ j ], DispatchLite_BurstyWorkloadCallBack );
+		}
+		dispatch_async_f( bench.queue, &task[ j ], DispatchLite_BurstyWorkloadFanOut );
+	}
+	err = (OSStatus) dispatch_semaphore_wait( bench.doneSem, dispatch_time_seconds( 30 ) );
+	require_noerr( err, exit );
+	
+	pthread_mutex_lock( gDispatchThreadPool_MutexPtr );
+	created = gDispatchThreadPool_CreatedThreads - created;
+	pthread_mutex_unlock( gDispatchThreadPool_MutexPtr );
+	
+	for( i = 0; i < total; ++i ) latencies[ i ] = bench.tasks[ i ].latencyTicks;
+	qsort( latencies, total, sizeof( *latencies ), DispatchLite_BurstyWorkloadCompare );
+	gcd_ulog( kLogLevelMax, "\t%d-%d workers: latency p50 %.1f, p90 %.1f, p99 %.1f, max %.1f us, %d threads created\n", 
+		inMinWorkers, inMaxWorkers, 
+		( 1e6 * latencies[ ( total * 50 ) / 100 ] ) / UpTicksPerSecond(), 
+		( 1e6 * latencies[ ( total * 90 ) / 100 ] ) / UpTicksPerSecond(), 
+		( 1e6 * latencies[ ( total * 99 ) / 100 ] ) / UpTicksPerSecond(), 
+		( 1e6 * latencies[ total - 1 ] ) / UpTicksPerSecond(), created );
+	
+exit:
+	if( limitsChanged ) LibDispatch_SetWorkerLimits( oldMinWorkers, oldMaxWorkers );
+	if( bench.doneSem ) dispatch_release( bench.doneSem );
+	ForgetMem( &bench.tasks );
+	ForgetMem( &latencies );
+	return( err );
+}
+
+void	DispatchLite_BurstyWorkloadFanOut( void *inContext )
+{
+	DispatchLiteBurstBenchmarkTask * const		task = (DispatchLiteBurstBenchmarkTask *) inContext;
+	uint64_t									ticks;
+	size_t										i;
+	
+	ticks = UpTicks();
+	for( i = 0; i < ( kDispatchLiteBurstBenchmarkTasks / 2 ); ++i )
+	{
+		task[ i ].submitTicks = ticks;
+		dispatch_async_f( task->bench->queue, &task[ i ], DispatchLite_BurstyWorkloadCallBack );
+	}
+}
+
+void	DispatchLite_BurstyWorkloadCallBack( void *inContext )
+{
+	DispatchLiteBurstBenchmarkTask * const		task = (DispatchLiteBurstBenchmarkTask *) inContext;
+	uint64_t const								ticks = UpTicks();
+	uint64_t const								endTicks = ticks + ( ( kDispatchLiteBurstBenchmarkWorkUs * UpTicksPerSecond() ) / 1000000 );
+	
+	task->latencyTicks = ticks - task->submitTicks;
+	while( UpTicks() < endTicks ) {}
+	if( atomic_add_and_fetch_32( &task->bench->remaining, -1 ) == 0 ) dispatch_semaphore_signal( task->bench->doneSem );
+}
+
+int	DispatchLite_BurstyWorkloadCompare( const void *inLeft, const void *inRight )
+{
+	uint64_t const		a = *( (const uint64_t *) inLeft );
+	uint64_t const		b = *( (const uint64_t *) inRight );
+	
+	return( ( a < b ) ? -1 : ( a > b ) ? 1 : 0 );
+}
+#endif
+
+#if( TARGET_OS_POSIX )
+//===========================================================================================================================
+//	DispatchLite_TimerChurnBenchmark
+//
+//	Arms inCount timers far in the future then re-arms each of them several times at random times and cancels them.
+//	Reports the cost of each re-arm and cancel as seen by the caller.
+//===========================================================================================================================
+
+#define kDispatchLiteTimerChurnRounds		4
+#define kDispatchLiteTimerFarMs				( 60 * 60 * 1000 ) // 1 hour so churned timers never fire.
+
+typedef struct
+{
+	dispatch_semaphore_t		doneSem;		// Signaled when all measured timers have fired.
+	dispatch_semaphore_t		canceledSem;	// Signaled by each cancel handler.
+	uint32_t					expected;
+	uint32_t					fired;
+	int64_t						latenessTotal;
+	int64_t						latenessMin;
+	int64_t						latenessMax;
+	
+	dispatch_source_t *			loadTimers;
+	int							loadCount;
+	volatile Boolean			stop;
+	
+}	DispatchLiteTimerTest;
+
+typedef struct
+{
+	DispatchLiteTimerTest *		test;
+	dispatch_source_t			source;
+	uint64_t					expectedTicks;
+	Boolean						fired;
+	
+}	DispatchLiteTimerTestItem;
+
+OSStatus	DispatchLite_TimerChurnBenchmark( int inCount )
+{
+	OSStatus					err;
+	DispatchLiteTimerTest		test;
+	dispatch_queue_t			dq = NULL;
+	dispatch_source_t *			timers = NULL;
+	dispatch_source_t			source;
+	int							i, round, started = 0;
+	uint64_t					ticks, armTicks, cancelTicks;
+	
+	memset( &test, 0, sizeof( test ) );
+	
+	timers = (dispatch_source_t *) calloc( (size_t) inCount, sizeof( *timers ) );
+	require_action( timers, exit, err = kNoMemoryErr );
+	dq = dispatch_queue_create( "TimerChurnBenchmark", NULL );
+	require_action( dq, exit, err = kNoMemoryErr );
+	test.canceledSem = dispatch_semaphore_create( 0 );
+	require_action( test.canceledSem, exit, err = kNoMemoryErr );
+	
+	for( i = 0; i < inCount; ++i )
+	{
+		source = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dq );
+		require_action( source, exit, err = kNoMemoryErr );
+		timers[ i ] = source;
+		dispatch_set_context( source, &test );
+		dispatch_source_set_event_handler_f( source, DispatchLite_TimerNopCallBack );
+		dispatch_source_set_cancel_handler_f( source, DispatchLite_TimerCancelSignalCallBack );
+		dispatch_source_set_timer( source, dispatch_time( DISPATCH_TIME_NOW, 
+			( (int64_t) kDispatchLiteTimerFarMs + RandomRange( 0, 60000 ) ) * kNanosecondsPerMillisecond ), 
+			(uint64_t) kDispatchLiteTimerFarMs * kNanosecondsPerMillisecond, 0 );
+		dispatch_resume( source );
+		++started;
+	}
+	
+	ticks = UpTicks();
+	for( round = 0; round < kDispatchLiteTimerChurnRounds; ++round )
+	{
+		for( i = 0; i < inCount; ++i )
+		{
+			dispatch_source_set_timer( timers[ i ], dispatch_time( DISPATCH_TIME_NOW, 
+				( (int64_t) kDispatchLiteTimerFarMs + RandomRange( 0, 60000 ) ) * kNanosecondsPerMillisecond ), 
+				(uint64_t) kDispatchLiteTimerFarMs * kNanosecondsPerMillisecond, 0 );
+		}
+	}
+	armTicks = UpTicks() - ticks;
+	
+	ticks = UpTicks();
+	for( i = 0; i < inCount; ++i ) dispatch_source_cancel( timers[ i ] );
+	cancelTicks = UpTicks() - ticks;
+	
+	gcd_ulog( kLogLevelMax, "\t%5d timers: %.0f ns per re-arm, %.0f ns per cancel\n", inCount, 
+		( 1e9 * armTicks ) / ( ( (double) inCount ) * kDispatchLiteTimerChurnRounds * UpTicksPerSecond() ), 
+		( 1e9 * cancelTicks ) / ( ( (double) inCount ) * UpTicksPerSecond() ) );
+	DEBUG_USE_ONLY( armTicks );
+	DEBUG_USE_ONLY( cancelTicks );
+	err = kNoErr;
+	
+exit:
+	if( timers )
+	{
+		// Release in paced batches because each free goes through the select thread's command socket.
+		
+		for( i = 0; i < inCount; ++i )
+		{
+			if( !timers[ i ] ) continue;
+			dispatch_source_cancel( timers[ i ] );
+		}
+		for( i = 0; i < started; ++i ) dispatch_semaphore_wait( test.canceledSem, dispatch_time_seconds( 5 ) );
+		for( i = 0; i < inCount; ++i )
+		{
+			if( !timers[ i ] ) continue;
+			dispatch_release( timers[ i ] );
+			if( ( i % 16 ) == 15 ) usleep( 1000 );
+		}
+		free( timers );
+	}
+	if( dq )				dispatch_release( dq );
+	if( test.canceledSem )	dispatch_release( test.canceledSem );
+	return( err );
+}
+
+//===========================================================================================================================
+//	DispatchLite_TimerAccuracyTest
+//
+//	Measures how late one-shot timers fire while thousands of other timers are being re-armed from another thread and 
+//	a set of short periodic timers keeps firing.
+//===========================================================================================================================
+
+#define kDispatchLiteTimerAccuracyCount			50
+#define kDispatchLiteTimerAccuracyLoadCount		2000
+#define kDispatchLiteTimerAccuracyPeriodicCount	100
+
+OSStatus	DispatchLite_TimerAccuracyTest( void )
+{
+	OSStatus						err;
+	DispatchLiteTimerTest			test;
+	DispatchLiteTimerTestItem *		items = NULL;
+	DispatchLiteTimerTestItem *		item;
+	dispatch_source_t *				timers = NULL;
+	dispatch_source_t				source;
+	dispatch_queue_t				loadQueue = NULL;
+	dispatch_queue_t				dq = NULL;
+	pthread_t						churnThread;
+	pthread_t *						churnThreadPtr = NULL;
+	int								i, timerCount, started = 0;
+	int64_t							delayMs;
+	
+	memset( &test, 0, sizeof( test ) );
+	test.expected		= kDispatchLiteTimerAccuracyCount;
+	test.latenessMin	= INT64_MAX;
+	test.latenessMax	= INT64_MIN;
+	timerCount			= kDispatchLiteTimerAccuracyLoadCount + kDispatchLiteTimerAccuracyPeriodicCount;
+	
+	timers = (dispatch_source_t *) calloc( (size_t) timerCount, sizeof( *timers ) );
+	require_action( timers, exit, err = kNoMemoryErr );
+	items = (DispatchLiteTimerTestItem *) calloc( kDispatchLiteTimerAccuracyCount, sizeof( *items ) );
+	require_action( items, exit, err = kNoMemoryErr );
+	loadQueue = dispatch_queue_create( "TimerAccuracyLoad", NULL );
+	require_action( loadQueue, exit, err = kNoMemoryErr );
+	dq = dispatch_queue_create( "TimerAccuracy", NULL );
+	require_action( dq, exit, err = kNoMemoryErr );
+	test.doneSem = dispatch_semaphore_create( 0 );
+	require_action( test.doneSem, exit, err = kNoMemoryErr );
+	test.canceledSem = dispatch_semaphore_create( 0 );
+	require_action( test.canceledSem, exit, err = kNoMemoryErr );
+	
+	// Set up far away timers for the churn thread to keep moving around and short periodic timers that keep firing.
+	
+	for( i = 0; i < timerCount; ++i )
+	{
+		source = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, loadQueue );
+		require_action( source, exit, err = kNoMemoryErr );
+		timers[ i ] = source;
+		dispatch_set_context( source, &test );
+		dispatch_source_set_event_handler_f( source, DispatchLite_TimerNopCallBack );
+		dispatch_source_set_cancel_handler_f( source, DispatchLite_TimerCancelSignalCallBack );
+		if( i < kDispatchLiteTimerAccuracyLoadCount )
+		{
+			dispatch_source_set_timer( source, dispatch_time( DISPATCH_TIME_NOW, 
+				( (int64_t) kDispatchLiteTimerFarMs + RandomRange( 0, 60000 ) ) * kNanosecondsPerMillisecond ), 
+				(uint64_t) kDispatchLiteTimerFarMs * kNanosecondsPerMillisecond, 0 );
+		}
+		else
+		{
+			dispatch_source_set_timer( source, dispatch_time( DISPATCH_TIME_NOW, 
+				(int64_t) RandomRange( 1, 10 ) * kNanosecondsPerMillisecond ), 
+				(uint64_t) RandomRange( 2, 10 ) * kNanosecondsPerMillisecond, 0 );
+		}
+		dispatch_resume( source );
+		++started;
+	}
+	test.loadTimers	= timers;
+	test.loadCount	= kDispatchLiteTimerAccuracyLoadCount;
+	err = pthread_create( &churnThread, NULL, DispatchLite_TimerChurnThread, &test );
+	require_noerr( err, exit );
+	churnThreadPtr = &churnThread;
+	
+	// Arm the measured timers a few milliseconds apart.
+	
+	for( i = 0; i < kDispatchLiteTimerAccuracyCount; ++i )
+	{
+		item = &items[ i ];
+		item->test = &test;
+		item->source = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dq );
+		require_action( item->source, exit, err = kNoMemoryErr );
+		dispatch_set_context( item->source, item );
+		dispatch_source_set_event_handler_f( item->source, DispatchLite_TimerAccuracyCallBack );
+		dispatch_source_set_cancel_handler_f( item->source, DispatchLite_TimerAccuracyCancelCallBack );
+		delayMs = 20 + ( i * 7 );
+		item->expectedTicks = UpTicks() + MillisecondsToUpTicks( (uint64_t) delayMs );
+		dispatch_source_set_timer( item->source, dispatch_time( DISPATCH_TIME_NOW, delayMs * kNanosecondsPerMillisecond ), 
+			DISPATCH_TIME_FOREVER, 0 );
+		dispatch_resume( item->source );
+		++started;
+	}
+	
+	err = (OSStatus) dispatch_semaphore_wait( test.doneSem, dispatch_time_seconds( 5 ) );
+	require_noerr( err, exit );
+	
+	gcd_ulog( kLogLevelMax, "\t%u timers with %d churning and %d periodic: lateness %.2f ms avg, %.2f ms min, %.2f ms max\n", 
+		test.fired, kDispatchLiteTimerAccuracyLoadCount, kDispatchLiteTimerAccuracyPeriodicCount, 
+		( 1000.0 * test.latenessTotal ) / ( test.fired * (double) UpTicksPerSecond() ), 
+		( 1000.0 * test.latenessMin ) / UpTicksPerSecond(), 
+		( 1000.0 * test.latenessMax ) / UpTicksPerSecond() );
+	
+	// Timers are scheduled to the millisecond so allow a little early. Allow late for the churn and a busy machine.
+	
+	require_action( test.latenessMin > -( (int64_t) MillisecondsToUpTicks( 2 ) ), exit, err = kRangeErr );
+	require_action( test.latenessMax < (int64_t) MillisecondsToUpTicks( 50 ), exit, err = kRangeErr );
+	err = kNoErr;
+	
+exit:
+	if( churnThreadPtr )
+	{
+		test.stop = true;
+		pthread_join( churnThread, NULL );
+	}
+	if( timers )
+	{
+		for( i = 0; i < timerCount; ++i ) if( timers[ i ] ) dispatch_source_cancel( timers[ i ] );
+	}
+	if( items )
+	{
+		for( i = 0; i < kDispatchLiteTimerAccuracyCount; ++i ) if( items[ i ].source ) dispatch_source_cancel( items[ i ].source );
+	}
+	for( i = 0; i < started; ++i ) dispatch_semaphore_wait( test.canceledSem, dispatch_time_seconds( 5 ) );
+	if( timers )
+	{
+		for( i = 0; i < timerCount; ++i )
+		{
+			if( !timers[ i ] ) continue;
+			dispatch_release( timers[ i ] );
+			if( ( i % 16 ) == 15 ) usleep( 1000 );
+		}
+		free( timers );
+	}
+	if( items )
+	{
+		for( i = 0; i < kDispatchLiteTimerAccuracyCount; ++i ) if( items[ i ].source ) dispatch_release( items[ i ].source );
+		free( items );
+	}
+	if( loadQueue )			dispatch_release( loadQueue );
+	if( dq )				dispatch_release( dq );
+	if( test.doneSem )		dispatch_release( test.doneSem );
+	if( test.canceledSem )	dispatch_release( test.canceledSem );
+	return( err );
+}
+
+void	DispatchLite_TimerNopCallBack( void *inContext )
+{
+	(void) inContext;
+}
+
+void	DispatchLite_TimerAccuracyCallBack( void *inContext )
+{
+	DispatchLiteTimerTestItem * const		item = (DispatchLiteTimerTestItem *) inContext;
+	DispatchLiteTimerTest * const			test = item->test;
+	int64_t									lateness;
+	
+	if( item->fired ) return;
+	item->fired = true;
+	
+	lateness = (int64_t)( UpTicks() - item->expectedTicks );
+	test->latenessTotal += lateness;
+	if( lateness < test->latenessMin ) test->latenessMin = lateness;
+	if( lateness > test->latenessMax ) test->latenessMax = lateness;
+	if( ++test->fired == test->expected ) dispatch_semaphore_signal( test->doneSem );
+}
+
+void	DispatchLite_TimerCancelSignalCallBack( void *inContext )
+{
+	DispatchLiteTimerTest * const		test = (DispatchLiteTimerTest *) inContext;
+	
+	dispatch_semaphore_signal( test->canceledSem );
+}
+
+void	DispatchLite_TimerAccuracyCancelCallBack( void *inContext )
+{
+	DispatchLiteTimerTestItem * const		item = (DispatchLiteTimerTestItem *) inContext;
+	
+	dispatch_semaphore_signal( item->test->canceledSem );
+}
+
+void *	DispatchLite_TimerChurnThread( void *inArg )
+{
+	DispatchLiteTimerTest * const		test = (DispatchLiteTimerTest *) inArg;
+	int									i;
+	
+	while( !test->stop )
+	{
+		for( i = 0; i < 100; ++i )
+		{
+			dispatch_source_set_timer( test->loadTimers[ RandomRange( 0, test->loadCount - 1 ) ], dispatch_time( DISPATCH_TIME_NOW, 
+				( (int64_t) kDispatchLiteTimerFarMs + RandomRange( 0, 60000 ) ) * kNanosecondsPerMillisecond ), 
+				(uint64_t) kDispatchLiteTimerFarMs * kNanosecondsPerMillisecond, 0 );
+		}
+		usleep( 1000 );
+	}
+	return( NULL );
+}
+#endif
+
+#if( TARGET_OS_POSIX )
+//===========================================================================================================================
+//	DispatchLite_SocketSourceBenchmark
+//
+//	Registers inCount UDP socket read sources and trickles events to them 1 ms apart. Reports the latency from send to
+//	event handler and the process CPU time per event. Build with DISPATCH_LITE_USE_EPOLL=0 to compare against select.
+//===========================================================================================================================
+
+#define kDispatchLiteSourceBenchmarkEvents		200
+
+typedef struct
+{
+	dispatch_semaphore_t		doneSem;
+	dispatch_semaphore_t		canceledSem;
+	uint32_t					expected;
+	uint32_t					received;
+	uint64_t					latencyTotal;
+	uint64_t					latencyMax;
+	
+}	DispatchLiteSourceBenchmark;
+
+typedef struct
+{
+	DispatchLiteSourceBenchmark *		bench;
+	dispatch_source_t					source;
+	SocketRef							sock;
+	sockaddr_ip							sip;
+	
+}	DispatchLiteSourceBenchmarkSocket;
+
+OSStatus	DispatchLite_SocketSourceBenchmark( int inCount )
+{
+	OSStatus								err;
+	DispatchLiteSourceBenchmark				bench;
+	DispatchLiteSourceBenchmarkSocket *		socks = NULL;
+	DispatchLiteSourceBenchmarkSocket *		bsock;
+	dispatch_queue_t						dq = NULL;
+	SocketRef								sendSock = kInvalidSocketRef;
+	struct rlimit							rl;
+	struct rusage							ru1, ru2;
+	socklen_t								len;
+	int										i, started = 0;
+	uint64_t								ticks, cpuUs;
+	ssize_t									n;
+	
+	memset( &bench, 0, sizeof( bench ) );
+	
+	// Make sure there are enough FDs for all the sockets.
+	
+	err = getrlimit( RLIMIT_NOFILE, &rl );
+	err = map_global_noerr_errno( err );
+	require_noerr( err, exit );
+	if( rl.rlim_cur < (rlim_t)( inCount + 64 ) )
+	{
+		rl.rlim_cur = Min( rl.rlim_max, (rlim_t)( inCount + 64 ) );
+		err = setrlimit( RLIMIT_NOFILE, &rl );
+		err = map_global_noerr_errno( err );
+		require_noerr( err, exit );
+	}
+	
+	socks = (DispatchLiteSourceBenchmarkSocket *) calloc( (size_t) inCount, sizeof( *socks ) );
+	require_action( socks, exit, err = kNoMemoryErr );
+	for( i = 0; i < inCount; ++i ) socks[ i ].sock = kInvalidSocketRef;
+	
+	dq = dispatch_queue_create( "SocketSourceBenchmark", NULL );
+	require_action( dq, exit, err = kNoMemoryErr );
+	bench.doneSem = dispatch_semaphore_create( 0 );
+	require_action( bench.doneSem, exit, err = kNoMemoryErr );
+	bench.canceledSem = dispatch_semaphore_create( 0 );
+	require_action( bench.canceledSem, exit, err = kNoMemoryErr );
+	bench.expected = kDispatchLiteSourceBenchmarkEvents;
+	
+	for( i = 0; i < inCount; ++i )
+	{
+		bsock = &socks[ i ];
+		bsock->bench = &bench;
+		bsock->sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+		err = map_socket_creation_errno( bsock->sock );
+		require_noerr( err, exit );
+	#if( !DISPATCH_LITE_USE_EPOLL )
+		if( bsock->sock >= FD_SETSIZE )
+		{
+			gcd_ulog( kLogLevelMax, "\t%4d sources: skipped, FD %d is too big for select\n", inCount, bsock->sock );
+			err = kNoErr;
+			goto exit;
+		}
+	#endif
+		err = fcntl( bsock->sock, F_SETFL, fcntl( bsock->sock, F_GETFL, 0 ) | O_NONBLOCK );
+		err = map_global_noerr_errno( err );
+		require_noerr( err, exit );
+		
+		memset( &bsock->sip, 0, sizeof( bsock->sip ) );
+		bsock->sip.v4.sin_family		= AF_INET;
+		bsock->sip.v4.sin_addr.s_addr	= htonl( INADDR_LOOPBACK );
+		err = bind( bsock->sock, &bsock->sip.sa, (socklen_t) sizeof( bsock->sip.v4 ) );
+		err = map_socket_noerr_errno( bsock->sock, err );
+		require_noerr( err, exit );
+		len = (socklen_t) sizeof( bsock->sip );
+		err = getsockname( bsock->sock, &bsock->sip.sa, &len );
+		err = map_socket_noerr_errno( bsock->sock, err );
+		require_noerr( err, exit );
+		
+		bsock->source = dispatch_source_create( DISPATCH_SOURCE_TYPE_READ, (uintptr_t) bsock->sock, 0, dq );
+		require_action( bsock->source, exit, err = kNoMemoryErr );
+		dispatch_set_context( bsock->source, bsock );
+		dispatch_source_set_event_handler_f( bsock->source, DispatchLite_SocketSourceBenchmarkReadHandler );
+		dispatch_source_set_cancel_handler_f( bsock->source, DispatchLite_SocketSourceBenchmarkCancelHandler );
+		dispatch_resume( bsock->source );
+		++started;
+		if( ( started % 16 ) == 0 ) usleep( 1000 ); // Pace arming so select's command socket doesn't drop commands.
+	}
+	
+	sendSock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	err = map_socket_creation_errno( sendSock );
+	require_noerr( err, exit );
+	
+	// Send to sockets spread across the whole set so no single FD stays hot.
+	
+	usleep( 100000 ); // Let arming settle before measuring.
+	getrusage( RUSAGE_SELF, &ru1 );
+	for( i = 0; i < kDispatchLiteSourceBenchmarkEvents; ++i )
+	{
+		bsock = &socks[ ( i * 7919 ) % inCount ];
+		ticks = UpTicks();
+		n = sendto( sendSock, (const void *) &ticks, sizeof( ticks ), 0, &bsock->sip.sa, (socklen_t) sizeof( bsock->sip.v4 ) );
+		err = map_socket_value_errno( sendSock, n == (ssize_t) sizeof( ticks ), n );
+		require_noerr( err, exit );
+		usleep( 1000 );
+	}
+	err = (OSStatus) dispatch_semaphore_wait( bench.doneSem, dispatch_time_seconds( 5 ) );
+	require_noerr( err, exit );
+	getrusage( RUSAGE_SELF, &ru2 );
+	
+	cpuUs  = ( ( (uint64_t) ru2.ru_utime.tv_sec * 1000000 ) + ru2.ru_utime.tv_usec ) -
+			 ( ( (uint64_t) ru1.ru_utime.tv_sec * 1000000 ) + ru1.ru_utime.tv_usec );
+	cpuUs += ( ( (uint64_t) ru2.ru_stime.tv_sec * 1000000 ) + ru2.ru_stime.tv_usec ) -
+			 ( ( (uint64_t) ru1.ru_stime.tv_sec * 1000000 ) + ru1.ru_stime.tv_usec );
+	gcd_ulog( kLogLevelMax, "\t%4d sources (%s): %u events, latency %.1f µs avg, %.1f µs max, CPU %.1f µs/event\n", 
+		inCount, DISPATCH_LITE_USE_EPOLL ? "epoll" : "select", bench.received, 
+		( 1000000.0 * bench.latencyTotal ) / ( bench.received * (double) UpTicksPerSecond() ), 
+		( 1000000.0 * bench.latencyMax ) / UpTicksPerSecond(), 
+		( (double) cpuUs ) / bench.received );
+	
+exit:
+	ForgetSocket( &sendSock );
+	if( socks )
+	{
+		// Cancel and release in paced batches so select's command socket doesn't drop disarm or free commands. Close 
+		// the sockets only after every source is canceled and the select thread has stopped watching them.
+		
+		for( i = 0; i < inCount; ++i )
+		{
+			if( !socks[ i ].source ) continue;
+			dispatch_source_cancel( socks[ i ].source );
+			if( ( i % 16 ) == 15 ) usleep( 1000 );
+		}
+		for( i = 0; i < started; ++i ) dispatch_semaphore_wait( bench.canceledSem, dispatch_time_seconds( 5 ) );
+		for( i = 0; i < inCount; ++i )
+		{
+			if( !socks[ i ].source ) continue;
+			dispatch_release( socks[ i ].source );
+			if( ( i % 16 ) == 15 ) usleep( 1000 );
+		}
+		usleep( 100000 );
+		for( i = 0; i < inCount; ++i ) ForgetSocket( &socks[ i ].sock );
+		free( socks );
+	}
+	if( dq )				dispatch_release( dq );
+	if( bench.doneSem )		dispatch_release( bench.doneSem );
+	if( bench.canceledSem )	dispatch_release( bench.canceledSem );
+	return( err );
+}
+
+void	DispatchLite_SocketSourceBenchmarkReadHandler( void *inContext )
+{
+	DispatchLiteSourceBenchmarkSocket * const		bsock = (DispatchLiteSourceBenchmarkSocket *) inContext;
+	DispatchLiteSourceBenchmark * const				bench = bsock->bench;
+	uint64_t										sendTicks, latency;
+	ssize_t											n;
+	
+	for( ;; )
+	{
+		n = recv( bsock->sock, (void *) &sendTicks, sizeof( sendTicks ), 0 );
+		if( n != (ssize_t) sizeof( sendTicks ) ) break;
+		
+		latency = UpTicks() - sendTicks;
+		bench->latencyTotal += latency;
+		if( latency > bench->latencyMax ) bench->latencyMax = latency;
+		if( ++bench->received == bench->expected ) dispatch_semaphore_signal( bench->doneSem );
+	}
+}
+
+void	DispatchLite_SocketSourceBenchmarkCancelHandler( void *inContext )
+{
+	DispatchLiteSourceBenchmarkSocket * const		bsock = (DispatchLiteSourceBenchmarkSocket *) inContext;
+	
+	dispatch_semaphore_signal( bsock->bench->canceledSem );
+}
+#endif
+
 void	DispatchLiteTest_WaitUntilDone( void )
 {
 	int		timeout;
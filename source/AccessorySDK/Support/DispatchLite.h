@@ -94,6 +94,16 @@
 	#endif
 #endif
 
+// DISPATCH_LITE_USE_EPOLL -- Controls whether select()-based I/O waits on read/write sources with epoll instead (Linux).
+
+#if( !defined( DISPATCH_LITE_USE_EPOLL ) )
+	#if( DISPATCH_LITE_USE_SELECT && TARGET_OS_LINUX )
+		#define DISPATCH_LITE_USE_EPOLL			1
+	#else
+		#define DISPATCH_LITE_USE_EPOLL			0
+	#endif
+#endif
+
 #if( DISPATCH_LITE_ENABLED )
 
 #if( TARGET_OS_POSIX )
@@ -115,6 +125,12 @@ extern "C" {
 OSStatus	LibDispatch_EnsureInitialized( void );
 void		LibDispatch_Finalize( void );
 
+// Sets the min and max number of global queue work threads. Threads are created on demand up to the max and idle 
+// threads exit after a couple of seconds, except for the last inMinWorkers. The max can only be raised before init.
+
+void		LibDispatch_SetWorkerLimits( int inMinWorkers, int inMaxWorkers );
+void		LibDispatch_GetWorkerLimits( int *outMinWorkers, int *outMaxWorkers );
+
 typedef void *	dispatch_object_t;
 typedef void ( *dispatch_function_t )( void *inParam );
 
@@ -270,11 +286,11 @@ long					dispatch_semaphore_signal( dispatch_semaphore_t inSem );
 
 //---------------------------------------------------------------------------------------------------------------------------
 /*!	@function	DispatchLite_Test
-	@abstract	Unit test.
+	@abstract	Unit test. If inPerf is non-zero, also runs the throughput, timer, and socket source benchmarks.
 */
 
 #if( !EXCLUDE_UNIT_TESTS )
-	OSStatus	DispatchLite_Test( void );
+	OSStatus	DispatchLite_Test( int inPerf );
 #endif
 
 #ifdef __cplusplus
@@ -79,10 +79,17 @@
 #if( TARGET_OS_POSIX )
 	#include <fcntl.h>
 	#include <pthread.h>
+	#include <sched.h>
 	#include <sys/stat.h>
+	#include <sys/time.h>
 	#include <syslog.h>
 #endif
 
+#if( LOGUTILS_ASYNC_ENABLED )
+	#include "AtomicUtils.h"
+	#include "ThreadUtils.h"
+#endif
+
 #if( TARGET_OS_WINDOWS && !TARGET_OS_WINDOWS_CE )
 	#include <direct.h>
 	#include <fcntl.h>
@@ -112,12 +119,91 @@ struct LogAction
 	char *			value;
 };
 
+// LogTimestamp -- Time a message was logged. Captured by the caller when the message is written later.
+
+typedef struct
+{
+	uint64_t		ticks;	// UpTicks when the message was logged. Used for rate limiting.
+	int64_t			secs;	// Seconds since 1970-01-01 00:00:00 UTC.
+	uint32_t		usecs;	// Microseconds within the second.
+	
+}	LogTimestamp;
+
+#if( LOGUTILS_ASYNC_ENABLED )
+
+#define kLogAsyncSlotSize			256								// Bytes in each ring buffer slot.
+#define kLogAsyncSlotDataSize		( kLogAsyncSlotSize - 8 )		// Bytes in each slot after the sequence number.
+#define kLogAsyncSlotCount			1024							// Slots in the ring buffer. Must be a power of 2.
+#define kLogAsyncMaxSlots			64								// Max slots for a message. Bigger ones are logged synchronously.
+
+// LogAsyncSlot -- Ring buffer slot. The sequence number is the slot's position in the message stream when it's free for
+// that position and the position + 1 after a producer has published its data. Messages use consecutive slots.
+
+typedef struct
+{
+	volatile uint32_t		seq;
+	uint32_t				reserved;
+	uint8_t					data[ kLogAsyncSlotDataSize ];
+	
+}	LogAsyncSlot;
+
+// LogAsyncEntry -- Header at the start of the first slot of a message. The message body follows it.
+
+typedef struct
+{
+	LogCategory *		category;
+	const char *		function;
+	LogLevel			level;
+	uint32_t			len;	// Number of bytes in the body.
+	uint32_t			slots;	// Number of slots used by the message.
+	LogTimestamp		time;
+	
+}	LogAsyncEntry;
+
+// LogAsyncControl -- Pending change requested by an "async" LogControl action. Applied after gLogUtilsLock is released
+// because LogSetAsync takes gLogAsyncStateLock before gLogUtilsLock.
+
+enum
+{
+	kLogAsyncControl_None	= 0,
+	kLogAsyncControl_Off	= 1,
+	kLogAsyncControl_On		= 2,
+	kLogAsyncControl_Block	= 3
+};
+
+#endif
+
 //===========================================================================================================================
 //	Prototypes
 //===========================================================================================================================
 
 static void	_LogUtils_FreeAction( LogAction *inAction );
 
+static int
+	_LogPrintFLocked( 
+		LogCategory *			inCategory, 
+		const char *			inFunction, 
+		LogLevel				inLevel, 
+		const LogTimestamp *	inTime, 
+		const char *			inFormat, 
+		... );
+static int
+	_LogPrintVLocked( 
+		LogCategory *			inCategory, 
+		const char *			inFunction, 
+		LogLevel				inLevel, 
+		const LogTimestamp *	inTime, 
+		const char *			inFormat, 
+		va_list					inArgs );
+
+#if( LOGUTILS_ASYNC_ENABLED )
+	static int		_LogAsyncPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel, const char *inFormat, va_list inArgs );
+	static void		_LogAsyncWake( void );
+	static void		_LogAsyncDrainLocked( void );
+	static void *	_LogAsyncThread( void *inArg );
+	static OSStatus	_LogAsyncApplyControl( void );
+#endif
+
 #if( LOGUTILS_CF_DISTRIBUTED_NOTIFICATIONS )
 	static void	_LogUtils_EnsureCFNotificationsInitialized( void );
 	static void
@@ -237,6 +323,25 @@ static LogCategory *			gLogCategoryList	= NULL;
 static LogAction *				gLogActionList		= NULL;
 static LogOutput *				gLogOutputList		= NULL;
 
+#if( LOGUTILS_ASYNC_ENABLED )
+	static pthread_mutex_t		gLogAsyncStateLock		= PTHREAD_MUTEX_INITIALIZER;	// Serializes LogSetAsync calls.
+	static pthread_mutex_t		gLogAsyncWakeLock		= PTHREAD_MUTEX_INITIALIZER;
+	static pthread_cond_t		gLogAsyncWakeCond		= PTHREAD_COND_INITIALIZER;
+	static pthread_t			gLogAsyncThreadID;
+	static Boolean				gLogAsyncThreadRunning	= false;
+	static Boolean				gLogAsyncQuit			= false;	// Protected by gLogAsyncWakeLock.
+	static volatile int32_t		gLogAsyncWakePending	= 0;
+	static volatile Boolean		gLogAsyncEnabled		= false;
+	static LogAsyncFlags		gLogAsyncFlags			= kLogAsyncFlags_None;
+	static LogAsyncSlot *		gLogAsyncRing			= NULL;		// Kept until LogUtils_Finalize once allocated.
+	static volatile uint32_t	gLogAsyncHead			= 0;		// Next position for producers to claim.
+	static uint32_t				gLogAsyncTail			= 0;		// Next position to write. Protected by gLogUtilsLock.
+	static volatile uint32_t	gLogAsyncDropped		= 0;		// Total messages dropped because the ring was full.
+	static volatile uint32_t	gLogAsyncDropsToReport	= 0;		// Dropped messages not logged as dropped yet.
+	static Boolean				gLogAsyncDeferFlush		= false;	// True while writing a batch. Protected by gLogUtilsLock.
+	static int					gLogAsyncControl		= kLogAsyncControl_None; // Pending "async" action. Protected by gLogUtilsLock.
+#endif
+
 ulog_define( LogUtils, kLogLevelAll, kLogFlags_PrintTime, "LogUtils", NULL );
 
 //===========================================================================================================================
@@ -300,6 +405,10 @@ void	LogUtils_Finalize( void )
 	dnc = CFNotificationCenterGetDistributedCenter();
 	if( dnc ) CFNotificationCenterRemoveEveryObserver( dnc, gLogCFNotificationObserver );
 #endif
+#if( LOGUTILS_ASYNC_ENABLED )
+	LogSetAsync( false, kLogAsyncFlags_None );
+	LogFlush();
+#endif
 	
 	for( category = gLogCategoryList; category; category = category->next )
 	{
@@ -324,6 +433,11 @@ void	LogUtils_Finalize( void )
 #endif
 #if( TARGET_OS_DARWIN && !COMMON_SERVICES_NO_CORE_SERVICES )
 	notify_forget( &gLogUtilsMCDefaultsChangedToken );
+#endif
+#if( LOGUTILS_ASYNC_ENABLED )
+	ForgetMem( &gLogAsyncRing );
+	gLogAsyncHead = 0;
+	gLogAsyncTail = 0;
 #endif
 	MinimalMutexEnsureFinalized( gLogUtilsLock );
 }
@@ -509,6 +623,9 @@ OSStatus	LogControl( const char *inCmd )
 	MinimalMutexLock( gLogUtilsLock );
 	err = _LogControlLocked( inCmd, kLogControlFlags_None );
 	MinimalMutexUnlock( gLogUtilsLock );
+#if( LOGUTILS_ASYNC_ENABLED )
+	if( !err ) err = _LogAsyncApplyControl();
+#endif
 	return( err );
 }
 
@@ -621,6 +738,18 @@ static OSStatus	_LogControlLocked( const char *inCmd, LogControlFlags inFlags )
 			continue;
 		}
 		
+	#if( LOGUTILS_ASYNC_ENABLED )
+		// Async is global so it's recorded here and applied by the caller after the lock is released.
+		
+		if( strnicmpx( variablePtr, variableLen, "async" ) == 0 )
+		{
+			if(      strnicmpx( valuePtr, valueLen, "on" )    == 0 ) gLogAsyncControl = kLogAsyncControl_On;
+			else if( strnicmpx( valuePtr, valueLen, "block" ) == 0 ) gLogAsyncControl = kLogAsyncControl_Block;
+			else if( strnicmpx( valuePtr, valueLen, "off" )   == 0 ) gLogAsyncControl = kLogAsyncControl_Off;
+			else { err = kValueErr; goto exit; }
+		}
+	#endif
+		
 		// Search for an action with the same name/variable. If found, replace. If not found, add.
 		
 		for( actionNext = &gLogActionList; ( action = *actionNext ) != NULL; actionNext = &action->next )
@@ -687,6 +816,9 @@ OSStatus	LogControlCF( CFStringRef inCmd )
 	MinimalMutexLock( gLogUtilsLock );
 	err = _LogControlLockedCF( inCmd, kLogControlFlags_None );
 	MinimalMutexUnlock( gLogUtilsLock );
+#if( LOGUTILS_ASYNC_ENABLED )
+	if( !err ) err = _LogAsyncApplyControl();
+#endif
 	return( err );
 }
 #endif
@@ -845,6 +977,17 @@ OSStatus	LogShow( char **outOutput )
 		}
 	}
 	
+	// Async
+	
+#if( LOGUTILS_ASYNC_ENABLED )
+	if( !err && gLogAsyncRing )
+	{
+		n = AppendPrintF( &outputStr, "\n  Async: %s, %s when full, %u dropped\n", gLogAsyncEnabled ? "on" : "off", 
+			( gLogAsyncFlags & kLogAsyncFlag_BlockWhenFull ) ? "block" : "drop", gLogAsyncDropped );
+		if( n <= 0 ) err = kNoMemoryErr;
+	}
+#endif
+	
 	MinimalMutexUnlock( gLogUtilsLock );
 	
 	// Return or print the final string.
@@ -938,6 +1081,9 @@ void	LogCategory_Remove( LogCategory *inCategory )
 	LogUtils_EnsureInitialized();
 	MinimalMutexLock( gLogUtilsLock );
 	
+#if( LOGUTILS_ASYNC_ENABLED )
+	_LogAsyncDrainLocked(); // Write queued messages before the category goes away.
+#endif
 	for( next = &gLogCategoryList; ( curr = *next ) != NULL; next = &curr->next )
 	{
 		if( curr == inCategory )
@@ -1296,10 +1442,9 @@ int	LogPrintF( LogCategory *inCategory, const char *inFunction, LogLevel inLevel
 
 int	LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel, const char *inFormat, va_list inArgs )
 {
-	LogPrintFContext		context;
-	int						total, n, last;
-	va_list					args;
-	char *					reason = NULL;
+	int				total;
+	va_list			args;
+	char *			reason = NULL;
 	
 	if( inLevel & kLogLevelFlagCrashReport )
 	{
@@ -1312,7 +1457,105 @@ int	LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel
 	}
 	
 	LogUtils_EnsureInitialized();
+	
+#if( LOGUTILS_ASYNC_ENABLED )
+	// Queue the message for the writer thread if async logging is enabled. Messages that stop the process or break into 
+	// the debugger are written synchronously so they're not lost or out of order with the stack trace, etc.
+	
+	if( gLogAsyncEnabled && !( inLevel & ( kLogLevelFlagStackTrace | kLogLevelFlagDebugBreak | kLogLevelFlagCrashReport ) ) )
+	{
+		total = _LogAsyncPrintV( inCategory, inFunction, inLevel, inFormat, inArgs );
+		if( total >= 0 ) goto exit;
+	}
+#endif
+	
 	MinimalMutexLock( gLogUtilsLock );
+#if( LOGUTILS_ASYNC_ENABLED )
+	_LogAsyncDrainLocked(); // Write queued messages first so messages stay in order.
+#endif
+	total = _LogPrintVLocked( inCategory, inFunction, inLevel, NULL, inFormat, inArgs );
+	MinimalMutexUnlock( gLogUtilsLock );
+	if( total < 0 )
+	{
+		total = 0; // Skipped because we're logging too frequently.
+		goto exit;
+	}
+	
+	// Print out a stack trace if requested.
+	
+	if( inLevel & kLogLevelFlagStackTrace )
+	{
+		DebugStackTrace( kLogLevelMax );
+	}
+	
+	// Break into the debugger if requested.
+	
+	if( ( inLevel & kLogLevelFlagDebugBreak ) && DebugIsDebuggerPresent() )
+	{
+		DebugEnterDebugger( true );
+	}
+	
+	// Force a crash report if requested.
+	
+	if( inLevel & kLogLevelFlagCrashReport )
+	{
+		if( reason )
+		{
+			char *		end;
+			
+			for( end = reason + strlen( reason ); ( end > reason ) && ( end[ -1 ] == '\n' ); --end ) {}
+			*end = '\0';
+			ReportCriticalError( reason, 0, true );
+		}
+	}
+	
+exit:
+	if( reason ) free( reason );
+	return( total );
+}
+
+//===========================================================================================================================
+//	_LogPrintFLocked
+//
+//	Note: assumes the lock is held. Returns -1 if the message was skipped because of rate limiting.
+//===========================================================================================================================
+
+static int
+	_LogPrintFLocked( 
+		LogCategory *			inCategory, 
+		const char *			inFunction, 
+		LogLevel				inLevel, 
+		const LogTimestamp *	inTime, 
+		const char *			inFormat, 
+		... )
+{
+	int				n;
+	va_list			args;
+	
+	va_start( args, inFormat );
+	n = _LogPrintVLocked( inCategory, inFunction, inLevel, inTime, inFormat, args );
+	va_end( args );
+	return( n );
+}
+
+//===========================================================================================================================
+//	_LogPrintVLocked
+//
+//	Note: assumes the lock is held. Returns -1 if the message was skipped because of rate limiting.
+//	If inTime is NULL, the current time is used.
+//===========================================================================================================================
+
+static int
+	_LogPrintVLocked( 
+		LogCategory *			inCategory, 
+		const char *			inFunction, 
+		LogLevel				inLevel, 
+		const LogTimestamp *	inTime, 
+		const char *			inFormat, 
+		va_list					inArgs )
+{
+	LogPrintFContext		context;
+	int						total, n, last;
 	
 	context.category	= inCategory;
 	context.level		= inLevel;
@@ -1334,19 +1577,21 @@ int	LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel
 		
 		if( ( inCategory->rateMaxCount > 0 ) && !( inLevel & kLogLevelFlagDontRateLimit ) )
 		{
+			uint64_t		now;
+			
+			now = inTime ? inTime->ticks : UpTicks();
 			if( inCategory->rateEnd == 0 )
 			{
-				inCategory->rateEnd = UpTicks() + inCategory->rateInterval;
+				inCategory->rateEnd = now + inCategory->rateInterval;
 			}
-			if( UpTicks() >= inCategory->rateEnd )
+			if( now >= inCategory->rateEnd )
 			{
 				inCategory->rateEnd		= 0;
 				inCategory->rateCounter = 0;
 			}
 			if( inCategory->rateCounter >= inCategory->rateMaxCount )
 			{
-				MinimalMutexUnlock( gLogUtilsLock );
-				goto exit;
+				return( -1 );
 			}
 			++inCategory->rateCounter;
 		}
@@ -1355,7 +1600,27 @@ int	LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel
 		
 		if( flags & kLogFlags_PrintTime )
 		{
-			n = CPrintF( _LogPrintFCallBack, &context, "%N " );
+		#if( LOGUTILS_ASYNC_ENABLED )
+			if( inTime )
+			{
+				time_t			secs;
+				struct tm		tm;
+				char			dateTimeStr[ 24 ];
+				char			amPMStr[ 8 ];
+				
+				// Same format as %N, but for the time the message was logged instead of now.
+				
+				secs = (time_t) inTime->secs;
+				localtime_r( &secs, &tm );
+				strftime( dateTimeStr, sizeof( dateTimeStr ), "%Y-%m-%d %I:%M:%S", &tm );
+				strftime( amPMStr, sizeof( amPMStr ), "%p", &tm );
+				n = CPrintF( _LogPrintFCallBack, &context, "%s.%06u %s ", dateTimeStr, inTime->usecs, amPMStr );
+			}
+			else
+		#endif
+			{
+				n = CPrintF( _LogPrintFCallBack, &context, "%N " );
+			}
 			if( n > 0 ) total += n;
 		}
 		
@@ -1433,39 +1698,6 @@ int	LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel
 	context.flushOnEnd = true;
 	n = _LogPrintFCallBack( "", 0, &context );
 	if( n > 0 ) total += n;
-	
-	MinimalMutexUnlock( gLogUtilsLock );
-	
-	// Print out a stack trace if requested.
-	
-	if( inLevel & kLogLevelFlagStackTrace )
-	{
-		DebugStackTrace( kLogLevelMax );
-	}
-	
-	// Break into the debugger if requested.
-	
-	if( ( inLevel & kLogLevelFlagDebugBreak ) && DebugIsDebuggerPresent() )
-	{
-		DebugEnterDebugger( true );
-	}
-	
-	// Force a crash report if requested.
-	
-	if( inLevel & kLogLevelFlagCrashReport )
-	{
-		if( reason )
-		{
-			char *		end;
-			
-			for( end = reason + strlen( reason ); ( end > reason ) && ( end[ -1 ] == '\n' ); --end ) {}
-			*end = '\0';
-			ReportCriticalError( reason, 0, true );
-		}
-	}
-	
-exit:
-	if( reason ) free( reason );
 	return( total );
 }
 
@@ -1553,6 +1785,347 @@ static void	_LogPrintFWrite( LogPrintFContext *inContext, const char *inStr, siz
 #endif
 }
 
+#if( LOGUTILS_ASYNC_ENABLED )
+#if 0
+#pragma mark -
+#pragma mark == Async ==
+#endif
+
+//===========================================================================================================================
+//	LogSetAsync
+//===========================================================================================================================
+
+OSStatus	LogSetAsync( Boolean inAsync, LogAsyncFlags inFlags )
+{
+	OSStatus		err;
+	uint32_t		i;
+	Boolean			stopThread = false;
+	
+	LogUtils_EnsureInitialized();
+	pthread_mutex_lock( &gLogAsyncStateLock );
+	MinimalMutexLock( gLogUtilsLock );
+	
+	if( inAsync )
+	{
+		// The ring is kept until LogUtils_Finalize because callers that saw async enabled may still be using it after
+		// it's disabled. Anything they queue after the writer thread stops is written by the next flush or sync log.
+		
+		if( !gLogAsyncRing )
+		{
+			gLogAsyncRing = (LogAsyncSlot *) calloc( kLogAsyncSlotCount, sizeof( *gLogAsyncRing ) );
+			require_action( gLogAsyncRing, exit, err = kNoMemoryErr );
+			for( i = 0; i < kLogAsyncSlotCount; ++i ) gLogAsyncRing[ i ].seq = i;
+			gLogAsyncHead = 0;
+			gLogAsyncTail = 0;
+		}
+		if( !gLogAsyncThreadRunning )
+		{
+			gLogAsyncQuit = false;
+			err = pthread_create( &gLogAsyncThreadID, NULL, _LogAsyncThread, NULL );
+			require_noerr( err, exit );
+			gLogAsyncThreadRunning = true;
+		}
+		gLogAsyncFlags		= inFlags;
+		gLogAsyncEnabled	= true;
+	}
+	else if( gLogAsyncThreadRunning )
+	{
+		gLogAsyncEnabled = false;
+		
+		pthread_mutex_lock( &gLogAsyncWakeLock );
+		gLogAsyncQuit = true;
+		pthread_cond_signal( &gLogAsyncWakeCond );
+		pthread_mutex_unlock( &gLogAsyncWakeLock );
+		stopThread = true;
+	}
+	err = kNoErr;
+	
+exit:
+	MinimalMutexUnlock( gLogUtilsLock );
+	if( stopThread )
+	{
+		// The thread writes everything queued before it exits.
+		
+		pthread_join( gLogAsyncThreadID, NULL );
+		gLogAsyncThreadRunning = false;
+	}
+	pthread_mutex_unlock( &gLogAsyncStateLock );
+	return( err );
+}
+
+//===========================================================================================================================
+//	LogFlush
+//===========================================================================================================================
+
+void	LogFlush( void )
+{
+	if( !gLogAsyncRing ) return;
+	
+	MinimalMutexLock( gLogUtilsLock );
+	_LogAsyncDrainLocked();
+	MinimalMutexUnlock( gLogUtilsLock );
+}
+
+//===========================================================================================================================
+//	LogGetDroppedCount
+//===========================================================================================================================
+
+uint32_t	LogGetDroppedCount( void )
+{
+	return( gLogAsyncDropped );
+}
+
+//===========================================================================================================================
+//	_LogAsyncApplyControl
+//
+//	Note: LogUtils lock must not be held.
+//===========================================================================================================================
+
+static OSStatus	_LogAsyncApplyControl( void )
+{
+	OSStatus		err;
+	int				control;
+	
+	MinimalMutexLock( gLogUtilsLock );
+	control = gLogAsyncControl;
+	gLogAsyncControl = kLogAsyncControl_None;
+	MinimalMutexUnlock( gLogUtilsLock );
+	
+	switch( control )
+	{
+		case kLogAsyncControl_On:		err = LogSetAsync( true,  kLogAsyncFlags_None );			break;
+		case kLogAsyncControl_Block:	err = LogSetAsync( true,  kLogAsyncFlag_BlockWhenFull );	break;
+		case kLogAsyncControl_Off:		err = LogSetAsync( false, kLogAsyncFlags_None );			break;
+		default:						err = kNoErr;												break;
+	}
+	return( err );
+}
+
+//===========================================================================================================================
+//	_LogAsyncPrintV
+//
+//	Queues a message for the writer thread. Returns -1 if the message needs to be written synchronously.
+//===========================================================================================================================
+
+static int	_LogAsyncPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLevel, const char *inFormat, va_list inArgs )
+{
+	LogAsyncSlot * const		ring = gLogAsyncRing;
+	int							n;
+	va_list						args;
+	char						buf[ 512 ];
+	char *						heapBuf = NULL;
+	const char *				body;
+	size_t						len, offset, chunk;
+	LogAsyncEntry				entry;
+	LogAsyncSlot *				slot;
+	struct timeval				now;
+	uint32_t					pos, last, i;
+	int32_t						diff;
+	
+	// Format the body here since the args are only valid during the call. Most messages fit in the stack buffer.
+	
+	va_copy( args, inArgs );
+	n = VSNPrintF( buf, sizeof( buf ), inFormat, args );
+	va_end( args );
+	body = buf;
+	if( n >= (int)( sizeof( buf ) - 1 ) )
+	{
+		va_copy( args, inArgs );
+		n = VASPrintF( &heapBuf, inFormat, args );
+		va_end( args );
+		require_action_quiet( heapBuf, exit, n = -1 );
+		body = heapBuf;
+	}
+	require_action_quiet( n >= 0, exit, n = -1 );
+	len = (size_t) n;
+	
+	entry.category		= inCategory;
+	entry.function		= inFunction;
+	entry.level			= inLevel;
+	entry.len			= (uint32_t) len;
+	entry.slots			= (uint32_t)( ( sizeof( entry ) + len + ( kLogAsyncSlotDataSize - 1 ) ) / kLogAsyncSlotDataSize );
+	entry.time.ticks	= UpTicks();
+	gettimeofday( &now, NULL );
+	entry.time.secs		= now.tv_sec;
+	entry.time.usecs	= (uint32_t) now.tv_usec;
+	require_action_quiet( entry.slots <= kLogAsyncMaxSlots, exit, n = -1 );
+	
+	// Claim consecutive slots. The writer frees slots in order so if the last slot is free, the ones before it are too.
+	
+	for( ;; )
+	{
+		pos  = gLogAsyncHead;
+		last = pos + entry.slots - 1;
+		diff = (int32_t)( ring[ last % kLogAsyncSlotCount ].seq - last );
+		if( diff == 0 )
+		{
+			if( atomic_bool_compare_and_swap_32( &gLogAsyncHead, pos, pos + entry.slots ) ) break;
+		}
+		else if( diff < 0 )
+		{
+			// The ring is full. Drop the message unless the caller asked to wait for the writer to make space.
+			
+			if( !( gLogAsyncFlags & kLogAsyncFlag_BlockWhenFull ) )
+			{
+				atomic_add_and_fetch_32( &gLogAsyncDropped, 1 );
+				atomic_add_and_fetch_32( &gLogAsyncDropsToReport, 1 );
+				n = 0;
+				goto exit;
+			}
+			_LogAsyncWake();
+			sched_yield();
+		}
+	}
+	
+	// Copy the message into the slots then publish them. The first slot is published last so the writer never sees
+	// part of a message.
+	
+	offset = 0;
+	for( i = 0; i < entry.slots; ++i )
+	{
+		slot = &ring[ ( pos + i ) % kLogAsyncSlotCount ];
+		if( i == 0 )
+		{
+			memcpy( slot->data, &entry, sizeof( entry ) );
+			chunk = Min( len, kLogAsyncSlotDataSize - sizeof( entry ) );
+			memcpy( &slot->data[ sizeof( entry ) ], body, chunk );
+		}
+		else
+		{
+			chunk = Min( len - offset, kLogAsyncSlotDataSize );
+			memcpy( slot->data, &body[ offset ], chunk );
+		}
+		offset += chunk;
+	}
+	atomic_write_barrier();
+	for( i = 1; i < entry.slots; ++i ) ring[ ( pos + i ) % kLogAsyncSlotCount ].seq = pos + i + 1;
+	atomic_write_barrier();
+	ring[ pos % kLogAsyncSlotCount ].seq = pos + 1;
+	_LogAsyncWake();
+	
+exit:
+	if( heapBuf ) free( heapBuf );
+	return( n );
+}
+
+//===========================================================================================================================
+//	_LogAsyncWake
+//
+//	Wakes the writer thread. Only the first message after the writer starts a batch pays for the signal.
+//===========================================================================================================================
+
+static void	_LogAsyncWake( void )
+{
+	if( atomic_bool_compare_and_swap_32( &gLogAsyncWakePending, 0, 1 ) )
+	{
+		pthread_mutex_lock( &gLogAsyncWakeLock );
+		pthread_cond_signal( &gLogAsyncWakeCond );
+		pthread_mutex_unlock( &gLogAsyncWakeLock );
+	}
+}
+
+//===========================================================================================================================
+//	_LogAsyncDrainLocked
+//
+//	Writes all published messages in the ring. Note: assumes the lock is held.
+//===========================================================================================================================
+
+static void	_LogAsyncDrainLocked( void )
+{
+	static char					sBody[ kLogAsyncMaxSlots * kLogAsyncSlotDataSize ];
+	LogAsyncSlot * const		ring = gLogAsyncRing;
+	LogAsyncEntry				entry;
+	LogAsyncSlot *				slot;
+	LogCategory *				lastCategory = NULL;
+	uint32_t					pos, i, dropped;
+	size_t						offset, chunk;
+	
+	if( !ring ) return;
+	
+	gLogAsyncDeferFlush = true;
+	for( ;; )
+	{
+		pos  = gLogAsyncTail;
+		slot = &ring[ pos % kLogAsyncSlotCount ];
+		if( slot->seq != ( pos + 1 ) ) break;
+		atomic_read_barrier();
+		
+		memcpy( &entry, slot->data, sizeof( entry ) );
+		chunk = Min( entry.len, kLogAsyncSlotDataSize - sizeof( entry ) );
+		memcpy( sBody, &slot->data[ sizeof( entry ) ], chunk );
+		for( offset = chunk, i = 1; i < entry.slots; ++i )
+		{
+			chunk = Min( entry.len - offset, kLogAsyncSlotDataSize );
+			memcpy( &sBody[ offset ], ring[ ( pos + i ) % kLogAsyncSlotCount ].data, chunk );
+			offset += chunk;
+		}
+		
+		// Free the slots before writing so producers don't wait on slow outputs.
+		
+		atomic_read_write_barrier();
+		for( i = 0; i < entry.slots; ++i ) ring[ ( pos + i ) % kLogAsyncSlotCount ].seq = pos + i + kLogAsyncSlotCount;
+		gLogAsyncTail = pos + entry.slots;
+		
+		_LogPrintFLocked( entry.category, entry.function, entry.level, &entry.time, "%.*s", (int) entry.len, sBody );
+		lastCategory = entry.category;
+	}
+	
+	// Messages are only dropped when the ring is full so there's always a message to report the drops after.
+	
+	if( lastCategory && ( gLogAsyncDropsToReport > 0 ) )
+	{
+		dropped = atomic_fetch_and_store_32( &gLogAsyncDropsToReport, 0 );
+		_LogPrintFLocked( lastCategory, __ROUTINE__, kLogLevelWarning | kLogLevelFlagDontRateLimit, NULL, 
+			"### Dropped %u log messages because the async log buffer was full\n", dropped );
+	}
+	gLogAsyncDeferFlush = false;
+	
+#if( DEBUG_FPRINTF_ENABLED )
+	if( lastCategory )
+	{
+		LogOutput *		output;
+		
+		for( output = gLogOutputList; output; output = output->next )
+		{
+			if( ( output->type == kLogOutputType_File ) && output->config.file.logFilePtr )
+			{
+				fflush( output->config.file.logFilePtr );
+			}
+		}
+	}
+#endif
+}
+
+//===========================================================================================================================
+//	_LogAsyncThread
+//===========================================================================================================================
+
+static void *	_LogAsyncThread( void *inArg )
+{
+	Boolean		quit;
+	
+	(void) inArg;
+	
+	pthread_setname_np_compat( "LogUtilsAsync" );
+	for( ;; )
+	{
+		pthread_mutex_lock( &gLogAsyncWakeLock );
+		while( !gLogAsyncWakePending && !gLogAsyncQuit ) pthread_cond_wait( &gLogAsyncWakeCond, &gLogAsyncWakeLock );
+		quit = gLogAsyncQuit;
+		pthread_mutex_unlock( &gLogAsyncWakeLock );
+		
+		// Clear the pending flag before draining so messages published during the drain wake us up again.
+		
+		atomic_bool_compare_and_swap_32( &gLogAsyncWakePending, 1, 0 );
+		MinimalMutexLock( gLogUtilsLock );
+		_LogAsyncDrainLocked();
+		MinimalMutexUnlock( gLogUtilsLock );
+		if( quit ) break;
+	}
+	return( NULL );
+}
+#endif // LOGUTILS_ASYNC_ENABLED
+
 #if 0
 #pragma mark -
 #endif
@@ -2039,6 +2612,9 @@ static void	_LogOutputFile_Writer( LogPrintFContext *inContext, LogOutput *inOut
 	if( inOutput->config.file.logFilePtr )
 	{
 		fwrite( inStr, 1, inLen, inOutput->config.file.logFilePtr );
+		#if( LOGUTILS_ASYNC_ENABLED )
+		if( !gLogAsyncDeferFlush ) // Async batches are flushed when the batch is done.
+		#endif
 		fflush( inOutput->config.file.logFilePtr );
 	}
 }
@@ -2695,19 +3271,379 @@ exit:
 #endif
 
 #if( !EXCLUDE_UNIT_TESTS )
+
+#if( LOGUTILS_ASYNC_ENABLED )
+ulog_define( LogUtilsTest, kLogLevelInfo, kLogFlags_None, "LogUtilsTest", NULL );
+ulog_define( LogUtilsPerf, kLogLevelInfo, kLogFlags_Default, "LogUtilsPerf", NULL );
+
+#define kLogUtilsTestThreads		8
+
+typedef struct
+{
+	char *		buf;	// Null terminated.
+	size_t		len;
+	size_t		maxLen;
+	
+}	LogUtilsTestOutput;
+
+typedef struct
+{
+	LogCategory *		category;
+	int					index;
+	int					count;
+	uint64_t *			latencies; // Optional UpTicks for each call.
+	
+}	LogUtilsTestThreadArgs;
+
+static OSStatus	_LogUtils_TestAsync( int inPrint );
+static OSStatus	_LogUtils_TestAsyncControl( void );
+static OSStatus	_LogUtils_TestPerf( void );
+static OSStatus	_LogUtils_TestRunThreads( LogCategory *inCategory, int inThreads, int inCount, uint64_t *ioLatencies );
+static void *	_LogUtils_TestThread( void *inArg );
+static void		_LogUtils_TestCallBack( LogPrintFContext *inPFContext, const char *inStr, size_t inLen, void *inContext );
+static int		_LogUtils_TestCompareTicks( const void *inLeft, const void *inRight );
+#endif
+
 //===========================================================================================================================
 //	LogUtils_Test
 //===========================================================================================================================
 
-OSStatus	LogUtils_Test( void )
+OSStatus	LogUtils_Test( int inPrint, int inPerf )
 {
 	OSStatus		err;
 	
+#if( LOGUTILS_ASYNC_ENABLED )
+	err = _LogUtils_TestAsync( inPrint );
+	require_noerr( err, exit );
+	
+	err = _LogUtils_TestAsyncControl();
+	require_noerr( err, exit );
+	
+	if( inPerf )
+	{
+		err = _LogUtils_TestPerf();
+		require_noerr( err, exit );
+	}
+#else
+	(void) inPrint;
+	(void) inPerf;
+	
 	err = kNoErr;
 	require_noerr( err, exit );
+#endif
 	
 exit:
 	printf( "LogUtils_Test: %s\n", !err ? "PASSED" : "FAILED" );
 	return( err );
 }
-#endif
+
+#if( LOGUTILS_ASYNC_ENABLED )
+//===========================================================================================================================
+//	_LogUtils_TestAsync
+//===========================================================================================================================
+
+static OSStatus	_LogUtils_TestAsync( int inPrint )
+{
+	OSStatus				err;
+	LogCategory * const		category = &log_category_from_name( LogUtilsTest );
+	LogUtilsTestOutput		output;
+	int						next[ kLogUtilsTestThreads ];
+	int						i, n, t, v, received;
+	const char *			ptr;
+	const char *			end;
+	char *					bigStr = NULL;
+	uint32_t				dropped;
+	Boolean					reported;
+	
+	output.maxLen	= 4 * 1024 * 1024;
+	output.len		= 0;
+	output.buf		= (char *) malloc( output.maxLen );
+	require_action( output.buf, exit, err = kNoMemoryErr );
+	
+	err = LogSetOutputCallback( "LogUtilsTest", 1, _LogUtils_TestCallBack, &output );
+	require_noerr( err, exit );
+	
+	// Sync.
+	
+	ulog( category, kLogLevelInfo, "sync %d\n", 1 );
+	require_action( strnicmpx( output.buf, output.len, "sync 1\n" ) == 0, exit, err = kResponseErr );
+	
+	// Async with a single message.
+	
+	output.len = 0;
+	err = LogSetAsync( true, kLogAsyncFlag_BlockWhenFull );
+	require_noerr( err, exit );
+	ulog( category, kLogLevelInfo, "async %d\n", 1 );
+	LogFlush();
+	require_action( strnicmpx( output.buf, output.len, "async 1\n" ) == 0, exit, err = kResponseErr );
+	
+	// Messages too big for the ring are written synchronously, after messages already queued.
+	
+	output.len = 0;
+	bigStr = (char *) malloc( 32000 );
+	require_action( bigStr, exit, err = kNoMemoryErr );
+	memset( bigStr, 'a', 31999 );
+	bigStr[ 31999 ] = '\0';
+	ulog( category, kLogLevelInfo, "before\n" );
+	ulog( category, kLogLevelInfo, "%s\n", bigStr );
+	require_action( output.len == ( 7 + 32000 ), exit, err = kSizeErr );
+	require_action( memcmp( output.buf, "before\naaaa", 11 ) == 0, exit, err = kResponseErr );
+	
+	// Multiple threads blocking when full. Messages from each thread must be in order with none lost.
+	
+	output.len = 0;
+	dropped = LogGetDroppedCount();
+	err = _LogUtils_TestRunThreads( category, kLogUtilsTestThreads, 5000, NULL );
+	require_noerr( err, exit );
+	LogFlush();
+	require_action( LogGetDroppedCount() == dropped, exit, err = kUnexpectedErr );
+	
+	memset( next, 0, sizeof( next ) );
+	for( ptr = output.buf, end = ptr + output.len; ptr < end; ptr += n )
+	{
+		n = 0;
+		require_action( sscanf( ptr, "t%d %d: %*[^\n]\n%n", &t, &v, &n ) == 2, exit, err = kMalformedErr );
+		require_action( n > 0, exit, err = kMalformedErr );
+		require_action( ( t >= 0 ) && ( t < kLogUtilsTestThreads ), exit, err = kRangeErr );
+		require_action( v == next[ t ], exit, err = kOrderErr );
+		++next[ t ];
+	}
+	for( i = 0; i < kLogUtilsTestThreads; ++i ) require_action( next[ i ] == 5000, exit, err = kCountErr );
+	
+	// Dropping when full. Hold the lock so the writer can't make space then check that everything is accounted for.
+	
+	err = LogSetAsync( true, kLogAsyncFlags_None );
+	require_noerr( err, exit );
+	output.len = 0;
+	dropped = LogGetDroppedCount();
+	MinimalMutexLock( gLogUtilsLock );
+	for( i = 0; i < ( 2 * kLogAsyncSlotCount ); ++i )
+	{
+		ulog( category, kLogLevelInfo, "d %d\n", i );
+	}
+	MinimalMutexUnlock( gLogUtilsLock );
+	LogFlush();
+	dropped = LogGetDroppedCount() - dropped;
+	if( inPrint ) printf( "LogUtils async: dropped %u of %d messages when full\n", dropped, 2 * kLogAsyncSlotCount );
+	require_action( dropped > 0, exit, err = kUnexpectedErr );
+	
+	received = 0;
+	reported = false;
+	v = -1;
+	for( ptr = output.buf, end = ptr + output.len; ptr < end; ptr += n )
+	{
+		n = 0;
+		if( sscanf( ptr, "d %d\n%n", &t, &n ) == 1 )
+		{
+			require_action( t > v, exit, err = kOrderErr );
+			v = t;
+			++received;
+		}
+		else
+		{
+			require_action( strnicmp_prefix( ptr, (size_t)( end - ptr ), "### Dropped" ) == 0, exit, err = kMalformedErr );
+			sscanf( ptr, "%*[^\n]\n%n", &n );
+			reported = true;
+		}
+		require_action( n > 0, exit, err = kMalformedErr );
+	}
+	require_action( ( received + (int) dropped ) == ( 2 * kLogAsyncSlotCount ), exit, err = kCountErr );
+	require_action( reported, exit, err = kNotFoundErr );
+	
+exit:
+	LogSetAsync( false, kLogAsyncFlags_None );
+	LogCategory_Remove( category );
+	FreeNullSafe( bigStr );
+	FreeNullSafe( output.buf );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestAsyncControl
+//===========================================================================================================================
+
+static OSStatus	_LogUtils_TestAsyncControl( void )
+{
+	OSStatus				err;
+	LogCategory * const		category = &log_category_from_name( LogUtilsTest );
+	LogUtilsTestOutput		output;
+	
+	output.maxLen	= 1024;
+	output.len		= 0;
+	output.buf		= (char *) malloc( output.maxLen );
+	require_action( output.buf, exit, err = kNoMemoryErr );
+	
+	err = LogSetOutputCallback( "LogUtilsTest", 1, _LogUtils_TestCallBack, &output );
+	require_noerr( err, exit );
+	
+	// On, along with another action in the same control string.
+	
+	err = LogControl( "LogUtils:async=on,LogUtilsTest:level=info" );
+	require_noerr( err, exit );
+	require_action( gLogAsyncEnabled && gLogAsyncThreadRunning, exit, err = kStateErr );
+	require_action( !( gLogAsyncFlags & kLogAsyncFlag_BlockWhenFull ), exit, err = kFlagErr );
+	ulog( category, kLogLevelInfo, "control %d\n", 1 );
+	LogFlush();
+	require_action( strnicmpx( output.buf, output.len, "control 1\n" ) == 0, exit, err = kResponseErr );
+	
+	// Block when full.
+	
+	err = LogControl( "LogUtils:async=block" );
+	require_noerr( err, exit );
+	require_action( gLogAsyncEnabled, exit, err = kStateErr );
+	require_action( gLogAsyncFlags & kLogAsyncFlag_BlockWhenFull, exit, err = kFlagErr );
+	
+	// Bad values are rejected and don't change the state.
+	
+	err = LogControl( "LogUtils:async=maybe" );
+	require_action( err != kNoErr, exit, err = kUnexpectedErr );
+	require_action( gLogAsyncEnabled, exit, err = kStateErr );
+	
+	// Off. Logging is synchronous again.
+	
+	err = LogControl( "LogUtils:async=off" );
+	require_noerr( err, exit );
+	require_action( !gLogAsyncEnabled && !gLogAsyncThreadRunning, exit, err = kStateErr );
+	output.len = 0;
+	ulog( category, kLogLevelInfo, "control %d\n", 2 );
+	require_action( strnicmpx( output.buf, output.len, "control 2\n" ) == 0, exit, err = kResponseErr );
+	
+exit:
+	LogSetAsync( false, kLogAsyncFlags_None );
+	LogCategory_Remove( category );
+	FreeNullSafe( output.buf );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestPerf
+//===========================================================================================================================
+
+static OSStatus	_LogUtils_TestPerf( void )
+{
+	static const int				kThreadCounts[] = { 1, 2, 4, 8 };
+	static const char * const		kModeNames[] = { "sync", "async block", "async drop" };
+	OSStatus						err;
+	uint64_t *						latencies;
+	size_t							i, total;
+	int								mode, count;
+	uint64_t						ticks;
+	uint32_t						dropped;
+	double							callsPerSec, p99;
+	
+	count = 20000;
+	latencies = (uint64_t *) malloc( kLogUtilsTestThreads * count * sizeof( *latencies ) );
+	require_action( latencies, exit, err = kNoMemoryErr );
+	
+	err = LogControl( "LogUtilsPerf:output=file;path=/dev/null" );
+	require_noerr( err, exit );
+	
+	for( mode = 0; mode < (int) countof( kModeNames ); ++mode )
+	{
+		err = LogSetAsync( mode != 0, ( mode == 1 ) ? kLogAsyncFlag_BlockWhenFull : kLogAsyncFlags_None );
+		require_noerr( err, exit );
+		
+		for( i = 0; i < countof( kThreadCounts ); ++i )
+		{
+			total	= (size_t)( kThreadCounts[ i ] * count );
+			dropped	= LogGetDroppedCount();
+			ticks	= UpTicks();
+			err = _LogUtils_TestRunThreads( &log_category_from_name( LogUtilsPerf ), kThreadCounts[ i ], count, latencies );
+			require_noerr( err, exit );
+			ticks = UpTicks() - ticks;
+			LogFlush();
+			
+			qsort( latencies, total, sizeof( *latencies ), _LogUtils_TestCompareTicks );
+			callsPerSec	= total / ( ( (double) ticks ) / UpTicksPerSecond() );
+			p99			= ( latencies[ ( total * 99 ) / 100 ] * 1000000.0 ) / UpTicksPerSecond();
+			dropped		= LogGetDroppedCount() - dropped;
+			fprintf( stderr, "\tLog %-11s %d thread%s %10.0f calls/sec, p99 latency %8.2f usec, %6u dropped\n", 
+				kModeNames[ mode ], kThreadCounts[ i ], ( kThreadCounts[ i ] == 1 ) ? " " : "s", callsPerSec, p99, dropped );
+		}
+	}
+	
+exit:
+	LogSetAsync( false, kLogAsyncFlags_None );
+	LogCategory_Remove( &log_category_from_name( LogUtilsPerf ) );
+	FreeNullSafe( latencies );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestRunThreads
+//===========================================================================================================================
+
+static OSStatus	_LogUtils_TestRunThreads( LogCategory *inCategory, int inThreads, int inCount, uint64_t *ioLatencies )
+{
+	OSStatus					err;
+	pthread_t					threads[ kLogUtilsTestThreads ];
+	LogUtilsTestThreadArgs		args[ kLogUtilsTestThreads ];
+	int							i, n;
+	
+	check( inThreads <= kLogUtilsTestThreads );
+	for( n = 0; n < inThreads; ++n )
+	{
+		args[ n ].category	= inCategory;
+		args[ n ].index		= n;
+		args[ n ].count		= inCount;
+		args[ n ].latencies	= ioLatencies ? &ioLatencies[ n * inCount ] : NULL;
+		err = pthread_create( &threads[ n ], NULL, _LogUtils_TestThread, &args[ n ] );
+		require_noerr( err, exit );
+	}
+	err = kNoErr;
+	
+exit:
+	for( i = 0; i < n; ++i ) pthread_join( threads[ i ], NULL );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestThread
+//===========================================================================================================================
+
+static void *	_LogUtils_TestThread( void *inArg )
+{
+	LogUtilsTestThreadArgs * const		args = (LogUtilsTestThreadArgs *) inArg;
+	int									i;
+	uint64_t							ticks;
+	
+	for( i = 0; i < args->count; ++i )
+	{
+		ticks = UpTicks();
+		ulog( args->category, kLogLevelInfo, "t%d %d: the quick brown fox jumps over the lazy dog %p\n", 
+			args->index, i, args );
+		if( args->latencies ) args->latencies[ i ] = UpTicks() - ticks;
+	}
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestCallBack
+//===========================================================================================================================
+
+static void	_LogUtils_TestCallBack( LogPrintFContext *inPFContext, const char *inStr, size_t inLen, void *inContext )
+{
+	LogUtilsTestOutput * const		output = (LogUtilsTestOutput *) inContext;
+	
+	(void) inPFContext;
+	
+	if( inLen > ( output->maxLen - output->len - 1 ) ) inLen = output->maxLen - output->len - 1;
+	memcpy( &output->buf[ output->len ], inStr, inLen );
+	output->len += inLen;
+	output->buf[ output->len ] = '\0';
+}
+
+//===========================================================================================================================
+//	_LogUtils_TestCompareTicks
+//===========================================================================================================================
+
+static int	_LogUtils_TestCompareTicks( const void *inLeft, const void *inRight )
+{
+	const uint64_t		a = *( (const uint64_t *) inLeft );
+	const uint64_t		b = *( (const uint64_t *) inRight );
+	
+	return( ( a < b ) ? -1 : ( a > b ) ? 1 : 0 );
+}
+#endif // LOGUTILS_ASYNC_ENABLED
+#endif // !EXCLUDE_UNIT_TESTS
+
@@ -133,6 +133,12 @@ extern "C" {
 		"output2" -- Same as "output", but for a second output (e.g. write to syslog and write to a file).
 		
 			"MyCategory:output2=syslog" to send log output to syslog.
+		
+		"async" -- Turn asynchronous logging (see LogSetAsync) on or off for all categories. The name is ignored.
+		
+			"LogUtils:async=on"		to write logs from a background thread, dropping them if it falls behind.
+			"LogUtils:async=block"	to write logs from a background thread, waiting for it if it falls behind.
+			"LogUtils:async=off"	to write logs on the caller's thread.
 	
 	Outputs:
 	
@@ -226,6 +232,16 @@ extern "C" {
 		#define LOGUTILS_OSLOG_ENABLED		0
 #endif
 
+// LOGUTILS_ASYNC_ENABLED -- Controls whether asynchronous logging (see LogSetAsync) is compiled in.
+
+#if( !defined( LOGUTILS_ASYNC_ENABLED ) )
+	#if( TARGET_OS_POSIX && ( COMPILER_CLANG || ( COMPILER_GCC >= 40500 ) ) )
+		#define LOGUTILS_ASYNC_ENABLED		1
+	#else
+		#define LOGUTILS_ASYNC_ENABLED		0
+	#endif
+#endif
+
 // LOG_STATIC_LEVEL -- Controls what logging is conditionalized out at compile time.
 
 #if( !defined( LOG_STATIC_LEVEL ) )
@@ -422,6 +438,35 @@ OSStatus	LogControl( const char *inCmd );
 OSStatus	LogSetOutputCallback( const char *inCategoryRegex, int inOutputNum, LogOutputCallBack inCallback, void *inContext );
 OSStatus	LogShow( char **outOutput );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	LogSetAsync
+	@abstract	Enables or disables asynchronous logging.
+	@discussion
+	
+	When async logging is enabled, the caller's thread only formats the message body and copies it to a ring buffer
+	with the category, level, and time. It doesn't take the LogUtils lock. A background thread adds the headers and
+	writes the messages to the category outputs in batches. This keeps slow outputs and verbose categories from
+	stalling time-critical threads.
+	
+	If the ring buffer is full, the message is dropped and counted. The background thread logs the number of dropped
+	messages after it catches up. Use kLogAsyncFlag_BlockWhenFull to make the caller wait for space instead. Messages
+	with a stack trace, debugger break, or crash report flag and messages too big for the ring buffer are always written
+	synchronously, after the messages already in the ring buffer.
+*/
+typedef uint32_t		LogAsyncFlags;
+#define kLogAsyncFlags_None				0			// Drop messages when the ring buffer is full.
+#define kLogAsyncFlag_BlockWhenFull		( 1U << 0 )	// Wait for space when the ring buffer is full instead of dropping.
+
+#if( LOGUTILS_ASYNC_ENABLED )
+	OSStatus	LogSetAsync( Boolean inAsync, LogAsyncFlags inFlags );
+	void		LogFlush( void );
+	uint32_t	LogGetDroppedCount( void );
+#else
+	#define		LogSetAsync( ASYNC, FLAGS )		( (ASYNC) ? kUnsupportedErr : kNoErr )
+	#define		LogFlush()						do {} while( 0 )
+	#define		LogGetDroppedCount()			0
+#endif
+
 Boolean		_LogCategory_Initialize( LogCategory *inCategory, LogLevel inLevel );
 void		LogCategory_Remove( LogCategory *inCategory );
 
@@ -474,7 +519,7 @@ int			LogPrintV( LogCategory *inCategory, const char *inFunction, LogLevel inLev
 	@abstract	Unit test.
 */
 #if( !EXCLUDE_UNIT_TESTS )
-	OSStatus	LogUtils_Test( void );
+	OSStatus	LogUtils_Test( int inPrint, int inPerf );
 #endif
 
 #endif // LOGUTILS_ENABLED
@@ -57,18 +57,28 @@
 #include "HTTPClient.h"
 #include "NetUtils.h"
 
+#if( !EXCLUDE_UNIT_TESTS && TARGET_OS_POSIX )
+	#include <pthread.h>
+	#include <sys/resource.h>
+	#include <sys/socket.h>
+	
+	#include "RandomNumberUtils.h"
+	#include "TickUtils.h"
+#endif
+
 //===========================================================================================================================
 //	Internals
 //===========================================================================================================================
 
 #define kMaxMessageReadSize			( 16 * 1024 )	// Max size message we can read.
 #define kMaxMessageWriteSize		1024			// Max size message we will write.
+#define kMaxWriteBatchMessages		32				// Max messages to encrypt before sending them with a single write.
+#define kMessageOverhead			( 2 + 16 )		// 2-byte length header and 16-byte auth tag around each message.
 
 typedef enum
 {
 	kNTState_ReadingHeader	= 1, 
-	kNTState_ReadingBody	= 2, 
-	kNTState_ReadingAuthTag	= 3
+	kNTState_ReadingBody	= 2	// Reading the body and auth tag.
 	
 }	NTState;
 
@@ -89,7 +99,7 @@ typedef struct
 	uint8_t						readKey[ 32 ];
 	uint8_t						readNonce[ 8 ];
 	
-	uint8_t						writeBuffer[ 2 + kMaxMessageWriteSize + 16 ];
+	uint8_t						writeBuffer[ kMaxWriteBatchMessages * ( kMaxMessageWriteSize + kMessageOverhead ) ];
 	uint8_t *					writeBufferedPtr;
 	uint8_t *					writeBufferedEnd;
 	chacha20_poly1305_state		writeCtx;
@@ -101,7 +111,15 @@ typedef struct
 static OSStatus	_NetTransportInitialize( SocketRef inSock, void *inContext );
 static void		_NetTransportFinalize( void *inContext );
 static OSStatus	_NetTransportRead( void *inBuffer, size_t inMaxLen, size_t *outLen, void *inContext );
+static OSStatus	_NetTransportReadBody( NTContext *ctx, uint8_t *inBody );
 static OSStatus	_NetTransportWriteV( iovec_t **ioArray, int *ioCount, void *inContext );
+static OSStatus
+	_NetTransportEncryptMessage( 
+		NTContext *		ctx, 
+		iovec_t **		ioArray, 
+		iovec_t *		inEnd, 
+		uint8_t *		inDst, 
+		size_t *		outLen );
 
 ulog_define( NetTransportChaCha20Poly1305, kLogLevelNotice, kLogFlags_Default, "NetTransportChaCha20Poly1305", NULL );
 #define nt_ucat()					&log_category_from_name( NetTransportChaCha20Poly1305 )
@@ -206,6 +224,7 @@ static void	_NetTransportFinalize( void *inContext )
 	}
 }
 
+
 //===========================================================================================================================
 //	_NetTransportRead
 //===========================================================================================================================
@@ -216,6 +235,8 @@ static OSStatus	_NetTransportRead( void *inBuffer, size_t inMaxLen, size_t *outL
 	uint8_t *				dst = (uint8_t *) inBuffer;
 	OSStatus				err;
 	size_t					len;
+	uint8_t *				body;
+	uint8_t					header[ 2 ];
 	
 	for( ;; )
 	{
@@ -245,37 +266,47 @@ static OSStatus	_NetTransportRead( void *inBuffer, size_t inMaxLen, size_t *outL
 			ctx->readOffset	= 0;
 			ctx->readState	= kNTState_ReadingBody;
 		}
-		if( ctx->readState == kNTState_ReadingBody )
+		
+		// If the whole message fits in the caller's buffer, read it there and decrypt it in place to avoid a copy.
+		// If the rest of it doesn't arrive yet, move what was read to our buffer since the caller's buffer may change.
+		
+		body = ( ( ctx->readOffset == 0 ) && ( ctx->readSize <= inMaxLen ) ) ? dst : ctx->readBody;
+		err = _NetTransportReadBody( ctx, body );
+		if( err && ( body != ctx->readBody ) ) memcpy( ctx->readBody, body, Min( ctx->readOffset, ctx->readSize ) );
+		require_noerr_quiet( err, exit );
+		
+		// The header buffer may already have part of the next message's header so recreate this message's header.
+		
+		WriteLittle16( header, (uint16_t) ctx->readSize );
+		nt_pre_read_dlog( kLogLevelMax, "-- Pre-decrypt read header: %.3H, auth tag: %.3H\n%1.1H\n", 
+			header, 2, 2, ctx->readAuthTag, 16, 16, body, (int) ctx->readSize, 256 );
+		
+		chacha20_poly1305_init_64x64( &ctx->readCtx, ctx->readKey, ctx->readNonce );
+		chacha20_poly1305_add_aad( &ctx->readCtx, header, sizeof( header ) );
+		len = chacha20_poly1305_decrypt( &ctx->readCtx, body, ctx->readSize, body );
+		len += chacha20_poly1305_verify( &ctx->readCtx, &body[ len ], ctx->readAuthTag, &err );
+		require_noerr_action( err, exit, 
+			nt_ulog( kLogLevelWarning, "### NTCP verify failed: %#m\n", err ) );
+		require_action( len == ctx->readSize, exit, err = kInternalErr; 
+			nt_ulog( kLogLevelWarning, "### NTCP verify len failed: %zu vs %zu\n", len, ctx->readSize ) );
+		LittleEndianIntegerIncrement( ctx->readNonce, sizeof( ctx->readNonce ) );
+		nt_post_read_dlog( kLogLevelMax, "-- Post-decrypt read\n%1.1H\n", body, (int) ctx->readSize, 256 );
+		
+		if( body == dst )
 		{
-			err = SocketReadData( ctx->sock, ctx->readBody, ctx->readSize, &ctx->readOffset );
-			require_noerr_quiet( err, exit );
-			
-			ctx->readOffset	= 0;
-			ctx->readState	= kNTState_ReadingAuthTag;
+			dst += ctx->readSize;
+			inMaxLen -= ctx->readSize;
 		}
-		if( ctx->readState == kNTState_ReadingAuthTag )
+		else
 		{
-			err = SocketReadData( ctx->sock, ctx->readAuthTag, sizeof( ctx->readAuthTag ), &ctx->readOffset );
-			require_noerr_quiet( err, exit );
-			nt_pre_read_dlog( kLogLevelMax, "-- Pre-decrypt read header: %.3H, auth tag: %.3H\n%1.1H\n", 
-				ctx->readHeader, 2, 2, ctx->readAuthTag, 16, 16, ctx->readBody, (int) ctx->readSize, 256 );
-			
-			chacha20_poly1305_init_64x64( &ctx->readCtx, ctx->readKey, ctx->readNonce );
-			chacha20_poly1305_add_aad( &ctx->readCtx, ctx->readHeader, sizeof( ctx->readHeader ) );
-			len = chacha20_poly1305_decrypt( &ctx->readCtx, ctx->readBody, ctx->readSize, ctx->readBody );
-			len += chacha20_poly1305_verify( &ctx->readCtx, &ctx->readBody[ len ], ctx->readAuthTag, &err );
-			require_noerr_action( err, exit, 
-				nt_ulog( kLogLevelWarning, "### NTCP verify failed: %#m\n", err ) );
-			require_action( len == ctx->readSize, exit, err = kInternalErr; 
-				nt_ulog( kLogLevelWarning, "### NTCP verify len failed: %zu vs %zu\n", len, ctx->readSize ) );
-			LittleEndianIntegerIncrement( ctx->readNonce, sizeof( ctx->readNonce ) );
-			nt_post_read_dlog( kLogLevelMax, "-- Post-decrypt read\n%1.1H\n", ctx->readBody, (int) ctx->readSize, 256 );
-			
-			ctx->readBufferedPtr	= ctx->readBody;
-			ctx->readBufferedEnd	= ctx->readBody + ctx->readSize;
-			ctx->readOffset			= 0;
-			ctx->readState			= kNTState_ReadingHeader;
+			ctx->readBufferedPtr = ctx->readBody;
+			ctx->readBufferedEnd = ctx->readBody + ctx->readSize;
 		}
+		
+		// Any bytes read past the auth tag are the start of the next message's header.
+		
+		ctx->readOffset	= ctx->readOffset - ( ctx->readSize + sizeof( ctx->readAuthTag ) );
+		ctx->readState	= kNTState_ReadingHeader;
 	}
 	err = kNoErr;
 	
@@ -286,6 +317,59 @@ exit:
 	return( err );
 }
 
+//===========================================================================================================================
+//	_NetTransportReadBody
+//
+//	Reads the rest of the body and auth tag plus as much of the next message's header as is available. This reads a whole
+//	message with a single call when data is arriving faster than it's being read.
+//===========================================================================================================================
+
+static OSStatus	_NetTransportReadBody( NTContext *ctx, uint8_t *inBody )
+{
+	size_t const		messageLen = ctx->readSize + sizeof( ctx->readAuthTag );
+	OSStatus			err;
+	iovec_t				iov[ 3 ];
+	iovec_t *			iop;
+	int					ion;
+	ssize_t				n;
+	
+	require_action_quiet( ctx->readOffset < messageLen, exit, err = kNoErr );
+	
+	SETIOV( &iov[ 0 ], inBody, ctx->readSize );
+	SETIOV( &iov[ 1 ], ctx->readAuthTag, sizeof( ctx->readAuthTag ) );
+	SETIOV( &iov[ 2 ], ctx->readHeader, sizeof( ctx->readHeader ) );
+	iop = iov;
+	ion = 3;
+	UpdateIOVec( &iop, &ion, ctx->readOffset );
+	do
+	{
+	#if( TARGET_OS_POSIX )
+		n = readv( ctx->sock, iop, ion );
+	#else
+		n = read_compat( ctx->sock, (char *) iop->iov_base, iop->iov_len );
+	#endif
+		err = map_socket_value_errno( ctx->sock, n >= 0, n );
+		
+	}	while( err == EINTR );
+	
+	if( n > 0 )
+	{
+		ctx->readOffset += ( (size_t) n );
+		err = ( ctx->readOffset >= messageLen ) ? kNoErr : EWOULDBLOCK;
+	}
+	else if( n == 0 )
+	{
+		err = kConnectionErr;
+	}
+	else if( err != EWOULDBLOCK )
+	{
+		dlogassert( "readv failed: %#m", err );
+	}
+	
+exit:
+	return( err );
+}
+
 //===========================================================================================================================
 //	_NetTransportWriteV
 //===========================================================================================================================
@@ -294,16 +378,14 @@ static OSStatus	_NetTransportWriteV( iovec_t **ioArray, int *ioCount, void *inCo
 {
 	NTContext * const			ctx = (NTContext *) inContext;
 	OSStatus					err;
-	size_t						len, totalLen, n;
-	const uint8_t *				ptr;
+	size_t						len, n;
 	uint8_t *					dst;
-	const uint8_t * const		lim = ctx->writeBuffer + 2 + kMaxMessageWriteSize;
+	const uint8_t * const		lim = ctx->writeBuffer + sizeof( ctx->writeBuffer );
 	iovec_t						iov[ 1 ];
 	int							ion;
 	iovec_t *					iop = *ioArray;
 	iovec_t * const				ioe = iop + *ioCount;
 	iovec_t *					iot;
-	uint8_t						authTag[ 16 ];
 	
 	for( ;; )
 	{
@@ -321,75 +403,341 @@ static OSStatus	_NetTransportWriteV( iovec_t **ioArray, int *ioCount, void *inCo
 			continue;
 		}
 		
-		// Count the number of bytes we can fit in our buffer.
+		// Encrypt as many messages as fit in the buffer so they can all be sent with one write. The caller's data is
+		// encrypted directly into the buffer so this is the only pass over it before it's sent.
 		
-		ptr = ctx->writeBuffer + 2;
-		totalLen = 0;
-		for( iot = iop; iot < ioe; ++iot )
+		dst = ctx->writeBuffer;
+		while( (size_t)( lim - dst ) >= ( kMaxMessageWriteSize + kMessageOverhead ) )
 		{
-			len = (size_t)( lim - ptr );
-			if( len < iot->iov_len )
-			{
-				totalLen += len;
-				break;
-			}
-			totalLen += iot->iov_len;
-			ptr += iot->iov_len;
+			err = _NetTransportEncryptMessage( ctx, &iop, ioe, dst, &n );
+			require_noerr( err, exit );
+			if( n == 0 ) break;
+			dst += n;
 		}
-		if( totalLen == 0 )
+		if( dst == ctx->writeBuffer )
 		{
 			err = kNoErr;
 			break;
 		}
-		
-		// Encrypt and authenticate the message.
-		
-		chacha20_poly1305_init_64x64( &ctx->writeCtx, ctx->writeKey, ctx->writeNonce );
-		
-		dst = ctx->writeBuffer;
-		WriteLittle16( dst, (uint16_t) totalLen );
-		chacha20_poly1305_add_aad( &ctx->writeCtx, dst, 2 );
-		dst += 2;
-		nt_post_write_dlog( kLogLevelMax, "-- Write header: %.3H\n", ctx->writeBuffer, 2, 2 );
-		
-		ptr = dst;
-		for( ; iop < ioe; ++iop )
+		ctx->writeBufferedPtr = ctx->writeBuffer;
+		ctx->writeBufferedEnd = dst;
+	}
+	
+exit:
+	*ioArray = iop;
+	*ioCount = (int)( ioe - iop );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_NetTransportEncryptMessage
+//
+//	Encrypts up to kMaxMessageWriteSize bytes from the iovecs into a message at inDst. Returns a size of 0 if there's no 
+//	more data.
+//===========================================================================================================================
+
+static OSStatus
+	_NetTransportEncryptMessage( 
+		NTContext *		ctx, 
+		iovec_t **		ioArray, 
+		iovec_t *		inEnd, 
+		uint8_t *		inDst, 
+		size_t *		outLen )
+{
+	const uint8_t * const		lim = inDst + 2 + kMaxMessageWriteSize;
+	OSStatus					err;
+	size_t						len, totalLen, n;
+	const uint8_t *				ptr;
+	uint8_t *					dst;
+	iovec_t *					iop = *ioArray;
+	iovec_t *					iot;
+	uint8_t						authTag[ 16 ];
+	
+	// Count the number of bytes we can fit in this message.
+	
+	ptr = inDst + 2;
+	totalLen = 0;
+	for( iot = iop; iot < inEnd; ++iot )
+	{
+		len = (size_t)( lim - ptr );
+		if( len < iot->iov_len )
+		{
+			totalLen += len;
+			break;
+		}
+		totalLen += iot->iov_len;
+		ptr += iot->iov_len;
+	}
+	require_action_quiet( totalLen > 0, exit, *outLen = 0; err = kNoErr );
+	
+	// Encrypt and authenticate the message.
+	
+	chacha20_poly1305_init_64x64( &ctx->writeCtx, ctx->writeKey, ctx->writeNonce );
+	
+	dst = inDst;
+	WriteLittle16( dst, (uint16_t) totalLen );
+	chacha20_poly1305_add_aad( &ctx->writeCtx, dst, 2 );
+	dst += 2;
+	nt_post_write_dlog( kLogLevelMax, "-- Write header: %.3H\n", inDst, 2, 2 );
+	
+	ptr = dst;
+	for( ; iop < inEnd; ++iop )
+	{
+		len = (size_t)( lim - ptr );
+		if( len < iop->iov_len )
 		{
-			len = (size_t)( lim - ptr );
-			if( len < iop->iov_len )
-			{
-				nt_pre_write_dlog( kLogLevelMax, "-- Pre-encrypt write body end:\n%1.1H\n", iop->iov_base, (int) len, 256 );
-				n = chacha20_poly1305_encrypt( &ctx->writeCtx, iop->iov_base, len, dst );
-				nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body end:\n%1.1H\n", dst, (int) n, 256 );
-				
-				iop->iov_base	 = ( (uint8_t *) iop->iov_base ) + len;
-				iop->iov_len	-= len;
-				dst				+= n;
-				break;
-			}
+			nt_pre_write_dlog( kLogLevelMax, "-- Pre-encrypt write body end:\n%1.1H\n", iop->iov_base, (int) len, 256 );
+			n = chacha20_poly1305_encrypt( &ctx->writeCtx, iop->iov_base, len, dst );
+			nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body end:\n%1.1H\n", dst, (int) n, 256 );
 			
-			nt_pre_write_dlog( kLogLevelMax, "-- Pre-encrypt write body:\n%1.1H\n", iop->iov_base, (int) iop->iov_len, 256 );
-			n = chacha20_poly1305_encrypt( &ctx->writeCtx, iop->iov_base, iop->iov_len, dst );
-			nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body:\n%1.1H\n", dst, (int) n, 256 );
-			ptr	+= iop->iov_len;
-			dst	+= n;
+			iop->iov_base	 = ( (uint8_t *) iop->iov_base ) + len;
+			iop->iov_len	-= len;
+			dst				+= n;
+			break;
 		}
-		n = chacha20_poly1305_final( &ctx->writeCtx, dst, authTag );
-		if( n > 0 ) nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body final:\n%1.1H\n", dst, (int) n, 256 );
-		dst += n;
-		require_action( dst == ( ctx->writeBuffer + 2 + totalLen ), exit, err = kInternalErr );
-		require_action( dst <= lim, exit, err = kInternalErr );
-		memcpy( dst, authTag, sizeof( authTag ) );
-		nt_post_write_dlog( kLogLevelMax, "-- Write auth tag: %.3H\n", dst, 16, 16 );
-		dst += sizeof( authTag );
-		LittleEndianIntegerIncrement( ctx->writeNonce, sizeof( ctx->writeNonce ) );
 		
-		ctx->writeBufferedPtr = ctx->writeBuffer;
-		ctx->writeBufferedEnd = dst;
+		nt_pre_write_dlog( kLogLevelMax, "-- Pre-encrypt write body:\n%1.1H\n", iop->iov_base, (int) iop->iov_len, 256 );
+		n = chacha20_poly1305_encrypt( &ctx->writeCtx, iop->iov_base, iop->iov_len, dst );
+		nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body:\n%1.1H\n", dst, (int) n, 256 );
+		ptr	+= iop->iov_len;
+		dst	+= n;
 	}
+	n = chacha20_poly1305_final( &ctx->writeCtx, dst, authTag );
+	if( n > 0 ) nt_post_write_dlog( kLogLevelMax, "-- Post-encrypt write body final:\n%1.1H\n", dst, (int) n, 256 );
+	dst += n;
+	require_action( dst == ( inDst + 2 + totalLen ), exit, err = kInternalErr );
+	require_action( dst <= lim, exit, err = kInternalErr );
+	memcpy( dst, authTag, sizeof( authTag ) );
+	nt_post_write_dlog( kLogLevelMax, "-- Write auth tag: %.3H\n", dst, 16, 16 );
+	dst += sizeof( authTag );
+	LittleEndianIntegerIncrement( ctx->writeNonce, sizeof( ctx->writeNonce ) );
+	*outLen = (size_t)( dst - inDst );
+	err = kNoErr;
 	
 exit:
 	*ioArray = iop;
-	*ioCount = (int)( ioe - iop );
 	return( err );
 }
+
+#if 0
+#pragma mark -
+#pragma mark == Debugging ==
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS && TARGET_OS_POSIX )
+//===========================================================================================================================
+//	NetTransportChaCha20Poly1305Test
+//
+//	Sends messages over a loopback socket pair with one transport writing on a thread and another reading. Messages are
+//	written as several iovecs and read with buffers smaller and larger than a message to cover in-place and buffered 
+//	reads. With inPerf, reports throughput and CPU time for message sizes from 64 bytes to 1 MB.
+//===========================================================================================================================
+
+#define kNTTestMaxMessageSize		( 1024 * 1024 )
+
+typedef struct
+{
+	NetTransportDelegate		delegate;
+	const uint8_t *				data;
+	size_t						messageSize;
+	size_t						messageCount;
+	OSStatus					err;
+	
+}	NTTestWriter;
+
+static void *		_NetTransportChaCha20Poly1305TestWriteThread( void *inArg );
+static OSStatus
+	_NetTransportChaCha20Poly1305TestOne( 
+		NetTransportDelegate *	inWriter, 
+		NetTransportDelegate *	inReader, 
+		const uint8_t *			inData, 
+		size_t					inMessageSize, 
+		size_t					inMessageCount, 
+		size_t					inReadSize, 
+		uint8_t *				inReadBuf, 
+		int						inPrint );
+
+OSStatus	NetTransportChaCha20Poly1305Test( int inPrint, int inPerf )
+{
+	static const size_t		kPerfSizes[] = { 64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024 };
+	static const size_t		kReadSizes[] = { 1, 100, 1000, 1024, 5000, 70000 };
+	OSStatus				err;
+	uint8_t					keyA[ 32 ], keyB[ 32 ];
+	SocketRef				socks[ 2 ] = { kInvalidSocketRef, kInvalidSocketRef };
+	NetTransportDelegate	writer, reader;
+	Boolean					writerValid = false, readerValid = false;
+	uint8_t *				data = NULL;
+	uint8_t *				readBuf = NULL;
+	size_t					i, size;
+	
+	NetTransportDelegateInit( &writer );
+	NetTransportDelegateInit( &reader );
+	RandomBytes( keyA, sizeof( keyA ) );
+	RandomBytes( keyB, sizeof( keyB ) );
+	
+	data = (uint8_t *) malloc( kNTTestMaxMessageSize );
+	require_action( data, exit, err = kNoMemoryErr );
+	for( i = 0; i < kNTTestMaxMessageSize; ++i ) data[ i ] = (uint8_t)( ( i * 7 ) + ( i >> 10 ) );
+	readBuf = (uint8_t *) malloc( kNTTestMaxMessageSize );
+	require_action( readBuf, exit, err = kNoMemoryErr );
+	
+	err = socketpair( AF_UNIX, SOCK_STREAM, 0, socks );
+	err = map_global_noerr_errno( err );
+	require_noerr( err, exit );
+	
+	err = NetTransportChaCha20Poly1305Configure( &writer, NULL, keyB, NULL, keyA, NULL );
+	require_noerr( err, exit );
+	writerValid = true;
+	err = writer.initialize_f( socks[ 0 ], writer.context );
+	require_noerr( err, exit );
+	
+	err = NetTransportChaCha20Poly1305Configure( &reader, NULL, keyA, NULL, keyB, NULL );
+	require_noerr( err, exit );
+	readerValid = true;
+	err = reader.initialize_f( socks[ 1 ], reader.context );
+	require_noerr( err, exit );
+	
+	// Odd message and read sizes so messages span reads and reads span messages.
+	
+	for( i = 0; i < countof( kReadSizes ); ++i )
+	{
+		err = _NetTransportChaCha20Poly1305TestOne( &writer, &reader, data, 3001, 20, kReadSizes[ i ], readBuf, 0 );
+		require_noerr( err, exit );
+	}
+	err = _NetTransportChaCha20Poly1305TestOne( &writer, &reader, data, 1, 500, 1, readBuf, 0 );
+	require_noerr( err, exit );
+	err = _NetTransportChaCha20Poly1305TestOne( &writer, &reader, data, kNTTestMaxMessageSize, 2, 
+		kNTTestMaxMessageSize, readBuf, 0 );
+	require_noerr( err, exit );
+	
+	if( inPerf )
+	{
+		for( i = 0; i < countof( kPerfSizes ); ++i )
+		{
+			size = kPerfSizes[ i ];
+			err = _NetTransportChaCha20Poly1305TestOne( &writer, &reader, data, size, ( 64 * 1024 * 1024 ) / size, size, 
+				readBuf, inPrint );
+			require_noerr( err, exit );
+		}
+	}
+	
+exit:
+	if( writerValid ) writer.finalize_f( writer.context );
+	if( readerValid ) reader.finalize_f( reader.context );
+	ForgetSocket( &socks[ 0 ] );
+	ForgetSocket( &socks[ 1 ] );
+	FreeNullSafe( data );
+	FreeNullSafe( readBuf );
+	printf( "NetTransportChaCha20Poly1305Test: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_NetTransportChaCha20Poly1305TestOne
+//===========================================================================================================================
+
+static OSStatus
+	_NetTransportChaCha20Poly1305TestOne( 
+		NetTransportDelegate *	inWriter, 
+		NetTransportDelegate *	inReader, 
+		const uint8_t *			inData, 
+		size_t					inMessageSize, 
+		size_t					inMessageCount, 
+		size_t					inReadSize, 
+		uint8_t *				inReadBuf, 
+		int						inPrint )
+{
+	OSStatus			err;
+	NTTestWriter		writer;
+	pthread_t			thread;
+	pthread_t *			threadPtr = NULL;
+	size_t				i, offset, len;
+	struct rusage		ru1, ru2;
+	uint64_t			ticks, cpuUs;
+	double				secs;
+	
+	writer.delegate		= *inWriter;
+	writer.data			= inData;
+	writer.messageSize	= inMessageSize;
+	writer.messageCount	= inMessageCount;
+	writer.err			= kNoErr;
+	
+	getrusage( RUSAGE_SELF, &ru1 );
+	ticks = UpTicks();
+	err = pthread_create( &thread, NULL, _NetTransportChaCha20Poly1305TestWriteThread, &writer );
+	require_noerr( err, exit );
+	threadPtr = &thread;
+	
+	for( i = 0; i < inMessageCount; ++i )
+	{
+		for( offset = 0; offset < inMessageSize; offset += len )
+		{
+			err = inReader->read_f( &inReadBuf[ offset ], Min( inReadSize, inMessageSize - offset ), &len, 
+				inReader->context );
+			if( err == EWOULDBLOCK ) err = kNoErr;
+			require_noerr( err, exit );
+		}
+		require_action( memcmp( inReadBuf, inData, inMessageSize ) == 0, exit, err = kMismatchErr );
+	}
+	pthread_join( thread, NULL );
+	threadPtr = NULL;
+	err = writer.err;
+	require_noerr( err, exit );
+	ticks = UpTicks() - ticks;
+	getrusage( RUSAGE_SELF, &ru2 );
+	
+	if( inPrint )
+	{
+		cpuUs  = ( ( (uint64_t) ru2.ru_utime.tv_sec * 1000000 ) + ru2.ru_utime.tv_usec ) -
+				 ( ( (uint64_t) ru1.ru_utime.tv_sec * 1000000 ) + ru1.ru_utime.tv_usec );
+		cpuUs += ( ( (uint64_t) ru2.ru_stime.tv_sec * 1000000 ) + ru2.ru_stime.tv_usec ) -
+				 ( ( (uint64_t) ru1.ru_stime.tv_sec * 1000000 ) + ru1.ru_stime.tv_usec );
+		secs = ( (double) ticks ) / UpTicksPerSecond();
+		fprintf( stderr, "\tNTCP loopback %7zu byte messages: %8.2f MB/sec, %6.2f ms CPU per MB\n", inMessageSize, 
+			( inMessageSize * inMessageCount ) / ( secs * 1048576.0 ), 
+			( cpuUs / 1000.0 ) / ( ( inMessageSize * inMessageCount ) / 1048576.0 ) );
+	}
+	
+exit:
+	if( threadPtr ) pthread_join( *threadPtr, NULL );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_NetTransportChaCha20Poly1305TestWriteThread
+//===========================================================================================================================
+
+static void *	_NetTransportChaCha20Poly1305TestWriteThread( void *inArg )
+{
+	NTTestWriter * const		writer = (NTTestWriter *) inArg;
+	OSStatus					err;
+	size_t						i, split;
+	iovec_t						iov[ 3 ];
+	iovec_t *					iop;
+	int							ion;
+	
+	for( i = 0; i < writer->messageCount; ++i )
+	{
+		// Split each message into a small header-like iovec, most of the body, and the rest like an HTTP message.
+		
+		split = Min( writer->messageSize, 17 );
+		SETIOV( &iov[ 0 ], (void *) writer->data, split );
+		SETIOV( &iov[ 1 ], (void *)( writer->data + split ), ( writer->messageSize - split ) / 2 );
+		SETIOV( &iov[ 2 ], (void *)( writer->data + split + iov[ 1 ].iov_len ), 
+			writer->messageSize - ( split + iov[ 1 ].iov_len ) );
+		iop = iov;
+		ion = 3;
+		do
+		{
+			err = writer->delegate.writev_f( &iop, &ion, writer->delegate.context );
+			
+		}	while( ( err == EWOULDBLOCK ) || ( !err && ( ion > 0 ) ) );
+		require_noerr( err, exit );
+	}
+	err = kNoErr;
+	
+exit:
+	writer->err = err;
+	return( NULL );
+}
+#endif // !EXCLUDE_UNIT_TESTS && TARGET_OS_POSIX
@@ -79,6 +79,14 @@ OSStatus
 		const uint8_t			inWriteKey[ 32 ], 
 		const uint8_t			inWriteNonce[ 8 ] );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	NetTransportChaCha20Poly1305Test
+	@abstract	Unit test. With inPerf, also reports loopback throughput and CPU time for a range of message sizes.
+*/
+#if( !EXCLUDE_UNIT_TESTS && TARGET_OS_POSIX )
+	OSStatus	NetTransportChaCha20Poly1305Test( int inPrint, int inPerf );
+#endif
+
 #ifdef __cplusplus
 }
 #endif
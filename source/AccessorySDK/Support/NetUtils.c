@@ -2394,6 +2394,187 @@ exit:
 }
 #endif
 
+//===========================================================================================================================
+//	SocketRecvPackets
+//===========================================================================================================================
+
+#if( NETUTILS_HAVE_RECVMMSG )
+OSStatus
+	SocketRecvPackets( 
+		SocketRef				inSock, 
+		SocketPacketBuffer *	inPackets, 
+		size_t					inMaxCount, 
+		size_t *				outCount, 
+		Boolean					inWantTicks )
+{
+	OSStatus				err;
+	struct mmsghdr			msgs[ kSocketRecvPacketsMaxCount ];
+	struct iovec			iovs[ kSocketRecvPacketsMaxCount ];
+	uint8_t					controlData[ kSocketRecvPacketsMaxCount ][ 64 ];
+	size_t					i;
+	int						n;
+	
+	if( inMaxCount > kSocketRecvPacketsMaxCount ) inMaxCount = kSocketRecvPacketsMaxCount;
+	require_action( inMaxCount > 0, exit, err = kCountErr );
+	
+	for( i = 0; i < inMaxCount; ++i )
+	{
+		iovs[ i ].iov_base					= inPackets[ i ].buf;
+		iovs[ i ].iov_len					= inPackets[ i ].maxLen;
+		msgs[ i ].msg_hdr.msg_name			= NULL;
+		msgs[ i ].msg_hdr.msg_namelen		= 0;
+		msgs[ i ].msg_hdr.msg_iov			= &iovs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen		= 1;
+		msgs[ i ].msg_hdr.msg_control		= inWantTicks ? controlData[ i ] : NULL;
+		msgs[ i ].msg_hdr.msg_controllen	= inWantTicks ? sizeof( controlData[ i ] ) : 0;
+		msgs[ i ].msg_hdr.msg_flags			= 0;
+		msgs[ i ].msg_len					= 0;
+	}
+	
+	// MSG_DONTWAIT makes the kernel return whatever is already queued instead of waiting to fill every slot.
+	
+	for( ;; )
+	{
+		n = recvmmsg( inSock, msgs, (unsigned int) inMaxCount, MSG_DONTWAIT, NULL );
+		err = map_socket_value_errno( inSock, n >= 0, n );
+		if( err == EINTR ) continue;
+		require_noerr_quiet( err, exit );
+		break;
+	}
+	
+	for( i = 0; i < (size_t) n; ++i )
+	{
+		inPackets[ i ].len		= msgs[ i ].msg_len;
+		inPackets[ i ].ticks	= inWantTicks ? SocketGetPacketUpTicks( &msgs[ i ].msg_hdr ) : 0;
+	}
+	*outCount = (size_t) n;
+	
+exit:
+	return( err );
+}
+#else
+OSStatus
+	SocketRecvPackets( 
+		SocketRef				inSock, 
+		SocketPacketBuffer *	inPackets, 
+		size_t					inMaxCount, 
+		size_t *				outCount, 
+		Boolean					inWantTicks )
+{
+	OSStatus		err;
+	size_t			i;
+	
+	if( inMaxCount > kSocketRecvPacketsMaxCount ) inMaxCount = kSocketRecvPacketsMaxCount;
+	require_action( inMaxCount > 0, exit, err = kCountErr );
+	
+	for( i = 0; i < inMaxCount; ++i )
+	{
+		inPackets[ i ].ticks = 0;
+		err = SocketRecvFrom( inSock, inPackets[ i ].buf, inPackets[ i ].maxLen, &inPackets[ i ].len, NULL, 0, NULL, 
+			inWantTicks ? &inPackets[ i ].ticks : NULL, NULL, NULL );
+		if( err ) break;
+	}
+	require_quiet( i > 0, exit );
+	*outCount = i;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+#endif
+
+//===========================================================================================================================
+//	SocketSendPackets
+//===========================================================================================================================
+
+#if( NETUTILS_HAVE_SENDMMSG )
+OSStatus
+	SocketSendPackets( 
+		SocketRef					inSock, 
+		const SocketPacketBuffer *	inPackets, 
+		size_t						inCount, 
+		const void *				inTo, 
+		socklen_t					inToLen, 
+		size_t *					outCount, 
+		size_t *					outCalls )
+{
+	OSStatus				err;
+	struct mmsghdr			msgs[ kSocketSendPacketsMaxCount ];
+	struct iovec			iovs[ kSocketSendPacketsMaxCount ];
+	size_t					sent, calls, i, n;
+	int						result;
+	
+	sent  = 0;
+	calls = 0;
+	err   = kNoErr;
+	while( sent < inCount )
+	{
+		n = Min( inCount - sent, kSocketSendPacketsMaxCount );
+		for( i = 0; i < n; ++i )
+		{
+			iovs[ i ].iov_base					= inPackets[ sent + i ].buf;
+			iovs[ i ].iov_len					= inPackets[ sent + i ].len;
+			msgs[ i ].msg_hdr.msg_name			= (void *) inTo;
+			msgs[ i ].msg_hdr.msg_namelen		= inTo ? inToLen : 0;
+			msgs[ i ].msg_hdr.msg_iov			= &iovs[ i ];
+			msgs[ i ].msg_hdr.msg_iovlen		= 1;
+			msgs[ i ].msg_hdr.msg_control		= NULL;
+			msgs[ i ].msg_hdr.msg_controllen	= 0;
+			msgs[ i ].msg_hdr.msg_flags			= 0;
+			msgs[ i ].msg_len					= 0;
+		}
+		
+		// sendmmsg returns how many were sent. If that's short of what was asked for, the next call reports the error.
+		
+		result = sendmmsg( inSock, msgs, (unsigned int) n, 0 );
+		++calls;
+		err = map_socket_value_errno( inSock, result > 0, result );
+		if( err == EINTR ) continue;
+		require_noerr_quiet( err, exit );
+		sent += (size_t) result;
+	}
+	
+exit:
+	if( outCount ) *outCount = sent;
+	if( outCalls ) *outCalls = calls;
+	return( err );
+}
+#else
+OSStatus
+	SocketSendPackets( 
+		SocketRef					inSock, 
+		const SocketPacketBuffer *	inPackets, 
+		size_t						inCount, 
+		const void *				inTo, 
+		socklen_t					inToLen, 
+		size_t *					outCount, 
+		size_t *					outCalls )
+{
+	OSStatus		err;
+	size_t			sent, calls;
+	ssize_t			n;
+	
+	calls = 0;
+	err   = kNoErr;
+	for( sent = 0; sent < inCount; )
+	{
+		if( inTo )	n = sendto( inSock, (const char *) inPackets[ sent ].buf, inPackets[ sent ].len, 0, 
+						(const struct sockaddr *) inTo, inToLen );
+		else		n = send( inSock, (const char *) inPackets[ sent ].buf, inPackets[ sent ].len, 0 );
+		++calls;
+		err = map_socket_value_errno( inSock, n == (ssize_t) inPackets[ sent ].len, n );
+		if( err == EINTR ) continue;
+		require_noerr_quiet( err, exit );
+		++sent;
+	}
+	
+exit:
+	if( outCount ) *outCount = sent;
+	if( outCalls ) *outCalls = calls;
+	return( err );
+}
+#endif
+
 //===========================================================================================================================
 //	SocketReadData
 //===========================================================================================================================
@@ -4310,6 +4491,202 @@ exit:
 	return( err );
 }
 
+//===========================================================================================================================
+//	SocketRecvPacketsTest
+//===========================================================================================================================
+
+#define kSocketRecvPacketsTestPacketSize		1436	// RTP header + 352 frames of 16-bit stereo + nonce/auth tag.
+#define kSocketRecvPacketsTestPacketsPerSec		125		// ~44100 Hz / 352 frames per packet.
+
+static OSStatus	_SocketRecvPacketsTestPerfOne( SocketRef inSock, Boolean inBatched, int inBurst, int inAudioSecs );
+
+OSStatus	SocketRecvPacketsTest( int inPrint, int inPerf )
+{
+	OSStatus				err;
+	SocketRef				sock = kInvalidSocketRef;
+	SocketPacketBuffer		pkts[ kSocketRecvPacketsMaxCount ];
+	uint8_t					bufs[ kSocketRecvPacketsMaxCount ][ 64 ];
+	uint8_t					msg[ 64 ];
+	size_t					i, n, total, calls;
+	int						burst;
+	
+	err = OpenSelfConnectedLoopbackSocket( &sock );
+	require_noerr( err, exit );
+	err = SocketMakeNonBlocking( sock );
+	require_noerr( err, exit );
+	err = SocketSetPacketTimestamps( sock, true );
+	require_noerr( err, exit );
+	
+	for( i = 0; i < countof( pkts ); ++i )
+	{
+		pkts[ i ].buf		= bufs[ i ];
+		pkts[ i ].maxLen	= sizeof( bufs[ i ] );
+	}
+	
+	// Nothing pending should return EWOULDBLOCK immediately.
+	
+	err = SocketRecvPackets( sock, pkts, countof( pkts ), &n, true );
+	require_action( err == EWOULDBLOCK, exit, err = kResponseErr );
+	
+	// Queue more packets than fit in a single batch and make sure they all come back, in order, with timestamps.
+	
+	for( i = 0; i < 40; ++i )
+	{
+		memset( msg, (int) i, sizeof( msg ) );
+		err = SendSelfConnectedLoopbackMessage( sock, msg, 10 + i );
+		require_noerr( err, exit );
+	}
+	for( total = 0; total < 40; )
+	{
+		err = SocketRecvPackets( sock, pkts, countof( pkts ), &n, true );
+		require_noerr( err, exit );
+		require_action( ( n > 0 ) && ( n <= countof( pkts ) ), exit, err = kCountErr );
+		if( inPrint ) fprintf( stderr, "\tSocketRecvPackets: %zu packet(s) in one call\n", n );
+		for( i = 0; i < n; ++i, ++total )
+		{
+			require_action( pkts[ i ].len == ( 10 + total ), exit, err = kSizeErr );
+			require_action( bufs[ i ][ 0 ] == (uint8_t) total, exit, err = kMismatchErr );
+			require_action( pkts[ i ].ticks != 0, exit, err = kTimeoutErr );
+		}
+	}
+	require_action( total == 40, exit, err = kCountErr );
+	err = SocketRecvPackets( sock, pkts, countof( pkts ), &n, true );
+	require_action( err == EWOULDBLOCK, exit, err = kResponseErr );
+	
+	// Send a full batch with SocketSendPackets and make sure it all comes back in order.
+	
+	for( i = 0; i < countof( pkts ); ++i )
+	{
+		memset( bufs[ i ], (int)( 100 + i ), sizeof( bufs[ i ] ) );
+		pkts[ i ].len = 10 + i;
+	}
+	err = SocketSendPackets( sock, pkts, countof( pkts ), NULL, 0, &n, &calls );
+	require_noerr( err, exit );
+	require_action( n == countof( pkts ), exit, err = kCountErr );
+	if( inPrint ) fprintf( stderr, "\tSocketSendPackets: %zu packet(s) in %zu call(s)\n", n, calls );
+	memset( bufs, 0, sizeof( bufs ) );
+	for( total = 0; total < countof( pkts ); )
+	{
+		err = SocketRecvPackets( sock, &pkts[ total ], countof( pkts ) - total, &n, false );
+		require_noerr( err, exit );
+		for( i = total; i < ( total + n ); ++i )
+		{
+			require_action( pkts[ i ].len == ( 10 + i ), exit, err = kSizeErr );
+			require_action( bufs[ i ][ 0 ] == (uint8_t)( 100 + i ), exit, err = kMismatchErr );
+		}
+		total += n;
+	}
+	
+	// Compare a read per packet (the old audio thread loop) against batched reads for different burst sizes.
+	
+	if( inPerf )
+	{
+		for( burst = 1; burst <= 16; burst *= 4 )
+		{
+			err = _SocketRecvPacketsTestPerfOne( sock, false, burst, 60 );
+			require_noerr( err, exit );
+			err = _SocketRecvPacketsTestPerfOne( sock, true, burst, 60 );
+			require_noerr( err, exit );
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	ForgetSocket( &sock );
+	printf( "SocketRecvPacketsTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_SocketRecvPacketsTestPerfOne
+//===========================================================================================================================
+
+static uint64_t	_SocketRecvPacketsTestThreadCPUNanos( void )
+{
+#if( TARGET_OS_POSIX )
+	struct timespec		ts;
+	
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+	return( ( ( (uint64_t) ts.tv_sec ) * kNanosecondsPerSecond ) + ( (uint64_t) ts.tv_nsec ) );
+#else
+	return( UpNanoseconds() ); // Wall time is the best we can do without per-thread CPU clocks.
+#endif
+}
+
+static OSStatus	_SocketRecvPacketsTestPerfOne( SocketRef inSock, Boolean inBatched, int inBurst, int inAudioSecs )
+{
+	OSStatus				err;
+	uint8_t *				bufs;
+	SocketPacketBuffer		pkts[ kSocketRecvPacketsMaxCount ];
+	fd_set					readSet;
+	struct timeval			timeout;
+	const int				packetCount = inAudioSecs * kSocketRecvPacketsTestPacketsPerSec;
+	int						sent, pending, i;
+	size_t					n;
+	ssize_t					sn;
+	uint64_t				syscalls = 0;
+	uint64_t				cpuNanos = 0;
+	uint64_t				nanos;
+	
+	bufs = (uint8_t *) calloc( countof( pkts ), kSocketRecvPacketsTestPacketSize );
+	require_action( bufs, exit, err = kNoMemoryErr );
+	for( i = 0; i < (int) countof( pkts ); ++i )
+	{
+		pkts[ i ].buf		= &bufs[ i * kSocketRecvPacketsTestPacketSize ];
+		pkts[ i ].maxLen	= kSocketRecvPacketsTestPacketSize;
+	}
+	
+	FD_ZERO( &readSet );
+	for( sent = 0; sent < packetCount; )
+	{
+		// Queue a burst, like a Wi-Fi aggregate or a scheduling hiccup would deliver.
+		
+		for( pending = 0; ( pending < inBurst ) && ( sent < packetCount ); ++pending, ++sent )
+		{
+			sn = send( inSock, (char *) bufs, kSocketRecvPacketsTestPacketSize, 0 );
+			err = map_socket_value_errno( inSock, sn == kSocketRecvPacketsTestPacketSize, sn );
+			require_noerr( err, exit );
+		}
+		
+		// Drain it the way the audio receive threads do: wait for the socket to be readable then read.
+		
+		nanos = _SocketRecvPacketsTestThreadCPUNanos();
+		while( pending > 0 )
+		{
+			FD_SET( inSock, &readSet );
+			timeout.tv_sec  = 1;
+			timeout.tv_usec = 0;
+			i = select( inSock + 1, &readSet, NULL, NULL, &timeout );
+			++syscalls;
+			require_action( i > 0, exit, err = kTimeoutErr );
+			
+			if( inBatched )
+			{
+				err = SocketRecvPackets( inSock, pkts, countof( pkts ), &n, false );
+				require_noerr( err, exit );
+				pending -= (int) n;
+			}
+			else
+			{
+				err = SocketRecvFrom( inSock, pkts[ 0 ].buf, pkts[ 0 ].maxLen, &n, NULL, 0, NULL, NULL, NULL, NULL );
+				require_noerr( err, exit );
+				pending -= 1;
+			}
+			++syscalls;
+		}
+		cpuNanos += _SocketRecvPacketsTestThreadCPUNanos() - nanos;
+	}
+	
+	fprintf( stderr, "\t%-7s receive, burst %2d: %.2f syscalls/packet, %llu µs CPU per second of audio\n", 
+		inBatched ? "batched" : "single", inBurst, ( (double) syscalls ) / packetCount, 
+		(unsigned long long)( cpuNanos / ( 1000 * (uint64_t) inAudioSecs ) ) );
+	err = kNoErr;
+	
+exit:
+	FreeNullSafe( bufs );
+	return( err );
+}
+
 //===========================================================================================================================
 //	NetUtilsTest
 //===========================================================================================================================
@@ -79,6 +79,22 @@
 	#endif
 #endif
 
+#if( !defined( NETUTILS_HAVE_RECVMMSG ) )
+	#if( TARGET_OS_LINUX )
+		#define NETUTILS_HAVE_RECVMMSG		1
+	#else
+		#define NETUTILS_HAVE_RECVMMSG		0
+	#endif
+#endif
+
+#if( !defined( NETUTILS_HAVE_SENDMMSG ) )
+	#if( TARGET_OS_LINUX )
+		#define NETUTILS_HAVE_SENDMMSG		1
+	#else
+		#define NETUTILS_HAVE_SENDMMSG		0
+	#endif
+#endif
+
 // Includes
 
 #if( TARGET_OS_BSD )
@@ -508,6 +524,56 @@ OSStatus
 		uint32_t *			outIfIndex, 	// May be NULL.
 		char *				outIfName );	// May be NULL.
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	SocketRecvPackets
+	@abstract	Receives all pending UDP packets (up to a max) using as few system calls as possible.
+	@discussion
+	
+	Uses recvmmsg() where available so a burst of packets can be drained with a single system call. Otherwise, it falls 
+	back to calling SocketRecvFrom for each packet, which requires the socket to be non-blocking. Returns EWOULDBLOCK if 
+	no packets were pending. To get receive ticks, you must call SocketSetPacketTimestamps when the socket is created.
+*/
+#define kSocketRecvPacketsMaxCount		32 // Max packets returned by a single call.
+
+typedef struct
+{
+	void *			buf;	// [in]  Buffer to receive the packet into (or to send from for SocketSendPackets).
+	size_t			maxLen;	// [in]  Max number of bytes "buf" can hold. Not used by SocketSendPackets.
+	size_t			len;	// [out] Number of bytes received. [in] for SocketSendPackets: number of bytes to send.
+	uint64_t		ticks;	// [out] UpTicks when the packet was received by the kernel. 0 if ticks weren't requested.
+	
+}	SocketPacketBuffer;
+
+OSStatus
+	SocketRecvPackets( 
+		SocketRef				inSock, 
+		SocketPacketBuffer *	inPackets, 
+		size_t					inMaxCount, 
+		size_t *				outCount, 
+		Boolean					inWantTicks );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	SocketSendPackets
+	@abstract	Sends UDP packets to a single destination using as few system calls as possible.
+	@discussion
+	
+	Uses sendmmsg() where available so a burst of packets can be sent with a single system call. Otherwise, it falls back 
+	to calling sendto() for each packet. If inTo is NULL, the socket must be connected. Stops at the first error and 
+	returns it. outCount receives the number of packets sent before the error (all of them if no error). outCalls, if 
+	non-NULL, receives the number of system calls it took.
+*/
+#define kSocketSendPacketsMaxCount		32 // Max packets sent by a single system call.
+
+OSStatus
+	SocketSendPackets( 
+		SocketRef					inSock, 
+		const SocketPacketBuffer *	inPackets, 
+		size_t						inCount, 
+		const void *				inTo, 
+		socklen_t					inToLen, 
+		size_t *					outCount, 
+		size_t *					outCalls );
+
 //---------------------------------------------------------------------------------------------------------------------------
 /*!	@function	SocketReadData
 	@abstract	Reads data into the specified buffer in a non-blocking manner.
@@ -915,6 +981,15 @@ OSStatus	GetInterfaceMACAddress( const char *inInterfaceName, uint8_t *outMACAdd
 OSStatus	SocketUtilsTest( void );
 #endif
 
+#if( !EXCLUDE_UNIT_TESTS )
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	SocketRecvPacketsTest
+	@abstract	Unit test for SocketRecvPackets and SocketSendPackets. If inPerf is non-zero, also compares per-packet and 
+				batched receives over loopback.
+*/
+OSStatus	SocketRecvPacketsTest( int inPrint, int inPerf );
+#endif
+
 //---------------------------------------------------------------------------------------------------------------------------
 /*!	@function	NetUtilsTest
 	@abstract	Unit test.
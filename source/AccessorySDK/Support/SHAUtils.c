@@ -61,6 +61,126 @@
 
 #include "CommonServices.h"
 #include "DebugServices.h"
+#include "TickUtils.h"
+
+//===========================================================================================================================
+//	Acceleration
+//
+//	Blocks are compressed with the fastest code the CPU supports. The choice is made at runtime the first time it's 
+//	needed so the same binary runs on CPUs with and without the optional instructions:
+//
+//	Hardware:	SHA instructions do the whole block. SHA-1 uses the x86 SHA extensions or ARMv8 crypto extensions and
+//				SHA-512 uses the ARMv8.2 SHA-512 instructions.
+//	SIMD:		The message schedule is expanded with NEON or SSE2 vectors and the rounds are done with scalar code.
+//	Scalar:		Portable C.
+//===========================================================================================================================
+
+#if( TARGET_HAS_NEON || defined( __aarch64__ ) || ( TARGET_HAS_SSE >= SSE_VERSION( 2, 0 ) ) )
+	#define SHA_SIMD		1
+#else
+	#define SHA_SIMD		0
+#endif
+
+// SHA1_HARDWARE_TARGET and SHA512_HARDWARE_TARGET enable the instructions for just the functions that use them when the 
+// rest of the file isn't built for them.
+
+#if( ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( ( COMPILER_GCC >= 50000 ) || ( COMPILER_CLANG >= 30800 ) ) )
+	#define SHA1_SHANI					1
+	#define SHA1_HARDWARE_TARGET		__attribute__( ( target( "sha,ssse3,sse4.1" ) ) )
+#else
+	#define SHA1_SHANI					0
+#endif
+
+// SHAUTILS_ARMV8_ENABLED -- Opts in to the ARMv8 SHA-1 and SHA-512 instruction code. It's off by default until it has
+// been built and has passed the SHA test vectors on ARM. AArch64 builds use the SIMD schedule code until then.
+
+#if( !defined( SHAUTILS_ARMV8_ENABLED ) )
+	#define SHAUTILS_ARMV8_ENABLED		0
+#endif
+
+#if( !SHAUTILS_ARMV8_ENABLED )
+	#define SHA1_ARMV8					0
+#elif( defined( __aarch64__ ) && ( defined( __ARM_FEATURE_CRYPTO ) || defined( __ARM_FEATURE_SHA2 ) ) )
+	#define SHA1_ARMV8					1
+	#define SHA1_HARDWARE_TARGET
+#elif( defined( __aarch64__ ) && ( COMPILER_GCC >= 60000 ) && !COMPILER_CLANG )
+	#define SHA1_ARMV8					1
+	#define SHA1_HARDWARE_TARGET		__attribute__( ( target( "+crypto" ) ) )
+#else
+	#define SHA1_ARMV8					0
+#endif
+
+#if( !SHAUTILS_ARMV8_ENABLED )
+	#define SHA512_ARMV8				0
+#elif( defined( __aarch64__ ) && defined( __ARM_FEATURE_SHA512 ) )
+	#define SHA512_ARMV8				1
+	#define SHA512_HARDWARE_TARGET
+#elif( defined( __aarch64__ ) && ( COMPILER_GCC >= 80000 ) && !COMPILER_CLANG )
+	#define SHA512_ARMV8				1
+	#define SHA512_HARDWARE_TARGET		__attribute__( ( target( "+sha3" ) ) )
+#else
+	#define SHA512_ARMV8				0
+#endif
+
+#define SHA1_HARDWARE		( SHA1_SHANI || SHA1_ARMV8 )
+#define SHA512_HARDWARE		( SHA512_ARMV8 )
+
+// The vector SHA-512 schedule is slower than scalar code where 64-bit scalar math is cheap (e.g. SSE2 has no 64-bit 
+// rotate) so it's only used by default on 32-bit ARM where each 64-bit rotate takes several instructions.
+
+#if( SHA_SIMD && TARGET_HAS_NEON && !defined( __aarch64__ ) )
+	#define SHA512_SIMD_PREFERRED		1
+#else
+	#define SHA512_SIMD_PREFERRED		0
+#endif
+
+#if( SHA1_SHANI )
+	#include <cpuid.h>
+	#include <immintrin.h>
+#endif
+#if( SHA1_ARMV8 || SHA512_ARMV8 )
+	#include <arm_neon.h>
+	#if( TARGET_OS_LINUX )
+		#include <sys/auxv.h>
+		
+		#if( !defined( HWCAP_SHA1 ) )
+			#define HWCAP_SHA1			( 1 << 5 )
+		#endif
+		#if( !defined( HWCAP_SHA512 ) )
+			#define HWCAP_SHA512		( 1 << 21 )
+		#endif
+	#endif
+#endif
+
+typedef enum
+{
+	kSHAImpl_Unknown	= 0, // Not selected yet.
+	kSHAImpl_Scalar		= 1, // Portable C.
+	kSHAImpl_SIMD		= 2, // Vector message schedule with scalar rounds.
+	kSHAImpl_Hardware	= 3  // SHA instructions.
+	
+}	SHAImpl;
+
+static SHAImpl		gSHA1Impl	= kSHAImpl_Unknown;
+static SHAImpl		gSHA512Impl	= kSHAImpl_Unknown;
+
+#if( SHA_SIMD )
+	typedef uint32_t		sha_u32x4 __attribute__( ( vector_size( 16 ) ) );
+	typedef uint64_t		sha_u64x2 __attribute__( ( vector_size( 16 ) ) );
+	
+	// Vectors are loaded and stored with memcpy because the input and the schedule may not be aligned.
+	
+	#define SHA_VEC_LOAD( VEC, PTR )		memcpy( &(VEC), (PTR), sizeof( VEC ) )
+	#define SHA_VEC_STORE( PTR, VEC )		memcpy( (PTR), &(VEC), sizeof( VEC ) )
+	
+	// SHA_VEC_SHUFFLE picks lanes from the concatenation of A and B (B's lanes are numbered after A's).
+	
+	#if( COMPILER_CLANG )
+		#define SHA_VEC_SHUFFLE( TYPE, A, B, ... )		__builtin_shufflevector( (A), (B), __VA_ARGS__ )
+	#else
+		#define SHA_VEC_SHUFFLE( TYPE, A, B, ... )		__builtin_shuffle( (A), (B), (TYPE){ __VA_ARGS__ } )
+	#endif
+#endif
 
 //===========================================================================================================================
 //	SHA-1 internals
@@ -70,7 +190,17 @@
 
 #define SHA1_BLOCK_SIZE		64
 
-static void	_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr );
+static void		_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr, size_t inCount );
+static SHAImpl	_SHA1_ImplBest( void );
+static Boolean	_SHA1_ImplSupported( SHAImpl inImpl );
+static void		_SHA1_CompressScalar( uint32_t ioState[ 5 ], const uint8_t *inPtr );
+#if( SHA_SIMD )
+static void		_SHA1_CompressSIMD( uint32_t ioState[ 5 ], const uint8_t *inPtr );
+#endif
+#if( SHA1_HARDWARE )
+SHA1_HARDWARE_TARGET
+static void		_SHA1_CompressHardware( uint32_t ioState[ 5 ], const uint8_t *inPtr, size_t inCount );
+#endif
 
 //===========================================================================================================================
 //	SHA1_Init_compat
@@ -101,10 +231,12 @@ int	SHA1_Update_compat( SHA_CTX_compat *ctx, const void *inData, size_t inLen )
 	{
 		if( ( ctx->curlen == 0 ) && ( inLen >= SHA1_BLOCK_SIZE ) )
 		{
-			_SHA1_Compress( ctx, src );
-			ctx->length += ( SHA1_BLOCK_SIZE * 8 );
-			src			+= SHA1_BLOCK_SIZE;
-			inLen		-= SHA1_BLOCK_SIZE;
+			n = inLen / SHA1_BLOCK_SIZE;
+			_SHA1_Compress( ctx, src, n );
+			n *= SHA1_BLOCK_SIZE;
+			ctx->length += ( n * 8 );
+			src			+= n;
+			inLen		-= n;
 		}
 		else
 		{
@@ -115,7 +247,7 @@ int	SHA1_Update_compat( SHA_CTX_compat *ctx, const void *inData, size_t inLen )
 			inLen		-= n;
 			if( ctx->curlen == SHA1_BLOCK_SIZE )
 			{
-				_SHA1_Compress( ctx, ctx->buf );
+				_SHA1_Compress( ctx, ctx->buf, 1 );
 				ctx->length += ( SHA1_BLOCK_SIZE * 8 );
 				ctx->curlen = 0;
 			}
@@ -139,7 +271,7 @@ int	SHA1_Final_compat( unsigned char *outDigest, SHA_CTX_compat *ctx )
 	if( ctx->curlen > 56 )
 	{
 		while( ctx->curlen < 64 ) ctx->buf[ ctx->curlen++ ] = 0;
-		_SHA1_Compress( ctx, ctx->buf );
+		_SHA1_Compress( ctx, ctx->buf, 1 );
 		ctx->curlen = 0;
 	}
 
@@ -148,7 +280,7 @@ int	SHA1_Final_compat( unsigned char *outDigest, SHA_CTX_compat *ctx )
 	
 	// Store length.
 	WriteBig64( ctx->buf + 56, ctx->length );
-	_SHA1_Compress( ctx, ctx->buf );
+	_SHA1_Compress( ctx, ctx->buf, 1 );
 
 	// Copy output.
 	for( i = 0; i < 5; ++i )
@@ -177,6 +309,94 @@ unsigned char *	SHA1_compat( const void *inData, size_t inLen, unsigned char *ou
 //	_SHA1_Compress
 //===========================================================================================================================
 
+static void	_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr, size_t inCount )
+{
+	SHAImpl		impl;
+	
+	impl = gSHA1Impl;
+	if( impl == kSHAImpl_Unknown )
+	{
+		impl = _SHA1_ImplBest();
+		gSHA1Impl = impl;
+	}
+	switch( impl )
+	{
+	#if( SHA1_HARDWARE )
+		case kSHAImpl_Hardware:
+			_SHA1_CompressHardware( ctx->state, inPtr, inCount );
+			break;
+	#endif
+		
+	#if( SHA_SIMD )
+		case kSHAImpl_SIMD:
+			for( ; inCount > 0; --inCount, inPtr += SHA1_BLOCK_SIZE ) _SHA1_CompressSIMD( ctx->state, inPtr );
+			break;
+	#endif
+		
+		default:
+			for( ; inCount > 0; --inCount, inPtr += SHA1_BLOCK_SIZE ) _SHA1_CompressScalar( ctx->state, inPtr );
+			break;
+	}
+}
+
+//===========================================================================================================================
+//	_SHA1_ImplBest
+//===========================================================================================================================
+
+static SHAImpl	_SHA1_ImplBest( void )
+{
+	if( _SHA1_ImplSupported( kSHAImpl_Hardware ) )	return( kSHAImpl_Hardware );
+	if( _SHA1_ImplSupported( kSHAImpl_SIMD ) )		return( kSHAImpl_SIMD );
+	return( kSHAImpl_Scalar );
+}
+
+//===========================================================================================================================
+//	_SHA1_ImplSupported
+//===========================================================================================================================
+
+static Boolean	_SHA1_ImplSupported( SHAImpl inImpl )
+{
+	switch( inImpl )
+	{
+		case kSHAImpl_Scalar:
+			return( true );
+		
+	#if( SHA_SIMD )
+		case kSHAImpl_SIMD:
+			return( true );
+	#endif
+		
+	#if( SHA1_SHANI )
+		case kSHAImpl_Hardware:
+		{
+			unsigned int		a, b, c, d;
+			
+			if( __get_cpuid_max( 0, NULL ) < 7 ) return( false );
+			__cpuid( 1, a, b, c, d );
+			if( !( c & bit_SSSE3 ) || !( c & bit_SSE4_1 ) ) return( false );
+			__cpuid_count( 7, 0, a, b, c, d );
+			return( ( b & ( 1 << 29 ) ) ? true : false ); // CPUID.(EAX=7,ECX=0):EBX.SHA[bit 29]
+		}
+	#elif( SHA1_ARMV8 )
+		case kSHAImpl_Hardware:
+		#if( defined( __ARM_FEATURE_CRYPTO ) || defined( __ARM_FEATURE_SHA2 ) )
+			return( true );
+		#elif( TARGET_OS_LINUX )
+			return( ( getauxval( AT_HWCAP ) & HWCAP_SHA1 ) ? true : false );
+		#else
+			return( false );
+		#endif
+	#endif
+		
+		default:
+			return( false );
+	}
+}
+
+//===========================================================================================================================
+//	_SHA1_CompressScalar
+//===========================================================================================================================
+
 #define SHA1_F0( x, y, z )				(z ^ ( x & ( y ^ z ) ) )
 #define SHA1_F1( x, y, z )				(x ^ y ^ z )
 #define SHA1_F2( x, y, z )				( ( x & y ) | ( z & ( x | y ) ) )
@@ -186,7 +406,7 @@ unsigned char *	SHA1_compat( const void *inData, size_t inLen, unsigned char *ou
 #define SHA1_FF2( a, b, c, d, e, i )	e = ( ROTL32( a, 5 ) + SHA1_F2( b, c, d ) + e + W[ i ] + UINT32_C( 0x8f1bbcdc ) ); b = ROTL32( b, 30);
 #define SHA1_FF3( a, b, c, d, e, i )	e = ( ROTL32( a, 5 ) + SHA1_F3( b, c, d ) + e + W[ i ] + UINT32_C( 0xca62c1d6 ) ); b = ROTL32( b, 30);
 
-static void	_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr )
+static void	_SHA1_CompressScalar( uint32_t ioState[ 5 ], const uint8_t *inPtr )
 {
 	uint32_t		a, b, c, d, e, W[ 80 ], i, tmp;
 	
@@ -198,11 +418,11 @@ static void	_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr )
 	}
 	
 	// Copy state
-	a = ctx->state[ 0 ];
-	b = ctx->state[ 1 ];
-	c = ctx->state[ 2 ];
-	d = ctx->state[ 3 ];
-	e = ctx->state[ 4 ];
+	a = ioState[ 0 ];
+	b = ioState[ 1 ];
+	c = ioState[ 2 ];
+	d = ioState[ 3 ];
+	e = ioState[ 4 ];
 	
 	// Expand it
 	for( i = 16; i < 80; ++i )
@@ -253,12 +473,272 @@ static void	_SHA1_Compress( SHA_CTX_compat *ctx, const uint8_t *inPtr )
 	}
 	
 	// Store
-	ctx->state[ 0 ] = ctx->state[ 0 ] + a;
-	ctx->state[ 1 ] = ctx->state[ 1 ] + b;
-	ctx->state[ 2 ] = ctx->state[ 2 ] + c;
-	ctx->state[ 3 ] = ctx->state[ 3 ] + d;
-	ctx->state[ 4 ] = ctx->state[ 4 ] + e;
+	ioState[ 0 ] = ioState[ 0 ] + a;
+	ioState[ 1 ] = ioState[ 1 ] + b;
+	ioState[ 2 ] = ioState[ 2 ] + c;
+	ioState[ 3 ] = ioState[ 3 ] + d;
+	ioState[ 4 ] = ioState[ 4 ] + e;
+}
+
+#if( SHA_SIMD )
+//===========================================================================================================================
+//	_SHA1_CompressSIMD
+//
+//	The schedule is expanded 4 words at a time with the last 16 words kept in vectors. W[i+3] depends on W[i] so it's 
+//	computed as if W[i] were 0 and then fixed up. The round constants are added to the schedule with vectors too.
+//===========================================================================================================================
+
+#define SHA1_GG( F, a, b, c, d, e, i )	e = ( ROTL32( a, 5 ) + F( b, c, d ) + e + W[ i ] ); b = ROTL32( b, 30 );
+
+static void	_SHA1_CompressSIMD( uint32_t ioState[ 5 ], const uint8_t *inPtr )
+{
+	static const sha_u32x4		kK[ 4 ] =
+	{
+		{ UINT32_C( 0x5a827999 ), UINT32_C( 0x5a827999 ), UINT32_C( 0x5a827999 ), UINT32_C( 0x5a827999 ) }, 
+		{ UINT32_C( 0x6ed9eba1 ), UINT32_C( 0x6ed9eba1 ), UINT32_C( 0x6ed9eba1 ), UINT32_C( 0x6ed9eba1 ) }, 
+		{ UINT32_C( 0x8f1bbcdc ), UINT32_C( 0x8f1bbcdc ), UINT32_C( 0x8f1bbcdc ), UINT32_C( 0x8f1bbcdc ) }, 
+		{ UINT32_C( 0xca62c1d6 ), UINT32_C( 0xca62c1d6 ), UINT32_C( 0xca62c1d6 ), UINT32_C( 0xca62c1d6 ) }
+	};
+	sha_u32x4 const		zero	= { 0, 0, 0, 0 };
+	sha_u32x4 const		mask	= { UINT32_C( 0x00ff00ff ), UINT32_C( 0x00ff00ff ), UINT32_C( 0x00ff00ff ), UINT32_C( 0x00ff00ff ) };
+	uint32_t			a, b, c, d, e, W[ 80 ], i;
+	sha_u32x4			w[ 4 ], t, v;
+	
+	for( i = 0; i < 4; ++i )
+	{
+		SHA_VEC_LOAD( v, inPtr + ( i * 16 ) );
+		v = ( ( v & mask ) << 8 ) | ( ( v >> 8 ) & mask );
+		v = ROTL32( v, 16 );
+		w[ i ] = v;
+		v += kK[ 0 ];
+		SHA_VEC_STORE( &W[ i * 4 ], v );
+	}
+	for( ; i < 20; ++i )
+	{
+		// W[i-3..i-1] and 0, W[i-8..i-5], W[i-14..i-11], and W[i-16..i-13].
+		
+		t = SHA_VEC_SHUFFLE( sha_u32x4, w[ 3 ], zero, 1, 2, 3, 4 ) ^ w[ 2 ] ^ 
+			SHA_VEC_SHUFFLE( sha_u32x4, w[ 0 ], w[ 1 ], 2, 3, 4, 5 ) ^ w[ 0 ];
+		v = ROTL32( t, 1 ) ^ ROTL32( SHA_VEC_SHUFFLE( sha_u32x4, t, zero, 4, 4, 4, 0 ), 2 );
+		w[ 0 ] = w[ 1 ];
+		w[ 1 ] = w[ 2 ];
+		w[ 2 ] = w[ 3 ];
+		w[ 3 ] = v;
+		v += kK[ i / 5 ];
+		SHA_VEC_STORE( &W[ i * 4 ], v );
+	}
+	
+	a = ioState[ 0 ];
+	b = ioState[ 1 ];
+	c = ioState[ 2 ];
+	d = ioState[ 3 ];
+	e = ioState[ 4 ];
+	for( i = 0; i < 20; )
+	{
+		SHA1_GG( SHA1_F0, a, b, c, d, e, i++ );
+		SHA1_GG( SHA1_F0, e, a, b, c, d, i++ );
+		SHA1_GG( SHA1_F0, d, e, a, b, c, i++ );
+		SHA1_GG( SHA1_F0, c, d, e, a, b, i++ );
+		SHA1_GG( SHA1_F0, b, c, d, e, a, i++ );
+	}
+	for( ; i < 40; )
+	{
+		SHA1_GG( SHA1_F1, a, b, c, d, e, i++ );
+		SHA1_GG( SHA1_F1, e, a, b, c, d, i++ );
+		SHA1_GG( SHA1_F1, d, e, a, b, c, i++ );
+		SHA1_GG( SHA1_F1, c, d, e, a, b, i++ );
+		SHA1_GG( SHA1_F1, b, c, d, e, a, i++ );
+	}
+	for( ; i < 60; )
+	{
+		SHA1_GG( SHA1_F2, a, b, c, d, e, i++ );
+		SHA1_GG( SHA1_F2, e, a, b, c, d, i++ );
+		SHA1_GG( SHA1_F2, d, e, a, b, c, i++ );
+		SHA1_GG( SHA1_F2, c, d, e, a, b, i++ );
+		SHA1_GG( SHA1_F2, b, c, d, e, a, i++ );
+	}
+	for( ; i < 80; )
+	{
+		SHA1_GG( SHA1_F3, a, b, c, d, e, i++ );
+		SHA1_GG( SHA1_F3, e, a, b, c, d, i++ );
+		SHA1_GG( SHA1_F3, d, e, a, b, c, i++ );
+		SHA1_GG( SHA1_F3, c, d, e, a, b, i++ );
+		SHA1_GG( SHA1_F3, b, c, d, e, a, i++ );
+	}
+	ioState[ 0 ] += a;
+	ioState[ 1 ] += b;
+	ioState[ 2 ] += c;
+	ioState[ 3 ] += d;
+	ioState[ 4 ] += e;
+}
+#endif // SHA_SIMD
+
+#if( SHA1_SHANI )
+//===========================================================================================================================
+//	_SHA1_CompressHardware
+//
+//	x86 SHA extensions. Each SHA1RNDS4 does 4 rounds. ABCD is kept with A in the high word so message words are loaded 
+//	with their order reversed. SHA1MSG1, XOR, and SHA1MSG2 expand the next 4 schedule words as the rounds go.
+//===========================================================================================================================
+
+#define SHA1_SHANI_RNDS4( E_NEXT, E_SAVE, MSG, FUNC ) \
+	E_NEXT	= _mm_sha1nexte_epu32( E_NEXT, MSG ); \
+	E_SAVE	= abcd; \
+	abcd	= _mm_sha1rnds4_epu32( abcd, E_NEXT, FUNC )
+
+#define SHA1_SHANI_MSG( A, B, C, D ) \
+	B = _mm_sha1msg2_epu32( B, A ); \
+	D = _mm_sha1msg1_epu32( D, A ); \
+	C = _mm_xor_si128( C, A )
+
+SHA1_HARDWARE_TARGET
+static void	_SHA1_CompressHardware( uint32_t ioState[ 5 ], const uint8_t *inPtr, size_t inCount )
+{
+	__m128i const		mask = _mm_set_epi64x( INT64_C( 0x0001020304050607 ), INT64_C( 0x08090a0b0c0d0e0f ) );
+	__m128i				abcd, abcdSave, e0, e0Save, e1, msg0, msg1, msg2, msg3;
+	
+	abcd	= _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i *) ioState ), 0x1B );
+	e0		= _mm_set_epi32( (int) ioState[ 4 ], 0, 0, 0 );
+	for( ; inCount > 0; --inCount, inPtr += SHA1_BLOCK_SIZE )
+	{
+		abcdSave	= abcd;
+		e0Save		= e0;
+		
+		// Rounds 0-15 (the message words).
+		
+		msg0	= _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)( inPtr +  0 ) ), mask );
+		e0		= _mm_add_epi32( e0, msg0 );
+		e1		= abcd;
+		abcd	= _mm_sha1rnds4_epu32( abcd, e0, 0 );
+		
+		msg1	= _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)( inPtr + 16 ) ), mask );
+		SHA1_SHANI_RNDS4( e1, e0, msg1, 0 );
+		msg0	= _mm_sha1msg1_epu32( msg0, msg1 );
+		
+		msg2	= _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)( inPtr + 32 ) ), mask );
+		SHA1_SHANI_RNDS4( e0, e1, msg2, 0 );
+		msg1	= _mm_sha1msg1_epu32( msg1, msg2 );
+		msg0	= _mm_xor_si128( msg0, msg2 );
+		
+		msg3	= _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)( inPtr + 48 ) ), mask );
+		SHA1_SHANI_RNDS4( e1, e0, msg3, 0 );
+		SHA1_SHANI_MSG( msg3, msg0, msg1, msg2 );
+		
+		// Rounds 16-67.
+		
+		SHA1_SHANI_RNDS4( e0, e1, msg0, 0 );
+		SHA1_SHANI_MSG( msg0, msg1, msg2, msg3 );
+		SHA1_SHANI_RNDS4( e1, e0, msg1, 1 );
+		SHA1_SHANI_MSG( msg1, msg2, msg3, msg0 );
+		SHA1_SHANI_RNDS4( e0, e1, msg2, 1 );
+		SHA1_SHANI_MSG( msg2, msg3, msg0, msg1 );
+		SHA1_SHANI_RNDS4( e1, e0, msg3, 1 );
+		SHA1_SHANI_MSG( msg3, msg0, msg1, msg2 );
+		SHA1_SHANI_RNDS4( e0, e1, msg0, 1 );
+		SHA1_SHANI_MSG( msg0, msg1, msg2, msg3 );
+		SHA1_SHANI_RNDS4( e1, e0, msg1, 1 );
+		SHA1_SHANI_MSG( msg1, msg2, msg3, msg0 );
+		SHA1_SHANI_RNDS4( e0, e1, msg2, 2 );
+		SHA1_SHANI_MSG( msg2, msg3, msg0, msg1 );
+		SHA1_SHANI_RNDS4( e1, e0, msg3, 2 );
+		SHA1_SHANI_MSG( msg3, msg0, msg1, msg2 );
+		SHA1_SHANI_RNDS4( e0, e1, msg0, 2 );
+		SHA1_SHANI_MSG( msg0, msg1, msg2, msg3 );
+		SHA1_SHANI_RNDS4( e1, e0, msg1, 2 );
+		SHA1_SHANI_MSG( msg1, msg2, msg3, msg0 );
+		SHA1_SHANI_RNDS4( e0, e1, msg2, 2 );
+		SHA1_SHANI_MSG( msg2, msg3, msg0, msg1 );
+		SHA1_SHANI_RNDS4( e1, e0, msg3, 3 );
+		SHA1_SHANI_MSG( msg3, msg0, msg1, msg2 );
+		SHA1_SHANI_RNDS4( e0, e1, msg0, 3 );
+		SHA1_SHANI_MSG( msg0, msg1, msg2, msg3 );
+		
+		// Rounds 68-79 (only finishing the last schedule words).
+		
+		SHA1_SHANI_RNDS4( e1, e0, msg1, 3 );
+		msg2	= _mm_sha1msg2_epu32( msg2, msg1 );
+		msg3	= _mm_xor_si128( msg3, msg1 );
+		SHA1_SHANI_RNDS4( e0, e1, msg2, 3 );
+		msg3	= _mm_sha1msg2_epu32( msg3, msg2 );
+		SHA1_SHANI_RNDS4( e1, e0, msg3, 3 );
+		
+		e0		= _mm_sha1nexte_epu32( e0, e0Save );
+		abcd	= _mm_add_epi32( abcd, abcdSave );
+	}
+	_mm_storeu_si128( (__m128i *) ioState, _mm_shuffle_epi32( abcd, 0x1B ) );
+	ioState[ 4 ] = (uint32_t) _mm_extract_epi32( e0, 3 );
+}
+#endif // SHA1_SHANI
+
+#if( SHA1_ARMV8 )
+//===========================================================================================================================
+//	_SHA1_CompressHardware
+//
+//	ARMv8 crypto extensions. Each SHA1C/SHA1P/SHA1M does 4 rounds and SHA1H gets E for the next 4 rounds from A. 
+//	SHA1SU0 and SHA1SU1 expand 4 schedule words from the previous 16.
+//===========================================================================================================================
+
+SHA1_HARDWARE_TARGET
+static void	_SHA1_CompressHardware( uint32_t ioState[ 5 ], const uint8_t *inPtr, size_t inCount )
+{
+	uint32x4_t const		k0 = vdupq_n_u32( UINT32_C( 0x5a827999 ) );
+	uint32x4_t const		k1 = vdupq_n_u32( UINT32_C( 0x6ed9eba1 ) );
+	uint32x4_t const		k2 = vdupq_n_u32( UINT32_C( 0x8f1bbcdc ) );
+	uint32x4_t const		k3 = vdupq_n_u32( UINT32_C( 0xca62c1d6 ) );
+	uint32x4_t				abcd, abcdSave, wk, m[ 20 ];
+	uint32_t				e0, e1, eSave;
+	int						i;
+	
+	abcd	= vld1q_u32( ioState );
+	e0		= ioState[ 4 ];
+	for( ; inCount > 0; --inCount, inPtr += SHA1_BLOCK_SIZE )
+	{
+		abcdSave	= abcd;
+		eSave		= e0;
+		
+		for( i = 0; i < 4; ++i )
+		{
+			m[ i ] = vreinterpretq_u32_u8( vrev32q_u8( vld1q_u8( inPtr + ( i * 16 ) ) ) );
+		}
+		for( ; i < 20; ++i )
+		{
+			m[ i ] = vsha1su1q_u32( vsha1su0q_u32( m[ i - 4 ], m[ i - 3 ], m[ i - 2 ] ), m[ i - 1 ] );
+		}
+		for( i = 0; i < 5; ++i )
+		{
+			wk		= vaddq_u32( m[ i ], k0 );
+			e1		= vsha1h_u32( vgetq_lane_u32( abcd, 0 ) );
+			abcd	= vsha1cq_u32( abcd, e0, wk );
+			e0		= e1;
+		}
+		for( ; i < 10; ++i )
+		{
+			wk		= vaddq_u32( m[ i ], k1 );
+			e1		= vsha1h_u32( vgetq_lane_u32( abcd, 0 ) );
+			abcd	= vsha1pq_u32( abcd, e0, wk );
+			e0		= e1;
+		}
+		for( ; i < 15; ++i )
+		{
+			wk		= vaddq_u32( m[ i ], k2 );
+			e1		= vsha1h_u32( vgetq_lane_u32( abcd, 0 ) );
+			abcd	= vsha1mq_u32( abcd, e0, wk );
+			e0		= e1;
+		}
+		for( ; i < 20; ++i )
+		{
+			wk		= vaddq_u32( m[ i ], k3 );
+			e1		= vsha1h_u32( vgetq_lane_u32( abcd, 0 ) );
+			abcd	= vsha1pq_u32( abcd, e0, wk );
+			e0		= e1;
+		}
+		abcd	= vaddq_u32( abcd, abcdSave );
+		e0		+= eSave;
+	}
+	vst1q_u32( ioState, abcd );
+	ioState[ 4 ] = e0;
 }
+#endif // SHA1_ARMV8
 
 #if( !EXCLUDE_UNIT_TESTS )
 //===========================================================================================================================
@@ -366,7 +846,17 @@ static const uint64_t		K[ 80 ] =
 	UINT64_C( 0x4cc5d4becb3e42b6 ), UINT64_C( 0x597f299cfc657e2a ), UINT64_C( 0x5fcb6fab3ad6faec ), UINT64_C( 0x6c44198c4a475817 )
 };
 
-static void	_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr );
+static void		_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr, size_t inCount );
+static SHAImpl	_SHA512_ImplBest( void );
+static Boolean	_SHA512_ImplSupported( SHAImpl inImpl );
+static void		_SHA512_CompressScalar( uint64_t ioState[ 8 ], const uint8_t *inPtr );
+#if( SHA_SIMD )
+static void		_SHA512_CompressSIMD( uint64_t ioState[ 8 ], const uint8_t *inPtr );
+#endif
+#if( SHA512_HARDWARE )
+SHA512_HARDWARE_TARGET
+static void		_SHA512_CompressHardware( uint64_t ioState[ 8 ], const uint8_t *inPtr, size_t inCount );
+#endif
 
 //===========================================================================================================================
 //	SHA512_Init_compat
@@ -400,10 +890,12 @@ int	SHA512_Update_compat( SHA512_CTX_compat *ctx, const void *inData, size_t inL
 	{
 		if( ( ctx->curlen == 0 ) && ( inLen >= SHA512_BLOCK_SIZE ) )
 		{
-			_SHA512_Compress( ctx, src );
-			ctx->length += ( SHA512_BLOCK_SIZE * 8 );
-			src			+= SHA512_BLOCK_SIZE;
-			inLen		-= SHA512_BLOCK_SIZE;
+			n = inLen / SHA512_BLOCK_SIZE;
+			_SHA512_Compress( ctx, src, n );
+			n *= SHA512_BLOCK_SIZE;
+			ctx->length += ( n * 8 );
+			src			+= n;
+			inLen		-= n;
 		}
 		else
 		{
@@ -414,7 +906,7 @@ int	SHA512_Update_compat( SHA512_CTX_compat *ctx, const void *inData, size_t inL
 			inLen		-= n;
 			if( ctx->curlen == SHA512_BLOCK_SIZE )
 			{
-				_SHA512_Compress( ctx, ctx->buf );
+				_SHA512_Compress( ctx, ctx->buf, 1 );
 				ctx->length += ( SHA512_BLOCK_SIZE * 8 );
 				ctx->curlen = 0;
 			}
@@ -438,7 +930,7 @@ int	SHA512_Final_compat( unsigned char *outDigest, SHA512_CTX_compat *ctx )
 	if( ctx->curlen > 112 )
 	{
 		while( ctx->curlen < 128 ) ctx->buf[ ctx->curlen++ ] = 0;
-		_SHA512_Compress( ctx, ctx->buf );
+		_SHA512_Compress( ctx, ctx->buf, 1 );
 		ctx->curlen = 0;
 	}
 	
@@ -448,7 +940,7 @@ int	SHA512_Final_compat( unsigned char *outDigest, SHA512_CTX_compat *ctx )
 	
 	// Store length
 	WriteBig64( ctx->buf + 120, ctx->length );
-	_SHA512_Compress( ctx, ctx->buf );
+	_SHA512_Compress( ctx, ctx->buf, 1 );
 	
 	// Copy output
 	for( i = 0; i < 8; ++i )
@@ -477,6 +969,83 @@ unsigned char *	SHA512_compat( const void *inData, size_t inLen, unsigned char *
 //	_SHA512_Compress
 //===========================================================================================================================
 
+static void	_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr, size_t inCount )
+{
+	SHAImpl		impl;
+	
+	impl = gSHA512Impl;
+	if( impl == kSHAImpl_Unknown )
+	{
+		impl = _SHA512_ImplBest();
+		gSHA512Impl = impl;
+	}
+	switch( impl )
+	{
+	#if( SHA512_HARDWARE )
+		case kSHAImpl_Hardware:
+			_SHA512_CompressHardware( ctx->state, inPtr, inCount );
+			break;
+	#endif
+		
+	#if( SHA_SIMD )
+		case kSHAImpl_SIMD:
+			for( ; inCount > 0; --inCount, inPtr += SHA512_BLOCK_SIZE ) _SHA512_CompressSIMD( ctx->state, inPtr );
+			break;
+	#endif
+		
+		default:
+			for( ; inCount > 0; --inCount, inPtr += SHA512_BLOCK_SIZE ) _SHA512_CompressScalar( ctx->state, inPtr );
+			break;
+	}
+}
+
+//===========================================================================================================================
+//	_SHA512_ImplBest
+//===========================================================================================================================
+
+static SHAImpl	_SHA512_ImplBest( void )
+{
+	if( _SHA512_ImplSupported( kSHAImpl_Hardware ) )						return( kSHAImpl_Hardware );
+	if( SHA512_SIMD_PREFERRED && _SHA512_ImplSupported( kSHAImpl_SIMD ) )	return( kSHAImpl_SIMD );
+	return( kSHAImpl_Scalar );
+}
+
+//===========================================================================================================================
+//	_SHA512_ImplSupported
+//===========================================================================================================================
+
+static Boolean	_SHA512_ImplSupported( SHAImpl inImpl )
+{
+	switch( inImpl )
+	{
+		case kSHAImpl_Scalar:
+			return( true );
+		
+	#if( SHA_SIMD )
+		case kSHAImpl_SIMD:
+			return( true );
+	#endif
+		
+	#if( SHA512_ARMV8 )
+		case kSHAImpl_Hardware:
+		#if( defined( __ARM_FEATURE_SHA512 ) )
+			return( true );
+		#elif( TARGET_OS_LINUX )
+			return( ( getauxval( AT_HWCAP ) & HWCAP_SHA512 ) ? true : false );
+		#else
+			return( false );
+		#endif
+	#endif
+		
+		default:
+			return( false );
+	}
+}
+
+//===========================================================================================================================
+//	_SHA512_CompressScalar
+//===========================================================================================================================
+
 #define SHA512_Ch(x,y,z)		(z ^ (x & (y ^ z)))
 #define SHA512_Maj(x,y,z)		(((x | y) & z) | (x & y)) 
 #define SHA512_S(x, n)			ROTR64(x, n)
@@ -491,7 +1060,7 @@ unsigned char *	SHA512_compat( const void *inData, size_t inLen, unsigned char *
 	 d += t0; \
 	 h  = t0 + t1;
 
-static void	_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr )
+static void	_SHA512_CompressScalar( uint64_t ioState[ 8 ], const uint8_t *inPtr )
 {
 	uint64_t		S[ 8] , W[ 80 ], t0, t1;
 	int				i;
@@ -499,7 +1068,7 @@ static void	_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr )
 	// Copy state into S
 	for( i = 0; i < 8; ++i )
 	{
-		S[ i ] = ctx->state[ i ];
+		S[ i ] = ioState[ i ];
 	}
 	
 	// Copy the state into 1024-bits into W[0..15]
@@ -531,10 +1100,146 @@ static void	_SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr )
 	// Feedback
 	for( i = 0; i < 8; ++i )
 	{
-		ctx->state[ i ] += S[ i ];
+		ioState[ i ] += S[ i ];
 	}
 }
 
+#if( SHA_SIMD )
+//===========================================================================================================================
+//	_SHA512_CompressSIMD
+//
+//	W[i] only depends on words at least 2 back so the schedule is expanded 2 words at a time with the last 16 words kept
+//	in vectors. The round constants are added to the schedule with vectors too.
+//===========================================================================================================================
+
+#define SHA512_VecGamma0( X )		( ROTR64( X,  1 ) ^ ROTR64( X,  8 ) ^ ( (X) >> 7 ) )
+#define SHA512_VecGamma1( X )		( ROTR64( X, 19 ) ^ ROTR64( X, 61 ) ^ ( (X) >> 6 ) )
+#define SHA512_RNDW( a, b, c, d, e, f, g, h, i ) \
+	 t0 = h + SHA512_Sigma1( e ) + SHA512_Ch( e, f, g ) + W[ i ]; \
+	 t1 = SHA512_Sigma0( a ) + SHA512_Maj( a, b, c); \
+	 d += t0; \
+	 h  = t0 + t1;
+
+static void	_SHA512_CompressSIMD( uint64_t ioState[ 8 ], const uint8_t *inPtr )
+{
+	sha_u64x2 const		mask8	= { UINT64_C( 0x00ff00ff00ff00ff ), UINT64_C( 0x00ff00ff00ff00ff ) };
+	sha_u64x2 const		mask16	= { UINT64_C( 0x0000ffff0000ffff ), UINT64_C( 0x0000ffff0000ffff ) };
+	uint64_t			S[ 8 ], W[ 80 ], t0, t1;
+	sha_u64x2			w[ 8 ], k, v;
+	int					i;
+	
+	for( i = 0; i < 8; ++i )
+	{
+		SHA_VEC_LOAD( v, inPtr + ( i * 16 ) );
+		v = ( ( v & mask8 )  << 8 )  | ( ( v >> 8 )  & mask8 );
+		v = ( ( v & mask16 ) << 16 ) | ( ( v >> 16 ) & mask16 );
+		v = ROTL64( v, 32 );
+		w[ i ] = v;
+		SHA_VEC_LOAD( k, &K[ i * 2 ] );
+		v += k;
+		SHA_VEC_STORE( &W[ i * 2 ], v );
+	}
+	for( ; i < 40; ++i )
+	{
+		// W[i-2..i-1], W[i-7..i-6], W[i-15..i-14], and W[i-16..i-15].
+		
+		v = SHA512_VecGamma1( w[ 7 ] ) + SHA_VEC_SHUFFLE( sha_u64x2, w[ 4 ], w[ 5 ], 1, 2 ) + 
+			SHA512_VecGamma0( SHA_VEC_SHUFFLE( sha_u64x2, w[ 0 ], w[ 1 ], 1, 2 ) ) + w[ 0 ];
+		w[ 0 ] = w[ 1 ];
+		w[ 1 ] = w[ 2 ];
+		w[ 2 ] = w[ 3 ];
+		w[ 3 ] = w[ 4 ];
+		w[ 4 ] = w[ 5 ];
+		w[ 5 ] = w[ 6 ];
+		w[ 6 ] = w[ 7 ];
+		w[ 7 ] = v;
+		SHA_VEC_LOAD( k, &K[ i * 2 ] );
+		v += k;
+		SHA_VEC_STORE( &W[ i * 2 ], v );
+	}
+	
+	for( i = 0; i < 8; ++i )
+	{
+		S[ i ] = ioState[ i ];
+	}
+	for( i = 0; i < 80; i += 8 )
+	{
+		 SHA512_RNDW( S[ 0 ], S[ 1 ], S[ 2 ], S[ 3 ], S[ 4 ], S[ 5 ], S[ 6 ], S[ 7 ], i+0 );
+		 SHA512_RNDW( S[ 7 ], S[ 0 ], S[ 1 ], S[ 2 ], S[ 3 ], S[ 4 ], S[ 5 ], S[ 6 ], i+1 );
+		 SHA512_RNDW( S[ 6 ], S[ 7 ], S[ 0 ], S[ 1 ], S[ 2 ], S[ 3 ], S[ 4 ], S[ 5 ], i+2 );
+		 SHA512_RNDW( S[ 5 ], S[ 6 ], S[ 7 ], S[ 0 ], S[ 1 ], S[ 2 ], S[ 3 ], S[ 4 ], i+3 );
+		 SHA512_RNDW( S[ 4 ], S[ 5 ], S[ 6 ], S[ 7 ], S[ 0 ], S[ 1 ], S[ 2 ], S[ 3 ], i+4 );
+		 SHA512_RNDW( S[ 3 ], S[ 4 ], S[ 5 ], S[ 6 ], S[ 7 ], S[ 0 ], S[ 1 ], S[ 2 ], i+5 );
+		 SHA512_RNDW( S[ 2 ], S[ 3 ], S[ 4 ], S[ 5 ], S[ 6 ], S[ 7 ], S[ 0 ], S[ 1 ], i+6 );
+		 SHA512_RNDW( S[ 1 ], S[ 2 ], S[ 3 ], S[ 4 ], S[ 5 ], S[ 6 ], S[ 7 ], S[ 0 ], i+7 );
+	}
+	for( i = 0; i < 8; ++i )
+	{
+		ioState[ i ] += S[ i ];
+	}
+}
+#endif // SHA_SIMD
+
+#if( SHA512_ARMV8 )
+//===========================================================================================================================
+//	_SHA512_CompressHardware
+//
+//	ARMv8.2 SHA-512 instructions. The state is kept as pairs of words (ab, cd, ef, gh) with the first word of each pair in
+//	lane 0. SHA512H does the T1 half of 2 rounds and SHA512H2 does the T2 half. SHA512SU0 and SHA512SU1 expand 2 schedule 
+//	words from the previous 16.
+//===========================================================================================================================
+
+SHA512_HARDWARE_TARGET
+static void	_SHA512_CompressHardware( uint64_t ioState[ 8 ], const uint8_t *inPtr, size_t inCount )
+{
+	uint64x2_t		ab, cd, ef, gh, abSave, cdSave, efSave, ghSave, wk, t1, m[ 40 ];
+	int				i;
+	
+	ab = vld1q_u64( &ioState[ 0 ] );
+	cd = vld1q_u64( &ioState[ 2 ] );
+	ef = vld1q_u64( &ioState[ 4 ] );
+	gh = vld1q_u64( &ioState[ 6 ] );
+	for( ; inCount > 0; --inCount, inPtr += SHA512_BLOCK_SIZE )
+	{
+		abSave = ab;
+		cdSave = cd;
+		efSave = ef;
+		ghSave = gh;
+		
+		for( i = 0; i < 8; ++i )
+		{
+			m[ i ] = vreinterpretq_u64_u8( vrev64q_u8( vld1q_u8( inPtr + ( i * 16 ) ) ) );
+		}
+		for( ; i < 40; ++i )
+		{
+			m[ i ] = vsha512su1q_u64( vsha512su0q_u64( m[ i - 8 ], m[ i - 7 ] ), m[ i - 1 ], 
+				vextq_u64( m[ i - 4 ], m[ i - 3 ], 1 ) );
+		}
+		for( i = 0; i < 40; ++i )
+		{
+			// SHA512H wants h + K[t] + W[t] for the first round in the high lane and g + K[t+1] + W[t+1] for the 
+			// second round in the low lane. It returns T1 of the first round in the high lane and the second in the low.
+			
+			wk	= vaddq_u64( m[ i ], vld1q_u64( &K[ i * 2 ] ) );
+			t1	= vsha512hq_u64( vaddq_u64( gh, vextq_u64( wk, wk, 1 ) ), vextq_u64( ef, gh, 1 ), vextq_u64( cd, ef, 1 ) );
+			gh	= ef;
+			ef	= vaddq_u64( cd, t1 );
+			t1	= vsha512h2q_u64( t1, cd, ab );
+			cd	= ab;
+			ab	= t1;
+		}
+		ab = vaddq_u64( ab, abSave );
+		cd = vaddq_u64( cd, cdSave );
+		ef = vaddq_u64( ef, efSave );
+		gh = vaddq_u64( gh, ghSave );
+	}
+	vst1q_u64( &ioState[ 0 ], ab );
+	vst1q_u64( &ioState[ 2 ], cd );
+	vst1q_u64( &ioState[ 4 ], ef );
+	vst1q_u64( &ioState[ 6 ], gh );
+}
+#endif // SHA512_ARMV8
+
 #if( !EXCLUDE_UNIT_TESTS )
 //===========================================================================================================================
 //	SHA512_Test
@@ -1199,3 +1904,321 @@ exit:
 	return( err );
 }
 #endif // !EXCLUDE_UNIT_TESTS
+
+#if 0
+#pragma mark -
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+//===========================================================================================================================
+//	SHAUtils_Test
+//===========================================================================================================================
+
+#define kSHAUtilsTestBufSize		5000
+
+typedef struct
+{
+	size_t			len;
+	const char *	sha1;
+	const char *	sha512;
+	
+}	SHAUtilsTestCase;
+
+static const SHAUtilsTestCase		kSHAUtilsTestCases[] = 
+{
+	// Digests of _SHAUtils_TestFill( buf, len, 7 ) for lengths around the padding and block boundaries.
+	
+	{
+		0, 
+		"\xDA\x39\xA3\xEE\x5E\x6B\x4B\x0D\x32\x55\xBF\xEF\x95\x60\x18\x90"
+		"\xAF\xD8\x07\x09", 
+		"\xCF\x83\xE1\x35\x7E\xEF\xB8\xBD\xF1\x54\x28\x50\xD6\x6D\x80\x07"
+		"\xD6\x20\xE4\x05\x0B\x57\x15\xDC\x83\xF4\xA9\x21\xD3\x6C\xE9\xCE"
+		"\x47\xD0\xD1\x3C\x5D\x85\xF2\xB0\xFF\x83\x18\xD2\x87\x7E\xEC\x2F"
+		"\x63\xB9\x31\xBD\x47\x41\x7A\x81\xA5\x38\x32\x7A\xF9\x27\xDA\x3E"
+	}, 
+	{
+		55, 
+		"\x74\x9B\xBE\xFB\x28\xED\xC4\x63\x8B\x28\xB2\xB9\xA9\xE0\x3A\xB9"
+		"\xA4\x03\x2B\x90", 
+		"\x33\x0E\xB5\xE8\x1B\x4D\x72\x2C\xAE\x1E\x0E\xFB\xF8\x83\xEF\xB1"
+		"\x80\xC3\xE3\x46\xD2\xB3\xB7\x97\xDA\xFC\x90\x40\x95\x83\xED\x35"
+		"\xAF\x65\xDC\x2D\x79\x74\xA3\x53\xF0\xC2\x16\x63\xE1\x96\xB6\x0D"
+		"\x3E\xE5\xA2\xC7\x0C\x50\xB7\xB3\xBC\xCD\xB9\x3A\x5D\xBC\xE6\xBF"
+	}, 
+	{
+		56, 
+		"\xA5\xB6\xE9\xC2\x9D\x20\x1C\x77\x47\x53\xFF\x8E\x7F\xB6\x49\x31"
+		"\x65\x6F\x5E\x63", 
+		"\x1B\x5B\x63\xBF\xD5\x42\x0B\x2D\xC4\x80\xAB\xCE\x3D\xBD\xB3\xE1"
+		"\x9E\x5F\x9D\x4F\xAB\xFF\xBA\x77\x64\x88\x39\x37\xEA\xAE\x87\x8A"
+		"\x55\x36\x2C\x93\x8C\x14\x17\x12\xC4\x4C\x30\x76\xC3\xFA\xBB\x2C"
+		"\x60\x81\x4C\x29\x94\xC3\x11\xC3\x30\x49\xA8\xD6\xDE\x2A\x88\x98"
+	}, 
+	{
+		64, 
+		"\x39\xA0\xD8\xB6\x45\xAD\x85\xF1\xF9\x76\x73\x1E\xD1\x12\xAC\x94"
+		"\x55\xE2\x8B\x78", 
+		"\x4C\x7A\xBA\x36\x59\x92\x9C\x4F\xD8\x76\x04\xC5\x32\xA3\xB5\xF1"
+		"\x74\xD0\x62\x6B\x2D\x66\x1D\xBB\xBF\xAC\x76\xC9\x7A\x49\xA5\xA7"
+		"\x78\x9D\x2C\x68\x32\x4C\x75\x4F\x66\xBF\x62\x9F\xA7\x20\x54\xF3"
+		"\x34\xFE\xAA\xD8\xB1\xCF\x4C\x88\x5A\xE0\x3A\x1E\x63\x4A\xFC\x18"
+	}, 
+	{
+		111, 
+		"\xB7\xB4\x2D\x19\xAE\x6B\xE2\x09\xC3\x6E\xFE\x0C\x5D\xFE\x5B\xDE"
+		"\x4D\x30\x6C\x43", 
+		"\xDA\x78\x0D\x83\x38\xA8\xA9\x20\xCE\xB6\x89\x2C\xB4\xEC\xBB\x0C"
+		"\xC0\xC6\x69\x56\x26\x9A\xAD\xD5\xDD\x0F\x48\x79\x0A\x00\x85\x7B"
+		"\xD9\x75\x89\x0F\x3B\x29\x55\xA3\x17\x73\x8C\xC7\xA7\x70\x82\x0C"
+		"\x29\xF9\x22\xFF\xBC\x22\x02\x0F\x19\x09\xD5\x94\xCC\x98\x7D\x1B"
+	}, 
+	{
+		112, 
+		"\x11\xE9\x20\xCD\x4E\xD4\x5C\x60\xC0\x5A\x91\x6E\x48\xA9\x42\xF9"
+		"\xE3\x9C\x77\x0B", 
+		"\x05\x31\x82\xF7\xFA\x4E\x59\xF8\x63\x6E\x41\x5A\x77\xED\x4F\xDC"
+		"\x65\x0F\x0A\x43\x83\x4C\x9D\x35\xAD\xF8\x99\x59\x9C\x3A\xB9\xC4"
+		"\x15\x3F\x02\xFF\x50\xBD\x01\x88\x80\x60\xCD\x36\xA6\xFA\x12\xD9"
+		"\xDB\x24\x2F\xC3\x51\x64\xC8\x01\x35\x61\x35\x14\x18\x6D\x58\x43"
+	}, 
+	{
+		128, 
+		"\x00\x60\xF2\xA7\xE3\x4B\x6E\x4D\x45\x9F\x56\x01\x97\xEF\x93\x24"
+		"\x37\x32\xA4\x00", 
+		"\xDF\x00\x7A\x08\xF3\xAA\xAE\x47\xE0\xC9\x2E\xF8\x40\xEC\xD4\x36"
+		"\x45\xAE\x60\x98\xC8\x19\xF2\xA4\xA6\x61\x74\xEF\x1C\xD4\x9E\x5C"
+		"\x6D\xFC\xCF\x06\x16\x89\x5E\x57\x0B\x75\x64\xAF\x64\x1D\xE5\x86"
+		"\x3D\xFF\x9F\x89\xC7\x52\x91\x3D\x30\xCF\x0E\xCF\x67\x8E\x16\x35"
+	}, 
+	{
+		1000, 
+		"\x82\x82\x07\xEF\xD4\x9B\x90\x68\xC8\xD2\x5E\xE6\x52\x19\xA6\xE0"
+		"\x8B\xF9\x69\xAD", 
+		"\x17\xD6\xC7\xD7\xFF\x88\x4A\x6D\xA4\xAB\x1C\xC9\x40\x50\x37\xB0"
+		"\xCB\x73\x78\xD5\xB0\xB0\xA1\x66\x6B\x65\x21\x2D\xBE\x28\x5F\x41"
+		"\xDD\xD5\xB6\x44\x86\x28\xA9\xBE\xB3\x00\x20\xD5\x72\xA8\xCA\x27"
+		"\x98\x8A\xDA\xD0\x0B\x04\xF4\x21\xED\x71\x2B\xA2\xA8\x67\xEB\x9E"
+	}, 
+	{
+		4113, 
+		"\x9E\x2C\xB2\x88\x3D\x72\x07\x78\x38\x9D\x97\xE2\x6A\xC4\xCE\xDE"
+		"\x59\x56\x0B\x48", 
+		"\x2E\x7E\x79\x41\xE4\xD4\x1D\x78\xA9\xB5\x86\x85\x71\x48\x37\xA0"
+		"\x61\x6F\x65\x27\x9F\x01\xC8\xF7\x75\x09\x75\x60\x11\xA2\x42\x05"
+		"\xA5\x35\xFE\xDA\x2C\x81\xFB\xAD\x4E\x77\x24\x21\x21\x4C\x11\xC1"
+		"\xEC\xCC\xD7\x93\x8B\xBE\x94\x7C\xEE\xE1\x1E\x86\x5D\x18\x7F\xA4"
+	}
+};
+
+static const char * const		kSHAUtilsTestImplNames[] = { "-", "scalar", "simd", "hardware" };
+
+static OSStatus	_SHAUtils_TestImpl( SHAImpl inImpl, uint8_t *inBuf );
+static void		_SHAUtils_TestFill( uint8_t *inBuf, size_t inLen, uint8_t inSeed );
+static void		_SHAUtils_TestPerf( SHAImpl inSHA1Impl, SHAImpl inSHA512Impl, uint8_t *inBuf );
+
+OSStatus	SHAUtils_Test( int inPrint, int inPerf )
+{
+	OSStatus		err;
+	uint8_t *		buf;
+	int				impl;
+	
+	buf = (uint8_t *) malloc( kSHAUtilsTestBufSize );
+	require_action( buf, exit, err = kNoMemoryErr );
+	
+	for( impl = kSHAImpl_Scalar; impl <= kSHAImpl_Hardware; ++impl )
+	{
+		err = _SHAUtils_TestImpl( (SHAImpl) impl, buf );
+		require_noerr( err, exit );
+	}
+	if( inPrint )
+	{
+		fprintf( stderr, "\tSHA-1: %s, SHA-512: %s\n", 
+			kSHAUtilsTestImplNames[ _SHA1_ImplBest() ], kSHAUtilsTestImplNames[ _SHA512_ImplBest() ] );
+	}
+	
+	if( inPerf )
+	{
+		// Scalar, then each faster implementation the CPU supports.
+		
+		_SHAUtils_TestPerf( kSHAImpl_Scalar, kSHAImpl_Scalar, buf );
+		for( impl = kSHAImpl_SIMD; impl <= kSHAImpl_Hardware; ++impl )
+		{
+			if( !_SHA1_ImplSupported( (SHAImpl) impl ) && !_SHA512_ImplSupported( (SHAImpl) impl ) ) continue;
+			_SHAUtils_TestPerf( 
+				_SHA1_ImplSupported(   (SHAImpl) impl ) ? (SHAImpl) impl : kSHAImpl_Unknown, 
+				_SHA512_ImplSupported( (SHAImpl) impl ) ? (SHAImpl) impl : kSHAImpl_Unknown, buf );
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	gSHA1Impl	= kSHAImpl_Unknown;
+	gSHA512Impl	= kSHAImpl_Unknown;
+	FreeNullSafe( buf );
+	printf( "SHAUtils_Test: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_SHAUtils_TestImpl
+//
+//	Checks the test vectors and compares with the scalar code for every length up to several blocks with unaligned input
+//	and for updates split at odd sizes. Hashes the CPU doesn't have this implementation for are skipped.
+//===========================================================================================================================
+
+static OSStatus	_SHAUtils_TestImpl( SHAImpl inImpl, uint8_t *inBuf )
+{
+	static const size_t				kSplits[] = { 1, 63, 64, 65, 127, 128, 129, 1000 };
+	OSStatus						err;
+	const SHAUtilsTestCase *		tc;
+	Boolean							sha1Supported, sha512Supported;
+	uint8_t							sha1[ 2 ][ SHA_DIGEST_LENGTH ];
+	uint8_t							sha512[ 2 ][ SHA512_DIGEST_LENGTH ];
+	SHA_CTX_compat					sha1Ctx;
+	SHA512_CTX_compat				sha512Ctx;
+	size_t							i, j, len, offset, n;
+	
+	sha1Supported	= _SHA1_ImplSupported( inImpl );
+	sha512Supported	= _SHA512_ImplSupported( inImpl );
+	for( i = 0; i < countof( kSHAUtilsTestCases ); ++i )
+	{
+		tc = &kSHAUtilsTestCases[ i ];
+		_SHAUtils_TestFill( inBuf, tc->len, 7 );
+		if( sha1Supported )
+		{
+			gSHA1Impl = inImpl;
+			SHA1_compat( inBuf, tc->len, sha1[ 0 ] );
+			require_action( memcmp( sha1[ 0 ], tc->sha1, SHA_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+		}
+		if( sha512Supported )
+		{
+			gSHA512Impl = inImpl;
+			SHA512_compat( inBuf, tc->len, sha512[ 0 ] );
+			require_action( memcmp( sha512[ 0 ], tc->sha512, SHA512_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+		}
+	}
+	
+	_SHAUtils_TestFill( inBuf, kSHAUtilsTestBufSize, 0x3C );
+	for( len = 0; len <= 1100; ++len )
+	{
+		offset = len % 3;
+		if( sha1Supported )
+		{
+			gSHA1Impl = kSHAImpl_Scalar;
+			SHA1_compat( &inBuf[ offset ], len, sha1[ 0 ] );
+			gSHA1Impl = inImpl;
+			SHA1_compat( &inBuf[ offset ], len, sha1[ 1 ] );
+			require_action( memcmp( sha1[ 0 ], sha1[ 1 ], SHA_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+		}
+		if( sha512Supported )
+		{
+			gSHA512Impl = kSHAImpl_Scalar;
+			SHA512_compat( &inBuf[ offset ], len, sha512[ 0 ] );
+			gSHA512Impl = inImpl;
+			SHA512_compat( &inBuf[ offset ], len, sha512[ 1 ] );
+			require_action( memcmp( sha512[ 0 ], sha512[ 1 ], SHA512_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+		}
+	}
+	
+	gSHA1Impl	= kSHAImpl_Scalar;
+	gSHA512Impl	= kSHAImpl_Scalar;
+	SHA1_compat( inBuf, kSHAUtilsTestBufSize, sha1[ 0 ] );
+	SHA512_compat( inBuf, kSHAUtilsTestBufSize, sha512[ 0 ] );
+	gSHA1Impl	= sha1Supported   ? inImpl : kSHAImpl_Scalar;
+	gSHA512Impl	= sha512Supported ? inImpl : kSHAImpl_Scalar;
+	for( i = 0; i < countof( kSplits ); ++i )
+	{
+		SHA1_Init_compat( &sha1Ctx );
+		SHA512_Init_compat( &sha512Ctx );
+		for( offset = 0, j = 0; offset < kSHAUtilsTestBufSize; offset += n, ++j )
+		{
+			n = ( j % 2 ) ? ( kSplits[ i ] + 300 ) : kSplits[ i ];
+			n = Min( n, kSHAUtilsTestBufSize - offset );
+			SHA1_Update_compat( &sha1Ctx, &inBuf[ offset ], n );
+			SHA512_Update_compat( &sha512Ctx, &inBuf[ offset ], n );
+		}
+		SHA1_Final_compat( sha1[ 1 ], &sha1Ctx );
+		SHA512_Final_compat( sha512[ 1 ], &sha512Ctx );
+		require_action( memcmp( sha1[ 0 ], sha1[ 1 ], SHA_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+		require_action( memcmp( sha512[ 0 ], sha512[ 1 ], SHA512_DIGEST_LENGTH ) == 0, exit, err = kResponseErr );
+	}
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_SHAUtils_TestFill
+//===========================================================================================================================
+
+static void	_SHAUtils_TestFill( uint8_t *inBuf, size_t inLen, uint8_t inSeed )
+{
+	size_t		i;
+	
+	for( i = 0; i < inLen; ++i ) inBuf[ i ] = (uint8_t)( ( i * 31 ) + ( i >> 8 ) + inSeed );
+}
+
+//===========================================================================================================================
+//	_SHAUtils_TestPerf
+//
+//	Reports SHA-1 and SHA-512 MB/sec and the time for an HKDF like the ones used to derive session keys. 
+//	kSHAImpl_Unknown skips that hash.
+//===========================================================================================================================
+
+static void	_SHAUtils_TestPerf( SHAImpl inSHA1Impl, SHAImpl inSHA512Impl, uint8_t *inBuf )
+{
+	static const size_t		kPerfSizes[] = { 64, 1024, 4096 };
+	uint8_t					digest[ SHA512_DIGEST_LENGTH ];
+	uint8_t					key[ 32 ];
+	size_t					i, j, len, count;
+	uint64_t				ticks;
+	double					sha1MBs, sha512MBs, hkdfUs;
+	
+	memset( inBuf, 'a', kSHAUtilsTestBufSize );
+	for( i = 0; i < countof( kPerfSizes ); ++i )
+	{
+		len		= kPerfSizes[ i ];
+		count	= ( 16 * 1024 * 1024 ) / len;
+		
+		sha1MBs = 0;
+		if( inSHA1Impl != kSHAImpl_Unknown )
+		{
+			gSHA1Impl = inSHA1Impl;
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j ) SHA1_compat( inBuf, len, digest );
+			ticks = UpTicks() - ticks;
+			sha1MBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+		}
+		
+		sha512MBs = 0;
+		if( inSHA512Impl != kSHAImpl_Unknown )
+		{
+			gSHA512Impl = inSHA512Impl;
+			ticks = UpTicks();
+			for( j = 0; j < count; ++j ) SHA512_compat( inBuf, len, digest );
+			ticks = UpTicks() - ticks;
+			sha512MBs = ( count * len ) / ( ( ( (double) ticks ) / UpTicksPerSecond() ) * 1048576.0 );
+		}
+		fprintf( stderr, "\tSHA-1 %-8s %8.2f MB/sec, SHA-512 %-8s %8.2f MB/sec (%4zu bytes)\n", 
+			kSHAUtilsTestImplNames[ inSHA1Impl ], sha1MBs, kSHAUtilsTestImplNames[ inSHA512Impl ], sha512MBs, len );
+	}
+	
+	if( inSHA512Impl != kSHAImpl_Unknown )
+	{
+		count = 100000;
+		gSHA512Impl = inSHA512Impl;
+		ticks = UpTicks();
+		for( j = 0; j < count; ++j )
+		{
+			HKDF_SHA512_compat( inBuf, 32, "Control-Salt", 12, "Control-Write-Encryption-Key", 28, sizeof( key ), key );
+		}
+		ticks = UpTicks() - ticks;
+		hkdfUs = ( 1000000.0 * ticks ) / ( ( (double) UpTicksPerSecond() ) * count );
+		fprintf( stderr, "\tHKDF-SHA-512 %-8s %.2f µs per 32 byte key\n", kSHAUtilsTestImplNames[ inSHA512Impl ], hkdfUs );
+	}
+	gSHA1Impl	= kSHAImpl_Unknown;
+	gSHA512Impl	= kSHAImpl_Unknown;
+}
+#endif // !EXCLUDE_UNIT_TESTS
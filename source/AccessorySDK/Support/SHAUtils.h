@@ -161,6 +161,16 @@ void
 
 OSStatus	HKDF_SHA512_Test( void );
 
+//===========================================================================================================================
+//	Debugging
+//===========================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	SHAUtils_Test
+	@abstract	Tests each SHA-1 and SHA-512 implementation the CPU supports. With inPerf, also reports MB/sec and HKDF time.
+*/
+OSStatus	SHAUtils_Test( int inPrint, int inPerf );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,643 @@
+/*
+	File:    	TraceUtils.c
+	Package: 	Apple CarPlay Communication Plug-in.
+	Abstract: 	n/a 
+	Version: 	410.12
+	
+	Disclaimer: IMPORTANT: This Apple software is supplied to you, by Apple Inc. ("Apple"), in your
+	capacity as a current, and in good standing, Licensee in the MFi Licensing Program. Use of this
+	Apple software is governed by and subject to the terms and conditions of your MFi License,
+	including, but not limited to, the restrictions specified in the provision entitled ”Public 
+	Software”, and is further subject to your agreement to the following additional terms, and your 
+	agreement that the use, installation, modification or redistribution of this Apple software
+	constitutes acceptance of these additional terms. If you do not agree with these additional terms,
+	please do not use, install, modify or redistribute this Apple software.
+	
+	Subject to all of these terms and in consideration of your agreement to abide by them, Apple grants
+	you, for as long as you are a current and in good-standing MFi Licensee, a personal, non-exclusive 
+	license, under Apple's copyrights in this original Apple software (the "Apple Software"), to use, 
+	reproduce, and modify the Apple Software in source form, and to use, reproduce, modify, and 
+	redistribute the Apple Software, with or without modifications, in binary form. While you may not 
+	redistribute the Apple Software in source form, should you redistribute the Apple Software in binary
+	form, you must retain this notice and the following text and disclaimers in all such redistributions
+	of the Apple Software. Neither the name, trademarks, service marks, or logos of Apple Inc. may be
+	used to endorse or promote products derived from the Apple Software without specific prior written
+	permission from Apple. Except as expressly stated in this notice, no other rights or licenses, 
+	express or implied, are granted by Apple herein, including but not limited to any patent rights that
+	may be infringed by your derivative works or by other works in which the Apple Software may be 
+	incorporated.  
+	
+	Unless you explicitly state otherwise, if you provide any ideas, suggestions, recommendations, bug 
+	fixes or enhancements to Apple in connection with this software (“Feedback”), you hereby grant to
+	Apple a non-exclusive, fully paid-up, perpetual, irrevocable, worldwide license to make, use, 
+	reproduce, incorporate, modify, display, perform, sell, make or have made derivative works of,
+	distribute (directly or indirectly) and sublicense, such Feedback in connection with Apple products 
+	and services. Providing this Feedback is voluntary, but if you do provide Feedback to Apple, you 
+	acknowledge and agree that Apple may exercise the license granted above without the payment of 
+	royalties or further consideration to Participant.
+	
+	The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR 
+	IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+	AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR
+	IN COMBINATION WITH YOUR PRODUCTS.
+	
+	IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES 
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+	PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION 
+	AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+	(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+	POSSIBILITY OF SUCH DAMAGE.
+	
+	Copyright (C) 2006-2016 Apple Inc. All Rights Reserved. Not to be used or disclosed without permission from Apple.
+*/
+
+#include "TraceUtils.h"
+
+#include "CommonServices.h"
+#include "DebugServices.h"
+#include "StringUtils.h"
+#include "ThreadUtils.h"
+#include "TickUtils.h"
+
+#if( TARGET_HAS_STD_C_LIB )
+	#include <ctype.h>
+	#include <stdio.h>
+	#include <stdlib.h>
+	#include <string.h>
+#endif
+
+#if( TRACEUTILS_ENABLED )
+	#include <pthread.h>
+	#include <unistd.h>
+	
+	#include "AtomicUtils.h"
+#endif
+
+#if( TRACEUTILS_ENABLED && TARGET_OS_LINUX )
+	#include <sys/prctl.h>
+	#include <sys/syscall.h>
+#endif
+
+#if( TRACEUTILS_ENABLED )
+//===========================================================================================================================
+//	Constants
+//===========================================================================================================================
+
+#define kTraceRingRecordCount		4096	// Records per thread. Must be a power of 2. 128 KB per thread.
+#define kTraceRingMaxCount			32		// Max number of rings. Threads started after this reuse rings of exited threads.
+
+// Orders the stores of a record before the store of the new count. x86 doesn't reorder stores with other stores so
+// it only needs to keep the compiler from reordering them. This avoids an mfence, which is most of the cost otherwise.
+
+#if( defined( __i386__ ) || defined( __x86_64__ ) )
+	#define trace_store_barrier()		__asm__ __volatile__( "" ::: "memory" )
+#else
+	#define trace_store_barrier()		atomic_write_barrier()
+#endif
+
+//===========================================================================================================================
+//	Types
+//===========================================================================================================================
+
+typedef struct TraceRing		TraceRing;
+struct TraceRing
+{
+	TraceRing *				next;							// Next ring in the list. Never changes after being added.
+	volatile uint32_t		count;							// Number of records ever written. Only the owning thread writes.
+	uint32_t				start;							// Count when last cleared. Records before this aren't written out.
+	Boolean					active;							// True while the owning thread is running.
+	uint64_t				threadID;						// Thread that owns the ring.
+	char					threadName[ 32 ];				// Name of the thread when it recorded its first event.
+	TraceRecord				records[ kTraceRingRecordCount ];
+};
+
+//===========================================================================================================================
+//	Prototypes
+//===========================================================================================================================
+
+static TraceRing *	_TraceRingAcquire( void );
+static void			_TraceRingRelease( void *inArg );
+static void			_TraceInitializeKey( void );
+static void			_TraceGetThreadInfo( uint64_t *outThreadID, char *inNameBuf, size_t inNameMaxLen );
+static void			_TraceWriteRecord( FILE *inFile, const TraceRecord *inRecord, int inPID, uint64_t inThreadID, double inUSecPerTick );
+
+//===========================================================================================================================
+//	Globals
+//===========================================================================================================================
+
+volatile Boolean				gTraceEnabled		= false;
+static pthread_mutex_t			gTraceLock			= PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t			gTraceKeyOnce		= PTHREAD_ONCE_INIT;
+static pthread_key_t			gTraceKey;
+static Boolean					gTraceKeyValid		= false;
+static TraceRing *				gTraceRingList		= NULL;
+static int						gTraceRingCount		= 0;
+static __thread TraceRing *		gTraceThreadRing	__attribute__( ( tls_model( "initial-exec" ) ) );
+static __thread Boolean			gTraceThreadNoRing	__attribute__( ( tls_model( "initial-exec" ) ) );
+
+//===========================================================================================================================
+//	TraceRecordEvent
+//===========================================================================================================================
+
+void	TraceRecordEvent( const TraceEvent *inEvent, int32_t inArg0, int32_t inArg1, int32_t inArg2, int32_t inArg3 )
+{
+	TraceRing *			ring;
+	TraceRecord *		record;
+	uint32_t			count;
+	
+	ring = gTraceThreadRing;
+	if( unlikely( !ring ) )
+	{
+		if( gTraceThreadNoRing ) return;
+		ring = _TraceRingAcquire();
+		if( !ring ) return;
+	}
+	
+	// Only this thread writes to its ring so it can write the next record without a lock. The count is updated after
+	// the record is complete so readers never see records that are still being written.
+	
+	count			= ring->count;
+	record			= &ring->records[ count & ( kTraceRingRecordCount - 1 ) ];
+	record->ticks	= UpTicks();
+	record->event	= inEvent;
+	record->args[ 0 ] = inArg0;
+	record->args[ 1 ] = inArg1;
+	record->args[ 2 ] = inArg2;
+	record->args[ 3 ] = inArg3;
+	trace_store_barrier();
+	ring->count = count + 1;
+}
+
+//===========================================================================================================================
+//	TraceSetEnabled
+//===========================================================================================================================
+
+void	TraceSetEnabled( Boolean inEnabled )
+{
+	gTraceEnabled = inEnabled;
+}
+
+//===========================================================================================================================
+//	TraceClear
+//===========================================================================================================================
+
+void	TraceClear( void )
+{
+	TraceRing *		ring;
+	
+	pthread_mutex_lock( &gTraceLock );
+	for( ring = gTraceRingList; ring; ring = ring->next )
+	{
+		ring->start = ring->count;
+	}
+	pthread_mutex_unlock( &gTraceLock );
+}
+
+//===========================================================================================================================
+//	TraceWriteChromeJSON
+//===========================================================================================================================
+
+OSStatus	TraceWriteChromeJSON( const char *inPath, size_t *outCount )
+{
+	OSStatus			err;
+	FILE *				file;
+	TraceRecord *		records = NULL;
+	TraceRing *			ring;
+	uint64_t			threadID;
+	char				threadName[ 32 ];
+	uint32_t			start, end, count, i, skip;
+	size_t				total = 0;
+	int					pid;
+	double				usecPerTick;
+	
+	file = fopen( inPath, "w" );
+	err = map_global_value_errno( file, file );
+	require_noerr_quiet( err, exit );
+	
+	records = (TraceRecord *) malloc( kTraceRingRecordCount * sizeof( *records ) );
+	require_action( records, exit, err = kNoMemoryErr );
+	
+	pid			= (int) getpid();
+	usecPerTick	= 1000000.0 / UpTicksPerSecond();
+	fprintf( file, "{\"traceEvents\":[\n" );
+	fprintf( file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}", 
+		pid, getprogname() );
+	
+	pthread_mutex_lock( &gTraceLock );
+	ring = gTraceRingList;
+	pthread_mutex_unlock( &gTraceLock );
+	for( ; ring; ring = ring->next )
+	{
+		// Copy the records then re-read the count to find out which records the thread may have overwritten during
+		// the copy. The oldest record in a full ring is skipped because the thread may be writing over it right now.
+		// The lock keeps the ring from being cleared or reused by another thread while it's being copied.
+		
+		pthread_mutex_lock( &gTraceLock );
+		end = ring->count;
+		atomic_read_barrier();
+		start = ring->start;
+		if( ( end - start ) > kTraceRingRecordCount ) start = end - kTraceRingRecordCount;
+		for( i = start; i != end; ++i )
+		{
+			records[ i - start ] = ring->records[ i & ( kTraceRingRecordCount - 1 ) ];
+		}
+		atomic_read_barrier();
+		count = ring->count;
+		threadID = ring->threadID;
+		memcpy( threadName, ring->threadName, sizeof( threadName ) );
+		pthread_mutex_unlock( &gTraceLock );
+		
+		skip = 0;
+		if( ( count - start ) >= kTraceRingRecordCount ) skip = Min( ( count - start ) - ( kTraceRingRecordCount - 1 ), end - start );
+		if( ( start + skip ) == end ) continue;
+		
+		fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%llu,\"args\":{\"name\":\"%s\"}}", 
+			pid, (unsigned long long) threadID, threadName );
+		for( i = skip; i < ( end - start ); ++i )
+		{
+			_TraceWriteRecord( file, &records[ i ], pid, threadID, usecPerTick );
+		}
+		total += ( end - start ) - skip;
+	}
+	fprintf( file, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+	
+	err = ferror( file ) ? kWriteErr : kNoErr;
+	require_noerr( err, exit );
+	if( outCount ) *outCount = total;
+	
+exit:
+	FreeNullSafe( records );
+	if( file ) fclose( file );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_TraceRingAcquire
+//===========================================================================================================================
+
+static TraceRing *	_TraceRingAcquire( void )
+{
+	TraceRing *		ring;
+	TraceRing *		oldest;
+	
+	pthread_once( &gTraceKeyOnce, _TraceInitializeKey );
+	
+	pthread_mutex_lock( &gTraceLock );
+	if( gTraceRingCount < kTraceRingMaxCount )
+	{
+		ring = (TraceRing *) calloc( 1, sizeof( *ring ) );
+		if( ring )
+		{
+			ring->next		= gTraceRingList;
+			gTraceRingList	= ring;
+			++gTraceRingCount;
+		}
+	}
+	else
+	{
+		// Reuse the ring of the thread that exited the longest time ago.
+		
+		oldest = NULL;
+		for( ring = gTraceRingList; ring; ring = ring->next )
+		{
+			if( ring->active ) continue;
+			if( !oldest || ( ring->records[ ( ring->count - 1 ) & ( kTraceRingRecordCount - 1 ) ].ticks < 
+				oldest->records[ ( oldest->count - 1 ) & ( kTraceRingRecordCount - 1 ) ].ticks ) )
+			{
+				oldest = ring;
+			}
+		}
+		ring = oldest;
+		if( ring )
+		{
+			ring->count = 0;
+			ring->start = 0;
+		}
+	}
+	if( ring )
+	{
+		ring->active = true;
+		_TraceGetThreadInfo( &ring->threadID, ring->threadName, sizeof( ring->threadName ) );
+	}
+	pthread_mutex_unlock( &gTraceLock );
+	
+	// Mark the thread so it doesn't keep trying if no rings are available. The key's destructor marks the ring as
+	// inactive when the thread exits so a later thread can reuse it.
+	
+	if( ring && gTraceKeyValid ) pthread_setspecific( gTraceKey, ring );
+	gTraceThreadRing	= ring;
+	gTraceThreadNoRing	= ( ring == NULL );
+	return( ring );
+}
+
+//===========================================================================================================================
+//	_TraceRingRelease
+//===========================================================================================================================
+
+static void	_TraceRingRelease( void *inArg )
+{
+	TraceRing * const		ring = (TraceRing *) inArg;
+	
+	pthread_mutex_lock( &gTraceLock );
+	ring->active = false;
+	pthread_mutex_unlock( &gTraceLock );
+}
+
+//===========================================================================================================================
+//	_TraceInitializeKey
+//===========================================================================================================================
+
+static void	_TraceInitializeKey( void )
+{
+	OSStatus		err;
+	
+	err = pthread_key_create( &gTraceKey, _TraceRingRelease );
+	check_noerr( err );
+	gTraceKeyValid = !err;
+}
+
+//===========================================================================================================================
+//	_TraceGetThreadInfo
+//===========================================================================================================================
+
+static void	_TraceGetThreadInfo( uint64_t *outThreadID, char *inNameBuf, size_t inNameMaxLen )
+{
+	char *		ptr;
+	
+#if( TARGET_OS_LINUX )
+	char		name[ 17 ]; // PR_GET_NAME needs at least 16 bytes.
+	
+	*outThreadID = (uint64_t) syscall( SYS_gettid );
+	memset( name, 0, sizeof( name ) );
+	prctl( PR_GET_NAME, (unsigned long) name, 0, 0, 0 );
+	strlcpy( inNameBuf, name, inNameMaxLen );
+#elif( TARGET_OS_DARWIN )
+	pthread_threadid_np( NULL, outThreadID );
+	*inNameBuf = '\0';
+	pthread_getname_np( pthread_self(), inNameBuf, inNameMaxLen );
+#else
+	*outThreadID = (uint64_t)(uintptr_t) pthread_self();
+	*inNameBuf = '\0';
+#endif
+	
+	// Replace characters that would need to be escaped in JSON.
+	
+	for( ptr = inNameBuf; *ptr != '\0'; ++ptr )
+	{
+		if( ( *ptr == '"' ) || ( *ptr == '\\' ) || !isprint_safe( *ptr ) ) *ptr = '_';
+	}
+}
+
+//===========================================================================================================================
+//	_TraceWriteRecord
+//===========================================================================================================================
+
+static void	_TraceWriteRecord( FILE *inFile, const TraceRecord *inRecord, int inPID, uint64_t inThreadID, double inUSecPerTick )
+{
+	const TraceEvent * const		event = inRecord->event;
+	const char *					names;
+	const char *					end;
+	size_t							i;
+	
+	fprintf( inFile, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%llu", 
+		event->name, event->phase, inRecord->ticks * inUSecPerTick, inPID, (unsigned long long) inThreadID );
+	if( event->phase == kTracePhase_Instant ) fputs( ",\"s\":\"t\"", inFile );
+	fputs( ",\"args\":{", inFile );
+	names = event->argNames;
+	for( i = 0; names && ( *names != '\0' ) && ( i < countof( inRecord->args ) ); ++i )
+	{
+		for( end = names; ( *end != '\0' ) && ( *end != ',' ); ++end ) {}
+		fprintf( inFile, "%s\"%.*s\":%d", ( i > 0 ) ? "," : "", (int)( end - names ), names, inRecord->args[ i ] );
+		names = ( *end != '\0' ) ? ( end + 1 ) : end;
+	}
+	fputs( "}}", inFile );
+}
+#endif // TRACEUTILS_ENABLED
+
+#if 0
+#pragma mark -
+#pragma mark == Debugging ==
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+
+#if( TRACEUTILS_ENABLED )
+#define kTraceUtilsTestBudgetNanos		100 // Max average time to record an event while tracing is enabled.
+
+trace_define( TraceTestBegin,	kTracePhase_Begin,		"index,value" );
+trace_define( TraceTestEnd,		kTracePhase_End,		"" );
+trace_define( TraceTestCounter,	kTracePhase_Counter,	"a,b,c,d" );
+trace_define( TraceTestInstant,	kTracePhase_Instant,	"seq" );
+
+static OSStatus	_TraceUtils_TestPerf( void );
+static void *	_TraceUtils_TestThread( void *inArg );
+static char *	_TraceUtils_TestReadFile( const char *inPath, OSStatus *outErr );
+static size_t	_TraceUtils_TestCount( const char *inStr, const char *inSubStr );
+#endif
+
+//===========================================================================================================================
+//	TraceUtils_Test
+//===========================================================================================================================
+
+OSStatus	TraceUtils_Test( int inPrint, int inPerf )
+{
+	OSStatus		err;
+#if( TRACEUTILS_ENABLED )
+	char			path[ 64 ];
+	char			str[ 32 ];
+	char *			json = NULL;
+	pthread_t		thread;
+	size_t			count;
+	int				i;
+	
+	snprintf( path, sizeof( path ), "/tmp/TraceUtils_Test-%d.json", (int) getpid() );
+	TraceClear();
+	
+	// Nothing should be recorded while tracing is disabled.
+	
+	TraceSetEnabled( false );
+	trace_event( TraceTestInstant, 1, 0, 0, 0 );
+	err = TraceWriteChromeJSON( path, &count );
+	require_noerr( err, exit );
+	require_action( count == 0, exit, err = kResponseErr );
+	
+	// Events from multiple threads.
+	
+	TraceSetEnabled( true );
+	for( i = 0; i < 10; ++i )
+	{
+		trace_event( TraceTestBegin, i, i * 100, 0, 0 );
+		trace_event( TraceTestEnd, 0, 0, 0, 0 );
+	}
+	trace_event( TraceTestCounter, 1, -2, 3, -4 );
+	err = pthread_create( &thread, NULL, _TraceUtils_TestThread, NULL );
+	require_noerr( err, exit );
+	pthread_join( thread, NULL );
+	
+	err = TraceWriteChromeJSON( path, &count );
+	require_noerr( err, exit );
+	require_action( count == 24, exit, err = kResponseErr );
+	json = _TraceUtils_TestReadFile( path, &err );
+	require_noerr( err, exit );
+	if( inPrint ) fprintf( stderr, "%s", json );
+	require_action( _TraceUtils_TestCount( json, "\"name\":\"TraceTestBegin\",\"ph\":\"B\"" ) == 10, exit, err = kResponseErr );
+	require_action( _TraceUtils_TestCount( json, "\"name\":\"TraceTestEnd\",\"ph\":\"E\"" ) == 10, exit, err = kResponseErr );
+	require_action( _TraceUtils_TestCount( json, "\"args\":{}" ) == 10, exit, err = kResponseErr );
+	require_action( _TraceUtils_TestCount( json, "\"ph\":\"i\",\"ts\"" ) == 3, exit, err = kResponseErr );
+	require_action( _TraceUtils_TestCount( json, "\"s\":\"t\"" ) == 3, exit, err = kResponseErr );
+	require_action( strstr( json, "\"args\":{\"index\":9,\"value\":900}}" ), exit, err = kResponseErr );
+	require_action( strstr( json, "\"args\":{\"a\":1,\"b\":-2,\"c\":3,\"d\":-4}}" ), exit, err = kResponseErr );
+	require_action( strstr( json, "\"args\":{\"name\":\"TraceTestThread\"}}" ), exit, err = kResponseErr );
+	require_action( strstr( json, "\"args\":{\"seq\":2}}" ), exit, err = kResponseErr );
+	ForgetMem( &json );
+	
+	// Only the newest records should be kept when a ring wraps.
+	
+	TraceClear();
+	for( i = 0; i < ( kTraceRingRecordCount + 100 ); ++i )
+	{
+		trace_event( TraceTestInstant, i, 0, 0, 0 );
+	}
+	err = TraceWriteChromeJSON( path, &count );
+	require_noerr( err, exit );
+	require_action( count == ( kTraceRingRecordCount - 1 ), exit, err = kResponseErr );
+	json = _TraceUtils_TestReadFile( path, &err );
+	require_noerr( err, exit );
+	require_action( !strstr( json, "{\"seq\":100}" ), exit, err = kResponseErr );
+	require_action( strstr( json, "{\"seq\":101}" ), exit, err = kResponseErr );
+	snprintf( str, sizeof( str ), "{\"seq\":%d}", kTraceRingRecordCount + 99 );
+	require_action( strstr( json, str ), exit, err = kResponseErr );
+	ForgetMem( &json );
+	
+	// Clearing should drop everything recorded before it.
+	
+	TraceClear();
+	err = TraceWriteChromeJSON( path, &count );
+	require_noerr( err, exit );
+	require_action( count == 0, exit, err = kResponseErr );
+	
+	if( inPerf )
+	{
+		err = _TraceUtils_TestPerf();
+		require_noerr( err, exit );
+	}
+	
+exit:
+	TraceSetEnabled( false );
+	TraceClear();
+	FreeNullSafe( json );
+	remove( path );
+#else
+	(void) inPrint;
+	(void) inPerf;
+	
+	err = kNoErr;
+#endif
+	printf( "TraceUtils_Test: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+#if( TRACEUTILS_ENABLED )
+//===========================================================================================================================
+//	_TraceUtils_TestPerf
+//===========================================================================================================================
+
+static OSStatus	_TraceUtils_TestPerf( void )
+{
+	OSStatus		err;
+	int				i, n;
+	uint64_t		ticks;
+	double			enabledNanos, disabledNanos, upTicksNanos;
+	
+	n = 2000000;
+	
+	TraceSetEnabled( false );
+	ticks = UpTicks();
+	for( i = 0; i < n; ++i ) trace_event( TraceTestCounter, i, n, 0, 0 );
+	disabledNanos = ( ( UpTicks() - ticks ) * 1E9 ) / ( ( (double) UpTicksPerSecond() ) * n );
+	
+	TraceSetEnabled( true );
+	ticks = UpTicks();
+	for( i = 0; i < n; ++i ) trace_event( TraceTestCounter, i, n, 0, 0 );
+	enabledNanos = ( ( UpTicks() - ticks ) * 1E9 ) / ( ( (double) UpTicksPerSecond() ) * n );
+	TraceSetEnabled( false );
+	
+	ticks = UpTicks();
+	for( i = 0; i < n; ++i ) UpTicks();
+	upTicksNanos = ( ( UpTicks() - ticks ) * 1E9 ) / ( ( (double) UpTicksPerSecond() ) * n );
+	
+	fprintf( stderr, "\tTrace event: %.1f ns enabled (%.1f ns of it UpTicks), %.1f ns disabled, budget %d ns\n", 
+		enabledNanos, upTicksNanos, disabledNanos, kTraceUtilsTestBudgetNanos );
+	require_action( enabledNanos < kTraceUtilsTestBudgetNanos, exit, err = kRangeErr );
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_TraceUtils_TestThread
+//===========================================================================================================================
+
+static void *	_TraceUtils_TestThread( void *inArg )
+{
+	int		i;
+	
+	(void) inArg;
+	
+	pthread_setname_np_compat( "TraceTestThread" );
+	for( i = 0; i < 3; ++i )
+	{
+		trace_event( TraceTestInstant, i, 0, 0, 0 );
+	}
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_TraceUtils_TestReadFile
+//===========================================================================================================================
+
+static char *	_TraceUtils_TestReadFile( const char *inPath, OSStatus *outErr )
+{
+	OSStatus		err;
+	FILE *			file;
+	char *			buf = NULL;
+	long			len;
+	
+	file = fopen( inPath, "r" );
+	err = map_global_value_errno( file, file );
+	require_noerr( err, exit );
+	
+	fseek( file, 0, SEEK_END );
+	len = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	require_action( len >= 0, exit, err = kReadErr );
+	
+	buf = (char *) malloc( ( (size_t) len ) + 1 );
+	require_action( buf, exit, err = kNoMemoryErr );
+	require_action( fread( buf, 1, (size_t) len, file ) == (size_t) len, exit, err = kReadErr; ForgetMem( &buf ) );
+	buf[ len ] = '\0';
+	
+exit:
+	if( file ) fclose( file );
+	*outErr = err;
+	return( buf );
+}
+
+//===========================================================================================================================
+//	_TraceUtils_TestCount
+//===========================================================================================================================
+
+static size_t	_TraceUtils_TestCount( const char *inStr, const char *inSubStr )
+{
+	size_t		n = 0;
+	
+	while( ( inStr = strstr( inStr, inSubStr ) ) != NULL )
+	{
+		++n;
+		inStr += strlen( inSubStr );
+	}
+	return( n );
+}
+#endif // TRACEUTILS_ENABLED
+#endif // !EXCLUDE_UNIT_TESTS
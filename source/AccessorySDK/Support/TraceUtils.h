@@ -0,0 +1,167 @@
+/*
+	File:    	TraceUtils.h
+	Package: 	Apple CarPlay Communication Plug-in.
+	Abstract: 	n/a 
+	Version: 	410.12
+	
+	Disclaimer: IMPORTANT: This Apple software is supplied to you, by Apple Inc. ("Apple"), in your
+	capacity as a current, and in good standing, Licensee in the MFi Licensing Program. Use of this
+	Apple software is governed by and subject to the terms and conditions of your MFi License,
+	including, but not limited to, the restrictions specified in the provision entitled ”Public 
+	Software”, and is further subject to your agreement to the following additional terms, and your 
+	agreement that the use, installation, modification or redistribution of this Apple software
+	constitutes acceptance of these additional terms. If you do not agree with these additional terms,
+	please do not use, install, modify or redistribute this Apple software.
+	
+	Subject to all of these terms and in consideration of your agreement to abide by them, Apple grants
+	you, for as long as you are a current and in good-standing MFi Licensee, a personal, non-exclusive 
+	license, under Apple's copyrights in this original Apple software (the "Apple Software"), to use, 
+	reproduce, and modify the Apple Software in source form, and to use, reproduce, modify, and 
+	redistribute the Apple Software, with or without modifications, in binary form. While you may not 
+	redistribute the Apple Software in source form, should you redistribute the Apple Software in binary
+	form, you must retain this notice and the following text and disclaimers in all such redistributions
+	of the Apple Software. Neither the name, trademarks, service marks, or logos of Apple Inc. may be
+	used to endorse or promote products derived from the Apple Software without specific prior written
+	permission from Apple. Except as expressly stated in this notice, no other rights or licenses, 
+	express or implied, are granted by Apple herein, including but not limited to any patent rights that
+	may be infringed by your derivative works or by other works in which the Apple Software may be 
+	incorporated.  
+	
+	Unless you explicitly state otherwise, if you provide any ideas, suggestions, recommendations, bug 
+	fixes or enhancements to Apple in connection with this software (“Feedback”), you hereby grant to
+	Apple a non-exclusive, fully paid-up, perpetual, irrevocable, worldwide license to make, use, 
+	reproduce, incorporate, modify, display, perform, sell, make or have made derivative works of,
+	distribute (directly or indirectly) and sublicense, such Feedback in connection with Apple products 
+	and services. Providing this Feedback is voluntary, but if you do provide Feedback to Apple, you 
+	acknowledge and agree that Apple may exercise the license granted above without the payment of 
+	royalties or further consideration to Participant.
+	
+	The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR 
+	IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+	AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR
+	IN COMBINATION WITH YOUR PRODUCTS.
+	
+	IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES 
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+	PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION 
+	AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+	(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+	POSSIBILITY OF SUCH DAMAGE.
+	
+	Copyright (C) 2006-2016 Apple Inc. All Rights Reserved. Not to be used or disclosed without permission from Apple.
+*/
+
+#ifndef	__TraceUtils_h__
+#define	__TraceUtils_h__
+
+#include "CommonServices.h"
+#include "DebugServices.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// TRACEUTILS_ENABLED -- Controls whether the trace recorder is compiled in.
+
+#if( !defined( TRACEUTILS_ENABLED ) )
+	#if( TARGET_OS_POSIX && ( COMPILER_CLANG || ( COMPILER_GCC >= 40500 ) ) )
+		#define TRACEUTILS_ENABLED		1
+	#else
+		#define TRACEUTILS_ENABLED		0
+	#endif
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	group		TraceUtils
+	@abstract	Low overhead binary event tracing for real-time code.
+	@discussion
+	
+	Each thread records events to its own ring buffer of fixed-size records holding the time, a pointer to the static
+	event description, and up to 4 integer arguments. Recording an event doesn't take a lock, allocate memory, or
+	format anything so it's cheap enough to leave in time-critical paths like audio rendering. When the ring buffer is
+	full, the oldest records are overwritten so the rings always hold the most recent history of each thread.
+	
+	Events are defined once per file with trace_define and recorded with trace_event. Nothing is recorded until tracing
+	is enabled with TraceSetEnabled. The rings can be written out as Chrome trace event JSON for chrome://tracing or
+	Perfetto with TraceWriteChromeJSON.
+	
+	Example:
+	
+		trace_define( AudioRender,		kTracePhase_Begin,	"rtpTime,size" );
+		trace_define( AudioRenderDone,	kTracePhase_End,	"glitches" );
+		
+		trace_event( AudioRender, rtpTime, size, 0, 0 );
+		...
+		trace_event( AudioRenderDone, glitchCount, 0, 0, 0 );
+	
+	Begin and end events are matched by thread so an end event must be recorded on the same thread as its begin event.
+	The name of an end event isn't shown. The arguments of counter events are shown as graphs.
+*/
+typedef char		TracePhase;
+#define kTracePhase_Instant		'i' // Point in time.
+#define kTracePhase_Begin		'B' // Start of a duration on this thread.
+#define kTracePhase_End			'E' // End of the most recent duration on this thread.
+#define kTracePhase_Counter		'C' // Values to graph over time.
+
+typedef struct
+{
+	const char *		name;		// Name of the event.
+	const char *		argNames;	// Comma-separated names of the arguments (e.g. "seq,ts"). Unnamed args aren't written.
+	TracePhase			phase;		// Type of event.
+	
+}	TraceEvent;
+
+typedef struct
+{
+	uint64_t				ticks;		// UpTicks() when the event was recorded.
+	const TraceEvent *		event;		// Static description of the event.
+	int32_t					args[ 4 ];	// Arguments. Meaning depends on the event.
+	
+}	TraceRecord;
+
+#if( TRACEUTILS_ENABLED )
+	extern volatile Boolean		gTraceEnabled;
+	
+	#define TraceIsEnabled()		gTraceEnabled // Use to skip work only needed to compute event arguments.
+	
+	#define trace_define( NAME, PHASE, ARG_NAMES )																				\
+		static const TraceEvent		gTraceEvent_ ## NAME = { # NAME, ARG_NAMES, PHASE }
+	
+	#define trace_event( NAME, A0, A1, A2, A3 )																				\
+		do																													\
+		{																													\
+			if( gTraceEnabled )																								\
+			{																												\
+				TraceRecordEvent( &gTraceEvent_ ## NAME, (int32_t)(A0), (int32_t)(A1), (int32_t)(A2), (int32_t)(A3) );		\
+			}																												\
+																															\
+		}	while( 0 )
+	
+	void		TraceRecordEvent( const TraceEvent *inEvent, int32_t inArg0, int32_t inArg1, int32_t inArg2, int32_t inArg3 );
+	void		TraceSetEnabled( Boolean inEnabled );
+	void		TraceClear( void );
+	OSStatus	TraceWriteChromeJSON( const char *inPath, size_t *outCount );
+#else
+	#define trace_define( NAME, PHASE, ARG_NAMES )		typedef int		gTraceEvent_ ## NAME ## _unused
+	#define trace_event( NAME, A0, A1, A2, A3 )			do { if( 0 ) { (void)(A0); (void)(A1); (void)(A2); (void)(A3); } } while( 0 )
+	#define TraceIsEnabled()							0
+	#define TraceSetEnabled( ENABLED )					do {} while( 0 )
+	#define TraceClear()								do {} while( 0 )
+	#define TraceWriteChromeJSON( PATH, OUT_COUNT )		kUnsupportedErr
+#endif
+
+#if 0
+#pragma mark == Debugging ==
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	TraceUtils_Test
+	@abstract	Unit test. If inPerf is non-zero, also measures the cost of recording an event.
+*/
+OSStatus	TraceUtils_Test( int inPrint, int inPerf );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TraceUtils_h__
@@ -80,6 +80,12 @@
 		#define AIRPLAY_THREADED_MAIN		0
 #endif
 
+// AIRPLAY_ALLOC_TRACKING: 1=Interpose the allocator to count calls made while rendering audio (glibc only, for testing).
+
+#if( !defined( AIRPLAY_ALLOC_TRACKING ) )
+	#define AIRPLAY_ALLOC_TRACKING		0
+#endif
+
 // AIRTUNES_DYNAMIC_PORTS: 1=Bind to dynamic ports. 0=bind to fixed ports.
 
 #if( !defined( AIRTUNES_DYNAMIC_PORTS ) )
@@ -1105,6 +1111,12 @@ typedef uint64_t	AirPlayFeatures;
 // [Number:uint32_t] Sample time.
 #define kAirPlayKey_SampleTime			"sampleTime"
 
+// [Number] Config: Number of screen frames queued for the decode stage. 0=Decode on the decrypt stage's thread.
+#define kAirPlayKey_ScreenDecodeQueueDepth		"screenDecodeQueueDepth"
+
+// [Number] Config: Number of screen frames queued for the decrypt stage. 0=Decrypt on the read stage's thread.
+#define kAirPlayKey_ScreenDecryptQueueDepth		"screenDecryptQueueDepth"
+
 // [Dictionary] Vendor specific screen stream configuration data. Keys are vendor specific.
 #define kAirPlayKey_ScreenStreamOptions	"screenStreamOptions"
 
@@ -1249,6 +1261,11 @@ typedef uint64_t	AirPlayFeatures;
 #endif
 	#define kAirPlaySecondaryLogConfig				"?.*:output2=file;path=/tmp/AirPlay.log;roll=128K#2"
 
+#if( !defined( AIRPLAY_LOG_ASYNC ) )
+		#define AIRPLAY_LOG_ASYNC					1
+#endif
+	#define kAirPlayLogAsyncConfig					"LogUtils:async=on" // Keep logging off the audio and screen threads.
+
 #if( DEBUG || 0 ) 
 	#define kAirPlayPhaseLogLevel		kLogLevelNotice
 #else
@@ -2221,6 +2238,12 @@ check_compile_time( sizeof( AirPlayScreenHeader )				== 128 );
 	#ifndef kAirPlayThreadPriority_ScreenReceiver
 	#define kAirPlayThreadPriority_ScreenReceiver	60 // airtunesd: Receives screen frames.
 	#endif
+	#ifndef kAirPlayThreadPriority_ScreenDecryptor
+	#define kAirPlayThreadPriority_ScreenDecryptor	60 // airtunesd: Decrypts screen frames.
+	#endif
+	#ifndef kAirPlayThreadPriority_ScreenDecoder
+	#define kAirPlayThreadPriority_ScreenDecoder	60 // airtunesd: Hands screen frames to the decoder.
+	#endif
 #ifndef kAirPlayThreadPriority_AudioDecoder
 #define kAirPlayThreadPriority_AudioDecoder			61 // airtunesd: Decodes audio
 #endif
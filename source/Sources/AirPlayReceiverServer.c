@@ -63,6 +63,7 @@
 #include "StringUtils.h"
 #include "ThreadUtils.h"
 #include "TickUtils.h"
+#include "TraceUtils.h"
 #include "UUIDUtils.h"
 
 #include "AirPlayCommon.h"
@@ -1292,6 +1293,54 @@ static OSStatus	_HandleDebug( CFDictionaryRef inRequest, CFDictionaryRef *outRes
 		require_noerr( err, exit );
 	}
 	
+	// Trace
+	
+	else if( CFEqual( opcode, kDebugIPCOpCode_Trace ) )
+	{
+		char		action[ 16 ];
+		char		path[ PATH_MAX + 1 ];
+		size_t		count;
+		
+		CFDictionaryGetCString( inRequest, kDebugIPCKey_Value, action, sizeof( action ), &err );
+		require_noerr( err, exit );
+		
+		if( strcmp( action, "start" ) == 0 )
+		{
+			TraceSetEnabled( true );
+		}
+		else if( strcmp( action, "stop" ) == 0 )
+		{
+			TraceSetEnabled( false );
+		}
+		else if( strcmp( action, "clear" ) == 0 )
+		{
+			TraceClear();
+		}
+		else if( strcmp( action, "dump" ) == 0 )
+		{
+			// The trace is usually too big to send back so write it to the path the client asked for.
+			
+			CFDictionaryGetCString( inRequest, kDebugIPCKey_Path, path, sizeof( path ), &err );
+			require_noerr( err, exit );
+			
+			count = 0;
+			err = TraceWriteChromeJSON( path, &count );
+			if( err )	DataBuffer_AppendF( &dataBuf, "### Write trace to '%s' failed: %#m\n", path, err );
+			else		DataBuffer_AppendF( &dataBuf, "Wrote %zu trace events to '%s'\n", count, path );
+		}
+		else
+		{
+			aprs_dlog( kLogLevelNotice, "### Unsupported trace command: '%s'\n", action );
+			err = kParamErr;
+			goto exit;
+		}
+		
+		DataBuffer_AppendF( &dataBuf, "Tracing %s\n", TraceIsEnabled() ? "enabled" : "disabled" );
+		err = CFPropertyListCreateFormatted( NULL, &response, "{%kO=%.*s}",
+											kDebugIPCKey_Value, (int) dataBuf.bufferLen, dataBuf.bufferPtr );
+		require_noerr( err, exit );
+	}
+	
 	// Other
 	
 	else
@@ -1332,6 +1381,9 @@ static void	_GlobalInitialize( void *inContext )
 	// Setup logging.
 	
 	AirPlayReceiverServerSetLogLevel();
+#if( AIRPLAY_LOG_ASYNC )
+	LogControl( kAirPlayLogAsyncConfig );
+#endif
 	
 #if  ( TARGET_OS_POSIX && DEBUG )
 	DebugIPC_EnsureInitialized( _HandleDebug, NULL );
@@ -2493,22 +2545,31 @@ static HTTPStatus _requestProcessCommand( AirPlayReceiverConnectionRef inCnx, HT
 {
 	HTTPStatus				status;
 	OSStatus				err;
-	CFDictionaryRef			requestDict = NULL;
+	CFBinaryPlistCursor		requestPlist, value;
 	CFStringRef				command = NULL;
-	CFDictionaryRef			params;
+	CFDictionaryRef			params = NULL;
 	CFDictionaryRef			responseDict;
 	
+	// Only the command type and its params are needed so create objects for those instead of the whole request.
+	
 	if( inRequest->bodyOffset > 0 ) {
-		requestDict = (CFDictionaryRef)CFBinaryPlistV0CreateWithData( inRequest->bodyPtr, inRequest->bodyOffset, &err );
+		err = CFBinaryPlistCursorInit( &requestPlist, inRequest->bodyPtr, inRequest->bodyOffset );
 		require_noerr_action( err, exit, status = kHTTPStatus_BadRequest );
-		require_action( CFGetTypeID( requestDict ) == CFDictionaryGetTypeID() , exit, status = kHTTPStatus_BadRequest );
+		require_action( CFBinaryPlistCursorGetTypeID( &requestPlist ) == CFDictionaryGetTypeID() , exit, status = kHTTPStatus_BadRequest );
+		
+		if( CFBinaryPlistCursorGetValue( &requestPlist, kAirPlayKey_Type, &value ) == kNoErr )
+		{
+			command = (CFStringRef) CFBinaryPlistCursorCopyObject( &value, NULL );
+			if( command && !CFIsType( command, CFString ) ) ForgetCF( &command );
+		}
+		if( CFBinaryPlistCursorGetValue( &requestPlist, kAirPlayKey_Params, &value ) == kNoErr )
+		{
+			params = (CFDictionaryRef) CFBinaryPlistCursorCopyObject( &value, NULL );
+			if( params && !CFIsType( params, CFDictionary ) ) ForgetCF( &params );
+		}
 	}
-	
-	command = CFDictionaryGetCFString( requestDict, CFSTR( kAirPlayKey_Type ), NULL );
 	require_action( command, exit, err = kParamErr; status = kHTTPStatus_ParameterNotUnderstood );
 	
-	params = CFDictionaryGetCFDictionary( requestDict, CFSTR( kAirPlayKey_Params ), NULL );
-	
 	// Perform the command and send its response.
 	
 	require_action( inCnx->session, exit, err = kNotPreparedErr; status = kHTTPStatus_SessionNotFound );
@@ -2526,7 +2587,8 @@ static HTTPStatus _requestProcessCommand( AirPlayReceiverConnectionRef inCnx, HT
 	
 exit:
 	if( err ) aprs_ulog( kLogLevelNotice, "### Command '%@' failed: %#m, %#m\n", command, status, err );
-	CFReleaseNullSafe( requestDict );
+	CFReleaseNullSafe( command );
+	CFReleaseNullSafe( params );
 	return( status );
 }
 
@@ -2819,7 +2881,7 @@ static HTTPStatus _requestProcessInfo( AirPlayReceiverConnectionRef inCnx, HTTPM
 {
 	HTTPStatus					status;
 	OSStatus					err;
-	CFDictionaryRef				requestDict = NULL;
+	CFBinaryPlistCursor			requestPlist, value;
 	CFMutableArrayRef			qualifier = NULL;
 	CFDictionaryRef				responseDict;
 	const char *				src;
@@ -2835,15 +2897,20 @@ static HTTPStatus _requestProcessInfo( AirPlayReceiverConnectionRef inCnx, HTTPM
 		return( kHTTPStatus_MethodNotValidInThisState );
 	}
 
+	// Only the qualifier is needed so create an object for it instead of the whole request.
+	
 	if ( inRequest->bodyLen > 0 ) {
-		requestDict = (CFDictionaryRef)CFBinaryPlistV0CreateWithData( inRequest->bodyPtr, inRequest->bodyLen, &err );
+		err = CFBinaryPlistCursorInit( &requestPlist, inRequest->bodyPtr, inRequest->bodyLen );
 		require_noerr_action( err, exit, status = kHTTPStatus_BadRequest );
-		require_action( CFGetTypeID( requestDict ) == CFDictionaryGetTypeID() , exit, status = kHTTPStatus_BadRequest );
+		require_action( CFBinaryPlistCursorGetTypeID( &requestPlist ) == CFDictionaryGetTypeID() , exit, status = kHTTPStatus_BadRequest );
+		
+		if( CFBinaryPlistCursorGetValue( &requestPlist, kAirPlayKey_Qualifier, &value ) == kNoErr )
+		{
+			qualifier = (CFMutableArrayRef) CFBinaryPlistCursorCopyObject( &value, NULL );
+			if( qualifier && !CFIsType( qualifier, CFArray ) ) ForgetCF( &qualifier );
+		}
 	}
 	
-	qualifier = (CFMutableArrayRef) CFDictionaryGetCFArray( requestDict, CFSTR( kAirPlayKey_Qualifier ), NULL );
-	if( qualifier ) CFRetain( qualifier );
-	
 	src = inRequest->header.url.queryPtr;
 	end = src + inRequest->header.url.queryLen;
 	while( ( err = URLGetOrCopyNextVariable( src, end, &namePtr, &nameLen, &nameBuf, NULL, NULL, NULL, &src ) ) == kNoErr )
@@ -2863,7 +2930,6 @@ static HTTPStatus _requestProcessInfo( AirPlayReceiverConnectionRef inCnx, HTTPM
 	
 exit:
 	CFReleaseNullSafe( qualifier );
-	CFReleaseNullSafe( requestDict );
 	if( err ) aprs_ulog( kLogLevelNotice, "### Get info failed: %#m, %#m\n", status, err );
 	return( status );
 }
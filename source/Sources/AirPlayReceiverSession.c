@@ -80,6 +80,7 @@
 #include "StringUtils.h"
 #include "TickUtils.h"
 #include "TimeUtils.h"
+#include "TraceUtils.h"
 #include "UUIDUtils.h"
 
 #include <ctype.h>
@@ -129,9 +130,12 @@
 	#define kAirTunesBufferNodeCountUDP			512		// 512 nodes * 352 samples per node = ~4 seconds.
 	#define kAirTunesRetransmitMaxLoss			128		// Max contiguous loss to try to recover. ~2 second @ 44100 Hz
 	#define kAirTunesRetransmitCount			512		// Max number of outstanding retransmits.
+	#define kAirTunesRTPReceiveBatchSize		16		// Max RTP packets to read with a single receive call.
+	#define kAirTunesInputSendBatchSize			16		// Max input RTP packets to send with a single send call.
 
 	check_compile_time( kAirTunesBufferNodeCountUDP	<= kAirTunesDupWindowSize );
 	check_compile_time( kAirTunesRetransmitCount	<= kAirTunesDupWindowSize );
+	check_compile_time( kAirTunesInputSendBatchSize	<= kSocketSendPacketsMaxCount );
 
 #define kAirPlayEventTimeoutNS	(10ll * kNanosecondsPerSecond) // Timeout in nanosecond for event message
 #if 0
@@ -186,7 +190,11 @@ static OSStatus
 		CFDictionaryRef				inStreamDesc,
 		CFMutableDictionaryRef		inResponseParams );
 static void *	_GeneralAudioThread( void *inArg );
+static OSStatus	_GeneralAudioStartDecodeThread( AirPlayReceiverSessionRef me );
+static void		_GeneralAudioStopDecodeThread( AirPlayReceiverSessionRef me );
+static void *	_GeneralAudioDecodeThread( void *inArg );
 static OSStatus	_GeneralAudioReceiveRTCP( AirPlayReceiverSessionRef inSession, SocketRef inSock, RTCPType inExpectedType );
+static OSStatus	_GeneralAudioSetupBufferNodes( AirPlayReceiverSessionRef me );
 static OSStatus	_GeneralAudioReceiveRTP( AirPlayReceiverSessionRef inSession, RTPPacket *inPkt, size_t inSize );
 static OSStatus
 	_GeneralAudioProcessPacket( 
@@ -194,6 +202,12 @@ static OSStatus
 		AirTunesBufferNode *		inNode, 
 		size_t 						inSize, 
 		Boolean						inIsRetransmit );
+static void
+	_GeneralAudioGenerateAADForPacket( 
+		AirPlayAudioStreamContext * const	ctx,
+		const RTPPacket *					inRTPPacket,
+		uint8_t **							outAAD, 
+		size_t *							outAADSize );
 static OSStatus
 	_GeneralAudioDecodePacket( 
 		AirPlayReceiverSessionRef	inSession, 
@@ -225,7 +239,8 @@ static OSStatus
 		CFDictionaryRef				inRequestStreamDesc, 
 		CFMutableDictionaryRef		inResponseParams );
 static void *	_MainAltAudioThread( void *inArg );
-static void		_MainAltAudioProcessPacket( AirPlayAudioStreamContext * const ctx );
+static void		_MainAltAudioReceivePackets( AirPlayAudioStreamContext * const ctx );
+static OSStatus	_MainAltAudioProcessPacket( AirPlayAudioStreamContext * const ctx, RTPPacketNode *inNode, size_t inSize );
 static OSStatus	_MainAltAudioGetAADFromRTPHeader( AirPlayAudioStreamContext * const ctx, RTPHeader *inRTPHeaderPtr, uint8_t **outAAD, size_t *outAADLength );
 
 // Timing
@@ -285,7 +300,8 @@ static OSStatus
 		AudioBufferList *				ioData,
 		AudioStreamPacketDescription **	outDataPacketDescription,
 		void *							inUserData );
-#define _AudioDecoderConcealLoss( SESSION, PTR, LEN )	memset( (PTR), 0, (LEN) )
+#define _AudioDecoderConcealLoss( SESSION, PTR, LEN )	AirPlayLossConcealerConceal( &(SESSION)->lossConcealer, (PTR), (LEN) )
+#define _AudioDecoderPlayed( SESSION, PTR, LEN )		AirPlayLossConcealerPlayed( &(SESSION)->lossConcealer, (PTR), (LEN) )
 static OSStatus
 	_AudioEncoderEncodeCallback(
 		AudioConverterRef				inAudioConverter,
@@ -324,6 +340,14 @@ ulog_define( AirPlayReceiverStats,		kLogLevelNotice, kLogFlags_Default, "AirPlay
 #define atr_stats_ucat()				&log_category_from_name( AirPlayReceiverStats )
 #define atr_stats_ulog( LEVEL, ... )	ulog( atr_stats_ucat(), (LEVEL), __VA_ARGS__ )
 
+trace_define( AudioReceive,			kTracePhase_Begin,		"oneShot" );
+trace_define( AudioReceiveDone,		kTracePhase_End,		"packets,busy,err" );
+trace_define( AudioPacket,			kTracePhase_Instant,	"seq,ts,size,retransmit" );
+trace_define( AudioRender,			kTracePhase_Begin,		"rtpTime,size,busy" );
+trace_define( AudioRenderDone,		kTracePhase_End,		"glitches,some,flushing" );
+trace_define( AudioBusyNodes,		kTracePhase_Counter,	"busy" );
+trace_define( TimingResponse,		kTracePhase_Instant,	"offsetUs,rttUs,used,err" );
+
 #if 0
 #pragma mark == Globals ==
 #endif
@@ -779,7 +803,9 @@ static void _AirPlayReceiverSessionSendCommand( void * inCtx )
 	err = HTTPHeader_InitRequest( &msg->header, "POST", kAirPlayCommandPath, kAirTunesHTTPVersionStr );
 	require_noerr( err, exit );
 	
-	ptr = CFBinaryPlistV0Create( context->request, &len, NULL );
+	// Commands are small and sent often so skip uniquing. It only saves a few bytes on plists this small.
+	
+	ptr = CFBinaryPlistV0CreateEx( context->request, kCFBinaryPlistFlag_NoUniquing, &len, NULL );
 	require_action( ptr, exit, err = kUnknownErr );
 	err = HTTPMessageSetBodyPtr( msg, kMIMEType_AppleBinaryPlist, ptr, len );
 	require_noerr( err, exit );
@@ -1193,13 +1219,19 @@ OSStatus
 	
 	_SessionLock( inSession );
 	
+	// Wait for any packet being decoded ahead to finish so it can be flushed too and the decoder can be reset.
+	
+	while( inSession->decodeActive ) pthread_cond_wait( inSession->decodeConditionPtr, inSession->mutexPtr );
+	
 	// Reset state so we don't play until we get post-flush timelines, etc.
 	
 	inSession->flushing				= true;
 	inSession->flushTimeoutTS		= inFlushUntilTS + ( 3 * ctx->sampleRate ); // 3 seconds.
 	inSession->flushUntilTS			= inFlushUntilTS;
 	inSession->lastPlayedValid		= false;
+	inSession->decodeLastSeqValid	= false;
 	ats->rtcpRTDisable				= inSession->redundantAudio;
+	AirPlayLossConcealerReset( &inSession->lossConcealer ); // Don't conceal post-flush losses with pre-flush audio.
 	ats->receiveCount				= 0; // Reset so we don't try to retransmit on the next post-flush packet.
 	
 	// Drop packets in the queue that are earlier than the flush timestamp and abort any pending retransmits.
@@ -1249,27 +1281,41 @@ OSStatus
 		void *						inBuffer, 
 		size_t						inLen )
 {
+	uint64_t const	startTicks = UpTicks();
 	OSStatus		err;
+	uint64_t		allocs;
+	uint64_t		micros;
+	uint32_t		bucket;
 	
 	switch( inType )
 	{
 		
 		case kAirPlayStreamType_MainAudio:
 			_UpdateEstimatedRate( &inSession->mainAudioCtx, inSampleTime, inHostTime );
+			RTPJitterBufferSetSkew( &inSession->mainAudioCtx.jitterBuffer, inSession->mainAudioCtx.rateAvg );
 			err = RTPJitterBufferRead( &inSession->mainAudioCtx.jitterBuffer, inBuffer, inLen );
 			require_noerr( err, exit );
 			break;
 
 		case kAirPlayStreamType_MainHighAudio:
 			_UpdateEstimatedRate( &inSession->mainAudioCtx, inSampleTime, inHostTime );
+			AirPlayAllocTrackingBegin();
 			_SessionLock( inSession );
 			_GeneralAudioRender( inSession, inSampleTime, inBuffer, inLen );
 			_SessionUnlock( inSession );
+			allocs = AirPlayAllocTrackingEnd();
+			if( allocs > 0 )
+			{
+				gAirPlayAudioStats.renderAllocs += allocs;
+				atr_stats_ulog( kLogLevelWarning, "### %llu allocator calls while rendering, %llu total\n", 
+					(unsigned long long) allocs, (unsigned long long) gAirPlayAudioStats.renderAllocs );
+			}
 			err = kNoErr;
 			break;
 			
 		case kAirPlayStreamType_AltAudio:
 			_UpdateEstimatedRate( &inSession->altAudioCtx, inSampleTime, inHostTime );
+			RTPJitterBufferSetSkew( &inSession->altAudioCtx.jitterBuffer, inSession->altAudioCtx.rateAvg );
 			err = RTPJitterBufferRead( &inSession->altAudioCtx.jitterBuffer, inBuffer, inLen );
 			require_noerr( err, exit );
 			break;
@@ -1280,6 +1326,12 @@ OSStatus
 			goto exit;
 	}
 	
+	// Track how long rendering took. Bucket 0 is under 1 µs and each bucket after that doubles.
+	
+	micros = UpTicksToMicroseconds( UpTicks() - startTicks );
+	for( bucket = 0; ( micros > 0 ) && ( bucket < ( kAirPlayRenderHistogramBuckets - 1 ) ); micros >>= 1 ) ++bucket;
+	++gAirPlayAudioStats.renderHistogram[ bucket ];
+	
 exit:
 	return( err );
 }
@@ -1317,17 +1369,35 @@ static size_t _AirPlayReceiver_EncryptAudio(
     return( additionalPayload );
 }
 
+static void  _AirPlayReceiver_SendAudioPackets( AirPlayAudioStreamContext * const ctx, SocketPacketBuffer *inPkts, size_t inCount )
+{
+    size_t									sent, calls;
+    OSStatus								err;
+
+    err = SocketSendPackets( ctx->dataSock, inPkts, inCount, &ctx->inputAddr, ctx->inputAddrLen, &sent, &calls );
+    ctx->inputSendCalls		+= calls;
+    ctx->inputSendPackets	+= sent;
+    if( err )
+    {
+        // Packets after the failed one aren't retried. They're real-time audio so they'd be late anyway.
+
+        increment_saturate( ctx->sendErrors, UINT32_MAX );
+        atr_stats_ulog( kLogLevelNotice, "### Audio audio send error (%u total, %zu of %zu sent): %#m\n", 
+            ctx->sendErrors, sent, inCount, err );
+    }
+}
+
 static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
 {
-    RTPSavedPacket							pkt;
+    RTPSavedPacket *						pkt;
+    SocketPacketBuffer						pkts[ kAirTunesInputSendBatchSize ];
+    size_t									pktCount = 0;
     size_t									avail, len;
     size_t									maxPayloadSize;
     MirroredRingBuffer * const				ring    = ctx->inputRingRef;
     uint16_t								seq		= ctx->inputSeqNum;
     uint32_t								ts		= ctx->inputTimestamp;
     uint32_t								spp;
-    ssize_t									n;
-    OSStatus								err;
 	
     if( ctx->inputCryptor.isValid )
     {
@@ -1338,9 +1408,9 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
         maxPayloadSize = kAirTunesMaxPayloadSizeUDP;
     }
 
-    pkt.pkt.rtp.header.v_p_x_cc	= RTPHeaderInsertVersion( 0, kRTPVersion );
-    pkt.pkt.rtp.header.m_pt		= RTPHeaderInsertPayloadType( 0, ctx->type );
-    pkt.pkt.rtp.header.ssrc		= 0;
+    // Assemble every packet that's ready into its own slot so they can all go out with a single send call.
+    // Byte swapping, encoding, and encryption all write directly into the slot so there's no extra copying.
+
     for( ;; )
     {
         avail = MirroredRingBufferGetBytesUsed( ring );
@@ -1348,8 +1418,12 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
         spp = (uint32_t)( avail / ctx->bytesPerUnit );
         if( spp == 0 ) break;
         
-        pkt.pkt.rtp.header.seq	= htons( seq );
-        pkt.pkt.rtp.header.ts	= htonl( ts );
+        pkt = &ctx->inputPackets[ pktCount ];
+        pkt->pkt.rtp.header.v_p_x_cc	= RTPHeaderInsertVersion( 0, kRTPVersion );
+        pkt->pkt.rtp.header.m_pt		= RTPHeaderInsertPayloadType( 0, ctx->type );
+        pkt->pkt.rtp.header.seq			= htons( seq );
+        pkt->pkt.rtp.header.ts			= htonl( ts );
+        pkt->pkt.rtp.header.ssrc		= 0;
         
         if( ctx->inputConverter )
         {
@@ -1357,6 +1431,7 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
 			UInt32								packetCount;
 			AudioBufferList						outputList;
 			AudioStreamPacketDescription		packetDescription;
+			OSStatus							err;
             
             src = MirroredRingBufferGetReadPtr( ring );
             ctx->inputDataPtr							= src;
@@ -1365,7 +1440,7 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
             outputList.mNumberBuffers					= 1;
             outputList.mBuffers[ 0 ].mNumberChannels	= ctx->channels;
             outputList.mBuffers[ 0 ].mDataByteSize		= (UInt32)maxPayloadSize;
-            outputList.mBuffers[ 0 ].mData				= pkt.pkt.rtp.payload;
+            outputList.mBuffers[ 0 ].mData				= pkt->pkt.rtp.payload;
 			packetDescription.mStartOffset				= 0;
 			packetDescription.mDataByteSize				= 0;
 			packetDescription.mVariableFramesInPacket	= 0;
@@ -1376,6 +1451,7 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
             check( packetCount == 0 || packetDescription.mStartOffset == 0 );
             MirroredRingBufferReadAdvance( ring, (size_t)( ctx->inputDataPtr - src ) );
             
+            if( ( err != kNoErr ) && ( err != kUnderrunErr ) ) break; // Drop the packet and retry on the next write.
             if( packetCount == 0 ) continue; // Skip if a packet wasn't produced.
             
             spp = packetCount * ctx->framesPerPacket;
@@ -1385,24 +1461,25 @@ static void  _AirPlayReceiver_SendAudio( AirPlayAudioStreamContext * const ctx )
         }
         else
         {
-            HostToBig16Mem( MirroredRingBufferGetReadPtr( ring ), avail, pkt.pkt.rtp.payload );
+            HostToBig16Mem( MirroredRingBufferGetReadPtr( ring ), avail, pkt->pkt.rtp.payload );
             len = kRTPHeaderSize + avail;
             MirroredRingBufferReadAdvance( ring, avail );
         }
 
-        len += _AirPlayReceiver_EncryptAudio( ctx, &pkt, len - kRTPHeaderSize );
+        len += _AirPlayReceiver_EncryptAudio( ctx, pkt, len - kRTPHeaderSize );
 
-        n = sendto( ctx->dataSock, (const char *) &pkt, len, 0, &ctx->inputAddr.sa, ctx->inputAddrLen );
-        err = map_socket_value_errno( inSession->audioInputSock, n == (ssize_t) len, n );
-        if( err )
+        pkts[ pktCount ].buf = pkt;
+        pkts[ pktCount ].len = len;
+        if( ++pktCount == kAirTunesInputSendBatchSize )
         {
-            increment_saturate( ctx->sendErrors, UINT32_MAX );
-            atr_stats_ulog( kLogLevelNotice, "### Audio audio send error (%u total): %#m\n", ctx->sendErrors, err );
+            _AirPlayReceiver_SendAudioPackets( ctx, pkts, pktCount );
+            pktCount = 0;
         }
 
         seq += 1;
         ts  += spp;
     }
+    if( pktCount > 0 ) _AirPlayReceiver_SendAudioPackets( ctx, pkts, pktCount );
     ctx->inputSeqNum = seq;
     ctx->inputTimestamp = ts;
 }
@@ -1898,7 +1975,6 @@ static OSStatus
 	AudioStreamBasicDescription				asbd;
 	sockaddr_ip								sip;
 	size_t									i, n;
-	uint8_t *								ptr;
 	uint32_t								latencyMs;
 	uint64_t								streamConnectionID = 0;
 	uint8_t									outputKey[ 32 ];
@@ -2063,33 +2139,10 @@ static OSStatus
 		}
 	}
 	
-	// Set up buffering. The free list is a normal head pointer, null tail list and is initially populated with all the 
-	// nodes. The busy list is doubly-linked and circular with a sentinel node to simplify and speed up linked list code.
-	
-	me->nodeHeaderStorage = (AirTunesBufferNode *) malloc( me->nodeCount * sizeof( AirTunesBufferNode ) );
-	require_action( me->nodeHeaderStorage, exit, err = kNoMemoryErr );
-	
-	me->nodeBufferStorage = (uint8_t *) malloc( me->nodeCount * me->nodeBufferSize );
-	require_action( me->nodeBufferStorage, exit, err = kNoMemoryErr );
-	
-	ptr = me->nodeBufferStorage;
-	n = me->nodeCount - 1;
-	for( i = 0; i < n; ++i )
-	{
-		me->nodeHeaderStorage[ i ].next = &me->nodeHeaderStorage[ i + 1 ];
-		me->nodeHeaderStorage[ i ].data = ptr;
-		ptr += me->nodeBufferSize;
-	}
-	me->nodeHeaderStorage[ i ].next = NULL;
-	me->nodeHeaderStorage[ i ].data = ptr;
-	ptr += me->nodeBufferSize;
-	check( ptr == ( me->nodeBufferStorage + ( me->nodeCount * me->nodeBufferSize ) ) );
+	// Set up buffering.
 	
-	me->freeList						= me->nodeHeaderStorage;
-	me->busyNodeCount					= 0;
-	me->busyListSentinelStorage.prev	= &me->busyListSentinelStorage;
-	me->busyListSentinelStorage.next	= &me->busyListSentinelStorage;
-	me->busyListSentinel				= &me->busyListSentinelStorage;
+	err = _GeneralAudioSetupBufferNodes( me );
+	require_noerr( err, exit );
 	
 	// Set up temporary buffers.
 	
@@ -2124,10 +2177,31 @@ static OSStatus
 	me->skewAdjustBuffer = (uint8_t *) malloc( me->skewAdjustBufferSize );
 	require_action( me->skewAdjustBuffer, exit, err = kNoMemoryErr );
 	
+	// Conceal lost packets by repeating pitch periods of recent audio. Only 16-bit PCM is supported so use silence otherwise.
+	
+	err = AirPlayLossConcealerInit( &me->lossConcealer, 
+		( ctx->bitsPerSample == 16 ) ? kAirPlayLossConcealment_PitchPeriod : kAirPlayLossConcealment_Silence, 
+		ctx->sampleRate, ctx->channels );
+	require_noerr( err, exit );
+	
 	EWMA_FP_Init( &gAirPlayAudioStats.bufferAvg, 0.25, kEWMAFlags_StartWithFirstValue );
 	gAirPlayAudioStats.lostPackets			= 0;
 	gAirPlayAudioStats.unrecoveredPackets	= 0;
 	gAirPlayAudioStats.latePackets			= 0;
+	gAirPlayAudioStats.renderAllocs			= 0;
+	gAirPlayAudioStats.renderDecodes		= 0;
+	memset( gAirPlayAudioStats.renderHistogram, 0, sizeof( gAirPlayAudioStats.renderHistogram ) );
+	me->unrecoveredPacketsLogged			= 0;
+	me->latePacketsLogged					= 0;
+	
+	// Log categories initialize lazily (and allocate) on first use so do it here rather than on the realtime thread.
+	
+	(void) log_category_enabled( atr_stats_ucat(), kLogLevelVerbose );
+	
+	// Decode packets as they arrive so the render callback doesn't have to.
+	
+	err = _GeneralAudioStartDecodeThread( me );
+	require_noerr( err, exit );
 	
 	// Add the stream to the response.
 	
@@ -2228,6 +2302,134 @@ static void *	_GeneralAudioThread( void *inArg )
 	return( NULL );
 }
 
+//===========================================================================================================================
+//	_GeneralAudioStartDecodeThread
+//===========================================================================================================================
+
+static OSStatus	_GeneralAudioStartDecodeThread( AirPlayReceiverSessionRef me )
+{
+	OSStatus		err;
+	
+	err = AirPlayConditionInit( &me->decodeCondition );
+	require_noerr( err, exit );
+	me->decodeConditionPtr = &me->decodeCondition;
+	
+	me->decodeActive		= false;
+	me->decodeDone			= false;
+	me->decodeLastSeqValid	= false;
+	err = pthread_create( &me->decodeThread, NULL, _GeneralAudioDecodeThread, me );
+	require_noerr( err, exit );
+	me->decodeThreadPtr = &me->decodeThread;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_GeneralAudioStopDecodeThread
+//===========================================================================================================================
+
+static void	_GeneralAudioStopDecodeThread( AirPlayReceiverSessionRef me )
+{
+	OSStatus		err;
+	
+	DEBUG_USE_ONLY( err );
+	
+	if( me->decodeThreadPtr )
+	{
+		_SessionLock( me );
+		me->decodeDone = true;
+		pthread_cond_broadcast( me->decodeConditionPtr );
+		_SessionUnlock( me );
+		
+		err = pthread_join( me->decodeThread, NULL );
+		check_noerr( err );
+		me->decodeThreadPtr = NULL;
+	}
+	pthread_cond_forget( &me->decodeConditionPtr );
+}
+
+//===========================================================================================================================
+//	_GeneralAudioDecodeThread
+//
+//	Decrypts and decodes packets as soon as they're queued so the render callback only has to copy PCM. The node being
+//	decoded stays on the busy list, marked as decoding, while the lock is dropped. The render thread treats it as not 
+//	ready yet instead of missing and the receive thread won't steal it. The decoder itself is only used by one thread at
+//	a time: this thread while decodeActive is set or the render thread (as a fallback for packets that arrive too late to
+//	be decoded ahead) while it isn't.
+//===========================================================================================================================
+
+static void *	_GeneralAudioDecodeThread( void *inArg )
+{
+	AirPlayReceiverSessionRef const		session		= (AirPlayReceiverSessionRef) inArg;
+	AirPlayAudioStreamContext * const	ctx			= &session->mainAudioCtx;
+	uint32_t const						marginTS	= ( ctx->sampleRate * kAirTunesDecodeAheadGapMs ) / 1000;
+	Boolean const						inOrder		= ( session->compressionType != kAirPlayCompressionType_PCM );
+	AirTunesBufferNode *				curr;
+	AirTunesBufferNode *				stop;
+	uint8_t *							aad;
+	size_t								aadSize;
+	size_t								size;
+	OSStatus							err;
+	
+	SetThreadName( "AirPlayAudioDecoder" );
+	SetCurrentThreadPriority( kAirPlayThreadPriority_AudioDecoder );
+	
+	_SessionLock( session );
+	while( !session->decodeDone )
+	{
+		// Find the oldest packet that hasn't been decoded yet. If nothing needs decoding, wait for more packets.
+		
+		stop = session->busyListSentinel;
+		for( curr = stop->next; ( curr != stop ) && curr->decoded; curr = curr->next ) {}
+		if( curr == stop )
+		{
+			pthread_cond_wait( session->decodeConditionPtr, session->mutexPtr );
+			continue;
+		}
+		
+		// Compressed audio has to be decoded in order so if there's a gap, give retransmits a chance to fill it 
+		// first. Only decode past the gap once the packet is about to play. Re-check periodically until then.
+		
+		if( inOrder && session->decodeLastSeqValid && ( curr->rtp->header.seq != (uint16_t)( session->decodeLastSeq + 1 ) ) &&
+			session->lastPlayedValid && Mod32_GT( curr->ts, session->lastPlayedTS + marginTS ) )
+		{
+			AirPlayConditionTimedWait( session->decodeConditionPtr, session->mutexPtr, kAirTunesDecodeRetryMs );
+			continue;
+		}
+		
+		// Decode the node in place without the lock.
+		
+		curr->decoding				= true;
+		session->decodeActive		= true;
+		session->decodeLastSeq		= curr->rtp->header.seq;
+		session->decodeLastSeqValid	= true;
+		_GeneralAudioGenerateAADForPacket( ctx, curr->rtp, &aad, &aadSize );
+		_SessionUnlock( session );
+		
+		size = 0;
+		err = _GeneralAudioDecodePacket( session, aad, aadSize, curr->ptr, curr->size, curr->ptr, 
+			session->nodeBufferSize - kRTPHeaderSize, &size );
+		
+		_SessionLock( session );
+		session->decodeActive	= false;
+		curr->decoding			= false;
+		if( err || ( size == 0 ) )
+		{
+			AirTunesFreeBufferNode( session, curr );
+		}
+		else
+		{
+			curr->size		= size;
+			curr->decoded	= true;
+		}
+		pthread_cond_broadcast( session->decodeConditionPtr ); // Wake a flush waiting on decodeActive.
+	}
+	_SessionUnlock( session );
+	atr_ulog( kLogLevelTrace, "General audio decode thread exit\n" );
+	return( NULL );
+}
+
 //===========================================================================================================================
 //	_GeneralAudioReceiveRTCP
 //===========================================================================================================================
@@ -2284,6 +2486,49 @@ exit:
 	return( err );
 }
 
+//===========================================================================================================================
+//	_GeneralAudioSetupBufferNodes
+//
+//	Sets up buffering. The free list is a normal head pointer, null tail list and is initially populated with all the 
+//	nodes. The busy list is doubly-linked and circular with a sentinel node to simplify and speed up linked list code.
+//===========================================================================================================================
+
+static OSStatus	_GeneralAudioSetupBufferNodes( AirPlayReceiverSessionRef me )
+{
+	OSStatus		err;
+	uint8_t *		ptr;
+	size_t			i, n;
+	
+	me->nodeHeaderStorage = (AirTunesBufferNode *) malloc( me->nodeCount * sizeof( AirTunesBufferNode ) );
+	require_action( me->nodeHeaderStorage, exit, err = kNoMemoryErr );
+	
+	me->nodeBufferStorage = (uint8_t *) malloc( me->nodeCount * me->nodeBufferSize );
+	require_action( me->nodeBufferStorage, exit, err = kNoMemoryErr );
+	
+	ptr = me->nodeBufferStorage;
+	n = me->nodeCount - 1;
+	for( i = 0; i < n; ++i )
+	{
+		me->nodeHeaderStorage[ i ].next = &me->nodeHeaderStorage[ i + 1 ];
+		me->nodeHeaderStorage[ i ].data = ptr;
+		ptr += me->nodeBufferSize;
+	}
+	me->nodeHeaderStorage[ i ].next = NULL;
+	me->nodeHeaderStorage[ i ].data = ptr;
+	ptr += me->nodeBufferSize;
+	check( ptr == ( me->nodeBufferStorage + ( me->nodeCount * me->nodeBufferSize ) ) );
+	
+	me->freeList						= me->nodeHeaderStorage;
+	me->busyNodeCount					= 0;
+	me->busyListSentinelStorage.prev	= &me->busyListSentinelStorage;
+	me->busyListSentinelStorage.next	= &me->busyListSentinelStorage;
+	me->busyListSentinel				= &me->busyListSentinelStorage;
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
 //===========================================================================================================================
 //	_GeneralAudioReceiveRTP
 //===========================================================================================================================
@@ -2292,34 +2537,42 @@ static OSStatus	_GeneralAudioReceiveRTP( AirPlayReceiverSessionRef inSession, RT
 {
 	AirPlayAudioStreamContext * const		ctx = &inSession->mainAudioCtx;
 	OSStatus								err;
+	AirTunesBufferNode *					nodes[ kAirTunesRTPReceiveBatchSize ];
+	SocketPacketBuffer						pkts[ kAirTunesRTPReceiveBatchSize ];
+	size_t									nodeCount = 0;
+	size_t									pktCount = 0;
+	size_t									i;
 	AirTunesBufferNode *					node;
 	AirTunesBufferNode *					stop;
-	size_t									len;
 	
-	// Get a free node. If there aren't any free nodes, steal the oldest busy node.
+	trace_event( AudioReceive, inPkt != NULL, 0, 0, 0 );
+	
+	// Get free nodes for every packet we might read (just one if a packet was passed in). If there aren't any free 
+	// nodes, steal the oldest busy node. The lock is held for the whole batch so the render thread only contends with 
+	// us once per wakeup instead of once per packet.
 	
 	_SessionLock( inSession );
-	node = inSession->freeList;
-	if( node )
+	while( ( nodeCount < ( inPkt ? 1 : countof( nodes ) ) ) && ( ( node = inSession->freeList ) != NULL ) )
 	{
 		inSession->freeList = node->next;
+		nodes[ nodeCount++ ] = node;
 	}
-	else
+	if( nodeCount == 0 )
 	{
 		stop = inSession->busyListSentinel;
 		node = stop->next;
+		if( node->decoding ) node = node->next; // The decode thread owns it until it's done.
 		if( node != stop )
 		{
 			node->next->prev = node->prev;
 			node->prev->next = node->next;
 			--inSession->busyNodeCount;
+			nodes[ nodeCount++ ] = node;
 			
 			atr_stats_ulog( kLogLevelVerbose, "### No free buffer nodes. Stealing oldest busy node.\n" );
 		}
 		else
 		{
-			node = NULL;
-			
 			dlogassert( "No buffer nodes at all? Probably a bug in the code\n" );
 			usleep( 100000 ); // Sleep for a moment to avoid hogging the CPU on continual failures.
 			err = kNoResourcesErr;
@@ -2327,36 +2580,50 @@ static OSStatus	_GeneralAudioReceiveRTP( AirPlayReceiverSessionRef inSession, RT
 		}
 	}
 	
-	// Get the packet. If a packet was passed in then use it directly. Otherwise, read it from the socket.
+	// Get the packets. If a packet was passed in then use it directly. Otherwise, drain everything pending on the socket.
 	
 	if( inPkt )
 	{
 		require_action( inSize <= inSession->nodeBufferSize, exit, err = kSizeErr );
-		memcpy( node->data, inPkt, inSize );
-		len = inSize;
+		memcpy( nodes[ 0 ]->data, inPkt, inSize );
+		pkts[ 0 ].len	= inSize;
+		pktCount		= 1;
 	}
 	else
 	{
-			err = SocketRecvFrom( ctx->dataSock, node->data, inSession->nodeBufferSize, &len, NULL, 0, NULL, NULL, NULL, NULL );
+		for( i = 0; i < nodeCount; ++i )
+		{
+			pkts[ i ].buf		= nodes[ i ]->data;
+			pkts[ i ].maxLen	= inSession->nodeBufferSize;
+		}
+		err = SocketRecvPackets( ctx->dataSock, pkts, nodeCount, &pktCount, false );
 		if( err == EWOULDBLOCK ) goto exit;
 		require_noerr( err, exit );
 	}
 	
-	// Process the packet. Warning: this function MUST either queue the node onto the busy queue and return kNoErr or
+	// Process the packets. Warning: this function MUST either queue the node onto the busy queue and return kNoErr or
 	// it MUST return an error and NOT queue the packet. Doing anything else will lead to leaks and/or crashes.
 	
-	err = _GeneralAudioProcessPacket( inSession, node, len, inPkt != NULL );
-	require_noerr_quiet( err, exit );
-	node = NULL;
+	for( i = 0; i < pktCount; ++i )
+	{
+		err = _GeneralAudioProcessPacket( inSession, nodes[ i ], pkts[ i ].len, inPkt != NULL );
+		if( !err ) nodes[ i ] = NULL;
+	}
+	if( inSession->decodeConditionPtr ) pthread_cond_broadcast( inSession->decodeConditionPtr );
 	
 exit:
-	if( node )
+	for( i = 0; i < nodeCount; ++i )
 	{
-		// Processing the packet failed so put the node back on the free list.
+		// Put back nodes that weren't filled or whose packets failed processing.
 		
-		node->next = inSession->freeList;
-		inSession->freeList = node;
+		node = nodes[ i ];
+		if( node )
+		{
+			node->next = inSession->freeList;
+			inSession->freeList = node;
+		}
 	}
+	trace_event( AudioReceiveDone, pktCount, inSession->busyNodeCount, err, 0 );
 	_SessionUnlock( inSession );
 	return( err );
 }
@@ -2397,6 +2664,9 @@ static OSStatus
 	inNode->ptr			= inNode->data + kRTPHeaderSize;
 	inNode->size		= inSize - kRTPHeaderSize;
 	inNode->ts			= pktTS;
+	inNode->decoded		= false;
+	inNode->decoding	= false;
+	trace_event( AudioPacket, pktSeq, pktTS, inSize, inIsRetransmit );
 	
 	if( _GeneralAudioTrackDups( inSession, pktSeq ) )	{ err = kDuplicateErr; goto exit; }
 	if( !inIsRetransmit )								_GeneralAudioTrackLosses( inSession, inNode );
@@ -2446,32 +2716,22 @@ exit:
 //	_GeneralAudioGenerateAADForPacket
 //===========================================================================================================================
 
-static OSStatus
+static void
 	_GeneralAudioGenerateAADForPacket( 
-		const RTPPacket *			inRTPPacket,
-		uint8_t **					outAAD, 
-		size_t *					outAADSize )
+		AirPlayAudioStreamContext * const	ctx,
+		const RTPPacket *					inRTPPacket,
+		uint8_t **							outAAD, 
+		size_t *							outAADSize )
 {
-	OSStatus			err;
-	uint8_t *			aad					= NULL;
-	size_t				aadSize				= sizeof( inRTPPacket->header.ts ) + sizeof( inRTPPacket->header.ssrc );
-	uint32_t			tsNetworkOrder		= htonl( inRTPPacket->header.ts );
-	uint32_t			ssrcNetworkOrder	= htonl( inRTPPacket->header.ssrc );
+	// The AAD is the RTP timestamp and SSRC in network byte order. The header was swapped to host byte order when the
+	// packet was received so build it in the stream's scratch space instead of allocating on the render thread.
 	
-	aad = calloc( 1, aadSize );
-	require_action( aad, exit, err = kNoMemoryErr );
+	check_compile_time_code( sizeof( ctx->aad ) == ( sizeof( inRTPPacket->header.ts ) + sizeof( inRTPPacket->header.ssrc ) ) );
+	WriteBig32( &ctx->aad[ 0 ], inRTPPacket->header.ts );
+	WriteBig32( &ctx->aad[ 4 ], inRTPPacket->header.ssrc );
 	
-	memcpy( aad, &tsNetworkOrder, sizeof( tsNetworkOrder ) );
-	memcpy( &aad[sizeof( tsNetworkOrder )], &ssrcNetworkOrder, sizeof( ssrcNetworkOrder ) );
-	
-	*outAAD = aad;
-	aad = NULL;
-	*outAADSize = aadSize;
-	err = kNoErr;
-
-exit:
-	ForgetMem( &aad );
-	return( err );
+	*outAAD = ctx->aad;
+	*outAADSize = sizeof( ctx->aad );
 }
 
 //===========================================================================================================================
@@ -2524,7 +2784,8 @@ exit:
 //===========================================================================================================================
 //	_GeneralAudioDecodePacket
 //
-//	Warning: Assumes the AirTunes lock is held.
+//	Warning: Uses the session's decoder state so only one thread may call this at a time. That's the decode thread while
+//	decodeActive is set or the render thread, with the AirTunes lock held, while it isn't.
 //===========================================================================================================================
 
 static OSStatus
@@ -2669,6 +2930,7 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 	dst		= (uint8_t *) inBuffer;
 	lim		= dst + inSize;
 	glitchCount = 0;
+	trace_event( AudioRender, inRTPTime, inSize, inSession->busyNodeCount, 0 );
 	
 	// Process all applicable packets for this timing window.
 	
@@ -2706,6 +2968,11 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 			srcTS = pktTS + src->rtpOffsetActive + inSession->audioLatencyOffset;
 		}
 		if( Mod32_GE( srcTS, limTS ) ) break;
+		
+		// If the packet still needs decoding, but the decode thread is using the decoder (usually on this packet), don't 
+		// wait for it. It's not lost so stop here, conceal the rest, and play it from the next pass once it's decoded.
+		
+		if( !curr->decoded && inSession->decodeActive ) break;
 		some = true;
 		
 		// Track packet losses.
@@ -2715,30 +2982,30 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 		{
 			pktGap = ( pktSeq - inSession->lastPlayedSeq ) - 1;
 			gAirPlayAudioStats.unrecoveredPackets += pktGap;
-			atr_stats_ulog( kLogLevelNotice, "### Unrecovered packets: %u-%u (%u) %u total\n", 
+			atr_stats_ulog( kLogLevelVerbose, "### Unrecovered packets: %u-%u (%u) %u total\n", 
 				inSession->lastPlayedSeq + 1, pktSeq, pktGap, gAirPlayAudioStats.unrecoveredPackets );
 		}
 		inSession->lastPlayedTS		= pktTS;
 		inSession->lastPlayedSeq	= pktSeq;
 		inSession->lastPlayedValid	= true;
 		
-		// Decrypt and decompress the packet (if we haven't already on a prevous pass).
+		// Decrypt and decompress the packet if the decode thread hasn't gotten to it yet (e.g. it arrived just in time).
 		
-		if( curr->ptr == curr->rtp->payload )
+		if( !curr->decoded )
 		{
 			uint8_t *	aad		= NULL;
 			size_t		aadSize	= 0;
-			err = _GeneralAudioGenerateAADForPacket( curr->rtp, &aad, &aadSize );
-			require_noerr( err, exit );
+			_GeneralAudioGenerateAADForPacket( ctx, curr->rtp, &aad, &aadSize );
 			
 			err = _GeneralAudioDecodePacket( inSession, aad, aadSize, curr->ptr, curr->size, curr->ptr, 
 				inSession->nodeBufferSize - kRTPHeaderSize, &curr->size );
-			free( aad );
+			++gAirPlayAudioStats.renderDecodes;
 			if( err || ( curr->size == 0 ) )
 			{
 				AirTunesFreeBufferNode( inSession, curr );
 				continue;
 			}
+			curr->decoded = true;
 		}
 		
 		// If the packet is too old, free it and move to the next packet.
@@ -2747,7 +3014,7 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 		if( Mod32_LE( endTS, nowTS ) )
 		{
 			gAirPlayAudioStats.latePackets += 1;
-			atr_stats_ulog( kLogLevelNotice, "Discarding late packet: seq %u ts %u-%u (%u ms), %u total\n", 
+			atr_stats_ulog( kLogLevelVerbose, "Discarding late packet: seq %u ts %u-%u (%u ms), %u total\n", 
 				pktSeq, nowTS, srcTS, AirTunesSamplesToMs( nowTS - srcTS ), gAirPlayAudioStats.latePackets );
 			
 			_RetransmitsAbortOne( inSession, pktSeq, "OLD" );
@@ -2802,6 +3069,7 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 		check_ptr_bounds( curr->data, inSession->nodeBufferSize, curr->ptr, size );
 		check_ptr_bounds( inBuffer, inSize, dst, size );
 		memcpy( dst, curr->ptr, size );
+		_AudioDecoderPlayed( inSession, dst, size );
 		dst   += size;
 		nowTS += delta;
 		
@@ -2822,7 +3090,6 @@ static void	_GeneralAudioRender( AirPlayReceiverSessionRef inSession, uint32_t i
 		if( dst >= lim ) break;
 	}
 	
-exit:
 	// If there wasn't enough data to fill the entire buffer then fill the remaining space with simulated data.
 	
 	if( Mod32_LT( nowTS, limTS ) )
@@ -2841,6 +3108,8 @@ exit:
 	}
 	check( dst == lim );
 	check( nowTS == limTS );
+	trace_event( AudioBusyNodes, inSession->busyNodeCount, 0, 0, 0 );
+	trace_event( AudioRenderDone, glitchCount, some, inSession->flushing, 0 );
 	
 	// Update to account for glitches. This tries to be conservative and ignore glitches due to no packets, 
 	// flushing, or when we expect a glitch (RTP reset). If there's too many glitches, use silence.
@@ -3429,6 +3698,11 @@ static OSStatus
 			ctx->inputRingRef = inSession->inputRingRef;
 			ctx->sendAudioDone = 0;
 			
+			ctx->inputPackets = (RTPSavedPacket *) malloc( kAirTunesInputSendBatchSize * sizeof( *ctx->inputPackets ) );
+			require_action( ctx->inputPackets, exit, err = kNoMemoryErr );
+			ctx->inputSendCalls		= 0;
+			ctx->inputSendPackets	= 0;
+			
 			err = pthread_mutex_init( &ctx->sendAudioMutex, NULL );
 			require_noerr( err, exit );
 			ctx->sendAudioMutexPtr = &ctx->sendAudioMutex;
@@ -3508,7 +3782,7 @@ static void *	_MainAltAudioThread( void *inArg )
 		if( err == EINTR ) continue;
 		if( err ) { dlogassert( "select() error: %#m", err ); usleep( 100000 ); continue; }
 		
-		if( FD_ISSET( dataSock, &readSet ) ) _MainAltAudioProcessPacket( ctx );
+		if( FD_ISSET( dataSock, &readSet ) ) _MainAltAudioReceivePackets( ctx );
 		if( FD_ISSET( cmdSock,  &readSet ) ) break; // The only event is quit so break if anything is pending.
 	}
 	atr_ulog( kLogLevelTrace, "%s audio thread exit\n", ctx->label );
@@ -3516,24 +3790,54 @@ static void *	_MainAltAudioThread( void *inArg )
 }
 
 //===========================================================================================================================
-//	_MainAltAudioProcessPacket
+//	_MainAltAudioReceivePackets
 //===========================================================================================================================
 
-static void	_MainAltAudioProcessPacket( AirPlayAudioStreamContext * const ctx )
+static void	_MainAltAudioReceivePackets( AirPlayAudioStreamContext * const ctx )
 {
-	OSStatus			err;
-	RTPPacketNode *		node = NULL;
-	size_t				len;
+	OSStatus				err;
+	RTPPacketNode *			nodes[ kAirTunesRTPReceiveBatchSize ];
+	SocketPacketBuffer		pkts[ kAirTunesRTPReceiveBatchSize ];
+	size_t					nodeCount = 0;
+	size_t					pktCount = 0;
+	size_t					i;
 	
-	err = RTPJitterBufferGetFreeNode( &ctx->jitterBuffer, &node );
+	err = RTPJitterBufferGetFreeNodes( &ctx->jitterBuffer, nodes, countof( nodes ), &nodeCount );
 	require_noerr( err, exit );
 	
-	err = SocketRecvFrom( ctx->dataSock, node->pkt.pkt.bytes, sizeof( node->pkt.pkt.bytes ), &len, 
-		NULL, 0, NULL, NULL, NULL, NULL );
+	for( i = 0; i < nodeCount; ++i )
+	{
+		pkts[ i ].buf		= nodes[ i ]->pkt.pkt.bytes;
+		pkts[ i ].maxLen	= sizeof( nodes[ i ]->pkt.pkt.bytes );
+	}
+	err = SocketRecvPackets( ctx->dataSock, pkts, nodeCount, &pktCount, false );
 	require_noerr( err, exit );
-	require_action( len >= kRTPHeaderSize, exit, err = kSizeErr );
 	
-	node->pkt.len					= len - kRTPHeaderSize;
+	for( i = 0; i < pktCount; ++i )
+	{
+		_MainAltAudioProcessPacket( ctx, nodes[ i ], pkts[ i ].len );
+	}
+	
+exit:
+	RTPJitterBufferPutFreeNodes( &ctx->jitterBuffer, &nodes[ pktCount ], nodeCount - pktCount );
+	if( err )	atr_ulog( kLogLevelNotice, "### Receive %s audio error: %#m\n", ctx->label, err );
+}
+
+//===========================================================================================================================
+//	_MainAltAudioProcessPacket
+//
+//	Takes ownership of the node. It's either queued onto the jitter buffer or put back on the free list.
+//===========================================================================================================================
+
+static OSStatus	_MainAltAudioProcessPacket( AirPlayAudioStreamContext * const ctx, RTPPacketNode *inNode, size_t inSize )
+{
+	OSStatus			err;
+	RTPPacketNode *		node = inNode;
+	size_t				len;
+	
+	require_action( inSize >= kRTPHeaderSize, exit, err = kSizeErr );
+	
+	node->pkt.len					= inSize - kRTPHeaderSize;
 	node->ptr						= node->pkt.pkt.rtp.payload;
 	
 	if( ctx->outputCryptor.isValid )
@@ -3573,6 +3877,7 @@ static void	_MainAltAudioProcessPacket( AirPlayAudioStreamContext * const ctx )
 exit:
 	if( node )	RTPJitterBufferPutFreeNode( &ctx->jitterBuffer, node );
 	if( err )	atr_ulog( kLogLevelNotice, "### Process main audio error: %#m\n", err );
+	return( err );
 }
 
 //===========================================================================================================================
@@ -4287,6 +4592,8 @@ static OSStatus	_TimingProcessResponse( AirPlayReceiverSessionRef inSession, RTC
 		}
 		++src->rtcpTIResponseCount;
 	}
+	trace_event( TimingResponse, Clamp( offset * 1E6, INT32_MIN, INT32_MAX ), Clamp( rtt * 1E6, INT32_MIN, INT32_MAX ), 
+		useMeasurement, err );
 	
 exit:
 	return( err );
@@ -4330,6 +4637,7 @@ static OSStatus
 	uint8_t							aesScreenKey[ 16 ];
 	uint8_t							aesScreenIV[ 16 ];
 	uint8_t							outputKey[ 32 ];
+	uint32_t						decryptDepth, decodeDepth;
 				
 	require_action( !inSession->screenInitialized, exit2, err = kAlreadyInitializedErr );
 	
@@ -4339,6 +4647,15 @@ static OSStatus
 	err = AirPlayReceiverSessionScreen_Setup( inSession->screenSession, inStreamDesc, (uint32_t) inSession->clientSessionID );
 	require_noerr( err, exit );
 	
+	if( inSession->server->config )
+	{
+		decryptDepth = (uint32_t) CFDictionaryGetInt64( inSession->server->config, CFSTR( kAirPlayKey_ScreenDecryptQueueDepth ), &err );
+		if( err ) decryptDepth = kAirPlayReceiverSessionScreenDecryptQueueDepthDefault;
+		decodeDepth = (uint32_t) CFDictionaryGetInt64( inSession->server->config, CFSTR( kAirPlayKey_ScreenDecodeQueueDepth ), &err );
+		if( err ) decodeDepth = kAirPlayReceiverSessionScreenDecodeQueueDepthDefault;
+		AirPlayReceiverSessionScreen_SetQueueDepths( inSession->screenSession, decryptDepth, decodeDepth );
+	}
+	
 	streamConnectionID = (uint64_t) CFDictionaryGetInt64( inStreamDesc, CFSTR( kAirPlayKey_StreamConnectionID ), NULL );
 	require_action( streamConnectionID, exit, err = kVersionErr );
 	
@@ -4798,6 +5115,7 @@ static void	_LogEnded( AirPlayReceiverSessionRef inSession, OSStatus inReason )
 	uint32_t const						ntpRTTMin				= (uint32_t)( 1000 * ats->rtcpTIClockRTTMin );
 	uint32_t const						ntpRTTMax				= (uint32_t)( 1000 * ats->rtcpTIClockRTTMax );
 	uint32_t const						ntpRTTAvg				= (uint32_t)( 1000 * ats->rtcpTIClockRTTAvg );
+	int									i;
 	
 	DataBuffer_Init( &db, buf, sizeof( buf ), 10000 );
 	DataBuffer_AppendF( &db, "AirPlay session ended: Dur=%u seconds Reason=%#m\n", durationSecs, inReason );
@@ -4817,6 +5135,20 @@ static void	_LogEnded( AirPlayReceiverSessionRef inSession, OSStatus inReason )
 		(int32_t)(  1000000 * ats->rtcpTIClockOffsetMin ), 
 		(int32_t)(  1000000 * ats->rtcpTIClockOffsetMax ), 
 		(int32_t)(  1000000 * ats->rtcpTIClockOffsetAvg ), ats->rtcpTIStepCount );
+	DataBuffer_AppendF( &db, "Render:      %u decoded on render thread, µS histogram", gAirPlayAudioStats.renderDecodes );
+	for( i = 0; i < kAirPlayRenderHistogramBuckets; ++i )
+	{
+		if( gAirPlayAudioStats.renderHistogram[ i ] == 0 ) continue;
+		DataBuffer_AppendF( &db, " %s%u:%u", ( i == 0 ) ? "<" : "", ( i == 0 ) ? 1 : ( 1U << ( i - 1 ) ), 
+			gAirPlayAudioStats.renderHistogram[ i ] );
+	}
+	DataBuffer_AppendF( &db, "\n" );
+	if( inSession->screenSession )
+	{
+		DataBuffer_AppendF( &db, "Screen:      " );
+		AirPlayReceiverSessionScreen_AppendStats( inSession->screenSession, &db );
+		DataBuffer_AppendF( &db, "\n" );
+	}
 	atr_ulog( kLogLevelNotice, "%.*s\n", (int) DataBuffer_GetLen( &db ), DataBuffer_GetPtr( &db ) );
 	DataBuffer_Free( &db );
 	
@@ -4828,9 +5160,23 @@ static void	_LogEnded( AirPlayReceiverSessionRef inSession, OSStatus inReason )
 
 static void	_LogUpdate( AirPlayReceiverSessionRef inSession, uint64_t inTicks, Boolean inForce )
 {
-	(void) inSession;
+	uint32_t const		unrecoveredPackets	= gAirPlayAudioStats.unrecoveredPackets;
+	uint32_t const		latePackets			= gAirPlayAudioStats.latePackets;
+	
 	(void) inTicks;
 	(void) inForce;
+	
+	// Loss and late packets are counted on the realtime render thread, which must not log (logging allocates).
+	// Report what's changed since the last update from here instead.
+	
+	if( ( unrecoveredPackets != inSession->unrecoveredPacketsLogged ) || ( latePackets != inSession->latePacketsLogged ) )
+	{
+		atr_stats_ulog( kLogLevelNotice, "### Unrecovered packets: %u new, %u total. Late packets: %u new, %u total\n", 
+			unrecoveredPackets - inSession->unrecoveredPacketsLogged, unrecoveredPackets, 
+			latePackets - inSession->latePacketsLogged, latePackets );
+		inSession->unrecoveredPacketsLogged	= unrecoveredPackets;
+		inSession->latePacketsLogged		= latePackets;
+	}
 }
 
 //===========================================================================================================================
@@ -4863,6 +5209,7 @@ static void	_TearDownStream( AirPlayReceiverSessionRef inSession, AirPlayAudioSt
         pthread_mutex_forget( &ctx->sendAudioMutexPtr );
         pthread_cond_forget( &ctx->sendAudioCondPtr );
     }
+	ForgetMem( &ctx->inputPackets );
 	if( ctx->zeroTimeLockPtr )
 	{
 		pthread_mutex_forget( &ctx->zeroTimeLockPtr );
@@ -4875,6 +5222,7 @@ static void	_TearDownStream( AirPlayReceiverSessionRef inSession, AirPlayAudioSt
 	
 	if( ctx == &inSession->mainAudioCtx )
 	{
+		_GeneralAudioStopDecodeThread( inSession );
 		inSession->flushing	= false;
 		inSession->rtpAudioPort = 0;
 		ForgetSocket( &inSession->rtcpSock );
@@ -4884,6 +5232,7 @@ static void	_TearDownStream( AirPlayReceiverSessionRef inSession, AirPlayAudioSt
 		ForgetMem( &inSession->decodeBuffer );
 		ForgetMem( &inSession->readBuffer );
 		ForgetMem( &inSession->skewAdjustBuffer );
+		AirPlayLossConcealerFree( &inSession->lossConcealer );
 		AudioConverterForget( &inSession->audioConverter );
 		inSession->source.receiveCount = 0;
 	}
@@ -5630,3 +5979,544 @@ exit:
 	CFReleaseNullSafe( dict );
 	return( err );
 }
+
+#if 0
+#pragma mark -
+#pragma mark == Testing ==
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+//===========================================================================================================================
+//	AirPlayReceiverSessionRenderTest
+//
+//	Plays a long synthetic stream of encrypted PCM packets through the general audio receive and render paths, dropping
+//	some packets so loss concealment runs too. Packets arrive in bursts like they do over Wi-Fi. Runs once with the render
+//	callback decoding packets itself and once with the decode thread decoding them ahead, and reports a histogram of 
+//	render durations for each. Verifies received audio is rendered intact and, if AIRPLAY_ALLOC_TRACKING is enabled 
+//	(build with alloctracking=1), that the render path never calls the allocator. Reports the allocation check as
+//	skipped otherwise. When decoding inline, one packet is held in the decoding state for a
+//	render, like a slow decode ahead, and must be played late rather than counted as lost.
+//===========================================================================================================================
+
+#define kRenderTestFramesPerPacket		352
+#define kRenderTestFramesPerRender		256	// Not a multiple of the packet size so packets get split across renders.
+#define kRenderTestLatencyPackets		64	// Send packets up to this far ahead of the render position.
+#define kRenderTestBurstPackets			32	// Send packets in bursts of this many.
+#define kRenderTestSSRC					0x12345678
+#define kRenderTestSampleTimeBase		1000	// Non-zero so the first render sets the sample time offset.
+#define kRenderTestHoldRender			1000	// Hold a packet in the decoding state at the first chance after this render.
+#define _RenderTestSample( FRAME, CHANNEL )		( (int16_t)( ( ( (FRAME) * 37 ) + ( (CHANNEL) * 1000 ) ) & 0xFFFF ) )
+
+static OSStatus	_RenderTestRun( int inPrint, uint32_t inSeconds, Boolean inDecodeAhead );
+static void		_RenderTestWaitForDecode( AirPlayReceiverSessionRef me );
+
+OSStatus	AirPlayReceiverSessionRenderTest( int inPrint, int inPerf )
+{
+	uint32_t const		seconds = inPerf ? 600 : 60;
+	OSStatus			err;
+	
+	err = _RenderTestRun( inPrint, seconds, false );
+	require_noerr( err, exit );
+	
+	err = _RenderTestRun( inPrint, seconds, true );
+	require_noerr( err, exit );
+	
+exit:
+	printf( "AirPlayReceiverSessionRenderTest: %s%s\n", !err ? "PASSED" : "FAILED", 
+		AIRPLAY_ALLOC_TRACKING ? "" : " (allocation check SKIPPED: AIRPLAY_ALLOC_TRACKING disabled)" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RenderTestRun
+//===========================================================================================================================
+
+static OSStatus	_RenderTestRun( int inPrint, uint32_t inSeconds, Boolean inDecodeAhead )
+{
+	uint32_t const						packetCount	= ( inSeconds * 44100 ) / kRenderTestFramesPerPacket;
+	size_t const						payloadLen	= kRenderTestFramesPerPacket * 4;
+	OSStatus							err;
+	AirPlayReceiverSessionRef			me;
+	AirPlayAudioStreamContext *			ctx;
+	uint8_t *							received = NULL;
+	uint8_t								plain[ kRenderTestFramesPerPacket * 4 ];
+	uint8_t								pkt[ kRTPHeaderSize + ( kRenderTestFramesPerPacket * 4 ) + 24 ];
+	uint8_t * const						payload = &pkt[ kRTPHeaderSize ];
+	int16_t								output[ kRenderTestFramesPerRender * 2 ];
+	uint8_t								nonce[ 8 ];
+	chacha20_poly1305_state				state;
+	uint32_t							seed = 1;
+	uint32_t							pktIndex, burstEnd, packet, renderTS, frame, ts, channel;
+	size_t								len;
+	uint64_t							ticks, renderTicks, maxTicks, renderCount, checked, mismatches, dropped;
+	uint64_t							heldRender = 0;
+	int									i;
+	AirTunesBufferNode *				held = NULL;
+	AirTunesBufferNode *				curr;
+	AirTunesBufferNode *				stop;
+	Boolean								heldDone = false;
+	uint32_t							skipStartTS = 0, skipEndTS = 0, unrecovered = 0;
+	
+	me = (AirPlayReceiverSessionRef) calloc( 1, sizeof( *me ) );
+	require_action( me, exit, err = kNoMemoryErr );
+	ctx = &me->mainAudioCtx;
+	
+	err = pthread_mutex_init( &me->mutex, NULL );
+	require_noerr( err, exit );
+	me->mutexPtr = &me->mutex;
+	
+	ctx->type					= kAirPlayStreamType_MainHighAudio;
+	ctx->sampleRate				= 44100;
+	ctx->channels				= 2;
+	ctx->bitsPerSample			= 16;
+	ctx->bytesPerUnit			= 4;
+	ctx->rateUpdateNextTicks	= UINT64_MAX; // No clock so skip rate estimation.
+	ctx->outputCryptor.isValid	= true;
+	RandomBytes( ctx->outputCryptor.key, sizeof( ctx->outputCryptor.key ) );
+	me->compressionType			= kAirPlayCompressionType_PCM;
+	me->framesPerPacket			= kRenderTestFramesPerPacket;
+	me->source.rtcpRTDisable	= true;
+	me->nodeCount				= kAirTunesBufferNodeCountUDP;
+	me->nodeBufferSize			= kRTPHeaderSize + kAirTunesMaxPacketSizeUDP;
+	err = _GeneralAudioSetupBufferNodes( me );
+	require_noerr( err, exit );
+	
+	me->decodeBufferSize = me->nodeBufferSize;
+	me->decodeBuffer = (uint8_t *) malloc( me->decodeBufferSize );
+	require_action( me->decodeBuffer, exit, err = kNoMemoryErr );
+	
+	err = AirPlayLossConcealerInit( &me->lossConcealer, kAirPlayLossConcealment_PitchPeriod, ctx->sampleRate, ctx->channels );
+	require_noerr( err, exit );
+	
+	(void) log_category_enabled( atr_stats_ucat(), kLogLevelVerbose ); // Same as _GeneralAudioSetup.
+	
+	if( inDecodeAhead )
+	{
+		err = _GeneralAudioStartDecodeThread( me );
+		require_noerr( err, exit );
+	}
+	
+	received = (uint8_t *) calloc( packetCount, 1 );
+	require_action( received, exit, err = kNoMemoryErr );
+	
+	memset( nonce, 0, sizeof( nonce ) );
+	gAirPlayAudioStats.renderAllocs		= 0;
+	gAirPlayAudioStats.renderDecodes	= 0;
+	memset( gAirPlayAudioStats.renderHistogram, 0, sizeof( gAirPlayAudioStats.renderHistogram ) );
+	pktIndex	= 0;
+	renderTicks	= 0;
+	maxTicks	= 0;
+	renderCount	= 0;
+	checked		= 0;
+	mismatches	= 0;
+	dropped		= 0;
+	for( renderTS = 0; renderTS < ( ( packetCount - kRenderTestLatencyPackets ) * kRenderTestFramesPerPacket ); 
+		 renderTS += kRenderTestFramesPerRender )
+	{
+		// Send a burst of packets whenever there's room for one within the latency, dropping about 1% of them.
+		
+		if( ( ( pktIndex + kRenderTestBurstPackets ) * kRenderTestFramesPerPacket ) <= 
+			( renderTS + ( kRenderTestLatencyPackets * kRenderTestFramesPerPacket ) ) )
+		{
+			burstEnd = Min( pktIndex + kRenderTestBurstPackets, packetCount );
+		}
+		else
+		{
+			burstEnd = pktIndex;
+		}
+		for( ; pktIndex < burstEnd; ++pktIndex )
+		{
+			seed = ( seed * 1103515245 ) + 12345;
+			if( ( ( seed >> 16 ) % 100 ) == 0 )
+			{
+				++dropped;
+				continue;
+			}
+			received[ pktIndex ] = 1;
+			
+			ts = pktIndex * kRenderTestFramesPerPacket;
+			pkt[ 0 ] = RTPHeaderInsertVersion( 0, kRTPVersion );
+			pkt[ 1 ] = RTPHeaderInsertPayloadType( 0, kAirPlayStreamType_MainHighAudio );
+			WriteBig16( &pkt[ 2 ], pktIndex );
+			WriteBig32( &pkt[ 4 ], ts );
+			WriteBig32( &pkt[ 8 ], kRenderTestSSRC );
+			for( frame = 0; frame < kRenderTestFramesPerPacket; ++frame )
+			{
+				for( channel = 0; channel < 2; ++channel )
+				{
+					WriteBig16( &plain[ ( ( frame * 2 ) + channel ) * 2 ], _RenderTestSample( ts + frame, channel ) );
+				}
+			}
+			
+			// Payload is the ciphertext followed by the auth tag and nonce. The AAD is the timestamp and SSRC.
+			
+			chacha20_poly1305_init_64x64( &state, ctx->outputCryptor.key, nonce );
+			chacha20_poly1305_add_aad( &state, &pkt[ 4 ], 8 );
+			len  = chacha20_poly1305_encrypt( &state, plain, payloadLen, payload );
+			len += chacha20_poly1305_final( &state, &payload[ len ], &payload[ payloadLen ] );
+			require_action( len == payloadLen, exit, err = kInternalErr );
+			memcpy( &payload[ payloadLen + 16 ], nonce, sizeof( nonce ) );
+			LittleEndianIntegerIncrement( nonce, sizeof( nonce ) );
+			
+			err = _GeneralAudioReceiveRTP( me, (RTPPacket *) pkt, sizeof( pkt ) );
+			require_noerr( err, exit );
+		}
+		
+		// Renders happen back-to-back here rather than in real time so give the decode thread the time it would have 
+		// had while a real burst waited to play.
+		
+		if( inDecodeAhead ) _RenderTestWaitForDecode( me );
+		
+		// Once, hold a packet that starts partway through this render in the decoding state. Everything from it to the
+		// end of the next render's crossfade out of concealment isn't checked.
+		
+		if( !inDecodeAhead && !heldDone && ( renderCount >= kRenderTestHoldRender ) )
+		{
+			_SessionLock( me );
+			stop = me->busyListSentinel;
+			for( curr = stop->next; ( curr != stop ) && Mod32_LT( curr->ts, renderTS + 64 ); curr = curr->next ) {}
+			packet = ( curr != stop ) ? ( curr->ts / kRenderTestFramesPerPacket ) : 0;
+			if( ( packet > 0 ) && Mod32_LT( curr->ts, renderTS + kRenderTestFramesPerRender ) && 
+				received[ packet - 1 ] && received[ packet + 1 ] )
+			{
+				held				= curr;
+				held->decoding		= true;
+				me->decodeActive	= true;
+				heldDone			= true;
+				heldRender			= renderCount;
+				skipStartTS			= held->ts;
+				skipEndTS			= renderTS + kRenderTestFramesPerRender + me->lossConcealer.fadeFrames;
+				unrecovered			= gAirPlayAudioStats.unrecoveredPackets;
+			}
+			_SessionUnlock( me );
+		}
+		
+		// Render.
+		
+		ticks = UpTicks();
+		err = AirPlayReceiverSessionReadAudio( me, kAirPlayStreamType_MainHighAudio, kRenderTestSampleTimeBase + renderTS, 0, 
+			output, sizeof( output ) );
+		ticks = UpTicks() - ticks;
+		require_noerr( err, exit );
+		renderTicks += ticks;
+		if( ticks > maxTicks ) maxTicks = ticks;
+		++renderCount;
+		
+		// The held packet must still be queued after the render. Let the next render play it.
+		
+		if( held )
+		{
+			_SessionLock( me );
+			stop = me->busyListSentinel;
+			for( curr = stop->next; ( curr != stop ) && ( curr != held ); curr = curr->next ) {}
+			held->decoding		= false;
+			me->decodeActive	= false;
+			_SessionUnlock( me );
+			require_action( curr == held, exit, err = kResponseErr );
+			held = NULL;
+		}
+		if( heldDone && ( renderCount == ( heldRender + 2 ) ) )
+		{
+			require_action( gAirPlayAudioStats.unrecoveredPackets == unrecovered, exit, err = kResponseErr );
+		}
+		
+		// Received audio must match exactly except at the start of a packet after a loss, which is crossfaded.
+		
+		for( frame = 0; frame < kRenderTestFramesPerRender; ++frame )
+		{
+			ts = renderTS + frame;
+			packet = ts / kRenderTestFramesPerPacket;
+			if( !received[ packet ] || ( ( packet > 0 ) && !received[ packet - 1 ] ) ) continue;
+			if( heldDone && Mod32_GE( ts, skipStartTS ) && Mod32_LT( ts, skipEndTS ) ) continue;
+			for( channel = 0; channel < 2; ++channel )
+			{
+				if( output[ ( frame * 2 ) + channel ] != _RenderTestSample( ts, channel ) ) ++mismatches;
+				++checked;
+			}
+		}
+	}
+	
+	if( inPrint )
+	{
+		fprintf( stderr, "\t%s: %u seconds, %llu renders, %llu packets dropped, %llu/%llu samples mismatched\n", 
+			inDecodeAhead ? "Decode ahead" : "Decode inline", inSeconds, (unsigned long long) renderCount, 
+			(unsigned long long) dropped, (unsigned long long) mismatches, (unsigned long long) checked );
+		fprintf( stderr, "\trender: %.2f µs avg, %.2f µs max, %u packets decoded, %llu allocator calls%s\n", 
+			( 1000000.0 * renderTicks ) / ( UpTicksPerSecond() * renderCount ), 
+			( 1000000.0 * maxTicks ) / UpTicksPerSecond(), gAirPlayAudioStats.renderDecodes, 
+			(unsigned long long) gAirPlayAudioStats.renderAllocs, 
+			AIRPLAY_ALLOC_TRACKING ? "" : " (AIRPLAY_ALLOC_TRACKING disabled)" );
+		fprintf( stderr, "\trender µs histogram:" );
+		for( i = 0; i < kAirPlayRenderHistogramBuckets; ++i )
+		{
+			if( gAirPlayAudioStats.renderHistogram[ i ] == 0 ) continue;
+			fprintf( stderr, " %s%u:%u", ( i == 0 ) ? "<" : "", ( i == 0 ) ? 1 : ( 1U << ( i - 1 ) ), 
+				gAirPlayAudioStats.renderHistogram[ i ] );
+		}
+		fprintf( stderr, "\n" );
+	}
+	require_action( inDecodeAhead || heldDone, exit, err = kResponseErr );
+	require_action( dropped > 0, exit, err = kResponseErr );
+	require_action( checked > 0, exit, err = kResponseErr );
+	require_action( mismatches == 0, exit, err = kMismatchErr );
+	require_action( gAirPlayAudioStats.renderAllocs == 0, exit, err = kResponseErr );
+	require_action( inDecodeAhead ? ( gAirPlayAudioStats.renderDecodes == 0 ) : ( gAirPlayAudioStats.renderDecodes > 0 ), 
+		exit, err = kResponseErr );
+	err = kNoErr;
+	
+exit:
+	if( me )
+	{
+		_GeneralAudioStopDecodeThread( me );
+		AirPlayLossConcealerFree( &me->lossConcealer );
+		FreeNullSafe( me->decodeBuffer );
+		FreeNullSafe( me->nodeBufferStorage );
+		FreeNullSafe( me->nodeHeaderStorage );
+		if( me->mutexPtr ) pthread_mutex_destroy( me->mutexPtr );
+		free( me );
+	}
+	FreeNullSafe( received );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RenderTestWaitForDecode
+//===========================================================================================================================
+
+static void	_RenderTestWaitForDecode( AirPlayReceiverSessionRef me )
+{
+	AirTunesBufferNode *		curr;
+	AirTunesBufferNode *		stop;
+	Boolean						done;
+	
+	for( ;; )
+	{
+		_SessionLock( me );
+		stop = me->busyListSentinel;
+		for( curr = stop->next; ( curr != stop ) && curr->decoded; curr = curr->next ) {}
+		done = ( curr == stop ) && !me->decodeActive;
+		_SessionUnlock( me );
+		if( done ) break;
+		usleep( 100 );
+	}
+}
+//===========================================================================================================================
+//	AirPlayReceiverSessionSendAudioTest
+//
+//	Sends synthetic mic audio through the encrypted PCM uplink to a loopback socket. Mic callbacks are delivered in bursts,
+//	as after a scheduling hiccup, so the sender has several packets ready at once. Verifies every packet decrypts to the
+//	right samples and reports packets per send system call and sender CPU time per second of mic audio.
+//===========================================================================================================================
+
+#define kSendAudioTestSampleRate			44100
+#define kSendAudioTestFramesPerCallback		256
+#define _SendAudioTestSample( FRAME, CHANNEL )		( (int16_t)( ( ( (FRAME) * 13 ) + ( (CHANNEL) * 500 ) ) & 0xFFFF ) )
+
+static OSStatus	_SendAudioTestRun( int inPrint, uint32_t inSeconds, uint32_t inBurst );
+static uint64_t	_SendAudioTestThreadCPUNanos( void );
+
+OSStatus	AirPlayReceiverSessionSendAudioTest( int inPrint, int inPerf )
+{
+	uint32_t const		seconds = inPerf ? 60 : 5;
+	OSStatus			err;
+	uint32_t			burst;
+	
+	for( burst = 1; burst <= 16; burst *= 4 )
+	{
+		err = _SendAudioTestRun( inPrint, seconds, burst );
+		require_noerr( err, exit );
+	}
+	
+exit:
+	printf( "AirPlayReceiverSessionSendAudioTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_SendAudioTestRun
+//===========================================================================================================================
+
+static OSStatus	_SendAudioTestRun( int inPrint, uint32_t inSeconds, uint32_t inBurst )
+{
+	uint32_t const						callbackCount = ( inSeconds * kSendAudioTestSampleRate ) / kSendAudioTestFramesPerCallback;
+	OSStatus							err;
+	AirPlayReceiverSessionRef			me;
+	AirPlayAudioStreamContext *			ctx = NULL;
+	SocketRef							recvSock = kInvalidSocketRef;
+	int									recvPort;
+	SocketPacketBuffer					pkts[ kAirTunesInputSendBatchSize ];
+	uint8_t *							bufs = NULL;
+	uint8_t								plain[ kAirTunesMaxPayloadSizeUDP ];
+	int16_t								samples[ kSendAudioTestFramesPerCallback * 2 ];
+	chacha20_poly1305_state				state;
+	uint32_t							callback, i, frame, writeFrame, ts, channel;
+	uint64_t							expected, received, mismatches, cpuNanos, nanos;
+	size_t								n, k, len, plainLen;
+	int									ready;
+	fd_set								readSet;
+	struct timeval						timeout;
+	
+	me = (AirPlayReceiverSessionRef) calloc( 1, sizeof( *me ) );
+	require_action( me, exit, err = kNoMemoryErr );
+	ctx = &me->mainAudioCtx;
+	ctx->dataSock = kInvalidSocketRef;
+	strlcpy( me->clientOSBuildVersion, "15A1", sizeof( me->clientOSBuildVersion ) ); // AAD is the timestamp and SSRC.
+	
+	ctx->session				= me;
+	ctx->type					= kAirPlayStreamType_MainAudio;
+	ctx->sampleRate				= kSendAudioTestSampleRate;
+	ctx->channels				= 2;
+	ctx->bitsPerSample			= 16;
+	ctx->bytesPerUnit			= 4;
+	ctx->inputCryptor.isValid	= true;
+	RandomBytes( ctx->inputCryptor.key, sizeof( ctx->inputCryptor.key ) );
+	
+	err = MirroredRingBufferInit( &me->inputRing, kAirPlayInputRingSize, true );
+	require_noerr( err, exit );
+	me->inputRingRef	= &me->inputRing;
+	ctx->inputRingRef	= me->inputRingRef;
+	
+	ctx->inputPackets = (RTPSavedPacket *) malloc( kAirTunesInputSendBatchSize * sizeof( *ctx->inputPackets ) );
+	require_action( ctx->inputPackets, exit, err = kNoMemoryErr );
+	
+	// Send from one UDP socket to another over loopback.
+	
+	err = ServerSocketOpen( AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0, &recvPort, kAirTunesRTPSocketBufferSize, &recvSock );
+	require_noerr( err, exit );
+	err = SocketMakeNonBlocking( recvSock );
+	require_noerr( err, exit );
+	ctx->dataSock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	err = map_socket_creation_errno( ctx->dataSock );
+	require_noerr( err, exit );
+	
+	memset( &ctx->inputAddr, 0, sizeof( ctx->inputAddr ) );
+	ctx->inputAddr.v4.sin_family		= AF_INET;
+	ctx->inputAddr.v4.sin_addr.s_addr	= htonl( INADDR_LOOPBACK );
+	ctx->inputAddr.v4.sin_port			= htons( (uint16_t) recvPort );
+	ctx->inputAddrLen					= (socklen_t) sizeof( ctx->inputAddr.v4 );
+	
+	bufs = (uint8_t *) malloc( countof( pkts ) * kAirTunesMaxPacketSizeUDP );
+	require_action( bufs, exit, err = kNoMemoryErr );
+	for( i = 0; i < countof( pkts ); ++i )
+	{
+		pkts[ i ].buf		= &bufs[ i * kAirTunesMaxPacketSizeUDP ];
+		pkts[ i ].maxLen	= kAirTunesMaxPacketSizeUDP;
+	}
+	
+	FD_ZERO( &readSet );
+	writeFrame	= 0;
+	expected	= 0;
+	received	= 0;
+	mismatches	= 0;
+	cpuNanos	= 0;
+	for( callback = 0; callback < callbackCount; )
+	{
+		// Deliver a burst of mic callbacks then let the sender catch up in one go.
+		
+		for( i = 0; ( i < inBurst ) && ( callback < callbackCount ); ++i, ++callback )
+		{
+			for( frame = 0; frame < kSendAudioTestFramesPerCallback; ++frame, ++writeFrame )
+			{
+				for( channel = 0; channel < 2; ++channel )
+				{
+					samples[ ( frame * 2 ) + channel ] = _SendAudioTestSample( writeFrame, channel );
+				}
+			}
+			require_action( MirroredRingBufferGetBytesFree( ctx->inputRingRef ) >= sizeof( samples ), exit, err = kNoSpaceErr );
+			memcpy( MirroredRingBufferGetWritePtr( ctx->inputRingRef ), samples, sizeof( samples ) );
+			MirroredRingBufferWriteAdvance( ctx->inputRingRef, sizeof( samples ) );
+		}
+		
+		nanos = _SendAudioTestThreadCPUNanos();
+		_AirPlayReceiver_SendAudio( ctx );
+		cpuNanos += _SendAudioTestThreadCPUNanos() - nanos;
+		require_action( ctx->sendErrors == 0, exit, err = kWriteErr );
+		expected = ctx->inputSendPackets;
+		
+		// Receive everything that was sent and make sure it decrypts to the samples that went in.
+		
+		while( received < expected )
+		{
+			FD_SET( recvSock, &readSet );
+			timeout.tv_sec  = 1;
+			timeout.tv_usec = 0;
+			ready = select( recvSock + 1, &readSet, NULL, NULL, &timeout );
+			require_action( ready > 0, exit, err = kTimeoutErr );
+			
+			err = SocketRecvPackets( recvSock, pkts, countof( pkts ), &n, false );
+			require_noerr( err, exit );
+			for( k = 0; k < n; ++k, ++received )
+			{
+				uint8_t * const		pkt = (uint8_t *) pkts[ k ].buf;
+				uint8_t * const		payload = &pkt[ kRTPHeaderSize ];
+				
+				require_action( pkts[ k ].len > ( kRTPHeaderSize + 24 ), exit, err = kSizeErr );
+				len = pkts[ k ].len - kRTPHeaderSize - 24;
+				chacha20_poly1305_init_64x64( &state, ctx->inputCryptor.key, &payload[ len + 16 ] );
+				chacha20_poly1305_add_aad( &state, &pkt[ 4 ], 8 );
+				plainLen  = chacha20_poly1305_decrypt( &state, payload, len, plain );
+				plainLen += chacha20_poly1305_verify( &state, &plain[ plainLen ], &payload[ len ], &err );
+				require_noerr( err, exit );
+				require_action( plainLen == len, exit, err = kSizeErr );
+				
+				ts = ReadBig32( &pkt[ 4 ] );
+				for( frame = 0; frame < ( len / 4 ); ++frame )
+				{
+					for( channel = 0; channel < 2; ++channel )
+					{
+						if( (int16_t) ReadBig16( &plain[ ( ( frame * 2 ) + channel ) * 2 ] ) != 
+							_SendAudioTestSample( ts + frame, channel ) )
+						{
+							++mismatches;
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	if( inPrint )
+	{
+		fprintf( stderr, "\tburst %2u: %llu packets, %.2f packets/syscall, %llu µs CPU per second of mic audio, %llu mismatches\n", 
+			inBurst, (unsigned long long) received, ( (double) ctx->inputSendPackets ) / ctx->inputSendCalls, 
+			(unsigned long long)( cpuNanos / ( 1000 * (uint64_t) inSeconds ) ), (unsigned long long) mismatches );
+	}
+	require_action( received > 0, exit, err = kCountErr );
+	require_action( mismatches == 0, exit, err = kMismatchErr );
+#if( NETUTILS_HAVE_SENDMMSG )
+	require_action( ( inBurst == 1 ) || ( ctx->inputSendCalls < ctx->inputSendPackets ), exit, err = kResponseErr );
+#endif
+	err = kNoErr;
+	
+exit:
+	if( ctx )
+	{
+		ForgetSocket( &ctx->dataSock );
+		FreeNullSafe( ctx->inputPackets );
+	}
+	if( me )
+	{
+		if( me->inputRingRef ) MirroredRingBufferFree( me->inputRingRef );
+		free( me );
+	}
+	ForgetSocket( &recvSock );
+	FreeNullSafe( bufs );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_SendAudioTestThreadCPUNanos
+//===========================================================================================================================
+
+static uint64_t	_SendAudioTestThreadCPUNanos( void )
+{
+#if( TARGET_OS_POSIX )
+	struct timespec		ts;
+	
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+	return( ( ( (uint64_t) ts.tv_sec ) * kNanosecondsPerSecond ) + ( (uint64_t) ts.tv_nsec ) );
+#else
+	return( UpNanoseconds() ); // Wall time is the best we can do without per-thread CPU clocks.
+#endif
+}
+#endif // !EXCLUDE_UNIT_TESTS
@@ -843,6 +843,11 @@ OSStatus
 		uint32_t							inWidthPhysical,
 		uint32_t							inHeightPhysical );
 
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	AirPlayReceiverSessionRenderTest( int inPrint, int inPerf );
+OSStatus	AirPlayReceiverSessionSendAudioTest( int inPrint, int inPerf );
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -94,6 +94,10 @@ extern "C" {
 //===========================================================================================================================
 
 	#define kAirTunesDupWindowSize		512 // Size of the dup checking window. Must be >= the max number of retransmits.
+	#define kAirTunesDecodeAheadGapMs	20	// Decode past a missing packet once the next one is this close to playing.
+	#define kAirTunesDecodeRetryMs		5	// How often to re-check a missing packet while waiting to decode past it.
+
+#define kAirPlayRenderHistogramBuckets		16 // Render durations: <1 µs, 1-2 µs, 2-4 µs, ..., >= 16384 µs.
 
 // AirPlayAudioStats
 
@@ -103,6 +107,9 @@ typedef struct
 	uint32_t			lostPackets;
 	uint32_t			unrecoveredPackets;
 	uint32_t			latePackets;
+	uint64_t			renderAllocs;		// Allocator calls made while rendering. Only counted if AIRPLAY_ALLOC_TRACKING.
+	uint32_t			renderDecodes;		// Packets the render callback had to decode itself because decode-ahead hadn't.
+	uint32_t			renderHistogram[ kAirPlayRenderHistogramBuckets ]; // Render callbacks by duration.
 	char				ifname[ IF_NAMESIZE + 1 ];
 	
 }	AirPlayAudioStats;
@@ -141,6 +148,8 @@ struct AirTunesBufferNode
 	size_t						size;	// Size of RTP payload. Note: this may be less than the full payload size.
 	uint8_t *					data;	// Buffer for the entire RTP packet. All node ptrs point within this buffer.
 	uint32_t					ts;		// RTP timestamp where "ptr" points. Updated when processing partial packets.
+	Boolean						decoded;	// True if "ptr" points to decoded PCM. False if it's still the encrypted payload.
+	Boolean						decoding;	// True while the decode thread is decoding it outside the lock.
 };
 
 // AirTunesRetransmitNode
@@ -282,6 +291,7 @@ typedef struct
 	pthread_mutex_t *				zeroTimeLockPtr;			// Ptr to the zeroTime mutex. NULL if invalid.
 	uint32_t						sendErrors;					// Number of send errors that occurred.
 	ChaChaPolyCryptor				outputCryptor;				// ChaCha20_Poly1305 cryptor for incoming audio packets.
+	uint8_t							aad[ 8 ];					// Scratch space for the AAD of the packet being decrypted.
 	pthread_t						sendAudioThread;            // Thread to offload sending audio data.
 	pthread_t *						sendAudioThreadPtr;         // Ptr to sendAudioThread when valid.
 	pthread_cond_t					sendAudioCond;              // Condition to signal when there is audio to send.
@@ -295,6 +305,9 @@ typedef struct
 	uint16_t						inputSeqNum;				// Last RTP sequence number we've sent.
 	uint32_t						inputTimestamp;				// Last RTP timestamp sent.
 	ChaChaPolyCryptor				inputCryptor;				// ChaCha20_Poly1305 cryptor for input audio.
+	RTPSavedPacket *				inputPackets;				// Slots to assemble a batch of input packets to send at once.
+	uint64_t						inputSendCalls;				// Number of system calls made to send input packets.
+	uint64_t						inputSendPackets;			// Number of input packets sent.
 	AudioConverterRef				inputConverter;				// Converter for encoding audio.
 	const uint8_t *					inputDataPtr;				// Ptr to the data to encode from converter callback.
 	const uint8_t *					inputDataEnd;				// End of the data to encode.
@@ -411,6 +424,15 @@ struct AirPlayReceiverSessionPrivate
 	size_t							readBufferSize;
 	uint8_t *						skewAdjustBuffer;			// Temporary buffer for doing skew compensation.
 	size_t							skewAdjustBufferSize;
+	AirPlayLossConcealer			lossConcealer;				// Synthesizes audio for lost packets.
+	pthread_t						decodeThread;				// Thread to decrypt and decode packets ahead of rendering.
+	pthread_t *						decodeThreadPtr;			// Ptr to decodeThread when valid.
+	pthread_cond_t					decodeCondition;			// Signaled with the session mutex when packets arrive or decode.
+	pthread_cond_t *				decodeConditionPtr;			// Ptr to decodeCondition when valid.
+	Boolean							decodeActive;				// True while decodeThread is using the decoder outside the lock.
+	Boolean							decodeDone;					// Sentinal for terminating decodeThread.
+	Boolean							decodeLastSeqValid;			// true if decodeLastSeq is valid.
+	uint16_t						decodeLastSeq;				// Sequence number of the last packet decoded ahead.
 	
 	// Audio
 	
@@ -436,6 +458,8 @@ struct AirPlayReceiverSessionPrivate
 	int								glitchTotalPeriods;			// Number of periods (with or without glitches).
 	uint64_t						glitchNextTicks;			// Next ticks to check the glitch counter.
 	uint64_t						glitchIntervalTicks;		// Number of ticks between glitch counter checks.
+	uint32_t						unrecoveredPacketsLogged;	// Unrecovered packet count when we last logged it.
+	uint32_t						latePacketsLogged;			// Late packet count when we last logged it.
 	MirroredRingBuffer				inputRing;					// Ring buffer for processing audio input.
 	MirroredRingBuffer *			inputRingRef;				// Ptr to the ring buffer
 	
@@ -56,8 +56,11 @@
 #include "AESUtils.h"
 #include "CFUtils.h"
 #include "DebugServices.h"
+#include "RandomNumberUtils.h"
 #include "ScreenUtils.h"
+#include "ThreadUtils.h"
 #include "TickUtils.h"
+#include "TraceUtils.h"
 #include <errno.h>
 #include "AirPlayCommon.h"
 #include "AirPlayUtils.h"
@@ -69,6 +72,45 @@
 
 #define kAirPlayReceiverSessionScreenCommandMaxSize		64
 
+// AirPlayScreenFrame
+
+typedef struct
+{
+	AirPlayScreenHeader		header;
+	uint8_t *				ptr;			// Frame body from the frame pool. May be NULL if the frame has no body.
+	OSStatus				err;			// Error from an earlier stage. The frame is dropped by the decode stage.
+	uint64_t				receiveTicks;	// UpTicks when the header was received.
+	uint64_t				readTicks;		// UpTicks when the body was read.
+	uint64_t				decryptTicks;	// UpTicks when the body was decrypted.
+	
+}	AirPlayScreenFrame;
+
+// AirPlayScreenFrameQueue -- Bounded FIFO of frames between two pipeline stages.
+
+typedef struct
+{
+	pthread_mutex_t			mutex;
+	pthread_mutex_t *		mutexPtr;
+	pthread_cond_t			cond;			// Signaled when a frame is added or removed or the queue is closed.
+	pthread_cond_t *		condPtr;
+	AirPlayScreenFrame *	frames;			// Ring of depth frames.
+	uint32_t				depth;
+	uint32_t				head;			// Index of the oldest frame.
+	uint32_t				count;			// Number of frames queued.
+	Boolean					closed;			// True when no more frames will be added.
+	
+}	AirPlayScreenFrameQueue;
+
+// AirPlayScreenStageStats
+
+typedef struct
+{
+	uint64_t		ticks;			// Total UpTicks frames spent reaching the end of the stage, including time queued for it.
+	uint64_t		ticksMax;		// Most UpTicks a single frame spent.
+	uint32_t		count;			// Number of frames through the stage.
+	
+}	AirPlayScreenStageStats;
+
 // AirPlayReceiverSessionScreenPrivate
 
 struct AirPlayReceiverSessionScreenPrivate
@@ -85,8 +127,6 @@ struct AirPlayReceiverSessionScreenPrivate
 	
 	double											ticksPerSecF;
 	
-	AirPlayScreenHeader								screenHeader;
-	
 	AES_CTR_Context									aesContext;
 	Boolean											aesValid;
 	
@@ -94,16 +134,39 @@ struct AirPlayReceiverSessionScreenPrivate
 	
 	SocketRef										commandSock;
 	ScreenStreamRef									screenStream;
+	AirPlayFramePool *								framePool;		// Frame bodies, released when the decoder is done.
+	
+	uint32_t										decryptQueueDepth;	// Frames queued for decryption. 0=Decrypt on the read thread.
+	uint32_t										decodeQueueDepth;	// Frames queued for decoding. 0=Decode on the decrypt thread.
+	AirPlayScreenFrameQueue							decryptQueue;
+	AirPlayScreenFrameQueue							decodeQueue;
+	pthread_t										decryptThread;
+	pthread_t *										decryptThreadPtr;
+	pthread_t										decodeThread;
+	pthread_t *										decodeThreadPtr;
+	AirPlayScreenStageStats							readStats;			// Header received to body read.
+	AirPlayScreenStageStats							decryptStats;		// Body read to decrypted.
+	AirPlayScreenStageStats							decodeStats;		// Decrypted to handed to the screen stream.
+	uint32_t										videoFrames;		// Number of video frames handed to the screen stream.
+	int64_t											displayDeltaUsTotal;
+	int64_t											displayDeltaUsMax;
 };
 
 // Prototypes
 
 static void			_AirPlayReceiverSessionScreen_Cleanup( AirPlayReceiverSessionScreenRef me );
-static OSStatus
-	_AirPlayReceiverSessionScreen_ProcessFrame(
-		AirPlayReceiverSessionScreenRef		me,
-		AirPlayScreenHeader *				inHeader, 
-		uint8_t *							inFramePtr );
+static void			_AirPlayReceiverSessionScreen_SubmitDecrypt( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame );
+static void			_AirPlayReceiverSessionScreen_SubmitDecode( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame );
+static void *		_AirPlayReceiverSessionScreen_DecryptThread( void *inArg );
+static void *		_AirPlayReceiverSessionScreen_DecodeThread( void *inArg );
+static void			_AirPlayReceiverSessionScreen_DecryptFrame( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame );
+static OSStatus		_AirPlayReceiverSessionScreen_DecodeFrame( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame );
+static OSStatus		_AirPlayScreenFrameQueueInit( AirPlayScreenFrameQueue *inQueue, uint32_t inDepth );
+static void			_AirPlayScreenFrameQueueFree( AirPlayScreenFrameQueue *inQueue );
+static OSStatus		_AirPlayScreenFrameQueuePush( AirPlayScreenFrameQueue *inQueue, const AirPlayScreenFrame *inFrame );
+static OSStatus		_AirPlayScreenFrameQueuePop( AirPlayScreenFrameQueue *inQueue, AirPlayScreenFrame *outFrame );
+static void			_AirPlayScreenFrameQueueClose( AirPlayScreenFrameQueue *inQueue );
+static void			_AirPlayScreenStageStatsAdd( AirPlayScreenStageStats *inStats, uint64_t inTicks );
 static OSStatus		_AirPlayReceiverSessionScreen_ProcessCommand( AirPlayReceiverSessionScreenRef me );
 
 // Logging
@@ -115,6 +178,9 @@ ulog_define( AirPlayReceiverSessionScreenCore, kLogLevelNotice, kLogFlags_Defaul
 ulog_define( AirPlayReceiverSessionScreenFrames, kLogLevelNotice, kLogFlags_Default, "AirPlayReceiverSessionScreen", "AirPlayReceiverSessionScreenFrames:rate=5;3000" );
 #define apvs_frames_ulog( LEVEL, ... )	ulog( &log_category_from_name( AirPlayReceiverSessionScreenFrames ), (LEVEL), __VA_ARGS__ )
 
+trace_define( ScreenFrame,		kTracePhase_Begin,	"size,displayDeltaUs,readUs,decryptUs" );
+trace_define( ScreenFrameDone,	kTracePhase_End,	"err,lateFrames" );
+
 //===========================================================================================================================
 //	AirPlayReceiverSessionScreen_Create
 //===========================================================================================================================
@@ -127,7 +193,12 @@ OSStatus AirPlayReceiverSessionScreen_Create( AirPlayReceiverSessionScreenRef *o
 	obj = (AirPlayReceiverSessionScreenRef) calloc( 1, sizeof( *obj ) );
 	require_action( obj, exit, err = kNoMemoryErr );
 	
-	obj->commandSock = kInvalidSocketRef;
+	obj->commandSock		= kInvalidSocketRef;
+	obj->decryptQueueDepth	= kAirPlayReceiverSessionScreenDecryptQueueDepthDefault;
+	obj->decodeQueueDepth	= kAirPlayReceiverSessionScreenDecodeQueueDepthDefault;
+	
+	err = AirPlayFramePoolCreate( &obj->framePool );
+	require_noerr( err, exit );
 	
 	*outRef = obj;
 	obj = NULL;
@@ -152,6 +223,7 @@ void AirPlayReceiverSessionScreen_Delete( AirPlayReceiverSessionScreenRef inSess
 		AES_CTR_Final( &inSession->aesContext );
 	}
 	MemZeroSecure( &inSession->chachaCryptor, sizeof( inSession->chachaCryptor ) );
+	ForgetCustom( &inSession->framePool, AirPlayFramePoolFree ); // Frames the screen stream still holds keep it alive.
 
 	free( inSession );
 }
@@ -168,6 +240,21 @@ void
 	inSession->timeSynchronizer = *inTimeSynchronizer;
 }
 
+//===========================================================================================================================
+//	AirPlayReceiverSessionScreen_SetQueueDepths
+//===========================================================================================================================
+
+void
+	AirPlayReceiverSessionScreen_SetQueueDepths(
+		AirPlayReceiverSessionScreenRef		inSession,
+		uint32_t							inDecryptDepth,
+		uint32_t							inDecodeDepth )
+{
+	check( !inSession->decryptThreadPtr && !inSession->decodeThreadPtr );
+	inSession->decryptQueueDepth	= inDecryptDepth;
+	inSession->decodeQueueDepth		= inDecodeDepth;
+}
+
 #if( defined( LEGACY_REGISTER_SCREEN_HID ) )
 //===========================================================================================================================
 //	AirPlayReceiverSessionScreen_CopyDisplaysInfo
@@ -379,31 +466,37 @@ OSStatus
 		
 		if( FD_ISSET( tcpSock, &readSet ) )
 		{
-			uint8_t *		frameBuffer;
+			AirPlayScreenFrame		frame;
 			
-			err = NetSocket_Read( inNetSock, sizeof( inSession->screenHeader ),
-				sizeof( inSession->screenHeader ), &inSession->screenHeader, NULL, inTimeoutDataSecs );
+			frame.receiveTicks = UpTicks();
+			err = NetSocket_Read( inNetSock, sizeof( frame.header ), sizeof( frame.header ), &frame.header, NULL, 
+				inTimeoutDataSecs );
 			if( err == kConnectionErr ) { err = kNoErr; goto exit; }
 			require_noerr_quiet( err, exit );
-			len = inSession->screenHeader.bodySize;
+			len = frame.header.bodySize;
 			
 			if( len > 0 )
 			{
-				frameBuffer = (uint8_t *) malloc( len );
-				if( frameBuffer == NULL ) { dlogassert( "malloc( %zu ) failed\n", len ); continue; }
+				frame.ptr = AirPlayFramePoolGet( inSession->framePool, len );
+				if( frame.ptr == NULL ) { dlogassert( "AirPlayFramePoolGet( %zu ) failed\n", len ); continue; }
 				
-				err = NetSocket_Read( inNetSock, len, len, frameBuffer, NULL, inTimeoutDataSecs );
-				if( err ) free( frameBuffer );
+				err = NetSocket_Read( inNetSock, len, len, frame.ptr, NULL, inTimeoutDataSecs );
+				if( err ) AirPlayFramePoolRelease( frame.ptr );
 				if( err == kConnectionErr ) goto exit;
 				require_noerr( err, exit );
 			}
 			else
 			{
-				frameBuffer = NULL;
+				frame.ptr = NULL;
 			}
+			frame.err		= kNoErr;
+			frame.readTicks	= UpTicks();
+			_AirPlayScreenStageStatsAdd( &inSession->readStats, frame.readTicks - frame.receiveTicks );
 			
-			_AirPlayReceiverSessionScreen_ProcessFrame( inSession, &inSession->screenHeader, frameBuffer );
-			// Note: frameBuffer is no longer our responsibility to munmap.
+			// Hand the frame to the next stage while we go back to reading the next frame.
+			
+			_AirPlayReceiverSessionScreen_SubmitDecrypt( inSession, &frame );
+			// Note: frame.ptr is no longer our responsibility to release.
 			lastAliveTicks = UpTicks();
 		}
 		if( FD_ISSET( inSession->commandSock, &readSet ) )
@@ -441,6 +534,30 @@ OSStatus AirPlayReceiverSessionScreen_StartSession( AirPlayReceiverSessionScreen
 	err = ScreenStreamStart( inSession->screenStream );
 	require_noerr( err, exit );
 	
+	// Set up the decrypt and decode stages. Each stage with a queue runs on its own thread so reading the next frame
+	// overlaps decrypting the current frame and decoding the previous one.
+	
+	if( inSession->decodeQueueDepth > 0 )
+	{
+		err = _AirPlayScreenFrameQueueInit( &inSession->decodeQueue, inSession->decodeQueueDepth );
+		require_noerr( err, exit );
+		
+		err = pthread_create( &inSession->decodeThread, NULL, _AirPlayReceiverSessionScreen_DecodeThread, inSession );
+		require_noerr( err, exit );
+		inSession->decodeThreadPtr = &inSession->decodeThread;
+	}
+	if( inSession->decryptQueueDepth > 0 )
+	{
+		err = _AirPlayScreenFrameQueueInit( &inSession->decryptQueue, inSession->decryptQueueDepth );
+		require_noerr( err, exit );
+		
+		err = pthread_create( &inSession->decryptThread, NULL, _AirPlayReceiverSessionScreen_DecryptThread, inSession );
+		require_noerr( err, exit );
+		inSession->decryptThreadPtr = &inSession->decryptThread;
+	}
+	apvs_ulog( kLogLevelTrace, "Screen pipeline started: decrypt queue %u, decode queue %u\n", 
+		inSession->decryptQueueDepth, inSession->decodeQueueDepth );
+	
 exit:
 	if( err ) AirPlayReceiverSessionScreen_StopSession( inSession );
 	return( err );
@@ -455,37 +572,190 @@ void AirPlayReceiverSessionScreen_StopSession( AirPlayReceiverSessionScreenRef i
 	_AirPlayReceiverSessionScreen_Cleanup( inSession );
 }
 
+//===========================================================================================================================
+//	AirPlayReceiverSessionScreen_AppendStats
+//===========================================================================================================================
+
+void AirPlayReceiverSessionScreen_AppendStats( AirPlayReceiverSessionScreenRef inSession, DataBuffer *inDB )
+{
+	const AirPlayScreenStageStats * const		stages[ 3 ] = 
+		{ &inSession->readStats, &inSession->decryptStats, &inSession->decodeStats };
+	double const								usPerTick = 1000000.0 / UpTicksPerSecond();
+	size_t										i;
+	
+	AirPlayFramePoolAppendStats( inSession->framePool, inDB );
+	DataBuffer_AppendF( inDB, ", %u late, %u errors, %lld/%lld ms avg/max display delta", 
+		inSession->lateFrames, inSession->frameErrors, 
+		( inSession->videoFrames > 0 ) ? ( inSession->displayDeltaUsTotal / ( 1000 * (int64_t) inSession->videoFrames ) ) : 0, 
+		inSession->displayDeltaUsMax / 1000 );
+	DataBuffer_AppendF( inDB, ", read/decrypt/decode µS avg/max" );
+	for( i = 0; i < countof( stages ); ++i )
+	{
+		DataBuffer_AppendF( inDB, " %.0f/%.0f", 
+			( stages[ i ]->count > 0 ) ? ( ( usPerTick * stages[ i ]->ticks ) / stages[ i ]->count ) : 0.0, 
+			usPerTick * stages[ i ]->ticksMax );
+	}
+}
+
 //===========================================================================================================================
 //	_AirPlayReceiverSessionScreen_Cleanup
 //===========================================================================================================================
 
 static void	_AirPlayReceiverSessionScreen_Cleanup( AirPlayReceiverSessionScreenRef me )
 {
+	// Let each stage finish what's already queued for it before stopping the next stage.
+	
+	if( me->decryptThreadPtr )
+	{
+		_AirPlayScreenFrameQueueClose( &me->decryptQueue );
+		pthread_join( me->decryptThread, NULL );
+		me->decryptThreadPtr = NULL;
+	}
+	_AirPlayScreenFrameQueueFree( &me->decryptQueue );
+	if( me->decodeThreadPtr )
+	{
+		_AirPlayScreenFrameQueueClose( &me->decodeQueue );
+		pthread_join( me->decodeThread, NULL );
+		me->decodeThreadPtr = NULL;
+	}
+	_AirPlayScreenFrameQueueFree( &me->decodeQueue );
 	ScreenStreamForget( &me->screenStream );
 	ForgetSocket( &me->commandSock );
 	AES_CTR_Forget( &me->aesContext, &me->aesValid );
 }
 
 //===========================================================================================================================
-//	_AirPlayReceiverSessionScreen_ProcessFrame
+//	_AirPlayReceiverSessionScreen_SubmitDecrypt
 //
-//	Warning: Unconventionally, ensuring that inFramePtr is munmap'd is the responsibility of this function.
+//	Warning: Unconventionally, ensuring that inFrame->ptr is released to the frame pool is the responsibility of the
+//	pipeline from here on. The decode stage releases it once the decoder has returned.
 //===========================================================================================================================
 
-static OSStatus
-	_AirPlayReceiverSessionScreen_ProcessFrame(
-		AirPlayReceiverSessionScreenRef		me,
-		AirPlayScreenHeader *				inHeader, 
-		uint8_t *							inFramePtr )
+static void	_AirPlayReceiverSessionScreen_SubmitDecrypt( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame )
 {
-	OSStatus		err;
-	uint64_t		displayTicks;
-	uint64_t		nowTicks;
-	size_t			tempSize;
+	if( me->decryptThreadPtr && ( _AirPlayScreenFrameQueuePush( &me->decryptQueue, inFrame ) == kNoErr ) ) return;
+	_AirPlayReceiverSessionScreen_DecryptFrame( me, inFrame );
+	_AirPlayReceiverSessionScreen_SubmitDecode( me, inFrame );
+}
+
+//===========================================================================================================================
+//	_AirPlayReceiverSessionScreen_SubmitDecode
+//===========================================================================================================================
+
+static void	_AirPlayReceiverSessionScreen_SubmitDecode( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame )
+{
+	if( me->decodeThreadPtr && ( _AirPlayScreenFrameQueuePush( &me->decodeQueue, inFrame ) == kNoErr ) ) return;
+	_AirPlayReceiverSessionScreen_DecodeFrame( me, inFrame );
+}
+
+//===========================================================================================================================
+//	_AirPlayReceiverSessionScreen_DecryptThread
+//===========================================================================================================================
+
+static void *	_AirPlayReceiverSessionScreen_DecryptThread( void *inArg )
+{
+	AirPlayReceiverSessionScreenRef const		me = (AirPlayReceiverSessionScreenRef) inArg;
+	AirPlayScreenFrame							frame;
+	
+	SetThreadName( "AirPlayScreenDecryptor" );
+	SetCurrentThreadPriority( kAirPlayThreadPriority_ScreenDecryptor );
+	
+	while( _AirPlayScreenFrameQueuePop( &me->decryptQueue, &frame ) == kNoErr )
+	{
+		_AirPlayReceiverSessionScreen_DecryptFrame( me, &frame );
+		_AirPlayReceiverSessionScreen_SubmitDecode( me, &frame );
+	}
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_AirPlayReceiverSessionScreen_DecodeThread
+//===========================================================================================================================
+
+static void *	_AirPlayReceiverSessionScreen_DecodeThread( void *inArg )
+{
+	AirPlayReceiverSessionScreenRef const		me = (AirPlayReceiverSessionScreenRef) inArg;
+	AirPlayScreenFrame							frame;
+	
+	SetThreadName( "AirPlayScreenDecoder" );
+	SetCurrentThreadPriority( kAirPlayThreadPriority_ScreenDecoder );
+	
+	while( _AirPlayScreenFrameQueuePop( &me->decodeQueue, &frame ) == kNoErr )
+	{
+		_AirPlayReceiverSessionScreen_DecodeFrame( me, &frame );
+	}
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_AirPlayReceiverSessionScreen_DecryptFrame
+//
+//	Decrypts a video frame in place. Frames must be decrypted in the order they were received because the nonce/counter
+//	advances with each frame. Errors are left in the frame for the decode stage to account for.
+//===========================================================================================================================
+
+static void	_AirPlayReceiverSessionScreen_DecryptFrame( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame )
+{
+	AirPlayScreenHeader * const		header = &inFrame->header;
+	uint8_t * const					ptr = inFrame->ptr;
+	OSStatus						err;
+	
+	if( header->opcode == kAirPlayScreenOpCode_VideoFrame )
+	{
+		if( me->chachaCryptor.isValid )
+		{
+			if( header->bodySize >= 16 )
+			{
+				size_t len;
+				chacha20_poly1305_init_64x64( &me->chachaCryptor.state, me->chachaCryptor.key, me->chachaCryptor.nonce );
+				chacha20_poly1305_add_aad( &me->chachaCryptor.state, header, sizeof( AirPlayScreenHeader ) );
+				len = chacha20_poly1305_decrypt( &me->chachaCryptor.state, ptr, header->bodySize - 16, ptr );
+				len += chacha20_poly1305_verify( &me->chachaCryptor.state, &ptr[ len ], &ptr[ header->bodySize - 16 ], &err );
+				require_noerr( err, exit );
+				require_action( len == header->bodySize - 16, exit, err = kInternalErr );
+				header->bodySize -= 16;
+				LittleEndianIntegerIncrement( me->chachaCryptor.nonce, sizeof( me->chachaCryptor.nonce ) );
+			}
+		}
+		else
+		if( me->aesValid )
+		{
+			err = AES_CTR_Update( &me->aesContext, ptr, header->bodySize, ptr );
+			require_noerr( err, exit );
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	inFrame->err			= err;
+	inFrame->decryptTicks	= UpTicks();
+	_AirPlayScreenStageStatsAdd( &me->decryptStats, inFrame->decryptTicks - inFrame->readTicks );
+}
+
+//===========================================================================================================================
+//	_AirPlayReceiverSessionScreen_DecodeFrame
+//
+//	Warning: Unconventionally, ensuring that inFrame->ptr is released to the frame pool is the responsibility of this
+//	function. ScreenStream plugins don't have to call the completion so it's released after the decoder returns.
+//===========================================================================================================================
+
+static OSStatus	_AirPlayReceiverSessionScreen_DecodeFrame( AirPlayReceiverSessionScreenRef me, AirPlayScreenFrame *inFrame )
+{
+	AirPlayScreenHeader * const		inHeader	= &inFrame->header;
+	uint8_t *						inFramePtr	= inFrame->ptr;
+	OSStatus						err;
+	uint64_t						displayTicks;
+	uint64_t						nowTicks;
+	int64_t							displayDeltaUs;
+	size_t							tempSize;
+	
+	err = inFrame->err;
+	require_noerr_quiet( err, exit );
 	
 	if( inHeader->opcode == kAirPlayScreenOpCode_VideoFrame )
 	{
-		// Processing timestamps.
+		// Processing timestamps. The frame has already spent time being read and decrypted so measure how much of the
+		// latency budget is left now that it's ready for the decoder.
 		
 		if( me->respectTimestamps )
 		{
@@ -500,46 +770,36 @@ static OSStatus
 		
 		if( displayTicks >= nowTicks )
 		{
-			me->displayDeltaMs = UpTicksToMilliseconds( displayTicks - nowTicks );
+			displayDeltaUs = (int64_t) UpTicksToMicroseconds( displayTicks - nowTicks );
 		}
 		else
 		{
-			me->displayDeltaMs = -(int64_t) UpTicksToMilliseconds( nowTicks - displayTicks );
+			displayDeltaUs = -(int64_t) UpTicksToMicroseconds( nowTicks - displayTicks );
 			++me->negativeAheadFrames;
 		}
-		me->displayDeltaMs = me->videoLatencyMs - me->displayDeltaMs;
+		displayDeltaUs = ( me->videoLatencyMs * 1000 ) - displayDeltaUs;
+		me->displayDeltaMs = displayDeltaUs / 1000;
+		++me->videoFrames;
+		me->displayDeltaUsTotal += displayDeltaUs;
+		if( displayDeltaUs > me->displayDeltaUsMax ) me->displayDeltaUsMax = displayDeltaUs;
 		if( me->displayDeltaMs >= ( 2 * me->videoLatencyMs ) )
 		{
 			++me->lateFrames;
 			tempSize = ( inHeader->bodySize >= 16 ) ? 16 : inHeader->bodySize;
-			apvs_frames_ulog( kLogLevelNotice, "Late frame (%lld ms, %u total late frames): %.3H ... %.3H\n", 
-				me->displayDeltaMs, me->lateFrames, inHeader, 16, 16, 
+			apvs_frames_ulog( kLogLevelNotice, "Late frame (%lld ms, %u total late frames, read %llu µs, decrypt %llu µs, "
+				"decode queue %llu µs): %.3H ... %.3H\n", 
+				me->displayDeltaMs, me->lateFrames, 
+				UpTicksToMicroseconds( inFrame->readTicks - inFrame->receiveTicks ), 
+				UpTicksToMicroseconds( inFrame->decryptTicks - inFrame->readTicks ), 
+				UpTicksToMicroseconds( nowTicks - inFrame->decryptTicks ), inHeader, 16, 16, 
 				inFramePtr + ( inHeader->bodySize - tempSize ), (int) tempSize, (int) tempSize );
 		}
-
-		if( me->chachaCryptor.isValid )
-		{
-			if( inHeader->bodySize >= 16 )
-			{
-				size_t len;
-				chacha20_poly1305_init_64x64( &me->chachaCryptor.state, me->chachaCryptor.key, me->chachaCryptor.nonce );
-				chacha20_poly1305_add_aad( &me->chachaCryptor.state, inHeader, sizeof( AirPlayScreenHeader ) );
-				len = chacha20_poly1305_decrypt( &me->chachaCryptor.state, inFramePtr, inHeader->bodySize - 16, inFramePtr );
-				len += chacha20_poly1305_verify( &me->chachaCryptor.state, &inFramePtr[ len ], &inFramePtr[ inHeader->bodySize - 16 ], &err );
-				require_noerr( err, exit );
-				require_action( len == inHeader->bodySize - 16, exit, err = kInternalErr );
-				inHeader->bodySize -= 16;
-				LittleEndianIntegerIncrement( me->chachaCryptor.nonce, sizeof( me->chachaCryptor.nonce ) );
-			}
-		}
-		else
-		if( me->aesValid )
-		{
-			err = AES_CTR_Update( &me->aesContext, inFramePtr, inHeader->bodySize, inFramePtr );
-			require_noerr( err, exit );
-		}
 		
+		trace_event( ScreenFrame, inHeader->bodySize, Clamp( displayDeltaUs, INT32_MIN, INT32_MAX ), 
+			UpTicksToMicroseconds( inFrame->readTicks - inFrame->receiveTicks ), 
+			UpTicksToMicroseconds( inFrame->decryptTicks - inFrame->readTicks ) );
 		err = ScreenStreamProcessData( me->screenStream, inFramePtr, inHeader->bodySize, displayTicks, NULL, NULL, NULL );
+		trace_event( ScreenFrameDone, err, me->lateFrames, 0, 0 );
 		require_noerr( err, exit );
 	}
 	else if( inHeader->opcode == kAirPlayScreenOpCode_VideoConfig )
@@ -575,7 +835,8 @@ static OSStatus
 	err = kNoErr;
 	
 exit:
-	if( inFramePtr ) free( inFramePtr );
+	AirPlayFramePoolRelease( inFramePtr );
+	_AirPlayScreenStageStatsAdd( &me->decodeStats, UpTicks() - inFrame->decryptTicks );
 	if( err )
 	{
 		++me->frameErrors;
@@ -654,3 +915,472 @@ exit:
 #if 0
 #pragma mark -
 #endif
+
+//===========================================================================================================================
+//	_AirPlayScreenFrameQueueInit
+//===========================================================================================================================
+
+static OSStatus	_AirPlayScreenFrameQueueInit( AirPlayScreenFrameQueue *inQueue, uint32_t inDepth )
+{
+	OSStatus		err;
+	
+	memset( inQueue, 0, sizeof( *inQueue ) );
+	inQueue->frames = (AirPlayScreenFrame *) malloc( inDepth * sizeof( *inQueue->frames ) );
+	require_action( inQueue->frames, exit, err = kNoMemoryErr );
+	inQueue->depth = inDepth;
+	
+	err = pthread_mutex_init( &inQueue->mutex, NULL );
+	require_noerr( err, exit );
+	inQueue->mutexPtr = &inQueue->mutex;
+	
+	err = pthread_cond_init( &inQueue->cond, NULL );
+	require_noerr( err, exit );
+	inQueue->condPtr = &inQueue->cond;
+	
+exit:
+	if( err ) _AirPlayScreenFrameQueueFree( inQueue );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenFrameQueueFree
+//
+//	Releases any frames still queued. The threads using the queue must have already exited.
+//===========================================================================================================================
+
+static void	_AirPlayScreenFrameQueueFree( AirPlayScreenFrameQueue *inQueue )
+{
+	for( ; inQueue->count > 0; --inQueue->count )
+	{
+		AirPlayFramePoolRelease( inQueue->frames[ inQueue->head ].ptr );
+		inQueue->head = ( inQueue->head + 1 ) % inQueue->depth;
+	}
+	ForgetMem( &inQueue->frames );
+	pthread_cond_forget( &inQueue->condPtr );
+	pthread_mutex_forget( &inQueue->mutexPtr );
+	memset( inQueue, 0, sizeof( *inQueue ) );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenFrameQueuePush
+//
+//	Waits for space and adds a copy of the frame. Returns kEndingErr if the queue has been closed.
+//===========================================================================================================================
+
+static OSStatus	_AirPlayScreenFrameQueuePush( AirPlayScreenFrameQueue *inQueue, const AirPlayScreenFrame *inFrame )
+{
+	OSStatus		err;
+	
+	pthread_mutex_lock( inQueue->mutexPtr );
+	while( !inQueue->closed && ( inQueue->count >= inQueue->depth ) ) pthread_cond_wait( inQueue->condPtr, inQueue->mutexPtr );
+	require_action_quiet( !inQueue->closed, exit, err = kEndingErr );
+	
+	inQueue->frames[ ( inQueue->head + inQueue->count ) % inQueue->depth ] = *inFrame;
+	++inQueue->count;
+	pthread_cond_broadcast( inQueue->condPtr );
+	err = kNoErr;
+	
+exit:
+	pthread_mutex_unlock( inQueue->mutexPtr );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenFrameQueuePop
+//
+//	Waits for and removes the oldest frame. Returns kEndingErr once the queue has been closed and emptied.
+//===========================================================================================================================
+
+static OSStatus	_AirPlayScreenFrameQueuePop( AirPlayScreenFrameQueue *inQueue, AirPlayScreenFrame *outFrame )
+{
+	OSStatus		err;
+	
+	pthread_mutex_lock( inQueue->mutexPtr );
+	while( !inQueue->closed && ( inQueue->count == 0 ) ) pthread_cond_wait( inQueue->condPtr, inQueue->mutexPtr );
+	require_action_quiet( inQueue->count > 0, exit, err = kEndingErr );
+	
+	*outFrame = inQueue->frames[ inQueue->head ];
+	inQueue->head = ( inQueue->head + 1 ) % inQueue->depth;
+	--inQueue->count;
+	pthread_cond_broadcast( inQueue->condPtr );
+	err = kNoErr;
+	
+exit:
+	pthread_mutex_unlock( inQueue->mutexPtr );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenFrameQueueClose
+//===========================================================================================================================
+
+static void	_AirPlayScreenFrameQueueClose( AirPlayScreenFrameQueue *inQueue )
+{
+	pthread_mutex_lock( inQueue->mutexPtr );
+	inQueue->closed = true;
+	pthread_cond_broadcast( inQueue->condPtr );
+	pthread_mutex_unlock( inQueue->mutexPtr );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenStageStatsAdd
+//===========================================================================================================================
+
+static void	_AirPlayScreenStageStatsAdd( AirPlayScreenStageStats *inStats, uint64_t inTicks )
+{
+	inStats->ticks += inTicks;
+	if( inTicks > inStats->ticksMax ) inStats->ticksMax = inTicks;
+	++inStats->count;
+}
+
+#if 0
+#pragma mark -
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+//===========================================================================================================================
+//	AirPlayReceiverSessionScreenTest
+//
+//	Replays an encrypted H.264-like capture from a sender thread over loopback TCP. Each run first paces frames at 60 fps
+//	to measure the end-to-end latency and then sends the whole capture as fast as possible to measure throughput. Runs
+//	both with every stage inline on the read thread (queue depths 0) and with the default pipeline.
+//===========================================================================================================================
+
+#define kAirPlayScreenTestLatencyMs			100
+#define kAirPlayScreenTestFPS				60
+#define kAirPlayScreenTestKeyFrameInterval	60
+
+typedef struct
+{
+	uint8_t			key[ 32 ];
+	uint8_t *		capture;		// Config frame followed by encrypted video frames, each a header then a body.
+	size_t			captureLen;
+	size_t *		offsets;		// Offset of each frame in the capture.
+	uint32_t		frameCount;		// Number of frames, including the config frame.
+	
+	SocketRef		sock;
+	Boolean			paced;
+	uint64_t		startTicks;		// UpTicks when the first frame was sent.
+	OSStatus		err;
+	
+}	AirPlayScreenTestContext;
+
+static OSStatus	_AirPlayScreenTestCreateCapture( AirPlayScreenTestContext *ctx, uint32_t inVideoFrames );
+static OSStatus
+	_AirPlayScreenTestRun(
+		AirPlayScreenTestContext *	ctx,
+		uint32_t					inDepth,
+		Boolean						inPaced,
+		int							inPrint,
+		double *					outFPS,
+		double *					outLatencyMs );
+static void *	_AirPlayScreenTestSender( void *inArg );
+static uint64_t	_AirPlayScreenTestGetSynchronizedNTPTime( void *inContext );
+static uint64_t	_AirPlayScreenTestGetUpTicksNearSynchronizedNTPTime( void *inContext, uint64_t inNTPTime );
+
+OSStatus	AirPlayReceiverSessionScreenTest( int inPrint, int inPerf )
+{
+	uint32_t const					videoFrames = inPerf ? ( 60 * kAirPlayScreenTestFPS ) : ( 5 * kAirPlayScreenTestFPS );
+	uint32_t const					depths[ 2 ] = { 0, kAirPlayReceiverSessionScreenDecryptQueueDepthDefault };
+	OSStatus						err;
+	AirPlayScreenTestContext		ctx;
+	double							fps[ 2 ], latencyMs[ 2 ], unused;
+	size_t							i;
+	
+	memset( &ctx, 0, sizeof( ctx ) );
+	ctx.sock = kInvalidSocketRef;
+	err = _AirPlayScreenTestCreateCapture( &ctx, videoFrames );
+	require_noerr( err, exit );
+	
+	for( i = 0; i < countof( depths ); ++i )
+	{
+		err = _AirPlayScreenTestRun( &ctx, depths[ i ], true, inPrint, &unused, &latencyMs[ i ] );
+		require_noerr( err, exit );
+		err = _AirPlayScreenTestRun( &ctx, depths[ i ], false, inPrint, &fps[ i ], &unused );
+		require_noerr( err, exit );
+	}
+	if( inPrint )
+	{
+		fprintf( stderr, "\tinline:    %6.2f ms avg latency at %d fps, %7.1f fps max\n", 
+			latencyMs[ 0 ], kAirPlayScreenTestFPS, fps[ 0 ] );
+		fprintf( stderr, "\tpipelined: %6.2f ms avg latency at %d fps, %7.1f fps max\n", 
+			latencyMs[ 1 ], kAirPlayScreenTestFPS, fps[ 1 ] );
+	}
+	
+exit:
+	FreeNullSafe( ctx.capture );
+	FreeNullSafe( ctx.offsets );
+	printf( "AirPlayReceiverSessionScreenTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenTestCreateCapture
+//
+//	Builds a config frame with an avcC followed by video frames of length-prefixed NAL units: a 100-200 KB key frame
+//	every second and 4-40 KB frames in between. Video frames carry their offset from the first frame in UpTicks as
+//	their timestamp and are encrypted the same way a sender would.
+//===========================================================================================================================
+
+static OSStatus	_AirPlayScreenTestCreateCapture( AirPlayScreenTestContext *ctx, uint32_t inVideoFrames )
+{
+	static const uint8_t		kAVCC[] = 
+	{
+		0x01, 0x64, 0x00, 0x1F, 0xFF, 0xE1, 0x00, 0x08, 0x67, 0x64, 0x00, 0x1F, 0xAC, 0xD9, 0x40, 0x50, 
+		0x01, 0x00, 0x04, 0x68, 0xEB, 0xE3, 0xCB
+	};
+	uint64_t const				frameTicks = UpTicksPerSecond() / kAirPlayScreenTestFPS;
+	OSStatus					err;
+	uint32_t					seed, i;
+	size_t						len, bodyLen, nalLen, offset;
+	AirPlayScreenHeader *		header;
+	uint8_t *					body;
+	uint8_t *					ptr;
+	uint8_t						nonce[ 8 ];
+	
+	RandomBytes( ctx->key, sizeof( ctx->key ) );
+	ctx->frameCount = 1 + inVideoFrames;
+	ctx->offsets = (size_t *) malloc( ctx->frameCount * sizeof( *ctx->offsets ) );
+	require_action( ctx->offsets, exit, err = kNoMemoryErr );
+	
+	// Size everything up front so the capture is a single allocation.
+	
+	len = sizeof( AirPlayScreenHeader ) + sizeof( kAVCC );
+	seed = 1;
+	for( i = 0; i < inVideoFrames; ++i )
+	{
+		seed = ( seed * 1103515245 ) + 12345;
+		if( ( i % kAirPlayScreenTestKeyFrameInterval ) == 0 )	len += 100000 + ( ( seed >> 8 ) % 100000 );
+		else													len +=   4000 + ( ( seed >> 8 ) %  36000 );
+		len += sizeof( AirPlayScreenHeader ) + 16;
+	}
+	ctx->capture = (uint8_t *) calloc( 1, len );
+	require_action( ctx->capture, exit, err = kNoMemoryErr );
+	ctx->captureLen = len;
+	
+	header = (AirPlayScreenHeader *) ctx->capture;
+	header->bodySize			= (uint32_t) sizeof( kAVCC );
+	header->opcode				= kAirPlayScreenOpCode_VideoConfig;
+	header->smallParam[ 1 ]		= kAirPlayScreenFlag_RespectTimestamps;
+	header->params[ 1 ].f32[ 0 ] = 1280;
+	header->params[ 1 ].f32[ 1 ] = 720;
+	memcpy( header + 1, kAVCC, sizeof( kAVCC ) );
+	ctx->offsets[ 0 ] = 0;
+	offset = sizeof( AirPlayScreenHeader ) + sizeof( kAVCC );
+	
+	memset( nonce, 0, sizeof( nonce ) );
+	seed = 1;
+	for( i = 0; i < inVideoFrames; ++i )
+	{
+		seed = ( seed * 1103515245 ) + 12345;
+		if( ( i % kAirPlayScreenTestKeyFrameInterval ) == 0 )	bodyLen = 100000 + ( ( seed >> 8 ) % 100000 );
+		else													bodyLen =   4000 + ( ( seed >> 8 ) %  36000 );
+		
+		ctx->offsets[ 1 + i ] = offset;
+		header = (AirPlayScreenHeader *) &ctx->capture[ offset ];
+		body = (uint8_t *)( header + 1 );
+		header->bodySize		= (uint32_t)( bodyLen + 16 );
+		header->opcode			= kAirPlayScreenOpCode_VideoFrame;
+		header->params[ 0 ].u64	= i * frameTicks;
+		
+		// Split the body into NAL units of up to 16 KB, each with a 4-byte big endian length prefix.
+		
+		for( ptr = body; ptr < ( body + bodyLen ); ptr += ( 4 + nalLen ) )
+		{
+			nalLen = (size_t)( ( body + bodyLen ) - ptr );
+			if( nalLen > ( 16384 + 8 ) ) nalLen = 16384;
+			nalLen -= 4;
+			WriteBig32( ptr, nalLen );
+			ptr[ 4 ] = ( ptr == body ) ? ( ( ( i % kAirPlayScreenTestKeyFrameInterval ) == 0 ) ? 0x65 : 0x41 ) : 0x01;
+			memset( &ptr[ 5 ], (int)( i & 0xFF ), nalLen - 1 );
+		}
+		chacha20_poly1305_encrypt_all_64x64( ctx->key, nonce, header, sizeof( *header ), body, bodyLen, body, 
+			&body[ bodyLen ] );
+		LittleEndianIntegerIncrement( nonce, sizeof( nonce ) );
+		offset += sizeof( AirPlayScreenHeader ) + bodyLen + 16;
+	}
+	check( offset == len );
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenTestRun
+//===========================================================================================================================
+
+static OSStatus
+	_AirPlayScreenTestRun(
+		AirPlayScreenTestContext *	ctx,
+		uint32_t					inDepth,
+		Boolean						inPaced,
+		int							inPrint,
+		double *					outFPS,
+		double *					outLatencyMs )
+{
+	OSStatus										err;
+	AirPlayReceiverSessionScreenRef					screen = NULL;
+	AirPlayReceiverSessionScreenTimeSynchronizer	timeSynchronizer;
+	CFMutableDictionaryRef							streamDesc = NULL;
+	SocketRef										listenSock = kInvalidSocketRef;
+	SocketRef										recvSock = kInvalidSocketRef;
+	NetSocketRef									netSock = NULL;
+	int												port;
+	struct sockaddr_in								sin;
+	pthread_t										sender;
+	pthread_t *										senderPtr = NULL;
+	Boolean											started = false;
+	uint64_t										ticks;
+	DataBuffer										db;
+	
+	DataBuffer_Init( &db, NULL, 0, SIZE_MAX );
+	err = AirPlayReceiverSessionScreen_Create( &screen );
+	require_noerr( err, exit );
+	
+	streamDesc = CFDictionaryCreateMutable( NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+	require_action( streamDesc, exit, err = kNoMemoryErr );
+	CFDictionarySetInt64( streamDesc, CFSTR( "latencyMs" ), kAirPlayScreenTestLatencyMs );
+	err = AirPlayReceiverSessionScreen_Setup( screen, streamDesc, 1 );
+	require_noerr( err, exit );
+	err = AirPlayReceiverSessionScreen_SetChaChaSecurityInfo( screen, ctx->key, sizeof( ctx->key ) );
+	require_noerr( err, exit );
+	AirPlayReceiverSessionScreen_SetQueueDepths( screen, inDepth, inDepth );
+	
+	timeSynchronizer.context								= ctx;
+	timeSynchronizer.getSynchronizedNTPTimeFunc				= _AirPlayScreenTestGetSynchronizedNTPTime;
+	timeSynchronizer.getUpTicksNearSynchronizedNTPTimeFunc	= _AirPlayScreenTestGetUpTicksNearSynchronizedNTPTime;
+	AirPlayReceiverSessionScreen_SetTimeSynchronizer( screen, &timeSynchronizer );
+	
+	err = AirPlayReceiverSessionScreen_StartSession( screen, NULL );
+	require_noerr( err, exit );
+	started = true;
+	
+	// Connect the sender to the receiver over loopback TCP.
+	
+	err = ServerSocketOpen( AF_INET, SOCK_STREAM, IPPROTO_TCP, kSocketPort_Auto, &port, kSocketBufferSize_DontSet, &listenSock );
+	require_noerr( err, exit );
+	ctx->sock = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	err = map_socket_creation_errno( ctx->sock );
+	require_noerr( err, exit );
+	memset( &sin, 0, sizeof( sin ) );
+	sin.sin_family		= AF_INET;
+	sin.sin_addr.s_addr	= htonl( INADDR_LOOPBACK );
+	sin.sin_port		= htons( (uint16_t) port );
+	err = SocketConnect( ctx->sock, &sin, 5 );
+	require_noerr( err, exit );
+	err = SocketMakeBlocking( ctx->sock );
+	require_noerr( err, exit );
+	err = SocketAccept( listenSock, 5, &recvSock, NULL );
+	require_noerr( err, exit );
+	err = NetSocket_CreateWithNative( &netSock, recvSock );
+	require_noerr( err, exit );
+	recvSock = kInvalidSocketRef;
+	
+	ctx->paced	= inPaced;
+	ctx->err	= kNoErr;
+	err = pthread_create( &sender, NULL, _AirPlayScreenTestSender, ctx );
+	require_noerr( err, exit );
+	senderPtr = &sender;
+	
+	// Receive until the sender closes the connection then let the pipeline drain.
+	
+	err = AirPlayReceiverSessionScreen_ProcessFrames( screen, netSock, 5 );
+	require_noerr( err, exit );
+	AirPlayReceiverSessionScreen_StopSession( screen );
+	started = false;
+	ticks = UpTicks() - ctx->startTicks;
+	pthread_join( sender, NULL );
+	senderPtr = NULL;
+	require_noerr_action( ctx->err, exit, err = ctx->err );
+	
+	*outFPS			= ( ( ctx->frameCount - 1 ) * (double) UpTicksPerSecond() ) / ticks;
+	*outLatencyMs	= ( screen->videoFrames > 0 ) ? ( screen->displayDeltaUsTotal / ( 1000.0 * screen->videoFrames ) ) : 0;
+	if( inPrint )
+	{
+		AirPlayReceiverSessionScreen_AppendStats( screen, &db );
+		fprintf( stderr, "\tdepth %u, %s: %.*s\n", inDepth, inPaced ? "paced" : "unpaced", 
+			(int) DataBuffer_GetLen( &db ), DataBuffer_GetPtr( &db ) );
+	}
+	require_action( screen->videoFrames == ( ctx->frameCount - 1 ), exit, err = kResponseErr );
+	require_action( screen->frameErrors == 0, exit, err = kResponseErr );
+	
+exit:
+	if( started ) AirPlayReceiverSessionScreen_StopSession( screen );
+	NetSocket_Forget( &netSock );
+	if( senderPtr ) pthread_join( *senderPtr, NULL );
+	ForgetSocket( &ctx->sock );
+	ForgetSocket( &recvSock );
+	ForgetSocket( &listenSock );
+	CFReleaseNullSafe( streamDesc );
+	if( screen ) AirPlayReceiverSessionScreen_Delete( screen );
+	DataBuffer_Free( &db );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenTestSender
+//===========================================================================================================================
+
+static void *	_AirPlayScreenTestSender( void *inArg )
+{
+	AirPlayScreenTestContext * const		ctx = (AirPlayScreenTestContext *) inArg;
+	uint64_t const							frameTicks = UpTicksPerSecond() / kAirPlayScreenTestFPS;
+	OSStatus								err;
+	uint32_t								i;
+	const uint8_t *							ptr;
+	const uint8_t *							end;
+	uint64_t								dueTicks, ticks;
+	ssize_t									n;
+	
+	ctx->startTicks = UpTicks();
+	for( i = 0; i < ctx->frameCount; ++i )
+	{
+		if( ctx->paced && ( i > 1 ) )
+		{
+			dueTicks = ctx->startTicks + ( ( i - 1 ) * frameTicks );
+			ticks = UpTicks();
+			if( ticks < dueTicks ) usleep( (useconds_t)( ( ( dueTicks - ticks ) * 1000000 ) / UpTicksPerSecond() ) );
+		}
+		ptr = &ctx->capture[ ctx->offsets[ i ] ];
+		end = ( ( i + 1 ) < ctx->frameCount ) ? &ctx->capture[ ctx->offsets[ i + 1 ] ] : &ctx->capture[ ctx->captureLen ];
+		while( ptr < end )
+		{
+			n = send( ctx->sock, (const char *) ptr, (size_t)( end - ptr ), 0 );
+			err = map_socket_value_errno( ctx->sock, n > 0, n );
+			require_noerr( err, exit );
+			ptr += n;
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	ForgetSocket( &ctx->sock );
+	ctx->err = err;
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenTestGetSynchronizedNTPTime
+//===========================================================================================================================
+
+static uint64_t	_AirPlayScreenTestGetSynchronizedNTPTime( void *inContext )
+{
+	AirPlayScreenTestContext * const		ctx = (AirPlayScreenTestContext *) inContext;
+	
+	return( UpTicks() - ctx->startTicks );
+}
+
+//===========================================================================================================================
+//	_AirPlayScreenTestGetUpTicksNearSynchronizedNTPTime
+//
+//	Frame timestamps are UpTicks relative to the first frame so each frame is due a fixed latency after it's sent.
+//===========================================================================================================================
+
+static uint64_t	_AirPlayScreenTestGetUpTicksNearSynchronizedNTPTime( void *inContext, uint64_t inNTPTime )
+{
+	AirPlayScreenTestContext * const		ctx = (AirPlayScreenTestContext *) inContext;
+	
+	return( ctx->startTicks + inNTPTime + MillisecondsToUpTicks( kAirPlayScreenTestLatencyMs ) );
+}
+#endif // !EXCLUDE_UNIT_TESTS
@@ -87,6 +87,16 @@ typedef struct
 	AirPlayReceiverSessionScreen_GetUpTicksNearSynchronizedNTPTimeFunc	getUpTicksNearSynchronizedNTPTimeFunc;
 }	AirPlayReceiverSessionScreenTimeSynchronizer;
 
+// Default number of frames queued between the read and decrypt stages and between the decrypt and decode stages.
+
+#define kAirPlayReceiverSessionScreenDecryptQueueDepthDefault		2
+#define kAirPlayReceiverSessionScreenDecodeQueueDepthDefault		2
+
+void
+	AirPlayReceiverSessionScreen_SetQueueDepths(
+		AirPlayReceiverSessionScreenRef		inSession,
+		uint32_t							inDecryptDepth,
+		uint32_t							inDecodeDepth );
 void
 	AirPlayReceiverSessionScreen_SetTimeSynchronizer(
 		AirPlayReceiverSessionScreenRef								inSession,
@@ -122,6 +132,7 @@ OSStatus
 		int									inTimeoutDataSecs );
 OSStatus	AirPlayReceiverSessionScreen_StartSession( AirPlayReceiverSessionScreenRef inSession, void* context );
 void		AirPlayReceiverSessionScreen_StopSession( AirPlayReceiverSessionScreenRef inSession );
+void		AirPlayReceiverSessionScreen_AppendStats( AirPlayReceiverSessionScreenRef inSession, DataBuffer *inDB );
 
 #define kAirPlayReceiverSessionScreenCommand_Quit			'q'
 
@@ -132,6 +143,10 @@ OSStatus
 		const void *						inExtraPtr,
 		size_t								inExtraLen );
 
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	AirPlayReceiverSessionScreenTest( int inPrint, int inPerf );
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -53,14 +53,18 @@
 
 #include "AirPlayUtils.h"
 
+#include "AtomicUtils.h"
 #include "CFUtils.h"
 #include "CommonServices.h"
 #include "DebugServices.h"
 #include "ThreadUtils.h"
 #include "TickUtils.h"
+#include "TraceUtils.h"
 
 #include "AirPlayCommon.h"
 
+#include <math.h>
+
 #include COREAUDIO_HEADER
 #include SHA_HEADER
 
@@ -72,6 +76,10 @@ ulog_define( AirPlayJitterBuffer, kLogLevelNotice, kLogFlags_Default, "AirPlay",
 #define ap_jitter_ulog( LEVEL, ... )		ulog( &log_category_from_name( AirPlayJitterBuffer ), (LEVEL), __VA_ARGS__ )
 #define ap_jitter_label( CTX )				( (CTX)->label ? (CTX)->label : "Default" )
 
+trace_define( JitterBufferRead,		kTracePhase_Begin,		"frames,fill,buffering" );
+trace_define( JitterBufferReadDone,	kTracePhase_End,		"gaps,late,skipped,rebuffers" );
+trace_define( JitterBufferFill,		kTracePhase_Counter,	"frames" );
+
 //===========================================================================================================================
 //	AirPlayAudioFormatToASBD
 //===========================================================================================================================
@@ -408,25 +416,317 @@ void
 	free( screenStreamIVSalt );
 }
 
+//===========================================================================================================================
+//	AirPlayConditionInit
+//===========================================================================================================================
+
+OSStatus	AirPlayConditionInit( pthread_cond_t *inCondition )
+{
+	OSStatus		err;
+#if( !TARGET_OS_DARWIN && !TARGET_OS_THREADX )
+	pthread_condattr_t		condAttr;
+	
+	pthread_condattr_init( &condAttr );
+	pthread_condattr_setclock( &condAttr, CLOCK_MONOTONIC );
+	err = pthread_cond_init( inCondition, &condAttr );
+	pthread_condattr_destroy( &condAttr );
+#else
+	err = pthread_cond_init( inCondition, NULL );
+#endif
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlayConditionTimedWait
+//===========================================================================================================================
+
+int	AirPlayConditionTimedWait( pthread_cond_t *inCondition, pthread_mutex_t *inMutex, uint32_t inMs )
+{
+	struct timespec		timeout;
+	
+#if( TARGET_OS_DARWIN || TARGET_OS_THREADX )
+	timeout.tv_sec  = (time_t)( inMs / 1000 );
+	timeout.tv_nsec = (long)( ( inMs % 1000 ) * kNanosecondsPerMillisecond );
+	return( pthread_cond_timedwait_relative_np( inCondition, inMutex, &timeout ) );
+#else
+	clock_gettime( CLOCK_MONOTONIC, &timeout );
+	timeout.tv_sec  += (time_t)( inMs / 1000 );
+	timeout.tv_nsec += (long)( ( inMs % 1000 ) * kNanosecondsPerMillisecond );
+	if( timeout.tv_nsec >= kNanosecondsPerSecond )
+	{
+		timeout.tv_sec  += 1;
+		timeout.tv_nsec -= kNanosecondsPerSecond;
+	}
+	return( pthread_cond_timedwait( inCondition, inMutex, &timeout ) );
+#endif
+}
+
+#if 0
+#pragma mark -
+#endif
+
+#if( AIRPLAY_ALLOC_TRACKING )
+//===========================================================================================================================
+//	Allocation Tracking
+//
+//	Interposes the glibc allocator entry points. The counters are initial-exec TLS so touching them never allocates.
+//===========================================================================================================================
+
+#if( !defined( __GLIBC__ ) )
+	#error "AIRPLAY_ALLOC_TRACKING requires glibc"
+#endif
+
+extern void *	__libc_malloc( size_t inSize );
+extern void *	__libc_calloc( size_t inCount, size_t inSize );
+extern void *	__libc_realloc( void *inPtr, size_t inSize );
+extern void		__libc_free( void *inPtr );
+
+static __thread int32_t		gAirPlayAllocTrackingDepth __attribute__( ( tls_model( "initial-exec" ) ) );
+static __thread uint64_t	gAirPlayAllocTrackingCount __attribute__( ( tls_model( "initial-exec" ) ) );
+
+#define AirPlayAllocTrackingCount()		do { if( gAirPlayAllocTrackingDepth > 0 ) ++gAirPlayAllocTrackingCount; } while( 0 )
+
+void *	malloc( size_t inSize )							{ AirPlayAllocTrackingCount(); return( __libc_malloc( inSize ) ); }
+void *	calloc( size_t inCount, size_t inSize )			{ AirPlayAllocTrackingCount(); return( __libc_calloc( inCount, inSize ) ); }
+void *	realloc( void *inPtr, size_t inSize )			{ AirPlayAllocTrackingCount(); return( __libc_realloc( inPtr, inSize ) ); }
+void	free( void *inPtr )								{ if( inPtr ) AirPlayAllocTrackingCount(); __libc_free( inPtr ); }
+
+//===========================================================================================================================
+//	AirPlayAllocTrackingBegin
+//===========================================================================================================================
+
+void	AirPlayAllocTrackingBegin( void )
+{
+	if( gAirPlayAllocTrackingDepth++ == 0 ) gAirPlayAllocTrackingCount = 0;
+}
+
+//===========================================================================================================================
+//	AirPlayAllocTrackingEnd
+//
+//	Returns the number of allocator calls made by this thread since the outermost AirPlayAllocTrackingBegin.
+//===========================================================================================================================
+
+uint64_t	AirPlayAllocTrackingEnd( void )
+{
+	check( gAirPlayAllocTrackingDepth > 0 );
+	--gAirPlayAllocTrackingDepth;
+	return( gAirPlayAllocTrackingCount );
+}
+
+#if 0
+#pragma mark -
+#endif
+#endif // AIRPLAY_ALLOC_TRACKING
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerInternals
+//===========================================================================================================================
+
+#define kAirPlaySkewResamplerMaxAdjust		( ( (Float64) kAirTunesMaxSkewAdjustRate ) / kAirTunesSampleRate )
+
+#define _AirPlaySkewResamplerInputIndex( CTX, FRAME )	( (uint32_t)( (CTX)->position + ( ( (Float64)(FRAME) ) * (CTX)->rate ) ) )
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerInit
+//===========================================================================================================================
+
+OSStatus	AirPlaySkewResamplerInit( AirPlaySkewResampler *ctx, uint32_t inChannels, uint32_t inMaxFrames )
+{
+	OSStatus		err;
+	
+	memset( ctx, 0, sizeof( *ctx ) );
+	require_action( inChannels > 0, exit, err = kParamErr );
+	require_action( inMaxFrames > 0, exit, err = kParamErr );
+	ctx->channels	= inChannels;
+	ctx->maxFrames	= inMaxFrames;
+	
+	// Room for the max adjustment plus the frames the interpolator keeps from the previous block.
+	
+	ctx->inputCapacity = inMaxFrames + (uint32_t)( inMaxFrames * kAirPlaySkewResamplerMaxAdjust ) + 8;
+	ctx->input = (int16_t *) calloc( ctx->inputCapacity * inChannels, sizeof( int16_t ) );
+	require_action( ctx->input, exit, err = kNoMemoryErr );
+	
+	ctx->rate = 1.0;
+	AirPlaySkewResamplerReset( ctx );
+	err = kNoErr;
+	
+exit:
+	if( err ) AirPlaySkewResamplerFree( ctx );
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerFree
+//===========================================================================================================================
+
+void	AirPlaySkewResamplerFree( AirPlaySkewResampler *ctx )
+{
+	ForgetMem( &ctx->input );
+	ctx->inputFrames	= 0;
+	ctx->inputCapacity	= 0;
+}
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerReset
+//
+//	Forgets buffered input (e.g. after a flush). Keeps the rate.
+//===========================================================================================================================
+
+void	AirPlaySkewResamplerReset( AirPlaySkewResampler *ctx )
+{
+	// The interpolator needs 1 frame before the output position. Start with 1 frame of silence.
+	
+	if( ctx->input ) memset( ctx->input, 0, ctx->channels * sizeof( int16_t ) );
+	ctx->inputFrames	= 1;
+	ctx->position		= 1.0;
+}
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerSetRate
+//
+//	Sets the number of input frames to consume per output frame. Clamped to kAirTunesMaxSkewAdjustRate.
+//===========================================================================================================================
+
+void	AirPlaySkewResamplerSetRate( AirPlaySkewResampler *ctx, Float64 inRate )
+{
+	ctx->rate = Clamp( inRate, 1.0 - kAirPlaySkewResamplerMaxAdjust, 1.0 + kAirPlaySkewResamplerMaxAdjust );
+}
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerPrepare
+//
+//	Returns the number of input frames needed to produce inFrames of output and where to write them. The caller must
+//	write exactly that many frames before calling AirPlaySkewResamplerProcess with the same number of output frames.
+//===========================================================================================================================
+
+uint32_t	AirPlaySkewResamplerPrepare( AirPlaySkewResampler *ctx, uint32_t inFrames, int16_t **outInput )
+{
+	uint32_t		needed;
+	
+	check( ( inFrames > 0 ) && ( inFrames <= ctx->maxFrames ) );
+	
+	// The last output frame interpolates between the 2 frames before and after its position so it needs 2 frames past
+	// its index.
+	
+	needed = _AirPlaySkewResamplerInputIndex( ctx, inFrames - 1 ) + 3;
+	needed = ( needed > ctx->inputFrames ) ? ( needed - ctx->inputFrames ) : 0;
+	check( ( ctx->inputFrames + needed ) <= ctx->inputCapacity );
+	
+	*outInput = &ctx->input[ ctx->inputFrames * ctx->channels ];
+	ctx->inputFrames += needed;
+	return( needed );
+}
+
+//===========================================================================================================================
+//	AirPlaySkewResamplerProcess
+//===========================================================================================================================
+
+void	AirPlaySkewResamplerProcess( AirPlaySkewResampler *ctx, int16_t *inDst, uint32_t inFrames )
+{
+	uint32_t const		channels = ctx->channels;
+	uint32_t			frame, channel, i;
+	const int16_t *		src;
+	Float64				pos;
+	float				t, xm1, x0, x1, x2, y;
+	
+	for( frame = 0; frame < inFrames; ++frame )
+	{
+		pos = ctx->position + ( ( (Float64) frame ) * ctx->rate );
+		i	= (uint32_t) pos;
+		t	= (float)( pos - i );
+		src	= &ctx->input[ ( i - 1 ) * channels ];
+		for( channel = 0; channel < channels; ++channel )
+		{
+			xm1	= src[ channel ];
+			x0	= src[ channel + channels ];
+			x1	= src[ channel + ( 2 * channels ) ];
+			x2	= src[ channel + ( 3 * channels ) ];
+			y	= x0 + ( 0.5f * t * ( ( x1 - xm1 ) + ( t * ( ( ( 2.0f * xm1 ) - ( 5.0f * x0 ) + ( 4.0f * x1 ) - x2 ) + 
+					( t * ( ( 3.0f * ( x0 - x1 ) ) + x2 - xm1 ) ) ) ) ) );
+			y	= ( y >= 0 ) ? ( y + 0.5f ) : ( y - 0.5f );
+			*inDst++ = (int16_t) Clamp( y, -32768.0f, 32767.0f );
+		}
+	}
+	
+	// Drop the input that's no longer needed, keeping the frame before the next output position.
+	
+	i = _AirPlaySkewResamplerInputIndex( ctx, inFrames ) - 1;
+	memmove( ctx->input, &ctx->input[ i * channels ], ( ctx->inputFrames - i ) * channels * sizeof( int16_t ) );
+	ctx->inputFrames -= i;
+	ctx->position = ( ctx->position + ( ( (Float64) inFrames ) * ctx->rate ) ) - i;
+}
+
 #if 0
 #pragma mark -
 #endif
 
 //===========================================================================================================================
 //	RTPJitterBufferInternals
+//
+//	Packets live in a power-of-2 ring of slots indexed by their extended sequence number. Each slot has an atomic state
+//	and ownership of a node moves between threads with that state:
+//
+//		Empty -> Received/Prepared		Producer queues a node (only the producer fills empty slots).
+//		Received -> Decoding -> Prepared	Decode thread decodes the node in place.
+//		Prepared -> Empty					Consumer reads the node and hands it back to the producer via the return ring.
+//
+//	Nodes are discarded with a compare-and-swap from Received/Prepared to Empty so a discard can't race the decoder.
+//	Shared counters are written by a single thread and published with the barriers in _RTPJitterBufferStore.
 //===========================================================================================================================
 
-	#define RTPJitterBufferLock( CTX, UNUSED )		dispatch_semaphore_wait( (CTX)->nodeLock, DISPATCH_TIME_FOREVER )
-	#define RTPJitterBufferUnlock( CTX, UNUSED )	dispatch_semaphore_signal( (CTX)->nodeLock )
+#define kRTPJitterBufferSlot_Empty			0	// No node. Only the producer fills empty slots.
+#define kRTPJitterBufferSlot_Received		1	// Node queued, but not decoded yet.
+#define kRTPJitterBufferSlot_Decoding		2	// Node being decoded by the decode thread.
+#define kRTPJitterBufferSlot_Prepared		3	// Node ready for reading.
+
+#define kRTPJitterBufferReorderSlack		8	// Sequence numbers to leave room for before the first packet.
+#define kRTPJitterBufferStaleResync			8	// Consecutive packets far behind the consumer before resyncing to them.
+#define kRTPJitterBufferDecodeRetryMs		5	// How often the decode thread re-checks while waiting on a missing packet.
+#define kRTPJitterBufferResampleFrames		512	// Max output frames to resample at a time.
+
+// Fill level control. The fill level is smoothed over about a second to average out network jitter and packet
+// boundaries. The PI gains are critically damped at 0.05 rad/s (settles in about a minute) so adjustments stay within
+// a few hundred ppm and are never audible as pitch changes.
+
+#define kRTPJitterBufferFillSeconds			1.0
+#define kRTPJitterBufferRateKp				0.1
+#define kRTPJitterBufferRateKi				0.0025
 
 #define RTPJitterBufferSamplesToMs( CTX, X )	( ( ( 1000 * (X) ) + (uint32_t)( (CTX)->inputFormat.mSampleRate / 2 ) ) / (uint32_t)(CTX)->inputFormat.mSampleRate )
 #define RTPJitterBufferMsToSamples( CTX, X )	( ( (X) * (uint32_t)(CTX)->inputFormat.mSampleRate ) / 1000 )
 #define RTPJitterBufferBufferedMs( CTX )		RTPJitterBufferSamplesToMs( (CTX), _RTPJitterBufferBufferedSamples( (CTX), false ) )
 #define RTPJitterBufferPreparedMs( CTX )		RTPJitterBufferSamplesToMs( (CTX), _RTPJitterBufferBufferedSamples( (CTX), true ) )
+#define RTPJitterBufferSlot( CTX, SEQ )			( &(CTX)->slots[ (SEQ) & (CTX)->slotMask ] )
+#define RTPJitterBufferNodeTS( NODE )			( (NODE)->pkt.pkt.rtp.header.ts )
+
+STATIC_INLINE uint32_t	_RTPJitterBufferLoad( const void *inPtr )
+{
+	uint32_t		x;
+	
+	x = *( (const volatile uint32_t *) inPtr );
+	atomic_read_barrier();
+	return( x );
+}
+
+STATIC_INLINE void	_RTPJitterBufferStore( void *inPtr, uint32_t inValue )
+{
+	atomic_write_barrier();
+	*( (volatile uint32_t *) inPtr ) = inValue;
+}
 
-static uint32_t _RTPJitterBufferBufferedSamples( RTPJitterBufferContext *ctx, Boolean preparedOnly );
-static OSStatus _RTPJitterBufferDecodeNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode );
-static void * _RTPJitterBufferDecodeThread( void *inCtx );
+static uint32_t			_RTPJitterBufferBufferedSamples( RTPJitterBufferContext *ctx, Boolean preparedOnly );
+static uint32_t			_RTPJitterBufferPacketFrames( RTPJitterBufferContext *ctx, const RTPPacketNode *inNode );
+static RTPPacketNode *	_RTPJitterBufferPeek( RTPJitterBufferContext *ctx, uint32_t inSeq, int32_t *outState );
+static RTPPacketNode *	_RTPJitterBufferFirst( RTPJitterBufferContext *ctx, uint32_t inSeq, uint32_t *outSeq, int32_t *outState );
+static void				_RTPJitterBufferRelease( RTPJitterBufferContext *ctx, RTPPacketNode *inNode );
+static Boolean			_RTPJitterBufferDiscard( RTPJitterBufferContext *ctx, RTPPacketNode *inNode, int32_t inState );
+static void				_RTPJitterBufferSkipTo( RTPJitterBufferContext *ctx, uint32_t inSeq );
+static void				_RTPJitterBufferLogEvents( RTPJitterBufferContext *ctx );
+static OSStatus			_RTPJitterBufferDecodeNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode );
+static Boolean			_RTPJitterBufferDecodePass( RTPJitterBufferContext *ctx );
+static void *			_RTPJitterBufferDecodeThread( void *inCtx );
+static void				_RTPJitterBufferUpdateRate( RTPJitterBufferContext *ctx, uint32_t inFrames );
+static void				_RTPJitterBufferReadFrames( RTPJitterBufferContext *ctx, uint8_t *inBuffer, uint32_t inFrames );
 
 //===========================================================================================================================
 //	_RTPJitterBufferLog
@@ -442,7 +742,7 @@ RTPJitterBufferLogContext;
 static void _RTPJitterBufferLog( void *inCtx )
 {
 	RTPJitterBufferLogContext *		ctx = inCtx;
-
+	
 	if( ctx )
 	{
 		ap_jitter_ulog( ctx->level, "%s", ctx->msg );
@@ -456,7 +756,7 @@ static void RTPJitterBufferLog( RTPJitterBufferContext *ctx, LogLevel inLevel, c
 {
 	RTPJitterBufferLogContext *		logCtx;
 	va_list							args;
-
+	
 	if( log_category_enabled( &log_category_from_name( AirPlayJitterBuffer ), inLevel ) )
 	{
 		logCtx = malloc( sizeof( *logCtx ) );
@@ -481,34 +781,37 @@ OSStatus
 {
 	OSStatus		err;
 	size_t			i;
-	uint32_t		framesPerPacket;
+	uint32_t		framesPerPacket, minNodes;
 	
 	memset( ctx, 0, sizeof( *ctx ) );
 	
-	ctx->nodeLock = dispatch_semaphore_create( 1 );
-	require_action( ctx->nodeLock, exit, err = kNoResourcesErr );
 	require_action( inInputFormat, exit, err = kParamErr );
 	require_action( inInputFormat->mFramesPerPacket > 0 || inInputFormat->mFormatID == kAudioFormatLinearPCM, exit, err = kParamErr );
 	require_action( !inOutputFormat || inOutputFormat->mSampleRate == inInputFormat->mSampleRate, exit, err = kParamErr );
 	require_action( !inOutputFormat || inOutputFormat->mChannelsPerFrame == inInputFormat->mChannelsPerFrame, exit, err = kParamErr );
-
-	framesPerPacket = inInputFormat->mFramesPerPacket > 0 ? inInputFormat->mFramesPerPacket : kAirPlaySamplesPerPacket_PCM;
+	
+	// PCM formats have 1 frame per packet, but RTP packets of PCM hold kAirPlaySamplesPerPacket_PCM frames.
+	
+	framesPerPacket = ( inInputFormat->mFormatID != kAudioFormatLinearPCM ) ? inInputFormat->mFramesPerPacket : kAirPlaySamplesPerPacket_PCM;
 	
 	//   Min # of packets to hold inBufferMs audio
 	//   = inBufferMs * inSampleRate / ( 1000 * framesPerPacket ); (Assumes packets are fully filled when PCM or contain one compressed packet otherwise)
 	//   = inBufferMs * inSampleRate / ( 1000 * framesPerPacket ) + 0.5; ( round up )
 	//   = ( inBufferMs * inSampleRate + 500 * framesPerPacket ) / ( 1000 * framesPerPacket );
-	//   The allocated JB is 2 times the minium to handle jitter.
-
-	ctx->nodesAllocated = 2 * ( inBufferMs * ( (uint32_t) inInputFormat->mSampleRate ) + 500 * framesPerPacket ) / ( 1000 * framesPerPacket );
-	if( 50 > ctx->nodesAllocated )
-		ctx->nodesAllocated = 50; // ~400 ms at 352 samples per packet and 44100 Hz.
+	//   The allocated JB is 2 times the minium to handle jitter, rounded up to a power of 2 for indexing the slot ring.
+	
+	minNodes = 2 * ( inBufferMs * ( (uint32_t) inInputFormat->mSampleRate ) + 500 * framesPerPacket ) / ( 1000 * framesPerPacket );
+	if( 50 > minNodes )
+		minNodes = 50; // ~400 ms at 352 samples per packet and 44100 Hz.
+	for( ctx->nodesAllocated = 1; ctx->nodesAllocated < minNodes; ctx->nodesAllocated <<= 1 ) {}
+	ctx->slotMask = ctx->nodesAllocated - 1;
+	
 	ctx->packets = (RTPPacketNode *) calloc( ctx->nodesAllocated, sizeof( *ctx->packets ) );
 	require_action( ctx->packets, exit, err = kNoMemoryErr );
-	
-	TAILQ_INIT( &ctx->freeList );
-	TAILQ_INIT( &ctx->preparedList );
-	TAILQ_INIT( &ctx->receivedList );
+	ctx->slots = (RTPJitterBufferSlot *) calloc( ctx->nodesAllocated, sizeof( *ctx->slots ) );
+	require_action( ctx->slots, exit, err = kNoMemoryErr );
+	ctx->returnRing = (RTPPacketNode **) calloc( ctx->nodesAllocated, sizeof( *ctx->returnRing ) );
+	require_action( ctx->returnRing, exit, err = kNoMemoryErr );
 	
 	ctx->inputFormat			= *inInputFormat;
 	ctx->inputFormat.mReserved	= 0;
@@ -526,35 +829,50 @@ OSStatus
 		
 		// Allocate decode buffer backing
 		ctx->decodeBuffers = malloc( framesPerPacket * ctx->outputFormat.mBytesPerFrame * ctx->nodesAllocated );
+		require_action( ctx->decodeBuffers, exit, err = kNoMemoryErr );
+	}
+	
+	// Resample to absorb clock skew if the output is 16-bit PCM. Other formats fall back to discarding excess audio.
+	
+	ctx->skewRate = 1.0;
+	if( ( ctx->outputFormat.mFormatID == kAudioFormatLinearPCM ) && ( ctx->outputFormat.mBitsPerChannel == 16 ) &&
+		( ctx->outputFormat.mFormatFlags & kAudioFormatFlagIsSignedInteger ) )
+	{
+		err = AirPlaySkewResamplerInit( &ctx->resampler, ctx->outputFormat.mChannelsPerFrame, kRTPJitterBufferResampleFrames );
+		require_noerr( err, exit );
+		ctx->skewAdjust = true;
 	}
-		
-	// Set up the decode thread
-	err = pthread_mutex_init( &ctx->decodeMutex, NULL );
-	require_noerr( err, exit );
-	ctx->decodeMutexPtr = &ctx->decodeMutex;
 	
-	err = pthread_cond_init( &ctx->decodeCondition, NULL );
-	require_noerr( err, exit );
-	ctx->decodeConditionPtr = &ctx->decodeCondition;
-
-	err = pthread_create( &ctx->decodeThread, NULL, _RTPJitterBufferDecodeThread, ctx );
-	require_noerr( err, exit );
-	ctx->decodeThreadPtr = &ctx->decodeThread;
-
 	for( i = 0; i < ctx->nodesAllocated; ++i )
 	{
-		TAILQ_INSERT_HEAD( &ctx->freeList, &ctx->packets[ i ], list );
+		ctx->packets[ i ].next = ctx->freeList;
+		ctx->freeList = &ctx->packets[ i ];
 		ctx->packets[ i ].jitterBuffer = ctx;
 		if( ctx->decodeBuffers )
 		{
-			ctx->packets[ i ].decodeLock = dispatch_semaphore_create( 1 );
-			require_action( ctx->packets[ i ].decodeLock, exit, err = kNoMemoryErr );
 			ctx->packets[ i ].decodeBuffer = ctx->decodeBuffers + ( framesPerPacket * ctx->outputFormat.mBytesPerFrame * i );
 		}
 	}
 	
 	ctx->logQueue = dispatch_queue_create( "com.apple.airplay.jitterbufferlog", NULL );
+	require_action( ctx->logQueue, exit, err = kNoResourcesErr );
 	
+	// Set up the decode thread. Packets that don't need decoding go straight from the producer to the consumer.
+	
+	if( ctx->decoder )
+	{
+		err = pthread_mutex_init( &ctx->decodeMutex, NULL );
+		require_noerr( err, exit );
+		ctx->decodeMutexPtr = &ctx->decodeMutex;
+		
+		err = AirPlayConditionInit( &ctx->decodeCondition );
+		require_noerr( err, exit );
+		ctx->decodeConditionPtr = &ctx->decodeCondition;
+		
+		err = pthread_create( &ctx->decodeThread, NULL, _RTPJitterBufferDecodeThread, ctx );
+		require_noerr( err, exit );
+		ctx->decodeThreadPtr = &ctx->decodeThread;
+	}
 	err = kNoErr;
 	
 exit:
@@ -568,18 +886,26 @@ exit:
 
 void	RTPJitterBufferFree( RTPJitterBufferContext *ctx )
 {
-	size_t		i;
-	
-	if( ( ctx->nLate > 0 ) || ( ctx->nGaps > 0 ) || ( ctx->nSkipped > 0 ) || ( ctx->nRebuffer > 0 ) )
+	if( ( ctx->nLate > 0 ) || ( ctx->nGaps > 0 ) || ( ctx->nSkipped > 0 ) || ( ctx->nRebuffer > 0 ) || ( ctx->nDiscards > 0 ) ||
+		( ctx->nDecodeLate > 0 ) )
 	{
 		RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit,
-			"### %s: Buffering issues during session: Late=%u Missing=%u Gaps=%u Rebuffers=%u\n", 
-			ap_jitter_label( ctx ), ctx->nLate, ctx->nGaps, ctx->nSkipped, ctx->nRebuffer );
+			"### %s: Buffering issues during session: Late=%u Missing=%u Gaps=%u Rebuffers=%u Discards=%u DecodeLate=%u\n",
+			ap_jitter_label( ctx ), ctx->nLate, ctx->nGaps, ctx->nSkipped, ctx->nRebuffer, ctx->nDiscards, ctx->nDecodeLate );
+	}
+	ctx->nLate			= 0;
+	ctx->nGaps			= 0;
+	ctx->nSkipped		= 0;
+	ctx->nRebuffer		= 0;
+	ctx->nDiscards		= 0;
+	ctx->nDecodeLate	= 0;
+	if( ctx->skewAdjust )
+	{
+		RTPJitterBufferLog( ctx, kLogLevelInfo | kLogLevelFlagDontRateLimit,
+			"%s: Skew adjust: skew %+.1f ppm, fill adjust %+.1f ppm (peak %+.1f ppm)\n", ap_jitter_label( ctx ),
+			( ctx->skewRate - 1.0 ) * 1e6, ctx->rateAdjust * 1e6, ctx->rateAdjustPeak * 1e6 );
+		ctx->skewAdjust = false;
 	}
-	ctx->nLate		= 0;
-	ctx->nGaps		= 0;
-	ctx->nSkipped	= 0;
-	ctx->nRebuffer	= 0;
 	
 	if( ctx->logQueue )
 	{
@@ -589,110 +915,82 @@ void	RTPJitterBufferFree( RTPJitterBufferContext *ctx )
 	
 	if( ctx->decodeThreadPtr )
 	{
-		ctx->decodeDone = true;
 		pthread_mutex_lock( ctx->decodeMutexPtr );
+		ctx->decodeDone = true;
 		pthread_cond_signal( ctx->decodeConditionPtr );
 		pthread_mutex_unlock( ctx->decodeMutexPtr );
 		pthread_join( ctx->decodeThread, NULL );
+		ctx->decodeThreadPtr = NULL;
 	}
-	
 	pthread_mutex_forget( &ctx->decodeMutexPtr );
 	pthread_cond_forget( &ctx->decodeConditionPtr );
-	ctx->decodeThreadPtr = NULL;
 	
-	TAILQ_INIT( &ctx->freeList );
-	TAILQ_INIT( &ctx->preparedList );
-	TAILQ_INIT( &ctx->receivedList );
-
-	dispatch_forget( &ctx->nodeLock );
-	if( ctx->packets )
-	{
-		for( i = 0; i < ctx->nodesAllocated; ++i )
-			dispatch_forget( &ctx->packets[i].decodeLock );
-	}
+	ctx->freeList = NULL;
+	ForgetMem( &ctx->returnRing );
+	ForgetMem( &ctx->slots );
 	ForgetMem( &ctx->packets );
 	AudioConverterForget( &ctx->decoder );
 	ForgetMem( &ctx->decodeBuffers );
+	AirPlaySkewResamplerFree( &ctx->resampler );
 }
 
 //===========================================================================================================================
 //	RTPJitterBufferReset
+//
+//	Safe to call from any thread. The consumer applies the change on its next read.
 //===========================================================================================================================
 
 void	RTPJitterBufferReset( RTPJitterBufferContext *ctx, Float64 inDelta )
 {
-	RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_RESET_LOCK_ENTER );
-
-	ctx->nextTS += (uint32_t) inDelta;
-
-	RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_RESET_LOCK_EXIT );
+	atomic_add_32( &ctx->resetDelta, (int32_t) inDelta );
 }
 
 //===========================================================================================================================
 //	_RTPJitterBufferDiscardExcess
+//
+//	Consumer only. Discards the oldest packets until no more than the high watermark is buffered.
 //===========================================================================================================================
 
-// TAILQ_FOREACH_SAFE is not available on all platforms, so define it here for those platforms that don't have it.
-
-#ifndef TAILQ_FOREACH_SAFE
-	#define	TAILQ_FOREACH_SAFE(var, head, field, tvar)			\
-		for ((var) = TAILQ_FIRST((head));						\
-			(var) && ((tvar) = TAILQ_NEXT((var), field), 1);	\
-			(var) = (tvar))
-#endif
-
-// Internal function that is accessed after taking the jitter buffer lock
-static void	_RTPJitterBufferDiscardExcess( RTPJitterBufferContext *ctx)
+static void	_RTPJitterBufferDiscardExcess( RTPJitterBufferContext *ctx )
 {
 	uint32_t				desired;
-	uint32_t				queueSize;
-	uint32_t				prevSampleSize;
 	uint32_t				highWatermarkMs;
-	size_t					listNdx, listCount;
-	RTPPacketNodeList *		listsToDiscardFrom[] = { &ctx->preparedList, &ctx->receivedList };
-	RTPPacketNode *			nodeToDiscard;
-	RTPPacketNode *			safeNode;
+	uint32_t				highEndTS;
+	uint32_t				seq;
+	int32_t					state;
+	RTPPacketNode *			node;
+	Boolean					discarded = false;
 	
 	require( ( ctx->bufferMs > 0 && ctx->inputFormat.mSampleRate > 0 ), exit );
-
+	
 	highWatermarkMs = ctx->bufferMs + 20;
 	// 200ms is derived from the 50 nodes PCM samples @44.1KHz
 	if( highWatermarkMs < 200 ) highWatermarkMs = 200;
-
+	
 	desired =  highWatermarkMs * ( (uint32_t) ctx->inputFormat.mSampleRate ) / 1000;
 	
-	queueSize = prevSampleSize = _RTPJitterBufferBufferedSamples( ctx, false );
-
-	listCount = sizeof( listsToDiscardFrom ) / sizeof( listsToDiscardFrom[0] );
-	for( listNdx = 0; listNdx < listCount; ++listNdx )
+	highEndTS = _RTPJitterBufferLoad( &ctx->highEndTS );
+	while( ( node = _RTPJitterBufferFirst( ctx, ctx->readSeq, &seq, &state ) ) != NULL )
 	{
-		TAILQ_FOREACH_SAFE( nodeToDiscard, listsToDiscardFrom[ listNdx ], list, safeNode )
-		{
-			// Stop discarding when we've reached our desired size
-			
-			if ( ( queueSize = _RTPJitterBufferBufferedSamples( ctx, false ) ) <= desired )
-				break;
-			
-			// Make sure the node isn't in use by the decode thread
-			
-			if( !nodeToDiscard->decodeLock || dispatch_semaphore_wait( nodeToDiscard->decodeLock, DISPATCH_TIME_NOW ) == 0 )
-			{
-				TAILQ_REMOVE( listsToDiscardFrom[ listNdx ], nodeToDiscard, list );
-				TAILQ_INSERT_HEAD( &ctx->freeList, nodeToDiscard, list );
-				ctx->nodesUsed -= 1;
-				
-				if( nodeToDiscard->decodeLock )
-					dispatch_semaphore_signal( nodeToDiscard->decodeLock );
-			}
-		}
+		// Stop discarding when we've reached our desired size
+		
+		if( ( highEndTS - RTPJitterBufferNodeTS( node ) ) <= desired )
+			break;
+		
+		// Make sure the node isn't in use by the decode thread
+		
+		if( !_RTPJitterBufferDiscard( ctx, node, state ) )
+			break;
+		_RTPJitterBufferStore( &ctx->readSeq, seq + 1 );
+		discarded = true;
 	}
 	
-	if( queueSize != prevSampleSize )
+	// Update the playhead
+	
+	if( discarded )
 	{
-		RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit,
-			"Jitter Buffer Discard Excess, prevSize=%d(%dms) newSize=%d(%dms)\n",
-			prevSampleSize, RTPJitterBufferSamplesToMs( ctx, prevSampleSize ),
-			queueSize, RTPJitterBufferSamplesToMs( ctx, queueSize ) );
+		++ctx->nDiscards;
+		if( node ) ctx->nextTS = RTPJitterBufferNodeTS( node );
 	}
 	
 exit:
@@ -705,25 +1003,39 @@ exit:
 
 OSStatus	RTPJitterBufferGetFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode **outNode )
 {
-	OSStatus				err;
-	RTPPacketNode *			node;
+	size_t		n;
+	
+	*outNode = NULL;
+	return( RTPJitterBufferGetFreeNodes( ctx, outNode, 1, &n ) );
+}
+
+//===========================================================================================================================
+//	RTPJitterBufferGetFreeNodes
+//===========================================================================================================================
+
+OSStatus	RTPJitterBufferGetFreeNodes( RTPJitterBufferContext *ctx, RTPPacketNode **outNodes, size_t inMaxCount, size_t *outCount )
+{
+	uint32_t const		returnHead = _RTPJitterBufferLoad( &ctx->returnHead );
+	RTPPacketNode *		node;
+	size_t				n;
+	
+	// Take back the nodes the consumer is done with. The return ring has a slot for every node so it can't overflow.
 	
-	RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_GETFREENODE_LOCK_ENTER );
-	node = TAILQ_FIRST( &ctx->freeList );
-	if( node )
+	for( ; ctx->returnTail != returnHead; ++ctx->returnTail )
 	{
-		TAILQ_REMOVE( &ctx->freeList, node, list );
-		err = kNoErr;
+		node = ctx->returnRing[ ctx->returnTail & ctx->slotMask ];
+		node->next = ctx->freeList;
+		ctx->freeList = node;
 	}
-	else
+	
+	for( n = 0; ( n < inMaxCount ) && ( ( node = ctx->freeList ) != NULL ); ++n )
 	{
-		node = NULL;
-		err = kNoSpaceErr;
+		ctx->freeList = node->next;
+		outNodes[ n ] = node;
 	}
-
-	*outNode = node;
-	RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_GETFREENODE_LOCK_EXIT );
-	return( err );
+	
+	*outCount = n;
+	return( ( n > 0 ) ? kNoErr : kNoSpaceErr );
 }
 
 //===========================================================================================================================
@@ -732,9 +1044,23 @@ OSStatus	RTPJitterBufferGetFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode
 
 void	RTPJitterBufferPutFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode )
 {
-	RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_PUTFREENODE_LOCK_ENTER );
-	TAILQ_INSERT_HEAD( &ctx->freeList, inNode, list );
-	RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_PUTFREENODE_LOCK_EXIT );
+	inNode->next = ctx->freeList;
+	ctx->freeList = inNode;
+}
+
+//===========================================================================================================================
+//	RTPJitterBufferPutFreeNodes
+//===========================================================================================================================
+
+void	RTPJitterBufferPutFreeNodes( RTPJitterBufferContext *ctx, RTPPacketNode **inNodes, size_t inCount )
+{
+	size_t		i;
+	
+	for( i = 0; i < inCount; ++i )
+	{
+		inNodes[ i ]->next = ctx->freeList;
+		ctx->freeList = inNodes[ i ];
+	}
 }
 
 //===========================================================================================================================
@@ -743,72 +1069,103 @@ void	RTPJitterBufferPutFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode *inN
 
 OSStatus	RTPJitterBufferPutBusyNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode )
 {
-	uint32_t const		ts = inNode->pkt.pkt.rtp.header.ts;
-	OSStatus			err;
-	RTPPacketNode *		node;
+	uint16_t const				seq16 = inNode->pkt.pkt.rtp.header.seq;
+	OSStatus					err;
+	RTPJitterBufferSlot *		slot;
+	uint32_t					seq, delta;
+	int32_t						state;
+	
+	_RTPJitterBufferLogEvents( ctx );
+	
+	// Nothing can be queued until the consumer has acted on a skip (it may still be discarding nodes).
+	
+	require_action_quiet( !_RTPJitterBufferLoad( &ctx->skipPending ), exit, err = kNoSpaceErr );
 	
-	RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_PUTBUSYNODE_LOCK_ENTER );
+	// Extend the sequence number to 32 bits relative to the highest one so far. The first packet positions the ring.
 	
-	// If we are hitting the allocation limit, discard excess samples from Jitter Buffer.
-	// FIXME: This will cause a glitch, and the better solution is to use General Audio model of
-	// maintaining optimal jitter buffer size at all times with clock adjustment.
-	if( ctx->nodesUsed >= ctx->nodesAllocated - 3 )
+	if( ctx->started )
 	{
-		_RTPJitterBufferDiscardExcess( ctx );
-		// Update the playhead
-		if( !TAILQ_EMPTY( &ctx->preparedList ) )
-		{
-			node = TAILQ_FIRST( &ctx->preparedList );
-		}
-		else
+		seq = ctx->highSeq + (uint32_t)(int32_t)(int16_t)( seq16 - (uint16_t) ctx->highSeq );
+	}
+	else
+	{
+		seq = seq16;
+		_RTPJitterBufferStore( &ctx->readSeq,   seq - kRTPJitterBufferReorderSlack );
+		_RTPJitterBufferStore( &ctx->decodeSeq, seq - kRTPJitterBufferReorderSlack );
+	}
+	
+	// Drop packets that are too late to play (e.g. a late retransmit or reordered packet). Packets too far ahead mean
+	// the consumer isn't keeping up or the sender jumped forward so have the consumer skip ahead (discarding the oldest
+	// packets) to make room. Only resync backwards after a run of packets far behind (e.g. the sender restarted).
+	
+	delta = seq - _RTPJitterBufferLoad( &ctx->readSeq );
+	if( delta >= ctx->nodesAllocated )
+	{
+		if( ( (int32_t) delta ) < 0 )
 		{
-			check( !TAILQ_EMPTY( &ctx->receivedList ) );
-			node = TAILQ_FIRST( &ctx->receivedList );
+			if( ( (int32_t) delta ) <= -( (int32_t) ctx->nodesAllocated ) ) ++ctx->staleRun;
+			require_action_quiet( ctx->staleRun >= kRTPJitterBufferStaleResync, exit, err = kOrderErr );
 		}
-		ctx->nextTS = node->pkt.pkt.rtp.header.ts;
+		ctx->staleRun = 0;
+		
+		ctx->skipSeq = seq - ( ctx->nodesAllocated / 2 );
+		_RTPJitterBufferStore( &ctx->highEndTS, RTPJitterBufferNodeTS( inNode ) + _RTPJitterBufferPacketFrames( ctx, inNode ) );
+		_RTPJitterBufferStore( &ctx->highSeq, seq );
+		_RTPJitterBufferStore( &ctx->skipPending, 1 );
+		err = kNoSpaceErr;
+		goto exit;
 	}
+	ctx->staleRun = 0;
 	
-	// Insert the new node in timestamp order. It's most likely to be a later timestamp so start at the end.
+	// Queue the node into its slot in O(1). The slot may still hold a stale node the consumer hasn't cleaned up yet.
 	
-	TAILQ_FOREACH_REVERSE( node, &ctx->receivedList, RTPPacketNodeList, list)
+	slot = RTPJitterBufferSlot( ctx, seq );
+	if( _RTPJitterBufferLoad( &slot->state ) != kRTPJitterBufferSlot_Empty )
 	{
-		if( Mod32_LE( node->pkt.pkt.rtp.header.ts, ts ) ) break;
+		err = ( slot->node->seq == seq ) ? kDuplicateErr : kNoSpaceErr;
+		goto exit;
 	}
+	state = ctx->decoder ? kRTPJitterBufferSlot_Received : kRTPJitterBufferSlot_Prepared;
+	inNode->seq = seq;
+	slot->node  = inNode;
+	_RTPJitterBufferStore( &slot->state, (uint32_t) state );
+	
+	// If the consumer moved past this packet while it was being queued then take it back. If that fails, the decode
+	// thread has it and the consumer will clean it up later.
 	
-	if( !node )
+	if( Mod32_LT( seq, _RTPJitterBufferLoad( &ctx->readSeq ) ) &&
+		atomic_bool_compare_and_swap_32( &slot->state, state, kRTPJitterBufferSlot_Empty ) )
 	{
-		// If the received list is empty (or the node would go at the head), make sure we didn't miss our chance
-		node = TAILQ_LAST( &ctx->preparedList, RTPPacketNodeList );
-		require_action( !node || Mod32_LT( node->pkt.pkt.rtp.header.ts, ts ), exit,
-			err = Mod32_EQ( node->pkt.pkt.rtp.header.ts, ts ) ? kDuplicateErr : kOrderErr );
-		TAILQ_INSERT_HEAD( &ctx->receivedList, inNode, list );
+		err = kOrderErr;
+		goto exit;
 	}
-	else
+	
+	if( !ctx->started || Mod32_GT( seq, ctx->highSeq ) )
 	{
-		require_action( !Mod32_EQ( node->pkt.pkt.rtp.header.ts, ts ), exit, err = kDuplicateErr );
-		TAILQ_INSERT_AFTER( &ctx->receivedList, node, inNode, list );
+		_RTPJitterBufferStore( &ctx->highEndTS, RTPJitterBufferNodeTS( inNode ) + _RTPJitterBufferPacketFrames( ctx, inNode ) );
+		_RTPJitterBufferStore( &ctx->highSeq, seq );
 	}
-	ctx->nodesUsed += 1;
-	
-	// Signal the decode thread that a new node is available
-	pthread_mutex_lock( ctx->decodeMutexPtr );
-	pthread_cond_signal( ctx->decodeConditionPtr );
-	pthread_mutex_unlock( ctx->decodeMutexPtr );
-	
-	// If this is the first packet after we started buffering then schedule audio to start after the buffer window.
-	
-	if( ctx->buffering && ( ctx->startTicks == 0 ) )
+	if( !ctx->started )
 	{
-		ctx->startTicks = UpTicks() + MillisecondsToUpTicks( ctx->bufferMs );
+		_RTPJitterBufferStore( &ctx->started, 1 );
 		RTPJitterBufferLog( ctx, kLogLevelInfo | kLogLevelFlagDontRateLimit, "%s: Starting audio in %u ms\n",
 			ap_jitter_label( ctx ), ctx->bufferMs );
 	}
-	err = kNoErr;
 	
-exit:
-	RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_PUTBUSYNODE_LOCK_EXIT );
-	return( err );
-}
+	// Signal the decode thread that a new node is available
+	
+	if( ctx->decodeThreadPtr )
+	{
+		pthread_mutex_lock( ctx->decodeMutexPtr );
+		ctx->decodePending = true;
+		pthread_cond_signal( ctx->decodeConditionPtr );
+		pthread_mutex_unlock( ctx->decodeMutexPtr );
+	}
+	err = kNoErr;
+	
+exit:
+	return( err );
+}
 
 //===========================================================================================================================
 //	_RTPJitterBufferBufferedSamples
@@ -816,44 +1173,170 @@ exit:
 
 static uint32_t _RTPJitterBufferBufferedSamples( RTPJitterBufferContext *ctx, Boolean preparedOnly )
 {
-	RTPPacketNode	*first, *last;
-	uint32_t		preparedSamples, receivedSamples;
+	uint32_t const		nextTS	= _RTPJitterBufferLoad( &ctx->nextTS );
+	uint32_t			endTS;
+	
+	// Everything before the last prepared sample is decoded. Only the newest packets may still be waiting for decode.
 	
-	// Calculate size of prepared list first (which is always fully decoded)
-	if( !TAILQ_EMPTY( &ctx->preparedList ) )
+	endTS = _RTPJitterBufferLoad( ( preparedOnly && ctx->decoder ) ? &ctx->decodedEndTS : &ctx->highEndTS );
+	return( Mod32_GT( endTS, nextTS ) ? ( endTS - nextTS ) : 0 );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferPacketFrames
+//===========================================================================================================================
+
+static uint32_t	_RTPJitterBufferPacketFrames( RTPJitterBufferContext *ctx, const RTPPacketNode *inNode )
+{
+	if( ctx->inputFormat.mFormatID == kAudioFormatLinearPCM )
 	{
-		first = TAILQ_FIRST( &ctx->preparedList );
-		last = TAILQ_LAST( &ctx->preparedList, RTPPacketNodeList );
-		
-		// Calculate sample count of all but the last node based on timestamps
-		preparedSamples = (uint32_t)( last->pkt.pkt.rtp.header.ts - first->pkt.pkt.rtp.header.ts );
+		return( (uint32_t)( inNode->pkt.len / ctx->inputFormat.mBytesPerFrame ) );
+	}
+	return( ctx->inputFormat.mFramesPerPacket );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferPeek
+//
+//	Consumer only. Returns the node for a sequence number or NULL if it's missing. Nodes that can't be played any more
+//	(they arrived after the consumer or the decoder gave up on them) are discarded.
+//===========================================================================================================================
 
-		// Calculate sample count of last packet based on size
-		preparedSamples += last->pkt.len / ctx->outputFormat.mBytesPerFrame;
+static RTPPacketNode *	_RTPJitterBufferPeek( RTPJitterBufferContext *ctx, uint32_t inSeq, int32_t *outState )
+{
+	RTPJitterBufferSlot * const		slot = RTPJitterBufferSlot( ctx, inSeq );
+	int32_t							state;
+	RTPPacketNode *					node;
+	
+	state = (int32_t) _RTPJitterBufferLoad( &slot->state );
+	if( state == kRTPJitterBufferSlot_Empty ) return( NULL );
+	node = slot->node;
+	
+	if( node->seq != inSeq )
+	{
+		_RTPJitterBufferDiscard( ctx, node, state );
+		return( NULL );
 	}
-	else
+	if( ( state == kRTPJitterBufferSlot_Received ) &&
+		( ( _RTPJitterBufferLoad( &ctx->decodeSeq ) - inSeq - 1 ) < ctx->nodesAllocated ) )
 	{
-		preparedSamples = 0;
+		_RTPJitterBufferDiscard( ctx, node, state );
+		return( NULL );
 	}
+	*outState = state;
+	return( node );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferFirst
+//
+//	Consumer only. Returns the first node at or after a sequence number or NULL if there aren't any.
+//===========================================================================================================================
+
+static RTPPacketNode *	_RTPJitterBufferFirst( RTPJitterBufferContext *ctx, uint32_t inSeq, uint32_t *outSeq, int32_t *outState )
+{
+	uint32_t const		highSeq = _RTPJitterBufferLoad( &ctx->highSeq );
+	RTPPacketNode *		node;
+	uint32_t			seq;
 	
-	// Add size of received list next (which is never decoded)
-	if( !preparedOnly && !TAILQ_EMPTY( &ctx->receivedList ) )
+	for( seq = inSeq; Mod32_LE( seq, highSeq ) && ( ( seq - inSeq ) < ctx->nodesAllocated ); ++seq )
 	{
-		first = TAILQ_FIRST( &ctx->receivedList );
-		last = TAILQ_LAST( &ctx->receivedList, RTPPacketNodeList );
-		
-		// Calculate sample count of all but the last node based on timestamps
-		receivedSamples = (uint32_t)( last->pkt.pkt.rtp.header.ts - first->pkt.pkt.rtp.header.ts );
+		node = _RTPJitterBufferPeek( ctx, seq, outState );
+		if( node )
+		{
+			*outSeq = seq;
+			return( node );
+		}
+	}
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferRelease
+//
+//	Consumer only. Empties the slot of a node that has been read and hands the node back to the producer.
+//===========================================================================================================================
+
+static void	_RTPJitterBufferRelease( RTPJitterBufferContext *ctx, RTPPacketNode *inNode )
+{
+	_RTPJitterBufferStore( &RTPJitterBufferSlot( ctx, inNode->seq )->state, kRTPJitterBufferSlot_Empty );
+	ctx->returnRing[ ctx->returnHead & ctx->slotMask ] = inNode;
+	_RTPJitterBufferStore( &ctx->returnHead, ctx->returnHead + 1 );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferDiscard
+//
+//	Consumer only. Like _RTPJitterBufferRelease, but for nodes the decode thread may be racing to take.
+//	Returns false if the node is being decoded.
+//===========================================================================================================================
 
-		// Calculate sample count of last packet based on format
-		receivedSamples += ctx->inputFormat.mFramesPerPacket;
+static Boolean	_RTPJitterBufferDiscard( RTPJitterBufferContext *ctx, RTPPacketNode *inNode, int32_t inState )
+{
+	RTPJitterBufferSlot * const		slot = RTPJitterBufferSlot( ctx, inNode->seq );
+	
+	if( ( inState == kRTPJitterBufferSlot_Decoding ) ||
+		!atomic_bool_compare_and_swap_32( &slot->state, inState, kRTPJitterBufferSlot_Empty ) )
+	{
+		return( false );
 	}
-	else
+	ctx->returnRing[ ctx->returnHead & ctx->slotMask ] = inNode;
+	_RTPJitterBufferStore( &ctx->returnHead, ctx->returnHead + 1 );
+	return( true );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferSkipTo
+//
+//	Consumer only. Discards everything outside the ring window starting at a new sequence number and re-buffers there.
+//===========================================================================================================================
+
+static void	_RTPJitterBufferSkipTo( RTPJitterBufferContext *ctx, uint32_t inSeq )
+{
+	RTPJitterBufferSlot *		slot;
+	int32_t						state;
+	uint32_t					i;
+	
+	for( i = 0; i < ctx->nodesAllocated; ++i )
 	{
-		receivedSamples = 0;
+		slot  = &ctx->slots[ i ];
+		state = (int32_t) _RTPJitterBufferLoad( &slot->state );
+		if( ( state != kRTPJitterBufferSlot_Empty ) && ( ( slot->node->seq - inSeq ) >= ctx->nodesAllocated ) )
+		{
+			_RTPJitterBufferDiscard( ctx, slot->node, state );
+		}
 	}
+	_RTPJitterBufferStore( &ctx->readSeq, inSeq );
+	ctx->buffering	= true;
+	ctx->startTicks	= 0;
+	++ctx->nDiscards;
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferLogEvents
+//
+//	Producer only. The consumer runs on the audio callback so it only counts events and the producer logs them.
+//===========================================================================================================================
 
-	return( preparedSamples + receivedSamples );
+static void	_RTPJitterBufferLogEvents( RTPJitterBufferContext *ctx )
+{
+	uint32_t const		nLate		= ctx->nLate;
+	uint32_t const		nGaps		= ctx->nGaps;
+	uint32_t const		nSkipped	= ctx->nSkipped;
+	uint32_t const		nRebuffer	= ctx->nRebuffer;
+	uint32_t const		nStarts		= ctx->nStarts;
+	uint32_t const		nDiscards	= ctx->nDiscards;
+	uint32_t const		nDecodeLate	= ctx->nDecodeLate;
+	uint32_t			total;
+	
+	total = nLate + nGaps + nSkipped + nRebuffer + nStarts + nDiscards + nDecodeLate;
+	if( total == ctx->eventsLogged ) return;
+	ctx->eventsLogged = total;
+	
+	RTPJitterBufferLog( ctx, kLogLevelNotice,
+		"%s: Late=%u Missing=%u Gaps=%u Rebuffers=%u Starts=%u Discards=%u DecodeLate=%u, %u ms buffered\n",
+		ap_jitter_label( ctx ), nLate, nGaps, nSkipped, nRebuffer, nStarts, nDiscards, nDecodeLate, 
+		RTPJitterBufferBufferedMs( ctx ) );
 }
 
 //===========================================================================================================================
@@ -892,7 +1375,7 @@ static OSStatus
 			node->jitterBuffer->packetDescription.mDataByteSize				= ioData->mBuffers[ 0 ].mDataByteSize;
 			*outDataPacketDescription										= &node->jitterBuffer->packetDescription;
 		}
-
+		
 		return( kNoErr );
 	}
 	
@@ -919,7 +1402,7 @@ static OSStatus _RTPJitterBufferDecodeNode( RTPJitterBufferContext *ctx, RTPPack
 	err = AudioConverterFillComplexBuffer( ctx->decoder, _RTPJitterBufferAudioDecoderDecodeCallback, inNode,
 										  &outputPacketCount, &bufferList, NULL );
 	require( err == kNoErr || err == kUnderrunErr, exit );
-
+	
 	if( outputPacketCount > 0 )
 	{
 		inNode->ptr = inNode->decodeBuffer;
@@ -937,155 +1420,317 @@ exit:
 }
 
 //===========================================================================================================================
-//	_RTPJitterBufferDecodeThread
+//	_RTPJitterBufferDecodePass
+//
+//	Decodes queued nodes in sequence order. Returns true if it stopped to wait for a missing packet.
 //===========================================================================================================================
 
-static void * _RTPJitterBufferDecodeThread( void *inCtx )
+static Boolean	_RTPJitterBufferDecodePass( RTPJitterBufferContext *ctx )
 {
-	RTPJitterBufferContext *	ctx = inCtx;
+	RTPJitterBufferSlot *		slot;
 	RTPPacketNode *				node;
-	uint32_t					nextDecodeTS = 0;
+	uint32_t					readSeq, seq;
+	int32_t						state;
+	OSStatus					err;
 	
-	SetThreadName( "AirPlayAudioDecoder" );
-	SetCurrentThreadPriority( kAirPlayThreadPriority_AudioDecoder );
-
-	while( !ctx->decodeDone )
+	for( ;; )
 	{
-		pthread_mutex_lock( ctx->decodeMutexPtr );
-		pthread_cond_wait( ctx->decodeConditionPtr, ctx->decodeMutexPtr );
-		pthread_mutex_unlock( ctx->decodeMutexPtr );
+		// Don't decode anything the consumer has already moved past. The unsigned compare also catches discontinuities.
 		
-		// Re-check after being signalled
-		if( ctx->decodeDone )	break;
+		readSeq = _RTPJitterBufferLoad( &ctx->readSeq );
+		seq = ctx->decodeSeq;
+		if( ( seq - readSeq ) > ctx->nodesAllocated ) seq = readSeq;
+		if( Mod32_GT( seq, _RTPJitterBufferLoad( &ctx->highSeq ) ) ) break;
 		
-		RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_DECODEPASS_LOCK_ENTER );
-		while( !TAILQ_EMPTY( &ctx->receivedList ) )
+		slot  = RTPJitterBufferSlot( ctx, seq );
+		state = (int32_t) _RTPJitterBufferLoad( &slot->state );
+		node  = slot->node;
+		if( ( state == kRTPJitterBufferSlot_Received ) && ( node->seq == seq ) )
 		{
-			node = TAILQ_FIRST( &ctx->receivedList );
-
-			if( node->pkt.pkt.rtp.header.ts == nextDecodeTS )
-			{
-				// Next node is in sequence so we can go ahead and decode it
-				if( ctx->decoder )
-				{
-					// Lock the node for decode, but keep it on the received list (keeps time calculations accurate while decoding)
-					// NB: This should never block since we're the decode thread and this is an encoded node
-					dispatch_semaphore_wait( node->decodeLock, DISPATCH_TIME_FOREVER );
-					RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_DECODEITERATION_LOCK_EXIT );
-
-					OSStatus err = _RTPJitterBufferDecodeNode( ctx, node );
-
-					RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_DECODEITERATION_LOCK_ENTER );
-					dispatch_semaphore_signal( node->decodeLock );
-
-					TAILQ_REMOVE( &ctx->receivedList, node, list );
-					if( err )
-					{
-						TAILQ_INSERT_TAIL( &ctx->freeList, node, list );
-						ctx->nodesUsed -= 1;
-					}
-					else
-					{
-						TAILQ_INSERT_TAIL( &ctx->preparedList, node, list );
-						nextDecodeTS += ctx->inputFormat.mFramesPerPacket;
-					}
-				}
-				else
-				{
-					// No decode needed - put it directly onto the prepared list
-					TAILQ_REMOVE( &ctx->receivedList, node, list );
-					TAILQ_INSERT_TAIL( &ctx->preparedList, node, list );
-					
-					nextDecodeTS += node->pkt.len / ctx->outputFormat.mBytesPerFrame;
-				}
-			}
-			else if( node->pkt.pkt.rtp.header.ts > nextDecodeTS )
+			// Take the node for decoding. The consumer may have discarded it (and the slot refilled) in the meantime.
+			
+			if( !atomic_bool_compare_and_swap_32( &slot->state, state, kRTPJitterBufferSlot_Decoding ) ) continue;
+			node = slot->node;
+			if( node->seq != seq )
 			{
-				// We have a gap, so decide whether we can afford to wait a bit
-				if( RTPJitterBufferPreparedMs( ctx ) >= 0.5 * ctx->bufferMs )
-				{
-					RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit, "Delaying decode of node at time %u\n", node->pkt.pkt.rtp.header.ts );
-					break;
-				}
-
-				nextDecodeTS = node->pkt.pkt.rtp.header.ts;
+				_RTPJitterBufferStore( &slot->state, kRTPJitterBufferSlot_Received );
 				continue;
 			}
-			else
+			
+			err = _RTPJitterBufferDecodeNode( ctx, node );
+			if( err ) node->pkt.len = 0; // Play it as a gap.
+			_RTPJitterBufferStore( &ctx->decodedEndTS,
+				RTPJitterBufferNodeTS( node ) + (uint32_t)( node->pkt.len / ctx->outputFormat.mBytesPerFrame ) );
+			_RTPJitterBufferStore( &slot->state, kRTPJitterBufferSlot_Prepared );
+		}
+		else if( ( state == kRTPJitterBufferSlot_Empty ) || ( node->seq != seq ) )
+		{
+			// We have a gap, so decide whether we can afford to wait a bit
+			
+			if( RTPJitterBufferPreparedMs( ctx ) >= ( ctx->bufferMs / 2 ) )
 			{
-				TAILQ_REMOVE( &ctx->receivedList, node, list );
-				TAILQ_INSERT_TAIL( &ctx->freeList, node, list );
-				ctx->nodesUsed -= 1;
+				_RTPJitterBufferStore( &ctx->decodeSeq, seq );
+				return( true );
+			}
+		}
+		_RTPJitterBufferStore( &ctx->decodeSeq, seq + 1 );
+	}
+	return( false );
+}
 
-				RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit, "Discarding late decode node at time %u\n",
-					node->pkt.pkt.rtp.header.ts );
-				
-				// The node must have arrived late, just after we decoded one of its successors, so just toss it
+//===========================================================================================================================
+//	_RTPJitterBufferDecodeThread
+//===========================================================================================================================
+
+static void * _RTPJitterBufferDecodeThread( void *inCtx )
+{
+	RTPJitterBufferContext * const		ctx = (RTPJitterBufferContext *) inCtx;
+	Boolean								waiting = false;
+	
+	SetThreadName( "AirPlayAudioDecoder" );
+	SetCurrentThreadPriority( kAirPlayThreadPriority_AudioDecoder );
+	
+	for( ;; )
+	{
+		pthread_mutex_lock( ctx->decodeMutexPtr );
+		while( !ctx->decodePending && !ctx->decodeDone )
+		{
+			if( !waiting )
+			{
+				pthread_cond_wait( ctx->decodeConditionPtr, ctx->decodeMutexPtr );
+				continue;
 			}
+			
+			// Waiting on a missing packet so re-check periodically in case it's time to give up on it.
+			
+			if( AirPlayConditionTimedWait( ctx->decodeConditionPtr, ctx->decodeMutexPtr, kRTPJitterBufferDecodeRetryMs ) != 0 ) break;
 		}
-		RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_DECODEPASS_LOCK_EXIT );
+		ctx->decodePending = false;
+		pthread_mutex_unlock( ctx->decodeMutexPtr );
+		if( ctx->decodeDone ) break;
+		
+		waiting = _RTPJitterBufferDecodePass( ctx );
 	}
 	
 	return NULL;
 }
 
-
 //===========================================================================================================================
 //	RTPJitterBufferRead
+//
+//	Consumer only. Never blocks so it's safe to call from the audio callback.
 //===========================================================================================================================
 
 OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_t inLen )
 {
-	uint32_t const		lenTS = (uint32_t)( inLen / ctx->outputFormat.mBytesPerFrame );
-	uint8_t *			dst   = (uint8_t *) inBuffer;
+	uint32_t		frames = (uint32_t)( inLen / ctx->outputFormat.mBytesPerFrame );
+	int16_t *		dst;
+	int16_t *		src;
+	uint32_t		n, needed;
+	int32_t			fill;
+	
+	if( TraceIsEnabled() )
+	{
+		fill = (int32_t)( _RTPJitterBufferLoad( &ctx->highEndTS ) - ctx->nextTS );
+		trace_event( JitterBufferRead, frames, fill, ctx->buffering, 0 );
+		trace_event( JitterBufferFill, ctx->buffering ? 0 : fill, 0, 0, 0 );
+	}
+	if( !ctx->skewAdjust )
+	{
+		_RTPJitterBufferReadFrames( ctx, (uint8_t *) inBuffer, frames );
+		goto exit;
+	}
+	
+	_RTPJitterBufferUpdateRate( ctx, frames );
+	for( dst = (int16_t *) inBuffer; frames > 0; frames -= n )
+	{
+		n = Min( frames, kRTPJitterBufferResampleFrames );
+		needed = AirPlaySkewResamplerPrepare( &ctx->resampler, n, &src );
+		_RTPJitterBufferReadFrames( ctx, (uint8_t *) src, needed );
+		AirPlaySkewResamplerProcess( &ctx->resampler, dst, n );
+		dst += ( n * ctx->resampler.channels );
+	}
+	
+exit:
+	trace_event( JitterBufferReadDone, ctx->nGaps, ctx->nLate, ctx->nSkipped, ctx->nRebuffer );
+	return( kNoErr );
+}
+
+//===========================================================================================================================
+//	RTPJitterBufferSetSkew
+//
+//	Consumer only. Sets the measured output sample rate relative to the sender's clock (e.g. from the audio timestamps).
+//	Ignores rates too far off to be real skew.
+//===========================================================================================================================
+
+void	RTPJitterBufferSetSkew( RTPJitterBufferContext *ctx, Float64 inOutputRate )
+{
+	Float64		rate;
+	
+	if( inOutputRate <= 0 ) return;
+	rate = ctx->inputFormat.mSampleRate / inOutputRate;
+	if( fabs( rate - 1.0 ) <= kAirPlaySkewResamplerMaxAdjust ) ctx->skewRate = rate;
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferUpdateRate
+//
+//	Consumer only. Adjusts the resampling rate to hold the fill level at bufferMs. Measured skew is applied directly and
+//	a proportional-integral controller corrects whatever is left (e.g. skew before it's been measured).
+//===========================================================================================================================
+
+static void	_RTPJitterBufferUpdateRate( RTPJitterBufferContext *ctx, uint32_t inFrames )
+{
+	Float64 const		sampleRate = ctx->inputFormat.mSampleRate;
+	Float64				fill, error, adjust;
+	
+	if( ctx->buffering || !_RTPJitterBufferLoad( &ctx->started ) )
+	{
+		ctx->fillValid = false;
+		goto exit;
+	}
+	
+	fill = (int32_t)( _RTPJitterBufferLoad( &ctx->highEndTS ) - ctx->nextTS );
+	if( ctx->fillValid )
+	{
+		ctx->fillAvg += ( fill - ctx->fillAvg ) * Min( 1.0, inFrames / ( sampleRate * kRTPJitterBufferFillSeconds ) );
+	}
+	else
+	{
+		ctx->fillAvg	= fill;
+		ctx->fillValid	= true;
+	}
+	
+	// Error is in seconds of audio. Positive means too much is buffered so consume input faster.
+	
+	error = ( ctx->fillAvg - RTPJitterBufferMsToSamples( ctx, ctx->bufferMs ) ) / sampleRate;
+	ctx->rateIntegral += ( kRTPJitterBufferRateKi * error * inFrames ) / sampleRate;
+	ctx->rateIntegral = Clamp( ctx->rateIntegral, -kAirPlaySkewResamplerMaxAdjust, kAirPlaySkewResamplerMaxAdjust );
+	adjust = ( kRTPJitterBufferRateKp * error ) + ctx->rateIntegral;
+	adjust = Clamp( adjust, -kAirPlaySkewResamplerMaxAdjust, kAirPlaySkewResamplerMaxAdjust );
+	
+	ctx->rateAdjust = adjust;
+	if( fabs( adjust ) > fabs( ctx->rateAdjustPeak ) ) ctx->rateAdjustPeak = adjust;
+	AirPlaySkewResamplerSetRate( &ctx->resampler, ctx->skewRate * ( 1.0 + adjust ) );
+	
+exit:
+	return;
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferReadFrames
+//
+//	Consumer only. Reads inFrames of output starting at nextTS.
+//===========================================================================================================================
+
+static void	_RTPJitterBufferReadFrames( RTPJitterBufferContext *ctx, uint8_t *inBuffer, uint32_t inFrames )
+{
+	size_t const		inLen = inFrames * ctx->outputFormat.mBytesPerFrame;
+	uint8_t *			dst   = inBuffer;
 	RTPPacketNode *		node;
-	uint32_t			nowTS, limTS, srcTS, endTS, delta;
+	int32_t				state;
+	uint32_t			seq, nowTS, limTS, srcTS, endTS, delta;
 	size_t				len;
 	Boolean				cap;
 	uint64_t			ticks;
 	
-	RTPJitterBufferLock( ctx, AIRPLAY_SIGNPOST_JB_READ_LOCK_ENTER );
+	if( !_RTPJitterBufferLoad( &ctx->started ) )
+	{
+		memset( inBuffer, 0, inLen );
+		goto exit;
+	}
+	if( ctx->resetDelta != 0 )
+	{
+		ctx->nextTS += (uint32_t) atomic_fetch_and_store_32( &ctx->resetDelta, 0 );
+	}
+	if( _RTPJitterBufferLoad( &ctx->skipPending ) )
+	{
+		_RTPJitterBufferSkipTo( ctx, ctx->skipSeq );
+		_RTPJitterBufferStore( &ctx->skipPending, 0 );
+	}
 	
 	if( ctx->buffering )
 	{
-		ticks = UpTicks();
-		if( ( ctx->startTicks == 0 ) || ( ticks < ctx->startTicks ) )
+		node = _RTPJitterBufferFirst( ctx, ctx->readSeq, &seq, &state );
+		if( !node )
 		{
 			memset( inBuffer, 0, inLen );
 			goto exit;
 		}
+		_RTPJitterBufferStore( &ctx->nextTS, RTPJitterBufferNodeTS( node ) );
 		
-		node = TAILQ_EMPTY( &ctx->preparedList) ? TAILQ_FIRST( &ctx->receivedList ) : TAILQ_FIRST( &ctx->preparedList );
-		if( node )
+		// If this is the first packet after we started buffering then schedule audio to start after the buffer window.
+		
+		ticks = UpTicks();
+		if( ctx->startTicks == 0 ) ctx->startTicks = ticks + MillisecondsToUpTicks( ctx->bufferMs );
+		if( ticks < ctx->startTicks )
 		{
-			// At this point a glitch is expected and the jitter buffer would have grown
-			// following the spike. Discard excess samples.
-			_RTPJitterBufferDiscardExcess( ctx );
-			
-			nowTS = node->pkt.pkt.rtp.header.ts;
-			ctx->buffering = false;
-			RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit, "%s: Buffering complete, %d ms (%d), %llu ticks late\n",
-				ap_jitter_label( ctx ), RTPJitterBufferBufferedMs( ctx ), _RTPJitterBufferBufferedSamples( ctx, false ),
-				ticks - ctx->startTicks );
+			memset( inBuffer, 0, inLen );
+			goto exit;
 		}
-		else
+		
+		// At this point a glitch is expected and the jitter buffer would have grown
+		// following the spike. Discard excess samples.
+		
+		_RTPJitterBufferStore( &ctx->readSeq, seq );
+		_RTPJitterBufferDiscardExcess( ctx );
+		node = _RTPJitterBufferFirst( ctx, ctx->readSeq, &seq, &state );
+		if( !node )
 		{
-			// Nothing buffered
-			nowTS = 0;
+			memset( inBuffer, 0, inLen );
+			goto exit;
 		}
+		_RTPJitterBufferStore( &ctx->readSeq, seq );
+		nowTS = RTPJitterBufferNodeTS( node );
+		ctx->buffering = false;
+		++ctx->nStarts;
 	}
 	else
 	{
+		// If we are hitting the allocation limit, discard excess samples from Jitter Buffer. This causes a glitch so
+		// skew adjustment keeps the fill level well below this unless a burst arrives that's bigger than the buffer.
+		
+		if( ( (int32_t)( _RTPJitterBufferLoad( &ctx->highSeq ) - ctx->readSeq ) ) >= ( (int32_t) ctx->nodesAllocated - 3 ) )
+		{
+			_RTPJitterBufferDiscardExcess( ctx );
+		}
 		nowTS = ctx->nextTS;
 	}
-	limTS = nowTS + lenTS;
+	limTS = nowTS + inFrames;
 	
-	while( ( node = TAILQ_FIRST( &ctx->preparedList ) ) != NULL )
+	while( Mod32_LT( nowTS, limTS ) )
 	{
-		srcTS = node->pkt.pkt.rtp.header.ts;
-
+		node = _RTPJitterBufferPeek( ctx, ctx->readSeq, &state );
+		if( !node )
+		{
+			// The next packet is missing. If a later one starts within the timing window then give up on it.
+			
+			node = _RTPJitterBufferFirst( ctx, ctx->readSeq + 1, &seq, &state );
+			if( !node ) break;
+			if( Mod32_GE( RTPJitterBufferNodeTS( node ), limTS ) )
+			{
+				len = ( limTS - nowTS ) * ctx->outputFormat.mBytesPerFrame;
+				memset( dst, 0, len );
+				nowTS = limTS;
+				break;
+			}
+			_RTPJitterBufferStore( &ctx->readSeq, seq );
+		}
+		if( state != kRTPJitterBufferSlot_Prepared )
+		{
+			// Still being decoded. Play silence for the rest of this read and try it again on the next read. The audio is
+			// here so this isn't running dry and re-buffering would only throw away the bufferMs we already have.
+			
+			++ctx->nDecodeLate;
+			len = ( limTS - nowTS ) * ctx->outputFormat.mBytesPerFrame;
+			memset( dst, 0, len );
+			nowTS = limTS;
+			break;
+		}
+		srcTS = RTPJitterBufferNodeTS( node );
+		
 		// If node is after the timing window, it's too early so fill in silence and advance the play-head.
-
+		
 		if( Mod32_GE( srcTS, limTS ) )
 		{
 			delta = limTS - nowTS;
@@ -1104,9 +1749,6 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 		if( Mod32_LE( endTS, nowTS ) )
 		{
 			++ctx->nLate;
-			RTPJitterBufferLog( ctx, kLogLevelNotice, "%s: Late: %d ms (%u total)\n", ap_jitter_label( ctx ),
-				RTPJitterBufferSamplesToMs( ctx, (int)( nowTS - endTS ) ), ctx->nLate );
-
 			goto next;
 		}
 		
@@ -1115,9 +1757,6 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 		if( Mod32_LT( srcTS, nowTS ) )
 		{
 			++ctx->nSkipped;
-			RTPJitterBufferLog( ctx, kLogLevelNotice, "%s: Skip: %d ms (%u total)\n", ap_jitter_label( ctx ),
-				RTPJitterBufferSamplesToMs( ctx, (int)( nowTS - srcTS ) ), ctx->nSkipped );
-			
 			delta = nowTS - srcTS;
 			len   = delta * ctx->outputFormat.mBytesPerFrame;
 			node->ptr += len;
@@ -1131,9 +1770,6 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 		else if( Mod32_GT( srcTS, nowTS ) )
 		{
 			++ctx->nGaps;
-			RTPJitterBufferLog( ctx, kLogLevelNotice, "%s: Gap:  %d ms (%u total)\n", ap_jitter_label( ctx ),
-				RTPJitterBufferSamplesToMs( ctx, (int)( srcTS - nowTS ) ), ctx->nGaps );
-			
 			delta = srcTS - nowTS;
 			len   = delta * ctx->outputFormat.mBytesPerFrame;
 			memset( dst, 0, len );
@@ -1142,7 +1778,7 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 		}
 		
 		// Node is completely within the timing window.
-
+		
 		else
 		{
 		}
@@ -1160,9 +1796,9 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 			delta = (uint32_t)( len / ctx->outputFormat.mBytesPerFrame );
 			cap = false;
 		}
-
+		
 		memcpy( dst, node->ptr, len );
-
+		
 		dst   += len;
 		nowTS += delta;
 		if( cap )
@@ -1172,19 +1808,10 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 			node->pkt.pkt.rtp.header.ts	+= delta;
 			break;
 		}
-		
+	
 	next:
-		TAILQ_REMOVE( &ctx->preparedList, node, list );
-		TAILQ_INSERT_HEAD( &ctx->freeList, node, list );
-		ctx->nodesUsed -= 1;
-		
-		// Signal decode thread to check if more should be decoded
-		if( ctx->decodeThreadPtr )
-		{
-			pthread_mutex_lock( ctx->decodeMutexPtr );
-			pthread_cond_signal( ctx->decodeConditionPtr );
-			pthread_mutex_unlock( ctx->decodeMutexPtr );
-		}
+		_RTPJitterBufferRelease( ctx, node );
+		_RTPJitterBufferStore( &ctx->readSeq, ctx->readSeq + 1 );
 	}
 	
 	// If more samples are needed for this timing window then we've run dry. If it's prolonged then re-buffer.
@@ -1192,11 +1819,6 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 	if( Mod32_LT( nowTS, limTS ) )
 	{
 		++ctx->nRebuffer;
-		RTPJitterBufferLog( ctx, kLogLevelNotice | kLogLevelFlagDontRateLimit,
-			"%s: Re-buffering: %d ms buffered (%d), %d ms missing (%d), %u total) nowTS (%u) \n", ap_jitter_label( ctx ),
-			RTPJitterBufferBufferedMs( ctx ), _RTPJitterBufferBufferedSamples( ctx, false ),
-			RTPJitterBufferSamplesToMs( ctx, (int)( limTS - nowTS ) ), (int)( limTS - nowTS ), ctx->nRebuffer, nowTS );
-		
 		delta = limTS - nowTS;
 		len = delta * ctx->outputFormat.mBytesPerFrame;
 		memset( dst, 0, len );
@@ -1204,9 +1826,1754 @@ OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_
 		ctx->startTicks = 0;
 		nowTS = limTS;
 	}
-	ctx->nextTS = nowTS;
+	_RTPJitterBufferStore( &ctx->nextTS, nowTS );
 	
 exit:
-	RTPJitterBufferUnlock( ctx, AIRPLAY_SIGNPOST_JB_READ_LOCK_EXIT );
-	return( kNoErr );
+	return;
+}
+
+#if 0
+#pragma mark -
+#endif
+
+//===========================================================================================================================
+//	AirPlayLossConcealerInternals
+//===========================================================================================================================
+
+#define kAirPlayLossConcealerMaxChannels		8
+#define kAirPlayLossConcealerDecimation			4	// Decimation factor for the coarse period search.
+#define kAirPlayLossConcealerShortestRatio		0.9	// Prefer the shortest period scoring at least this much of the best.
+
+#define _AirPlayLossConcealerFrame( CTX, BACK ) \
+	( &(CTX)->history[ ( ( (CTX)->historyEnd - (BACK) ) & (CTX)->historyMask ) * (CTX)->channels ] )
+
+static void		_AirPlayLossConcealerStart( AirPlayLossConcealer *ctx );
+static uint32_t	_AirPlayLossConcealerFindPeriod( AirPlayLossConcealer *ctx, uint32_t inWindow, uint32_t inMaxLag, Boolean inPreferShortest );
+static void		_AirPlayLossConcealerSynthesize( AirPlayLossConcealer *ctx, int16_t *inDst, uint32_t inFrames );
+
+//===========================================================================================================================
+//	AirPlayLossConcealerInit
+//===========================================================================================================================
+
+OSStatus
+	AirPlayLossConcealerInit(
+		AirPlayLossConcealer *		ctx,
+		AirPlayLossConcealmentType	inType,
+		uint32_t					inSampleRate,
+		uint32_t					inChannels )
+{
+	OSStatus		err;
+	uint32_t		ringFrames;
+	size_t			n;
+	
+	memset( ctx, 0, sizeof( *ctx ) );
+	ctx->type		= inType;
+	ctx->channels	= inChannels;
+	require_action( ( inChannels > 0 ) && ( inChannels <= kAirPlayLossConcealerMaxChannels ), exit, err = kParamErr );
+	require_action( inSampleRate >= 8000, exit, err = kParamErr );
+	if( inType == kAirPlayLossConcealment_Silence ) { err = kNoErr; goto exit; }
+	require_action( ( inType == kAirPlayLossConcealment_Waveform ) || ( inType == kAirPlayLossConcealment_PitchPeriod ), 
+		exit, err = kUnsupportedErr );
+	
+	// Search for periods between 2.5 ms (400 Hz) and 20 ms (50 Hz). Crossfade back to real audio over 2.5 ms. Hold the 
+	// concealed audio at full level for 20 ms then fade it to silence over 40 ms so long losses don't buzz.
+	
+	ctx->minPeriod		= inSampleRate / 400;
+	ctx->maxPeriod		= inSampleRate / 50;
+	ctx->fadeFrames		= inSampleRate / 400;
+	ctx->holdFrames		= inSampleRate / 50;
+	ctx->decayFrames	= inSampleRate / 25;
+	
+	// The history needs room for a search window plus the longest period plus the crossfade into the previous period.
+	
+	for( ringFrames = 1; ringFrames < ( 3 * ctx->maxPeriod ); ringFrames <<= 1 ) {}
+	ctx->historyMask = ringFrames - 1;
+	
+	ctx->history = (int16_t *) calloc( ringFrames * inChannels, sizeof( int16_t ) );
+	require_action( ctx->history, exit, err = kNoMemoryErr );
+	
+	n = ( ( 3 * ctx->maxPeriod ) / kAirPlayLossConcealerDecimation ) + 2;
+	ctx->analysis = (float *) calloc( n, sizeof( float ) );
+	require_action( ctx->analysis, exit, err = kNoMemoryErr );
+	
+	ctx->loop = (int16_t *) calloc( ctx->maxPeriod * inChannels, sizeof( int16_t ) );
+	require_action( ctx->loop, exit, err = kNoMemoryErr );
+	err = kNoErr;
+	
+exit:
+	if( err ) AirPlayLossConcealerFree( ctx );
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlayLossConcealerFree
+//===========================================================================================================================
+
+void	AirPlayLossConcealerFree( AirPlayLossConcealer *ctx )
+{
+	ForgetMem( &ctx->history );
+	ForgetMem( &ctx->analysis );
+	ForgetMem( &ctx->loop );
+	ctx->type = kAirPlayLossConcealment_Silence;
+	AirPlayLossConcealerReset( ctx );
+}
+
+//===========================================================================================================================
+//	AirPlayLossConcealerReset
+//
+//	Forgets all history (e.g. after a flush) so audio from before the reset is never used to conceal later losses.
+//===========================================================================================================================
+
+void	AirPlayLossConcealerReset( AirPlayLossConcealer *ctx )
+{
+	ctx->historyEnd			= 0;
+	ctx->historyCount		= 0;
+	ctx->period				= 0;
+	ctx->phase				= 0;
+	ctx->concealedFrames	= 0;
+	ctx->concealing			= false;
+}
+
+//===========================================================================================================================
+//	AirPlayLossConcealerConceal
+//
+//	Fills a buffer with synthesized audio in place of lost audio.
+//===========================================================================================================================
+
+void	AirPlayLossConcealerConceal( AirPlayLossConcealer *ctx, void *inBuffer, size_t inLen )
+{
+	size_t			bytesPerFrame;
+	uint32_t		frames;
+	
+	if( ctx->type == kAirPlayLossConcealment_Silence )
+	{
+		memset( inBuffer, 0, inLen );
+		return;
+	}
+	
+	bytesPerFrame	= ctx->channels * sizeof( int16_t );
+	frames			= (uint32_t)( inLen / bytesPerFrame );
+	if( !ctx->concealing ) _AirPlayLossConcealerStart( ctx );
+	_AirPlayLossConcealerSynthesize( ctx, (int16_t *) inBuffer, frames );
+	ctx->nConcealedFrames += frames;
+	
+	memset( ( (uint8_t *) inBuffer ) + ( frames * bytesPerFrame ), 0, inLen - ( frames * bytesPerFrame ) );
+}
+
+//===========================================================================================================================
+//	AirPlayLossConcealerPlayed
+//
+//	Records real audio about to be played. If the previous audio was concealed, the start of this audio is crossfaded 
+//	from the concealed audio to avoid a discontinuity.
+//===========================================================================================================================
+
+void	AirPlayLossConcealerPlayed( AirPlayLossConcealer *ctx, void *ioBuffer, size_t inLen )
+{
+	uint32_t const		channels	= ctx->channels;
+	uint32_t const		ringFrames	= ctx->historyMask + 1;
+	int16_t *			ptr			= (int16_t *) ioBuffer;
+	int16_t				synth[ kAirPlayLossConcealerMaxChannels ];
+	uint32_t			frames, n, i, j, index, chunk;
+	
+	if( ctx->type == kAirPlayLossConcealment_Silence ) return;
+	
+	frames = (uint32_t)( inLen / ( channels * sizeof( int16_t ) ) );
+	if( ctx->concealing )
+	{
+		n = Min( ctx->fadeFrames, frames );
+		for( i = 0; i < n; ++i )
+		{
+			_AirPlayLossConcealerSynthesize( ctx, synth, 1 );
+			for( j = 0; j < channels; ++j )
+			{
+				ptr[ j ] = (int16_t)( ( ( ptr[ j ] * (int32_t)( i + 1 ) ) + ( synth[ j ] * (int32_t)( n - i - 1 ) ) ) / (int32_t) n );
+			}
+			ptr += channels;
+		}
+		ptr = (int16_t *) ioBuffer;
+		ctx->concealing = false;
+	}
+	
+	// Append to the history, keeping only the most recent frames if there's more than the history can hold.
+	
+	if( frames > ringFrames )
+	{
+		ptr    += ( frames - ringFrames ) * channels;
+		frames  = ringFrames;
+	}
+	index = ctx->historyEnd;
+	while( frames > 0 )
+	{
+		chunk = Min( frames, ringFrames - index );
+		memcpy( &ctx->history[ index * channels ], ptr, chunk * channels * sizeof( int16_t ) );
+		ptr    += chunk * channels;
+		frames -= chunk;
+		index   = ( index + chunk ) & ctx->historyMask;
+		ctx->historyCount = Min( ctx->historyCount + chunk, ringFrames );
+	}
+	ctx->historyEnd = index;
+}
+
+//===========================================================================================================================
+//	_AirPlayLossConcealerStart
+//
+//	Analyzes the history at the start of a loss to build the loop of audio to repeat.
+//===========================================================================================================================
+
+static void	_AirPlayLossConcealerStart( AirPlayLossConcealer *ctx )
+{
+	uint32_t const		channels	= ctx->channels;
+	uint32_t const		avail		= ctx->historyCount;
+	uint32_t const		D			= kAirPlayLossConcealerDecimation;
+	Boolean const		pitch		= ( ctx->type == kAirPlayLossConcealment_PitchPeriod );
+	uint32_t			window, maxLag, period, fade, i, j, k;
+	const int16_t *		a;
+	const int16_t *		b;
+	int16_t *			dst;
+	
+	ctx->concealing			= true;
+	ctx->concealedFrames	= 0;
+	ctx->phase				= 0;
+	ctx->period				= 0;
+	++ctx->nLosses;
+	
+	if( pitch )
+	{
+		// Correlate the most recent 10 ms of audio against the audio before it. The loop needs an extra quarter period
+		// of history before the repeated period for the crossfade.
+		
+		maxLag	= ( avail > D ) ? Min( ctx->maxPeriod, ( avail - D ) / 2 ) : 0;
+		window	= maxLag / 2;
+	}
+	else
+	{
+		// Match a short template of the most recent audio against earlier audio.
+		
+		window	= ctx->maxPeriod / 4;
+		maxLag	= ( avail > ( window + D ) ) ? Min( ctx->maxPeriod, avail - window - D ) : 0;
+	}
+	if( maxLag < ctx->minPeriod ) return; // Not enough history so conceal with silence.
+	
+	period = _AirPlayLossConcealerFindPeriod( ctx, window, maxLag, pitch );
+	
+	// Copy the last period into the loop. For pitch-period repetition, crossfade the end of the loop into the audio 
+	// before the period so wrapping back to the start of the loop is continuous. For waveform substitution, the match
+	// already makes the start of the loop continue from the end of the history.
+	
+	fade = pitch ? ( period / 4 ) : 0;
+	for( i = 0; i < period; ++i )
+	{
+		a   = _AirPlayLossConcealerFrame( ctx, period - i );
+		dst = &ctx->loop[ i * channels ];
+		if( i < ( period - fade ) )
+		{
+			for( j = 0; j < channels; ++j ) dst[ j ] = a[ j ];
+		}
+		else
+		{
+			k = i - ( period - fade ) + 1;
+			b = _AirPlayLossConcealerFrame( ctx, ( 2 * period ) - i );
+			for( j = 0; j < channels; ++j )
+			{
+				dst[ j ] = (int16_t)( ( ( a[ j ] * (int32_t)( fade - k ) ) + ( b[ j ] * (int32_t) k ) ) / (int32_t) fade );
+			}
+		}
+	}
+	ctx->period = period;
+}
+
+//===========================================================================================================================
+//	_AirPlayLossConcealerFindPeriod
+//
+//	Finds the lag maximizing the normalized correlation between the most recent inWindow frames and the frames before 
+//	them. Searches a decimated mono signal first then refines around the best lag at the full rate so the cost is 
+//	bounded by roughly ( inWindow * inMaxLag ) / 16 + 14 * inWindow operations.
+//===========================================================================================================================
+
+static uint32_t	_AirPlayLossConcealerFindPeriod( AirPlayLossConcealer *ctx, uint32_t inWindow, uint32_t inMaxLag, Boolean inPreferShortest )
+{
+	uint32_t const		D		= kAirPlayLossConcealerDecimation;
+	uint32_t const		channels= ctx->channels;
+	uint32_t const		windowD	= Max( inWindow / D, 1 );
+	uint32_t const		minLagD	= Max( ctx->minPeriod / D, 1 );
+	uint32_t const		maxLagD	= inMaxLag / D;
+	uint32_t const		n		= windowD + maxLagD;
+	float * const		x		= ctx->analysis;
+	float * const		scores	= ctx->analysis + n;
+	const int16_t *		src;
+	const int16_t *		old;
+	uint32_t			i, j, k, lag, bestLag, lo, hi;
+	float				sum, xs, xo, c, e, score, bestScore;
+	
+	// Decimate to mono with a box filter. x[ 0 ] is the oldest sample and x[ n - 1 ] is the most recent.
+	
+	for( i = 0; i < n; ++i )
+	{
+		sum = 0;
+		for( j = 0; j < D; ++j )
+		{
+			src = _AirPlayLossConcealerFrame( ctx, ( ( n - i ) * D ) - j );
+			for( k = 0; k < channels; ++k ) sum += src[ k ];
+		}
+		x[ i ] = sum;
+	}
+	
+	// Coarse search. The energy of the lagged window is updated incrementally as the lag increases.
+	
+	e = 0;
+	for( i = n - windowD; i < n; ++i ) e += x[ i - minLagD ] * x[ i - minLagD ];
+	bestLag		= maxLagD;
+	bestScore	= 0;
+	for( lag = minLagD; lag <= maxLagD; ++lag )
+	{
+		if( lag > minLagD ) e += ( x[ n - windowD - lag ] * x[ n - windowD - lag ] ) - ( x[ n - lag ] * x[ n - lag ] );
+		c = 0;
+		for( i = n - windowD; i < n; ++i ) c += x[ i ] * x[ i - lag ];
+		score = ( ( c > 0 ) && ( e > 0 ) ) ? ( ( c * c ) / e ) : 0;
+		scores[ lag - minLagD ] = score;
+		if( score > bestScore )
+		{
+			bestScore	= score;
+			bestLag		= lag;
+		}
+	}
+	
+	// Multiples of the period correlate about as well as the period itself so prefer the shortest good candidate.
+	
+	if( inPreferShortest && ( bestScore > 0 ) )
+	{
+		for( lag = minLagD; lag < bestLag; ++lag )
+		{
+			if( scores[ lag - minLagD ] >= ( bestScore * kAirPlayLossConcealerShortestRatio ) )
+			{
+				bestLag = lag;
+				break;
+			}
+		}
+	}
+	
+	// Refine at the full rate around the coarse lag.
+	
+	lo = ( ( bestLag * D ) > ( D - 1 ) ) ? ( ( bestLag * D ) - ( D - 1 ) ) : 1;
+	lo = Max( lo, ctx->minPeriod );
+	hi = Min( ( bestLag * D ) + ( D - 1 ), inMaxLag );
+	if( lo > hi ) return( hi );
+	
+	bestLag		= hi;
+	bestScore	= -1;
+	for( lag = lo; lag <= hi; ++lag )
+	{
+		c = 0;
+		e = 0;
+		for( i = 1; i <= inWindow; ++i )
+		{
+			src = _AirPlayLossConcealerFrame( ctx, i );
+			old = _AirPlayLossConcealerFrame( ctx, i + lag );
+			xs  = 0;
+			xo  = 0;
+			for( j = 0; j < channels; ++j )
+			{
+				xs += src[ j ];
+				xo += old[ j ];
+			}
+			c += xs * xo;
+			e += xo * xo;
+		}
+		score = ( e > 0 ) ? ( ( ( c < 0 ) ? -( c * c ) : ( c * c ) ) / e ) : 0;
+		if( score > bestScore )
+		{
+			bestScore	= score;
+			bestLag		= lag;
+		}
+	}
+	return( bestLag );
+}
+
+//===========================================================================================================================
+//	_AirPlayLossConcealerSynthesize
+//===========================================================================================================================
+
+static void	_AirPlayLossConcealerSynthesize( AirPlayLossConcealer *ctx, int16_t *inDst, uint32_t inFrames )
+{
+	uint32_t const		channels	= ctx->channels;
+	uint32_t const		endFrames	= ctx->holdFrames + ctx->decayFrames;
+	int16_t *			dst			= inDst;
+	const int16_t *		src;
+	int32_t				gain;
+	uint32_t			i, j;
+	
+	for( i = 0; i < inFrames; ++i )
+	{
+		if( ( ctx->period == 0 ) || ( ctx->concealedFrames >= endFrames ) )
+		{
+			memset( dst, 0, ( inFrames - i ) * channels * sizeof( int16_t ) );
+			ctx->concealedFrames = endFrames;
+			break;
+		}
+		if( ctx->concealedFrames < ctx->holdFrames )	gain = 32768;
+		else											gain = (int32_t)( ( ( endFrames - ctx->concealedFrames ) << 15 ) / ctx->decayFrames );
+		
+		src = &ctx->loop[ ctx->phase * channels ];
+		for( j = 0; j < channels; ++j ) dst[ j ] = (int16_t)( ( src[ j ] * gain ) >> 15 );
+		dst += channels;
+		if( ++ctx->phase >= ctx->period ) ctx->phase = 0;
+		++ctx->concealedFrames;
+	}
+}
+
+#if 0
+#pragma mark -
+#endif
+
+//===========================================================================================================================
+//	AirPlayFramePoolInternals
+//===========================================================================================================================
+
+struct AirPlayFramePoolBuffer
+{
+	AirPlayFramePoolBuffer *		next;		// Next free buffer in the same size class.
+	AirPlayFramePool *				pool;		// Pool the buffer belongs to.
+	size_t							size;		// Number of usable bytes after the header.
+	int								sizeClass;	// Size class or -1 if too big to pool.
+};
+
+#define kAirPlayFramePoolHeaderSize		( ( sizeof( AirPlayFramePoolBuffer ) + 15 ) & ~( (size_t) 15 ) )
+
+#define _AirPlayFramePoolBufferFromPtr( PTR ) \
+	( (AirPlayFramePoolBuffer *)( ( (uint8_t *)(PTR) ) - kAirPlayFramePoolHeaderSize ) )
+
+//===========================================================================================================================
+//	AirPlayFramePoolCreate
+//===========================================================================================================================
+
+OSStatus	AirPlayFramePoolCreate( AirPlayFramePool **outPool )
+{
+	OSStatus				err;
+	AirPlayFramePool *		pool;
+	
+	pool = (AirPlayFramePool *) calloc( 1, sizeof( *pool ) );
+	require_action( pool, exit, err = kNoMemoryErr );
+	err = pthread_mutex_init( &pool->mutex, NULL );
+	require_noerr( err, exit );
+	pool->mutexPtr = &pool->mutex;
+	
+	*outPool = pool;
+	pool = NULL;
+	
+exit:
+	FreeNullSafe( pool );
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlayFramePoolFree
+//
+//	Frees the released buffers and gives up the owner's reference. Buffers still in use are freed as they're released and
+//	the last one frees the pool so the screen stream may complete a frame after the session has been torn down.
+//===========================================================================================================================
+
+void	AirPlayFramePoolFree( AirPlayFramePool *inPool )
+{
+	AirPlayFramePoolBuffer *		buf;
+	AirPlayFramePoolBuffer *		freeList = NULL;
+	Boolean							last;
+	int								i;
+	
+	pthread_mutex_lock( inPool->mutexPtr );
+	check( !inPool->freed );
+	inPool->freed = true;
+	for( i = 0; i < kAirPlayFramePoolClassCount; ++i )
+	{
+		while( ( buf = inPool->freeLists[ i ] ) != NULL )
+		{
+			inPool->freeLists[ i ] = buf->next;
+			inPool->bytesAllocated -= buf->size;
+			buf->next = freeList;
+			freeList = buf;
+		}
+	}
+	last = ( inPool->inUse == 0 );
+	pthread_mutex_unlock( inPool->mutexPtr );
+	
+	while( ( buf = freeList ) != NULL )
+	{
+		freeList = buf->next;
+		free( buf );
+	}
+	if( last )
+	{
+		pthread_mutex_forget( &inPool->mutexPtr );
+		free( inPool );
+	}
+}
+
+//===========================================================================================================================
+//	AirPlayFramePoolGet
+//
+//	Returns a buffer of at least inLen bytes. Reuses a released buffer of the same size class if there is one.
+//===========================================================================================================================
+
+uint8_t *	AirPlayFramePoolGet( AirPlayFramePool *inPool, size_t inLen )
+{
+	uint64_t const					startTicks = UpTicks();
+	AirPlayFramePoolBuffer *		buf;
+	Boolean							allocated = false;
+	int								sizeClass;
+	size_t							size;
+	uint64_t						ticks;
+	
+	for( sizeClass = 0; sizeClass < kAirPlayFramePoolClassCount; ++sizeClass )
+	{
+		size = ( (size_t) 1 ) << ( kAirPlayFramePoolMinSizeShift + sizeClass );
+		if( size >= inLen ) break;
+	}
+	if( sizeClass >= kAirPlayFramePoolClassCount )
+	{
+		sizeClass	= -1;
+		size		= inLen;
+	}
+	
+	buf = NULL;
+	if( sizeClass >= 0 )
+	{
+		pthread_mutex_lock( inPool->mutexPtr );
+		buf = inPool->freeLists[ sizeClass ];
+		if( buf ) inPool->freeLists[ sizeClass ] = buf->next;
+		pthread_mutex_unlock( inPool->mutexPtr );
+	}
+	if( !buf )
+	{
+		buf = (AirPlayFramePoolBuffer *) malloc( kAirPlayFramePoolHeaderSize + size );
+		require( buf, exit );
+		buf->pool		= inPool;
+		buf->size		= size;
+		buf->sizeClass	= sizeClass;
+		allocated		= true;
+	}
+	buf->next = NULL;
+	ticks = UpTicks() - startTicks;
+	
+	pthread_mutex_lock( inPool->mutexPtr );
+	++inPool->gets;
+	++inPool->inUse;
+	if( allocated )
+	{
+		inPool->bytesAllocated += size;
+		if( inPool->bytesAllocated > inPool->bytesPeak ) inPool->bytesPeak = inPool->bytesAllocated;
+	}
+	else
+	{
+		++inPool->hits;
+	}
+	inPool->getTicks += ticks;
+	if( ticks > inPool->getTicksMax ) inPool->getTicksMax = ticks;
+	pthread_mutex_unlock( inPool->mutexPtr );
+	
+exit:
+	return( buf ? ( ( (uint8_t *) buf ) + kAirPlayFramePoolHeaderSize ) : NULL );
+}
+
+//===========================================================================================================================
+//	AirPlayFramePoolRelease
+//
+//	Returns a buffer from AirPlayFramePoolGet to its pool. May be called from any thread. NULL is ignored.
+//===========================================================================================================================
+
+void	AirPlayFramePoolRelease( void *inBuffer )
+{
+	AirPlayFramePoolBuffer *		buf;
+	AirPlayFramePool *				pool;
+	Boolean							last;
+	
+	if( !inBuffer ) return;
+	buf  = _AirPlayFramePoolBufferFromPtr( inBuffer );
+	pool = buf->pool;
+	
+	pthread_mutex_lock( pool->mutexPtr );
+	check( pool->inUse > 0 );
+	--pool->inUse;
+	if( ( buf->sizeClass >= 0 ) && !pool->freed )
+	{
+		buf->next = pool->freeLists[ buf->sizeClass ];
+		pool->freeLists[ buf->sizeClass ] = buf;
+		buf = NULL;
+	}
+	else
+	{
+		pool->bytesAllocated -= buf->size;
+	}
+	last = ( pool->freed && ( pool->inUse == 0 ) );
+	pthread_mutex_unlock( pool->mutexPtr );
+	FreeNullSafe( buf );
+	
+	// The owner already freed the pool so the last buffer released frees it.
+	
+	if( last )
+	{
+		pthread_mutex_forget( &pool->mutexPtr );
+		free( pool );
+	}
+}
+
+//===========================================================================================================================
+//	AirPlayFramePoolAppendStats
+//===========================================================================================================================
+
+void	AirPlayFramePoolAppendStats( AirPlayFramePool *inPool, DataBuffer *inDB )
+{
+	uint64_t		gets, hits, getTicks, getTicksMax;
+	size_t			bytesPeak;
+	
+	pthread_mutex_lock( inPool->mutexPtr );
+	gets		= inPool->gets;
+	hits		= inPool->hits;
+	getTicks	= inPool->getTicks;
+	getTicksMax	= inPool->getTicksMax;
+	bytesPeak	= inPool->bytesPeak;
+	pthread_mutex_unlock( inPool->mutexPtr );
+	
+	DataBuffer_AppendF( inDB, "%llu frames, %u%% pool hits, %zu KB peak, %.2f/%.2f µS avg/max alloc", 
+		(unsigned long long) gets, ( gets > 0 ) ? (uint32_t)( ( hits * 100 ) / gets ) : 0, bytesPeak / 1024, 
+		( gets > 0 ) ? ( ( 1000000.0 * getTicks ) / ( gets * (double) UpTicksPerSecond() ) ) : 0.0, 
+		( 1000000.0 * getTicksMax ) / UpTicksPerSecond() );
+}
+
+#if 0
+#pragma mark -
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
+//===========================================================================================================================
+//	RTPJitterBufferTest
+//
+//	Runs a producer thread queuing PCM packets with reordering, duplicates, and loss while the consumer reads on its own
+//	thread at the same rate as an audio callback. The consumer stalls once to force an overflow. Every sample read must
+//	be either silence or the right sample for its timestamp. Reports the read latency.
+//===========================================================================================================================
+
+#define kRTPJitterBufferTestSampleRate			44100
+#define kRTPJitterBufferTestFramesPerPacket		352
+#define kRTPJitterBufferTestFramesPerRead		256
+#define kRTPJitterBufferTestBufferMs			100
+#define kRTPJitterBufferTestStallMs				750		// Longer than the ring holds to force the producer to skip.
+
+#define _RTPJitterBufferTestSample( TS, CHANNEL )	( (int16_t)( ( ( ( (TS) * 7 ) + (CHANNEL) ) % 30000 ) + 1 ) ) // Never 0.
+
+typedef struct
+{
+	RTPJitterBufferContext		jb;
+	uint32_t					packetCount;	// Number of packets to send.
+	uint64_t					startTicks;		// Ticks when the first packet is due.
+	uint32_t					sent;			// Number of packets queued without error.
+	uint32_t					dropped;		// Number of packets dropped (never sent).
+	uint32_t					reordered;		// Number of packets sent after later packets.
+	uint32_t					duplicates;		// Number of packets sent twice.
+	uint32_t					rejected;		// Number of packets the jitter buffer rejected (late, duplicate, or full).
+	OSStatus					err;
+	
+}	RTPJitterBufferTestContext;
+
+static void *	_RTPJitterBufferTestProducer( void *inArg );
+static OSStatus	_RTPJitterBufferTestSend( RTPJitterBufferTestContext *ctx, uint32_t inIndex );
+static OSStatus	_RTPJitterBufferTestDecodeLate( int inPrint );
+static OSStatus	_RTPJitterBufferTestStale( int inPrint );
+
+OSStatus	RTPJitterBufferTest( int inPrint, int inPerf )
+{
+	uint32_t const					seconds = inPerf ? 60 : 5;
+	uint64_t const					readTicks = ( UpTicksPerSecond() * kRTPJitterBufferTestFramesPerRead ) / kRTPJitterBufferTestSampleRate;
+	OSStatus						err;
+	RTPJitterBufferTestContext *	ctx;
+	AudioStreamBasicDescription		asbd;
+	pthread_t						producer;
+	pthread_t *						producerPtr = NULL;
+	int16_t							buf[ kRTPJitterBufferTestFramesPerRead * 2 ];
+	uint32_t						readCount, stallRead, i, frame, startTS;
+	uint64_t						ticks, nextTicks, latency, maxLatency, totalLatency, played, mismatches;
+	
+	ctx = (RTPJitterBufferTestContext *) calloc( 1, sizeof( *ctx ) );
+	require_action( ctx, exit, err = kNoMemoryErr );
+	
+	ASBD_FillPCM( &asbd, kRTPJitterBufferTestSampleRate, 16, 16, 2 );
+	err = RTPJitterBufferInit( &ctx->jb, &asbd, NULL, kRTPJitterBufferTestBufferMs );
+	require_noerr( err, exit );
+	ctx->jb.label		= "Test";
+	ctx->jb.skewAdjust	= false; // Samples are checked exactly so don't resample.
+	
+	ctx->packetCount	= ( seconds * kRTPJitterBufferTestSampleRate ) / kRTPJitterBufferTestFramesPerPacket;
+	ctx->startTicks		= UpTicks();
+	err = pthread_create( &producer, NULL, _RTPJitterBufferTestProducer, ctx );
+	require_noerr( err, exit );
+	producerPtr = &producer;
+	
+	// Read like an audio callback until everything sent has had time to play out.
+	
+	readCount = ( ( ctx->packetCount * kRTPJitterBufferTestFramesPerPacket ) / kRTPJitterBufferTestFramesPerRead ) +
+		( ( 2 * kRTPJitterBufferTestBufferMs * kRTPJitterBufferTestSampleRate ) / ( 1000 * kRTPJitterBufferTestFramesPerRead ) );
+	stallRead		= readCount / 2;
+	nextTicks		= ctx->startTicks;
+	maxLatency		= 0;
+	totalLatency	= 0;
+	played			= 0;
+	mismatches		= 0;
+	for( i = 0; i < readCount; ++i )
+	{
+		if( i == stallRead ) usleep( kRTPJitterBufferTestStallMs * 1000 );
+		nextTicks += readTicks;
+		ticks = UpTicks();
+		if( ticks < nextTicks ) usleep( (useconds_t)( ( ( nextTicks - ticks ) * 1000000 ) / UpTicksPerSecond() ) );
+		
+		ticks = UpTicks();
+		err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+		latency = UpTicks() - ticks;
+		require_noerr( err, exit );
+		totalLatency += latency;
+		if( latency > maxLatency ) maxLatency = latency;
+		
+		startTS = ctx->jb.nextTS - kRTPJitterBufferTestFramesPerRead;
+		for( frame = 0; frame < kRTPJitterBufferTestFramesPerRead; ++frame )
+		{
+			if( ( buf[ frame * 2 ] == 0 ) && ( buf[ ( frame * 2 ) + 1 ] == 0 ) ) continue;
+			if( ( buf[ frame * 2 ]         != _RTPJitterBufferTestSample( startTS + frame, 0 ) ) ||
+				( buf[ ( frame * 2 ) + 1 ] != _RTPJitterBufferTestSample( startTS + frame, 1 ) ) )
+			{
+				if( inPrint && ( mismatches == 0 ) ) fprintf( stderr, "\tMismatch at TS %u\n", startTS + frame );
+				++mismatches;
+			}
+			++played;
+		}
+	}
+	pthread_join( producer, NULL );
+	producerPtr = NULL;
+	require_noerr_action( ctx->err, exit, err = ctx->err );
+	
+	if( inPrint )
+	{
+		fprintf( stderr, "\t%u packets: %u sent, %u dropped, %u reordered, %u duplicates, %u rejected\n",
+			ctx->packetCount, ctx->sent, ctx->dropped, ctx->reordered, ctx->duplicates, ctx->rejected );
+		fprintf( stderr, "\t%u reads: %llu%% of frames played, %llu mismatched, Late=%u Missing=%u Gaps=%u Rebuffers=%u Starts=%u Discards=%u\n",
+			readCount, (unsigned long long)( ( played * 100 ) / ( ctx->packetCount * kRTPJitterBufferTestFramesPerPacket ) ),
+			(unsigned long long) mismatches,
+			ctx->jb.nLate, ctx->jb.nGaps, ctx->jb.nSkipped, ctx->jb.nRebuffer, ctx->jb.nStarts, ctx->jb.nDiscards );
+		fprintf( stderr, "\tread latency: %.2f µs avg, %.2f µs max\n",
+			( 1000000.0 * totalLatency ) / ( readCount * (double) UpTicksPerSecond() ),
+			( 1000000.0 * maxLatency ) / UpTicksPerSecond() );
+	}
+	require_action( mismatches == 0, exit, err = kResponseErr );
+	require_action( ctx->dropped > 0 && ctx->reordered > 0 && ctx->duplicates > 0, exit, err = kResponseErr );
+	require_action( ctx->jb.nDiscards > 0 && ctx->jb.nStarts >= 2, exit, err = kResponseErr );
+	require_action( played >= ( ( 70 * ctx->packetCount * kRTPJitterBufferTestFramesPerPacket ) / 100 ), exit, err = kResponseErr );
+	
+	err = _RTPJitterBufferTestDecodeLate( inPrint );
+	require_noerr( err, exit );
+	
+	err = _RTPJitterBufferTestStale( inPrint );
+	require_noerr( err, exit );
+	
+exit:
+	if( producerPtr ) pthread_join( *producerPtr, NULL );
+	if( ctx )
+	{
+		RTPJitterBufferFree( &ctx->jb );
+		free( ctx );
+	}
+	printf( "RTPJitterBufferTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferTestProducer
+//===========================================================================================================================
+
+static void *	_RTPJitterBufferTestProducer( void *inArg )
+{
+	RTPJitterBufferTestContext * const		ctx = (RTPJitterBufferTestContext *) inArg;
+	uint64_t const							packetTicks = ( UpTicksPerSecond() * kRTPJitterBufferTestFramesPerPacket ) / kRTPJitterBufferTestSampleRate;
+	OSStatus								err;
+	uint32_t								seed = 1;
+	uint32_t								i, r, heldIndex = 0, heldUntil = 0;
+	Boolean									held = false;
+	uint64_t								dueTicks, ticks;
+	
+	for( i = 0; i < ctx->packetCount; ++i )
+	{
+		dueTicks = ctx->startTicks + ( i * packetTicks );
+		ticks = UpTicks();
+		if( ticks < dueTicks ) usleep( (useconds_t)( ( ( dueTicks - ticks ) * 1000000 ) / UpTicksPerSecond() ) );
+		
+		// Drop 1%, hold back 5% until after the next 1-3 packets, and send 1% twice.
+		
+		seed = ( seed * 1103515245 ) + 12345;
+		r = ( seed >> 16 ) % 100;
+		if( r == 0 )
+		{
+			++ctx->dropped;
+		}
+		else if( ( r <= 5 ) && !held )
+		{
+			held		= true;
+			heldIndex	= i;
+			heldUntil	= i + 1 + ( ( seed >> 8 ) % 3 );
+			++ctx->reordered;
+		}
+		else
+		{
+			err = _RTPJitterBufferTestSend( ctx, i );
+			require_noerr( err, exit );
+			if( r == 99 )
+			{
+				err = _RTPJitterBufferTestSend( ctx, i );
+				require_noerr( err, exit );
+				++ctx->duplicates;
+			}
+		}
+		if( held && ( i == heldUntil ) )
+		{
+			err = _RTPJitterBufferTestSend( ctx, heldIndex );
+			require_noerr( err, exit );
+			held = false;
+		}
+	}
+	err = kNoErr;
+	
+exit:
+	ctx->err = err;
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferTestSend
+//===========================================================================================================================
+
+static OSStatus	_RTPJitterBufferTestSend( RTPJitterBufferTestContext *ctx, uint32_t inIndex )
+{
+	uint32_t const		ts = inIndex * kRTPJitterBufferTestFramesPerPacket;
+	OSStatus			err;
+	RTPPacketNode *		node;
+	int16_t *			samples;
+	uint32_t			frame;
+	
+	err = RTPJitterBufferGetFreeNode( &ctx->jb, &node );
+	require_noerr( err, exit );
+	
+	node->pkt.pkt.rtp.header.seq	= (uint16_t)( inIndex + 60000 ); // Wrap the sequence number early in the run.
+	node->pkt.pkt.rtp.header.ts		= ts;
+	node->pkt.len					= kRTPJitterBufferTestFramesPerPacket * 4;
+	node->ptr						= node->pkt.pkt.rtp.payload;
+	samples = (int16_t *) node->ptr;
+	for( frame = 0; frame < kRTPJitterBufferTestFramesPerPacket; ++frame )
+	{
+		samples[ frame * 2 ]		= _RTPJitterBufferTestSample( ts + frame, 0 );
+		samples[ ( frame * 2 ) + 1 ]	= _RTPJitterBufferTestSample( ts + frame, 1 );
+	}
+	
+	if( RTPJitterBufferPutBusyNode( &ctx->jb, node ) == kNoErr )
+	{
+		++ctx->sent;
+	}
+	else
+	{
+		RTPJitterBufferPutFreeNode( &ctx->jb, node );
+		++ctx->rejected;
+	}
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferTestDecodeLate
+//
+//	Holds a packet in the decoding state across a read like a decoder that's running behind. The read must play what's
+//	ready, fill the rest with silence, and stay started. Once the packet is decoded, the next read must play it from the
+//	current position without having re-buffered.
+//===========================================================================================================================
+
+#define kRTPJitterBufferTestDecodeLatePackets		10	// Less than bufferMs so nothing is discarded when playback starts.
+
+static OSStatus	_RTPJitterBufferTestDecodeLate( int inPrint )
+{
+	OSStatus						err;
+	RTPJitterBufferTestContext *	ctx;
+	AudioStreamBasicDescription		asbd;
+	RTPJitterBufferSlot *			slot;
+	int16_t							buf[ kRTPJitterBufferTestFramesPerRead * 2 ];
+	uint32_t						i, frame, startTS, readyFrames;
+	Boolean							silent;
+	
+	ctx = (RTPJitterBufferTestContext *) calloc( 1, sizeof( *ctx ) );
+	require_action( ctx, exit, err = kNoMemoryErr );
+	
+	ASBD_FillPCM( &asbd, kRTPJitterBufferTestSampleRate, 16, 16, 2 );
+	err = RTPJitterBufferInit( &ctx->jb, &asbd, NULL, kRTPJitterBufferTestBufferMs );
+	require_noerr( err, exit );
+	ctx->jb.label		= "DecodeLate";
+	ctx->jb.skewAdjust	= false;
+	
+	for( i = 0; i < kRTPJitterBufferTestDecodeLatePackets; ++i )
+	{
+		err = _RTPJitterBufferTestSend( ctx, i );
+		require_noerr( err, exit );
+	}
+	
+	// Buffer then start playing from the first packet.
+	
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	usleep( ( kRTPJitterBufferTestBufferMs + 10 ) * 1000 );
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	require_action( !ctx->jb.buffering && ( ctx->jb.nextTS == kRTPJitterBufferTestFramesPerRead ), exit, err = kResponseErr );
+	
+	// Hold the second packet in the decoding state. Only the rest of the first packet is ready to play.
+	
+	slot = RTPJitterBufferSlot( &ctx->jb, ctx->jb.readSeq + 1 );
+	require_action( slot->state == kRTPJitterBufferSlot_Prepared, exit, err = kResponseErr );
+	_RTPJitterBufferStore( &slot->state, kRTPJitterBufferSlot_Decoding );
+	
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	startTS		= ctx->jb.nextTS - kRTPJitterBufferTestFramesPerRead;
+	readyFrames	= kRTPJitterBufferTestFramesPerPacket - kRTPJitterBufferTestFramesPerRead;
+	for( frame = 0; frame < kRTPJitterBufferTestFramesPerRead; ++frame )
+	{
+		silent = ( buf[ frame * 2 ] == 0 ) && ( buf[ ( frame * 2 ) + 1 ] == 0 );
+		if( frame < readyFrames )	require_action( buf[ frame * 2 ] == _RTPJitterBufferTestSample( startTS + frame, 0 ), exit, err = kResponseErr );
+		else						require_action( silent, exit, err = kResponseErr );
+	}
+	require_action( !ctx->jb.buffering && ( ctx->jb.nRebuffer == 0 ) && ( ctx->jb.nDecodeLate == 1 ), exit, err = kResponseErr );
+	
+	// Finish decoding. The next read plays the packet from where playback is now and skips what's already past.
+	
+	_RTPJitterBufferStore( &slot->state, kRTPJitterBufferSlot_Prepared );
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	startTS = ctx->jb.nextTS - kRTPJitterBufferTestFramesPerRead;
+	for( frame = 0; frame < kRTPJitterBufferTestFramesPerRead; ++frame )
+	{
+		require_action( buf[ frame * 2 ] == _RTPJitterBufferTestSample( startTS + frame, 0 ), exit, err = kResponseErr );
+		require_action( buf[ ( frame * 2 ) + 1 ] == _RTPJitterBufferTestSample( startTS + frame, 1 ), exit, err = kResponseErr );
+	}
+	require_action( !ctx->jb.buffering && ( ctx->jb.nRebuffer == 0 ) && ( ctx->jb.nStarts == 1 ), exit, err = kResponseErr );
+	require_action( ctx->jb.nSkipped == 1, exit, err = kResponseErr );
+	
+	if( inPrint )
+	{
+		fprintf( stderr, "	decode late: %u ready frames, %u silent, Rebuffers=%u Skipped=%u\n", readyFrames, 
+			kRTPJitterBufferTestFramesPerRead - readyFrames, ctx->jb.nRebuffer, ctx->jb.nSkipped );
+	}
+	
+exit:
+	if( ctx )
+	{
+		RTPJitterBufferFree( &ctx->jb );
+		free( ctx );
+	}
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferTestStale
+//
+//	Sends one packet from far behind the consumer during playback, like a very late retransmit. It must be dropped and
+//	playback must continue without skipping or re-buffering. A run of such packets (e.g. the sender restarted) must
+//	make the consumer resync to them.
+//===========================================================================================================================
+
+#define kRTPJitterBufferTestStalePackets		10	// Less than bufferMs so nothing is discarded when playback starts.
+
+static OSStatus	_RTPJitterBufferTestStale( int inPrint )
+{
+	OSStatus						err;
+	RTPJitterBufferTestContext *	ctx;
+	AudioStreamBasicDescription		asbd;
+	int16_t							buf[ kRTPJitterBufferTestFramesPerRead * 2 ];
+	uint32_t						i, frame, startTS, staleIndex, reads;
+	
+	ctx = (RTPJitterBufferTestContext *) calloc( 1, sizeof( *ctx ) );
+	require_action( ctx, exit, err = kNoMemoryErr );
+	
+	ASBD_FillPCM( &asbd, kRTPJitterBufferTestSampleRate, 16, 16, 2 );
+	err = RTPJitterBufferInit( &ctx->jb, &asbd, NULL, kRTPJitterBufferTestBufferMs );
+	require_noerr( err, exit );
+	ctx->jb.label		= "Stale";
+	ctx->jb.skewAdjust	= false;
+	
+	for( i = 0; i < kRTPJitterBufferTestStalePackets; ++i )
+	{
+		err = _RTPJitterBufferTestSend( ctx, i );
+		require_noerr( err, exit );
+	}
+	
+	// Buffer then start playing from the first packet.
+	
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	usleep( ( kRTPJitterBufferTestBufferMs + 10 ) * 1000 );
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	require_action( !ctx->jb.buffering && ( ctx->jb.nextTS == kRTPJitterBufferTestFramesPerRead ), exit, err = kResponseErr );
+	
+	// One packet from far behind is dropped. Later packets are still accepted.
+	
+	staleIndex = (uint32_t)( -4 * (int32_t) ctx->jb.nodesAllocated );
+	err = _RTPJitterBufferTestSend( ctx, staleIndex );
+	require_noerr( err, exit );
+	require_action( ( ctx->rejected == 1 ) && !ctx->jb.skipPending, exit, err = kResponseErr );
+	for( i = kRTPJitterBufferTestStalePackets; i < ( 2 * kRTPJitterBufferTestStalePackets ); ++i )
+	{
+		err = _RTPJitterBufferTestSend( ctx, i );
+		require_noerr( err, exit );
+	}
+	require_action( ( ctx->rejected == 1 ) && ( ctx->sent == ( 2 * kRTPJitterBufferTestStalePackets ) ), exit, 
+		err = kResponseErr );
+	
+	// Playback continues through the packets queued before and after it.
+	
+	reads = ( ( 2 * kRTPJitterBufferTestStalePackets - 1 ) * kRTPJitterBufferTestFramesPerPacket ) / kRTPJitterBufferTestFramesPerRead;
+	for( i = 1; i < reads; ++i )
+	{
+		err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+		require_noerr( err, exit );
+		startTS = ctx->jb.nextTS - kRTPJitterBufferTestFramesPerRead;
+		for( frame = 0; frame < kRTPJitterBufferTestFramesPerRead; ++frame )
+		{
+			require_action( buf[ frame * 2 ] == _RTPJitterBufferTestSample( startTS + frame, 0 ), exit, err = kResponseErr );
+			require_action( buf[ ( frame * 2 ) + 1 ] == _RTPJitterBufferTestSample( startTS + frame, 1 ), exit, err = kResponseErr );
+		}
+	}
+	require_action( !ctx->jb.buffering && ( ctx->jb.nRebuffer == 0 ) && ( ctx->jb.nDiscards == 0 ), exit, err = kResponseErr );
+	require_action( ( ctx->jb.nSkipped == 0 ) && ( ctx->jb.nGaps == 0 ), exit, err = kResponseErr );
+	
+	// A run of packets from far behind makes the consumer resync to them.
+	
+	for( i = 0; i < kRTPJitterBufferStaleResync; ++i )
+	{
+		require_action( !ctx->jb.skipPending, exit, err = kResponseErr );
+		err = _RTPJitterBufferTestSend( ctx, staleIndex + i );
+		require_noerr( err, exit );
+	}
+	require_action( ctx->jb.skipPending && ( ctx->jb.skipSeq == ( staleIndex + i - 1 + 60000 - ( ctx->jb.nodesAllocated / 2 ) ) ), 
+		exit, err = kResponseErr );
+	err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+	require_noerr( err, exit );
+	require_action( !ctx->jb.skipPending && ctx->jb.buffering && ( ctx->jb.nDiscards == 1 ), exit, err = kResponseErr );
+	
+	if( inPrint )
+	{
+		fprintf( stderr, "	stale: 1 packet dropped, %u reads played through, resynced after %u\n", reads - 1, 
+			kRTPJitterBufferStaleResync );
+	}
+	
+exit:
+	if( ctx )
+	{
+		RTPJitterBufferFree( &ctx->jb );
+		free( ctx );
+	}
+	return( err );
+}
+
+//===========================================================================================================================
+//	RTPJitterBufferSkewTest
+//
+//	Simulates an hour of audio with the audio hardware running 500 ppm fast and then 500 ppm slow relative to the sender
+//	plus network jitter. Time is simulated so an hour runs in seconds. Each case runs with and without skew adjustment.
+//	Skew adjustment must have no glitches and hold the fill level near bufferMs. Without it the same stream must glitch
+//	(otherwise the simulation isn't stressing anything). Reports glitches, fill level, and CPU time per read.
+//===========================================================================================================================
+
+#define kRTPJitterBufferSkewTestSeconds			3600
+#define kRTPJitterBufferSkewTestSettleSeconds	120		// Time for the fill level to settle before measuring it.
+#define kRTPJitterBufferSkewTestPPM				500		// Clock skew between the sender and the audio hardware.
+#define kRTPJitterBufferSkewTestNoisePPM		20		// Max error in the skew estimate.
+#define kRTPJitterBufferSkewTestLatencyUs		2000	// Min network latency.
+#define kRTPJitterBufferSkewTestJitterUs		15000	// Max network jitter on top of the min latency.
+
+#define _RTPJitterBufferSkewTestHash( X )		( ( ( (uint32_t)(X) ) * 2654435761U ) ^ ( ( (uint32_t)(X) ) >> 7 ) )
+#define _RTPJitterBufferSkewTestArrival( K ) \
+	( ( ( (Float64)(K) ) * kRTPJitterBufferTestFramesPerPacket ) / kRTPJitterBufferTestSampleRate + \
+	( kRTPJitterBufferSkewTestLatencyUs + ( _RTPJitterBufferSkewTestHash( K ) % kRTPJitterBufferSkewTestJitterUs ) ) / 1e6 )
+
+typedef struct
+{
+	uint32_t		glitches;		// Reads with late, missing, skipped, or discarded audio, re-buffering, or rejected packets.
+	Float64			fillMean;		// Mean fill level after settling (ms).
+	Float64			fillStdDev;		// Standard deviation of the fill level after settling (ms).
+	Float64			fillMin;		// Min fill level after settling (ms).
+	Float64			fillMax;		// Max fill level after settling (ms).
+	Float64			adjustPeak;		// Largest fill level adjustment (ppm).
+	Float64			readAvgUs;		// Average CPU time per read (microseconds).
+	Float64			readMaxUs;		// Max CPU time per read (microseconds).
+
+}	RTPJitterBufferSkewTestResult;
+
+static OSStatus
+	_RTPJitterBufferSkewTestRun(
+		RTPJitterBufferTestContext *		ctx,
+		int									inPPM,
+		Boolean								inAdjust,
+		RTPJitterBufferSkewTestResult *		outResult );
+
+OSStatus	RTPJitterBufferSkewTest( int inPrint, int inPerf )
+{
+	static const int					kPPMs[] = { kRTPJitterBufferSkewTestPPM, -kRTPJitterBufferSkewTestPPM };
+	OSStatus							err;
+	RTPJitterBufferTestContext *		ctx;
+	RTPJitterBufferSkewTestResult		adjusted, unadjusted;
+	size_t								i;
+	
+	(void) inPerf;
+	
+	ctx = (RTPJitterBufferTestContext *) calloc( 1, sizeof( *ctx ) );
+	require_action( ctx, exit, err = kNoMemoryErr );
+	
+	for( i = 0; i < countof( kPPMs ); ++i )
+	{
+		err = _RTPJitterBufferSkewTestRun( ctx, kPPMs[ i ], true, &adjusted );
+		require_noerr( err, exit );
+		err = _RTPJitterBufferSkewTestRun( ctx, kPPMs[ i ], false, &unadjusted );
+		require_noerr( err, exit );
+		
+		if( inPrint )
+		{
+			fprintf( stderr, "\t%+d ppm, adjusted:   %u glitches, fill %.1f ms +/- %.2f ms (%.1f-%.1f ms), adjust peak %+.0f ppm, "
+				"read %.2f us avg, %.2f us max\n", kPPMs[ i ], adjusted.glitches, adjusted.fillMean, adjusted.fillStdDev,
+				adjusted.fillMin, adjusted.fillMax, adjusted.adjustPeak, adjusted.readAvgUs, adjusted.readMaxUs );
+			fprintf( stderr, "\t%+d ppm, unadjusted: %u glitches, fill %.1f ms +/- %.2f ms (%.1f-%.1f ms), "
+				"read %.2f us avg, %.2f us max\n", kPPMs[ i ], unadjusted.glitches, unadjusted.fillMean, unadjusted.fillStdDev,
+				unadjusted.fillMin, unadjusted.fillMax, unadjusted.readAvgUs, unadjusted.readMaxUs );
+		}
+		require_action( adjusted.glitches == 0, exit, err = kResponseErr );
+		require_action( fabs( adjusted.fillMean - kAirPlayAudioBufferMainAltWiFiMs ) < 5, exit, err = kResponseErr );
+		require_action( adjusted.fillStdDev < 5, exit, err = kResponseErr );
+		require_action( unadjusted.glitches > 0, exit, err = kResponseErr );
+	}
+	err = kNoErr;
+	
+exit:
+	FreeNullSafe( ctx );
+	printf( "RTPJitterBufferSkewTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_RTPJitterBufferSkewTestRun
+//===========================================================================================================================
+
+static OSStatus
+	_RTPJitterBufferSkewTestRun(
+		RTPJitterBufferTestContext *		ctx,
+		int									inPPM,
+		Boolean								inAdjust,
+		RTPJitterBufferSkewTestResult *		outResult )
+{
+	Float64 const					outputRate	= kRTPJitterBufferTestSampleRate * ( 1.0 + ( inPPM / 1e6 ) );
+	Float64 const					readSecs	= kRTPJitterBufferTestFramesPerRead / outputRate;
+	uint32_t const					readCount	= (uint32_t)( kRTPJitterBufferSkewTestSeconds / readSecs );
+	OSStatus						err;
+	AudioStreamBasicDescription		asbd;
+	int16_t							buf[ kRTPJitterBufferTestFramesPerRead * 2 ];
+	uint32_t						i, j, low, arrived, second, lastSecond, events, lastEvents, n;
+	Float64							now, bufferingStart, noise, fill, sum, sumSq;
+	uint64_t						ticks, totalTicks, maxTicks;
+	
+	memset( ctx, 0, sizeof( *ctx ) );
+	memset( outResult, 0, sizeof( *outResult ) );
+	
+	ASBD_FillPCM( &asbd, kRTPJitterBufferTestSampleRate, 16, 16, 2 );
+	err = RTPJitterBufferInit( &ctx->jb, &asbd, NULL, kAirPlayAudioBufferMainAltWiFiMs );
+	require_noerr( err, exit );
+	ctx->jb.label = "SkewTest";
+	require_action( ctx->jb.skewAdjust, exit, err = kInternalErr );
+	if( !inAdjust ) ctx->jb.skewAdjust = false;
+	
+	low			= 0;
+	arrived		= 0;
+	bufferingStart = -1;
+	lastSecond	= 0;
+	lastEvents	= 0;
+	n			= 0;
+	sum			= 0;
+	sumSq		= 0;
+	totalTicks	= 0;
+	maxTicks	= 0;
+	outResult->fillMin = 1e9;
+	for( i = 0; i < readCount; ++i )
+	{
+		now = i * readSecs;
+		
+		// Queue the packets that have arrived by now. Jitter is less than 8 packets so later packets haven't arrived yet.
+		
+		for( j = 0; j < 8; ++j )
+		{
+			if( ( arrived & ( 1U << j ) ) || ( _RTPJitterBufferSkewTestArrival( low + j ) > now ) ) continue;
+			err = _RTPJitterBufferTestSend( ctx, low + j );
+			if( err == kNoSpaceErr ) { ++ctx->rejected; err = kNoErr; }
+			require_noerr( err, exit );
+			arrived |= ( 1U << j );
+		}
+		for( ; arrived & 1; arrived >>= 1 ) ++low;
+		
+		// Update the skew estimate once a second after 8 seconds like _UpdateEstimatedRate.
+		
+		second = (uint32_t) now;
+		if( ( second != lastSecond ) && ( second >= 8 ) )
+		{
+			noise = ( ( (int)( _RTPJitterBufferSkewTestHash( second ) % ( ( 2 * kRTPJitterBufferSkewTestNoisePPM ) + 1 ) ) ) - 
+				kRTPJitterBufferSkewTestNoisePPM ) / 1e6;
+			RTPJitterBufferSetSkew( &ctx->jb, outputRate * ( 1.0 + noise ) );
+		}
+		lastSecond = second;
+		
+		// Simulated time runs faster than UpTicks so time buffering in simulated time.
+		
+		if( ctx->jb.buffering )
+		{
+			if( bufferingStart < 0 ) bufferingStart = now;
+			ctx->jb.startTicks = ( now >= ( bufferingStart + ( kAirPlayAudioBufferMainAltWiFiMs / 1000.0 ) ) ) ? 1 : UINT64_MAX;
+		}
+		else
+		{
+			bufferingStart = -1;
+		}
+		
+		// Measure the fill level the same way the skew adjustment sees it.
+		
+		if( now >= kRTPJitterBufferSkewTestSettleSeconds )
+		{
+			fill = ( ( (int32_t)( ctx->jb.highEndTS - ctx->jb.nextTS ) ) * 1000.0 ) / kRTPJitterBufferTestSampleRate;
+			sum   += fill;
+			sumSq += fill * fill;
+			++n;
+			if( fill < outResult->fillMin ) outResult->fillMin = fill;
+			if( fill > outResult->fillMax ) outResult->fillMax = fill;
+		}
+		
+		ticks = UpTicks();
+		err = RTPJitterBufferRead( &ctx->jb, buf, sizeof( buf ) );
+		ticks = UpTicks() - ticks;
+		require_noerr( err, exit );
+		totalTicks += ticks;
+		if( ticks > maxTicks ) maxTicks = ticks;
+		
+		events = ctx->jb.nLate + ctx->jb.nGaps + ctx->jb.nSkipped + ctx->jb.nRebuffer + ctx->jb.nDiscards + ctx->rejected;
+		if( events != lastEvents ) ++outResult->glitches;
+		lastEvents = events;
+	}
+	
+	require_action( n > 0, exit, err = kInternalErr );
+	outResult->fillMean		= sum / n;
+	outResult->fillStdDev	= sqrt( Max( 0.0, ( sumSq / n ) - ( outResult->fillMean * outResult->fillMean ) ) );
+	outResult->adjustPeak	= ctx->jb.rateAdjustPeak * 1e6;
+	outResult->readAvgUs	= ( 1e6 * totalTicks ) / ( readCount * (Float64) UpTicksPerSecond() );
+	outResult->readMaxUs	= ( 1e6 * maxTicks ) / UpTicksPerSecond();
+	
+exit:
+	RTPJitterBufferFree( &ctx->jb );
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlayLossConcealerTest
+//
+//	Drops packets from a synthetic voiced PCM stream using several loss patterns, conceals them with each strategy, and
+//	reports the SNR of the result against the original stream and the time taken per concealed packet.
+//===========================================================================================================================
+
+typedef struct
+{
+	const char *		name;
+	uint32_t			lossPerMille;	// Average number of packets lost per 1000 packets.
+	uint32_t			burst;			// Number of consecutive packets lost in each loss event.
+	
+}	AirPlayLossConcealerTestPattern;
+
+static const AirPlayLossConcealerTestPattern		kAirPlayLossConcealerTestPatterns[] =
+{
+	{ "1% random",		10,  1 },
+	{ "5% random",		50,  1 },
+	{ "10% random",		100, 1 },
+	{ "5% bursts of 3",	50,  3 },
+	{ "10% bursts of 8",100, 8 },
+};
+
+static const char * const		kAirPlayLossConcealerTestTypeNames[] = { "silence", "waveform", "pitch" };
+
+static void
+	_AirPlayLossConcealerTestSignal(
+		int16_t *	outSamples,
+		uint32_t	inFrames,
+		uint32_t	inSampleRate,
+		uint32_t	inChannels );
+static OSStatus
+	_AirPlayLossConcealerTestOne(
+		const AirPlayLossConcealerTestPattern *	inPattern,
+		AirPlayLossConcealmentType				inType,
+		uint32_t								inSampleRate,
+		uint32_t								inChannels,
+		const int16_t *							inSignal,
+		uint32_t								inFrames,
+		int16_t *								inOutput,
+		double *								outSNR,
+		double *								outAvgUs,
+		double *								outMaxUs );
+
+OSStatus	AirPlayLossConcealerTest( int inPrint, int inPerf )
+{
+	static const uint32_t		kFormats[][ 2 ] = { { 44100, 2 }, { 16000, 1 } };
+	OSStatus					err;
+	AirPlayLossConcealer		concealer;
+	int16_t *					signal = NULL;
+	int16_t *					output = NULL;
+	int16_t						buf[ 64 ];
+	uint32_t					seconds, sampleRate, channels, frames;
+	size_t						i, j, k;
+	double						snr[ 3 ], avgUs[ 3 ], maxUs[ 3 ];
+	
+	memset( &concealer, 0, sizeof( concealer ) );
+	
+	// Concealing with no history must produce silence.
+	
+	err = AirPlayLossConcealerInit( &concealer, kAirPlayLossConcealment_PitchPeriod, 44100, 2 );
+	require_noerr( err, exit );
+	memset( buf, 0x55, sizeof( buf ) );
+	AirPlayLossConcealerConceal( &concealer, buf, sizeof( buf ) );
+	for( i = 0; i < countof( buf ); ++i ) require_action( buf[ i ] == 0, exit, err = kResponseErr );
+	AirPlayLossConcealerFree( &concealer );
+	
+	// Loss patterns.
+	
+	seconds = inPerf ? 60 : 5;
+	for( i = 0; i < countof( kFormats ); ++i )
+	{
+		sampleRate	= kFormats[ i ][ 0 ];
+		channels	= kFormats[ i ][ 1 ];
+		frames		= seconds * sampleRate;
+		
+		signal = (int16_t *) malloc( frames * channels * sizeof( int16_t ) );
+		require_action( signal, exit, err = kNoMemoryErr );
+		output = (int16_t *) malloc( frames * channels * sizeof( int16_t ) );
+		require_action( output, exit, err = kNoMemoryErr );
+		_AirPlayLossConcealerTestSignal( signal, frames, sampleRate, channels );
+		
+		if( inPrint ) fprintf( stderr, "\t%u Hz, %u channel(s), %u seconds\n", sampleRate, channels, seconds );
+		for( j = 0; j < countof( kAirPlayLossConcealerTestPatterns ); ++j )
+		{
+			for( k = 0; k < countof( kAirPlayLossConcealerTestTypeNames ); ++k )
+			{
+				err = _AirPlayLossConcealerTestOne( &kAirPlayLossConcealerTestPatterns[ j ], (AirPlayLossConcealmentType) k, 
+					sampleRate, channels, signal, frames, output, &snr[ k ], &avgUs[ k ], &maxUs[ k ] );
+				require_noerr( err, exit );
+				
+				if( inPrint )
+				{
+					fprintf( stderr, "\t\t%-16s %-9s SNR %6.2f dB, %7.2f µs/packet avg, %7.2f µs max\n", 
+						kAirPlayLossConcealerTestPatterns[ j ].name, kAirPlayLossConcealerTestTypeNames[ k ], 
+						snr[ k ], avgUs[ k ], maxUs[ k ] );
+				}
+			}
+			
+			// Both strategies should track the original signal better than silence. Long bursts fade to silence so the
+			// improvement there is smaller.
+			
+			require_action( snr[ kAirPlayLossConcealment_Waveform ]    > ( snr[ kAirPlayLossConcealment_Silence ] + 1 ), exit, err = kResponseErr );
+			require_action( snr[ kAirPlayLossConcealment_PitchPeriod ] > ( snr[ kAirPlayLossConcealment_Silence ] + 1 ), exit, err = kResponseErr );
+		}
+		ForgetMem( &signal );
+		ForgetMem( &output );
+	}
+	err = kNoErr;
+	
+exit:
+	AirPlayLossConcealerFree( &concealer );
+	FreeNullSafe( signal );
+	FreeNullSafe( output );
+	printf( "AirPlayLossConcealerTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayLossConcealerTestSignal
+//
+//	Generates a voiced-like signal: a harmonic series with vibrato around 140 Hz, a slow amplitude envelope, and noise.
+//===========================================================================================================================
+
+static void
+	_AirPlayLossConcealerTestSignal(
+		int16_t *	outSamples,
+		uint32_t	inFrames,
+		uint32_t	inSampleRate,
+		uint32_t	inChannels )
+{
+	uint32_t		seed = 12345;
+	double			phase = 0, t, f0, env, sum;
+	uint32_t		i, j, h;
+	
+	for( i = 0; i < inFrames; ++i )
+	{
+		t		= ( (double) i ) / inSampleRate;
+		f0		= 140 + ( 20 * sin( 2 * M_PI * 0.5 * t ) );
+		env		= 0.6 + ( 0.4 * sin( 2 * M_PI * 0.3 * t ) );
+		phase  += ( 2 * M_PI * f0 ) / inSampleRate;
+		sum		= 0;
+		for( h = 1; h <= 8; ++h ) sum += sin( h * phase ) / h;
+		for( j = 0; j < inChannels; ++j )
+		{
+			seed = ( seed * 1103515245 ) + 12345;
+			outSamples[ ( i * inChannels ) + j ] = (int16_t)( ( 6000 * env * sum * ( 1.0 - ( 0.2 * j ) ) ) + 
+				( (int32_t)( ( seed >> 16 ) & 0xFF ) - 128 ) );
+		}
+	}
+}
+
+//===========================================================================================================================
+//	_AirPlayLossConcealerTestOne
+//===========================================================================================================================
+
+static OSStatus
+	_AirPlayLossConcealerTestOne(
+		const AirPlayLossConcealerTestPattern *	inPattern,
+		AirPlayLossConcealmentType				inType,
+		uint32_t								inSampleRate,
+		uint32_t								inChannels,
+		const int16_t *							inSignal,
+		uint32_t								inFrames,
+		int16_t *								inOutput,
+		double *								outSNR,
+		double *								outAvgUs,
+		double *								outMaxUs )
+{
+	uint32_t const				framesPerPacket = inSampleRate / 125; // 8 ms packets.
+	OSStatus					err;
+	AirPlayLossConcealer		concealer;
+	uint32_t					seed = 1;
+	uint32_t					offset, frames, lostRemaining, nConcealed;
+	size_t						i, len;
+	uint64_t					ticks, totalTicks, maxTicks;
+	double						signalEnergy, errorEnergy, d;
+	
+	err = AirPlayLossConcealerInit( &concealer, inType, inSampleRate, inChannels );
+	require_noerr( err, exit );
+	
+	lostRemaining	= 0;
+	nConcealed		= 0;
+	totalTicks		= 0;
+	maxTicks		= 0;
+	for( offset = 0; offset < inFrames; offset += frames )
+	{
+		frames	= Min( framesPerPacket, inFrames - offset );
+		len		= frames * inChannels * sizeof( int16_t );
+		if( lostRemaining == 0 )
+		{
+			seed = ( seed * 1103515245 ) + 12345;
+			if( ( ( seed >> 16 ) % 1000 ) < ( inPattern->lossPerMille / inPattern->burst ) ) lostRemaining = inPattern->burst;
+		}
+		if( lostRemaining > 0 )
+		{
+			--lostRemaining;
+			ticks = UpTicks();
+			AirPlayLossConcealerConceal( &concealer, &inOutput[ offset * inChannels ], len );
+			ticks = UpTicks() - ticks;
+			totalTicks += ticks;
+			if( ticks > maxTicks ) maxTicks = ticks;
+			++nConcealed;
+		}
+		else
+		{
+			memcpy( &inOutput[ offset * inChannels ], &inSignal[ offset * inChannels ], len );
+			AirPlayLossConcealerPlayed( &concealer, &inOutput[ offset * inChannels ], len );
+		}
+	}
+	require_action( nConcealed > 0, exit, err = kResponseErr );
+	
+	signalEnergy = 0;
+	errorEnergy  = 0;
+	for( i = 0; i < ( inFrames * inChannels ); ++i )
+	{
+		d = inSignal[ i ];
+		signalEnergy += d * d;
+		d -= inOutput[ i ];
+		errorEnergy  += d * d;
+	}
+	*outSNR   = 10 * log10( signalEnergy / Max( errorEnergy, 1.0 ) );
+	*outAvgUs = ( 1000000.0 * totalTicks ) / ( UpTicksPerSecond() * nConcealed );
+	*outMaxUs = ( 1000000.0 * maxTicks ) / UpTicksPerSecond();
+	
+exit:
+	AirPlayLossConcealerFree( &concealer );
+	return( err );
+}
+
+//===========================================================================================================================
+//	AirPlayFramePoolTest
+//
+//	Simulates a 60 fps screen stream with mostly small frames and a large key frame every second. A decoder thread holds
+//	on to a few frames before releasing them. Every frame must still hold what was written to it when it's released so a buffer is never handed out twice.
+//	Compares the per-frame allocation time with malloc/free for the same sizes.
+//===========================================================================================================================
+
+#define kAirPlayFramePoolTestDepth		4		// Number of frames the decoder holds at once.
+#define kAirPlayFramePoolTestKeyFrame	60		// Frames per key frame.
+
+typedef struct
+{
+	AirPlayFramePool *		pool;
+	pthread_mutex_t			mutex;
+	pthread_cond_t			cond;
+	uint8_t *				frames[ kAirPlayFramePoolTestDepth ];
+	size_t					sizes[ kAirPlayFramePoolTestDepth ];
+	uint32_t				indexes[ kAirPlayFramePoolTestDepth ];
+	uint32_t				head;		// Next frame for the decoder to take.
+	uint32_t				count;		// Number of frames queued.
+	Boolean					done;
+	uint32_t				mismatches;
+	
+}	AirPlayFramePoolTestContext;
+
+static size_t	_AirPlayFramePoolTestSize( uint32_t inIndex, uint32_t *ioSeed );
+static void *	_AirPlayFramePoolTestDecoder( void *inArg );
+static OSStatus	_AirPlayFramePoolTestLateRelease( void );
+static void *	_AirPlayFramePoolTestLateReleaseThread( void *inArg );
+
+OSStatus	AirPlayFramePoolTest( int inPrint, int inPerf )
+{
+	uint32_t const					frameCount = inPerf ? ( 60 * 60 * 10 ) : ( 60 * 60 );
+	OSStatus						err;
+	AirPlayFramePoolTestContext *	ctx;
+	pthread_mutex_t *				mutexPtr = NULL;
+	pthread_cond_t *				condPtr = NULL;
+	pthread_t						decoder;
+	pthread_t *						decoderPtr = NULL;
+	uint8_t *						held[ kAirPlayFramePoolTestDepth ];
+	uint8_t *						ptr;
+	uint32_t						i, j, seed;
+	size_t							size, bytesPeak;
+	uint64_t						ticks, mallocTicks, mallocTicksMax;
+	double							poolAvgUs, mallocAvgUs;
+	
+	memset( held, 0, sizeof( held ) );
+	ctx = (AirPlayFramePoolTestContext *) calloc( 1, sizeof( *ctx ) );
+	require_action( ctx, exit, err = kNoMemoryErr );
+	err = AirPlayFramePoolCreate( &ctx->pool );
+	require_noerr( err, exit );
+	err = pthread_mutex_init( &ctx->mutex, NULL );
+	require_noerr( err, exit );
+	mutexPtr = &ctx->mutex;
+	err = pthread_cond_init( &ctx->cond, NULL );
+	require_noerr( err, exit );
+	condPtr = &ctx->cond;
+	err = pthread_create( &decoder, NULL, _AirPlayFramePoolTestDecoder, ctx );
+	require_noerr( err, exit );
+	decoderPtr = &decoder;
+	
+	// Queue frames to the decoder thread, which releases them once it's holding more than it can.
+	
+	seed = 1;
+	for( i = 0; i < frameCount; ++i )
+	{
+		size = _AirPlayFramePoolTestSize( i, &seed );
+		ptr = AirPlayFramePoolGet( ctx->pool, size );
+		require_action( ptr, exit, err = kNoMemoryErr );
+		memset( ptr, (int)( i & 0xFF ), size );
+		
+		pthread_mutex_lock( mutexPtr );
+		while( ctx->count >= kAirPlayFramePoolTestDepth ) pthread_cond_wait( condPtr, mutexPtr );
+		j = ( ctx->head + ctx->count ) % kAirPlayFramePoolTestDepth;
+		ctx->frames[ j ]	= ptr;
+		ctx->sizes[ j ]		= size;
+		ctx->indexes[ j ]	= i;
+		++ctx->count;
+		pthread_cond_signal( condPtr );
+		pthread_mutex_unlock( mutexPtr );
+	}
+	pthread_mutex_lock( mutexPtr );
+	ctx->done = true;
+	pthread_cond_signal( condPtr );
+	pthread_mutex_unlock( mutexPtr );
+	pthread_join( decoder, NULL );
+	decoderPtr = NULL;
+	
+	// Buffers too big for any size class are allocated and freed on each use.
+	
+	bytesPeak = ctx->pool->bytesPeak;
+	ptr = AirPlayFramePoolGet( ctx->pool, ( (size_t) 1 ) << ( kAirPlayFramePoolMinSizeShift + kAirPlayFramePoolClassCount ) );
+	require_action( ptr, exit, err = kNoMemoryErr );
+	AirPlayFramePoolRelease( ptr );
+	require_action( ctx->pool->inUse == 0, exit, err = kResponseErr );
+	
+	// Allocate the same sizes with malloc/free, holding the same number of frames, for comparison.
+	
+	seed			= 1;
+	mallocTicks		= 0;
+	mallocTicksMax	= 0;
+	for( i = 0; i < frameCount; ++i )
+	{
+		size = _AirPlayFramePoolTestSize( i, &seed );
+		FreeNullSafe( held[ i % kAirPlayFramePoolTestDepth ] );
+		ticks = UpTicks();
+		ptr = (uint8_t *) malloc( size );
+		ticks = UpTicks() - ticks;
+		require_action( ptr, exit, err = kNoMemoryErr );
+		memset( ptr, (int)( i & 0xFF ), size );
+		held[ i % kAirPlayFramePoolTestDepth ] = ptr;
+		mallocTicks += ticks;
+		if( ticks > mallocTicksMax ) mallocTicksMax = ticks;
+	}
+	
+	poolAvgUs	= ( 1000000.0 * ctx->pool->getTicks ) / ( ctx->pool->gets * (double) UpTicksPerSecond() );
+	mallocAvgUs	= ( 1000000.0 * mallocTicks ) / ( frameCount * (double) UpTicksPerSecond() );
+	if( inPrint )
+	{
+		fprintf( stderr, "\t%u frames: %llu pool hits, %u mismatched, %zu KB peak\n", frameCount, 
+			(unsigned long long) ctx->pool->hits, ctx->mismatches, bytesPeak / 1024 );
+		fprintf( stderr, "\tpool:   %.2f µs avg, %.2f µs max\n", poolAvgUs, 
+			( 1000000.0 * ctx->pool->getTicksMax ) / UpTicksPerSecond() );
+		fprintf( stderr, "\tmalloc: %.2f µs avg, %.2f µs max\n", mallocAvgUs, 
+			( 1000000.0 * mallocTicksMax ) / UpTicksPerSecond() );
+	}
+	require_action( ctx->mismatches == 0, exit, err = kResponseErr );
+	require_action( ctx->pool->hits >= ( ( 99 * (uint64_t) frameCount ) / 100 ), exit, err = kResponseErr );
+	
+	// The decoder's frames plus one being checked and one being filled can be in use at once so no size class (up to
+	// 512 KB for the biggest key frame) should grow beyond that many buffers.
+	
+	require_action( bytesPeak <= ( ( kAirPlayFramePoolTestDepth + 2 ) * ( ( (size_t) 1 ) << 20 ) ), exit, err = kResponseErr );
+	
+	err = _AirPlayFramePoolTestLateRelease();
+	require_noerr( err, exit );
+	
+exit:
+	if( decoderPtr )
+	{
+		pthread_mutex_lock( mutexPtr );
+		ctx->done = true;
+		pthread_cond_signal( condPtr );
+		pthread_mutex_unlock( mutexPtr );
+		pthread_join( *decoderPtr, NULL );
+	}
+	for( i = 0; i < kAirPlayFramePoolTestDepth; ++i ) FreeNullSafe( held[ i ] );
+	if( ctx )
+	{
+		for( i = 0; i < ctx->count; ++i ) AirPlayFramePoolRelease( ctx->frames[ ( ctx->head + i ) % kAirPlayFramePoolTestDepth ] );
+		ForgetCustom( &ctx->pool, AirPlayFramePoolFree );
+		pthread_cond_forget( &condPtr );
+		pthread_mutex_forget( &mutexPtr );
+		free( ctx );
+	}
+	printf( "AirPlayFramePoolTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayFramePoolTestSize
+//
+//	Returns 200-400 KB for key frames and 4-80 KB for the frames in between.
+//===========================================================================================================================
+
+static size_t	_AirPlayFramePoolTestSize( uint32_t inIndex, uint32_t *ioSeed )
+{
+	*ioSeed = ( *ioSeed * 1103515245 ) + 12345;
+	if( ( inIndex % kAirPlayFramePoolTestKeyFrame ) == 0 ) return( 200000 + ( ( *ioSeed >> 8 ) % 200000 ) );
+	return( 4000 + ( ( *ioSeed >> 8 ) % 76000 ) );
+}
+
+//===========================================================================================================================
+//	_AirPlayFramePoolTestDecoder
+//===========================================================================================================================
+
+static void *	_AirPlayFramePoolTestDecoder( void *inArg )
+{
+	AirPlayFramePoolTestContext * const		ctx = (AirPlayFramePoolTestContext *) inArg;
+	uint8_t *								ptr;
+	size_t									size, i;
+	uint8_t									value;
+	
+	pthread_mutex_lock( &ctx->mutex );
+	for( ;; )
+	{
+		while( !ctx->done && ( ctx->count < kAirPlayFramePoolTestDepth ) ) pthread_cond_wait( &ctx->cond, &ctx->mutex );
+		if( ctx->count == 0 ) break;
+		
+		ptr  = ctx->frames[ ctx->head ];
+		size = ctx->sizes[ ctx->head ];
+		value = (uint8_t)( ctx->indexes[ ctx->head ] & 0xFF );
+		ctx->head = ( ctx->head + 1 ) % kAirPlayFramePoolTestDepth;
+		--ctx->count;
+		pthread_cond_signal( &ctx->cond );
+		pthread_mutex_unlock( &ctx->mutex );
+		
+		for( i = 0; i < size; ++i )
+		{
+			if( ptr[ i ] != value ) { ++ctx->mismatches; break; }
+		}
+		AirPlayFramePoolRelease( ptr );
+		
+		pthread_mutex_lock( &ctx->mutex );
+	}
+	pthread_mutex_unlock( &ctx->mutex );
+	return( NULL );
+}
+
+//===========================================================================================================================
+//	_AirPlayFramePoolTestLateRelease
+//
+//	Frees the pool while frames are still in use, like a session torn down before the screen stream has completed its
+//	frames, then completes them on another thread. The pool must outlive the frames and the frames must still be usable.
+//===========================================================================================================================
+
+static OSStatus	_AirPlayFramePoolTestLateRelease( void )
+{
+	OSStatus				err;
+	AirPlayFramePool *		pool = NULL;
+	AirPlayFramePool *		freedPool;
+	uint8_t *				frames[ 3 ];
+	uint8_t *				ptr;
+	pthread_t				thread;
+	
+	memset( frames, 0, sizeof( frames ) );
+	err = AirPlayFramePoolCreate( &pool );
+	require_noerr( err, exit );
+	
+	ptr = AirPlayFramePoolGet( pool, 1000 );
+	require_action( ptr, exit, err = kNoMemoryErr );
+	AirPlayFramePoolRelease( ptr ); // Leave a buffer on a free list.
+	frames[ 0 ] = AirPlayFramePoolGet( pool, 1000 );
+	frames[ 1 ] = AirPlayFramePoolGet( pool, 100000 );
+	frames[ 2 ] = AirPlayFramePoolGet( pool, ( (size_t) 1 ) << ( kAirPlayFramePoolMinSizeShift + kAirPlayFramePoolClassCount ) );
+	require_action( frames[ 0 ] && frames[ 1 ] && frames[ 2 ], exit, err = kNoMemoryErr );
+	
+	freedPool = pool;
+	ForgetCustom( &pool, AirPlayFramePoolFree );
+	require_action( freedPool->freed && ( freedPool->inUse == 3 ), exit, err = kResponseErr );
+	
+	err = pthread_create( &thread, NULL, _AirPlayFramePoolTestLateReleaseThread, frames );
+	require_noerr( err, exit );
+	pthread_join( thread, NULL );
+	memset( frames, 0, sizeof( frames ) );
+	
+exit:
+	AirPlayFramePoolRelease( frames[ 0 ] );
+	AirPlayFramePoolRelease( frames[ 1 ] );
+	AirPlayFramePoolRelease( frames[ 2 ] );
+	if( pool ) AirPlayFramePoolFree( pool );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirPlayFramePoolTestLateReleaseThread
+//===========================================================================================================================
+
+static void *	_AirPlayFramePoolTestLateReleaseThread( void *inArg )
+{
+	uint8_t ** const		frames = (uint8_t **) inArg;
+	
+	usleep( 10000 );
+	memset( frames[ 0 ], 0xAA, 1000 );
+	memset( frames[ 1 ], 0xAA, 100000 );
+	AirPlayFramePoolRelease( frames[ 0 ] );
+	AirPlayFramePoolRelease( frames[ 1 ] );
+	AirPlayFramePoolRelease( frames[ 2 ] );
+	return( NULL );
 }
+#endif // !EXCLUDE_UNIT_TESTS
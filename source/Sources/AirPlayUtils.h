@@ -57,6 +57,7 @@
 #include "AirPlayCommon.h"
 #include "AudioConverter.h"
 #include "ChaCha20Poly1305.h"
+#include "DataBufferUtils.h"
 #include <sys/queue.h>
 
 #include CF_HEADER
@@ -136,57 +137,160 @@ void	AirPlay_DeriveAESKeySHA512ForScreen(
 		uint8_t				outKey[ 16 ],
 		uint8_t				outIV[ 16 ] );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	AirPlayConditionInit
+	@abstract	Initializes a condition for AirPlayConditionTimedWait. Timed waits use the monotonic clock so setting the
+				wall clock (e.g. when NTP first syncs) doesn't stretch or cut short a wait.
+*/
+OSStatus	AirPlayConditionInit( pthread_cond_t *inCondition );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*!	@function	AirPlayConditionTimedWait
+	@abstract	Waits up to inMs milliseconds on a condition from AirPlayConditionInit.
+	
+	@result		0 if signaled (or woken spuriously) or ETIMEDOUT if the time ran out.
+*/
+int	AirPlayConditionTimedWait( pthread_cond_t *inCondition, pthread_mutex_t *inMutex, uint32_t inMs );
+
+
+//===========================================================================================================================
+//	Allocation Tracking
+//
+//	Counts allocator calls (malloc, calloc, realloc, free) made by the current thread between Begin and End. Used to 
+//	verify real-time code paths never touch the heap. Compiles to nothing unless AIRPLAY_ALLOC_TRACKING is enabled.
+//===========================================================================================================================
+
+#if( AIRPLAY_ALLOC_TRACKING )
+	void		AirPlayAllocTrackingBegin( void );
+	uint64_t	AirPlayAllocTrackingEnd( void );
+#else
+	#define AirPlayAllocTrackingBegin()		do {} while( 0 )
+	#define AirPlayAllocTrackingEnd()		( (uint64_t) 0 )
+#endif
+
+//===========================================================================================================================
+//	AirPlaySkewResampler
+//
+//	Variable-rate resampler for interleaved 16-bit PCM used to absorb clock skew between the sender and the audio
+//	hardware. Uses 4-point cubic (Catmull-Rom) interpolation so a rate of exactly 1.0 passes samples through unchanged.
+//	For each block of output, AirPlaySkewResamplerPrepare says how many input frames are needed and where to put them,
+//	then AirPlaySkewResamplerProcess produces the output. Nothing allocates after init so it's safe on the render thread.
+//===========================================================================================================================
+
+typedef struct
+{
+	uint32_t			channels;		// Number of interleaved channels.
+	uint32_t			maxFrames;		// Max output frames per block.
+	Float64				rate;			// Input frames consumed per output frame.
+	Float64				position;		// Position of the next output frame in the input buffer (in frames).
+	int16_t *			input;			// Input frames still needed by the interpolator followed by new input (interleaved).
+	uint32_t			inputFrames;	// Number of valid frames in the input buffer.
+	uint32_t			inputCapacity;	// Size of the input buffer in frames.
+
+}	AirPlaySkewResampler;
+
+OSStatus	AirPlaySkewResamplerInit( AirPlaySkewResampler *ctx, uint32_t inChannels, uint32_t inMaxFrames );
+void		AirPlaySkewResamplerFree( AirPlaySkewResampler *ctx );
+void		AirPlaySkewResamplerReset( AirPlaySkewResampler *ctx );
+void		AirPlaySkewResamplerSetRate( AirPlaySkewResampler *ctx, Float64 inRate );
+uint32_t	AirPlaySkewResamplerPrepare( AirPlaySkewResampler *ctx, uint32_t inFrames, int16_t **outInput );
+void		AirPlaySkewResamplerProcess( AirPlaySkewResampler *ctx, int16_t *inDst, uint32_t inFrames );
 
 //===========================================================================================================================
 //	RTPJitterBuffer
+//
+//	Single producer (RTPJitterBufferGetFreeNode(s), RTPJitterBufferPutFreeNode(s), RTPJitterBufferPutBusyNode) and single
+//	consumer (RTPJitterBufferRead) jitter buffer. Packets are queued into a ring of slots indexed by sequence number and
+//	handed between threads without locks so reading never blocks. RTPJitterBufferReset may be called from any thread.
+//
+//	When the output is 16-bit PCM, the consumer resamples by a few hundred ppm to hold the buffer at bufferMs instead of
+//	letting clock skew fill or drain it. The rate follows the fill level and the skew from RTPJitterBufferSetSkew.
 //===========================================================================================================================
 
 typedef struct RTPJitterBufferContext		RTPJitterBufferContext;
 typedef struct RTPPacketNode				RTPPacketNode;
 
-TAILQ_HEAD( RTPPacketNodeList, RTPPacketNode );
-typedef struct RTPPacketNodeList RTPPacketNodeList;
-
 struct RTPPacketNode
 {
-	TAILQ_ENTRY( RTPPacketNode )	list;
+	RTPPacketNode *					next;			// Next node on the producer's free list.
 	RTPSavedPacket					pkt;			// Full RTP packet with header and payload.
 	uint8_t *						ptr;			// Ptr to RTP payload. Note: this may not point to the beginning of the payload.
-	dispatch_semaphore_t			decodeLock;		// Lock to protect node while decoding (no reading from / writing to node while decoding). 
+	uint32_t						seq;			// Extended (32-bit) RTP sequence number.
 	uint8_t *						decodeBuffer;	// Intermediate decode buffer.
 	RTPJitterBufferContext *		jitterBuffer;	// Owning jitter buffer context.
 };
 
+typedef struct
+{
+	int32_t							state;			// State of the slot (empty, received, decoding, prepared). Changed atomically.
+	RTPPacketNode *					node;			// Node in the slot. Only valid if the slot isn't empty.
+	
+}	RTPJitterBufferSlot;
+
 struct RTPJitterBufferContext
 {
-	dispatch_semaphore_t			nodeLock;			// Lock to protect node lists.
 	pthread_t						decodeThread;		// Thread to offload decoding work.
 	pthread_t *						decodeThreadPtr;	// Ptr to decodeThread when valid.
 	pthread_cond_t					decodeCondition;	// Condition to signal when decode work is ready.
 	pthread_cond_t *				decodeConditionPtr;	// Ptr to decodeCondition when valid.
 	pthread_mutex_t					decodeMutex;		// Mutex for signaling decodeCondition.
 	pthread_mutex_t *				decodeMutexPtr;		// Ptr to decodeMutex when valid.
+	Boolean							decodePending;		// True if nodes were queued since the decode thread last looked.
 	Boolean							decodeDone;			// Sentinal for terminating decodeThread.
 	RTPPacketNode *					packets;			// Backing store for all the packets.
-	RTPPacketNodeList				freeList;			// List of free nodes.
-	RTPPacketNodeList				preparedList;		// List of nodes prepared for reading, sorted by timestamp.
-	RTPPacketNodeList				receivedList;		// List of nodes received (but not prepared), sorted by timestamp.
-	uint32_t						nodesAllocated;		// Allocated size of the Jitter Buffer in nodes.
-	uint32_t						nodesUsed;			// Depth of the Jitter Buffer in nodes.
+	RTPJitterBufferSlot *			slots;				// Ring of slots indexed by sequence number.
+	RTPPacketNode **				returnRing;			// Ring of nodes handed back from the consumer to the producer.
+	uint32_t						nodesAllocated;		// Allocated size of the Jitter Buffer in nodes (a power of 2).
+	uint32_t						slotMask;			// Mask for indexing the slot and return rings.
+	
+	// Producer. Fields marked shared are read by the other threads.
+	
+	RTPPacketNode *					freeList;			// Nodes available to the producer.
+	uint32_t						returnTail;			// Next node to take back from returnRing.
+	int32_t							started;			// Non-zero once the first packet has been queued (shared).
+	uint32_t						highSeq;			// Highest sequence number queued (shared).
+	uint32_t						highEndTS;			// Timestamp after the last sample of highSeq (shared).
+	uint32_t						skipSeq;			// Sequence number the consumer should skip to (shared).
+	int32_t							skipPending;		// Non-zero if the consumer should skip to skipSeq (shared).
+	uint32_t						staleRun;			// Consecutive packets too far behind the consumer to be reordered.
+	uint32_t						eventsLogged;		// Sum of the consumer's event counts when they were last logged.
+	
+	// Consumer.
+	
+	uint32_t						readSeq;			// Next sequence number to read (shared).
+	uint32_t						nextTS;				// Next timestamp to read from (shared).
+	uint32_t						returnHead;			// Next entry to fill in returnRing (shared).
+	int32_t							resetDelta;			// Samples to advance nextTS by on the next read (shared).
+	uint64_t						startTicks;			// Ticks when we should start playing audio.
+	Boolean							buffering;			// True if we're buffering until the high watermark is reached.
+	uint32_t						nLate;				// Number of times samples were dropped because of being late.
+	uint32_t						nGaps;				// Number of times samples that were missing (e.g. lost packet).
+	uint32_t						nSkipped;			// Number of times we had to skip samples (before timing window).
+	uint32_t						nRebuffer;			// Number of times we had to re-buffer because we ran dry.
+	uint32_t						nStarts;			// Number of times buffering completed.
+	uint32_t						nDiscards;			// Number of times excess packets were discarded.
+	uint32_t						nDecodeLate;		// Number of reads cut short because the next packet wasn't decoded yet.
+	Boolean							skewAdjust;			// True to resample to hold the buffer at bufferMs.
+	AirPlaySkewResampler			resampler;			// Resampler for skew adjustment.
+	Float64							skewRate;			// Input frames per output frame from the measured clock skew.
+	Float64							fillAvg;			// Smoothed number of buffered input frames.
+	Boolean							fillValid;			// True if fillAvg is tracking the fill level.
+	Float64							rateIntegral;		// Integral term of the fill level controller.
+	Float64							rateAdjust;			// Current rate adjustment on top of skewRate (e.g. 0.0001 = 100 ppm).
+	Float64							rateAdjustPeak;		// Largest rate adjustment applied.
+	
+	// Decoder.
+	
+	uint32_t						decodeSeq;			// Next sequence number to decode (shared).
+	uint32_t						decodedEndTS;		// Timestamp after the last decoded sample (shared).
+	
 	AudioStreamBasicDescription		inputFormat;		// Format of sample data in enqueued nodes.
 	AudioStreamBasicDescription		outputFormat;		// Format of sample data read from buffer (must be PCM).
 	AudioConverterRef				decoder;			// AudioConverter instance for decoding.
 	AudioStreamPacketDescription	packetDescription;	// Description of encoded packet.
 	uint8_t *						decodeBuffers;		// Backing store for all packet decode buffers.
 	uint32_t						bufferMs;			// Milliseconds of audio to buffer before starting.
-	uint32_t						nextTS;				// Next timestamp to read from.
-	uint64_t						startTicks;			// Ticks when we should start playing audio.
 	Boolean							disabled;			// True if all input data should be dropped.
-	Boolean							buffering;			// True if we're buffering until the high watermark is reached.
-	uint32_t						nLate;				// Number of times samples were dropped because of being late.
-	uint32_t						nGaps;				// Number of times samples that were missing (e.g. lost packet).
-	uint32_t						nSkipped;			// Number of times we had to skip samples (before timing window).
-	uint32_t						nRebuffer;			// Number of times we had to re-buffer because we ran dry.
 	const char *					label;				// Optional label for logging.
 	dispatch_queue_t				logQueue;			// Queue to keep logging off of time critical threads / locks.
 };
@@ -200,9 +304,114 @@ OSStatus
 void		RTPJitterBufferFree( RTPJitterBufferContext *ctx );
 void		RTPJitterBufferReset( RTPJitterBufferContext *ctx, Float64 inDelta );
 OSStatus	RTPJitterBufferGetFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode **outNode );
+OSStatus	RTPJitterBufferGetFreeNodes( RTPJitterBufferContext *ctx, RTPPacketNode **outNodes, size_t inMaxCount, size_t *outCount );
 void		RTPJitterBufferPutFreeNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode );
+void		RTPJitterBufferPutFreeNodes( RTPJitterBufferContext *ctx, RTPPacketNode **inNodes, size_t inCount );
 OSStatus	RTPJitterBufferPutBusyNode( RTPJitterBufferContext *ctx, RTPPacketNode *inNode );
 OSStatus	RTPJitterBufferRead( RTPJitterBufferContext *ctx, void *inBuffer, size_t inLen );
+void		RTPJitterBufferSetSkew( RTPJitterBufferContext *ctx, Float64 inOutputRate );
+
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	RTPJitterBufferTest( int inPrint, int inPerf );
+OSStatus	RTPJitterBufferSkewTest( int inPrint, int inPerf );
+#endif
+
+//===========================================================================================================================
+//	AirPlayLossConcealer
+//
+//	Synthesizes replacement audio for lost or late packets of 16-bit PCM streams. Analysis is done once at the start of
+//	each loss (bounded by the history size) and synthesis is O(1) per sample so it's safe to use from the render thread.
+//===========================================================================================================================
+
+typedef enum
+{
+	kAirPlayLossConcealment_Silence		= 0,	// Fill gaps with silence.
+	kAirPlayLossConcealment_Waveform	= 1,	// Waveform substitution: repeat what followed the best match of the recent audio.
+	kAirPlayLossConcealment_PitchPeriod	= 2		// Pitch-period repetition: repeat the last pitch period with crossfaded joins.
+
+}	AirPlayLossConcealmentType;
+
+typedef struct
+{
+	AirPlayLossConcealmentType		type;				// Strategy to use for synthesizing lost audio.
+	uint32_t						channels;			// Number of interleaved channels.
+	uint32_t						minPeriod;			// Shortest repeat period to consider (in frames).
+	uint32_t						maxPeriod;			// Longest repeat period to consider (in frames).
+	uint32_t						fadeFrames;			// Frames to crossfade from concealed audio back to real audio.
+	uint32_t						holdFrames;			// Frames to conceal at full level before attenuating.
+	uint32_t						decayFrames;		// Frames to attenuate from full level to silence.
+	int16_t *						history;			// Ring buffer of the most recent real audio (interleaved).
+	uint32_t						historyMask;		// Ring size in frames minus 1 (ring size is a power of 2).
+	uint32_t						historyEnd;			// Ring index one past the most recent frame.
+	uint32_t						historyCount;		// Number of valid frames in the ring.
+	float *							analysis;			// Scratch space for the decimated mono signal used for analysis.
+	int16_t *						loop;				// Period being repeated while concealing (interleaved).
+	uint32_t						period;				// Number of frames in the loop. 0 if there wasn't enough history.
+	uint32_t						phase;				// Next frame to play from the loop.
+	uint32_t						concealedFrames;	// Frames concealed since the current loss started.
+	Boolean							concealing;			// True if the last audio produced was concealed.
+	uint32_t						nLosses;			// Number of losses concealed.
+	uint64_t						nConcealedFrames;	// Total number of frames concealed.
+
+}	AirPlayLossConcealer;
+
+OSStatus
+	AirPlayLossConcealerInit(
+		AirPlayLossConcealer *		ctx,
+		AirPlayLossConcealmentType	inType,
+		uint32_t					inSampleRate,
+		uint32_t					inChannels );
+void	AirPlayLossConcealerFree( AirPlayLossConcealer *ctx );
+void	AirPlayLossConcealerReset( AirPlayLossConcealer *ctx );
+void	AirPlayLossConcealerConceal( AirPlayLossConcealer *ctx, void *inBuffer, size_t inLen );
+void	AirPlayLossConcealerPlayed( AirPlayLossConcealer *ctx, void *ioBuffer, size_t inLen );
+
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	AirPlayLossConcealerTest( int inPrint, int inPerf );
+#endif
+
+//===========================================================================================================================
+//	AirPlayFramePool
+//
+//	Size-classed pool of buffers for variable-sized frames (e.g. H.264 screen frames). Each power-of-2 size class keeps the
+//	buffers released to it so a class only grows to the most buffers of its size ever in use at once. Buffers may be
+//	released from any thread so a decoder can hold on to a frame and release it when it's done. AirPlayFramePoolRelease
+//	matches ScreenStreamCompletion_f so it can be passed directly as a completion with the buffer as the context.
+//
+//	Each buffer in use holds a reference to the pool so a decoder may release a frame after the owner has called
+//	AirPlayFramePoolFree. The pool is freed when the owner and the last buffer in use have both let go of it.
+//===========================================================================================================================
+
+#define kAirPlayFramePoolMinSizeShift		12	// Smallest size class is 4 KB.
+#define kAirPlayFramePoolClassCount			12	// Largest size class is 8 MB. Larger buffers are allocated per use.
+
+typedef struct AirPlayFramePoolBuffer		AirPlayFramePoolBuffer;
+
+typedef struct
+{
+	pthread_mutex_t					mutex;				// Protects everything below.
+	pthread_mutex_t *				mutexPtr;			// Ptr to mutex when valid.
+	AirPlayFramePoolBuffer *		freeLists[ kAirPlayFramePoolClassCount ]; // Released buffers for each size class.
+	uint32_t						inUse;				// Number of buffers currently handed out.
+	Boolean							freed;				// True once the owner has freed the pool.
+	uint64_t						gets;				// Number of buffers handed out.
+	uint64_t						hits;				// Number of buffers handed out without allocating.
+	size_t							bytesAllocated;		// Bytes currently allocated (in use or free).
+	size_t							bytesPeak;			// Most bytes allocated at once.
+	uint64_t						getTicks;			// Total UpTicks spent getting buffers.
+	uint64_t						getTicksMax;		// Most UpTicks spent getting a single buffer.
+
+}	AirPlayFramePool;
+
+OSStatus	AirPlayFramePoolCreate( AirPlayFramePool **outPool );
+void		AirPlayFramePoolFree( AirPlayFramePool *inPool );
+uint8_t *	AirPlayFramePoolGet( AirPlayFramePool *inPool, size_t inLen );
+void		AirPlayFramePoolRelease( void *inBuffer );
+void		AirPlayFramePoolAppendStats( AirPlayFramePool *inPool, DataBuffer *inDB );
+
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	AirPlayFramePoolTest( int inPrint, int inPerf );
+#endif
 
 //===========================================================================================================================
 // ChaChaPoly encryption/decryption
@@ -53,6 +53,7 @@
 
 #include "AirTunesClock.h"
 
+#include "AtomicUtils.h"
 #include "DebugServices.h"
 #include "ThreadUtils.h"
 #include "TickUtils.h"
@@ -86,36 +87,43 @@ typedef int64_t		Fixed64;
 #define kAirTunesClock_MaxFrequency		   500000 // Max frequence error (nanoseconds per second).
 #define kAirTunesClock_PLLShift			        4 // PLL loop gain (bit shift value).
 
+// Snapshot of the clock state published to readers. Readers map UpTicks to synchronized time from a consistent copy of
+// this without taking a lock. It's only rewritten when the clock is adjusted so it's valid for any number of ticks.
+
+typedef struct
+{
+	uint64_t			ticks;			// UpTicks the snapshot is based at.
+	AirTunesTime		time;			// Synchronized time at "ticks".
+	uint64_t			slewScale;		// 1/2^64 seconds per tick until "slewEndTicks" (frequency and phase correction).
+	uint64_t			slewEndTicks;	// UpTicks when the phase correction completes.
+	AirTunesTime		slewEndTime;	// Synchronized time at "slewEndTicks".
+	uint64_t			scale;			// 1/2^64 seconds per tick after "slewEndTicks" (frequency correction only).
+	
+}	AirTunesClockSnapshot;
+
 // Prototypes
 
-DEBUG_STATIC void	_AirTunesClock_Tick( AirTunesClockRef inClock );
-DEBUG_STATIC void *	_AirTunesClock_Thread( void *inArg );
+DEBUG_STATIC void		_AirTunesClock_RebaseSnapshot( AirTunesClockRef inClock, AirTunesClockSnapshot *outSnapshot );
+DEBUG_STATIC void		_AirTunesClock_PublishSnapshot( AirTunesClockRef inClock, const AirTunesClockSnapshot *inSnapshot );
+DEBUG_STATIC void		_AirTunesClock_ReadSnapshot( AirTunesClockRef inClock, AirTunesClockSnapshot *outSnapshot, uint64_t *outNowTicks );
+DEBUG_STATIC void		_AirTunesClock_TimeAtTicks( const AirTunesClockSnapshot *inSnapshot, uint64_t inTicks, AirTunesTime *outTime );
+DEBUG_STATIC void		_AirTunesClock_ScaleTicks( uint64_t inTicks, uint64_t inScale, AirTunesTime *outTime );
+DEBUG_STATIC uint64_t	_AirTunesClock_ScaleForAdjustment( AirTunesClockRef inClock, Fixed64 inAdjustment );
 
 // Globals
 
 struct AirTunesClockPrivate
 {
-	AirTunesTime		epochTime;
-	AirTunesTime		upTime;
-	AirTunesTime		lastTime;
-	uint64_t			frequency;
-	uint64_t			scale;
-	uint32_t			lastCount;
-	int64_t				adjustment;
-	int32_t				lastOffset;						// Last time offset (nanoseconds).
-	int32_t				lastAdjustTime;					// Time at last adjustment (seconds).
-	Fixed64				offset;							// Time offset (nanoseconds).
-	Fixed64				frequencyOffset;				// Frequency offset (nanoseconds per second).
-	Fixed64				tickAdjust;						// Amount to adjust at each tick (nanoseconds per second).
-	int32_t				second;							// Current second.
-	pthread_t			thread;
-	pthread_t *			threadPtr;
-	pthread_mutex_t		lock;
-	pthread_mutex_t *	lockPtr;
-	Boolean				running;
+	AirTunesClockSnapshot volatile		snapshots[ 2 ];		// Current and next snapshot. Only valid to read via _AirTunesClock_ReadSnapshot.
+	uint32_t volatile					generation;			// Bumped on each update. Current snapshot is snapshots[ generation & 1 ].
+	uint64_t							frequency;			// UpTicks per second.
+	int32_t								lastOffset;			// Last time offset (nanoseconds).
+	int32_t								lastAdjustTime;		// Time at last adjustment (seconds).
+	Fixed64								frequencyOffset;	// Frequency offset (nanoseconds per second).
+	pthread_mutex_t						lock;				// Serializes updates. Never taken by readers.
+	pthread_mutex_t *					lockPtr;
 };
 
-
 //===========================================================================================================================
 //	AirTunesClock_Create
 //===========================================================================================================================
@@ -128,39 +136,26 @@ OSStatus	AirTunesClock_Create( AirTunesClockRef *outRef )
 	obj = (AirTunesClockRef) calloc( 1, sizeof( *obj ) );
 	require_action( obj, exit, err = kNoMemoryErr );
 	
-	obj->epochTime.secs = 0;
-	obj->epochTime.frac = 0;
-	
-	obj->upTime.secs = 0;
-	obj->upTime.frac = 0;
-	
-	obj->lastTime.secs = 0;
-	obj->lastTime.frac = 0;
-	
 	obj->frequency = UpTicksPerSecond();
-	obj->scale = UINT64_C( 0xFFFFFFFFFFFFFFFF ) / obj->frequency;
 	
-	obj->lastCount		= 0;
-	obj->adjustment		= 0;
+	obj->snapshots[ 0 ].ticks				= UpTicks();
+	obj->snapshots[ 0 ].time.secs			= 0;
+	obj->snapshots[ 0 ].time.frac			= 0;
+	obj->snapshots[ 0 ].slewScale			= UINT64_C( 0xFFFFFFFFFFFFFFFF ) / obj->frequency;
+	obj->snapshots[ 0 ].slewEndTicks		= obj->snapshots[ 0 ].ticks;
+	obj->snapshots[ 0 ].slewEndTime.secs	= 0;
+	obj->snapshots[ 0 ].slewEndTime.frac	= 0;
+	obj->snapshots[ 0 ].scale				= obj->snapshots[ 0 ].slewScale;
+	obj->generation							= 0;
+	
 	obj->lastOffset		= 0;
 	obj->lastAdjustTime	= 0;
-	
-	Fixed64_Clear( obj->offset );
 	Fixed64_Clear( obj->frequencyOffset );
-	Fixed64_Clear( obj->tickAdjust );
-	
-	obj->second = 1;
 	
 	err = pthread_mutex_init( &obj->lock, NULL );
 	require_noerr( err, exit );
 	obj->lockPtr = &obj->lock;
 	
-	// Signal to Terminate the thread.
-	obj->running = true;
-	err = pthread_create( &obj->thread, NULL, _AirTunesClock_Thread, obj );
-	require_noerr( err, exit );
-	obj->threadPtr = &obj->thread;
-
 	*outRef = obj;
 	obj = NULL;
 	err = kNoErr;
@@ -183,14 +178,6 @@ OSStatus	AirTunesClock_Finalize( AirTunesClockRef inClock )
 
 	if( inClock )
 	{
-		inClock->running = false;
-		if( inClock->threadPtr )
-		{
-			err = pthread_join( inClock->thread, NULL );
-			check_noerr( err );
-			inClock->threadPtr = NULL;
-		}
-		
 		if( inClock->lockPtr )
 		{
 			err = pthread_mutex_destroy( inClock->lockPtr );
@@ -204,61 +191,67 @@ OSStatus	AirTunesClock_Finalize( AirTunesClockRef inClock )
 
 //===========================================================================================================================
 //	AirTunesClock_Adjust
+//
+//	The PLL only runs here, when a new offset is measured. Each update rebases the snapshot at the current ticks so time
+//	stays continuous, then slews out the phase error at 1/2^PLLShift of it per second for 2^PLLShift seconds on top of
+//	the frequency correction. After that only the frequency correction applies until the next adjustment.
+//
+//	The PLL math is done first, before the current ticks are read, so only the rebase happens between reading them and
+//	publishing the new snapshot. Readers never wait for an update in progress (see _AirTunesClock_ReadSnapshot).
 //===========================================================================================================================
 
 Boolean	AirTunesClock_Adjust( AirTunesClockRef inClock, int64_t inOffsetNanoseconds, Boolean inReset )
 {
+	AirTunesClockSnapshot		snapshot;
+	AirTunesTime				now;
+	AirTunesTime				step;
+	Boolean						stepBack;
+	uint64_t					slewScale, scale, slewTicks;
+	AirTunesTime				slewAt;
+	
+	pthread_mutex_lock( inClock->lockPtr );
+	
+	step.secs	= 0;
+	step.frac	= 0;
+	stepBack	= false;
+	slewScale	= 0;
+	scale		= 0;
+	slewTicks	= 0;
+	slewAt		= step;
 	if( inReset || ( ( inOffsetNanoseconds < -100000000 ) || ( inOffsetNanoseconds > 100000000 ) ) )
 	{
-		AirTunesTime		at;
-		uint64_t			offset;
-		
-		pthread_mutex_lock( inClock->lockPtr );
-		if( inOffsetNanoseconds < 0 )
-		{
-			offset  = (uint64_t) -inOffsetNanoseconds;
-			at.secs = (int32_t)( offset / 1000000000 );
-			at.frac = ( offset % 1000000000 ) * ( UINT64_C( 0xFFFFFFFFFFFFFFFF ) / 1000000000 );
-			AirTunesTime_Sub( &inClock->epochTime, &at );
-		}
-		else
-		{
-			offset  = (uint64_t) inOffsetNanoseconds;
-			at.secs = (int32_t)( offset / 1000000000 );
-			at.frac = ( offset % 1000000000 ) * ( UINT64_C( 0xFFFFFFFFFFFFFFFF ) / 1000000000 );
-			AirTunesTime_Add( &inClock->epochTime, &at );
-		}
-		pthread_mutex_unlock( inClock->lockPtr );
+		uint64_t		offset;
 		
-		_AirTunesClock_Tick( inClock );
+		stepBack	= ( inOffsetNanoseconds < 0 );
+		offset		= stepBack ? (uint64_t) -inOffsetNanoseconds : (uint64_t) inOffsetNanoseconds;
+		step.secs	= (int32_t)( offset / 1000000000 );
+		step.frac	= ( offset % 1000000000 ) * ( UINT64_C( 0xFFFFFFFFFFFFFFFF ) / 1000000000 );
 		inReset = true;
 	}
 	else
 	{
-		int32_t		offset;
-		int32_t		mtemp;
-		Fixed64		ftemp;
-		
-		pthread_mutex_lock( inClock->lockPtr );
+		int32_t				offset;
+		int32_t				mtemp;
+		Fixed64				ftemp;
 		
 		// Use a phase-lock loop (PLL) to update the time and frequency offset estimates.
 		
+		AirTunesClock_GetSynchronizedTime( inClock, &now );
 		offset = (int32_t) inOffsetNanoseconds;
 		if(      offset >  kAirTunesClock_MaxPhase )	inClock->lastOffset = kAirTunesClock_MaxPhase;
 		else if( offset < -kAirTunesClock_MaxPhase )	inClock->lastOffset = -kAirTunesClock_MaxPhase;
 		else											inClock->lastOffset = offset;
-		Fixed64_SetInteger( inClock->offset, inClock->lastOffset );
 		
 		if( inClock->lastAdjustTime == 0 )
 		{
-			inClock->lastAdjustTime = inClock->second;
+			inClock->lastAdjustTime = now.secs;
 		}
-		mtemp = inClock->second - inClock->lastAdjustTime;
+		mtemp = now.secs - inClock->lastAdjustTime;
 		Fixed64_SetInteger( ftemp, inClock->lastOffset );
 		Fixed64_RightShift( ftemp, ( kAirTunesClock_PLLShift + 2 ) << 1 );
 		Fixed64_Multiply( ftemp, mtemp );
 		Fixed64_Add( inClock->frequencyOffset, ftemp );
-		inClock->lastAdjustTime = inClock->second;
+		inClock->lastAdjustTime = now.secs;
 		if( Fixed64_GetInteger( inClock->frequencyOffset ) > kAirTunesClock_MaxFrequency )
 		{
 			Fixed64_SetInteger( inClock->frequencyOffset, kAirTunesClock_MaxFrequency );
@@ -268,8 +261,42 @@ Boolean	AirTunesClock_Adjust( AirTunesClockRef inClock, int64_t inOffsetNanoseco
 			Fixed64_SetInteger( inClock->frequencyOffset, -kAirTunesClock_MaxFrequency );
 		}
 		
-		pthread_mutex_unlock( inClock->lockPtr );
+		// Slew the phase error out over the next 2^PLLShift seconds, then run at the corrected frequency.
+		
+		Fixed64_SetInteger( ftemp, inClock->lastOffset );
+		Fixed64_RightShift( ftemp, kAirTunesClock_PLLShift );
+		Fixed64_Add( ftemp, inClock->frequencyOffset );
+		slewScale	= _AirTunesClock_ScaleForAdjustment( inClock, ftemp );
+		scale		= _AirTunesClock_ScaleForAdjustment( inClock, inClock->frequencyOffset );
+		slewTicks	= inClock->frequency << kAirTunesClock_PLLShift;
+		_AirTunesClock_ScaleTicks( slewTicks, slewScale, &slewAt );
+	}
+	
+	_AirTunesClock_RebaseSnapshot( inClock, &snapshot );
+	if( inReset )
+	{
+		if( stepBack )
+		{
+			AirTunesTime_Sub( &snapshot.time, &step );
+			AirTunesTime_Sub( &snapshot.slewEndTime, &step );
+		}
+		else
+		{
+			AirTunesTime_Add( &snapshot.time, &step );
+			AirTunesTime_Add( &snapshot.slewEndTime, &step );
+		}
 	}
+	else
+	{
+		snapshot.slewScale		= slewScale;
+		snapshot.scale			= scale;
+		snapshot.slewEndTicks	= snapshot.ticks + slewTicks;
+		snapshot.slewEndTime	= snapshot.time;
+		AirTunesTime_Add( &snapshot.slewEndTime, &slewAt );
+	}
+	_AirTunesClock_PublishSnapshot( inClock, &snapshot );
+	
+	pthread_mutex_unlock( inClock->lockPtr );
 	return( inReset );
 }
 
@@ -291,11 +318,11 @@ uint64_t	AirTunesClock_GetSynchronizedNTPTime( AirTunesClockRef inClock )
 
 void	AirTunesClock_GetSynchronizedTime( AirTunesClockRef inClock, AirTunesTime *outTime )
 {
-	pthread_mutex_lock( inClock->lockPtr );
-		*outTime = inClock->upTime;
-		AirTunesTime_AddFrac( outTime, inClock->scale * ( UpTicks32() - inClock->lastCount ) );
-		AirTunesTime_Add( outTime, &inClock->epochTime );
-	pthread_mutex_unlock( inClock->lockPtr );
+	AirTunesClockSnapshot		snapshot;
+	uint64_t					nowTicks;
+	
+	_AirTunesClock_ReadSnapshot( inClock, &snapshot, &nowTicks );
+	_AirTunesClock_TimeAtTicks( &snapshot, nowTicks, outTime );
 }
 
 //===========================================================================================================================
@@ -304,29 +331,10 @@ void	AirTunesClock_GetSynchronizedTime( AirTunesClockRef inClock, AirTunesTime *
 
 void	AirTunesClock_GetSynchronizedTimeNearUpTicks( AirTunesClockRef inClock, AirTunesTime *outTime, uint64_t inTicks )
 {
-	uint64_t			nowTicks;
-	uint32_t			nowTicks32;
-	uint64_t			deltaTicks;
-	AirTunesTime		deltaTime;
-	uint64_t			scale;
-	Boolean				future;
+	AirTunesClockSnapshot		snapshot;
 	
-	pthread_mutex_lock( inClock->lockPtr );
-		nowTicks	= UpTicks();
-		nowTicks32	= ( (uint32_t)( nowTicks & UINT32_C( 0xFFFFFFFF ) ) );
-		future		= ( inTicks > nowTicks );
-		deltaTicks	= future ? ( inTicks - nowTicks ) : ( nowTicks - inTicks );
-		
-		*outTime = inClock->upTime;
-		AirTunesTime_AddFrac( outTime, inClock->scale * ( nowTicks32 - inClock->lastCount ) );
-		AirTunesTime_Add( outTime, &inClock->epochTime );
-		scale = inClock->scale;
-	pthread_mutex_unlock( inClock->lockPtr );
-	
-	deltaTime.secs = (int32_t)( deltaTicks / inClock->frequency ); // Note: unscaled, but delta expected to be < 1 sec.
-	deltaTime.frac = ( deltaTicks % inClock->frequency ) * scale;
-	if( future )	AirTunesTime_Add( outTime, &deltaTime );
-	else			AirTunesTime_Sub( outTime, &deltaTime );
+	_AirTunesClock_ReadSnapshot( inClock, &snapshot, NULL );
+	_AirTunesClock_TimeAtTicks( &snapshot, inTicks, outTime );
 }
 
 //===========================================================================================================================
@@ -361,80 +369,408 @@ uint64_t	AirTunesClock_GetUpTicksNearSynchronizedNTPTimeMid32( AirTunesClockRef
 }
 
 //===========================================================================================================================
-//	_AirTunesClock_Tick
+//	_AirTunesClock_RebaseSnapshot
+//
+//	Returns a copy of the current snapshot rebased at the current ticks. Assumes the lock is held.
 //===========================================================================================================================
 
-DEBUG_STATIC void	_AirTunesClock_Tick( AirTunesClockRef inClock )
+DEBUG_STATIC void	_AirTunesClock_RebaseSnapshot( AirTunesClockRef inClock, AirTunesClockSnapshot *outSnapshot )
 {
-	uint32_t			count;
-	uint32_t			delta;
+	uint64_t			nowTicks;
 	AirTunesTime		at;
 	
-	pthread_mutex_lock( inClock->lockPtr );
-	
-	// Update the current uptime from the delta between now and the last update.
-	
-	count = UpTicks32();
-	delta = count - inClock->lastCount;
-	inClock->lastCount = count;
-	AirTunesTime_AddFrac( &inClock->upTime, inClock->scale * delta );
+	*outSnapshot = inClock->snapshots[ inClock->generation & 1 ];
+	nowTicks = UpTicks();
+	_AirTunesClock_TimeAtTicks( outSnapshot, nowTicks, &at );
+	outSnapshot->time = at;
+	if( nowTicks >= outSnapshot->slewEndTicks )
+	{
+		outSnapshot->slewScale		= outSnapshot->scale;
+		outSnapshot->slewEndTicks	= nowTicks;
+		outSnapshot->slewEndTime	= outSnapshot->time;
+	}
+	outSnapshot->ticks = nowTicks;
+}
+
+//===========================================================================================================================
+//	_AirTunesClock_PublishSnapshot
+//
+//	Writes the new snapshot to the slot readers aren't using then makes it current. Assumes the lock is held.
+//===========================================================================================================================
+
+DEBUG_STATIC void	_AirTunesClock_PublishSnapshot( AirTunesClockRef inClock, const AirTunesClockSnapshot *inSnapshot )
+{
+	uint32_t const		generation = inClock->generation + 1;
 	
-	// Perform NTP adjustments each second.
+	inClock->snapshots[ generation & 1 ] = *inSnapshot;
+	atomic_write_barrier();
+	inClock->generation = generation;
+}
+
+//===========================================================================================================================
+//	_AirTunesClock_ReadSnapshot
+//
+//	Copies the current snapshot without locking. The writer only writes the other slot so readers never wait for an
+//	update in progress, which matters when a real-time reader preempts the writer on a single core. A reader only retries
+//	if an update was published during its copy, since the next update after that reuses the slot it was copying. If
+//	requested, the current ticks are read inside the same window so ticks read after a newer snapshot is published are
+//	always used with that snapshot.
+//===========================================================================================================================
+
+DEBUG_STATIC void	_AirTunesClock_ReadSnapshot( AirTunesClockRef inClock, AirTunesClockSnapshot *outSnapshot, uint64_t *outNowTicks )
+{
+	uint32_t		generation;
 	
-	at = inClock->upTime;
-	AirTunesTime_Add( &at, &inClock->epochTime );
-	if( at.secs > inClock->lastTime.secs )
+	for( ;; )
 	{
-		Fixed64		ftemp;
+		generation = inClock->generation;
+		atomic_read_barrier();
 		
-		ftemp = inClock->offset;
-		Fixed64_RightShift( ftemp, kAirTunesClock_PLLShift );
-		inClock->tickAdjust = ftemp;
-		Fixed64_Sub( inClock->offset, ftemp );
-		Fixed64_Add( inClock->tickAdjust, inClock->frequencyOffset );
-		
-		inClock->adjustment = inClock->tickAdjust;
-	
-		// Recalculate the scaling factor. We want the number of 1/2^64 fractions of a second per period of
-		// the hardware counter, taking into account the adjustment factor which the NTP PLL processing 
-		// provides us with. The adjustment is nanoseconds per second with 32 bit binary fraction and we want 
-		// 64 bit binary fraction of second:
-		//
-		//		x = a * 2^32 / 10^9 = a * 4.294967296
-		//
-		// The range of adjustment is +/- 5000PPM so inside a 64 bit integer we can only multiply by about 
-		// 850 without overflowing, that leaves no suitably precise fractions for multiply before divide.
-		// Divide before multiply with a fraction of 2199/512 results in a systematic undercompensation of 
-		// 10PPM. On a 5000 PPM adjustment this is a 0.05PPM error. This is acceptable.
-	
-		uint64_t		scale;
+		*outSnapshot = inClock->snapshots[ generation & 1 ];
+		if( outNowTicks ) *outNowTicks = UpTicks();
 		
-		scale  = UINT64_C( 1 ) << 63;
-		scale += ( inClock->adjustment / 1024 ) * 2199;
-		scale /= inClock->frequency;
-		inClock->scale = scale * 2;
+		atomic_read_barrier();
+		if( inClock->generation == generation ) break;
 	}
+}
+
+//===========================================================================================================================
+//	_AirTunesClock_TimeAtTicks
+//===========================================================================================================================
+
+DEBUG_STATIC void	_AirTunesClock_TimeAtTicks( const AirTunesClockSnapshot *inSnapshot, uint64_t inTicks, AirTunesTime *outTime )
+{
+	AirTunesTime		delta;
 	
-	inClock->second = at.secs;
-	inClock->lastTime = at;
+	if( inTicks >= inSnapshot->slewEndTicks )
+	{
+		_AirTunesClock_ScaleTicks( inTicks - inSnapshot->slewEndTicks, inSnapshot->scale, &delta );
+		*outTime = inSnapshot->slewEndTime;
+		AirTunesTime_Add( outTime, &delta );
+	}
+	else if( inTicks >= inSnapshot->ticks )
+	{
+		_AirTunesClock_ScaleTicks( inTicks - inSnapshot->ticks, inSnapshot->slewScale, &delta );
+		*outTime = inSnapshot->time;
+		AirTunesTime_Add( outTime, &delta );
+	}
+	else
+	{
+		_AirTunesClock_ScaleTicks( inSnapshot->ticks - inTicks, inSnapshot->slewScale, &delta );
+		*outTime = inSnapshot->time;
+		AirTunesTime_Sub( outTime, &delta );
+	}
+}
+
+//===========================================================================================================================
+//	_AirTunesClock_ScaleTicks
+//
+//	Converts ticks to time with a full 64x64->128 bit multiply so any gap between updates is handled exactly.
+//===========================================================================================================================
+
+DEBUG_STATIC void	_AirTunesClock_ScaleTicks( uint64_t inTicks, uint64_t inScale, AirTunesTime *outTime )
+{
+#if( TARGET_HAS_NATIVE_INT128 )
+	uint128_t		x;
+	
+	x = ( (uint128_t) inTicks ) * inScale;
+	outTime->secs = (int32_t)( x >> 64 );
+	outTime->frac = (uint64_t) x;
+#else
+	uint64_t		lolo, lohi, hilo, mid;
+	
+	lolo = ( inTicks & UINT32_C( 0xFFFFFFFF ) ) * ( inScale & UINT32_C( 0xFFFFFFFF ) );
+	lohi = ( inTicks & UINT32_C( 0xFFFFFFFF ) ) * ( inScale >> 32 );
+	hilo = ( inTicks >> 32 ) * ( inScale & UINT32_C( 0xFFFFFFFF ) );
+	mid  = ( lolo >> 32 ) + ( lohi & UINT32_C( 0xFFFFFFFF ) ) + ( hilo & UINT32_C( 0xFFFFFFFF ) );
+	outTime->secs = (int32_t)( ( ( inTicks >> 32 ) * ( inScale >> 32 ) ) + ( lohi >> 32 ) + ( hilo >> 32 ) + ( mid >> 32 ) );
+	outTime->frac = ( mid << 32 ) | ( lolo & UINT32_C( 0xFFFFFFFF ) );
+#endif
+}
+
+//===========================================================================================================================
+//	_AirTunesClock_ScaleForAdjustment
+//
+//	Calculates the scaling factor. We want the number of 1/2^64 fractions of a second per period of the hardware counter,
+//	taking into account the adjustment factor which the NTP PLL processing provides us with. The adjustment is
+//	nanoseconds per second with 32 bit binary fraction and we want 64 bit binary fraction of second:
+//
+//		x = a * 2^32 / 10^9 = a * 4.294967296
+//
+//	The range of adjustment is +/- 5000PPM so inside a 64 bit integer we can only multiply by about 850 without
+//	overflowing, that leaves no suitably precise fractions for multiply before divide. Divide before multiply with a
+//	fraction of 2199/512 results in a systematic undercompensation of 10PPM. On a 5000 PPM adjustment this is a 0.05PPM
+//	error. This is acceptable.
+//===========================================================================================================================
+
+DEBUG_STATIC uint64_t	_AirTunesClock_ScaleForAdjustment( AirTunesClockRef inClock, Fixed64 inAdjustment )
+{
+	uint64_t		scale;
 	
-	pthread_mutex_unlock( inClock->lockPtr );
+	scale  = UINT64_C( 1 ) << 63;
+	scale += ( inAdjustment / 1024 ) * 2199;
+	scale /= inClock->frequency;
+	return( scale * 2 );
 }
 
+#if 0
+#pragma mark -
+#endif
+
+#if( !EXCLUDE_UNIT_TESTS )
 //===========================================================================================================================
-//	_AirTunesClock_Thread
+//	AirTunesClockTest
+//
+//	Checks the PLL slews a phase error out over 2^PLLShift seconds and steps large offsets. Then runs reader threads
+//	while the clock is adjusted every few milliseconds. Each reader checks synchronized time never goes backwards and
+//	never advances more than the slew rate allows relative to UpTicks. Finally measures the read cost with 1, 2, and 4
+//	concurrent readers while the clock is being adjusted.
 //===========================================================================================================================
 
-DEBUG_STATIC void *	_AirTunesClock_Thread( void *inArg )
+#define kAirTunesClockTestMaxReaders		4
+
+typedef struct
 {
-	AirTunesClockRef const me = (AirTunesClockRef) inArg;
+	AirTunesClockRef		clock;
+	uint64_t				endTicks;		// Read until UpTicks reaches this. 0 to read "reads" times without checking.
+	uint64_t				reads;			// Number of reads done.
+	uint64_t				readTicks;		// Ticks spent reading.
+	uint64_t				backwards;		// Reads earlier than the previous read.
+	uint64_t				jumps;			// Reads that moved more than the slew rate allows.
+	int64_t					maxErrorNs;		// Largest difference between synchronized and UpTicks elapsed time.
+	Boolean volatile		done;			// Set by the reader thread when it's finished.
+	
+}	AirTunesClockTestReader;
+
+static void *	_AirTunesClockTestReaderThread( void *inArg );
+static OSStatus	_AirTunesClockTestRunReaders( AirTunesClockRef inClock, AirTunesClockTestReader *inReaders, int inCount );
+static int64_t	_AirTunesClockTestNanoseconds( const AirTunesTime *inTime );
+static int64_t	_AirTunesClockTestDiffNanoseconds( const AirTunesTime *inA, const AirTunesTime *inB );
+
+OSStatus	AirTunesClockTest( int inPrint, int inPerf )
+{
+	uint64_t const				ticksPerSec = UpTicksPerSecond();
+	OSStatus					err;
+	AirTunesClockRef			clock = NULL;
+	AirTunesClockTestReader		readers[ kAirTunesClockTestMaxReaders ];
+	AirTunesTime				t1, t2;
+	uint64_t					ticks;
+	int64_t						ns;
+	int							i, n;
+	
+	err = AirTunesClock_Create( &clock );
+	require_noerr( err, exit );
+	require_action( AirTunesClock_Adjust( clock, 0, true ), exit, err = kResponseErr );
+	
+	// A small offset slews at 1/16 of the offset per second for 16 seconds then runs at the nominal rate.
+	
+	require_action( !AirTunesClock_Adjust( clock, 8000000, false ), exit, err = kResponseErr );
+	ticks = UpTicks();
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t1, ticks );
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t2, ticks + ticksPerSec );
+	ns = _AirTunesClockTestDiffNanoseconds( &t2, &t1 ) - 1000000000;
+	if( inPrint ) fprintf( stderr, "\tslew rate: %lld ns/s\n", (long long) ns );
+	require_action( ( ns > 499000 ) && ( ns < 501000 ), exit, err = kResponseErr );
+	
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t1, ticks + ( 16 * ticksPerSec ) );
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t2, ticks + ( 17 * ticksPerSec ) );
+	ns = _AirTunesClockTestDiffNanoseconds( &t2, &t1 ) - 1000000000;
+	require_action( ( ns > -1000 ) && ( ns < 1000 ), exit, err = kResponseErr );
+	
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t1, ticks );
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t2, ticks + ( 20 * ticksPerSec ) );
+	ns = _AirTunesClockTestDiffNanoseconds( &t2, &t1 ) - INT64_C( 20000000000 );
+	if( inPrint ) fprintf( stderr, "\tslewed: %lld ns of 8000000 ns\n", (long long) ns );
+	require_action( ( ns > 7990000 ) && ( ns < 8010000 ), exit, err = kResponseErr );
+	
+	// A large offset steps the clock immediately.
+	
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t1, ticks );
+	require_action( AirTunesClock_Adjust( clock, -200000000, false ), exit, err = kResponseErr );
+	AirTunesClock_GetSynchronizedTimeNearUpTicks( clock, &t2, ticks );
+	ns = _AirTunesClockTestDiffNanoseconds( &t2, &t1 );
+	require_action( ( ns > -200001000 ) && ( ns < -199999000 ), exit, err = kResponseErr );
+	
+	// Reads must not wait for a writer that's stalled in the middle of an update (e.g. preempted by the reader).
+	
+	pthread_mutex_lock( clock->lockPtr );
+	AirTunesClock_GetSynchronizedTime( clock, &t1 );
+	AirTunesClock_GetSynchronizedTime( clock, &t2 );
+	pthread_mutex_unlock( clock->lockPtr );
+	require_action( _AirTunesClockTestDiffNanoseconds( &t2, &t1 ) >= 0, exit, err = kResponseErr );
+	
+	// Readers must see monotonic, continuous time while the clock is adjusted.
 	
-	pthread_setname_np_compat( "AirPlayClock" );
+	memset( readers, 0, sizeof( readers ) );
+	for( i = 0; i < 2; ++i )
+	{
+		readers[ i ].clock		= clock;
+		readers[ i ].endTicks	= UpTicks() + ( ( inPerf ? 10 : 1 ) * ticksPerSec );
+	}
+	err = _AirTunesClockTestRunReaders( clock, readers, 2 );
+	require_noerr( err, exit );
+	for( i = 0; i < 2; ++i )
+	{
+		if( inPrint )
+		{
+			fprintf( stderr, "\treader %d: %llu reads, %llu backwards, %llu jumps, %lld ns max error\n", i, 
+				(unsigned long long) readers[ i ].reads, (unsigned long long) readers[ i ].backwards, 
+				(unsigned long long) readers[ i ].jumps, (long long) readers[ i ].maxErrorNs );
+		}
+		require_action( readers[ i ].reads > 0, exit, err = kResponseErr );
+		require_action( readers[ i ].backwards == 0, exit, err = kResponseErr );
+		require_action( readers[ i ].jumps == 0, exit, err = kResponseErr );
+	}
+	
+	// Read cost with concurrent readers.
 	
-	while( me->running )
+	for( n = 1; n <= kAirTunesClockTestMaxReaders; n *= 2 )
 	{
-		_AirTunesClock_Tick( me );
-		usleep( 10000 );
+		uint64_t		reads		= 0;
+		uint64_t		readTicks	= 0;
+		
+		memset( readers, 0, sizeof( readers ) );
+		for( i = 0; i < n; ++i )
+		{
+			readers[ i ].clock = clock;
+			readers[ i ].reads = inPerf ? 10000000 : 1000000;
+		}
+		ticks = UpTicks();
+		err = _AirTunesClockTestRunReaders( clock, readers, n );
+		require_noerr( err, exit );
+		ticks = UpTicks() - ticks;
+		for( i = 0; i < n; ++i )
+		{
+			reads		+= readers[ i ].reads;
+			readTicks	+= readers[ i ].readTicks;
+		}
+		if( inPrint )
+		{
+			fprintf( stderr, "\t%d reader%s: %.1f ns/read, %.1f M reads/sec total\n", n, ( n == 1 ) ? "" : "s", 
+				( 1000000000.0 * readTicks ) / ( reads * (double) ticksPerSec ), 
+				( reads * (double) ticksPerSec ) / ( 1000000.0 * ticks ) );
+		}
 	}
+	err = kNoErr;
+	
+exit:
+	if( clock ) AirTunesClock_Finalize( clock );
+	printf( "AirTunesClockTest: %s\n", !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirTunesClockTestRunReaders
+//
+//	Runs the readers on their own threads and adjusts the clock by PLL-sized offsets every 2 ms until they finish.
+//===========================================================================================================================
+
+static OSStatus	_AirTunesClockTestRunReaders( AirTunesClockRef inClock, AirTunesClockTestReader *inReaders, int inCount )
+{
+	static const int32_t		kOffsets[] = { 5000000, -3000000, 99000000, -99000000, 250000, -50000000, 20000000, 0 };
+	OSStatus					err;
+	pthread_t					threads[ kAirTunesClockTestMaxReaders ];
+	int							started, i;
+	size_t						adjusts;
+	
+	for( started = 0; started < inCount; ++started )
+	{
+		err = pthread_create( &threads[ started ], NULL, _AirTunesClockTestReaderThread, &inReaders[ started ] );
+		require_noerr( err, exit );
+	}
+	for( adjusts = 0; ; ++adjusts )
+	{
+		for( i = 0; i < inCount; ++i )
+		{
+			if( !inReaders[ i ].done ) break;
+		}
+		if( i == inCount ) break;
+		
+		require_action( !AirTunesClock_Adjust( inClock, kOffsets[ adjusts % countof( kOffsets ) ], false ), exit, 
+			err = kResponseErr );
+		usleep( 2000 );
+	}
+	err = kNoErr;
+	
+exit:
+	for( i = 0; i < started; ++i ) pthread_join( threads[ i ], NULL );
+	return( err );
+}
+
+//===========================================================================================================================
+//	_AirTunesClockTestReaderThread
+//===========================================================================================================================
+
+static void *	_AirTunesClockTestReaderThread( void *inArg )
+{
+	AirTunesClockTestReader * const		reader = (AirTunesClockTestReader *) inArg;
+	uint64_t							startTicks, beforeTicks, afterTicks, prevBeforeTicks, prevAfterTicks;
+	uint64_t							i;
+	AirTunesTime						t, prev;
+	int64_t								ns, minNs, maxNs, errorNs;
+	
+	startTicks = UpTicks();
+	if( reader->endTicks == 0 )
+	{
+		for( i = 0; i < reader->reads; ++i )
+		{
+			AirTunesClock_GetSynchronizedTimeNearUpTicks( reader->clock, &t, startTicks + i );
+		}
+	}
+	else
+	{
+		prevBeforeTicks = UpTicks();
+		AirTunesClock_GetSynchronizedTime( reader->clock, &prev );
+		prevAfterTicks = UpTicks();
+		while( prevAfterTicks < reader->endTicks )
+		{
+			beforeTicks = UpTicks();
+			AirTunesClock_GetSynchronizedTime( reader->clock, &t );
+			afterTicks = UpTicks();
+			if( ( t.secs == prev.secs ) ? ( t.frac < prev.frac ) : ( t.secs < prev.secs ) ) ++reader->backwards;
+			
+			// Synchronized time can only run faster or slower than UpTicks by the slew rate (< 1/64).
+			
+			ns		= _AirTunesClockTestDiffNanoseconds( &t, &prev );
+			minNs	= (int64_t) UpTicksToNanoseconds( beforeTicks - prevAfterTicks );
+			maxNs	= (int64_t) UpTicksToNanoseconds( afterTicks - prevBeforeTicks );
+			if(      ns > maxNs )	errorNs = ns - maxNs;
+			else if( ns < minNs )	errorNs = minNs - ns;
+			else					errorNs = 0;
+			if( errorNs > reader->maxErrorNs ) reader->maxErrorNs = errorNs;
+			if( errorNs > ( ( maxNs / 64 ) + 1000 ) ) ++reader->jumps;
+			
+			prev			= t;
+			prevBeforeTicks	= beforeTicks;
+			prevAfterTicks	= afterTicks;
+			++reader->reads;
+		}
+	}
+	reader->readTicks = UpTicks() - startTicks;
+	reader->done = true;
 	return( NULL );
 }
+
+//===========================================================================================================================
+//	_AirTunesClockTestNanoseconds
+//===========================================================================================================================
+
+static int64_t	_AirTunesClockTestNanoseconds( const AirTunesTime *inTime )
+{
+	return( ( ( (int64_t) inTime->secs ) * 1000000000 ) + 
+		(int64_t)( ( UINT64_C( 1000000000 ) * ( (uint32_t)( inTime->frac >> 32 ) ) ) >> 32 ) );
+}
+
+//===========================================================================================================================
+//	_AirTunesClockTestDiffNanoseconds
+//===========================================================================================================================
+
+static int64_t	_AirTunesClockTestDiffNanoseconds( const AirTunesTime *inA, const AirTunesTime *inB )
+{
+	AirTunesTime		delta;
+	
+	delta = *inA;
+	AirTunesTime_Sub( &delta, inB );
+	return( _AirTunesClockTestNanoseconds( &delta ) );
+}
+#endif // !EXCLUDE_UNIT_TESTS
@@ -141,6 +141,10 @@ uint64_t	AirTunesClock_GetUpTicksNearSynchronizedNTPTime( AirTunesClockRef inClo
 
 uint64_t	AirTunesClock_GetUpTicksNearSynchronizedNTPTimeMid32( AirTunesClockRef inClock, uint32_t inNTPMid32 );
 
+#if( !EXCLUDE_UNIT_TESTS )
+OSStatus	AirTunesClockTest( int inPrint, int inPerf );
+#endif
+
 #if 0
 #pragma mark == Utils ==
 #endif
@@ -104,6 +104,7 @@ static void		cmd_moved_to_cuutil ( void );
 
 static void		cmd_show( void );
 static void		cmd_test( void );
+static void		cmd_trace( void );
 
 //===========================================================================================================================
 //	Globals
@@ -219,6 +220,7 @@ static CLIOption		kGlobalOptions[] =
 	CLI_COMMAND( "mfi",						cmd_mfi,					NULL,					"Tests the MFi auth IC.", NULL ), 
 	CLI_COMMAND( "show",					cmd_show,					kShowOptions,			"Shows state.", NULL ), 
 	CLI_COMMAND_EX( "test",					cmd_test,					kTestOptions, kCLIOptionFlags_NotCommon, "Tests network performance.", NULL ), 
+	CLI_COMMAND( "trace",					cmd_trace,					NULL,					"Starts, stops, clears, or dumps the real-time trace (start|stop|clear|dump [path]).", NULL ), 
 	CLI_COMMAND_VERSION( kAirPlayMarketingVersionStr, kAirPlaySourceVersionStr ),
 	
 	CLI_OPTION_END()
@@ -721,6 +723,47 @@ exit:
 	if( err ) ErrQuit( 1, "error: %#m\n", err );
 }
 
+//===========================================================================================================================
+//	cmd_trace
+//===========================================================================================================================
+
+static void	cmd_trace( void )
+{
+	OSStatus			err;
+	const char *		action;
+	const char *		path = NULL;
+	char *				absPath = NULL;
+	char				cwd[ PATH_MAX + 1 ];
+	
+	if( gArgI >= gArgC ) ErrQuit( 1, "error: no trace command specified (start, stop, clear, or dump)\n" );
+	action = gArgV[ gArgI++ ];
+	if( strcmp( action, "dump" ) == 0 )
+	{
+		// The server writes the file so make relative paths relative to our working directory instead of the server's.
+		
+		path = ( gArgI < gArgC ) ? gArgV[ gArgI++ ] : "airplay-trace.json";
+		if( *path != '/' )
+		{
+			if( !getcwd( cwd, sizeof( cwd ) ) ) ErrQuit( 1, "error: couldn't get working directory\n" );
+			ASPrintF( &absPath, "%s/%s", cwd, path );
+			if( !absPath ) ErrQuit( 1, "error: no memory\n" );
+			path = absPath;
+		}
+	}
+	
+	err = DebugIPC_PerformF( NULL, NULL,
+		"{"
+			"%kO=%O"
+			"%kO=%s"
+			"%kO=%s" // Note: path is NULL except for dump, which excludes it.
+		"}", 
+		kDebugIPCKey_Command,	kDebugIPCOpCode_Trace, 
+		kDebugIPCKey_Value,		action, 
+		kDebugIPCKey_Path,		path );
+	FreeNullSafe( absPath );
+	if( err ) ErrQuit( EINVAL, "error: %#m\n", err );
+}
+
 #if 0
 #pragma mark -
 #endif
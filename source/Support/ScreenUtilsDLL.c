@@ -274,7 +274,10 @@ OSStatus
 		ScreenStreamCompletion_f	inCompletion, 
 		void *						inContext )
 {
-	return( me->processData_f ? 
-		me->processData_f( me, inData, inLen, inDisplayTicks, inOptions, inCompletion, inContext ) : 
-		kUnsupportedErr );
+	if( !me->processData_f )
+	{
+		if( inCompletion ) inCompletion( inContext );
+		return( kUnsupportedErr );
+	}
+	return( me->processData_f( me, inData, inLen, inDisplayTicks, inOptions, inCompletion, inContext ) );
 }